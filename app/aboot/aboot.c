@@ -44,6 +44,7 @@
 #include <lib/ptable.h>
 #include <dev/keys.h>
 #include <dev/fbcon.h>
+#include <dev/uart.h>
 #include <baseband.h>
 #include <target.h>
 #include <mmc.h>
@@ -59,6 +60,8 @@
 #include <boot_verifier.h>
 #include <image_verify.h>
 #include <decompress.h>
+#include <lib/lz4.h>
+#include <crc32.h>
 #include <platform/timer.h>
 #include <sys/types.h>
 #if USE_RPMB_FOR_DEVINFO
@@ -98,6 +101,9 @@
 
 #if WITH_LK2ND
 #include <lk2nd/init.h>
+#include <lk2nd/util/memcpy.h>
+#else
+#define lk2nd_memcpy memmove
 #endif
 #if WITH_LK2ND_DEVICE
 #include <lk2nd/device.h>
@@ -105,6 +111,16 @@
 #if WITH_LK2ND_BOOT
 #include <lk2nd/boot.h>
 #endif
+#if WITH_LK2ND_BOOTSTATS
+#include <lk2nd/bootstats.h>
+#endif
+#if WITH_LK2ND_SMP_WORKER
+#include <lk2nd/smp-worker.h>
+#endif
+#if WITH_LK2ND_HW_BDEV
+#include <lib/bio.h>
+#include <lk2nd/hw/bdev.h>
+#endif
 
 extern bool target_use_signed_kernel(void);
 extern void platform_uninit(void);
@@ -122,6 +138,16 @@ bool pwr_key_is_pressed = false;
 unsigned boot_into_recovery = 0;
 static bool is_systemd_present = false;
 static void publish_getvar_multislot_vars(void);
+
+/* Size of the download buffer at the scratch address */
+static unsigned aboot_download_size(void)
+{
+#if WITH_LK2ND_BOOT && LK2ND_DOWNLOAD_DYNAMIC
+	return lk2nd_layout_download_size();
+#else
+	return target_get_max_flash_size();
+#endif
+}
 /* fastboot command function pointer */
 typedef void (*fastboot_cmd_fn)(const char *, void *, unsigned);
 bool get_perm_attr_status(void);
@@ -370,6 +396,8 @@ struct getvar_partition_info part_type_known[] =
 
 char max_download_size[MAX_RSP_SIZE];
 char charger_screen_enabled[MAX_RSP_SIZE];
+char discard_enabled[MAX_RSP_SIZE];
+static bool use_discard;
 char sn_buf[13];
 char display_panel_buf[MAX_PANEL_BUF_SIZE];
 char panel_display_mode[MAX_RSP_SIZE];
@@ -1319,6 +1347,76 @@ void generate_atags(unsigned *ptr, const char *cmdline,
 }
 
 typedef void entry_func_ptr(unsigned, unsigned, unsigned *);
+
+/* Stop the platform and turn off the caches & MMU before leaving LK */
+static void boot_leave_lk(void)
+{
+	enter_critical_section();
+
+#if UART_DM_ASYNC_TX
+	/* The timer that drains the UART is stopped by platform_uninit() */
+	uart_flush_tx(0);
+#endif
+
+	platform_uninit();
+
+	/* Disabling the cache cleans all of it, including the batched ranges */
+	arch_cache_batch_discard();
+	arch_disable_cache(UCACHE);
+
+#if ARM_WITH_MMU
+	arch_disable_mmu();
+#endif
+}
+
+#if DISPLAY_INIT_ASYNC
+static event_t display_init_done;
+static bool display_init_pending;
+
+static int aboot_display_init_thread(void *arg)
+{
+	target_display_init(device.display_panel);
+	event_signal(&display_init_done, true);
+	return 0;
+}
+
+/*
+ * Panel bring-up spends hundreds of milliseconds in DSI command waits, which
+ * sleep instead of spinning (see delay_or_sleep()). Run it in its own thread
+ * so that lk2nd can scan the storage for something to boot in the meantime.
+ */
+static void aboot_display_init_async(void)
+{
+	thread_t *thr;
+
+	event_init(&display_init_done, false, 0);
+	thr = thread_create("display-init", aboot_display_init_thread, NULL,
+			    DEFAULT_PRIORITY, DEFAULT_STACK_SIZE);
+	if (!thr) {
+		target_display_init(device.display_panel);
+		return;
+	}
+
+	display_init_pending = true;
+	thread_resume(thr);
+}
+#endif
+
+/* Wait until the display (and the panel information) can be used */
+static void aboot_display_wait(void)
+{
+#if DISPLAY_INIT_ASYNC
+	if (!display_init_pending)
+		return;
+
+	event_wait(&display_init_done);
+	display_init_pending = false;
+#endif
+}
+#if DISPLAY_INIT_ASYNC && WITH_LK2ND
+LK2ND_INIT_DEFERRED(aboot_display_wait, LK2ND_INIT_NEED_MENU);
+#endif
+
 /**
  * @brief 启动Linux内核的主函数
  * 
@@ -1348,6 +1446,25 @@ void boot_linux(void *kernel, unsigned *tags,
 
 	// 将内核地址转换为物理地址并强制转换为函数指针
 	void (*entry)(unsigned, unsigned, unsigned *) = (entry_func_ptr *)(PA((addr_t)kernel));
+
+#if WITH_LK2ND_BOOTSTATS
+	// 记录到跳转内核为止的耗时，该阶段不会结束
+	lk2nd_bootstats_start("boot_linux");
+#endif
+#if WITH_LK2ND_SMP_WORKER
+	/* The spin table resets the CPU cores while updating the device tree */
+	lk2nd_smp_worker_park();
+#endif
+#if WITH_LK2ND_HW_BDEV
+	/* The SD card might still be initializing in the background */
+	lk2nd_bdev_wait();
+#endif
+#if LK2ND_FASTBOOT_EARLY
+	/* Disconnect the gadget brought up during boot if fastboot was not used */
+	fastboot_stop();
+#endif
+	/* The panel might still be initializing in the background */
+	aboot_display_wait();
 	
 	// 将tags地址转换为物理地址
 	uint32_t tags_phys = PA((addr_t)tags);
@@ -1443,6 +1560,10 @@ tags_done:
 	target_display_shutdown();
 #endif
 
+	/* Turned on for fastboot flashing, write back everything before leaving */
+	if (target_is_emmc_boot())
+		mmc_write_cache_enable(false);
+
 	// 执行目标平台相关的清理工作
 	target_uninit();
 	
@@ -1459,19 +1580,7 @@ tags_done:
 	dprintf(INFO, "booting linux @ %p, ramdisk @ %p (%d), tags/device tree @ %p\n",
 			entry, ramdisk, ramdisk_size, (void *)tags_phys);
 
-	// 进入临界区
-	enter_critical_section();
-
-	// 执行平台特定的清理工作
-	platform_uninit();
-
-	// 禁用缓存
-	arch_disable_cache(UCACHE);
-
-#if ARM_WITH_MMU
-	// 禁用MMU
-	arch_disable_mmu();
-#endif
+	boot_leave_lk();
 
 	// 设置启动时间戳
 	bs_set_timestamp(BS_KERNEL_ENTRY);
@@ -1557,16 +1666,26 @@ int getimage(void **image_buffer, uint32_t *imgsize,
 	return -1;
 }
 
-static void verify_signed_bootimg(uint32_t bootimg_addr, uint32_t bootimg_size)
+static uint32_t bootimg_auth_algo(void)
 {
-	int ret;
-
-#if !VERIFIED_BOOT
 #if IMAGE_VERIF_ALGO_SHA1
-	uint32_t auth_algo = CRYPTO_AUTH_ALG_SHA1;
+	return CRYPTO_AUTH_ALG_SHA1;
 #else
-	uint32_t auth_algo = CRYPTO_AUTH_ALG_SHA256;
+	return CRYPTO_AUTH_ALG_SHA256;
 #endif
+}
+
+/*
+ * digest: Digest of the image calculated while reading it (see
+ * read_bootimg_hashed()), or NULL to calculate it here.
+ */
+static void verify_signed_bootimg(uint32_t bootimg_addr, uint32_t bootimg_size,
+				  unsigned char *digest)
+{
+	int ret;
+
+#if !VERIFIED_BOOT
+	uint32_t auth_algo = bootimg_auth_algo();
 #endif
 
 	/* Assume device is rooted at this time. */
@@ -1589,10 +1708,15 @@ static void verify_signed_bootimg(uint32_t bootimg_addr, uint32_t bootimg_size)
 	}
 	boot_verify_print_state();
 #else
-	ret = image_verify((unsigned char *)bootimg_addr,
-					   (unsigned char *)(bootimg_addr + bootimg_size),
-					   bootimg_size,
-					   auth_algo);
+	if (digest)
+		ret = image_verify_digest(digest,
+					  (unsigned char *)(bootimg_addr + bootimg_size),
+					  auth_algo);
+	else
+		ret = image_verify((unsigned char *)bootimg_addr,
+						   (unsigned char *)(bootimg_addr + bootimg_size),
+						   bootimg_size,
+						   auth_algo);
 #endif
 	dprintf(INFO, "Authenticating boot image: done return value = %d\n", ret);
 
@@ -1759,3257 +1883,4868 @@ void get_recovery_dtbo_info(uint32_t *dtbo_size, void **dtbo_buf)
 	return;
 }
 
-/**
- * 从MMC存储设备启动Linux系统的主要函数
- * 该函数负责加载boot镜像、验证签名、解压内核、设置设备树并最终启动Linux内核
- */
-int boot_linux_from_mmc(void)
+/* Check if the boot image is signed, hashed or verified as a whole */
+static bool boot_img_needs_auth(void)
 {
-    // 定义boot镜像头部结构指针和相关变量
-    boot_img_hdr *hdr = (void *)buf;           // 指向缓冲区的boot镜像头指针
-    boot_img_hdr *uhdr;                        // 统一boot方法的头部指针
-    unsigned offset = 0;                       // 数据偏移量
-    int rcode;                                 // 返回码
-    unsigned long long ptn = 0;                // 分区偏移地址
-    int index = INVALID_PTN;                   // 分区索引
-
-    // 定义镜像处理相关变量
-    unsigned char *image_addr = 0;             // 镜像在内存中的起始地址
-    unsigned kernel_actual;                    // 实际内核大小（按页对齐）
-    unsigned ramdisk_actual;                   // 实际ramdisk大小（按页对齐）
-    unsigned imagesize_actual;                 // 实际镜像总大小
-    unsigned second_actual = 0;                // 第二阶段镜像大小（按页对齐）
-    enum boot_type boot_type = 0;              // 启动类型标志
+#if VERIFIED_BOOT || VERIFIED_BOOT_2 || defined(TZ_SAVE_KERNEL_HASH) || defined(MDTP_SUPPORT)
+	return true;
+#else
+	return (target_use_signed_kernel() && !device.is_unlocked) || is_test_mode_enabled();
+#endif
+}
 
+/*
+ * Without signature checks or hashing the boot image is never needed in one
+ * piece, so each part can be read from eMMC straight to where it is used.
+ */
+static bool boot_img_direct_load(const boot_img_hdr *hdr)
+{
+	if (boot_img_needs_auth())
+		return false;
 #ifdef OSVERSION_IN_BOOTIMAGE
-    uint32_t dtb_image_offset = 0;             // 设备树blob在镜像中的偏移量
+	/* The recovery DTBO and the v2 DTB are located in the full image */
+	if (hdr->header_version == BOOT_HEADER_VERSION_TWO ||
+	    (boot_into_recovery && hdr->header_version == BOOT_HEADER_VERSION_ONE))
+		return false;
 #endif
-    unsigned int out_len = 0;                  // 输出数据长度
-    unsigned int out_avai_len = 0;             // 可用输出空间长度
-    unsigned char *out_addr = NULL;            // 输出数据地址
-    uint32_t dtb_offset = 0;                   // 设备树偏移量
-    unsigned char *kernel_start_addr = NULL;   // 内核起始地址
-    unsigned int kernel_size = 0;              // 内核大小
-    unsigned int patched_kernel_hdr_size = 0;  // 修补内核头部大小
-    uint64_t image_size = 0;                   // 镜像分区大小
-    int rc;                                    // 通用返回码
+	return true;
+}
 
-#if VERIFIED_BOOT_2
-    int status;                                // 验证状态
-    void *dtbo_image_buf = NULL;               // dtbo镜像缓冲区
-    uint32_t dtbo_image_sz = 0;                // dtbo镜像大小
-    void *vbmeta_image_buf = NULL;             // vbmeta镜像缓冲区
-    uint32_t vbmeta_image_sz = 0;              // vbmeta镜像大小
-#endif
+#define BOOTIMG_HASH_CHUNK	(1024 * 1024)
 
-    char *ptn_name = "boot";                   // 默认分区名称为boot
+/*
+ * Reading the boot image and calculating its digest for the signature check
+ * can overlap: A separate thread reads the image in chunks straight to its
+ * place, while the chunks that have arrived already are hashed.
+ */
+struct bootimg_stream
+{
+	unsigned long long ptn;
+	unsigned char *buf;
+	uint32_t size;
+	volatile uint32_t avail;
+	volatile bool error;
+	event_t data_event;
+	event_t done_event;
+};
 
-#if DEVICE_TREE
-    void *image_buf = NULL;                    // 图像缓冲区指针
-    unsigned int dtb_size = 0;                 // 设备树大小
-    unsigned dtb_image_size = 0;               // 设备树镜像大小
-    struct dt_table *table;                    // 设备树表结构指针
-    struct dt_entry dt_entry;                  // 设备树条目
-    unsigned dt_table_offset;                  // 设备树表偏移量
-    uint32_t dt_actual;                        // 实际设备树大小（按页对齐）
-    uint32_t dt_hdr_size;                      // 设备树头部大小
-    unsigned char *best_match_dt_addr = NULL;  // 最佳匹配的设备树地址
-#endif
+static int bootimg_stream_reader(void *arg)
+{
+	struct bootimg_stream *s = arg;
+	uint32_t len;
 
-    struct kernel64_hdr *kptr = NULL;          // 64位内核头部指针
-    int current_active_slot = INVALID;         // 当前活动槽位
+	while (s->avail < s->size)
+	{
+		len = MIN(s->size - s->avail, BOOTIMG_HASH_CHUNK);
+		if (mmc_read(s->ptn + s->avail, (uint32_t *)(s->buf + s->avail), len))
+		{
+			s->error = true;
+			break;
+		}
+		s->avail += len;
+		event_signal(&s->data_event, false);
+	}
 
-    // 检查是否需要进入恢复模式
-    if (!IS_ENABLED(ABOOT_STANDALONE) && check_format_bit())
-        boot_into_recovery = 1;
+	event_signal(&s->data_event, false);
+	event_signal(&s->done_event, false);
+	return 0;
+}
 
-    // 处理FFBM（Factory Firmware Boot Mode）模式
-    if (!IS_ENABLED(ABOOT_STANDALONE) && !boot_into_recovery)
-    {
-        // 清空FFBM模式字符串
-        memset(ffbm_mode_string, '\0', sizeof(ffbm_mode_string));
-        // 获取FFBM模式信息
-        rcode = get_ffbm(ffbm_mode_string, sizeof(ffbm_mode_string));
-        if (rcode <= 0)
-        {
-            boot_into_ffbm = false;
-            if (rcode < 0)
-                dprintf(CRITICAL, "获取ffbm cookie失败");
-        }
-        else
-            boot_into_ffbm = true;
-    }
-    else
-        boot_into_ffbm = false;
+/**
+ * read_bootimg_hashed() - Read the boot image and calculate its digest.
+ * @ptn:    Offset of the boot partition
+ * @buf:    Buffer for the image, the first @offset bytes are read already
+ * @offset: Number of bytes read already
+ * @size:   Size of the image without the signature
+ * @digest: Returns the digest of the whole image
+ *
+ * Returns: 1 if the image was read and hashed, 0 if it was read but could
+ * not be hashed or -1 if reading failed.
+ */
+static int read_bootimg_hashed(unsigned long long ptn, unsigned char *buf,
+			       uint32_t offset, uint32_t size, unsigned char *digest)
+{
+	struct bootimg_stream s = { .ptn = ptn, .buf = buf, .size = size, .avail = offset };
+	crypto_hash_ctx ctx;
+	uint32_t hashed = 0, avail;
+	crypto_result_type ret;
+	bool hash_ok;
+	thread_t *thr;
 
-    // 检查统一启动方法（检查EMMC_BOOT_IMG_HEADER_ADDR处的魔数）
-    uhdr = (boot_img_hdr *)EMMC_BOOT_IMG_HEADER_ADDR;
-    if (!memcmp(uhdr->magic, BOOT_MAGIC, BOOT_MAGIC_SIZE))
-    {
-        dprintf(INFO, "使用统一启动方法！\n");
-        hdr = uhdr;
-        goto unified_boot;  // 跳转到统一启动流程
-    }
+	hash_ok = hash_find_start(&ctx, bootimg_auth_algo()) == CRYPTO_SHA_ERR_NONE;
 
-    // 如果是恢复模式，切换到恢复分区
-    if (boot_into_recovery)
-    {
-        if (partition_get_index("recovery") != INVALID_PTN)
-        {
-            ptn_name = "recovery";
-        }
-    }
+	event_init(&s.data_event, false, EVENT_FLAG_AUTOUNSIGNAL);
+	event_init(&s.done_event, false, 0);
 
-    // 获取分区信息
-    index = partition_get_index(ptn_name);     // 获取分区索引
-    ptn = partition_get_offset(index);         // 获取分区偏移地址
-    image_size = partition_get_size(index);    // 获取分区大小
-    
-    // 验证分区是否存在
-    if (ptn == 0 || image_size == 0)
-    {
-        dprintf(CRITICAL, "错误：未找到%s分区\n", ptn_name);
-        return -1;
-    }
+	thr = thread_create("bootimg reader", bootimg_stream_reader, &s,
+			    DEFAULT_PRIORITY, DEFAULT_STACK_SIZE);
+	if (!thr)
+	{
+		/* Read everything here, the digest is calculated later */
+		hash_ok = false;
+		bootimg_stream_reader(&s);
+	}
+	else
+		thread_resume(thr);
 
-    // 为boot和recovery分区设置LUN（逻辑单元号）
-    mmc_set_lun(partition_get_lun(index));
+	while (hashed < size)
+	{
+		avail = s.avail;
+		if (avail == hashed)
+		{
+			if (s.error)
+				break;
+			event_wait(&s.data_event);
+			continue;
+		}
 
-    // 读取boot镜像头部到缓冲区
-    if (mmc_read(ptn + offset, (uint32_t *)buf, page_size))
-    {
-        dprintf(CRITICAL, "错误：无法读取boot镜像头部\n");
-        return -1;
-    }
+		if (hash_ok)
+		{
+			if (avail < size)
+				ret = hash_find_update(&ctx, buf + hashed, avail - hashed);
+			else
+				ret = hash_find_finish(&ctx, buf + hashed, avail - hashed, digest);
+			hash_ok = ret == CRYPTO_SHA_ERR_NONE;
+		}
+		hashed = avail;
+	}
 
-    // 验证boot镜像头部魔数
-    if (memcmp(hdr->magic, BOOT_MAGIC, BOOT_MAGIC_SIZE))
-    {
-        dprintf(CRITICAL, "错误：无效的boot镜像头部\n");
-        return ERR_INVALID_BOOT_MAGIC;
-    }
+	event_wait(&s.done_event);
+	event_destroy(&s.data_event);
+	event_destroy(&s.done_event);
 
-    // 检查并更新页面大小
-    if (hdr->page_size && (hdr->page_size != page_size))
-    {
-        // 验证页面大小是否有效
-        if (hdr->page_size > BOOT_IMG_MAX_PAGE_SIZE)
-        {
-            dprintf(CRITICAL, "错误：无效的页面大小\n");
-            return -1;
-        }
-        page_size = hdr->page_size;      // 更新全局页面大小
-        page_mask = page_size - 1;       // 更新页面掩码
-    }
+	if (s.error)
+		return -1;
+	return hash_ok ? 1 : 0;
+}
 
-    // 计算各组件的实际大小（按页面对齐）
-    kernel_actual = ROUND_TO_PAGE(hdr->kernel_size, page_mask);
-    ramdisk_actual = ROUND_TO_PAGE(hdr->ramdisk_size, page_mask);
-    second_actual = ROUND_TO_PAGE(hdr->second_size, page_mask);
+static bool ranges_overlap(uintptr_t a, uint32_t a_size, uintptr_t b, uint32_t b_size)
+{
+	return a < b + b_size && b < a + a_size;
+}
 
-    // 获取目标平台的临时存储地址
-    image_addr = (unsigned char *)target_get_scratch_address();
-    
-#if VERIFIED_BOOT_2
-    // 为VB盐值复制在镜像开头创建空隙
-    image_addr += SALT_BUFF_OFFSET;
-#endif
-    
-    // 将boot头部复制到临时存储地址
-    memcpy(image_addr, (void *)buf, page_size);
-
-    // 确保命令行参数以null结尾
-    hdr->cmdline[BOOT_ARGS_SIZE - 1] = 0;
+/* page_size of the older header versions is reserved[3] and always 0 here */
+static bool boot_img_is_v3(const struct boot_img_hdr_v3 *hdr3)
+{
+	return (hdr3->header_version == BOOT_HEADER_VERSION_THREE ||
+		hdr3->header_version == BOOT_HEADER_VERSION_FOUR) && !hdr3->reserved[3];
+}
 
-#if DEVICE_TREE
-#ifndef OSVERSION_IN_BOOTIMAGE
-    // 获取设备树大小
-    dt_size = hdr->dt_size;
-#else
-    dprintf(INFO, "BootImage头部版本: %d\n", hdr->header_version);
-#endif
+static char boot_v3_cmdline[VENDOR_BOOT_ARGS_SIZE + BOOT_IMG_V3_ARGS_SIZE + 2];
+static boot_img_hdr boot_v3_addrs;
 
-    // 计算实际设备树大小（按页面对齐）
-    dt_actual = ROUND_TO_PAGE(dt_size, page_mask);
-    
-    // 检查整数溢出
-    if (UINT_MAX < ((uint64_t)kernel_actual + (uint64_t)ramdisk_actual + (uint64_t)second_actual + (uint64_t)dt_actual + page_size))
-    {
-        dprintf(CRITICAL, "在文件%s第%u行检测到bootimage头部字段整数溢出\n", __FILE__, __LINE__);
-        return -1;
-    }
-    
-    // 计算实际镜像总大小
-    imagesize_actual = (page_size + kernel_actual + ramdisk_actual + second_actual + dt_actual);
-    dtb_image_size = hdr->kernel_size;
-#else
-    // 不支持设备树时的大小计算和溢出检查
-    if (UINT_MAX < ((uint64_t)kernel_actual + (uint64_t)ramdisk_actual + (uint64_t)second_actual + page_size))
-    {
-        dprintf(CRITICAL, "在文件%s第%u行检测到bootimage头部字段整数溢出\n", __FILE__, __LINE__);
-        return -1;
-    }
-    imagesize_actual = (page_size + kernel_actual + ramdisk_actual + second_actual);
-#endif
+static void boot_v3_build_cmdline(const struct vendor_boot_img_hdr_v3 *vhdr,
+				  const struct boot_img_hdr_v3 *hdr3)
+{
+	size_t vlen = strnlen((const char *)vhdr->cmdline, VENDOR_BOOT_ARGS_SIZE);
+	size_t len = strnlen((const char *)hdr3->cmdline, BOOT_IMG_V3_ARGS_SIZE);
+	char *p = boot_v3_cmdline;
+
+	memcpy(p, vhdr->cmdline, vlen);
+	p += vlen;
+	if (vlen && len)
+		*p++ = ' ';
+	memcpy(p, hdr3->cmdline, len);
+	p[len] = '\0';
+}
 
-#ifdef OSVERSION_IN_BOOTIMAGE
-    /* 如果头部版本为ONE且正在启动恢复模式，
-       dtbo会附加到恢复镜像中。
-       执行以下操作：
-         * 验证恢复偏移量和大小
-         * 提取恢复dtbo作为dtbo使用
-    */
-    if (boot_into_recovery &&
-        hdr->header_version == BOOT_HEADER_VERSION_ONE)
-    {
-        // 获取v1头部结构
-        struct boot_img_hdr_v1 *hdr1 =
-            (struct boot_img_hdr_v1 *)(image_addr + sizeof(boot_img_hdr));
-        unsigned int recovery_dtbo_actual = 0;
+/*
+ * Append the bootconfig after the initrd. The kernel finds it through
+ * the size, checksum and magic at the very end of the initrd.
+ */
+static uint32_t boot_v3_append_bootconfig(unsigned char *dst, const unsigned char *config,
+					  uint32_t size)
+{
+	uint32_t padded = ROUNDUP(size, BOOTCONFIG_ALIGN);
+	uint32_t csum = 0, i;
+
+	memmove(dst, config, size);
+	memset(dst + size, 0, padded - size);
+	for (i = 0; i < size; i++)
+		csum += config[i];
+
+	memcpy(dst + padded, &padded, sizeof(padded));
+	memcpy(dst + padded + 4, &csum, sizeof(csum));
+	memcpy(dst + padded + 8, BOOTCONFIG_MAGIC, BOOTCONFIG_MAGIC_SIZE);
+	return padded + 8 + BOOTCONFIG_MAGIC_SIZE;
+}
 
-        // 计算恢复dtbo的实际大小
-        recovery_dtbo_actual = ROUND_TO_PAGE(hdr1->recovery_dtbo_size, page_mask);
-        
-        // 验证头部大小
-        if ((hdr1->header_size !=
-             sizeof(struct boot_img_hdr_v1) + sizeof(boot_img_hdr)))
-        {
-            dprintf(CRITICAL, "无效的boot镜像头部：%d\n", hdr1->header_size);
-            return -1;
-        }
+/*
+ * Boot image header version 3 and 4 (GKI). The kernel, ramdisk and
+ * command line are in boot, the load addresses, the vendor ramdisk and
+ * the dtb in vendor_boot. Each part is read directly to its final place:
+ * the vendor ramdisk followed by the generic ramdisk form the initrd
+ * without any copy. Only the dtb and compressed kernels go through the
+ * scratch region.
+ */
+static int boot_linux_from_mmc_v3(const struct boot_img_hdr_v3 *hdr3,
+				  unsigned long long ptn, uint64_t image_size)
+{
+	const struct vendor_boot_img_hdr_v3 *vhdr;
+	const struct vendor_boot_img_hdr_v4 *vhdr4;
+	boot_img_hdr *hdr = &boot_v3_addrs;
+	struct kernel64_hdr *kptr;
+	unsigned char *image_addr, *kernel_buf, *kernel_start_addr;
+	unsigned char *out_addr = NULL, *ramdisk;
+	unsigned int out_len = 0, dtb_offset = 0;
+	uint32_t kernel_actual, ramdisk_actual, kernel_size;
+	uint32_t vpage, vmask, vramdisk_offset, vdtb_offset, vbootconfig_offset;
+	uint32_t vendor_gap, bootconfig_size = 0, initrd_size, initrd_max, scratch_used;
+	unsigned long long vptn;
+	uint64_t vimage_size;
+	int index, boot_lun, vendor_lun, rc;
+	enum boot_type boot_type = 0;
+	bool compressed, direct_kernel;
+	void *dtb;
 
-        // 检查dtbo大小是否超出限制
-        if (recovery_dtbo_actual > MAX_SUPPORTED_DTBO_IMG_BUF)
-        {
-            dprintf(CRITICAL, "恢复Dtbo大小过大 0x%x，允许大小 0x%x\n", recovery_dtbo_actual,
-                    MAX_SUPPORTED_DTBO_IMG_BUF);
-            return -1;
-        }
+	if (boot_img_needs_auth())
+	{
+		dprintf(CRITICAL, "ERROR: Boot image v%u cannot be verified\n",
+			hdr3->header_version);
+		return -1;
+	}
 
-        // 检查整数溢出
-        if (UINT_MAX < ((uint64_t)imagesize_actual + recovery_dtbo_actual))
-        {
-            dprintf(CRITICAL, "在文件%s第%u行检测到恢复镜像头部字段整数溢出\n", __FILE__, __LINE__);
-            return -1;
-        }
+	kernel_actual = ROUND_TO_PAGE(hdr3->kernel_size, BOOT_IMG_V3_PAGE_SIZE - 1);
+	ramdisk_actual = ROUND_TO_PAGE(hdr3->ramdisk_size, BOOT_IMG_V3_PAGE_SIZE - 1);
+	if (!hdr3->kernel_size ||
+	    BOOT_IMG_V3_PAGE_SIZE + (uint64_t)kernel_actual + ramdisk_actual > image_size)
+	{
+		dprintf(CRITICAL, "ERROR: Invalid boot image v%u sizes\n", hdr3->header_version);
+		return -1;
+	}
+	boot_lun = mmc_get_lun();
 
-        // 检查偏移量和大小的组合溢出
-        if (UINT_MAX < (hdr1->recovery_dtbo_offset + recovery_dtbo_actual))
-        {
-            dprintf(CRITICAL,
-                    "在文件%s第%u行检测到恢复镜像头部字段整数溢出\n", __FILE__, __LINE__);
-            return -1;
-        }
+	index = partition_get_index("vendor_boot");
+	vptn = partition_get_offset(index);
+	vimage_size = partition_get_size(index);
+	if (vptn == 0 || vimage_size < BOOT_IMG_V3_PAGE_SIZE)
+	{
+		dprintf(CRITICAL, "ERROR: No vendor_boot partition found\n");
+		return -1;
+	}
+	vendor_lun = partition_get_lun(index);
 
-        // 验证恢复dtbo是否在镜像范围内
-        if (hdr1->recovery_dtbo_offset + recovery_dtbo_actual > image_size)
-        {
-            dprintf(CRITICAL, "无效的恢复dtbo：恢复Dtbo偏移量=0x%llx,"
-                              " 恢复Dtbo大小=0x%x, 镜像大小=0x%llx\n",
-                    hdr1->recovery_dtbo_offset, recovery_dtbo_size, image_size);
-            return -1;
-        }
+	/*
+	 * Scratch layout: vendor_boot header page, dtb section, kernel as
+	 * stored in boot (later the bootconfig) and the decompressed kernel
+	 * if necessary.
+	 */
+	image_addr = (unsigned char *)target_get_scratch_address();
+	vhdr = (const struct vendor_boot_img_hdr_v3 *)image_addr;
+	vhdr4 = (const struct vendor_boot_img_hdr_v4 *)image_addr;
 
-        // 设置恢复dtbo缓冲区和大小
-        recovery_dtbo_buf = (void *)(hdr1->recovery_dtbo_offset + image_addr);
-        recovery_dtbo_size = recovery_dtbo_actual;
-        imagesize_actual += recovery_dtbo_size;
+	mmc_set_lun(vendor_lun);
+	if (mmc_read(vptn, (uint32_t *)image_addr, BOOT_IMG_V3_PAGE_SIZE))
+	{
+		dprintf(CRITICAL, "ERROR: Cannot read vendor_boot header\n");
+		return -1;
+	}
 
-        // 输出调试信息
-        dprintf(SPEW, "头部版本：%d\n", hdr->header_version);
-        dprintf(SPEW, "恢复Dtbo大小 0x%x\n", recovery_dtbo_size);
-        dprintf(SPEW, "恢复Dtbo偏移量 0x%llx\n", hdr1->recovery_dtbo_offset);
-    }
+	vpage = vhdr->page_size;
+	if (memcmp(vhdr->magic, VENDOR_BOOT_MAGIC, VENDOR_BOOT_MAGIC_SIZE) ||
+	    vhdr->header_version != hdr3->header_version ||
+	    !vpage || (vpage & (vpage - 1)) || vpage < mmc_blocksize ||
+	    vhdr->header_size > BOOT_IMG_V3_PAGE_SIZE)
+	{
+		dprintf(CRITICAL, "ERROR: Invalid vendor_boot header\n");
+		return -1;
+	}
+	vmask = vpage - 1;
 
-    // 处理头部版本为TWO的情况
-    if (hdr->header_version == BOOT_HEADER_VERSION_TWO)
-    {
-        // 获取v1和v2头部结构
-        struct boot_img_hdr_v1 *hdr1 =
-            (struct boot_img_hdr_v1 *)(image_addr + sizeof(boot_img_hdr));
-        struct boot_img_hdr_v2 *hdr2 = (struct boot_img_hdr_v2 *)(image_addr + sizeof(boot_img_hdr) +
-                                                                  BOOT_IMAGE_HEADER_V2_OFFSET);
-        unsigned int recovery_dtbo_actual = 0;
+	vramdisk_offset = ROUND_TO_PAGE(vhdr->header_size, vmask);
+	vdtb_offset = vramdisk_offset + ROUND_TO_PAGE(vhdr->vendor_ramdisk_size, vmask);
+	vbootconfig_offset = vdtb_offset + ROUND_TO_PAGE(vhdr->dtb_size, vmask);
+	if (vhdr->header_version == BOOT_HEADER_VERSION_FOUR)
+	{
+		vbootconfig_offset += ROUND_TO_PAGE(vhdr4->vendor_ramdisk_table_size, vmask);
+		bootconfig_size = vhdr4->bootconfig_size;
+	}
+	if (vbootconfig_offset < vdtb_offset ||
+	    (uint64_t)vbootconfig_offset + ROUND_TO_PAGE(bootconfig_size, vmask) > vimage_size)
+	{
+		dprintf(CRITICAL, "ERROR: Invalid vendor_boot sizes\n");
+		return -1;
+	}
 
-        // 计算恢复dtbo实际大小并加入总大小
-        recovery_dtbo_actual =
-            ROUND_TO_PAGE(hdr1->recovery_dtbo_size, page_mask);
-        imagesize_actual += recovery_dtbo_actual;
+	kernel_buf = image_addr + BOOT_IMG_V3_PAGE_SIZE + ROUND_TO_PAGE(vhdr->dtb_size, vmask);
+	scratch_used = kernel_buf - image_addr +
+		       MAX(kernel_actual, ROUND_TO_PAGE(bootconfig_size, vmask));
+	if (scratch_used < kernel_actual || scratch_used > target_get_max_flash_size() ||
+	    check_aboot_addr_range_overlap((uintptr_t)image_addr, scratch_used))
+	{
+		dprintf(CRITICAL, "ERROR: Boot image v%u does not fit in scratch\n",
+			hdr3->header_version);
+		return -1;
+	}
 
-        // 加入dtb大小
-        imagesize_actual += ROUND_TO_PAGE(hdr2->dtb_size, page_mask);
+	bs_set_timestamp(BS_KERNEL_LOAD_START);
 
-        // 计算dtb镜像偏移量
-        dtb_image_offset = page_size + patched_kernel_hdr_size +
-                           kernel_actual + ramdisk_actual + second_actual +
-                           recovery_dtbo_actual;
+	if (vhdr->dtb_size &&
+	    mmc_read(vptn + vdtb_offset, (uint32_t *)(image_addr + BOOT_IMG_V3_PAGE_SIZE),
+		     ROUND_TO_PAGE(vhdr->dtb_size, vmask)))
+	{
+		dprintf(CRITICAL, "ERROR: Cannot read vendor_boot dtb\n");
+		return -1;
+	}
 
-        // 输出调试信息
-        dprintf(SPEW, "头部版本：%d\n", hdr->header_version);
-        dprintf(SPEW, "Dtb镜像偏移量 0x%x\n", dtb_image_offset);
-    }
-#endif
+	/* The first page tells if the kernel needs to be decompressed */
+	mmc_set_lun(boot_lun);
+	if (mmc_read(ptn + BOOT_IMG_V3_PAGE_SIZE, (uint32_t *)kernel_buf, BOOT_IMG_V3_PAGE_SIZE))
+	{
+		dprintf(CRITICAL, "ERROR: Cannot read boot image\n");
+		return -1;
+	}
 
-    // 验证boot/恢复镜像大小是否在分区大小范围内
-    if (imagesize_actual > image_size)
-    {
-        dprintf(CRITICAL, "镜像大小大于分区大小。\n");
-        return -1;
-    }
+	compressed = is_gzip_package(kernel_buf, hdr3->kernel_size) ||
+		     lz4_is_compressed(kernel_buf, hdr3->kernel_size);
+	direct_kernel = !compressed;
+	kptr = (struct kernel64_hdr *)kernel_buf;
+	kernel_start_addr = kernel_buf;
+	kernel_size = hdr3->kernel_size;
 
-#if VERIFIED_BOOT
-    // 初始化启动验证器
-    boot_verifier_init();
-#endif
+	if (compressed)
+	{
+		unsigned int out_avai_len = target_get_max_flash_size() - scratch_used;
+		size_t lz4_in, lz4_out;
 
-#if VERIFIED_BOOT_2
-    // 如果设备已解锁，则读取完整分区
-    if (device.is_unlocked)
-        imagesize_actual = image_size;
-#endif
+		if (kernel_actual > BOOT_IMG_V3_PAGE_SIZE &&
+		    mmc_read(ptn + 2 * BOOT_IMG_V3_PAGE_SIZE,
+			     (uint32_t *)(kernel_buf + BOOT_IMG_V3_PAGE_SIZE),
+			     kernel_actual - BOOT_IMG_V3_PAGE_SIZE))
+		{
+			dprintf(CRITICAL, "ERROR: Cannot read boot image\n");
+			return -1;
+		}
 
-    // 检查boot镜像缓冲区地址是否与aboot地址重叠
-    if (check_aboot_addr_range_overlap((uintptr_t)image_addr, imagesize_actual))
-    {
-        dprintf(CRITICAL, "Boot镜像缓冲区地址与aboot地址重叠。\n");
-        return -1;
-    }
+		out_addr = image_addr + scratch_used;
+		dprintf(INFO, "Decompressing kernel image: start\n");
+		if (is_gzip_package(kernel_buf, hdr3->kernel_size))
+			rc = decompress(kernel_buf, hdr3->kernel_size, out_addr, out_avai_len,
+					&dtb_offset, &out_len);
+		else
+		{
+			rc = lz4_decompress(kernel_buf, hdr3->kernel_size, out_addr, out_avai_len,
+					    &lz4_in, &lz4_out);
+			out_len = lz4_out;
+		}
+		if (rc)
+		{
+			dprintf(CRITICAL, "Decompressing kernel image failed: %d\n", rc);
+			return -1;
+		}
+		dprintf(INFO, "Decompressing kernel image: done\n");
 
-    /*
-     * 更新boot镜像加载流程以支持压缩/未压缩的
-     * boot镜像在64位和32位平台上。
-     * 1. 从emmc分区加载boot镜像到DDR。
-     * 2. 检查boot镜像是否为gzip格式。如果是，解压压缩内核
-     * 3. 检查内核头部并相应更新64位和32位平台的内核加载地址。
-     * 4. 对kernel_addr和ramdisk_addr进行健全性检查并复制数据。
-     */
-    
-    // 处理多槽位启动情况
-    if (partition_multislot_is_supported())
-    {
-        current_active_slot = partition_find_active_slot();
-        dprintf(INFO, "正在加载boot镜像 (%d) 活动槽位(%s)：开始\n",
-                imagesize_actual, SUFFIX_SLOT(current_active_slot));
-    }
-    else
-    {
-        dprintf(INFO, "正在加载(%s)镜像 (%d)：开始\n",
-                (!boot_into_recovery ? "boot" : "recovery"), imagesize_actual);
-    }
-    
-    // 设置内核加载开始时间戳
-    bs_set_timestamp(BS_KERNEL_LOAD_START);
+		kptr = (struct kernel64_hdr *)out_addr;
+		kernel_start_addr = out_addr;
+		kernel_size = out_len;
+	}
 
-    // 检查DDR是否有足够空间容纳镜像
-    if ((target_get_max_flash_size() - page_size) < imagesize_actual)
-    {
-        dprintf(CRITICAL, "boot镜像大小超过DDR可容纳范围\n");
-        return -1;
-    }
-    
-    offset = page_size;
-    /* 读取不包含签名和头部的镜像 */
-    if (mmc_read(ptn + offset, (void *)(image_addr + offset), imagesize_actual - page_size))
-    {
-        dprintf(CRITICAL, "错误：无法读取boot镜像\n");
-        return -1;
-    }
+	if (kptr->text_offset > 2 * 1024 * 1024)
+		kptr->text_offset = 0;
 
-    // 输出加载完成信息
-    if (partition_multislot_is_supported())
-    {
-        dprintf(INFO, "正在加载boot镜像 (%d) 活动槽位(%s)：完成\n",
-                imagesize_actual, SUFFIX_SLOT(current_active_slot));
-    }
-    else
-    {
-        dprintf(INFO, "正在加载(%s)镜像 (%d)：完成\n",
-                (!boot_into_recovery ? "boot" : "recovery"), imagesize_actual);
-    }
-    
-    // 设置内核加载完成时间戳
-    bs_set_timestamp(BS_KERNEL_LOAD_DONE);
+	hdr->kernel_addr = vhdr->kernel_addr;
+	hdr->ramdisk_addr = vhdr->ramdisk_addr;
+	hdr->tags_addr = vhdr->tags_addr;
+	update_ker_tags_rdisk_addr(hdr, kptr);
+	hdr->kernel_addr = VA((addr_t)(hdr->kernel_addr));
+	hdr->ramdisk_addr = VA((addr_t)(hdr->ramdisk_addr));
+	hdr->tags_addr = VA((addr_t)(hdr->tags_addr));
 
-    // 内核认证信息输出
-    dprintf(INFO, "use_signed_kernel=%d, is_unlocked=%d, is_tampered=%d.\n",
-            (int)target_use_signed_kernel(),
-            device.is_unlocked,
-            device.is_tampered);
+	/*
+	 * The vendor ramdisk is read in whole blocks. The rest of its last
+	 * block is cleared, the kernel skips zeros between the archives.
+	 */
+	vendor_gap = ROUNDUP(vhdr->vendor_ramdisk_size, mmc_blocksize);
+	initrd_max = vendor_gap + ramdisk_actual;
+	if (bootconfig_size)
+		initrd_max += ROUNDUP(bootconfig_size, BOOTCONFIG_ALIGN) + 8 + BOOTCONFIG_MAGIC_SIZE;
+
+	kernel_size = ROUND_TO_PAGE(kernel_size, BOOT_IMG_V3_PAGE_SIZE - 1);
+	if (initrd_max < ramdisk_actual ||
+	    check_aboot_addr_range_overlap(hdr->kernel_addr, kernel_size) ||
+	    check_ddr_addr_range_bound(hdr->kernel_addr, kernel_size) ||
+	    check_aboot_addr_range_overlap(hdr->ramdisk_addr, initrd_max) ||
+	    check_ddr_addr_range_bound(hdr->ramdisk_addr, initrd_max) ||
+	    ranges_overlap(hdr->ramdisk_addr, initrd_max, hdr->kernel_addr, kernel_size))
+	{
+		dprintf(CRITICAL, "Kernel/ramdisk addresses are not valid.\n");
+		return -1;
+	}
+
+	/* Keep using the scratch region if the kernel would overwrite it */
+	if (direct_kernel &&
+	    ranges_overlap(hdr->kernel_addr, kernel_size, (uintptr_t)image_addr, scratch_used))
+		direct_kernel = false;
+
+	if (!compressed &&
+	    mmc_read(ptn + BOOT_IMG_V3_PAGE_SIZE,
+		     (uint32_t *)(direct_kernel ? (unsigned char *)hdr->kernel_addr : kernel_buf),
+		     kernel_actual))
+	{
+		dprintf(CRITICAL, "ERROR: Cannot read boot image\n");
+		return -1;
+	}
+
+	if (vhdr->dtb_size)
+		dtb = dev_tree_appended(image_addr, BOOT_IMG_V3_PAGE_SIZE + vhdr->dtb_size,
+					BOOT_IMG_V3_PAGE_SIZE, (void *)hdr->tags_addr);
+	else
+		dtb = NULL;
+	if (!dtb)
+	{
+		dprintf(CRITICAL, "ERROR: Appended Device Tree Blob not found\n");
+#if WITH_LK2ND_DEVICE_2ND
+		if (lk2nd_device2nd_have_atags())
+			boot_type |= BOOT_ATAGS_COPY;
+		else
+#endif
+			return -1;
+	}
+
+	if (!direct_kernel)
+		lk2nd_memcpy((void *)hdr->kernel_addr, kernel_start_addr, kernel_size);
+
+	/* The bootconfig goes to scratch first, it is appended at the very end */
+	if (bootconfig_size)
+	{
+		mmc_set_lun(vendor_lun);
+		if (mmc_read(vptn + vbootconfig_offset, (uint32_t *)kernel_buf,
+			     ROUND_TO_PAGE(bootconfig_size, vmask)))
+		{
+			dprintf(CRITICAL, "ERROR: Cannot read vendor_boot bootconfig\n");
+			return -1;
+		}
+	}
+
+	ramdisk = (unsigned char *)hdr->ramdisk_addr;
+	if (vendor_gap)
+	{
+		mmc_set_lun(vendor_lun);
+		if (mmc_read(vptn + vramdisk_offset, (uint32_t *)ramdisk, vendor_gap))
+		{
+			dprintf(CRITICAL, "ERROR: Cannot read vendor ramdisk\n");
+			return -1;
+		}
+		memset(ramdisk + vhdr->vendor_ramdisk_size, 0,
+		       vendor_gap - vhdr->vendor_ramdisk_size);
+	}
+
+	mmc_set_lun(boot_lun);
+	if (ramdisk_actual &&
+	    mmc_read(ptn + BOOT_IMG_V3_PAGE_SIZE + kernel_actual,
+		     (uint32_t *)(ramdisk + vendor_gap), ramdisk_actual))
+	{
+		dprintf(CRITICAL, "ERROR: Cannot read ramdisk\n");
+		return -1;
+	}
+	initrd_size = vendor_gap + hdr3->ramdisk_size;
+
+	if (bootconfig_size)
+		initrd_size += boot_v3_append_bootconfig(ramdisk + initrd_size, kernel_buf,
+							 bootconfig_size);
+
+	boot_v3_build_cmdline(vhdr, hdr3);
+
+	bs_set_timestamp(BS_KERNEL_LOAD_DONE);
+
+	boot_linux((void *)hdr->kernel_addr, (void *)hdr->tags_addr,
+		   boot_v3_cmdline, board_machtype(),
+		   (void *)hdr->ramdisk_addr, initrd_size, boot_type);
+
+	return 0;
+}
+
+/**
+ * 从MMC存储设备启动Linux系统的主要函数
+ * 该函数负责加载boot镜像、验证签名、解压内核、设置设备树并最终启动Linux内核
+ */
+int boot_linux_from_mmc(void)
+{
+    // 定义boot镜像头部结构指针和相关变量
+    boot_img_hdr *hdr = (void *)buf;           // 指向缓冲区的boot镜像头指针
+    boot_img_hdr *uhdr;                        // 统一boot方法的头部指针
+    unsigned offset = 0;                       // 数据偏移量
+    int rcode;                                 // 返回码
+    unsigned long long ptn = 0;                // 分区偏移地址
+    int index = INVALID_PTN;                   // 分区索引
+
+    // 定义镜像处理相关变量
+    unsigned char *image_addr = 0;             // 镜像在内存中的起始地址
+    unsigned kernel_actual;                    // 实际内核大小（按页对齐）
+    unsigned ramdisk_actual;                   // 实际ramdisk大小（按页对齐）
+    unsigned imagesize_actual;                 // 实际镜像总大小
+    unsigned loaded_actual;                    // Part of the image in the scratch region
+    unsigned second_actual = 0;                // 第二阶段镜像大小（按页对齐）
+    bool direct_load;                          // Read each part to its final address
+    bool direct_kernel = false;                // Kernel is read straight to kernel_addr
+    unsigned char bootimg_digest[SHA256_SIZE]; // Digest calculated while reading the image
+    bool bootimg_hashed = false;
+    enum boot_type boot_type = 0;              // 启动类型标志
+
+#ifdef OSVERSION_IN_BOOTIMAGE
+    uint32_t dtb_image_offset = 0;             // 设备树blob在镜像中的偏移量
+#endif
+    unsigned int out_len = 0;                  // 输出数据长度
+    unsigned int out_avai_len = 0;             // 可用输出空间长度
+    unsigned char *out_addr = NULL;            // 输出数据地址
+    uint32_t dtb_offset = 0;                   // 设备树偏移量
+    unsigned char *kernel_start_addr = NULL;   // 内核起始地址
+    unsigned int kernel_size = 0;              // 内核大小
+    unsigned int patched_kernel_hdr_size = 0;  // 修补内核头部大小
+    uint64_t image_size = 0;                   // 镜像分区大小
+    int rc;                                    // 通用返回码
 
 #if VERIFIED_BOOT_2
-    // 如果设备未解锁则读取签名（已解锁时读取完整分区）
-    if (!device.is_unlocked)
-    {
-        offset = imagesize_actual;
-        // 检查签名读取缓冲区地址是否与aboot地址重叠
-        if (check_aboot_addr_range_overlap((uintptr_t)image_addr + offset, page_size))
-        {
-            dprintf(CRITICAL, "签名读取缓冲区地址与aboot地址重叠。\n");
-            return -1;
-        }
+    int status;                                // 验证状态
+    void *dtbo_image_buf = NULL;               // dtbo镜像缓冲区
+    uint32_t dtbo_image_sz = 0;                // dtbo镜像大小
+    void *vbmeta_image_buf = NULL;             // vbmeta镜像缓冲区
+    uint32_t vbmeta_image_sz = 0;              // vbmeta镜像大小
+#endif
 
-        // 读取签名
-        if (mmc_read(ptn + offset, (void *)(image_addr + offset), page_size))
-        {
-            dprintf(CRITICAL, "错误：无法读取boot镜像签名\n");
-            return -1;
-        }
-    }
+    char *ptn_name = "boot";                   // 默认分区名称为boot
 
-    // 加载并验证dtbo分区
-    load_validate_dtbo_image(&dtbo_image_buf, &dtbo_image_sz);
+#if DEVICE_TREE
+    void *image_buf = NULL;                    // 图像缓冲区指针
+    unsigned int dtb_size = 0;                 // 设备树大小
+    unsigned dtb_image_size = 0;               // 设备树镜像大小
+    struct dt_table *table;                    // 设备树表结构指针
+    struct dt_entry dt_entry;                  // 设备树条目
+    unsigned dt_table_offset;                  // 设备树表偏移量
+    uint32_t dt_actual;                        // 实际设备树大小（按页对齐）
+    uint32_t dt_hdr_size;                      // 设备树头部大小
+    unsigned char *best_match_dt_addr = NULL;  // 最佳匹配的设备树地址
+#endif
 
-    // 加载vbmeta分区
-    load_vbmeta_image(&vbmeta_image_buf, &vbmeta_image_sz);
+    struct kernel64_hdr *kptr = NULL;          // 64位内核头部指针
+    int current_active_slot = INVALID;         // 当前活动槽位
 
-    // 初始化启动信息结构
-    memset(&info, 0, sizeof(bootinfo));
+    // 检查是否需要进入恢复模式
+    if (!IS_ENABLED(ABOOT_STANDALONE) && check_format_bit())
+        boot_into_recovery = 1;
 
-    // 传递加载的boot镜像信息
-    info.images[IMG_BOOT].image_buffer = SUB_SALT_BUFF_OFFSET(image_addr);
-    info.images[IMG_BOOT].imgsize = imagesize_actual;
-    info.images[IMG_BOOT].name = ptn_name;
-    ++info.num_loaded_images;
+    // 处理FFBM（Factory Firmware Boot Mode）模式
+    if (!IS_ENABLED(ABOOT_STANDALONE) && !boot_into_recovery)
+    {
+        // 清空FFBM模式字符串
+        memset(ffbm_mode_string, '\0', sizeof(ffbm_mode_string));
+        // 获取FFBM模式信息
+        rcode = get_ffbm(ffbm_mode_string, sizeof(ffbm_mode_string));
+        if (rcode <= 0)
+        {
+            boot_into_ffbm = false;
+            if (rcode < 0)
+                dprintf(CRITICAL, "获取ffbm cookie失败");
+        }
+        else
+            boot_into_ffbm = true;
+    }
+    else
+        boot_into_ffbm = false;
 
-    // 传递加载的dtbo镜像信息
-    if (dtbo_image_buf != NULL)
+    // 检查统一启动方法（检查EMMC_BOOT_IMG_HEADER_ADDR处的魔数）
+    uhdr = (boot_img_hdr *)EMMC_BOOT_IMG_HEADER_ADDR;
+    if (!memcmp(uhdr->magic, BOOT_MAGIC, BOOT_MAGIC_SIZE))
     {
-        info.images[IMG_DTBO].image_buffer =
-            SUB_SALT_BUFF_OFFSET(dtbo_image_buf);
-        info.images[IMG_DTBO].imgsize = dtbo_image_sz;
-        info.images[IMG_DTBO].name = "dtbo";
-        ++info.num_loaded_images;
+        dprintf(INFO, "使用统一启动方法！\n");
+        hdr = uhdr;
+        goto unified_boot;  // 跳转到统一启动流程
     }
 
-    // 传递加载的vbmeta镜像信息
-    if (vbmeta_image_buf != NULL)
+    // 如果是恢复模式，切换到恢复分区
+    if (boot_into_recovery)
     {
-        info.images[IMG_VBMETA].image_buffer = vbmeta_image_buf;
-        info.images[IMG_VBMETA].imgsize = vbmeta_image_sz;
-        info.images[IMG_VBMETA].name = "vbmeta";
-        ++info.num_loaded_images;
+        if (partition_get_index("recovery") != INVALID_PTN)
+        {
+            ptn_name = "recovery";
+        }
     }
 
-    // 设置其他启动信息
-    info.header_version = hdr->header_version;
-    info.multi_slot_boot = partition_multislot_is_supported();
-    info.bootreason_alarm = boot_reason_alarm;
-    info.bootinto_recovery = boot_into_recovery;
+    // 获取分区信息
+    index = partition_get_index(ptn_name);     // 获取分区索引
+    ptn = partition_get_offset(index);         // 获取分区偏移地址
+    image_size = partition_get_size(index);    // 获取分区大小
     
-    // 加载镜像并进行认证
-    status = load_image_and_auth(&info);
-    if (status)
+    // 验证分区是否存在
+    if (ptn == 0 || image_size == 0)
+    {
+        dprintf(CRITICAL, "错误：未找到%s分区\n", ptn_name);
         return -1;
+    }
 
-    // 获取验证后的命令行
-    vbcmdline = info.vbcmdline;
+    // 为boot和recovery分区设置LUN（逻辑单元号）
+    mmc_set_lun(partition_get_lun(index));
 
-    // 验证后释放vbmeta分配的缓冲区
-    if (vbmeta_image_buf != NULL)
+    // 读取boot镜像头部到缓冲区
+    if (mmc_read(ptn + offset, (uint32_t *)buf, page_size))
     {
-        free(vbmeta_image_buf);
-        --info.num_loaded_images;
+        dprintf(CRITICAL, "错误：无法读取boot镜像头部\n");
+        return -1;
     }
-#else
-    /* 稍微修改条件以包含测试框架支持。
-     * 如果设备处于fastboot模式我们永远不会到达这一点，即使到了
-     * 这意味着我们在测试模式下，所以为测试执行内核认证部分
-     */
-    if ((target_use_signed_kernel() && (!device.is_unlocked)) || is_test_mode_enabled())
+
+    // 验证boot镜像头部魔数
+    if (memcmp(hdr->magic, BOOT_MAGIC, BOOT_MAGIC_SIZE))
     {
-        offset = imagesize_actual;
-        // 检查签名读取缓冲区地址重叠
-        if (check_aboot_addr_range_overlap((uintptr_t)image_addr + offset, page_size))
-        {
-            dprintf(CRITICAL, "签名读取缓冲区地址与aboot地址重叠。\n");
-            return -1;
-        }
+        dprintf(CRITICAL, "错误：无效的boot镜像头部\n");
+        return ERR_INVALID_BOOT_MAGIC;
+    }
 
-        // 读取签名
-        if (mmc_read(ptn + offset, (void *)(image_addr + offset), page_size))
+    if (boot_img_is_v3((struct boot_img_hdr_v3 *)buf))
+        return boot_linux_from_mmc_v3((struct boot_img_hdr_v3 *)buf, ptn, image_size);
+
+    // 检查并更新页面大小
+    if (hdr->page_size && (hdr->page_size != page_size))
+    {
+        // 验证页面大小是否有效
+        if (hdr->page_size > BOOT_IMG_MAX_PAGE_SIZE)
         {
-            dprintf(CRITICAL, "错误：无法读取boot镜像签名\n");
+            dprintf(CRITICAL, "错误：无效的页面大小\n");
             return -1;
         }
-
-        // 验证签名的boot镜像
-        verify_signed_bootimg((uint32_t)image_addr, imagesize_actual);
-        /* 我们的测试目的到这里就完成了 */
-        if (is_test_mode_enabled() && auth_kernel_img)
-            return 0;
+        page_size = hdr->page_size;      // 更新全局页面大小
+        page_mask = page_size - 1;       // 更新页面掩码
     }
-    else
-    {
-        second_actual = ROUND_TO_PAGE(hdr->second_size, page_mask);
-#ifdef TZ_SAVE_KERNEL_HASH
-        // 保存内核哈希到安全区域
-        aboot_save_boot_hash_mmc((uint32_t)image_addr, imagesize_actual);
-#endif /* TZ_SAVE_KERNEL_HASH */
 
-#ifdef MDTP_SUPPORT
-        {
-            // 验证MDTP锁
-            mdtp_ext_partition_verification_t ext_partition;
-            ext_partition.partition = boot_into_recovery ? MDTP_PARTITION_RECOVERY : MDTP_PARTITION_BOOT;
-            ext_partition.integrity_state = MDTP_PARTITION_STATE_UNSET;
-            ext_partition.page_size = page_size;
-            ext_partition.image_addr = (uint32)image_addr;
-            ext_partition.image_size = imagesize_actual;
-            ext_partition.sig_avail = FALSE;
-            mdtp_fwlock_verify_lock(&ext_partition);
-        }
-#endif /* MDTP_SUPPORT */
-    }
-#endif
-
-#if VERIFIED_BOOT
-    // 处理橙色状态（设备已解锁但不可信）
-    if ((boot_verify_get_state() == ORANGE) && (!boot_into_ffbm))
-    {
-#if FBCON_DISPLAY_MSG
-        // 显示启动验证菜单
-        display_bootverify_menu(DISPLAY_MENU_ORANGE);
-        wait_for_users_action();
-#else
-        dprintf(CRITICAL,
-                "您的设备已被解锁且不可信。\n请等待5秒后继续\n");
-        mdelay(5000);
-#endif
-    }
-#endif
-
-#if VERIFIED_BOOT
-    // 处理VB_M版本的验证启动
-    if (VB_M == target_get_vb_version())
-    {
-        // 设置boot和system版本
-        set_os_version((unsigned char *)image_addr);
-        // 发送信任根
-        if (!send_rot_command((uint32_t)device.is_unlocked))
-            ASSERT(0);
-    }
-#endif
+    // 计算各组件的实际大小（按页面对齐）
+    kernel_actual = ROUND_TO_PAGE(hdr->kernel_size, page_mask);
+    ramdisk_actual = ROUND_TO_PAGE(hdr->ramdisk_size, page_mask);
+    second_actual = ROUND_TO_PAGE(hdr->second_size, page_mask);
 
-    /*
-     * 检查内核镜像是否为gzip包。如果是，需要解压它。
-     * 如果不是，继续启动。
-     */
-    if (is_gzip_package((unsigned char *)(image_addr + page_size), hdr->kernel_size))
-    {
-        // 设置解压输出地址和可用长度
-        out_addr = (unsigned char *)(image_addr + imagesize_actual + page_size);
-        out_avai_len = target_get_max_flash_size() - imagesize_actual - page_size;
+    // 获取目标平台的临时存储地址
+    image_addr = (unsigned char *)target_get_scratch_address();
+    
 #if VERIFIED_BOOT_2
-        // 如果有dtbo镜像，减少可用空间
-        if (dtbo_image_sz)
-            out_avai_len -= DTBO_IMG_BUF;
+    // 为VB盐值复制在镜像开头创建空隙
+    image_addr += SALT_BUFF_OFFSET;
 #endif
-        
-        dprintf(INFO, "正在解压内核镜像：开始\n");
-        // 执行解压操作
-        rc = decompress((unsigned char *)(image_addr + page_size),
-                        hdr->kernel_size, out_addr, out_avai_len,
-                        &dtb_offset, &out_len);
-        if (rc)
-        {
-            dprintf(CRITICAL, "解压内核镜像失败！！！\n");
-            ASSERT(0);
-        }
-
-        dprintf(INFO, "正在解压内核镜像：完成\n");
-        // 设置解压后的内核相关信息
-        kptr = (struct kernel64_hdr *)out_addr;
-        kernel_start_addr = out_addr;
-        kernel_size = out_len;
-    }
-    else
-    {
-        dprintf(INFO, "使用未压缩内核\n");
-        // 检查是否为修补过的内核
-        if (!strncmp((char *)(image_addr + page_size),
-                     PATCHED_KERNEL_MAGIC,
-                     sizeof(PATCHED_KERNEL_MAGIC) - 1))
-        {
-            dprintf(INFO, "检测到修补内核\n");
-            // 设置修补内核的相关信息
-            kptr = (struct kernel64_hdr *)(image_addr + page_size +
-                                           PATCHED_KERNEL_HEADER_SIZE);
-            // 内核大小存储在内核镜像起始位置+16字节
-            // dtb将在内核之后开始
-            dtb_offset = *((uint32_t *)((unsigned char *)(image_addr + page_size +
-                                                          sizeof(PATCHED_KERNEL_MAGIC) -
-                                                          1)));
-            // 实际内核在20字节头部之后开始
-            kernel_start_addr = (unsigned char *)(image_addr +
-                                                  page_size + PATCHED_KERNEL_HEADER_SIZE);
-            kernel_size = hdr->kernel_size;
-            patched_kernel_hdr_size = PATCHED_KERNEL_HEADER_SIZE;
-        }
-        else
-        {
-            dprintf(INFO, "内核镜像未修补..无法定位dt偏移量\n");
-            // 使用标准内核头部
-            kptr = (struct kernel64_hdr *)(image_addr + page_size);
-            kernel_start_addr = (unsigned char *)(image_addr + page_size);
-            kernel_size = hdr->kernel_size;
-        }
-    }
-
-    // 修复text_offset过大的问题（HACK方式）
-    if (kptr->text_offset > 2 * 1024 * 1024)
-        kptr->text_offset = 0;
+    
+    // 将boot头部复制到临时存储地址
+    memcpy(image_addr, (void *)buf, page_size);
 
-    /*
-     * 如果boot镜像头部具有默认值，则更新内核/ramdisk/tags地址，
-     * 这些默认值来自mkbootimg，当使用fastboot flash:raw刷写boot镜像时产生
-     */
-    update_ker_tags_rdisk_addr(hdr, kptr);
+    // 确保命令行参数以null结尾
+    hdr->cmdline[BOOT_ARGS_SIZE - 1] = 0;
 
-    // 获取虚拟地址（因为hdr保存的是物理地址）
-    hdr->kernel_addr = VA((addr_t)(hdr->kernel_addr));
-    hdr->ramdisk_addr = VA((addr_t)(hdr->ramdisk_addr));
-    hdr->tags_addr = VA((addr_t)(hdr->tags_addr));
+#if DEVICE_TREE
+#ifndef OSVERSION_IN_BOOTIMAGE
+    // 获取设备树大小
+    dt_size = hdr->dt_size;
+#else
+    dprintf(INFO, "BootImage头部版本: %d\n", hdr->header_version);
+#endif
 
-    // 按页面对齐内核大小
-    kernel_size = ROUND_TO_PAGE(kernel_size, page_mask);
+    // 计算实际设备树大小（按页面对齐）
+    dt_actual = ROUND_TO_PAGE(dt_size, page_mask);
     
-    // 检查头部中的地址是否有效
-    if (check_aboot_addr_range_overlap(hdr->kernel_addr, kernel_size) ||
-        check_ddr_addr_range_bound(hdr->kernel_addr, kernel_size) ||
-        check_aboot_addr_range_overlap(hdr->ramdisk_addr, ramdisk_actual) ||
-        check_ddr_addr_range_bound(hdr->ramdisk_addr, ramdisk_actual))
+    // 检查整数溢出
+    if (UINT_MAX < ((uint64_t)kernel_actual + (uint64_t)ramdisk_actual + (uint64_t)second_actual + (uint64_t)dt_actual + page_size))
     {
-        dprintf(CRITICAL, "内核/ramdisk地址无效。\n");
+        dprintf(CRITICAL, "在文件%s第%u行检测到bootimage头部字段整数溢出\n", __FILE__, __LINE__);
         return -1;
     }
-
-#ifndef DEVICE_TREE
-    // 在非设备树环境下检查tags地址
-    (void)patched_kernel_hdr_size;
-    if (check_aboot_addr_range_overlap(hdr->tags_addr, MAX_TAGS_SIZE) ||
-        check_ddr_addr_range_bound(hdr->tags_addr, MAX_TAGS_SIZE))
+    
+    // 计算实际镜像总大小
+    imagesize_actual = (page_size + kernel_actual + ramdisk_actual + second_actual + dt_actual);
+    dtb_image_size = hdr->kernel_size;
+#else
+    // 不支持设备树时的大小计算和溢出检查
+    if (UINT_MAX < ((uint64_t)kernel_actual + (uint64_t)ramdisk_actual + (uint64_t)second_actual + page_size))
     {
-        dprintf(CRITICAL, "Tags地址无效。\n");
+        dprintf(CRITICAL, "在文件%s第%u行检测到bootimage头部字段整数溢出\n", __FILE__, __LINE__);
         return -1;
     }
+    imagesize_actual = (page_size + kernel_actual + ramdisk_actual + second_actual);
 #endif
 
-#if DEVICE_TREE
-    // 处理设备树
-    if (dt_size)
+#ifdef OSVERSION_IN_BOOTIMAGE
+    /* 如果头部版本为ONE且正在启动恢复模式，
+       dtbo会附加到恢复镜像中。
+       执行以下操作：
+         * 验证恢复偏移量和大小
+         * 提取恢复dtbo作为dtbo使用
+    */
+    if (boot_into_recovery &&
+        hdr->header_version == BOOT_HEADER_VERSION_ONE)
     {
-        // 计算设备树表偏移量
-        dt_table_offset = ((uint32_t)image_addr + page_size + kernel_actual + ramdisk_actual + second_actual);
-        table = (struct dt_table *)dt_table_offset;
+        // 获取v1头部结构
+        struct boot_img_hdr_v1 *hdr1 =
+            (struct boot_img_hdr_v1 *)(image_addr + sizeof(boot_img_hdr));
+        unsigned int recovery_dtbo_actual = 0;
 
-        // 验证设备树表
-        if (dev_tree_validate(table, hdr->page_size, &dt_hdr_size) != 0)
+        // 计算恢复dtbo的实际大小
+        recovery_dtbo_actual = ROUND_TO_PAGE(hdr1->recovery_dtbo_size, page_mask);
+        
+        // 验证头部大小
+        if ((hdr1->header_size !=
+             sizeof(struct boot_img_hdr_v1) + sizeof(boot_img_hdr)))
         {
-            dprintf(CRITICAL, "错误：无法验证设备树表\n");
+            dprintf(CRITICAL, "无效的boot镜像头部：%d\n", hdr1->header_size);
             return -1;
         }
 
-        /* 如果dt_hdr_size（table->num_entries * dt_entry大小 + 设备树头部）
-           超出hdr->dt_size则是错误 */
-        if (dt_hdr_size > ROUND_TO_PAGE(dt_size, hdr->page_size))
+        // 检查dtbo大小是否超出限制
+        if (recovery_dtbo_actual > MAX_SUPPORTED_DTBO_IMG_BUF)
         {
-            dprintf(CRITICAL, "错误：无效的设备树大小\n");
+            dprintf(CRITICAL, "恢复Dtbo大小过大 0x%x，允许大小 0x%x\n", recovery_dtbo_actual,
+                    MAX_SUPPORTED_DTBO_IMG_BUF);
             return -1;
         }
 
-        // 在设备树表中查找设备树条目索引
-        if (dev_tree_get_entry_info(table, &dt_entry) != 0)
+        // 检查整数溢出
+        if (UINT_MAX < ((uint64_t)imagesize_actual + recovery_dtbo_actual))
         {
-            dprintf(CRITICAL, "错误：获取设备树地址失败\n");
+            dprintf(CRITICAL, "在文件%s第%u行检测到恢复镜像头部字段整数溢出\n", __FILE__, __LINE__);
             return -1;
         }
 
         // 检查偏移量和大小的组合溢出
-        if (dt_entry.offset > (UINT_MAX - dt_entry.size))
+        if (UINT_MAX < (hdr1->recovery_dtbo_offset + recovery_dtbo_actual))
         {
-            dprintf(CRITICAL, "错误：设备树内容无效\n");
+            dprintf(CRITICAL,
+                    "在文件%s第%u行检测到恢复镜像头部字段整数溢出\n", __FILE__, __LINE__);
             return -1;
         }
 
-        // 确保选中的dt_entry不超过dt_size
-        if ((dt_entry.offset + dt_entry.size) > dt_size)
+        // 验证恢复dtbo是否在镜像范围内
+        if (hdr1->recovery_dtbo_offset + recovery_dtbo_actual > image_size)
         {
-            dprintf(CRITICAL, "错误：设备树内容无效\n");
+            dprintf(CRITICAL, "无效的恢复dtbo：恢复Dtbo偏移量=0x%llx,"
+                              " 恢复Dtbo大小=0x%x, 镜像大小=0x%llx\n",
+                    hdr1->recovery_dtbo_offset, recovery_dtbo_size, image_size);
             return -1;
         }
 
-        // 检查设备树是否为gzip格式并解压
-        if (is_gzip_package((unsigned char *)dt_table_offset + dt_entry.offset, dt_entry.size))
-        {
-            unsigned int compressed_size = 0;
-            // 调整输出地址和可用空间
-            out_addr += out_len;
-            out_avai_len -= out_len;
-            
-            dprintf(INFO, "正在解压dtb：开始\n");
-            // 解压设备树
-            rc = decompress((unsigned char *)dt_table_offset + dt_entry.offset,
-                            dt_entry.size, out_addr, out_avai_len,
-                            &compressed_size, &dtb_size);
-            if (rc)
-            {
-                dprintf(CRITICAL, "解压dtb失败！！！\n");
-                ASSERT(0);
-            }
+        // 设置恢复dtbo缓冲区和大小
+        recovery_dtbo_buf = (void *)(hdr1->recovery_dtbo_offset + image_addr);
+        recovery_dtbo_size = recovery_dtbo_actual;
+        imagesize_actual += recovery_dtbo_size;
 
-            dprintf(INFO, "正在解压dtb：完成\n");
-            best_match_dt_addr = out_addr;
-        }
-        else
-        {
-            // 使用未压缩的设备树
-            best_match_dt_addr = (unsigned char *)dt_table_offset + dt_entry.offset;
-            dtb_size = dt_entry.size;
-        }
+        // 输出调试信息
+        dprintf(SPEW, "头部版本：%d\n", hdr->header_version);
+        dprintf(SPEW, "恢复Dtbo大小 0x%x\n", recovery_dtbo_size);
+        dprintf(SPEW, "恢复Dtbo偏移量 0x%llx\n", hdr1->recovery_dtbo_offset);
+    }
 
-        // 验证并在tags_addr中读取设备树
-        if (check_aboot_addr_range_overlap(hdr->tags_addr, dtb_size) ||
-            check_ddr_addr_range_bound(hdr->tags_addr, dtb_size))
-        {
-            dprintf(CRITICAL, "设备树地址无效\n");
-            return -1;
-        }
+    // 处理头部版本为TWO的情况
+    if (hdr->header_version == BOOT_HEADER_VERSION_TWO)
+    {
+        // 获取v1和v2头部结构
+        struct boot_img_hdr_v1 *hdr1 =
+            (struct boot_img_hdr_v1 *)(image_addr + sizeof(boot_img_hdr));
+        struct boot_img_hdr_v2 *hdr2 = (struct boot_img_hdr_v2 *)(image_addr + sizeof(boot_img_hdr) +
+                                                                  BOOT_IMAGE_HEADER_V2_OFFSET);
+        unsigned int recovery_dtbo_actual = 0;
 
-        // 将设备树移动到tags地址
-        memmove((void *)hdr->tags_addr, (char *)best_match_dt_addr, dtb_size);
+        // 计算恢复dtbo实际大小并加入总大小
+        recovery_dtbo_actual =
+            ROUND_TO_PAGE(hdr1->recovery_dtbo_size, page_mask);
+        imagesize_actual += recovery_dtbo_actual;
+
+        // 加入dtb大小
+        imagesize_actual += ROUND_TO_PAGE(hdr2->dtb_size, page_mask);
+
+        // 计算dtb镜像偏移量
+        dtb_image_offset = page_size + patched_kernel_hdr_size +
+                           kernel_actual + ramdisk_actual + second_actual +
+                           recovery_dtbo_actual;
+
+        // 输出调试信息
+        dprintf(SPEW, "头部版本：%d\n", hdr->header_version);
+        dprintf(SPEW, "Dtb镜像偏移量 0x%x\n", dtb_image_offset);
+    }
+#endif
+
+    // 验证boot/恢复镜像大小是否在分区大小范围内
+    if (imagesize_actual > image_size)
+    {
+        dprintf(CRITICAL, "镜像大小大于分区大小。\n");
+        return -1;
+    }
+
+    /*
+     * With direct loading only the kernel and the DT table are kept in the
+     * scratch region, the DT table right after the kernel. The ramdisk is
+     * read to ramdisk_addr once everything else is done.
+     */
+    direct_load = boot_img_direct_load(hdr);
+    loaded_actual = imagesize_actual;
+    if (direct_load)
+    {
+        loaded_actual = page_size + kernel_actual;
+#if DEVICE_TREE
+        loaded_actual += dt_actual;
+#endif
+    }
+
+#if VERIFIED_BOOT
+    // 初始化启动验证器
+    boot_verifier_init();
+#endif
+
+#if VERIFIED_BOOT_2
+    // 如果设备已解锁，则读取完整分区
+    if (device.is_unlocked)
+        imagesize_actual = image_size;
+#endif
+
+    // 检查boot镜像缓冲区地址是否与aboot地址重叠
+    if (check_aboot_addr_range_overlap((uintptr_t)image_addr, loaded_actual))
+    {
+        dprintf(CRITICAL, "Boot镜像缓冲区地址与aboot地址重叠。\n");
+        return -1;
+    }
+
+    /*
+     * 更新boot镜像加载流程以支持压缩/未压缩的
+     * boot镜像在64位和32位平台上。
+     * 1. 从emmc分区加载boot镜像到DDR。
+     * 2. 检查boot镜像是否为gzip格式。如果是，解压压缩内核
+     * 3. 检查内核头部并相应更新64位和32位平台的内核加载地址。
+     * 4. 对kernel_addr和ramdisk_addr进行健全性检查并复制数据。
+     */
+    
+    // 处理多槽位启动情况
+    if (partition_multislot_is_supported())
+    {
+        current_active_slot = partition_find_active_slot();
+        dprintf(INFO, "正在加载boot镜像 (%d) 活动槽位(%s)：开始\n",
+                imagesize_actual, SUFFIX_SLOT(current_active_slot));
     }
     else
     {
-        // 验证tags_addr
-        if (check_aboot_addr_range_overlap(hdr->tags_addr, kernel_actual) ||
-            check_ddr_addr_range_bound(hdr->tags_addr, kernel_actual))
+        dprintf(INFO, "正在加载(%s)镜像 (%d)：开始\n",
+                (!boot_into_recovery ? "boot" : "recovery"), imagesize_actual);
+    }
+    
+    // 设置内核加载开始时间戳
+    bs_set_timestamp(BS_KERNEL_LOAD_START);
+
+    // 检查DDR是否有足够空间容纳镜像
+    if ((target_get_max_flash_size() - page_size) < loaded_actual)
+    {
+        dprintf(CRITICAL, "boot镜像大小超过DDR可容纳范围\n");
+        return -1;
+    }
+    
+    offset = page_size;
+    if (direct_load)
+    {
+        /*
+         * Start with the first page of the kernel. It decides if the kernel
+         * needs to be decompressed from the scratch region or can be read
+         * directly to its load address later.
+         */
+        if (mmc_read(ptn + offset, (void *)(image_addr + offset), MIN(page_size, kernel_actual)))
         {
-            dprintf(CRITICAL, "设备树地址无效。\n");
+            dprintf(CRITICAL, "错误：无法读取boot镜像\n");
             return -1;
         }
-        
-        /*
-         * 如果找到附加的设备树，则使用指向RAM上DTB附加位置的
-         * 内存地址更新atags。
-         * 否则使用内核头部中的atags地址更新
-         *
-         * 确保在下一步之前从scratch地址读取所有内容！
-         * 在dtbo的情况下，此API将在scratch上读取dtbo。
-         */
-        void *dtb;
-        image_buf = (void *)(image_addr + page_size + patched_kernel_hdr_size);
 
-#ifdef OSVERSION_IN_BOOTIMAGE
-        // 处理头部版本为TWO的情况
-        if (hdr->header_version == BOOT_HEADER_VERSION_TWO)
+        direct_kernel = kernel_actual &&
+            !is_gzip_package((unsigned char *)(image_addr + page_size), hdr->kernel_size) &&
+            !lz4_is_compressed((unsigned char *)(image_addr + page_size), hdr->kernel_size) &&
+            strncmp((char *)(image_addr + page_size), PATCHED_KERNEL_MAGIC,
+                    sizeof(PATCHED_KERNEL_MAGIC) - 1);
+
+        if (!direct_kernel && kernel_actual > page_size &&
+            mmc_read(ptn + offset + page_size, (void *)(image_addr + offset + page_size),
+                     kernel_actual - page_size))
         {
-            image_buf = (void *)(image_addr);
-            dtb_offset = dtb_image_offset;
-            dtb_image_size = imagesize_actual;
+            dprintf(CRITICAL, "错误：无法读取boot镜像\n");
+            return -1;
         }
-#endif
 
-        // 查找附加的设备树blob
-        dtb = dev_tree_appended(image_buf, dtb_image_size, dtb_offset,
-                                (void *)hdr->tags_addr);
-        if (!dtb)
+#if DEVICE_TREE
+        if (dt_actual &&
+            mmc_read(ptn + page_size + kernel_actual + ramdisk_actual + second_actual,
+                     (void *)(image_addr + page_size + kernel_actual), dt_actual))
         {
-            dprintf(CRITICAL, "错误：未找到附加的设备树Blob\n");
-#if WITH_LK2ND_DEVICE_2ND
-            // 检查lk2nd第二设备是否有atags
-            if (lk2nd_device2nd_have_atags())
-                boot_type |= BOOT_ATAGS_COPY;
-            else
+            dprintf(CRITICAL, "错误：无法读取boot镜像\n");
+            return -1;
+        }
 #endif
-                return -1;
+    }
+    else if (!IS_ENABLED(VERIFIED_BOOT) && !IS_ENABLED(VERIFIED_BOOT_2) &&
+             ((target_use_signed_kernel() && !device.is_unlocked) || is_test_mode_enabled()))
+    {
+        /* The signature is checked later, hash the image while reading it */
+        rc = read_bootimg_hashed(ptn, image_addr, offset, imagesize_actual, bootimg_digest);
+        if (rc < 0)
+        {
+            dprintf(CRITICAL, "错误：无法读取boot镜像\n");
+            return -1;
         }
+        bootimg_hashed = rc > 0;
+    }
+    /* 读取不包含签名和头部的镜像 */
+    else if (mmc_read(ptn + offset, (void *)(image_addr + offset), imagesize_actual - page_size))
+    {
+        dprintf(CRITICAL, "错误：无法读取boot镜像\n");
+        return -1;
     }
-#endif
 
-    // 将内核、ramdisk和设备树移动到正确的地址
-    memmove((void *)hdr->kernel_addr, kernel_start_addr, kernel_size);
-    memmove((void *)hdr->ramdisk_addr, (char *)(image_addr + page_size + kernel_actual), hdr->ramdisk_size);
+    // 输出加载完成信息
+    if (partition_multislot_is_supported())
+    {
+        dprintf(INFO, "正在加载boot镜像 (%d) 活动槽位(%s)：完成\n",
+                imagesize_actual, SUFFIX_SLOT(current_active_slot));
+    }
+    else
+    {
+        dprintf(INFO, "正在加载(%s)镜像 (%d)：完成\n",
+                (!boot_into_recovery ? "boot" : "recovery"), imagesize_actual);
+    }
+    
+    // 设置内核加载完成时间戳
+    bs_set_timestamp(BS_KERNEL_LOAD_DONE);
 
-    // 如果是恢复模式且设备未解锁且未被篡改，则加载ssd密钥库
-    if (boot_into_recovery && !device.is_unlocked && !device.is_tampered)
-        target_load_ssd_keystore();
+    // 内核认证信息输出
+    dprintf(INFO, "use_signed_kernel=%d, is_unlocked=%d, is_tampered=%d.\n",
+            (int)target_use_signed_kernel(),
+            device.is_unlocked,
+            device.is_tampered);
 
-// 统一启动标签
-unified_boot:
+#if VERIFIED_BOOT_2
+    // 如果设备未解锁则读取签名（已解锁时读取完整分区）
+    if (!device.is_unlocked)
+    {
+        offset = imagesize_actual;
+        // 检查签名读取缓冲区地址是否与aboot地址重叠
+        if (check_aboot_addr_range_overlap((uintptr_t)image_addr + offset, page_size))
+        {
+            dprintf(CRITICAL, "签名读取缓冲区地址与aboot地址重叠。\n");
+            return -1;
+        }
 
-    // 启动Linux内核
-    boot_linux((void *)hdr->kernel_addr, (void *)hdr->tags_addr,
-               (const char *)hdr->cmdline, board_machtype(),
-               (void *)hdr->ramdisk_addr, hdr->ramdisk_size,
-               boot_type);
+        // 读取签名
+        if (mmc_read(ptn + offset, (void *)(image_addr + offset), page_size))
+        {
+            dprintf(CRITICAL, "错误：无法读取boot镜像签名\n");
+            return -1;
+        }
+    }
 
-    return 0;
-}
-/**
- * @brief 从Flash启动Linux系统。
- *
- * 该函数负责从Flash存储器中读取boot.img镜像并启动Linux内核。
- * 它会验证镜像头、读取内核和ramdisk数据、处理设备树（如果存在），
- * 并最终跳转到内核入口点执行。
- *
- * @return 0 表示成功，负数表示错误码。
- */
-int boot_linux_from_flash(void)
-{
-	// 定义boot镜像头指针，指向全局缓冲区
-	boot_img_hdr *hdr = (void *)buf;
+    // 加载并验证dtbo分区
+    load_validate_dtbo_image(&dtbo_image_buf, &dtbo_image_sz);
+
+    // 加载vbmeta分区
+    load_vbmeta_image(&vbmeta_image_buf, &vbmeta_image_sz);
+
+    // 初始化启动信息结构
+    memset(&info, 0, sizeof(bootinfo));
+
+    // 传递加载的boot镜像信息
+    info.images[IMG_BOOT].image_buffer = SUB_SALT_BUFF_OFFSET(image_addr);
+    info.images[IMG_BOOT].imgsize = imagesize_actual;
+    info.images[IMG_BOOT].name = ptn_name;
+    ++info.num_loaded_images;
+
+    // 传递加载的dtbo镜像信息
+    if (dtbo_image_buf != NULL)
+    {
+        info.images[IMG_DTBO].image_buffer =
+            SUB_SALT_BUFF_OFFSET(dtbo_image_buf);
+        info.images[IMG_DTBO].imgsize = dtbo_image_sz;
+        info.images[IMG_DTBO].name = "dtbo";
+        ++info.num_loaded_images;
+    }
+
+    // 传递加载的vbmeta镜像信息
+    if (vbmeta_image_buf != NULL)
+    {
+        info.images[IMG_VBMETA].image_buffer = vbmeta_image_buf;
+        info.images[IMG_VBMETA].imgsize = vbmeta_image_sz;
+        info.images[IMG_VBMETA].name = "vbmeta";
+        ++info.num_loaded_images;
+    }
+
+    // 设置其他启动信息
+    info.header_version = hdr->header_version;
+    info.multi_slot_boot = partition_multislot_is_supported();
+    info.bootreason_alarm = boot_reason_alarm;
+    info.bootinto_recovery = boot_into_recovery;
+    
+    // 加载镜像并进行认证
+    status = load_image_and_auth(&info);
+    if (status)
+        return -1;
+
+    // 获取验证后的命令行
+    vbcmdline = info.vbcmdline;
+
+    // 验证后释放vbmeta分配的缓冲区
+    if (vbmeta_image_buf != NULL)
+    {
+        free(vbmeta_image_buf);
+        --info.num_loaded_images;
+    }
+#else
+    /* 稍微修改条件以包含测试框架支持。
+     * 如果设备处于fastboot模式我们永远不会到达这一点，即使到了
+     * 这意味着我们在测试模式下，所以为测试执行内核认证部分
+     */
+    if ((target_use_signed_kernel() && (!device.is_unlocked)) || is_test_mode_enabled())
+    {
+        offset = imagesize_actual;
+        // 检查签名读取缓冲区地址重叠
+        if (check_aboot_addr_range_overlap((uintptr_t)image_addr + offset, page_size))
+        {
+            dprintf(CRITICAL, "签名读取缓冲区地址与aboot地址重叠。\n");
+            return -1;
+        }
+
+        // 读取签名
+        if (mmc_read(ptn + offset, (void *)(image_addr + offset), page_size))
+        {
+            dprintf(CRITICAL, "错误：无法读取boot镜像签名\n");
+            return -1;
+        }
+
+        // 验证签名的boot镜像
+        verify_signed_bootimg((uint32_t)image_addr, imagesize_actual,
+                              bootimg_hashed ? bootimg_digest : NULL);
+        /* 我们的测试目的到这里就完成了 */
+        if (is_test_mode_enabled() && auth_kernel_img)
+            return 0;
+    }
+    else
+    {
+        second_actual = ROUND_TO_PAGE(hdr->second_size, page_mask);
+#ifdef TZ_SAVE_KERNEL_HASH
+        // 保存内核哈希到安全区域
+        aboot_save_boot_hash_mmc((uint32_t)image_addr, imagesize_actual);
+#endif /* TZ_SAVE_KERNEL_HASH */
+
+#ifdef MDTP_SUPPORT
+        {
+            // 验证MDTP锁
+            mdtp_ext_partition_verification_t ext_partition;
+            ext_partition.partition = boot_into_recovery ? MDTP_PARTITION_RECOVERY : MDTP_PARTITION_BOOT;
+            ext_partition.integrity_state = MDTP_PARTITION_STATE_UNSET;
+            ext_partition.page_size = page_size;
+            ext_partition.image_addr = (uint32)image_addr;
+            ext_partition.image_size = imagesize_actual;
+            ext_partition.sig_avail = FALSE;
+            mdtp_fwlock_verify_lock(&ext_partition);
+        }
+#endif /* MDTP_SUPPORT */
+    }
+#endif
+
+#if VERIFIED_BOOT
+    // 处理橙色状态（设备已解锁但不可信）
+    if ((boot_verify_get_state() == ORANGE) && (!boot_into_ffbm))
+    {
+#if FBCON_DISPLAY_MSG
+        // 显示启动验证菜单
+        display_bootverify_menu(DISPLAY_MENU_ORANGE);
+        wait_for_users_action();
+#else
+        dprintf(CRITICAL,
+                "您的设备已被解锁且不可信。\n请等待5秒后继续\n");
+        mdelay(5000);
+#endif
+    }
+#endif
+
+#if VERIFIED_BOOT
+    // 处理VB_M版本的验证启动
+    if (VB_M == target_get_vb_version())
+    {
+        // 设置boot和system版本
+        set_os_version((unsigned char *)image_addr);
+        // 发送信任根
+        if (!send_rot_command((uint32_t)device.is_unlocked))
+            ASSERT(0);
+    }
+#endif
+
+    /*
+     * 检查内核镜像是否为gzip包。如果是，需要解压它。
+     * 如果不是，继续启动。
+     */
+    if (is_gzip_package((unsigned char *)(image_addr + page_size), hdr->kernel_size))
+    {
+        // 设置解压输出地址和可用长度
+        out_addr = (unsigned char *)(image_addr + loaded_actual + page_size);
+        out_avai_len = target_get_max_flash_size() - loaded_actual - page_size;
+#if VERIFIED_BOOT_2
+        // 如果有dtbo镜像，减少可用空间
+        if (dtbo_image_sz)
+            out_avai_len -= DTBO_IMG_BUF;
+#endif
+        
+        dprintf(INFO, "正在解压内核镜像：开始\n");
+        // 执行解压操作
+        rc = decompress((unsigned char *)(image_addr + page_size),
+                        hdr->kernel_size, out_addr, out_avai_len,
+                        &dtb_offset, &out_len);
+        if (rc)
+        {
+            dprintf(CRITICAL, "解压内核镜像失败！！！\n");
+            ASSERT(0);
+        }
+
+        dprintf(INFO, "正在解压内核镜像：完成\n");
+        // 设置解压后的内核相关信息
+        kptr = (struct kernel64_hdr *)out_addr;
+        kernel_start_addr = out_addr;
+        kernel_size = out_len;
+    }
+    else if (lz4_is_compressed((unsigned char *)(image_addr + page_size), hdr->kernel_size))
+    {
+        size_t lz4_in, lz4_out;
+
+        out_addr = (unsigned char *)(image_addr + loaded_actual + page_size);
+        out_avai_len = target_get_max_flash_size() - loaded_actual - page_size;
+#if VERIFIED_BOOT_2
+        if (dtbo_image_sz)
+            out_avai_len -= DTBO_IMG_BUF;
+#endif
+
+        dprintf(INFO, "正在解压LZ4内核镜像：开始\n");
+        rc = lz4_decompress((unsigned char *)(image_addr + page_size),
+                            hdr->kernel_size, out_addr, out_avai_len,
+                            &lz4_in, &lz4_out);
+        if (rc)
+        {
+            dprintf(CRITICAL, "解压LZ4内核镜像失败：%d\n", rc);
+            ASSERT(0);
+        }
+
+        dprintf(INFO, "正在解压LZ4内核镜像：完成\n");
+        // 追加的dtb紧跟在压缩数据之后
+        dtb_offset = lz4_in;
+        kptr = (struct kernel64_hdr *)out_addr;
+        kernel_start_addr = out_addr;
+        kernel_size = lz4_out;
+    }
+    else
+    {
+        dprintf(INFO, "使用未压缩内核\n");
+        // 检查是否为修补过的内核
+        if (!strncmp((char *)(image_addr + page_size),
+                     PATCHED_KERNEL_MAGIC,
+                     sizeof(PATCHED_KERNEL_MAGIC) - 1))
+        {
+            dprintf(INFO, "检测到修补内核\n");
+            // 设置修补内核的相关信息
+            kptr = (struct kernel64_hdr *)(image_addr + page_size +
+                                           PATCHED_KERNEL_HEADER_SIZE);
+            // 内核大小存储在内核镜像起始位置+16字节
+            // dtb将在内核之后开始
+            dtb_offset = *((uint32_t *)((unsigned char *)(image_addr + page_size +
+                                                          sizeof(PATCHED_KERNEL_MAGIC) -
+                                                          1)));
+            // 实际内核在20字节头部之后开始
+            kernel_start_addr = (unsigned char *)(image_addr +
+                                                  page_size + PATCHED_KERNEL_HEADER_SIZE);
+            kernel_size = hdr->kernel_size;
+            patched_kernel_hdr_size = PATCHED_KERNEL_HEADER_SIZE;
+        }
+        else
+        {
+            dprintf(INFO, "内核镜像未修补..无法定位dt偏移量\n");
+            // 使用标准内核头部
+            kptr = (struct kernel64_hdr *)(image_addr + page_size);
+            kernel_start_addr = (unsigned char *)(image_addr + page_size);
+            kernel_size = hdr->kernel_size;
+        }
+    }
+
+    // 修复text_offset过大的问题（HACK方式）
+    if (kptr->text_offset > 2 * 1024 * 1024)
+        kptr->text_offset = 0;
+
+    /*
+     * 如果boot镜像头部具有默认值，则更新内核/ramdisk/tags地址，
+     * 这些默认值来自mkbootimg，当使用fastboot flash:raw刷写boot镜像时产生
+     */
+    update_ker_tags_rdisk_addr(hdr, kptr);
+
+    // 获取虚拟地址（因为hdr保存的是物理地址）
+    hdr->kernel_addr = VA((addr_t)(hdr->kernel_addr));
+    hdr->ramdisk_addr = VA((addr_t)(hdr->ramdisk_addr));
+    hdr->tags_addr = VA((addr_t)(hdr->tags_addr));
+
+    // 按页面对齐内核大小
+    kernel_size = ROUND_TO_PAGE(kernel_size, page_mask);
+    
+    // 检查头部中的地址是否有效
+    if (check_aboot_addr_range_overlap(hdr->kernel_addr, kernel_size) ||
+        check_ddr_addr_range_bound(hdr->kernel_addr, kernel_size) ||
+        check_aboot_addr_range_overlap(hdr->ramdisk_addr, ramdisk_actual) ||
+        check_ddr_addr_range_bound(hdr->ramdisk_addr, ramdisk_actual))
+    {
+        dprintf(CRITICAL, "内核/ramdisk地址无效。\n");
+        return -1;
+    }
+
+    /* Read the rest of an uncompressed kernel directly to its load address */
+    if (direct_kernel)
+    {
+        unsigned char *kernel_dst = (unsigned char *)hdr->kernel_addr;
+        unsigned kernel_done = 0;
+
+        /* Keep using the scratch region if the kernel would overwrite it */
+        if (ranges_overlap(hdr->kernel_addr, kernel_size, (uintptr_t)image_addr, loaded_actual))
+        {
+            direct_kernel = false;
+            kernel_dst = image_addr + page_size;
+            kernel_done = page_size;
+        }
+
+        if (kernel_done < kernel_actual &&
+            mmc_read(ptn + page_size + kernel_done, (void *)(kernel_dst + kernel_done),
+                     kernel_actual - kernel_done))
+        {
+            dprintf(CRITICAL, "错误：无法读取boot镜像\n");
+            return -1;
+        }
+    }
+
+#ifndef DEVICE_TREE
+    // 在非设备树环境下检查tags地址
+    (void)patched_kernel_hdr_size;
+    if (check_aboot_addr_range_overlap(hdr->tags_addr, MAX_TAGS_SIZE) ||
+        check_ddr_addr_range_bound(hdr->tags_addr, MAX_TAGS_SIZE))
+    {
+        dprintf(CRITICAL, "Tags地址无效。\n");
+        return -1;
+    }
+#endif
+
+#if DEVICE_TREE
+    // 处理设备树
+    if (dt_size)
+    {
+        // 计算设备树表偏移量
+        dt_table_offset = ((uint32_t)image_addr + page_size + kernel_actual + ramdisk_actual + second_actual);
+        if (direct_load)
+            dt_table_offset = (uint32_t)image_addr + page_size + kernel_actual;
+        table = (struct dt_table *)dt_table_offset;
+
+        // 验证设备树表
+        if (dev_tree_validate(table, hdr->page_size, &dt_hdr_size) != 0)
+        {
+            dprintf(CRITICAL, "错误：无法验证设备树表\n");
+            return -1;
+        }
+
+        /* 如果dt_hdr_size（table->num_entries * dt_entry大小 + 设备树头部）
+           超出hdr->dt_size则是错误 */
+        if (dt_hdr_size > ROUND_TO_PAGE(dt_size, hdr->page_size))
+        {
+            dprintf(CRITICAL, "错误：无效的设备树大小\n");
+            return -1;
+        }
+
+        // 在设备树表中查找设备树条目索引
+        if (dev_tree_get_entry_info(table, &dt_entry) != 0)
+        {
+            dprintf(CRITICAL, "错误：获取设备树地址失败\n");
+            return -1;
+        }
+
+        // 检查偏移量和大小的组合溢出
+        if (dt_entry.offset > (UINT_MAX - dt_entry.size))
+        {
+            dprintf(CRITICAL, "错误：设备树内容无效\n");
+            return -1;
+        }
+
+        // 确保选中的dt_entry不超过dt_size
+        if ((dt_entry.offset + dt_entry.size) > dt_size)
+        {
+            dprintf(CRITICAL, "错误：设备树内容无效\n");
+            return -1;
+        }
+
+        // 检查设备树是否为gzip格式并解压
+        if (is_gzip_package((unsigned char *)dt_table_offset + dt_entry.offset, dt_entry.size))
+        {
+            unsigned int compressed_size = 0;
+            // 调整输出地址和可用空间
+            out_addr += out_len;
+            out_avai_len -= out_len;
+            
+            dprintf(INFO, "正在解压dtb：开始\n");
+            // 解压设备树
+            rc = decompress((unsigned char *)dt_table_offset + dt_entry.offset,
+                            dt_entry.size, out_addr, out_avai_len,
+                            &compressed_size, &dtb_size);
+            if (rc)
+            {
+                dprintf(CRITICAL, "解压dtb失败！！！\n");
+                ASSERT(0);
+            }
+
+            dprintf(INFO, "正在解压dtb：完成\n");
+            best_match_dt_addr = out_addr;
+        }
+        else
+        {
+            // 使用未压缩的设备树
+            best_match_dt_addr = (unsigned char *)dt_table_offset + dt_entry.offset;
+            dtb_size = dt_entry.size;
+        }
+
+        // 验证并在tags_addr中读取设备树
+        if (check_aboot_addr_range_overlap(hdr->tags_addr, dtb_size) ||
+            check_ddr_addr_range_bound(hdr->tags_addr, dtb_size))
+        {
+            dprintf(CRITICAL, "设备树地址无效\n");
+            return -1;
+        }
+
+        // 将设备树移动到tags地址
+        memmove((void *)hdr->tags_addr, (char *)best_match_dt_addr, dtb_size);
+    }
+    else
+    {
+        // 验证tags_addr
+        if (check_aboot_addr_range_overlap(hdr->tags_addr, kernel_actual) ||
+            check_ddr_addr_range_bound(hdr->tags_addr, kernel_actual))
+        {
+            dprintf(CRITICAL, "设备树地址无效。\n");
+            return -1;
+        }
+        
+        /*
+         * 如果找到附加的设备树，则使用指向RAM上DTB附加位置的
+         * 内存地址更新atags。
+         * 否则使用内核头部中的atags地址更新
+         *
+         * 确保在下一步之前从scratch地址读取所有内容！
+         * 在dtbo的情况下，此API将在scratch上读取dtbo。
+         */
+        void *dtb;
+        image_buf = (void *)(image_addr + page_size + patched_kernel_hdr_size);
+        if (direct_kernel)
+            image_buf = (void *)hdr->kernel_addr;
+
+#ifdef OSVERSION_IN_BOOTIMAGE
+        // 处理头部版本为TWO的情况
+        if (hdr->header_version == BOOT_HEADER_VERSION_TWO)
+        {
+            image_buf = (void *)(image_addr);
+            dtb_offset = dtb_image_offset;
+            dtb_image_size = imagesize_actual;
+        }
+#endif
+
+        // 查找附加的设备树blob
+        dtb = dev_tree_appended(image_buf, dtb_image_size, dtb_offset,
+                                (void *)hdr->tags_addr);
+        if (!dtb)
+        {
+            dprintf(CRITICAL, "错误：未找到附加的设备树Blob\n");
+#if WITH_LK2ND_DEVICE_2ND
+            // 检查lk2nd第二设备是否有atags
+            if (lk2nd_device2nd_have_atags())
+                boot_type |= BOOT_ATAGS_COPY;
+            else
+#endif
+                return -1;
+        }
+    }
+#endif
+
+    // 将内核、ramdisk和设备树移动到正确的地址
+    if (!direct_kernel)
+        lk2nd_memcpy((void *)hdr->kernel_addr, kernel_start_addr, kernel_size);
+    if (!direct_load)
+        lk2nd_memcpy((void *)hdr->ramdisk_addr, (char *)(image_addr + page_size + kernel_actual), hdr->ramdisk_size);
+    else if (ramdisk_actual &&
+             mmc_read(ptn + page_size + kernel_actual, (void *)hdr->ramdisk_addr, ramdisk_actual))
+    {
+        dprintf(CRITICAL, "错误：无法读取boot镜像\n");
+        return -1;
+    }
+
+    // 如果是恢复模式且设备未解锁且未被篡改，则加载ssd密钥库
+    if (boot_into_recovery && !device.is_unlocked && !device.is_tampered)
+        target_load_ssd_keystore();
+
+// 统一启动标签
+unified_boot:
+
+    // 启动Linux内核
+    boot_linux((void *)hdr->kernel_addr, (void *)hdr->tags_addr,
+               (const char *)hdr->cmdline, board_machtype(),
+               (void *)hdr->ramdisk_addr, hdr->ramdisk_size,
+               boot_type);
+
+    return 0;
+}
+/**
+ * @brief 从Flash启动Linux系统。
+ *
+ * 该函数负责从Flash存储器中读取boot.img镜像并启动Linux内核。
+ * 它会验证镜像头、读取内核和ramdisk数据、处理设备树（如果存在），
+ * 并最终跳转到内核入口点执行。
+ *
+ * @return 0 表示成功，负数表示错误码。
+ */
+int boot_linux_from_flash(void)
+{
+	// 定义boot镜像头指针，指向全局缓冲区
+	boot_img_hdr *hdr = (void *)buf;
+
+	// 定义分区表项和分区表指针
+	struct ptentry *ptn;
+	struct ptable *ptable;
+
+	// 定义读取偏移量，初始为0
+	unsigned offset = 0;
+
+	// 定义镜像加载地址、实际大小等变量
+	unsigned char *image_addr = 0;
+	unsigned kernel_actual;
+	unsigned ramdisk_actual;
+	unsigned imagesize_actual;
+	unsigned second_actual = 0;
+	enum boot_type boot_type = 0;
+
+#if DEVICE_TREE
+	// 如果启用设备树支持，定义相关变量
+	struct dt_table *table = NULL;
+	struct dt_entry dt_entry;
+	unsigned dt_table_offset;
+	uint32_t dt_actual;
+	uint32_t dt_hdr_size = 0;
+	uint32_t dtb_offset = 0;
+	unsigned int dtb_size = 0;
+	unsigned char *best_match_dt_addr = NULL;
+#endif
+
+	// 检查是否为eMMC启动模式
+	if (target_is_emmc_boot())
+	{
+		// 如果是eMMC启动，直接使用预定义的boot镜像头地址
+		hdr = (boot_img_hdr *)EMMC_BOOT_IMG_HEADER_ADDR;
+
+		// 验证boot镜像魔数是否正确
+		if (memcmp(hdr->magic, BOOT_MAGIC, BOOT_MAGIC_SIZE))
+		{
+			dprintf(CRITICAL, "ERROR: Invalid boot image header\n");
+			return -1;
+		}
+		// 跳转到继续启动流程
+		goto continue_boot;
+	}
+
+	// 获取Flash分区表
+	ptable = flash_get_ptable();
+	if (ptable == NULL)
+	{
+		dprintf(CRITICAL, "ERROR: Partition table not found\n");
+		return -1;
+	}
+
+	// 根据启动模式选择对应的分区
+	if (!boot_into_recovery)
+	{
+		// 正常启动模式，查找boot分区
+		ptn = ptable_find(ptable, "boot");
+
+		if (ptn == NULL)
+		{
+			dprintf(CRITICAL, "ERROR: No boot partition found\n");
+			return -1;
+		}
+	}
+	else
+	{
+		// 恢复模式，查找recovery分区
+		ptn = ptable_find(ptable, "recovery");
+		if (ptn == NULL)
+		{
+			dprintf(CRITICAL, "ERROR: No recovery partition found\n");
+			return -1;
+		}
+	}
+
+	/* 从Flash读取boot.img头部 */
+	if (flash_read(ptn, offset, buf, page_size))
+	{
+		dprintf(CRITICAL, "ERROR: Cannot read boot image header\n");
+		return -1;
+	}
+
+	// 验证boot镜像头部魔数
+	if (memcmp(hdr->magic, BOOT_MAGIC, BOOT_MAGIC_SIZE))
+	{
+		dprintf(CRITICAL, "ERROR: Invalid boot image header\n");
+		return -1;
+	}
+
+	// 检查页面大小是否匹配
+	if (hdr->page_size != page_size)
+	{
+		dprintf(CRITICAL, "ERROR: Invalid boot image pagesize. Device pagesize: %d, Image pagesize: %d\n", page_size, hdr->page_size);
+		return -1;
+	}
+
+	// 获取目标平台的临时加载地址
+	image_addr = (unsigned char *)target_get_scratch_address();
+
+	// 将boot镜像头复制到加载地址
+	memcpy(image_addr, (void *)buf, page_size);
+
+	/*
+	 * 如果boot镜像头包含默认地址值，则更新内核/ramdisk/tags地址。
+	 * 这些默认值来自使用fastboot flash:raw刷写boot镜像时的mkbootimg工具。
+	 */
+	update_ker_tags_rdisk_addr(hdr, NULL);
+
+	// 将物理地址转换为虚拟地址
+	hdr->kernel_addr = VA((addr_t)(hdr->kernel_addr));
+	hdr->ramdisk_addr = VA((addr_t)(hdr->ramdisk_addr));
+	hdr->tags_addr = VA((addr_t)(hdr->tags_addr));
+
+	// 计算各部分的实际大小（向上对齐到页面边界）
+	kernel_actual = ROUND_TO_PAGE(hdr->kernel_size, page_mask);
+	ramdisk_actual = ROUND_TO_PAGE(hdr->ramdisk_size, page_mask);
+	second_actual = ROUND_TO_PAGE(hdr->second_size, page_mask);
+
+	// 确保命令行参数以null结尾
+	hdr->cmdline[BOOT_ARGS_SIZE - 1] = 0;
+
+	// 检查头部中的地址是否有效
+	if (check_aboot_addr_range_overlap(hdr->kernel_addr, kernel_actual) ||
+		check_ddr_addr_range_bound(hdr->kernel_addr, kernel_actual) ||
+		check_aboot_addr_range_overlap(hdr->ramdisk_addr, ramdisk_actual) ||
+		check_ddr_addr_range_bound(hdr->ramdisk_addr, ramdisk_actual))
+	{
+		dprintf(CRITICAL, "kernel/ramdisk addresses are not valid.\n");
+		return -1;
+	}
+
+#ifndef DEVICE_TREE
+	// 如果不使用设备树，检查整数溢出并计算镜像总大小
+	if (UINT_MAX < ((uint64_t)kernel_actual + (uint64_t)ramdisk_actual + (uint64_t)second_actual + page_size))
+	{
+		dprintf(CRITICAL, "Integer overflow detected in bootimage header fields\n");
+		return -1;
+	}
+	imagesize_actual = (page_size + kernel_actual + ramdisk_actual + second_actual);
+
+	// 验证tags地址有效性
+	if (check_aboot_addr_range_overlap(hdr->tags_addr, MAX_TAGS_SIZE) ||
+		check_ddr_addr_range_bound(hdr->tags_addr, MAX_TAGS_SIZE))
+	{
+		dprintf(CRITICAL, "Tags addresses are not valid.\n");
+		return -1;
+	}
+#else
+	// 如果使用设备树...
+
+#ifndef OSVERSION_IN_BOOTIMAGE
+	dt_size = hdr->dt_size;
+#endif
+	dt_actual = ROUND_TO_PAGE(dt_size, page_mask);
+
+	// 检查整数溢出
+	if (UINT_MAX < ((uint64_t)kernel_actual + (uint64_t)ramdisk_actual + (uint64_t)second_actual + (uint64_t)dt_actual + page_size))
+	{
+		dprintf(CRITICAL, "Integer overflow detected in bootimage header fields\n");
+		return -1;
+	}
+
+	// 计算包含设备树的镜像总大小
+	imagesize_actual = (page_size + kernel_actual + ramdisk_actual + second_actual + dt_actual);
+
+	// 验证设备树地址有效性
+	if (check_aboot_addr_range_overlap(hdr->tags_addr, dt_size) ||
+		check_ddr_addr_range_bound(hdr->tags_addr, dt_size))
+	{
+		dprintf(CRITICAL, "Device tree addresses are not valid.\n");
+		return -1;
+	}
+#endif
+
+	/* 从Flash读取完整的boot.img */
+	dprintf(INFO, "Loading (%s) image (%d): start\n",
+			(!boot_into_recovery ? "boot" : "recovery"), imagesize_actual);
+
+	// 设置启动时间戳
+	bs_set_timestamp(BS_KERNEL_LOAD_START);
+
+	// 检查整数溢出
+	if (UINT_MAX - page_size < imagesize_actual)
+	{
+		dprintf(CRITICAL, "Integer overflow detected in bootimage header fields %u %s\n", __LINE__, __func__);
+		return -1;
+	}
+
+	/* 检查RAM容量是否足够加载boot镜像和最大签名长度 */
+	if (target_get_max_flash_size() < (imagesize_actual + page_size))
+	{
+		dprintf(CRITICAL, "bootimage  size is greater than DDR can hold\n");
+		return -1;
+	}
+
+	// 设置读取偏移量为页面大小
+	offset = page_size;
+
+	/* 读取不含签名和头部的镜像数据 */
+	if (flash_read(ptn, offset, (void *)(image_addr + offset), imagesize_actual - page_size))
+	{
+		dprintf(CRITICAL, "ERROR: Cannot read boot image\n");
+		return -1;
+	}
+
+	dprintf(INFO, "Loading (%s) image (%d): done\n",
+			(!boot_into_recovery ? "boot" : "recovery"), imagesize_actual);
+
+	// 设置启动时间戳
+	bs_set_timestamp(BS_KERNEL_LOAD_DONE);
+
+	/* 验证内核签名 */
+	if (target_use_signed_kernel() && (!device.is_unlocked))
+	{
+		// 设置偏移量到镜像末尾（签名位置）
+		offset = imagesize_actual;
+
+		/* 读取签名数据 */
+		if (flash_read(ptn, offset, (void *)(image_addr + offset), page_size))
+		{
+			dprintf(CRITICAL, "ERROR: Cannot read boot image signature\n");
+			return -1;
+		}
+
+		// 验证签名的boot镜像
+		verify_signed_bootimg((uint32_t)image_addr, imagesize_actual, NULL);
+	}
+
+	// 重置偏移量
+	offset = page_size;
+
+	// 如果存在第二阶段镜像
+	if (hdr->second_size != 0)
+	{
+		// 检查整数溢出
+		if (UINT_MAX - offset < second_actual)
+		{
+			dprintf(CRITICAL, "ERROR: Integer overflow in boot image header %s\t%d\n", __func__, __LINE__);
+			return -1;
+		}
+
+		// 更新偏移量
+		offset += second_actual;
+
+		// 第二阶段镜像加载尚未实现
+		ASSERT(0);
+	}
+
+#if DEVICE_TREE
+	// 如果设备树大小不为0
+	if (dt_size != 0)
+	{
+		// 计算设备树表在镜像中的偏移量
+		dt_table_offset = ((uint32_t)image_addr + page_size + kernel_actual + ramdisk_actual + second_actual);
+
+		// 获取设备树表指针
+		table = (struct dt_table *)dt_table_offset;
+
+		// 验证设备树表
+		if (dev_tree_validate(table, hdr->page_size, &dt_hdr_size) != 0)
+		{
+			dprintf(CRITICAL, "ERROR: Cannot validate Device Tree Table \n");
+			return -1;
+		}
+
+		/* 如果dt_hdr_size（表项数量 * dt_entry大小 + 设备树头部）
+		   超过hdr->dt_size则是错误 */
+		if (dt_hdr_size > ROUND_TO_PAGE(dt_size, hdr->page_size))
+		{
+			dprintf(CRITICAL, "ERROR: Invalid Device Tree size \n");
+			return -1;
+		}
+
+		/* 在设备树表中查找设备树条目信息 */
+		if (dev_tree_get_entry_info(table, &dt_entry) != 0)
+		{
+			dprintf(CRITICAL, "ERROR: Getting device tree address failed\n");
+			return -1;
+		}
+
+		/* 验证并读取设备树到tags_addr */
+		if (check_aboot_addr_range_overlap(hdr->tags_addr, dt_entry.size) ||
+			check_ddr_addr_range_bound(hdr->tags_addr, dt_entry.size))
+		{
+			dprintf(CRITICAL, "Device tree addresses are not valid.\n");
+			return -1;
+		}
+
+		// 检查偏移量和大小的整数溢出
+		if (dt_entry.offset > (UINT_MAX - dt_entry.size))
+		{
+			dprintf(CRITICAL, "ERROR: Device tree contents are Invalid\n");
+			return -1;
+		}
+
+		/* 确保所选的dt_entry不会超出dt_size */
+		if ((dt_entry.offset + dt_entry.size) > dt_size)
+		{
+			dprintf(CRITICAL, "ERROR: Device tree contents are Invalid\n");
+			return -1;
+		}
+
+		// 设置最佳匹配的设备树地址和大小
+		best_match_dt_addr = (unsigned char *)table + dt_entry.offset;
+		dtb_size = dt_entry.size;
+
+		// 将设备树复制到tags地址
+		memmove((void *)hdr->tags_addr, (char *)best_match_dt_addr, dtb_size);
+	}
+	else
+	{
+		/* 验证tags_addr */
+		if (check_aboot_addr_range_overlap(hdr->tags_addr, kernel_actual) ||
+			check_ddr_addr_range_bound(hdr->tags_addr, kernel_actual))
+		{
+			dprintf(CRITICAL, "Device tree addresses are not valid.\n");
+			return -1;
+		}
+
+		/*
+		 * 如果找到附加的设备树，则使用dev_tree_appended更新atags，
+		 * 将内存地址设置为RAM上DTB附加位置。
+		 * 否则使用内核头部中的atags地址
+		 *
+		 * 确保在下一步之前读取了从scratch地址开始的所有内容！
+		 * 在dtbo的情况下，此API将在scratch上读取dtbo。
+		 */
+		void *dtb = NULL;
+		dtb = dev_tree_appended((void *)(image_addr + page_size), hdr->kernel_size, dtb_offset, (void *)hdr->tags_addr);
+		if (!dtb)
+		{
+			dprintf(CRITICAL, "ERROR: Appended Device Tree Blob not found\n");
+#if WITH_LK2ND_DEVICE_2ND
+			if (lk2nd_device2nd_have_atags())
+				boot_type |= BOOT_ATAGS_COPY;
+			else
+#endif
+				return -1;
+		}
+	}
+#endif
+
+	/* 将内核和ramdisk移动到正确的地址 */
+	memmove((void *)hdr->kernel_addr, (char *)(image_addr + page_size), hdr->kernel_size);
+	memmove((void *)hdr->ramdisk_addr, (char *)(image_addr + page_size + kernel_actual), hdr->ramdisk_size);
+
+	// 如果使用签名内核且设备未解锁
+	if (target_use_signed_kernel() && (!device.is_unlocked))
+	{
+		/* 确保在下一步之前读取了从scratch地址开始的所有内容！*/
+		if (device.is_tampered)
+		{
+			write_device_info_flash(&device);
+		}
+#if USE_PCOM_SECBOOT
+		set_tamper_flag(device.is_tampered);
+#endif
+	}
+
+// 继续启动标签
+continue_boot:
+
+	/* TODO: 创建/传递atags给内核 */
+
+	// 启动Linux内核
+	boot_linux((void *)hdr->kernel_addr, (void *)hdr->tags_addr,
+			   (const char *)hdr->cmdline, board_machtype(),
+			   (void *)hdr->ramdisk_addr, hdr->ramdisk_size,
+			   boot_type);
+
+	return 0;
+}
+
+#if !ABOOT_STANDALONE
+void write_device_info_mmc(device_info *dev)
+{
+	unsigned long long ptn = 0;
+	unsigned long long size;
+	int index = INVALID_PTN;
+	uint8_t lun = 0;
+	uint32_t ret = 0;
+	uint32_t device_info_sz = 0;
+
+	if (devinfo_present)
+		index = partition_get_index("devinfo");
+	else
+		index = partition_get_index("aboot");
+
+	ptn = partition_get_offset(index);
+	if (ptn == 0)
+	{
+		return;
+	}
+
+	lun = partition_get_lun(index);
+	mmc_set_lun(lun);
+
+	size = partition_get_size(index);
+
+	device_info_sz = ROUND_TO_PAGE(sizeof(struct device_info),
+								   mmc_blocksize_mask);
+	if (device_info_sz == UINT_MAX)
+	{
+		dprintf(CRITICAL, "ERROR: Incorrect blocksize of card\n");
+		return;
+	}
+
+	if (devinfo_present)
+		ret = mmc_write(ptn, device_info_sz, (void *)info_buf);
+	else
+		ret = mmc_write((ptn + size - device_info_sz), device_info_sz, (void *)info_buf);
+	if (ret)
+	{
+		dprintf(CRITICAL, "ERROR: Cannot write device info\n");
+		ASSERT(0);
+	}
+}
+
+void read_device_info_mmc(struct device_info *info)
+{
+	unsigned long long ptn = 0;
+	unsigned long long size;
+	int index = INVALID_PTN;
+	uint32_t ret = 0;
+	uint32_t device_info_sz = 0;
+
+	if ((index = partition_get_index("devinfo")) < 0)
+	{
+		devinfo_present = false;
+		index = partition_get_index("aboot");
+	}
+
+	ptn = partition_get_offset(index);
+	if (ptn == 0)
+	{
+		return;
+	}
+
+	mmc_set_lun(partition_get_lun(index));
+
+	size = partition_get_size(index);
+
+	device_info_sz = ROUND_TO_PAGE(sizeof(struct device_info),
+								   mmc_blocksize_mask);
+	if (device_info_sz == UINT_MAX)
+	{
+		dprintf(CRITICAL, "ERROR: Incorrect blocksize of card\n");
+		return;
+	}
+
+	if (devinfo_present)
+		ret = mmc_read(ptn, (void *)info_buf, device_info_sz);
+	else
+		ret = mmc_read((ptn + size - device_info_sz), (void *)info_buf, device_info_sz);
+	if (ret)
+	{
+		dprintf(CRITICAL, "ERROR: Cannot read device info\n");
+		ASSERT(0);
+	}
+}
+
+void write_device_info_flash(device_info *dev)
+{
+	struct device_info *info = memalign(PAGE_SIZE, ROUNDUP(BOOT_IMG_MAX_PAGE_SIZE, PAGE_SIZE));
+	struct ptentry *ptn;
+	struct ptable *ptable;
+	if (info == NULL)
+	{
+		dprintf(CRITICAL, "Failed to allocate memory for device info struct\n");
+		ASSERT(0);
+	}
+	info_buf = info;
+	ptable = flash_get_ptable();
+	if (ptable == NULL)
+	{
+		dprintf(CRITICAL, "ERROR: Partition table not found\n");
+		return;
+	}
+
+	ptn = ptable_find(ptable, "devinfo");
+	if (ptn == NULL)
+	{
+		dprintf(CRITICAL, "ERROR: No devinfo partition found\n");
+		return;
+	}
+
+	memset(info, 0, BOOT_IMG_MAX_PAGE_SIZE);
+	memcpy(info, dev, sizeof(device_info));
+
+	if (flash_write(ptn, 0, (void *)info_buf, page_size))
+	{
+		dprintf(CRITICAL, "ERROR: Cannot write device info\n");
+		return;
+	}
+	free(info);
+}
+
+static int read_allow_oem_unlock(device_info *dev)
+{
+	if (!target_is_emmc_boot())
+		return -1;
+
+	unsigned offset;
+	int index;
+	unsigned long long ptn;
+	unsigned long long ptn_size;
+	unsigned blocksize = mmc_get_device_blocksize();
+	STACKBUF_DMA_ALIGN(buf, blocksize);
+
+	index = partition_get_index(frp_ptns[0]);
+	if (index == INVALID_PTN)
+	{
+		index = partition_get_index(frp_ptns[1]);
+		if (index == INVALID_PTN)
+		{
+			dprintf(CRITICAL, "Neither '%s' nor '%s' partition found\n", frp_ptns[0], frp_ptns[1]);
+			return -1;
+		}
+	}
+
+	ptn = partition_get_offset(index);
+	ptn_size = partition_get_size(index);
+	offset = ptn_size - blocksize;
+
+	/* Set Lun for partition */
+	mmc_set_lun(partition_get_lun(index));
+
+	if (mmc_read(ptn + offset, (void *)buf, blocksize))
+	{
+		dprintf(CRITICAL, "Reading MMC failed\n");
+		return -1;
+	}
+
+	/*is_allow_unlock is a bool value stored at the LSB of last byte*/
+	is_allow_unlock = buf[blocksize - 1] & 0x01;
+	return 0;
+}
+
+static int write_allow_oem_unlock(bool allow_unlock)
+{
+	if (!target_is_emmc_boot())
+		return -1;
+
+	unsigned offset;
+	int index;
+	unsigned long long ptn;
+	unsigned long long ptn_size;
+	unsigned blocksize = mmc_get_device_blocksize();
+	STACKBUF_DMA_ALIGN(buf, blocksize);
+
+	index = partition_get_index(frp_ptns[0]);
+	if (index == INVALID_PTN)
+	{
+		index = partition_get_index(frp_ptns[1]);
+		if (index == INVALID_PTN)
+		{
+			dprintf(CRITICAL, "Neither '%s' nor '%s' partition found\n", frp_ptns[0], frp_ptns[1]);
+			return -1;
+		}
+	}
+
+	ptn = partition_get_offset(index);
+	ptn_size = partition_get_size(index);
+	offset = ptn_size - blocksize;
+	mmc_set_lun(partition_get_lun(index));
+
+	if (mmc_read(ptn + offset, (void *)buf, blocksize))
+	{
+		dprintf(CRITICAL, "Reading MMC failed\n");
+		return -1;
+	}
+
+	/*is_allow_unlock is a bool value stored at the LSB of last byte*/
+	buf[blocksize - 1] = allow_unlock;
+	if (mmc_write(ptn + offset, blocksize, buf))
+	{
+		dprintf(CRITICAL, "Writing MMC failed\n");
+		return -1;
+	}
 
-	// 定义分区表项和分区表指针
+	return 0;
+}
+
+void read_device_info_flash(device_info *dev)
+{
+	struct device_info *info = memalign(PAGE_SIZE, ROUNDUP(BOOT_IMG_MAX_PAGE_SIZE, PAGE_SIZE));
 	struct ptentry *ptn;
 	struct ptable *ptable;
+	if (info == NULL)
+	{
+		dprintf(CRITICAL, "Failed to allocate memory for device info struct\n");
+		ASSERT(0);
+	}
+	info_buf = info;
+	ptable = flash_get_ptable();
+	if (ptable == NULL)
+	{
+		dprintf(CRITICAL, "ERROR: Partition table not found\n");
+		return;
+	}
 
-	// 定义读取偏移量，初始为0
-	unsigned offset = 0;
+	ptn = ptable_find(ptable, "devinfo");
+	if (ptn == NULL)
+	{
+		dprintf(CRITICAL, "ERROR: No devinfo partition found\n");
+		return;
+	}
 
-	// 定义镜像加载地址、实际大小等变量
-	unsigned char *image_addr = 0;
-	unsigned kernel_actual;
-	unsigned ramdisk_actual;
-	unsigned imagesize_actual;
-	unsigned second_actual = 0;
-	enum boot_type boot_type = 0;
+	if (flash_read(ptn, 0, (void *)info_buf, page_size))
+	{
+		dprintf(CRITICAL, "ERROR: Cannot write device info\n");
+		return;
+	}
 
-#if DEVICE_TREE
-	// 如果启用设备树支持，定义相关变量
-	struct dt_table *table = NULL;
-	struct dt_entry dt_entry;
-	unsigned dt_table_offset;
-	uint32_t dt_actual;
-	uint32_t dt_hdr_size = 0;
-	uint32_t dtb_offset = 0;
-	unsigned int dtb_size = 0;
-	unsigned char *best_match_dt_addr = NULL;
-#endif
+	if (memcmp(info->magic, DEVICE_MAGIC, DEVICE_MAGIC_SIZE))
+	{
+		memcpy(info->magic, DEVICE_MAGIC, DEVICE_MAGIC_SIZE);
+		info->is_unlocked = 0;
+		info->is_tampered = 0;
+		write_device_info_flash(info);
+	}
+	memcpy(dev, info, sizeof(device_info));
+	free(info);
+}
 
-	// 检查是否为eMMC启动模式
+void write_device_info(device_info *dev)
+{
 	if (target_is_emmc_boot())
 	{
-		// 如果是eMMC启动，直接使用预定义的boot镜像头地址
-		hdr = (boot_img_hdr *)EMMC_BOOT_IMG_HEADER_ADDR;
+		struct device_info *info = memalign(PAGE_SIZE, ROUNDUP(BOOT_IMG_MAX_PAGE_SIZE, PAGE_SIZE));
+		if (info == NULL)
+		{
+			dprintf(CRITICAL, "Failed to allocate memory for device info struct\n");
+			ASSERT(0);
+		}
+		info_buf = info;
+		memcpy(info, dev, sizeof(struct device_info));
 
-		// 验证boot镜像魔数是否正确
-		if (memcmp(hdr->magic, BOOT_MAGIC, BOOT_MAGIC_SIZE))
+#if USE_RPMB_FOR_DEVINFO
+		if (VB_M <= target_get_vb_version() &&
+			is_secure_boot_enable())
 		{
-			dprintf(CRITICAL, "ERROR: Invalid boot image header\n");
-			return -1;
+			if ((write_device_info_rpmb((void *)info, PAGE_SIZE)) < 0)
+				ASSERT(0);
 		}
-		// 跳转到继续启动流程
-		goto continue_boot;
+		else
+			write_device_info_mmc(info);
+#else
+		write_device_info_mmc(info);
+#endif
+		free(info);
+	}
+	else
+	{
+		write_device_info_flash(dev);
 	}
+}
 
-	// 获取Flash分区表
-	ptable = flash_get_ptable();
-	if (ptable == NULL)
+int read_rollback_index(uint32_t loc, uint64_t *roll_back_index)
+{
+	if (!devinfo_present)
 	{
-		dprintf(CRITICAL, "ERROR: Partition table not found\n");
-		return -1;
+		dprintf(CRITICAL, "DeviceInfo not initalized \n");
+		return -EINVAL;
+	}
+	if (loc >= ARRAY_SIZE(device.rollback_index))
+	{
+		dprintf(CRITICAL, "%s() Loc out of range index: %d, array len: %d\n",
+				__func__, loc, ARRAY_SIZE(device.rollback_index));
+		ASSERT(0);
 	}
 
-	// 根据启动模式选择对应的分区
-	if (!boot_into_recovery)
+	*roll_back_index = device.rollback_index[loc];
+	return 0;
+}
+
+int write_rollback_index(uint32_t loc, uint64_t roll_back_index)
+{
+	if (!devinfo_present)
 	{
-		// 正常启动模式，查找boot分区
-		ptn = ptable_find(ptable, "boot");
+		dprintf(CRITICAL, "DeviceInfo not initalized \n");
+		return -EINVAL;
+	}
+	if (loc >= ARRAY_SIZE(device.rollback_index))
+	{
+		dprintf(CRITICAL, "%s() Loc out of range index: %d, array len: %d\n",
+				__func__, loc, ARRAY_SIZE(device.rollback_index));
+		ASSERT(0);
+	}
 
-		if (ptn == NULL)
-		{
-			dprintf(CRITICAL, "ERROR: No boot partition found\n");
-			return -1;
-		}
+	device.rollback_index[loc] = roll_back_index;
+	write_device_info(&device);
+	return 0;
+}
+
+#if VERIFIED_BOOT_2
+int store_userkey(uint8_t *user_key, uint32_t user_key_size)
+{
+	if (!devinfo_present)
+	{
+		dprintf(CRITICAL, "DeviceInfo not initalized \n");
+		return -EINVAL;
 	}
-	else
+
+	if (user_key_size > ARRAY_SIZE(device.user_public_key))
 	{
-		// 恢复模式，查找recovery分区
-		ptn = ptable_find(ptable, "recovery");
-		if (ptn == NULL)
-		{
-			dprintf(CRITICAL, "ERROR: No recovery partition found\n");
-			return -1;
-		}
+		dprintf(CRITICAL, "StoreUserKey, UserKeySize too large!\n");
+		return -ENODEV;
 	}
 
-	/* 从Flash读取boot.img头部 */
-	if (flash_read(ptn, offset, buf, page_size))
+	memcpy(device.user_public_key, user_key, user_key_size);
+	device.user_public_key_length = user_key_size;
+	write_device_info(&device);
+	return 0;
+}
+
+int erase_userkey(void)
+{
+	if (!devinfo_present)
 	{
-		dprintf(CRITICAL, "ERROR: Cannot read boot image header\n");
-		return -1;
+		dprintf(CRITICAL, "DeviceInfo not initalized \n");
+		return -EINVAL;
 	}
+	memset(device.user_public_key, 0, ARRAY_SIZE(device.user_public_key));
+	device.user_public_key_length = 0;
+	write_device_info(&device);
+	return 0;
+}
 
-	// 验证boot镜像头部魔数
-	if (memcmp(hdr->magic, BOOT_MAGIC, BOOT_MAGIC_SIZE))
+int get_userkey(uint8_t **user_key, uint32_t *user_key_size)
+{
+	if (!devinfo_present)
 	{
-		dprintf(CRITICAL, "ERROR: Invalid boot image header\n");
-		return -1;
+		dprintf(CRITICAL, "DeviceInfo not initalized \n");
+		return -EINVAL;
+	}
+	*user_key = device.user_public_key;
+	*user_key_size = device.user_public_key_length;
+	return 0;
+}
+#endif /* VERIFIED_BOOT_2 */
+
+void read_device_info(device_info *dev)
+{
+	if (target_is_emmc_boot())
+	{
+		struct device_info *info = memalign(PAGE_SIZE, ROUNDUP(BOOT_IMG_MAX_PAGE_SIZE, PAGE_SIZE));
+		if (info == NULL)
+		{
+			dprintf(CRITICAL, "Failed to allocate memory for device info struct\n");
+			ASSERT(0);
+		}
+		info_buf = info;
+
+#if USE_RPMB_FOR_DEVINFO
+		if (VB_M <= target_get_vb_version() &&
+			is_secure_boot_enable())
+		{
+			if ((read_device_info_rpmb((void *)info, PAGE_SIZE)) < 0)
+				ASSERT(0);
+		}
+		else
+			read_device_info_mmc(info);
+#else
+		read_device_info_mmc(info);
+#endif
+
+		if (memcmp(info->magic, DEVICE_MAGIC, DEVICE_MAGIC_SIZE))
+		{
+			memcpy(info->magic, DEVICE_MAGIC, DEVICE_MAGIC_SIZE);
+			if (is_secure_boot_enable())
+			{
+				info->is_unlocked = 0;
+#if VERIFIED_BOOT || VERIFIED_BOOT_2
+				if (VB_M <= target_get_vb_version())
+					info->is_unlock_critical = 0;
+#endif
+			}
+			else
+			{
+				info->is_unlocked = 1;
+#if VERIFIED_BOOT || VERIFIED_BOOT_2
+				if (VB_M <= target_get_vb_version())
+					info->is_unlock_critical = 1;
+#endif
+			}
+			info->is_tampered = 0;
+			info->charger_screen_enabled = 0;
+#if VERIFIED_BOOT || VERIFIED_BOOT_2
+			if (VB_M <= target_get_vb_version())
+			{
+				info->verity_mode = 1; // enforcing by default
+				info->user_public_key_length = 0;
+				memset(info->rollback_index, 0, sizeof(info->rollback_index));
+				memset(info->user_public_key, 0, sizeof(info->user_public_key));
+			}
+#endif
+			write_device_info(info);
+		}
+		memcpy(dev, info, sizeof(device_info));
+		free(info);
 	}
-
-	// 检查页面大小是否匹配
-	if (hdr->page_size != page_size)
+	else
 	{
-		dprintf(CRITICAL, "ERROR: Invalid boot image pagesize. Device pagesize: %d, Image pagesize: %d\n", page_size, hdr->page_size);
-		return -1;
+		read_device_info_flash(dev);
 	}
+}
 
-	// 获取目标平台的临时加载地址
-	image_addr = (unsigned char *)target_get_scratch_address();
-
-	// 将boot镜像头复制到加载地址
-	memcpy(image_addr, (void *)buf, page_size);
-
-	/*
-	 * 如果boot镜像头包含默认地址值，则更新内核/ramdisk/tags地址。
-	 * 这些默认值来自使用fastboot flash:raw刷写boot镜像时的mkbootimg工具。
-	 */
-	update_ker_tags_rdisk_addr(hdr, NULL);
-
-	// 将物理地址转换为虚拟地址
-	hdr->kernel_addr = VA((addr_t)(hdr->kernel_addr));
-	hdr->ramdisk_addr = VA((addr_t)(hdr->ramdisk_addr));
-	hdr->tags_addr = VA((addr_t)(hdr->tags_addr));
+void reset_device_info(void)
+{
+	dprintf(ALWAYS, "reset_device_info called.");
+	device.is_tampered = 0;
+	write_device_info(&device);
+}
 
-	// 计算各部分的实际大小（向上对齐到页面边界）
-	kernel_actual = ROUND_TO_PAGE(hdr->kernel_size, page_mask);
-	ramdisk_actual = ROUND_TO_PAGE(hdr->ramdisk_size, page_mask);
-	second_actual = ROUND_TO_PAGE(hdr->second_size, page_mask);
+void set_device_root(void)
+{
+	dprintf(ALWAYS, "set_device_root called.");
+	device.is_tampered = 1;
+	write_device_info(&device);
+}
 
-	// 确保命令行参数以null结尾
-	hdr->cmdline[BOOT_ARGS_SIZE - 1] = 0;
+/* set device unlock value
+ * Must check FRP before call this function
+ * Need to wipe data when unlock status changed
+ * type 0: oem unlock
+ * type 1: unlock critical
+ * status 0: unlock as false
+ * status 1: lock as true
+ */
+void set_device_unlock_value(int type, bool status)
+{
+	if (type == UNLOCK)
+		device.is_unlocked = status;
+#if VERIFIED_BOOT || VERIFIED_BOOT_2
+	else if (VB_M <= target_get_vb_version() &&
+			 type == UNLOCK_CRITICAL)
+		device.is_unlock_critical = status;
+#endif
+	write_device_info(&device);
+}
 
-	// 检查头部中的地址是否有效
-	if (check_aboot_addr_range_overlap(hdr->kernel_addr, kernel_actual) ||
-		check_ddr_addr_range_bound(hdr->kernel_addr, kernel_actual) ||
-		check_aboot_addr_range_overlap(hdr->ramdisk_addr, ramdisk_actual) ||
-		check_ddr_addr_range_bound(hdr->ramdisk_addr, ramdisk_actual))
-	{
-		dprintf(CRITICAL, "kernel/ramdisk addresses are not valid.\n");
-		return -1;
-	}
+static void set_device_unlock(int type, bool status)
+{
+	int is_unlocked = -1;
+	char response[MAX_RSP_SIZE];
 
-#ifndef DEVICE_TREE
-	// 如果不使用设备树，检查整数溢出并计算镜像总大小
-	if (UINT_MAX < ((uint64_t)kernel_actual + (uint64_t)ramdisk_actual + (uint64_t)second_actual + page_size))
+	/* check device unlock status if it is as expected */
+	if (type == UNLOCK)
+		is_unlocked = device.is_unlocked;
+#if VERIFIED_BOOT || VERIFIED_BOOT_2
+	if (VB_M <= target_get_vb_version() &&
+		type == UNLOCK_CRITICAL)
 	{
-		dprintf(CRITICAL, "Integer overflow detected in bootimage header fields\n");
-		return -1;
+		is_unlocked = device.is_unlock_critical;
 	}
-	imagesize_actual = (page_size + kernel_actual + ramdisk_actual + second_actual);
-
-	// 验证tags地址有效性
-	if (check_aboot_addr_range_overlap(hdr->tags_addr, MAX_TAGS_SIZE) ||
-		check_ddr_addr_range_bound(hdr->tags_addr, MAX_TAGS_SIZE))
+#endif
+	if (is_unlocked == status)
 	{
-		dprintf(CRITICAL, "Tags addresses are not valid.\n");
-		return -1;
+		snprintf(response, sizeof(response), "\tDevice already : %s", (status ? "unlocked!" : "locked!"));
+		fastboot_info(response);
+		fastboot_okay("");
+		return;
 	}
-#else
-	// 如果使用设备树...
-
-#ifndef OSVERSION_IN_BOOTIMAGE
-	dt_size = hdr->dt_size;
-#endif
-	dt_actual = ROUND_TO_PAGE(dt_size, page_mask);
 
-	// 检查整数溢出
-	if (UINT_MAX < ((uint64_t)kernel_actual + (uint64_t)ramdisk_actual + (uint64_t)second_actual + (uint64_t)dt_actual + page_size))
+	/* status is true, it means to unlock device */
+	if (status && !is_allow_unlock)
 	{
-		dprintf(CRITICAL, "Integer overflow detected in bootimage header fields\n");
-		return -1;
+		fastboot_fail("oem unlock is not allowed");
+		return;
 	}
 
-	// 计算包含设备树的镜像总大小
-	imagesize_actual = (page_size + kernel_actual + ramdisk_actual + second_actual + dt_actual);
-
-	// 验证设备树地址有效性
-	if (check_aboot_addr_range_overlap(hdr->tags_addr, dt_size) ||
-		check_ddr_addr_range_bound(hdr->tags_addr, dt_size))
+#if FBCON_DISPLAY_MSG
+	aboot_display_wait();
+	display_unlock_menu(type, status);
+	fastboot_okay("");
+	return;
+#else
+	if (status && type == UNLOCK)
 	{
-		dprintf(CRITICAL, "Device tree addresses are not valid.\n");
-		return -1;
+		fastboot_fail("Need wipe userdata. Do 'fastboot oem unlock-go'");
+		return;
 	}
 #endif
 
-	/* 从Flash读取完整的boot.img */
-	dprintf(INFO, "Loading (%s) image (%d): start\n",
-			(!boot_into_recovery ? "boot" : "recovery"), imagesize_actual);
-
-	// 设置启动时间戳
-	bs_set_timestamp(BS_KERNEL_LOAD_START);
+	set_device_unlock_value(type, status);
 
-	// 检查整数溢出
-	if (UINT_MAX - page_size < imagesize_actual)
-	{
-		dprintf(CRITICAL, "Integer overflow detected in bootimage header fields %u %s\n", __LINE__, __func__);
-		return -1;
-	}
+	/* wipe data */
+	struct recovery_message msg;
+	memset(&msg, 0, sizeof(msg));
+	snprintf(msg.recovery, sizeof(msg.recovery), "recovery\n--wipe_data");
+	write_misc(0, &msg, sizeof(msg));
 
-	/* 检查RAM容量是否足够加载boot镜像和最大签名长度 */
-	if (target_get_max_flash_size() < (imagesize_actual + page_size))
-	{
-		dprintf(CRITICAL, "bootimage  size is greater than DDR can hold\n");
-		return -1;
-	}
+	fastboot_okay("");
+	reboot_device(RECOVERY_MODE);
+}
 
-	// 设置读取偏移量为页面大小
-	offset = page_size;
+static bool critical_flash_allowed(const char *entry)
+{
+	uint32_t i = 0;
+	if (entry == NULL)
+		return false;
 
-	/* 读取不含签名和头部的镜像数据 */
-	if (flash_read(ptn, offset, (void *)(image_addr + offset), imagesize_actual - page_size))
+	for (i = 0; i < ARRAY_SIZE(critical_flash_allowed_ptn); i++)
 	{
-		dprintf(CRITICAL, "ERROR: Cannot read boot image\n");
-		return -1;
+		if (!strcmp(entry, critical_flash_allowed_ptn[i]))
+			return true;
 	}
+	return false;
+}
+#endif /* !ABOOT_STANDALONE */
 
-	dprintf(INFO, "Loading (%s) image (%d): done\n",
-			(!boot_into_recovery ? "boot" : "recovery"), imagesize_actual);
-
-	// 设置启动时间戳
-	bs_set_timestamp(BS_KERNEL_LOAD_DONE);
+#if DEVICE_TREE
+int copy_dtb(uint8_t *boot_image_start, unsigned int scratch_offset)
+{
+	uint32 dt_image_offset = 0;
+	uint32_t n;
+	struct dt_table *table = NULL;
+	struct dt_entry dt_entry;
+	uint32_t dt_hdr_size = 0;
+	unsigned int compressed_size = 0;
+	unsigned int dtb_size = 0;
+	unsigned int out_avai_len = 0;
+	unsigned char *out_addr = NULL;
+	unsigned char *best_match_dt_addr = NULL;
+	int rc;
 
-	/* 验证内核签名 */
-	if (target_use_signed_kernel() && (!device.is_unlocked))
-	{
-		// 设置偏移量到镜像末尾（签名位置）
-		offset = imagesize_actual;
+	boot_img_hdr *hdr = (boot_img_hdr *)(boot_image_start);
 
-		/* 读取签名数据 */
-		if (flash_read(ptn, offset, (void *)(image_addr + offset), page_size))
-		{
-			dprintf(CRITICAL, "ERROR: Cannot read boot image signature\n");
-			return -1;
-		}
+#ifndef OSVERSION_IN_BOOTIMAGE
+	dt_size = hdr->dt_size;
+#endif
 
-		// 验证签名的boot镜像
-		verify_signed_bootimg((uint32_t)image_addr, imagesize_actual);
-	}
+	if (dt_size != 0)
+	{
+		/* add kernel offset */
+		dt_image_offset += page_size;
+		n = ROUND_TO_PAGE(hdr->kernel_size, page_mask);
+		dt_image_offset += n;
 
-	// 重置偏移量
-	offset = page_size;
+		/* add ramdisk offset */
+		n = ROUND_TO_PAGE(hdr->ramdisk_size, page_mask);
+		dt_image_offset += n;
 
-	// 如果存在第二阶段镜像
-	if (hdr->second_size != 0)
-	{
-		// 检查整数溢出
-		if (UINT_MAX - offset < second_actual)
+		/* add second offset */
+		if (hdr->second_size != 0)
 		{
-			dprintf(CRITICAL, "ERROR: Integer overflow in boot image header %s\t%d\n", __func__, __LINE__);
-			return -1;
+			n = ROUND_TO_PAGE(hdr->second_size, page_mask);
+			dt_image_offset += n;
 		}
 
-		// 更新偏移量
-		offset += second_actual;
-
-		// 第二阶段镜像加载尚未实现
-		ASSERT(0);
-	}
-
-#if DEVICE_TREE
-	// 如果设备树大小不为0
-	if (dt_size != 0)
-	{
-		// 计算设备树表在镜像中的偏移量
-		dt_table_offset = ((uint32_t)image_addr + page_size + kernel_actual + ramdisk_actual + second_actual);
-
-		// 获取设备树表指针
-		table = (struct dt_table *)dt_table_offset;
+		/* offset now point to start of dt.img */
+		table = (struct dt_table *)(boot_image_start + dt_image_offset);
 
-		// 验证设备树表
 		if (dev_tree_validate(table, hdr->page_size, &dt_hdr_size) != 0)
 		{
 			dprintf(CRITICAL, "ERROR: Cannot validate Device Tree Table \n");
 			return -1;
 		}
 
-		/* 如果dt_hdr_size（表项数量 * dt_entry大小 + 设备树头部）
-		   超过hdr->dt_size则是错误 */
+		/* Its Error if, dt_hdr_size (table->num_entries * dt_entry size + Dev_Tree Header)
+		goes beyound hdr->dt_size*/
 		if (dt_hdr_size > ROUND_TO_PAGE(dt_size, hdr->page_size))
 		{
 			dprintf(CRITICAL, "ERROR: Invalid Device Tree size \n");
 			return -1;
 		}
 
-		/* 在设备树表中查找设备树条目信息 */
+		/* Find index of device tree within device tree table */
 		if (dev_tree_get_entry_info(table, &dt_entry) != 0)
 		{
 			dprintf(CRITICAL, "ERROR: Getting device tree address failed\n");
 			return -1;
 		}
 
-		/* 验证并读取设备树到tags_addr */
-		if (check_aboot_addr_range_overlap(hdr->tags_addr, dt_entry.size) ||
-			check_ddr_addr_range_bound(hdr->tags_addr, dt_entry.size))
+		best_match_dt_addr = (unsigned char *)boot_image_start + dt_image_offset + dt_entry.offset;
+		if (is_gzip_package(best_match_dt_addr, dt_entry.size))
 		{
-			dprintf(CRITICAL, "Device tree addresses are not valid.\n");
-			return -1;
-		}
+			out_addr = (unsigned char *)target_get_scratch_address() + scratch_offset;
+			out_avai_len = target_get_max_flash_size() - scratch_offset;
+			dprintf(INFO, "decompressing dtb: start\n");
+			rc = decompress(best_match_dt_addr,
+							dt_entry.size, out_addr, out_avai_len,
+							&compressed_size, &dtb_size);
+			if (rc)
+			{
+				dprintf(CRITICAL, "decompressing dtb failed!!!\n");
+				ASSERT(0);
+			}
 
-		// 检查偏移量和大小的整数溢出
-		if (dt_entry.offset > (UINT_MAX - dt_entry.size))
+			dprintf(INFO, "decompressing dtb: done\n");
+			best_match_dt_addr = out_addr;
+		}
+		else
 		{
-			dprintf(CRITICAL, "ERROR: Device tree contents are Invalid\n");
-			return -1;
+			dtb_size = dt_entry.size;
 		}
-
-		/* 确保所选的dt_entry不会超出dt_size */
-		if ((dt_entry.offset + dt_entry.size) > dt_size)
+		/* Validate and Read device device tree in the "tags_add */
+		if (check_aboot_addr_range_overlap(hdr->tags_addr, dtb_size) ||
+			check_ddr_addr_range_bound(hdr->tags_addr, dtb_size))
 		{
-			dprintf(CRITICAL, "ERROR: Device tree contents are Invalid\n");
+			dprintf(CRITICAL, "Device tree addresses are not valid.\n");
 			return -1;
 		}
 
-		// 设置最佳匹配的设备树地址和大小
-		best_match_dt_addr = (unsigned char *)table + dt_entry.offset;
-		dtb_size = dt_entry.size;
-
-		// 将设备树复制到tags地址
-		memmove((void *)hdr->tags_addr, (char *)best_match_dt_addr, dtb_size);
+		/* Read device device tree in the "tags_add */
+		memmove((void *)hdr->tags_addr, (void *)best_match_dt_addr, dtb_size);
 	}
 	else
-	{
-		/* 验证tags_addr */
-		if (check_aboot_addr_range_overlap(hdr->tags_addr, kernel_actual) ||
-			check_ddr_addr_range_bound(hdr->tags_addr, kernel_actual))
-		{
-			dprintf(CRITICAL, "Device tree addresses are not valid.\n");
-			return -1;
-		}
+		return -1;
 
-		/*
-		 * 如果找到附加的设备树，则使用dev_tree_appended更新atags，
-		 * 将内存地址设置为RAM上DTB附加位置。
-		 * 否则使用内核头部中的atags地址
-		 *
-		 * 确保在下一步之前读取了从scratch地址开始的所有内容！
-		 * 在dtbo的情况下，此API将在scratch上读取dtbo。
-		 */
-		void *dtb = NULL;
-		dtb = dev_tree_appended((void *)(image_addr + page_size), hdr->kernel_size, dtb_offset, (void *)hdr->tags_addr);
-		if (!dtb)
-		{
-			dprintf(CRITICAL, "ERROR: Appended Device Tree Blob not found\n");
-#if WITH_LK2ND_DEVICE_2ND
-			if (lk2nd_device2nd_have_atags())
-				boot_type |= BOOT_ATAGS_COPY;
-			else
+	/* Everything looks fine. Return success. */
+	return 0;
+}
 #endif
-				return -1;
-		}
-	}
+
+void cmd_boot(const char *arg, void *data, unsigned sz)
+{
+	unsigned kernel_actual;
+	unsigned ramdisk_actual;
+	unsigned second_actual;
+	uint32_t image_actual;
+	uint32_t dt_actual = 0;
+	boot_img_hdr *hdr = NULL;
+	struct kernel64_hdr *kptr = NULL;
+	char *ptr = ((char *)data);
+	int ret = 0;
+	unsigned int out_len = 0;
+	unsigned int out_avai_len = 0;
+	unsigned char *out_addr = NULL;
+	uint32_t dtb_offset = 0;
+	unsigned char *kernel_start_addr = NULL;
+	unsigned int kernel_size = 0;
+	enum boot_type boot_type = 0;
+#if DEVICE_TREE
+	uint8_t dtb_copied = 0;
+	unsigned int scratch_offset = 0;
+#endif
+#if VERIFIED_BOOT_2
+	void *dtbo_image_buf = NULL;
+	uint32_t dtbo_image_sz = 0;
+	void *vbmeta_image_buf = NULL;
+	uint32_t vbmeta_image_sz = 0;
+#endif
+#if !VERIFIED_BOOT_2
+	uint32_t sig_actual = 0;
+	uint32_t sig_size = 0;
+#ifdef MDTP_SUPPORT
+	static bool is_mdtp_activated = 0;
+#endif /* MDTP_SUPPORT */
 #endif
 
-	/* 将内核和ramdisk移动到正确的地址 */
-	memmove((void *)hdr->kernel_addr, (char *)(image_addr + page_size), hdr->kernel_size);
-	memmove((void *)hdr->ramdisk_addr, (char *)(image_addr + page_size + kernel_actual), hdr->ramdisk_size);
+#if FBCON_DISPLAY_MSG
+	/* Exit keys' detection thread firstly */
+	exit_menu_keys_detection();
+#endif
 
-	// 如果使用签名内核且设备未解锁
-	if (target_use_signed_kernel() && (!device.is_unlocked))
+#if VERIFIED_BOOT || VERIFIED_BOOT_2
+	if (target_build_variant_user() && !device.is_unlocked)
 	{
-		/* 确保在下一步之前读取了从scratch地址开始的所有内容！*/
-		if (device.is_tampered)
-		{
-			write_device_info_flash(&device);
-		}
-#if USE_PCOM_SECBOOT
-		set_tamper_flag(device.is_tampered);
-#endif
+		fastboot_fail("unlock device to use this command");
+		goto boot_failed;
 	}
+#endif
 
-// 继续启动标签
-continue_boot:
+	if (sz < sizeof(hdr))
+	{
+		fastboot_fail("invalid bootimage header");
+		goto boot_failed;
+	}
 
-	/* TODO: 创建/传递atags给内核 */
+	hdr = (boot_img_hdr *)data;
 
-	// 启动Linux内核
-	boot_linux((void *)hdr->kernel_addr, (void *)hdr->tags_addr,
-			   (const char *)hdr->cmdline, board_machtype(),
-			   (void *)hdr->ramdisk_addr, hdr->ramdisk_size,
-			   boot_type);
+	/* ensure commandline is terminated */
+	hdr->cmdline[BOOT_ARGS_SIZE - 1] = 0;
 
-	return 0;
-}
+	if (target_is_emmc_boot() && hdr->page_size)
+	{
+		page_size = hdr->page_size;
+		page_mask = page_size - 1;
+	}
 
-#if !ABOOT_STANDALONE
-void write_device_info_mmc(device_info *dev)
-{
-	unsigned long long ptn = 0;
-	unsigned long long size;
-	int index = INVALID_PTN;
-	uint8_t lun = 0;
-	uint32_t ret = 0;
-	uint32_t device_info_sz = 0;
+	kernel_actual = ROUND_TO_PAGE(hdr->kernel_size, page_mask);
+	ramdisk_actual = ROUND_TO_PAGE(hdr->ramdisk_size, page_mask);
+	second_actual = ROUND_TO_PAGE(hdr->second_size, page_mask);
+#if DEVICE_TREE
+#ifndef OSVERSION_IN_BOOTIMAGE
+	dt_size = hdr->dt_size;
+#endif
+	dt_actual = ROUND_TO_PAGE(dt_size, page_mask);
+#endif
 
-	if (devinfo_present)
-		index = partition_get_index("devinfo");
-	else
-		index = partition_get_index("aboot");
+	image_actual = ADD_OF(page_size, kernel_actual);
+	image_actual = ADD_OF(image_actual, ramdisk_actual);
+	image_actual = ADD_OF(image_actual, second_actual);
+	image_actual = ADD_OF(image_actual, dt_actual);
 
-	ptn = partition_get_offset(index);
-	if (ptn == 0)
+	/* Checking to prevent oob access in read_der_message_length */
+	if (image_actual > sz)
 	{
-		return;
+		fastboot_fail("bootimage header fields are invalid");
+		goto boot_failed;
 	}
 
-	lun = partition_get_lun(index);
-	mmc_set_lun(lun);
+#if VERIFIED_BOOT_2
+	/* Pass size of boot partition, as imgsize, to avoid
+	read fewer bytes error */
+	image_actual = partition_get_size(partition_get_index("boot"));
 
-	size = partition_get_size(index);
+	/* load and validate dtbo partition */
+	load_validate_dtbo_image(&dtbo_image_buf, &dtbo_image_sz);
 
-	device_info_sz = ROUND_TO_PAGE(sizeof(struct device_info),
-								   mmc_blocksize_mask);
-	if (device_info_sz == UINT_MAX)
-	{
-		dprintf(CRITICAL, "ERROR: Incorrect blocksize of card\n");
-		return;
-	}
+	/* load vbmeta partition */
+	load_vbmeta_image(&vbmeta_image_buf, &vbmeta_image_sz);
 
-	if (devinfo_present)
-		ret = mmc_write(ptn, device_info_sz, (void *)info_buf);
-	else
-		ret = mmc_write((ptn + size - device_info_sz), device_info_sz, (void *)info_buf);
-	if (ret)
+	memset(&info, 0, sizeof(bootinfo));
+
+	info.images[IMG_BOOT].image_buffer = SUB_SALT_BUFF_OFFSET(data);
+	info.images[IMG_BOOT].imgsize = image_actual;
+	info.images[IMG_BOOT].name = "boot";
+	++info.num_loaded_images;
+
+	/* Pass loaded dtbo image */
+	if (dtbo_image_buf != NULL)
 	{
-		dprintf(CRITICAL, "ERROR: Cannot write device info\n");
-		ASSERT(0);
+		info.images[IMG_DTBO].image_buffer = SUB_SALT_BUFF_OFFSET(dtbo_image_buf);
+		info.images[IMG_DTBO].imgsize = dtbo_image_sz;
+		info.images[IMG_DTBO].name = "dtbo";
+		++info.num_loaded_images;
 	}
-}
-
-void read_device_info_mmc(struct device_info *info)
-{
-	unsigned long long ptn = 0;
-	unsigned long long size;
-	int index = INVALID_PTN;
-	uint32_t ret = 0;
-	uint32_t device_info_sz = 0;
 
-	if ((index = partition_get_index("devinfo")) < 0)
+	/* Pass loaded vbmeta image */
+	if (vbmeta_image_buf != NULL)
 	{
-		devinfo_present = false;
-		index = partition_get_index("aboot");
+		info.images[IMG_VBMETA].image_buffer = vbmeta_image_buf;
+		info.images[IMG_VBMETA].imgsize = vbmeta_image_sz;
+		info.images[IMG_VBMETA].name = "vbmeta";
+		++info.num_loaded_images;
 	}
 
-	ptn = partition_get_offset(index);
-	if (ptn == 0)
+	info.multi_slot_boot = partition_multislot_is_supported();
+	if (load_image_and_auth(&info))
+		goto boot_failed;
+	vbcmdline = info.vbcmdline;
+
+	/* Free the buffer allocated to vbmeta post verification */
+	if (vbmeta_image_buf != NULL)
 	{
-		return;
+		free(vbmeta_image_buf);
+		--info.num_loaded_images;
 	}
+#else
+	sig_size = sz - image_actual;
 
-	mmc_set_lun(partition_get_lun(index));
+	if (target_use_signed_kernel() && (!device.is_unlocked))
+	{
+		unsigned chk;
+		/* Calculate the signature length from boot image */
+		sig_actual = read_der_message_length(
+			(unsigned char *)(data + image_actual), sig_size);
+		chk = ADD_OF(image_actual, sig_actual);
 
-	size = partition_get_size(index);
+		if (chk > sz)
+		{
+			fastboot_fail("bootimage header fields are invalid");
+			goto boot_failed;
+		}
+	}
 
-	device_info_sz = ROUND_TO_PAGE(sizeof(struct device_info),
-								   mmc_blocksize_mask);
-	if (device_info_sz == UINT_MAX)
+	// Initialize boot state before trying to verify boot.img
+#if VERIFIED_BOOT
+	boot_verifier_init();
+#endif
+	/* Handle overflow if the input image size is greater than
+	 * boot image buffer can hold
+	 */
+	if ((target_get_max_flash_size() - page_size) < image_actual)
 	{
-		dprintf(CRITICAL, "ERROR: Incorrect blocksize of card\n");
-		return;
+		fastboot_fail("booimage: size is greater than boot image buffer can hold");
+		goto boot_failed;
 	}
 
-	if (devinfo_present)
-		ret = mmc_read(ptn, (void *)info_buf, device_info_sz);
+	/* Verify the boot image
+	 * device & page_size are initialized in aboot_init
+	 */
+	if (target_use_signed_kernel() && (!device.is_unlocked))
+	{
+		/* Pass size excluding signature size, otherwise we would try to
+		 * access signature beyond its length
+		 */
+		verify_signed_bootimg((uint32_t)data, image_actual, NULL);
+	}
+#ifdef MDTP_SUPPORT
 	else
-		ret = mmc_read((ptn + size - device_info_sz), (void *)info_buf, device_info_sz);
-	if (ret)
 	{
-		dprintf(CRITICAL, "ERROR: Cannot read device info\n");
-		ASSERT(0);
+		/* fastboot boot is not allowed when MDTP is activated */
+		mdtp_ext_partition_verification_t ext_partition;
+
+		if (!is_mdtp_activated)
+		{
+			ext_partition.partition = MDTP_PARTITION_NONE;
+			mdtp_fwlock_verify_lock(&ext_partition);
+		}
 	}
-}
 
-void write_device_info_flash(device_info *dev)
-{
-	struct device_info *info = memalign(PAGE_SIZE, ROUNDUP(BOOT_IMG_MAX_PAGE_SIZE, PAGE_SIZE));
-	struct ptentry *ptn;
-	struct ptable *ptable;
-	if (info == NULL)
+	/* If mdtp state cannot be validate, block fastboot boot*/
+	if (mdtp_activated(&is_mdtp_activated))
 	{
-		dprintf(CRITICAL, "Failed to allocate memory for device info struct\n");
-		ASSERT(0);
+		dprintf(CRITICAL, "mdtp_activated cannot validate state.\n");
+		dprintf(CRITICAL, "Can not proceed with fastboot boot command.\n");
+		goto boot_failed;
 	}
-	info_buf = info;
-	ptable = flash_get_ptable();
-	if (ptable == NULL)
+	if (is_mdtp_activated)
 	{
-		dprintf(CRITICAL, "ERROR: Partition table not found\n");
-		return;
+		dprintf(CRITICAL, "fastboot boot command is not available.\n");
+		goto boot_failed;
 	}
+#endif /* MDTP_SUPPORT */
+#endif /* VERIFIED_BOOT_2 else */
 
-	ptn = ptable_find(ptable, "devinfo");
-	if (ptn == NULL)
+#if VERIFIED_BOOT
+	if (VB_M == target_get_vb_version())
 	{
-		dprintf(CRITICAL, "ERROR: No devinfo partition found\n");
-		return;
+		/* set boot and system versions. */
+		set_os_version((unsigned char *)data);
+		// send root of trust
+		if (!send_rot_command((uint32_t)device.is_unlocked))
+			ASSERT(0);
 	}
-
-	memset(info, 0, BOOT_IMG_MAX_PAGE_SIZE);
-	memcpy(info, dev, sizeof(device_info));
-
-	if (flash_write(ptn, 0, (void *)info_buf, page_size))
+#endif
+	/*
+	 * Check if the kernel image is a gzip package. If yes, need to decompress it.
+	 * If not, continue booting.
+	 */
+	if (is_gzip_package((unsigned char *)(data + page_size), hdr->kernel_size))
 	{
-		dprintf(CRITICAL, "ERROR: Cannot write device info\n");
-		return;
-	}
-	free(info);
-}
-
-static int read_allow_oem_unlock(device_info *dev)
-{
-	if (!target_is_emmc_boot())
-		return -1;
-
-	unsigned offset;
-	int index;
-	unsigned long long ptn;
-	unsigned long long ptn_size;
-	unsigned blocksize = mmc_get_device_blocksize();
-	STACKBUF_DMA_ALIGN(buf, blocksize);
+		out_addr = (unsigned char *)target_get_scratch_address();
+		out_addr = (unsigned char *)(out_addr + image_actual + page_size);
+		out_avai_len = target_get_max_flash_size() - image_actual - page_size;
+#if VERIFIED_BOOT_2
+		if (dtbo_image_sz)
+			out_avai_len -= DTBO_IMG_BUF;
+#endif
+		dprintf(INFO, "decompressing kernel image: start\n");
+		ret = decompress((unsigned char *)(ptr + page_size),
+						 hdr->kernel_size, out_addr, out_avai_len,
+						 &dtb_offset, &out_len);
+		if (ret)
+		{
+			dprintf(CRITICAL, "decompressing image failed!!!\n");
+			ASSERT(0);
+		}
 
-	index = partition_get_index(frp_ptns[0]);
-	if (index == INVALID_PTN)
+		dprintf(INFO, "decompressing kernel image: done\n");
+		kptr = (struct kernel64_hdr *)out_addr;
+		kernel_start_addr = out_addr;
+		kernel_size = out_len;
+	}
+	else if (lz4_is_compressed((unsigned char *)(data + page_size), hdr->kernel_size))
 	{
-		index = partition_get_index(frp_ptns[1]);
-		if (index == INVALID_PTN)
+		size_t lz4_in, lz4_out;
+
+		out_addr = (unsigned char *)target_get_scratch_address();
+		out_addr = (unsigned char *)(out_addr + image_actual + page_size);
+		out_avai_len = target_get_max_flash_size() - image_actual - page_size;
+#if VERIFIED_BOOT_2
+		if (dtbo_image_sz)
+			out_avai_len -= DTBO_IMG_BUF;
+#endif
+		dprintf(INFO, "decompressing lz4 kernel image: start\n");
+		ret = lz4_decompress((unsigned char *)(ptr + page_size),
+				     hdr->kernel_size, out_addr, out_avai_len,
+				     &lz4_in, &lz4_out);
+		if (ret)
 		{
-			dprintf(CRITICAL, "Neither '%s' nor '%s' partition found\n", frp_ptns[0], frp_ptns[1]);
-			return -1;
+			dprintf(CRITICAL, "decompressing lz4 image failed: %d\n", ret);
+			ASSERT(0);
 		}
+
+		dprintf(INFO, "decompressing lz4 kernel image: done\n");
+		dtb_offset = lz4_in;
+		kptr = (struct kernel64_hdr *)out_addr;
+		kernel_start_addr = out_addr;
+		kernel_size = lz4_out;
+	}
+	else
+	{
+		kptr = (struct kernel64_hdr *)((char *)data + page_size);
+		kernel_start_addr = (unsigned char *)((char *)data + page_size);
+		kernel_size = hdr->kernel_size;
 	}
 
-	ptn = partition_get_offset(index);
-	ptn_size = partition_get_size(index);
-	offset = ptn_size - blocksize;
+	if (kptr->text_offset > 2 * 1024 * 1024)
+		kptr->text_offset = 0; // HACK
 
-	/* Set Lun for partition */
-	mmc_set_lun(partition_get_lun(index));
+	/*
+	 * Update the kernel/ramdisk/tags address if the boot image header
+	 * has default values, these default values come from mkbootimg when
+	 * the boot image is flashed using fastboot flash:raw
+	 */
+	update_ker_tags_rdisk_addr(hdr, kptr);
 
-	if (mmc_read(ptn + offset, (void *)buf, blocksize))
+	/* Get virtual addresses since the hdr saves physical addresses. */
+	hdr->kernel_addr = VA(hdr->kernel_addr);
+	hdr->ramdisk_addr = VA(hdr->ramdisk_addr);
+	hdr->tags_addr = VA(hdr->tags_addr);
+
+	kernel_size = ROUND_TO_PAGE(kernel_size, page_mask);
+	/* Check if the addresses in the header are valid. */
+	if (check_aboot_addr_range_overlap(hdr->kernel_addr, kernel_size) ||
+		check_ddr_addr_range_bound(hdr->kernel_addr, kernel_size) ||
+		check_aboot_addr_range_overlap(hdr->ramdisk_addr, ramdisk_actual) ||
+		check_ddr_addr_range_bound(hdr->ramdisk_addr, ramdisk_actual))
 	{
-		dprintf(CRITICAL, "Reading MMC failed\n");
-		return -1;
+		dprintf(CRITICAL, "kernel/ramdisk addresses are not valid.\n");
+		goto boot_failed;
 	}
 
-	/*is_allow_unlock is a bool value stored at the LSB of last byte*/
-	is_allow_unlock = buf[blocksize - 1] & 0x01;
-	return 0;
-}
+#if DEVICE_TREE
+	scratch_offset = image_actual + page_size + out_len;
+	/* find correct dtb and copy it to right location */
+	ret = copy_dtb(data, scratch_offset);
 
-static int write_allow_oem_unlock(bool allow_unlock)
-{
-	if (!target_is_emmc_boot())
-		return -1;
+	dtb_copied = !ret ? 1 : 0;
+#else
+	if (check_aboot_addr_range_overlap(hdr->tags_addr, MAX_TAGS_SIZE) ||
+		check_ddr_addr_range_bound(hdr->tags_addr, MAX_TAGS_SIZE))
+	{
+		dprintf(CRITICAL, "Tags addresses are not valid.\n");
+		goto boot_failed;
+	}
+#endif
 
-	unsigned offset;
-	int index;
-	unsigned long long ptn;
-	unsigned long long ptn_size;
-	unsigned blocksize = mmc_get_device_blocksize();
-	STACKBUF_DMA_ALIGN(buf, blocksize);
+#if DEVICE_TREE
+	if (check_aboot_addr_range_overlap(hdr->tags_addr, kernel_actual) ||
+		check_ddr_addr_range_bound(hdr->tags_addr, kernel_actual))
+	{
+		dprintf(CRITICAL, "Tags addresses are not valid.\n");
+		goto boot_failed;
+	}
 
-	index = partition_get_index(frp_ptns[0]);
-	if (index == INVALID_PTN)
+	/*
+	 * If dtb is not found look for appended DTB in the kernel.
+	 * If appended dev tree is found, update the atags with
+	 * memory address to the DTB appended location on RAM.
+	 * Else update with the atags address in the kernel header
+	 */
+	if (!dtb_copied)
 	{
-		index = partition_get_index(frp_ptns[1]);
-		if (index == INVALID_PTN)
+		void *dtb;
+		dtb = dev_tree_appended((void *)(ptr + page_size),
+								hdr->kernel_size, dtb_offset,
+								(void *)hdr->tags_addr);
+#if WITH_LK2ND_DEVICE_2ND
+		if (!dtb && lk2nd_device2nd_have_atags())
+			boot_type |= BOOT_ATAGS_COPY;
+		else
+#endif
+			if (!dtb)
 		{
-			dprintf(CRITICAL, "Neither '%s' nor '%s' partition found\n", frp_ptns[0], frp_ptns[1]);
-			return -1;
+			fastboot_fail("dtb not found");
+			goto boot_failed;
 		}
 	}
+#endif
 
-	ptn = partition_get_offset(index);
-	ptn_size = partition_get_size(index);
-	offset = ptn_size - blocksize;
-	mmc_set_lun(partition_get_lun(index));
+	/* Load ramdisk & kernel */
+	lk2nd_memcpy((void *)hdr->ramdisk_addr, ptr + page_size + kernel_actual, hdr->ramdisk_size);
+	lk2nd_memcpy((void *)hdr->kernel_addr, (char *)(kernel_start_addr), kernel_size);
 
-	if (mmc_read(ptn + offset, (void *)buf, blocksize))
-	{
-		dprintf(CRITICAL, "Reading MMC failed\n");
-		return -1;
-	}
+	fastboot_okay("");
+	fastboot_stop();
 
-	/*is_allow_unlock is a bool value stored at the LSB of last byte*/
-	buf[blocksize - 1] = allow_unlock;
-	if (mmc_write(ptn + offset, blocksize, buf))
-	{
-		dprintf(CRITICAL, "Writing MMC failed\n");
-		return -1;
-	}
+#ifdef LK2ND_FASTBOOT_DELAY
+	/* This can help with debugging on devices with carkit uart. You need to switch the cable before starting linux to see all the logs */
+	dprintf(INFO, "Waiting %ums before boot\n", LK2ND_FASTBOOT_DELAY);
+	thread_sleep(LK2ND_FASTBOOT_DELAY);
+#endif
 
-	return 0;
+	boot_linux((void *)hdr->kernel_addr, (void *)hdr->tags_addr,
+			   (const char *)hdr->cmdline, board_machtype(),
+			   (void *)hdr->ramdisk_addr, hdr->ramdisk_size,
+			   boot_type);
+
+	/* fastboot already stop, it's no need to show fastboot menu */
+	return;
+boot_failed:
+#if FBCON_DISPLAY_MSG
+	/* revert to fastboot menu if boot failed */
+	display_fastboot_menu();
+#endif
+	return;
 }
 
-void read_device_info_flash(device_info *dev)
+#if WITH_LK2ND_DEVICE_2ND
+/* Header of LK images (arch/arm/crt0.S), same as for 32-bit zImage */
+#define LK_IMAGE_MAGIC_OFFSET	0x24
+#define LK_IMAGE_MAGIC		0x016f2818
+#define LK_IMAGE_SIZE_OFFSET	0x2c
+
+/*
+ * "oem boot-lk2nd" runs a new lk2nd build from the download buffer, either
+ * the raw binary or lk2nd.img. It is started with the same registers as this
+ * one by the primary bootloader, so it sees the original DTB/ATAGS and
+ * cmdline. LK copies itself to its link address on startup, so the image can
+ * be started where it is as long as it does not overlap with the running LK.
+ */
+static void cmd_oem_boot_lk2nd(const char *arg, void *data, unsigned sz)
 {
-	struct device_info *info = memalign(PAGE_SIZE, ROUNDUP(BOOT_IMG_MAX_PAGE_SIZE, PAGE_SIZE));
-	struct ptentry *ptn;
-	struct ptable *ptable;
-	if (info == NULL)
-	{
-		dprintf(CRITICAL, "Failed to allocate memory for device info struct\n");
-		ASSERT(0);
+	extern uintptr_t lk_boot_args[3];
+	boot_img_hdr *hdr = data;
+	const void *tags;
+	unsigned tags_size;
+	uint32_t magic, size;
+	entry_func_ptr *entry;
+
+	if (sz >= sizeof(*hdr) && !memcmp(hdr->magic, BOOT_MAGIC, BOOT_MAGIC_SIZE)) {
+		if (hdr->page_size > sz || hdr->kernel_size > sz - hdr->page_size) {
+			fastboot_fail("invalid boot image");
+			return;
+		}
+		data = (char *)data + hdr->page_size;
+		sz = hdr->kernel_size;
 	}
-	info_buf = info;
-	ptable = flash_get_ptable();
-	if (ptable == NULL)
-	{
-		dprintf(CRITICAL, "ERROR: Partition table not found\n");
+
+	if (sz < LK_IMAGE_SIZE_OFFSET + sizeof(size)) {
+		fastboot_fail("not an lk2nd image");
 		return;
 	}
-
-	ptn = ptable_find(ptable, "devinfo");
-	if (ptn == NULL)
-	{
-		dprintf(CRITICAL, "ERROR: No devinfo partition found\n");
+	memcpy(&magic, (char *)data + LK_IMAGE_MAGIC_OFFSET, sizeof(magic));
+	memcpy(&size, (char *)data + LK_IMAGE_SIZE_OFFSET, sizeof(size));
+	if (magic != LK_IMAGE_MAGIC || !size || size > sz) {
+		fastboot_fail("not an lk2nd image");
 		return;
 	}
 
-	if (flash_read(ptn, 0, (void *)info_buf, page_size))
-	{
-		dprintf(CRITICAL, "ERROR: Cannot write device info\n");
+	if (check_aboot_addr_range_overlap((uintptr_t)data, size)) {
+		fastboot_fail("image overlaps with lk2nd");
 		return;
 	}
 
-	if (memcmp(info->magic, DEVICE_MAGIC, DEVICE_MAGIC_SIZE))
-	{
-		memcpy(info->magic, DEVICE_MAGIC, DEVICE_MAGIC_SIZE);
-		info->is_unlocked = 0;
-		info->is_tampered = 0;
-		write_device_info_flash(info);
+	tags = lk2nd_device2nd_get_tags(&tags_size);
+	if (!tags) {
+		fastboot_fail("no DTB/ATAGS from the previous bootloader");
+		return;
+	}
+	if ((uintptr_t)tags < (uintptr_t)data + size &&
+	    (uintptr_t)data < (uintptr_t)tags + tags_size) {
+		fastboot_fail("image overlaps with the DTB/ATAGS");
+		return;
 	}
-	memcpy(dev, info, sizeof(device_info));
-	free(info);
-}
 
-void write_device_info(device_info *dev)
-{
-	if (target_is_emmc_boot())
-	{
-		struct device_info *info = memalign(PAGE_SIZE, ROUNDUP(BOOT_IMG_MAX_PAGE_SIZE, PAGE_SIZE));
-		if (info == NULL)
-		{
-			dprintf(CRITICAL, "Failed to allocate memory for device info struct\n");
-			ASSERT(0);
-		}
-		info_buf = info;
-		memcpy(info, dev, sizeof(struct device_info));
+	fastboot_okay("");
+	fastboot_stop();
 
-#if USE_RPMB_FOR_DEVINFO
-		if (VB_M <= target_get_vb_version() &&
-			is_secure_boot_enable())
-		{
-			if ((write_device_info_rpmb((void *)info, PAGE_SIZE)) < 0)
-				ASSERT(0);
-		}
-		else
-			write_device_info_mmc(info);
-#else
-		write_device_info_mmc(info);
+#if WITH_LK2ND_SMP_WORKER
+	lk2nd_smp_worker_park();
 #endif
-		free(info);
-	}
-	else
-	{
-		write_device_info_flash(dev);
-	}
-}
+#if WITH_LK2ND_HW_BDEV
+	lk2nd_bdev_wait();
+#endif
+	aboot_display_wait();
+#if DISPLAY_SPLASH_SCREEN
+	target_display_shutdown();
+#endif
+	if (target_is_emmc_boot())
+		mmc_write_cache_enable(false);
+	target_uninit();
 
-int read_rollback_index(uint32_t loc, uint64_t *roll_back_index)
-{
-	if (!devinfo_present)
-	{
-		dprintf(CRITICAL, "DeviceInfo not initalized \n");
-		return -EINVAL;
-	}
-	if (loc >= ARRAY_SIZE(device.rollback_index))
-	{
-		dprintf(CRITICAL, "%s() Loc out of range index: %d, array len: %d\n",
-				__func__, loc, ARRAY_SIZE(device.rollback_index));
-		ASSERT(0);
-	}
+	dprintf(INFO, "booting lk2nd @ %p (%u bytes), r1=%#lx, r2=%#lx\n",
+		data, size, lk_boot_args[1], lk_boot_args[2]);
 
-	*roll_back_index = device.rollback_index[loc];
-	return 0;
+	entry = (entry_func_ptr *)PA((addr_t)data);
+	boot_leave_lk();
+	entry(0, lk_boot_args[1], (unsigned *)lk_boot_args[2]);
 }
+#endif
 
-int write_rollback_index(uint32_t loc, uint64_t roll_back_index)
+void cmd_erase_nand(const char *arg, void *data, unsigned sz)
 {
-	if (!devinfo_present)
+	struct ptentry *ptn;
+	struct ptable *ptable;
+
+	ptable = flash_get_ptable();
+	if (ptable == NULL)
 	{
-		dprintf(CRITICAL, "DeviceInfo not initalized \n");
-		return -EINVAL;
+		fastboot_fail("partition table doesn't exist");
+		return;
 	}
-	if (loc >= ARRAY_SIZE(device.rollback_index))
+
+	ptn = ptable_find(ptable, arg);
+	if (ptn == NULL)
 	{
-		dprintf(CRITICAL, "%s() Loc out of range index: %d, array len: %d\n",
-				__func__, loc, ARRAY_SIZE(device.rollback_index));
-		ASSERT(0);
+		fastboot_fail("unknown partition name");
+		return;
 	}
 
-	device.rollback_index[loc] = roll_back_index;
-	write_device_info(&device);
-	return 0;
-}
-
 #if VERIFIED_BOOT_2
-int store_userkey(uint8_t *user_key, uint32_t user_key_size)
-{
-	if (!devinfo_present)
+	if (!strncmp(arg, "avb_custom_key", strlen("avb_custom_key")))
 	{
-		dprintf(CRITICAL, "DeviceInfo not initalized \n");
-		return -EINVAL;
+		dprintf(INFO, "erasing avb_custom_key\n");
+		if (erase_userkey())
+		{
+			fastboot_fail("Erasing avb_custom_key failed");
+		}
+		else
+		{
+			fastboot_okay("");
+		}
+		return;
 	}
+#endif
 
-	if (user_key_size > ARRAY_SIZE(device.user_public_key))
+	if (flash_erase(ptn))
 	{
-		dprintf(CRITICAL, "StoreUserKey, UserKeySize too large!\n");
-		return -ENODEV;
+		fastboot_fail("failed to erase partition");
+		return;
 	}
-
-	memcpy(device.user_public_key, user_key, user_key_size);
-	device.user_public_key_length = user_key_size;
-	write_device_info(&device);
-	return 0;
+	fastboot_okay("");
 }
 
-int erase_userkey(void)
+void cmd_erase_mmc(const char *arg, void *data, unsigned sz)
 {
-	if (!devinfo_present)
-	{
-		dprintf(CRITICAL, "DeviceInfo not initalized \n");
-		return -EINVAL;
-	}
-	memset(device.user_public_key, 0, ARRAY_SIZE(device.user_public_key));
-	device.user_public_key_length = 0;
-	write_device_info(&device);
-	return 0;
-}
+	unsigned long long ptn = 0;
+	unsigned long long size = 0;
+	int index = INVALID_PTN;
+	uint8_t lun = 0;
+	char *footer = NULL;
+	char EraseResultStr[MAX_RSP_SIZE] = "";
+	VirtualAbMergeStatus SnapshotMergeStatus;
 
-int get_userkey(uint8_t **user_key, uint32_t *user_key_size)
-{
-	if (!devinfo_present)
+#if VERIFIED_BOOT
+	if (!strcmp(arg, KEYSTORE_PTN_NAME))
 	{
-		dprintf(CRITICAL, "DeviceInfo not initalized \n");
-		return -EINVAL;
+		if (!device.is_unlocked)
+		{
+			fastboot_fail("unlock device to erase keystore");
+			return;
+		}
 	}
-	*user_key = device.user_public_key;
-	*user_key_size = device.user_public_key_length;
-	return 0;
-}
-#endif /* VERIFIED_BOOT_2 */
+#endif
 
-void read_device_info(device_info *dev)
-{
-	if (target_is_emmc_boot())
+	index = partition_get_index(arg);
+	ptn = partition_get_offset(index);
+	size = partition_get_size(index);
+
+	if (target_virtual_ab_supported())
 	{
-		struct device_info *info = memalign(PAGE_SIZE, ROUNDUP(BOOT_IMG_MAX_PAGE_SIZE, PAGE_SIZE));
-		if (info == NULL)
+		if (CheckVirtualAbCriticalPartition(arg))
 		{
-			dprintf(CRITICAL, "Failed to allocate memory for device info struct\n");
-			ASSERT(0);
+			snprintf(EraseResultStr, MAX_RSP_SIZE, "Erase of %s is not allowed in %s state",
+					 arg, SnapshotMergeState);
+			fastboot_fail(EraseResultStr);
+			return;
+		}
+		SnapshotMergeStatus = GetSnapshotMergeStatus();
+		if (((SnapshotMergeStatus == MERGING) || (SnapshotMergeStatus == SNAPSHOTTED)) &&
+			!strncmp(arg, "super", strlen("super")))
+		{
+
+			if (SetSnapshotMergeStatus(CANCELLED))
+			{
+				fastboot_fail("Failed to update snapshot state to cancel");
+				return;
+			}
+
+			// updating fbvar snapshot-merge-state
+			snprintf(SnapshotMergeState, strlen(VabSnapshotMergeStatus[NONE_MERGE_STATUS]) + 1,
+					 "%s", VabSnapshotMergeStatus[NONE_MERGE_STATUS]);
 		}
-		info_buf = info;
+	}
 
-#if USE_RPMB_FOR_DEVINFO
-		if (VB_M <= target_get_vb_version() &&
-			is_secure_boot_enable())
+#if VERIFIED_BOOT_2
+	if (!strncmp(arg, "avb_custom_key", strlen("avb_custom_key")))
+	{
+		dprintf(INFO, "erasing avb_custom_key\n");
+		if (erase_userkey())
 		{
-			if ((read_device_info_rpmb((void *)info, PAGE_SIZE)) < 0)
-				ASSERT(0);
+			fastboot_fail("Erasing avb_custom_key failed");
 		}
 		else
-			read_device_info_mmc(info);
-#else
-		read_device_info_mmc(info);
+		{
+			fastboot_okay("");
+		}
+		return;
+	}
 #endif
 
-		if (memcmp(info->magic, DEVICE_MAGIC, DEVICE_MAGIC_SIZE))
+	if (ptn == 0)
+	{
+		fastboot_fail("Partition table doesn't exist\n");
+		return;
+	}
+
+	lun = partition_get_lun(index);
+	mmc_set_lun(lun);
+
+	if (platform_boot_dev_isemmc())
+	{
+		/* Trim leaves the erased memory content behind, like erase */
+		if (use_discard && !mmc_trim_card(ptn, size, false))
+			dprintf(INFO, "Trimmed partition %s\n", arg);
+		else if (mmc_erase_card(ptn, size))
 		{
-			memcpy(info->magic, DEVICE_MAGIC, DEVICE_MAGIC_SIZE);
-			if (is_secure_boot_enable())
-			{
-				info->is_unlocked = 0;
-#if VERIFIED_BOOT || VERIFIED_BOOT_2
-				if (VB_M <= target_get_vb_version())
-					info->is_unlock_critical = 0;
-#endif
-			}
-			else
-			{
-				info->is_unlocked = 1;
-#if VERIFIED_BOOT || VERIFIED_BOOT_2
-				if (VB_M <= target_get_vb_version())
-					info->is_unlock_critical = 1;
-#endif
-			}
-			info->is_tampered = 0;
-			info->charger_screen_enabled = 0;
-#if VERIFIED_BOOT || VERIFIED_BOOT_2
-			if (VB_M <= target_get_vb_version())
-			{
-				info->verity_mode = 1; // enforcing by default
-				info->user_public_key_length = 0;
-				memset(info->rollback_index, 0, sizeof(info->rollback_index));
-				memset(info->user_public_key, 0, sizeof(info->user_public_key));
-			}
-#endif
-			write_device_info(info);
+			fastboot_fail("failed to erase partition\n");
+			return;
 		}
-		memcpy(dev, info, sizeof(device_info));
-		free(info);
 	}
 	else
 	{
-		read_device_info_flash(dev);
-	}
-}
+		BUF_DMA_ALIGN(out, DEFAULT_ERASE_SIZE);
 
-void reset_device_info(void)
-{
-	dprintf(ALWAYS, "reset_device_info called.");
-	device.is_tampered = 0;
-	write_device_info(&device);
-}
+		/* Unmap the partition, the start & the footer are zeroed below */
+		if (use_discard && mmc_trim_card(ptn, size, false))
+			dprintf(CRITICAL, "Failed to unmap partition %s\n", arg);
 
-void set_device_root(void)
-{
-	dprintf(ALWAYS, "set_device_root called.");
-	device.is_tampered = 1;
-	write_device_info(&device);
-}
+		size = partition_get_size(index);
+		if (size > DEFAULT_ERASE_SIZE)
+			size = DEFAULT_ERASE_SIZE;
 
-/* set device unlock value
- * Must check FRP before call this function
- * Need to wipe data when unlock status changed
- * type 0: oem unlock
- * type 1: unlock critical
- * status 0: unlock as false
- * status 1: lock as true
- */
-void set_device_unlock_value(int type, bool status)
-{
-	if (type == UNLOCK)
-		device.is_unlocked = status;
+		/* Simple inefficient version of erase. Just writing
+		   0 in first several blocks */
+		if (mmc_write(ptn, size, (unsigned int *)out))
+		{
+			fastboot_fail("failed to erase partition");
+			return;
+		}
+		/*Erase FDE metadata at the userdata footer*/
+		if (!(strncmp(arg, "userdata", 8)))
+		{
+			footer = memalign(CACHE_LINE, FOOTER_SIZE);
+			memset((void *)footer, 0, FOOTER_SIZE);
+
+			size = partition_get_size(index);
+
+			if (mmc_write((ptn + size) - FOOTER_SIZE, FOOTER_SIZE, (unsigned int *)footer))
+			{
+				fastboot_fail("failed to erase userdata footer");
+				free(footer);
+				return;
+			}
+			free(footer);
+		}
+	}
 #if VERIFIED_BOOT || VERIFIED_BOOT_2
-	else if (VB_M <= target_get_vb_version() &&
-			 type == UNLOCK_CRITICAL)
-		device.is_unlock_critical = status;
+	if (VB_M <= target_get_vb_version() &&
+		!(strncmp(arg, "userdata", 8)) &&
+		send_delete_keys_to_tz())
+		ASSERT(0);
 #endif
-	write_device_info(&device);
+	fastboot_okay("");
 }
 
-static void set_device_unlock(int type, bool status)
+void cmd_erase(const char *arg, void *data, unsigned sz)
 {
-	int is_unlocked = -1;
-	char response[MAX_RSP_SIZE];
-
-	/* check device unlock status if it is as expected */
-	if (type == UNLOCK)
-		is_unlocked = device.is_unlocked;
 #if VERIFIED_BOOT || VERIFIED_BOOT_2
-	if (VB_M <= target_get_vb_version() &&
-		type == UNLOCK_CRITICAL)
+	if (target_build_variant_user())
 	{
-		is_unlocked = device.is_unlock_critical;
+		if (!device.is_unlocked)
+		{
+			fastboot_fail("device is locked. Cannot erase");
+			return;
+		}
 	}
 #endif
-	if (is_unlocked == status)
+
+	if (target_is_emmc_boot())
+		cmd_erase_mmc(arg, data, sz);
+	else
+		cmd_erase_nand(arg, data, sz);
+}
+
+/* Get the size from partiton name */
+static void get_partition_size(const char *arg, char *response)
+{
+	uint64_t ptn = 0;
+	uint64_t size;
+	int index = INVALID_PTN;
+
+	index = partition_get_index(arg);
+
+	if (index == INVALID_PTN)
 	{
-		snprintf(response, sizeof(response), "\tDevice already : %s", (status ? "unlocked!" : "locked!"));
-		fastboot_info(response);
-		fastboot_okay("");
+		dprintf(CRITICAL, "Invalid partition index\n");
 		return;
 	}
 
-	/* status is true, it means to unlock device */
-	if (status && !is_allow_unlock)
+	ptn = partition_get_offset(index);
+
+	if (!ptn)
 	{
-		fastboot_fail("oem unlock is not allowed");
+		dprintf(CRITICAL, "Invalid partition name %s\n", arg);
 		return;
 	}
 
-#if FBCON_DISPLAY_MSG
-	display_unlock_menu(type, status);
-	fastboot_okay("");
+	size = partition_get_size(index);
+
+	snprintf(response, MAX_RSP_SIZE, "\t 0x%llx", size);
 	return;
-#else
-	if (status && type == UNLOCK)
+}
+
+/* Function to check partition type of a partition*/
+static fs_signature_type
+check_partition_fs_signature(const char *arg)
+{
+	fs_signature_type ret = NO_FS;
+	int index;
+	unsigned long long ptn;
+	char *buffer = memalign(CACHE_LINE, mmc_blocksize);
+	uint32_t sb_blk_offset = 0;
+	char *sb_buffer = buffer;
+
+	if (!sb_buffer)
 	{
-		fastboot_fail("Need wipe userdata. Do 'fastboot oem unlock-go'");
-		return;
+		dprintf(CRITICAL, "ERROR: Failed to allocate buffer for superblock\n");
+		goto out;
 	}
-#endif
 
-	set_device_unlock_value(type, status);
-
-	/* wipe data */
-	struct recovery_message msg;
-	memset(&msg, 0, sizeof(msg));
-	snprintf(msg.recovery, sizeof(msg.recovery), "recovery\n--wipe_data");
-	write_misc(0, &msg, sizeof(msg));
+	/* Read super block */
+	if ((index = partition_get_index(arg)) < 0)
+	{
+		dprintf(CRITICAL, "ERROR: %s() doesn't exsit\n", arg);
+		goto out;
+	}
+	ptn = partition_get_offset(index);
+	mmc_set_lun(partition_get_lun(index));
+	sb_blk_offset = (FS_SUPERBLOCK_OFFSET / mmc_blocksize);
 
-	fastboot_okay("");
-	reboot_device(RECOVERY_MODE);
-}
+	if (mmc_read(ptn + (sb_blk_offset * mmc_blocksize),
+				 (void *)sb_buffer, mmc_blocksize))
+	{
+		dprintf(CRITICAL, "ERROR: Failed to read Superblock\n");
+		goto out;
+	}
 
-static bool critical_flash_allowed(const char *entry)
-{
-	uint32_t i = 0;
-	if (entry == NULL)
-		return false;
+	if (sb_blk_offset == 0)
+		sb_buffer += FS_SUPERBLOCK_OFFSET;
 
-	for (i = 0; i < ARRAY_SIZE(critical_flash_allowed_ptn); i++)
+	if (*((uint16 *)(&sb_buffer[EXT_MAGIC_OFFSET_SB])) == (uint16)EXT_MAGIC)
 	{
-		if (!strcmp(entry, critical_flash_allowed_ptn[i]))
-			return true;
+		dprintf(SPEW, "%s() Found EXT FS\n", arg);
+		ret = EXT_FS_SIGNATURE;
 	}
-	return false;
+	else if (*((uint32 *)(&sb_buffer[F2FS_MAGIC_OFFSET_SB])) == F2FS_MAGIC)
+	{
+		dprintf(SPEW, "%s() Found F2FS FS\n", arg);
+		ret = EXT_F2FS_SIGNATURE;
+	}
+	else
+	{
+		dprintf(SPEW, "%s() Reverting to default 0x%x\n",
+				arg, *((uint16 *)(&sb_buffer[EXT_MAGIC_OFFSET_SB])));
+		ret = NO_FS;
+	}
+
+out:
+	if (buffer)
+		free(buffer);
+	return ret;
 }
-#endif /* !ABOOT_STANDALONE */
 
-#if DEVICE_TREE
-int copy_dtb(uint8_t *boot_image_start, unsigned int scratch_offset)
+/* Function to get partition type */
+static void get_partition_type(const char *arg, char *response)
 {
-	uint32 dt_image_offset = 0;
-	uint32_t n;
-	struct dt_table *table = NULL;
-	struct dt_entry dt_entry;
-	uint32_t dt_hdr_size = 0;
-	unsigned int compressed_size = 0;
-	unsigned int dtb_size = 0;
-	unsigned int out_avai_len = 0;
-	unsigned char *out_addr = NULL;
-	unsigned char *best_match_dt_addr = NULL;
-	int rc;
-
-	boot_img_hdr *hdr = (boot_img_hdr *)(boot_image_start);
-
-#ifndef OSVERSION_IN_BOOTIMAGE
-	dt_size = hdr->dt_size;
-#endif
+	uint n = 0;
+	fs_signature_type fs_signature;
 
-	if (dt_size != 0)
+	if (arg == NULL ||
+		response == NULL)
 	{
-		/* add kernel offset */
-		dt_image_offset += page_size;
-		n = ROUND_TO_PAGE(hdr->kernel_size, page_mask);
-		dt_image_offset += n;
+		dprintf(CRITICAL, "Invalid input parameter\n");
+		return;
+	}
 
-		/* add ramdisk offset */
-		n = ROUND_TO_PAGE(hdr->ramdisk_size, page_mask);
-		dt_image_offset += n;
+	/* By default copy raw to response */
+	strlcpy(response, RAW_STR, MAX_RSP_SIZE);
 
-		/* add second offset */
-		if (hdr->second_size != 0)
+	/* Mark partiton type for known paritions only */
+	for (n = 0; n < ARRAY_SIZE(part_type_known); n++)
+	{
+		if (!strncmp(part_type_known[n].part_name, arg, strlen(arg)))
 		{
-			n = ROUND_TO_PAGE(hdr->second_size, page_mask);
-			dt_image_offset += n;
+			/* Check partition for FS signature */
+			fs_signature = check_partition_fs_signature(arg);
+			switch (fs_signature)
+			{
+			case EXT_FS_SIGNATURE:
+				strlcpy(response, EXT_STR, MAX_RSP_SIZE);
+				break;
+			case EXT_F2FS_SIGNATURE:
+				strlcpy(response, F2FS_STR, MAX_RSP_SIZE);
+				break;
+			case NO_FS:
+				strlcpy(response, part_type_known[n].type_response, MAX_RSP_SIZE);
+			}
 		}
+	}
+	return;
+}
 
-		/* offset now point to start of dt.img */
-		table = (struct dt_table *)(boot_image_start + dt_image_offset);
+/*
+ * Publish the partition type & size info
+ * fastboot getvar will publish the required information.
+ * fastboot getvar partition_size:<partition_name>: partition size in hex
+ * fastboot getvar partition_type:<partition_name>: partition type (ext/fat)
+ */
+static void publish_getvar_partition_info(struct getvar_partition_info *info, uint8_t num_parts)
+{
+	uint8_t i;
+	static bool published = false;
+	struct partition_entry *ptn_entry =
+		partition_get_partition_entries();
+	memset(info, 0, sizeof(struct getvar_partition_info) * num_parts);
 
-		if (dev_tree_validate(table, hdr->page_size, &dt_hdr_size) != 0)
+	for (i = 0; i < num_parts; i++)
+	{
+		strlcat(info[i].part_name, (const char *)ptn_entry[i].name, MAX_RSP_SIZE);
+		strlcat(info[i].getvar_size, "partition-size:", MAX_GET_VAR_NAME_SIZE);
+		strlcat(info[i].getvar_type, "partition-type:", MAX_GET_VAR_NAME_SIZE);
+
+		get_partition_type(info[i].part_name, info[i].type_response);
+		get_partition_size(info[i].part_name, info[i].size_response);
+		if (strlcat(info[i].getvar_size, info[i].part_name, MAX_GET_VAR_NAME_SIZE) >= MAX_GET_VAR_NAME_SIZE)
 		{
-			dprintf(CRITICAL, "ERROR: Cannot validate Device Tree Table \n");
-			return -1;
+			dprintf(CRITICAL, "partition size name truncated\n");
+			return;
 		}
-
-		/* Its Error if, dt_hdr_size (table->num_entries * dt_entry size + Dev_Tree Header)
-		goes beyound hdr->dt_size*/
-		if (dt_hdr_size > ROUND_TO_PAGE(dt_size, hdr->page_size))
+		if (strlcat(info[i].getvar_type, info[i].part_name, MAX_GET_VAR_NAME_SIZE) >= MAX_GET_VAR_NAME_SIZE)
 		{
-			dprintf(CRITICAL, "ERROR: Invalid Device Tree size \n");
-			return -1;
+			dprintf(CRITICAL, "partition type name truncated\n");
+			return;
 		}
 
-		/* Find index of device tree within device tree table */
-		if (dev_tree_get_entry_info(table, &dt_entry) != 0)
+		if (!published)
 		{
-			dprintf(CRITICAL, "ERROR: Getting device tree address failed\n");
-			return -1;
+			/* publish partition size & type info */
+			fastboot_publish((const char *)info[i].getvar_size, (const char *)info[i].size_response);
+			fastboot_publish((const char *)info[i].getvar_type, (const char *)info[i].type_response);
 		}
+	}
+	if (!published)
+		published = true;
+}
 
-		best_match_dt_addr = (unsigned char *)boot_image_start + dt_image_offset + dt_entry.offset;
-		if (is_gzip_package(best_match_dt_addr, dt_entry.size))
-		{
-			out_addr = (unsigned char *)target_get_scratch_address() + scratch_offset;
-			out_avai_len = target_get_max_flash_size() - scratch_offset;
-			dprintf(INFO, "decompressing dtb: start\n");
-			rc = decompress(best_match_dt_addr,
-							dt_entry.size, out_addr, out_avai_len,
-							&compressed_size, &dtb_size);
-			if (rc)
-			{
-				dprintf(CRITICAL, "decompressing dtb failed!!!\n");
-				ASSERT(0);
-			}
+static void flash_publish_getvar_partition_info(struct getvar_partition_info *info)
+{
+	struct ptable *ptable;
+	unsigned num_parts, i;
 
-			dprintf(INFO, "decompressing dtb: done\n");
-			best_match_dt_addr = out_addr;
-		}
-		else
+	ptable = flash_get_ptable();
+	if (!ptable)
+		return;
+
+	num_parts = ptable_size(ptable);
+	memset(info, 0, sizeof(struct getvar_partition_info) * num_parts);
+
+	for (i = 0; i < num_parts; i++)
+	{
+		struct ptentry *ptn = ptable_get(ptable, i);
+
+		strlcpy(info[i].part_name, ptn->name, MAX_RSP_SIZE);
+		strlcpy(info[i].getvar_size, "partition-size:", MAX_GET_VAR_NAME_SIZE);
+		strlcpy(info[i].getvar_type, "partition-type:", MAX_GET_VAR_NAME_SIZE);
+
+		strlcpy(info[i].type_response, RAW_STR, MAX_RSP_SIZE);
+		snprintf(info[i].size_response, MAX_RSP_SIZE, "0x%llx", validate_partition_size(ptn));
+
+		if (strlcat(info[i].getvar_size, info[i].part_name, MAX_GET_VAR_NAME_SIZE) >= MAX_GET_VAR_NAME_SIZE)
 		{
-			dtb_size = dt_entry.size;
+			dprintf(CRITICAL, "partition size name truncated\n");
+			continue;
 		}
-		/* Validate and Read device device tree in the "tags_add */
-		if (check_aboot_addr_range_overlap(hdr->tags_addr, dtb_size) ||
-			check_ddr_addr_range_bound(hdr->tags_addr, dtb_size))
+		if (strlcat(info[i].getvar_type, info[i].part_name, MAX_GET_VAR_NAME_SIZE) >= MAX_GET_VAR_NAME_SIZE)
 		{
-			dprintf(CRITICAL, "Device tree addresses are not valid.\n");
-			return -1;
+			dprintf(CRITICAL, "partition type name truncated\n");
+			continue;
 		}
 
-		/* Read device device tree in the "tags_add */
-		memmove((void *)hdr->tags_addr, (void *)best_match_dt_addr, dtb_size);
+		/* publish partition size & type info */
+		fastboot_publish(info[i].getvar_size, info[i].size_response);
+		fastboot_publish(info[i].getvar_type, info[i].type_response);
 	}
-	else
-		return -1;
-
-	/* Everything looks fine. Return success. */
-	return 0;
 }
-#endif
 
-void cmd_boot(const char *arg, void *data, unsigned sz)
+void cmd_flash_mmc_img(const char *arg, void *data, unsigned sz)
 {
-	unsigned kernel_actual;
-	unsigned ramdisk_actual;
-	unsigned second_actual;
-	uint32_t image_actual;
-	uint32_t dt_actual = 0;
-	boot_img_hdr *hdr = NULL;
-	struct kernel64_hdr *kptr = NULL;
-	char *ptr = ((char *)data);
-	int ret = 0;
-	unsigned int out_len = 0;
-	unsigned int out_avai_len = 0;
-	unsigned char *out_addr = NULL;
-	uint32_t dtb_offset = 0;
-	unsigned char *kernel_start_addr = NULL;
-	unsigned int kernel_size = 0;
-	enum boot_type boot_type = 0;
-#if DEVICE_TREE
-	uint8_t dtb_copied = 0;
-	unsigned int scratch_offset = 0;
-#endif
-#if VERIFIED_BOOT_2
-	void *dtbo_image_buf = NULL;
-	uint32_t dtbo_image_sz = 0;
-	void *vbmeta_image_buf = NULL;
-	uint32_t vbmeta_image_sz = 0;
-#endif
-#if !VERIFIED_BOOT_2
-	uint32_t sig_actual = 0;
-	uint32_t sig_size = 0;
-#ifdef MDTP_SUPPORT
-	static bool is_mdtp_activated = 0;
-#endif /* MDTP_SUPPORT */
-#endif
-
-#if FBCON_DISPLAY_MSG
-	/* Exit keys' detection thread firstly */
-	exit_menu_keys_detection();
-#endif
-
-#if VERIFIED_BOOT || VERIFIED_BOOT_2
-	if (target_build_variant_user() && !device.is_unlocked)
-	{
-		fastboot_fail("unlock device to use this command");
-		goto boot_failed;
-	}
-#endif
+	unsigned long long ptn = 0;
+	unsigned long long size = 0;
+	int index = INVALID_PTN;
+	char *token = NULL;
+	char *pname = NULL;
+	char *sp;
+	uint8_t lun = 0;
+	bool lun_set = false;
+	int current_active_slot = INVALID;
 
-	if (sz < sizeof(hdr))
+	token = strtok_r((char *)arg, ":", &sp);
+	pname = token;
+	token = strtok_r(NULL, ":", &sp);
+	if (token)
 	{
-		fastboot_fail("invalid bootimage header");
-		goto boot_failed;
+		lun = atoi(token);
+		mmc_set_lun(lun);
+		lun_set = true;
 	}
 
-	hdr = (boot_img_hdr *)data;
-
-	/* ensure commandline is terminated */
-	hdr->cmdline[BOOT_ARGS_SIZE - 1] = 0;
-
-	if (target_is_emmc_boot() && hdr->page_size)
-	{
-		page_size = hdr->page_size;
-		page_mask = page_size - 1;
-	}
+	if (pname)
+	{
+#if !ABOOT_STANDALONE
+		if (!strncmp(pname, "frp-unlock", strlen("frp-unlock")))
+		{
+			if (!aboot_frp_unlock(pname, data, sz))
+			{
+				fastboot_info("FRP unlock successful");
+				fastboot_okay("");
+			}
+			else
+				fastboot_fail("Secret key is invalid, please update the bootloader with secret key");
 
-	kernel_actual = ROUND_TO_PAGE(hdr->kernel_size, page_mask);
-	ramdisk_actual = ROUND_TO_PAGE(hdr->ramdisk_size, page_mask);
-	second_actual = ROUND_TO_PAGE(hdr->second_size, page_mask);
-#if DEVICE_TREE
-#ifndef OSVERSION_IN_BOOTIMAGE
-	dt_size = hdr->dt_size;
-#endif
-	dt_actual = ROUND_TO_PAGE(dt_size, page_mask);
+			return;
+		}
 #endif
 
-	image_actual = ADD_OF(page_size, kernel_actual);
-	image_actual = ADD_OF(image_actual, ramdisk_actual);
-	image_actual = ADD_OF(image_actual, second_actual);
-	image_actual = ADD_OF(image_actual, dt_actual);
+		if (!strcmp(pname, "partition"))
+		{
+			dprintf(INFO, "Attempt to write partition image.\n");
+			if (write_partition(sz, (unsigned char *)data))
+			{
+				fastboot_fail("failed to write partition");
+				return;
+			}
+			/* Re-publish partition table */
+			publish_getvar_partition_info(part_info, partition_get_partition_count());
 
-	/* Checking to prevent oob access in read_der_message_length */
-	if (image_actual > sz)
-	{
-		fastboot_fail("bootimage header fields are invalid");
-		goto boot_failed;
-	}
+			/* Rescan partition table to ensure we have multislot support*/
+			if (partition_scan_for_multislot())
+			{
+				current_active_slot = partition_find_active_slot();
+				dprintf(INFO, "Multislot supported: Slot %s active",
+						(SUFFIX_SLOT(current_active_slot)));
+			}
+			partition_mark_active_slot(current_active_slot);
+		}
+		else
+		{
+#if VERIFIED_BOOT
+			if (!strcmp(pname, KEYSTORE_PTN_NAME))
+			{
+				if (!device.is_unlocked)
+				{
+					fastboot_fail("unlock device to flash keystore");
+					return;
+				}
+				if (!boot_verify_validate_keystore((unsigned char *)data, sz))
+				{
+					fastboot_fail("image is not a keystore file");
+					return;
+				}
+			}
+#endif
+			index = partition_get_index(pname);
+			ptn = partition_get_offset(index);
+			if (ptn == 0)
+			{
+				fastboot_fail("partition table doesn't exist");
+				return;
+			}
 
-#if VERIFIED_BOOT_2
-	/* Pass size of boot partition, as imgsize, to avoid
-	read fewer bytes error */
-	image_actual = partition_get_size(partition_get_index("boot"));
+			if (!strncmp(pname, "boot", strlen("boot")) || !strcmp(pname, "recovery"))
+			{
+				if (!IS_ENABLED(WITH_LK2ND_BOOT) &&
+					((sz < BOOT_MAGIC_SIZE) || memcmp((void *)data, BOOT_MAGIC, BOOT_MAGIC_SIZE)))
+				{
+					fastboot_fail("image is not a boot image");
+					return;
+				}
 
-	/* load and validate dtbo partition */
-	load_validate_dtbo_image(&dtbo_image_buf, &dtbo_image_sz);
+				/* Reset multislot_partition attributes in case of flashing boot */
+				if (partition_multislot_is_supported())
+				{
+					partition_reset_attributes(index);
+				}
+			}
 
-	/* load vbmeta partition */
-	load_vbmeta_image(&vbmeta_image_buf, &vbmeta_image_sz);
+			if (!lun_set)
+			{
+				lun = partition_get_lun(index);
+				mmc_set_lun(lun);
+			}
 
-	memset(&info, 0, sizeof(bootinfo));
+			size = partition_get_size(index);
+			if (ROUND_TO_PAGE(sz, mmc_blocksize_mask) > size)
+			{
+				fastboot_fail("size too large");
+				return;
+			}
 
-	info.images[IMG_BOOT].image_buffer = SUB_SALT_BUFF_OFFSET(data);
-	info.images[IMG_BOOT].imgsize = image_actual;
-	info.images[IMG_BOOT].name = "boot";
-	++info.num_loaded_images;
+			/*
+			 * Discard the old content first, so the card doesn't have to
+			 * preserve it while the new data is written. A single card
+			 * can't erase one range while receiving data for another, so
+			 * it is done once for the whole image instead of region by
+			 * region ahead of the writes.
+			 */
+			if (use_discard && mmc_trim_card(ptn, ROUND_TO_PAGE(sz, mmc_blocksize_mask), true))
+				dprintf(INFO, "Failed to discard %s before writing\n", pname);
 
-	/* Pass loaded dtbo image */
-	if (dtbo_image_buf != NULL)
-	{
-		info.images[IMG_DTBO].image_buffer = SUB_SALT_BUFF_OFFSET(dtbo_image_buf);
-		info.images[IMG_DTBO].imgsize = dtbo_image_sz;
-		info.images[IMG_DTBO].name = "dtbo";
-		++info.num_loaded_images;
+			if (mmc_write(ptn, sz, (unsigned int *)data))
+			{
+				fastboot_fail("flash write failure");
+				return;
+			}
+		}
 	}
+	fastboot_okay("");
+	return;
+}
 
-	/* Pass loaded vbmeta image */
-	if (vbmeta_image_buf != NULL)
+void cmd_flash_meta_img(const char *arg, void *data, unsigned sz)
+{
+#if ABOOT_STANDALONE
+	fastboot_fail("Cannot flash meta image on standalone aboot");
+#else
+	int i, images;
+	meta_header_t *meta_header;
+	img_header_entry_t *img_header_entry;
+	/*End of the image address*/
+	uintptr_t data_end;
+
+	if ((UINT_MAX - sz) > (uintptr_t)data)
+		data_end = (uintptr_t)data + sz;
+	else
 	{
-		info.images[IMG_VBMETA].image_buffer = vbmeta_image_buf;
-		info.images[IMG_VBMETA].imgsize = vbmeta_image_sz;
-		info.images[IMG_VBMETA].name = "vbmeta";
-		++info.num_loaded_images;
+		fastboot_fail("Cannot  flash: image header corrupt");
+		return;
 	}
 
-	info.multi_slot_boot = partition_multislot_is_supported();
-	if (load_image_and_auth(&info))
-		goto boot_failed;
-	vbcmdline = info.vbcmdline;
-
-	/* Free the buffer allocated to vbmeta post verification */
-	if (vbmeta_image_buf != NULL)
+	if ((UINT_MAX - sizeof(meta_header_t) < (uintptr_t)data) || (data_end < ((uintptr_t)data + sizeof(meta_header_t))))
 	{
-		free(vbmeta_image_buf);
-		--info.num_loaded_images;
+		fastboot_fail("Cannot  flash: image header corrupt");
+		return;
 	}
-#else
-	sig_size = sz - image_actual;
 
-	if (target_use_signed_kernel() && (!device.is_unlocked))
+	/* If device is locked:
+	 * Forbid to flash image to avoid the device to bypass the image
+	 * which with "any" name other than bootloader. Because it maybe
+	 * a meta package of all partitions.
+	 */
+#if VERIFIED_BOOT || VERIFIED_BOOT_2
+	if (target_build_variant_user())
 	{
-		unsigned chk;
-		/* Calculate the signature length from boot image */
-		sig_actual = read_der_message_length(
-			(unsigned char *)(data + image_actual), sig_size);
-		chk = ADD_OF(image_actual, sig_actual);
+		if (!device.is_unlocked)
+		{
+			fastboot_fail("Device is locked, meta image flashing is not allowed");
+			return;
+		}
 
-		if (chk > sz)
+		if (VB_M <= target_get_vb_version() &&
+			!device.is_unlock_critical)
 		{
-			fastboot_fail("bootimage header fields are invalid");
-			goto boot_failed;
+			fastboot_fail("Device is critical locked, Meta image flashing is not allowed");
+			return;
 		}
 	}
-
-	// Initialize boot state before trying to verify boot.img
-#if VERIFIED_BOOT
-	boot_verifier_init();
 #endif
-	/* Handle overflow if the input image size is greater than
-	 * boot image buffer can hold
-	 */
-	if ((target_get_max_flash_size() - page_size) < image_actual)
-	{
-		fastboot_fail("booimage: size is greater than boot image buffer can hold");
-		goto boot_failed;
-	}
 
-	/* Verify the boot image
-	 * device & page_size are initialized in aboot_init
-	 */
-	if (target_use_signed_kernel() && (!device.is_unlocked))
+	meta_header = (meta_header_t *)data;
+	if (((UINT_MAX - sizeof(meta_header_t) - meta_header->img_hdr_sz) < (uintptr_t)data) || data_end < ((uintptr_t)data + sizeof(meta_header_t) + meta_header->img_hdr_sz))
 	{
-		/* Pass size excluding signature size, otherwise we would try to
-		 * access signature beyond its length
-		 */
-		verify_signed_bootimg((uint32_t)data, image_actual);
+		fastboot_fail("Cannot  flash: image header corrupt");
+		return;
 	}
-#ifdef MDTP_SUPPORT
-	else
+	img_header_entry = (img_header_entry_t *)(data + sizeof(meta_header_t));
+
+	images = meta_header->img_hdr_sz / sizeof(img_header_entry_t);
+
+	for (i = 0; i < images; i++)
 	{
-		/* fastboot boot is not allowed when MDTP is activated */
-		mdtp_ext_partition_verification_t ext_partition;
 
-		if (!is_mdtp_activated)
+		if ((!img_header_entry[i].ptn_name[0]) ||
+			(img_header_entry[i].start_offset == 0) ||
+			(img_header_entry[i].size == 0))
+			break;
+		if ((UINT_MAX - img_header_entry[i].start_offset) < (uintptr_t)data)
 		{
-			ext_partition.partition = MDTP_PARTITION_NONE;
-			mdtp_fwlock_verify_lock(&ext_partition);
+			fastboot_fail("Integer overflow detected in start_offset of img");
+			break;
+		}
+		else if ((UINT_MAX - (img_header_entry[i].start_offset + (uintptr_t)data)) < img_header_entry[i].size)
+		{
+			fastboot_fail("Integer overflow detected in size of img");
+			break;
+		}
+		if (data_end < ((uintptr_t)data + img_header_entry[i].start_offset + img_header_entry[i].size))
+		{
+			fastboot_fail("Cannot  flash: image size mismatch");
+			break;
 		}
+
+		cmd_flash_mmc_img(img_header_entry[i].ptn_name,
+						  (void *)data + img_header_entry[i].start_offset,
+						  img_header_entry[i].size);
 	}
 
-	/* If mdtp state cannot be validate, block fastboot boot*/
-	if (mdtp_activated(&is_mdtp_activated))
+	if (!strncmp(arg, "bootloader", strlen("bootloader")))
 	{
-		dprintf(CRITICAL, "mdtp_activated cannot validate state.\n");
-		dprintf(CRITICAL, "Can not proceed with fastboot boot command.\n");
-		goto boot_failed;
+		strlcpy(device.bootloader_version, TARGET(BOARD), MAX_VERSION_LEN);
+		strlcat(device.bootloader_version, "-", MAX_VERSION_LEN);
+		strlcat(device.bootloader_version, meta_header->img_version, MAX_VERSION_LEN);
 	}
-	if (is_mdtp_activated)
+	else
 	{
-		dprintf(CRITICAL, "fastboot boot command is not available.\n");
-		goto boot_failed;
+		strlcpy(device.radio_version, TARGET(BOARD), MAX_VERSION_LEN);
+		strlcat(device.radio_version, "-", MAX_VERSION_LEN);
+		strlcat(device.radio_version, meta_header->img_version, MAX_VERSION_LEN);
 	}
-#endif /* MDTP_SUPPORT */
-#endif /* VERIFIED_BOOT_2 else */
 
-#if VERIFIED_BOOT
-	if (VB_M == target_get_vb_version())
-	{
-		/* set boot and system versions. */
-		set_os_version((unsigned char *)data);
-		// send root of trust
-		if (!send_rot_command((uint32_t)device.is_unlocked))
-			ASSERT(0);
-	}
+	write_device_info(&device);
+	fastboot_okay("");
+	return;
 #endif
-	/*
-	 * Check if the kernel image is a gzip package. If yes, need to decompress it.
-	 * If not, continue booting.
-	 */
-	if (is_gzip_package((unsigned char *)(data + page_size), hdr->kernel_size))
-	{
-		out_addr = (unsigned char *)target_get_scratch_address();
-		out_addr = (unsigned char *)(out_addr + image_actual + page_size);
-		out_avai_len = target_get_max_flash_size() - image_actual - page_size;
-#if VERIFIED_BOOT_2
-		if (dtbo_image_sz)
-			out_avai_len -= DTBO_IMG_BUF;
+}
+
+/* Size of the buffer used to write the FILL chunks of sparse images */
+#define SPARSE_FILL_BUF_SIZE (1024 * 1024)
+
+struct bdev;
+
+/* Write to the mmc, or to a block device opened for "oem bdev-flash" */
+static int flash_dev_write(struct bdev *bdev, uint64_t addr, uint32_t len, void *buf)
+{
+#if WITH_LK2ND_HW_BDEV
+	if (bdev)
+		return bio_write(bdev, buf, addr, len) == (ssize_t)len ? 0 : -1;
 #endif
-		dprintf(INFO, "decompressing kernel image: start\n");
-		ret = decompress((unsigned char *)(ptr + page_size),
-						 hdr->kernel_size, out_addr, out_avai_len,
-						 &dtb_offset, &out_len);
-		if (ret)
-		{
-			dprintf(CRITICAL, "decompressing image failed!!!\n");
-			ASSERT(0);
-		}
+	return mmc_write(addr, len, buf) ? -1 : 0;
+}
 
-		dprintf(INFO, "decompressing kernel image: done\n");
-		kptr = (struct kernel64_hdr *)out_addr;
-		kernel_start_addr = out_addr;
-		kernel_size = out_len;
-	}
-	else
+static int sparse_fill_write(struct bdev *bdev, uint64_t addr, uint64_t len,
+							 uint32_t *fill_buf, uint32_t buf_sz)
+{
+	uint32_t write_sz;
+
+	while (len)
 	{
-		kptr = (struct kernel64_hdr *)((char *)data + page_size);
-		kernel_start_addr = (unsigned char *)((char *)data + page_size);
-		kernel_size = hdr->kernel_size;
+		write_sz = (uint32_t)MIN(len, (uint64_t)buf_sz);
+		if (flash_dev_write(bdev, addr, write_sz, fill_buf))
+			return -1;
+
+		addr += write_sz;
+		len -= write_sz;
 	}
 
-	if (kptr->text_offset > 2 * 1024 * 1024)
-		kptr->text_offset = 0; // HACK
+	return 0;
+}
 
-	/*
-	 * Update the kernel/ramdisk/tags address if the boot image header
-	 * has default values, these default values come from mkbootimg when
-	 * the boot image is flashed using fastboot flash:raw
-	 */
-	update_ker_tags_rdisk_addr(hdr, kptr);
+/*
+ * Flash a FILL chunk of a sparse image. The fill value is repeated in a
+ * large buffer so that whole spans of it are written at once. Zero fills
+ * erase the aligned erase units instead if the card reads them back as
+ * zeros, only the unaligned head & tail are written. Block devices (@bdev)
+ * are always written.
+ */
+static int sparse_fill_chunk(struct bdev *bdev, uint64_t addr, uint64_t len,
+							 uint32_t fill_val, uint32_t blk_sz)
+{
+	uint64_t erase_start = addr;
+	uint64_t erase_end = addr;
+	uint64_t write_len = len;
+	uint32_t *fill_buf = NULL;
+	uint32_t erase_unit = 0;
+	uint32_t buf_sz;
+	uint32_t i;
+	int ret = 0;
 
-	/* Get virtual addresses since the hdr saves physical addresses. */
-	hdr->kernel_addr = VA(hdr->kernel_addr);
-	hdr->ramdisk_addr = VA(hdr->ramdisk_addr);
-	hdr->tags_addr = VA(hdr->tags_addr);
+	if (!fill_val && !bdev)
+		erase_unit = mmc_get_zero_erase_unit();
 
-	kernel_size = ROUND_TO_PAGE(kernel_size, page_mask);
-	/* Check if the addresses in the header are valid. */
-	if (check_aboot_addr_range_overlap(hdr->kernel_addr, kernel_size) ||
-		check_ddr_addr_range_bound(hdr->kernel_addr, kernel_size) ||
-		check_aboot_addr_range_overlap(hdr->ramdisk_addr, ramdisk_actual) ||
-		check_ddr_addr_range_bound(hdr->ramdisk_addr, ramdisk_actual))
+	if (erase_unit)
 	{
-		dprintf(CRITICAL, "kernel/ramdisk addresses are not valid.\n");
-		goto boot_failed;
+		erase_start = (addr + erase_unit - 1) / erase_unit * erase_unit;
+		erase_end = (addr + len) / erase_unit * erase_unit;
+		if (erase_end > erase_start)
+			write_len = MAX(erase_start - addr, addr + len - erase_end);
+		else
+			erase_start = erase_end = addr;
 	}
 
-#if DEVICE_TREE
-	scratch_offset = image_actual + page_size + out_len;
-	/* find correct dtb and copy it to right location */
-	ret = copy_dtb(data, scratch_offset);
+	/* Use a smaller buffer if the heap is too small */
+	buf_sz = (uint32_t)MIN((uint64_t)MAX(SPARSE_FILL_BUF_SIZE / blk_sz, 1U), write_len / blk_sz) * blk_sz;
+	buf_sz = MAX(buf_sz, blk_sz);
 
-	dtb_copied = !ret ? 1 : 0;
-#else
-	if (check_aboot_addr_range_overlap(hdr->tags_addr, MAX_TAGS_SIZE) ||
-		check_ddr_addr_range_bound(hdr->tags_addr, MAX_TAGS_SIZE))
+	/* Integer overflow detected */
+	if (ROUNDUP(buf_sz, CACHE_LINE) < buf_sz)
 	{
-		dprintf(CRITICAL, "Tags addresses are not valid.\n");
-		goto boot_failed;
+		fastboot_fail("Invalid block size");
+		return -1;
 	}
-#endif
 
-#if DEVICE_TREE
-	if (check_aboot_addr_range_overlap(hdr->tags_addr, kernel_actual) ||
-		check_ddr_addr_range_bound(hdr->tags_addr, kernel_actual))
+	for (;;)
 	{
-		dprintf(CRITICAL, "Tags addresses are not valid.\n");
-		goto boot_failed;
+		fill_buf = (uint32_t *)memalign(CACHE_LINE, ROUNDUP(buf_sz, CACHE_LINE));
+		if (fill_buf || buf_sz == blk_sz)
+			break;
+		buf_sz = MAX(buf_sz / blk_sz / 2, 1U) * blk_sz;
 	}
 
-	/*
-	 * If dtb is not found look for appended DTB in the kernel.
-	 * If appended dev tree is found, update the atags with
-	 * memory address to the DTB appended location on RAM.
-	 * Else update with the atags address in the kernel header
-	 */
-	if (!dtb_copied)
+	if (!fill_buf)
 	{
-		void *dtb;
-		dtb = dev_tree_appended((void *)(ptr + page_size),
-								hdr->kernel_size, dtb_offset,
-								(void *)hdr->tags_addr);
-#if WITH_LK2ND_DEVICE_2ND
-		if (!dtb && lk2nd_device2nd_have_atags())
-			boot_type |= BOOT_ATAGS_COPY;
-		else
-#endif
-			if (!dtb)
-		{
-			fastboot_fail("dtb not found");
-			goto boot_failed;
-		}
+		fastboot_fail("Malloc failed for: CHUNK_TYPE_FILL");
+		return -1;
 	}
-#endif
 
-	/* Load ramdisk & kernel */
-	memmove((void *)hdr->ramdisk_addr, ptr + page_size + kernel_actual, hdr->ramdisk_size);
-	memmove((void *)hdr->kernel_addr, (char *)(kernel_start_addr), kernel_size);
+	for (i = 0; i < buf_sz / sizeof(fill_val); i++)
+		fill_buf[i] = fill_val;
 
-	fastboot_okay("");
-	fastboot_stop();
+	if (erase_end > erase_start)
+	{
+		dprintf(SPEW, "Erasing zero fill 0x%llx:0x%llx\n", erase_start, erase_end - erase_start);
+		if (mmc_erase_units(erase_start, erase_end - erase_start))
+			ret = -1;
+	}
 
-#ifdef LK2ND_FASTBOOT_DELAY
-	/* This can help with debugging on devices with carkit uart. You need to switch the cable before starting linux to see all the logs */
-	dprintf(INFO, "Waiting %ums before boot\n", LK2ND_FASTBOOT_DELAY);
-	thread_sleep(LK2ND_FASTBOOT_DELAY);
-#endif
+	if (!ret)
+		ret = sparse_fill_write(bdev, addr, erase_start - addr, fill_buf, buf_sz);
+	if (!ret)
+		ret = sparse_fill_write(bdev, erase_end, addr + len - erase_end, fill_buf, buf_sz);
 
-	boot_linux((void *)hdr->kernel_addr, (void *)hdr->tags_addr,
-			   (const char *)hdr->cmdline, board_machtype(),
-			   (void *)hdr->ramdisk_addr, hdr->ramdisk_size,
-			   boot_type);
+	if (ret)
+		fastboot_fail("flash write failure");
 
-	/* fastboot already stop, it's no need to show fastboot menu */
-	return;
-boot_failed:
-#if FBCON_DISPLAY_MSG
-	/* revert to fastboot menu if boot failed */
-	display_fastboot_menu();
-#endif
-	return;
+	free(fill_buf);
+	return ret;
 }
 
-void cmd_erase_nand(const char *arg, void *data, unsigned sz)
+/*
+ * CRC32 chunks are rare, so the CRC of the image is only calculated if there
+ * is one. Walks the chunk headers, they are checked again while flashing.
+ */
+static bool sparse_has_crc_chunk(const sparse_header_t *sparse_header, uintptr_t data,
+								 uintptr_t data_end)
 {
-	struct ptentry *ptn;
-	struct ptable *ptable;
-
-	ptable = flash_get_ptable();
-	if (ptable == NULL)
-	{
-		fastboot_fail("partition table doesn't exist");
-		return;
-	}
+	const chunk_header_t *chunk_header;
+	unsigned int chunk;
 
-	ptn = ptable_find(ptable, arg);
-	if (ptn == NULL)
+	for (chunk = 0; chunk < sparse_header->total_chunks; chunk++)
 	{
-		fastboot_fail("unknown partition name");
-		return;
-	}
+		if (data_end - data < sizeof(chunk_header_t))
+			return false;
 
-#if VERIFIED_BOOT_2
-	if (!strncmp(arg, "avb_custom_key", strlen("avb_custom_key")))
-	{
-		dprintf(INFO, "erasing avb_custom_key\n");
-		if (erase_userkey())
-		{
-			fastboot_fail("Erasing avb_custom_key failed");
-		}
-		else
-		{
-			fastboot_okay("");
-		}
-		return;
+		chunk_header = (const chunk_header_t *)data;
+		if (chunk_header->chunk_type == CHUNK_TYPE_CRC32)
+			return true;
+		if (chunk_header->total_sz < sizeof(chunk_header_t) ||
+			data_end - data < chunk_header->total_sz)
+			return false;
+		data += chunk_header->total_sz;
 	}
-#endif
 
-	if (flash_erase(ptn))
-	{
-		fastboot_fail("failed to erase partition");
-		return;
-	}
-	fastboot_okay("");
+	return false;
 }
 
-void cmd_erase_mmc(const char *arg, void *data, unsigned sz)
+void cmd_flash_mmc_sparse_img(const char *arg, void *data, unsigned sz)
 {
+	unsigned int chunk;
+	uint64_t chunk_data_sz;
+	uint32_t fill_val;
+	sparse_header_t *sparse_header;
+	chunk_header_t *chunk_header;
+	uint32_t total_blocks = 0;
 	unsigned long long ptn = 0;
 	unsigned long long size = 0;
 	int index = INVALID_PTN;
 	uint8_t lun = 0;
-	char *footer = NULL;
-	char EraseResultStr[MAX_RSP_SIZE] = "";
-	VirtualAbMergeStatus SnapshotMergeStatus;
+	/* CRC32 of the data in the image, like libsparse calculates it */
+	uint32_t crc = ~0U;
+	const uint32_t zero = 0;
+	bool check_crc;
+	/*End of the sparse image address*/
+	uintptr_t data_end = (uintptr_t)data + sz;
 
-#if VERIFIED_BOOT
-	if (!strcmp(arg, KEYSTORE_PTN_NAME))
+	index = partition_get_index(arg);
+	ptn = partition_get_offset(index);
+	if (ptn == 0)
 	{
-		if (!device.is_unlocked)
-		{
-			fastboot_fail("unlock device to erase keystore");
-			return;
-		}
+		fastboot_fail("partition table doesn't exist");
+		return;
 	}
-#endif
 
-	index = partition_get_index(arg);
-	ptn = partition_get_offset(index);
 	size = partition_get_size(index);
 
-	if (target_virtual_ab_supported())
+	lun = partition_get_lun(index);
+	mmc_set_lun(lun);
+
+	if (sz < sizeof(sparse_header_t))
 	{
-		if (CheckVirtualAbCriticalPartition(arg))
-		{
-			snprintf(EraseResultStr, MAX_RSP_SIZE, "Erase of %s is not allowed in %s state",
-					 arg, SnapshotMergeState);
-			fastboot_fail(EraseResultStr);
-			return;
-		}
-		SnapshotMergeStatus = GetSnapshotMergeStatus();
-		if (((SnapshotMergeStatus == MERGING) || (SnapshotMergeStatus == SNAPSHOTTED)) &&
-			!strncmp(arg, "super", strlen("super")))
-		{
+		fastboot_fail("size too low");
+		return;
+	}
 
-			if (SetSnapshotMergeStatus(CANCELLED))
-			{
-				fastboot_fail("Failed to update snapshot state to cancel");
-				return;
-			}
+	/* Read and skip over sparse image header */
+	sparse_header = (sparse_header_t *)data;
+
+	if (!sparse_header->blk_sz || (sparse_header->blk_sz % 4))
+	{
+		fastboot_fail("Invalid block size\n");
+		return;
+	}
 
-			// updating fbvar snapshot-merge-state
-			snprintf(SnapshotMergeState, strlen(VabSnapshotMergeStatus[NONE_MERGE_STATUS]) + 1,
-					 "%s", VabSnapshotMergeStatus[NONE_MERGE_STATUS]);
-		}
+	if (((uint64_t)sparse_header->total_blks * (uint64_t)sparse_header->blk_sz) > size)
+	{
+		fastboot_fail("size too large");
+		return;
 	}
 
-#if VERIFIED_BOOT_2
-	if (!strncmp(arg, "avb_custom_key", strlen("avb_custom_key")))
+	data += sizeof(sparse_header_t);
+
+	if (data_end < (uintptr_t)data)
 	{
-		dprintf(INFO, "erasing avb_custom_key\n");
-		if (erase_userkey())
-		{
-			fastboot_fail("Erasing avb_custom_key failed");
-		}
-		else
-		{
-			fastboot_okay("");
-		}
+		fastboot_fail("buffer overreads occured due to invalid sparse header");
 		return;
 	}
-#endif
 
-	if (ptn == 0)
+	if (sparse_header->file_hdr_sz != sizeof(sparse_header_t))
 	{
-		fastboot_fail("Partition table doesn't exist\n");
+		fastboot_fail("sparse header size mismatch");
 		return;
 	}
 
-	lun = partition_get_lun(index);
-	mmc_set_lun(lun);
+	dprintf(SPEW, "=== Sparse Image Header ===\n");
+	dprintf(SPEW, "magic: 0x%x\n", sparse_header->magic);
+	dprintf(SPEW, "major_version: 0x%x\n", sparse_header->major_version);
+	dprintf(SPEW, "minor_version: 0x%x\n", sparse_header->minor_version);
+	dprintf(SPEW, "file_hdr_sz: %d\n", sparse_header->file_hdr_sz);
+	dprintf(SPEW, "chunk_hdr_sz: %d\n", sparse_header->chunk_hdr_sz);
+	dprintf(SPEW, "blk_sz: %d\n", sparse_header->blk_sz);
+	dprintf(SPEW, "total_blks: %d\n", sparse_header->total_blks);
+	dprintf(SPEW, "total_chunks: %d\n", sparse_header->total_chunks);
 
-	if (platform_boot_dev_isemmc())
+	check_crc = sparse_has_crc_chunk(sparse_header, (uintptr_t)data, data_end);
+
+	/* Start processing chunks */
+	for (chunk = 0; chunk < sparse_header->total_chunks; chunk++)
 	{
-		if (mmc_erase_card(ptn, size))
+		/* Make sure the total image size does not exceed the partition size */
+		if (((uint64_t)total_blocks * (uint64_t)sparse_header->blk_sz) >= size)
 		{
-			fastboot_fail("failed to erase partition\n");
+			fastboot_fail("size too large");
 			return;
 		}
-	}
-	else
-	{
-		BUF_DMA_ALIGN(out, DEFAULT_ERASE_SIZE);
-		size = partition_get_size(index);
-		if (size > DEFAULT_ERASE_SIZE)
-			size = DEFAULT_ERASE_SIZE;
+		/* Read and skip over chunk header */
+		chunk_header = (chunk_header_t *)data;
+		data += sizeof(chunk_header_t);
 
-		/* Simple inefficient version of erase. Just writing
-		   0 in first several blocks */
-		if (mmc_write(ptn, size, (unsigned int *)out))
+		if (data_end < (uintptr_t)data)
 		{
-			fastboot_fail("failed to erase partition");
+			fastboot_fail("buffer overreads occured due to invalid sparse header");
 			return;
 		}
-		/*Erase FDE metadata at the userdata footer*/
-		if (!(strncmp(arg, "userdata", 8)))
-		{
-			footer = memalign(CACHE_LINE, FOOTER_SIZE);
-			memset((void *)footer, 0, FOOTER_SIZE);
 
-			size = partition_get_size(index);
+		dprintf(SPEW, "=== Chunk Header ===\n");
+		dprintf(SPEW, "chunk_type: 0x%x\n", chunk_header->chunk_type);
+		dprintf(SPEW, "chunk_data_sz: 0x%x\n", chunk_header->chunk_sz);
+		dprintf(SPEW, "total_size: 0x%x\n", chunk_header->total_sz);
 
-			if (mmc_write((ptn + size) - FOOTER_SIZE, FOOTER_SIZE, (unsigned int *)footer))
-			{
-				fastboot_fail("failed to erase userdata footer");
-				free(footer);
-				return;
-			}
-			free(footer);
+		if (sparse_header->chunk_hdr_sz != sizeof(chunk_header_t))
+		{
+			fastboot_fail("chunk header size mismatch");
+			return;
 		}
-	}
-#if VERIFIED_BOOT || VERIFIED_BOOT_2
-	if (VB_M <= target_get_vb_version() &&
-		!(strncmp(arg, "userdata", 8)) &&
-		send_delete_keys_to_tz())
-		ASSERT(0);
-#endif
-	fastboot_okay("");
-}
 
-void cmd_erase(const char *arg, void *data, unsigned sz)
-{
-#if VERIFIED_BOOT || VERIFIED_BOOT_2
-	if (target_build_variant_user())
-	{
-		if (!device.is_unlocked)
+		chunk_data_sz = (uint64_t)sparse_header->blk_sz * chunk_header->chunk_sz;
+
+		/* Make sure that the chunk size calculated from sparse image does not
+		 * exceed partition size
+		 */
+		if ((uint64_t)total_blocks * (uint64_t)sparse_header->blk_sz + chunk_data_sz > size)
 		{
-			fastboot_fail("device is locked. Cannot erase");
+			fastboot_fail("Chunk data size exceeds partition size");
 			return;
 		}
-	}
-#endif
 
-	if (target_is_emmc_boot())
-		cmd_erase_mmc(arg, data, sz);
-	else
-		cmd_erase_nand(arg, data, sz);
-}
+		switch (chunk_header->chunk_type)
+		{
+		case CHUNK_TYPE_RAW:
+			if ((uint64_t)chunk_header->total_sz != ((uint64_t)sparse_header->chunk_hdr_sz +
+													 chunk_data_sz))
+			{
+				fastboot_fail("Bogus chunk size for chunk type Raw");
+				return;
+			}
 
-/* Get the size from partiton name */
-static void get_partition_size(const char *arg, char *response)
-{
-	uint64_t ptn = 0;
-	uint64_t size;
-	int index = INVALID_PTN;
+			if (data_end < (uintptr_t)data + chunk_data_sz)
+			{
+				fastboot_fail("buffer overreads occured due to invalid sparse header");
+				return;
+			}
 
-	index = partition_get_index(arg);
+			/* The data is still in the cache when it is written right after */
+			if (check_crc)
+				crc = crc32(crc, data, (uint32_t)chunk_data_sz);
 
-	if (index == INVALID_PTN)
-	{
-		dprintf(CRITICAL, "Invalid partition index\n");
-		return;
-	}
+			/* chunk_header->total_sz is uint32,So chunk_data_sz is now less than 2^32
+			   otherwise it will return in the line above
+			 */
+			if (mmc_write(ptn + ((uint64_t)total_blocks * sparse_header->blk_sz),
+						  (uint32_t)chunk_data_sz,
+						  (unsigned int *)data))
+			{
+				fastboot_fail("flash write failure");
+				return;
+			}
+			if (total_blocks > (UINT_MAX - chunk_header->chunk_sz))
+			{
+				fastboot_fail("Bogus size for RAW chunk type");
+				return;
+			}
+			total_blocks += chunk_header->chunk_sz;
+			data += (uint32_t)chunk_data_sz;
+			break;
 
-	ptn = partition_get_offset(index);
+		case CHUNK_TYPE_FILL:
+			if (chunk_header->total_sz != (sparse_header->chunk_hdr_sz +
+										   sizeof(uint32_t)))
+			{
+				fastboot_fail("Bogus chunk size for chunk type FILL");
+				return;
+			}
 
-	if (!ptn)
-	{
-		dprintf(CRITICAL, "Invalid partition name %s\n", arg);
-		return;
-	}
+			if (data_end < (uintptr_t)data + sizeof(uint32_t))
+			{
+				fastboot_fail("buffer overreads occured due to invalid sparse header");
+				return;
+			}
+			fill_val = *(uint32_t *)data;
+			data = (char *)data + sizeof(uint32_t);
 
-	size = partition_get_size(index);
+			if (total_blocks > (UINT_MAX - chunk_header->chunk_sz))
+			{
+				fastboot_fail("bogus size for chunk FILL type");
+				return;
+			}
 
-	snprintf(response, MAX_RSP_SIZE, "\t 0x%llx", size);
-	return;
-}
+			/* The chunk was checked against the partition size above */
+			if (sparse_fill_chunk(NULL, ptn + ((uint64_t)total_blocks * sparse_header->blk_sz),
+								  chunk_data_sz, fill_val, sparse_header->blk_sz))
+				return;
 
-/* Function to check partition type of a partition*/
-static fs_signature_type
-check_partition_fs_signature(const char *arg)
-{
-	fs_signature_type ret = NO_FS;
-	int index;
-	unsigned long long ptn;
-	char *buffer = memalign(CACHE_LINE, mmc_blocksize);
-	uint32_t sb_blk_offset = 0;
-	char *sb_buffer = buffer;
+			if (check_crc)
+				crc = crc32_repeat(crc, &fill_val, sizeof(fill_val),
+								   chunk_data_sz / sizeof(fill_val));
 
-	if (!sb_buffer)
-	{
-		dprintf(CRITICAL, "ERROR: Failed to allocate buffer for superblock\n");
-		goto out;
-	}
+			total_blocks += chunk_header->chunk_sz;
+			break;
 
-	/* Read super block */
-	if ((index = partition_get_index(arg)) < 0)
-	{
-		dprintf(CRITICAL, "ERROR: %s() doesn't exsit\n", arg);
-		goto out;
-	}
-	ptn = partition_get_offset(index);
-	mmc_set_lun(partition_get_lun(index));
-	sb_blk_offset = (FS_SUPERBLOCK_OFFSET / mmc_blocksize);
+		case CHUNK_TYPE_DONT_CARE:
+			if (total_blocks > (UINT_MAX - chunk_header->chunk_sz))
+			{
+				fastboot_fail("bogus size for chunk DONT CARE type");
+				return;
+			}
+
+			/* Let the card reuse the blocks, their content does not matter */
+			if (use_discard && chunk_data_sz &&
+				!(sparse_header->blk_sz % mmc_get_device_blocksize()) &&
+				mmc_trim_card(ptn + ((uint64_t)total_blocks * sparse_header->blk_sz),
+							  chunk_data_sz, true))
+				dprintf(CRITICAL, "Failed to discard chunk %u, ignoring\n", chunk);
+
+			/* libsparse counts skipped blocks as zeros */
+			if (check_crc)
+				crc = crc32_repeat(crc, &zero, sizeof(zero), chunk_data_sz / sizeof(zero));
+
+			total_blocks += chunk_header->chunk_sz;
+			break;
+
+		case CHUNK_TYPE_CRC32:
+			/* libsparse stores the CRC32 of everything before the chunk */
+			if (chunk_header->total_sz == sparse_header->chunk_hdr_sz + sizeof(uint32_t))
+			{
+				if (data_end - (uintptr_t)data < sizeof(uint32_t))
+				{
+					fastboot_fail("buffer overreads occured due to invalid sparse header");
+					return;
+				}
+				if (*(uint32_t *)data != (crc ^ ~0U))
+				{
+					dprintf(CRITICAL, "Sparse CRC32 mismatch: expected 0x%08x, got 0x%08x\n",
+							*(uint32_t *)data, crc ^ ~0U);
+					fastboot_fail("sparse image CRC32 mismatch");
+					return;
+				}
+				data = (char *)data + sizeof(uint32_t);
+			}
+			else if (chunk_header->total_sz != sparse_header->chunk_hdr_sz)
+			{
+				fastboot_fail("Bogus chunk size for chunk type CRC");
+				return;
+			}
+			if (total_blocks > (UINT_MAX - chunk_header->chunk_sz))
+			{
+				fastboot_fail("bogus size for chunk CRC type");
+				return;
+			}
+			total_blocks += chunk_header->chunk_sz;
+			if ((uintptr_t)data > UINT_MAX - chunk_data_sz)
+			{
+				fastboot_fail("integer overflow occured");
+				return;
+			}
+			data += (uint32_t)chunk_data_sz;
+			if (data_end < (uintptr_t)data)
+			{
+				fastboot_fail("buffer overreads occured due to invalid sparse header");
+				return;
+			}
+			break;
 
-	if (mmc_read(ptn + (sb_blk_offset * mmc_blocksize),
-				 (void *)sb_buffer, mmc_blocksize))
-	{
-		dprintf(CRITICAL, "ERROR: Failed to read Superblock\n");
-		goto out;
+		default:
+			dprintf(CRITICAL, "Unkown chunk type: %x\n", chunk_header->chunk_type);
+			fastboot_fail("Unknown chunk type");
+			return;
+		}
 	}
 
-	if (sb_blk_offset == 0)
-		sb_buffer += FS_SUPERBLOCK_OFFSET;
+	dprintf(INFO, "Wrote %d blocks, expected to write %d blocks\n",
+			total_blocks, sparse_header->total_blks);
 
-	if (*((uint16 *)(&sb_buffer[EXT_MAGIC_OFFSET_SB])) == (uint16)EXT_MAGIC)
-	{
-		dprintf(SPEW, "%s() Found EXT FS\n", arg);
-		ret = EXT_FS_SIGNATURE;
-	}
-	else if (*((uint32 *)(&sb_buffer[F2FS_MAGIC_OFFSET_SB])) == F2FS_MAGIC)
-	{
-		dprintf(SPEW, "%s() Found F2FS FS\n", arg);
-		ret = EXT_F2FS_SIGNATURE;
-	}
-	else
+	if (total_blocks != sparse_header->total_blks)
 	{
-		dprintf(SPEW, "%s() Reverting to default 0x%x\n",
-				arg, *((uint16 *)(&sb_buffer[EXT_MAGIC_OFFSET_SB])));
-		ret = NO_FS;
+		fastboot_fail("sparse image write failure");
 	}
 
-out:
-	if (buffer)
-		free(buffer);
-	return ret;
+	fastboot_okay("");
+	return;
 }
 
-/* Function to get partition type */
-static void get_partition_type(const char *arg, char *response)
+static bool CheckVirtualAbCriticalPartition(const char *PartitionName)
 {
-	uint n = 0;
-	fs_signature_type fs_signature;
-
-	if (arg == NULL ||
-		response == NULL)
-	{
-		dprintf(CRITICAL, "Invalid input parameter\n");
-		return;
-	}
-
-	/* By default copy raw to response */
-	strlcpy(response, RAW_STR, MAX_RSP_SIZE);
+	VirtualAbMergeStatus SnapshotMergeStatus;
+	uint32 Iter = 0;
 
-	/* Mark partiton type for known paritions only */
-	for (n = 0; n < ARRAY_SIZE(part_type_known); n++)
+	SnapshotMergeStatus = GetSnapshotMergeStatus();
+	if ((SnapshotMergeStatus == MERGING || SnapshotMergeStatus == SNAPSHOTTED))
 	{
-		if (!strncmp(part_type_known[n].part_name, arg, strlen(arg)))
+		for (Iter = 0; Iter < ARRAY_SIZE(VirtualAbCriticalPartitions); Iter++)
 		{
-			/* Check partition for FS signature */
-			fs_signature = check_partition_fs_signature(arg);
-			switch (fs_signature)
-			{
-			case EXT_FS_SIGNATURE:
-				strlcpy(response, EXT_STR, MAX_RSP_SIZE);
-				break;
-			case EXT_F2FS_SIGNATURE:
-				strlcpy(response, F2FS_STR, MAX_RSP_SIZE);
-				break;
-			case NO_FS:
-				strlcpy(response, part_type_known[n].type_response, MAX_RSP_SIZE);
-			}
+			if (!strncmp(PartitionName, VirtualAbCriticalPartitions[Iter],
+						 strlen(VirtualAbCriticalPartitions[Iter])))
+				return true;
 		}
 	}
-	return;
+	return false;
 }
 
-/*
- * Publish the partition type & size info
- * fastboot getvar will publish the required information.
- * fastboot getvar partition_size:<partition_name>: partition size in hex
- * fastboot getvar partition_type:<partition_name>: partition type (ext/fat)
- */
-static void publish_getvar_partition_info(struct getvar_partition_info *info, uint8_t num_parts)
+/* Check the lock state & the Virtual A/B state before flashing a partition */
+static int flash_mmc_check_allowed(const char *arg)
 {
-	uint8_t i;
-	static bool published = false;
-	struct partition_entry *ptn_entry =
-		partition_get_partition_entries();
-	memset(info, 0, sizeof(struct getvar_partition_info) * num_parts);
+	VirtualAbMergeStatus SnapshotMergeStatus;
+	char FlashResultStr[MAX_RSP_SIZE] = "";
 
-	for (i = 0; i < num_parts; i++)
+#if VERIFIED_BOOT || VERIFIED_BOOT_2
+	if (target_build_variant_user())
 	{
-		strlcat(info[i].part_name, (const char *)ptn_entry[i].name, MAX_RSP_SIZE);
-		strlcat(info[i].getvar_size, "partition-size:", MAX_GET_VAR_NAME_SIZE);
-		strlcat(info[i].getvar_type, "partition-type:", MAX_GET_VAR_NAME_SIZE);
-
-		get_partition_type(info[i].part_name, info[i].type_response);
-		get_partition_size(info[i].part_name, info[i].size_response);
-		if (strlcat(info[i].getvar_size, info[i].part_name, MAX_GET_VAR_NAME_SIZE) >= MAX_GET_VAR_NAME_SIZE)
-		{
-			dprintf(CRITICAL, "partition size name truncated\n");
-			return;
-		}
-		if (strlcat(info[i].getvar_type, info[i].part_name, MAX_GET_VAR_NAME_SIZE) >= MAX_GET_VAR_NAME_SIZE)
+		/* if device is locked:
+		 * common partition will not allow to be flashed
+		 * critical partition will allow to flash image.
+		 */
+		if (!device.is_unlocked && !critical_flash_allowed(arg))
 		{
-			dprintf(CRITICAL, "partition type name truncated\n");
-			return;
+			fastboot_fail("Partition flashing is not allowed");
+			return -1;
 		}
 
-		if (!published)
+		/* if device critical is locked:
+		 * common partition will allow to be flashed
+		 * critical partition will not allow to flash image.
+		 */
+		if (VB_M <= target_get_vb_version() &&
+			!device.is_unlock_critical &&
+			critical_flash_allowed(arg))
 		{
-			/* publish partition size & type info */
-			fastboot_publish((const char *)info[i].getvar_size, (const char *)info[i].size_response);
-			fastboot_publish((const char *)info[i].getvar_type, (const char *)info[i].type_response);
+			fastboot_fail("Critical partition flashing is not allowed");
+			return -1;
 		}
 	}
-	if (!published)
-		published = true;
-}
-
-static void flash_publish_getvar_partition_info(struct getvar_partition_info *info)
-{
-	struct ptable *ptable;
-	unsigned num_parts, i;
-
-	ptable = flash_get_ptable();
-	if (!ptable)
-		return;
-
-	num_parts = ptable_size(ptable);
-	memset(info, 0, sizeof(struct getvar_partition_info) * num_parts);
+#endif
 
-	for (i = 0; i < num_parts; i++)
+	if (target_virtual_ab_supported())
 	{
-		struct ptentry *ptn = ptable_get(ptable, i);
-
-		strlcpy(info[i].part_name, ptn->name, MAX_RSP_SIZE);
-		strlcpy(info[i].getvar_size, "partition-size:", MAX_GET_VAR_NAME_SIZE);
-		strlcpy(info[i].getvar_type, "partition-type:", MAX_GET_VAR_NAME_SIZE);
-
-		strlcpy(info[i].type_response, RAW_STR, MAX_RSP_SIZE);
-		snprintf(info[i].size_response, MAX_RSP_SIZE, "0x%llx", validate_partition_size(ptn));
-
-		if (strlcat(info[i].getvar_size, info[i].part_name, MAX_GET_VAR_NAME_SIZE) >= MAX_GET_VAR_NAME_SIZE)
+		if (CheckVirtualAbCriticalPartition(arg))
 		{
-			dprintf(CRITICAL, "partition size name truncated\n");
-			continue;
+			snprintf(FlashResultStr, MAX_RSP_SIZE, "Flashing of %s is not allowed in %s state",
+					 arg, SnapshotMergeState);
+			fastboot_fail(FlashResultStr);
+			return -1;
 		}
-		if (strlcat(info[i].getvar_type, info[i].part_name, MAX_GET_VAR_NAME_SIZE) >= MAX_GET_VAR_NAME_SIZE)
+
+		SnapshotMergeStatus = GetSnapshotMergeStatus();
+		if (((SnapshotMergeStatus == MERGING) || (SnapshotMergeStatus == SNAPSHOTTED)) &&
+			!strncmp(arg, "super", strlen("super")))
 		{
-			dprintf(CRITICAL, "partition type name truncated\n");
-			continue;
-		}
+			if (SetSnapshotMergeStatus(CANCELLED))
+			{
+				fastboot_fail("Failed to update snapshot state to cancel");
+				return -1;
+			}
 
-		/* publish partition size & type info */
-		fastboot_publish(info[i].getvar_size, info[i].size_response);
-		fastboot_publish(info[i].getvar_type, info[i].type_response);
+			// updating fbvar snapshot-merge-state
+			snprintf(SnapshotMergeState, strlen(VabSnapshotMergeStatus[NONE_MERGE_STATUS]) + 1,
+					 "%s", VabSnapshotMergeStatus[NONE_MERGE_STATUS]);
+		}
 	}
+
+	return 0;
 }
 
-void cmd_flash_mmc_img(const char *arg, void *data, unsigned sz)
+void cmd_flash_mmc(const char *arg, void *data, unsigned sz)
 {
-	unsigned long long ptn = 0;
-	unsigned long long size = 0;
-	int index = INVALID_PTN;
-	char *token = NULL;
-	char *pname = NULL;
-	char *sp;
-	uint8_t lun = 0;
-	bool lun_set = false;
-	int current_active_slot = INVALID;
+	sparse_header_t *sparse_header;
+	meta_header_t *meta_header;
 
-	token = strtok_r((char *)arg, ":", &sp);
-	pname = token;
-	token = strtok_r(NULL, ":", &sp);
-	if (token)
-	{
-		lun = atoi(token);
-		mmc_set_lun(lun);
-		lun_set = true;
-	}
+#ifdef SSD_ENABLE
+	/* 8 Byte Magic + 2048 Byte xml + Encrypted Data */
+	unsigned int *magic_number = (unsigned int *)data;
+	int ret = 0;
+	uint32 major_version = 0;
+	uint32 minor_version = 0;
 
-	if (pname)
+	ret = scm_svc_version(&major_version, &minor_version);
+	if (!ret)
 	{
-#if !ABOOT_STANDALONE
-		if (!strncmp(pname, "frp-unlock", strlen("frp-unlock")))
-		{
-			if (!aboot_frp_unlock(pname, data, sz))
-			{
-				fastboot_info("FRP unlock successful");
-				fastboot_okay("");
-			}
-			else
-				fastboot_fail("Secret key is invalid, please update the bootloader with secret key");
-
-			return;
-		}
-#endif
-
-		if (!strcmp(pname, "partition"))
-		{
-			dprintf(INFO, "Attempt to write partition image.\n");
-			if (write_partition(sz, (unsigned char *)data))
-			{
-				fastboot_fail("failed to write partition");
-				return;
-			}
-			/* Re-publish partition table */
-			publish_getvar_partition_info(part_info, partition_get_partition_count());
-
-			/* Rescan partition table to ensure we have multislot support*/
-			if (partition_scan_for_multislot())
-			{
-				current_active_slot = partition_find_active_slot();
-				dprintf(INFO, "Multislot supported: Slot %s active",
-						(SUFFIX_SLOT(current_active_slot)));
-			}
-			partition_mark_active_slot(current_active_slot);
-		}
-		else
+		if (major_version >= 2)
 		{
-#if VERIFIED_BOOT
-			if (!strcmp(pname, KEYSTORE_PTN_NAME))
+			if (!strcmp(arg, "ssd") || !strcmp(arg, "tqs"))
 			{
-				if (!device.is_unlocked)
+				ret = encrypt_scm((uint32 **)&data, &sz);
+				if (ret != 0)
 				{
-					fastboot_fail("unlock device to flash keystore");
+					dprintf(CRITICAL, "ERROR: Encryption Failure\n");
 					return;
 				}
-				if (!boot_verify_validate_keystore((unsigned char *)data, sz))
+
+				/* Protect only for SSD */
+				if (!strcmp(arg, "ssd"))
 				{
-					fastboot_fail("image is not a keystore file");
-					return;
+					ret = scm_protect_keystore((uint32 *)data, sz);
+					if (ret != 0)
+					{
+						dprintf(CRITICAL, "ERROR: scm_protect_keystore Failed\n");
+						return;
+					}
 				}
 			}
-#endif
-			index = partition_get_index(pname);
-			ptn = partition_get_offset(index);
-			if (ptn == 0)
-			{
-				fastboot_fail("partition table doesn't exist");
-				return;
-			}
-
-			if (!strncmp(pname, "boot", strlen("boot")) || !strcmp(pname, "recovery"))
+			else
 			{
-				if (!IS_ENABLED(WITH_LK2ND_BOOT) &&
-					((sz < BOOT_MAGIC_SIZE) || memcmp((void *)data, BOOT_MAGIC, BOOT_MAGIC_SIZE)))
+				ret = decrypt_scm_v2((uint32 **)&data, &sz);
+				if (ret != 0)
 				{
-					fastboot_fail("image is not a boot image");
+					dprintf(CRITICAL, "ERROR: Decryption Failure\n");
 					return;
 				}
-
-				/* Reset multislot_partition attributes in case of flashing boot */
-				if (partition_multislot_is_supported())
-				{
-					partition_reset_attributes(index);
-				}
-			}
-
-			if (!lun_set)
-			{
-				lun = partition_get_lun(index);
-				mmc_set_lun(lun);
 			}
-
-			size = partition_get_size(index);
-			if (ROUND_TO_PAGE(sz, mmc_blocksize_mask) > size)
+		}
+		else
+		{
+			if (magic_number[0] == DECRYPT_MAGIC_0 &&
+				magic_number[1] == DECRYPT_MAGIC_1)
 			{
-				fastboot_fail("size too large");
-				return;
+				ret = decrypt_scm((uint32 **)&data, &sz);
+				if (ret != 0)
+				{
+					dprintf(CRITICAL, "ERROR: Invalid secure image\n");
+					return;
+				}
 			}
-			else if (mmc_write(ptn, sz, (unsigned int *)data))
+			else if (magic_number[0] == ENCRYPT_MAGIC_0 &&
+					 magic_number[1] == ENCRYPT_MAGIC_1)
 			{
-				fastboot_fail("flash write failure");
-				return;
+				ret = encrypt_scm((uint32 **)&data, &sz);
+				if (ret != 0)
+				{
+					dprintf(CRITICAL, "ERROR: Encryption Failure\n");
+					return;
+				}
 			}
 		}
 	}
-	fastboot_okay("");
-	return;
-}
-
-void cmd_flash_meta_img(const char *arg, void *data, unsigned sz)
-{
-#if ABOOT_STANDALONE
-	fastboot_fail("Cannot flash meta image on standalone aboot");
-#else
-	int i, images;
-	meta_header_t *meta_header;
-	img_header_entry_t *img_header_entry;
-	/*End of the image address*/
-	uintptr_t data_end;
-
-	if ((UINT_MAX - sz) > (uintptr_t)data)
-		data_end = (uintptr_t)data + sz;
 	else
 	{
-		fastboot_fail("Cannot  flash: image header corrupt");
+		dprintf(CRITICAL, "INVALID SVC Version\n");
 		return;
 	}
+#endif /* SSD_ENABLE */
 
-	if ((UINT_MAX - sizeof(meta_header_t) < (uintptr_t)data) || (data_end < ((uintptr_t)data + sizeof(meta_header_t))))
-	{
-		fastboot_fail("Cannot  flash: image header corrupt");
+	if (flash_mmc_check_allowed(arg))
 		return;
-	}
 
-	/* If device is locked:
-	 * Forbid to flash image to avoid the device to bypass the image
-	 * which with "any" name other than bootloader. Because it maybe
-	 * a meta package of all partitions.
-	 */
-#if VERIFIED_BOOT || VERIFIED_BOOT_2
-	if (target_build_variant_user())
+#if VERIFIED_BOOT_2
+	if (!strncmp(arg, "avb_custom_key", strlen("avb_custom_key")))
 	{
-		if (!device.is_unlocked)
+		dprintf(INFO, "flashing avb_custom_key\n");
+		if (store_userkey(data, sz))
 		{
-			fastboot_fail("Device is locked, meta image flashing is not allowed");
-			return;
+			fastboot_fail("Flashing avb_custom_key failed");
 		}
-
-		if (VB_M <= target_get_vb_version() &&
-			!device.is_unlock_critical)
+		else
 		{
-			fastboot_fail("Device is critical locked, Meta image flashing is not allowed");
-			return;
+			fastboot_okay("");
 		}
+		return;
 	}
 #endif
 
+	sparse_header = (sparse_header_t *)data;
 	meta_header = (meta_header_t *)data;
-	if (((UINT_MAX - sizeof(meta_header_t) - meta_header->img_hdr_sz) < (uintptr_t)data) || data_end < ((uintptr_t)data + sizeof(meta_header_t) + meta_header->img_hdr_sz))
-	{
-		fastboot_fail("Cannot  flash: image header corrupt");
+	if (sparse_header->magic == SPARSE_HEADER_MAGIC)
+		cmd_flash_mmc_sparse_img(arg, data, sz);
+	else if (meta_header->magic == META_HEADER_MAGIC)
+		cmd_flash_meta_img(arg, data, sz);
+	else
+		cmd_flash_mmc_img(arg, data, sz);
+
+#if VERIFIED_BOOT
+	if (VB_M <= target_get_vb_version() &&
+		(!strncmp(arg, "system", 6)) &&
+		!device.verity_mode)
+		// reset dm_verity mode to enforcing
+		device.verity_mode = 1;
+	write_device_info(&device);
+#endif
+
+	return;
+}
+
+/*
+ * The eMMC write cache speeds up flashing a lot, so it is turned on for the
+ * flash commands. The cached data is written back before the command
+ * responds, the cache is turned off again before booting or rebooting.
+ */
+static int flash_cache_sync(void)
+{
+	return mmc_write_cache_flush() ? -1 : 0;
+}
+
+static void flash_cache_begin(void)
+{
+	if (!target_is_emmc_boot())
 		return;
-	}
-	img_header_entry = (img_header_entry_t *)(data + sizeof(meta_header_t));
 
-	images = meta_header->img_hdr_sz / sizeof(img_header_entry_t);
+	if (mmc_write_cache_enable(true))
+		return;
+	fastboot_set_sync(flash_cache_sync);
+}
 
-	for (i = 0; i < images; i++)
-	{
+static void flash_cache_end(void)
+{
+	if (target_is_emmc_boot())
+		mmc_write_cache_enable(false);
+}
 
-		if ((!img_header_entry[i].ptn_name[0]) ||
-			(img_header_entry[i].start_offset == 0) ||
-			(img_header_entry[i].size == 0))
-			break;
-		if ((UINT_MAX - img_header_entry[i].start_offset) < (uintptr_t)data)
-		{
-			fastboot_fail("Integer overflow detected in start_offset of img");
-			break;
-		}
-		else if ((UINT_MAX - (img_header_entry[i].start_offset + (uintptr_t)data)) < img_header_entry[i].size)
-		{
-			fastboot_fail("Integer overflow detected in size of img");
-			break;
-		}
-		if (data_end < ((uintptr_t)data + img_header_entry[i].start_offset + img_header_entry[i].size))
-		{
-			fastboot_fail("Cannot  flash: image size mismatch");
-			break;
-		}
+/*
+ * State of "oem stream-flash". The image is received in pieces of arbitrary
+ * size, so sparse headers & partial device blocks are collected in small
+ * buffers until they are complete.
+ */
+enum stream_flash_state
+{
+	STREAM_RAW,
+	STREAM_SPARSE_HDR,
+	STREAM_CHUNK_HDR,
+	STREAM_CHUNK_RAW,
+	STREAM_CHUNK_FILL,
+	STREAM_CHUNK_SKIP,
+	STREAM_SPARSE_DONE,
+};
 
-		cmd_flash_mmc_img(img_header_entry[i].ptn_name,
-						  (void *)data + img_header_entry[i].start_offset,
-						  img_header_entry[i].size);
-	}
+struct stream_flash
+{
+	enum stream_flash_state state;
+	bool started;
+	/* Block device for "oem bdev-flash", ptn is 0 then */
+	struct bdev *bdev;
+	unsigned long long ptn;
+	unsigned long long size;
+	/* Offset of the next write from the start of the partition */
+	uint64_t offset;
+	sparse_header_t sparse_header;
+	chunk_header_t chunk_header;
+	/* Header or fill value being collected */
+	uint8_t hdr[sizeof(sparse_header_t)];
+	uint32_t hdr_len;
+	uint32_t chunk;
+	uint32_t total_blocks;
+	/* Data left in the current chunk */
+	uint64_t left;
+	/* Data of an incomplete device block */
+	uint8_t *carry;
+	uint32_t carry_len;
+	uint32_t blk_sz;
+};
 
-	if (!strncmp(arg, "bootloader", strlen("bootloader")))
+/* Write data in whole device blocks, keep the rest for the next piece */
+static int stream_flash_write(struct stream_flash *s, uint8_t *buf, uint32_t len)
+{
+	uint32_t n;
+
+	if (s->carry_len)
 	{
-		strlcpy(device.bootloader_version, TARGET(BOARD), MAX_VERSION_LEN);
-		strlcat(device.bootloader_version, "-", MAX_VERSION_LEN);
-		strlcat(device.bootloader_version, meta_header->img_version, MAX_VERSION_LEN);
+		n = MIN(len, s->blk_sz - s->carry_len);
+		memcpy(s->carry + s->carry_len, buf, n);
+		s->carry_len += n;
+		buf += n;
+		len -= n;
+
+		if (s->carry_len < s->blk_sz)
+			return 0;
+
+		if (flash_dev_write(s->bdev, s->ptn + s->offset, s->blk_sz, s->carry))
+			return -1;
+		s->offset += s->blk_sz;
+		s->carry_len = 0;
 	}
-	else
+
+	n = ROUNDDOWN(len, s->blk_sz);
+	if (n)
 	{
-		strlcpy(device.radio_version, TARGET(BOARD), MAX_VERSION_LEN);
-		strlcat(device.radio_version, "-", MAX_VERSION_LEN);
-		strlcat(device.radio_version, meta_header->img_version, MAX_VERSION_LEN);
+		if (flash_dev_write(s->bdev, s->ptn + s->offset, n, buf))
+			return -1;
+		s->offset += n;
 	}
 
-	write_device_info(&device);
-	fastboot_okay("");
-	return;
-#endif
+	memcpy(s->carry, buf + n, len - n);
+	s->carry_len = len - n;
+	return 0;
 }
 
-void cmd_flash_mmc_sparse_img(const char *arg, void *data, unsigned sz)
+/* Collect len bytes of a header, return the number of bytes consumed */
+static uint32_t stream_flash_collect(struct stream_flash *s, uint8_t *buf, uint32_t len,
+									 uint32_t needed)
 {
-	unsigned int chunk;
-	uint64_t chunk_data_sz;
-	uint32_t *fill_buf = NULL;
-	uint32_t fill_val;
-	uint32_t blk_sz_actual = 0;
-	sparse_header_t *sparse_header;
-	chunk_header_t *chunk_header;
-	uint32_t total_blocks = 0;
-	unsigned long long ptn = 0;
-	unsigned long long size = 0;
-	int index = INVALID_PTN;
-	uint32_t i;
-	uint8_t lun = 0;
-	/*End of the sparse image address*/
-	uintptr_t data_end = (uintptr_t)data + sz;
+	uint32_t n = MIN(len, needed - s->hdr_len);
 
-	index = partition_get_index(arg);
-	ptn = partition_get_offset(index);
-	if (ptn == 0)
-	{
-		fastboot_fail("partition table doesn't exist");
-		return;
-	}
+	memcpy(s->hdr + s->hdr_len, buf, n);
+	s->hdr_len += n;
+	return n;
+}
 
-	size = partition_get_size(index);
+static int stream_flash_sparse_hdr(struct stream_flash *s)
+{
+	sparse_header_t *sparse_header = &s->sparse_header;
 
-	lun = partition_get_lun(index);
-	mmc_set_lun(lun);
+	memcpy(sparse_header, s->hdr, sizeof(*sparse_header));
 
-	if (sz < sizeof(sparse_header_t))
+	if (!sparse_header->blk_sz || (sparse_header->blk_sz % s->blk_sz))
 	{
-		fastboot_fail("size too low");
-		return;
+		fastboot_fail("Invalid block size\n");
+		return -1;
 	}
 
-	/* Read and skip over sparse image header */
-	sparse_header = (sparse_header_t *)data;
+	if (((uint64_t)sparse_header->total_blks * (uint64_t)sparse_header->blk_sz) > s->size)
+	{
+		fastboot_fail("size too large");
+		return -1;
+	}
 
-	if (!sparse_header->blk_sz || (sparse_header->blk_sz % 4))
+	if (sparse_header->file_hdr_sz != sizeof(sparse_header_t))
 	{
-		fastboot_fail("Invalid block size\n");
-		return;
+		fastboot_fail("sparse header size mismatch");
+		return -1;
 	}
 
-	if (((uint64_t)sparse_header->total_blks * (uint64_t)sparse_header->blk_sz) > size)
+	if (sparse_header->chunk_hdr_sz != sizeof(chunk_header_t))
 	{
-		fastboot_fail("size too large");
-		return;
+		fastboot_fail("chunk header size mismatch");
+		return -1;
 	}
 
-	data += sizeof(sparse_header_t);
+	s->state = sparse_header->total_chunks ? STREAM_CHUNK_HDR : STREAM_SPARSE_DONE;
+	return 0;
+}
 
-	if (data_end < (uintptr_t)data)
+static int stream_flash_chunk_hdr(struct stream_flash *s)
+{
+	sparse_header_t *sparse_header = &s->sparse_header;
+	chunk_header_t *chunk_header = &s->chunk_header;
+	uint64_t chunk_data_sz;
+
+	memcpy(chunk_header, s->hdr, sizeof(*chunk_header));
+
+	dprintf(SPEW, "=== Chunk %u: type 0x%x, chunk_sz 0x%x, total_sz 0x%x ===\n",
+			s->chunk, chunk_header->chunk_type, chunk_header->chunk_sz, chunk_header->total_sz);
+
+	chunk_data_sz = (uint64_t)sparse_header->blk_sz * chunk_header->chunk_sz;
+
+	/* Make sure that the chunk does not exceed the partition size */
+	if ((uint64_t)s->total_blocks * (uint64_t)sparse_header->blk_sz + chunk_data_sz > s->size)
 	{
-		fastboot_fail("buffer overreads occured due to invalid sparse header");
-		return;
+		fastboot_fail("Chunk data size exceeds partition size");
+		return -1;
 	}
 
-	if (sparse_header->file_hdr_sz != sizeof(sparse_header_t))
+	if (s->total_blocks > (UINT_MAX - chunk_header->chunk_sz))
 	{
-		fastboot_fail("sparse header size mismatch");
-		return;
+		fastboot_fail("Bogus chunk size");
+		return -1;
 	}
 
-	dprintf(SPEW, "=== Sparse Image Header ===\n");
-	dprintf(SPEW, "magic: 0x%x\n", sparse_header->magic);
-	dprintf(SPEW, "major_version: 0x%x\n", sparse_header->major_version);
-	dprintf(SPEW, "minor_version: 0x%x\n", sparse_header->minor_version);
-	dprintf(SPEW, "file_hdr_sz: %d\n", sparse_header->file_hdr_sz);
-	dprintf(SPEW, "chunk_hdr_sz: %d\n", sparse_header->chunk_hdr_sz);
-	dprintf(SPEW, "blk_sz: %d\n", sparse_header->blk_sz);
-	dprintf(SPEW, "total_blks: %d\n", sparse_header->total_blks);
-	dprintf(SPEW, "total_chunks: %d\n", sparse_header->total_chunks);
+	s->offset = (uint64_t)s->total_blocks * sparse_header->blk_sz;
+	s->total_blocks += chunk_header->chunk_sz;
+	s->left = chunk_data_sz;
 
-	/* Start processing chunks */
-	for (chunk = 0; chunk < sparse_header->total_chunks; chunk++)
+	switch (chunk_header->chunk_type)
 	{
-		/* Make sure the total image size does not exceed the partition size */
-		if (((uint64_t)total_blocks * (uint64_t)sparse_header->blk_sz) >= size)
+	case CHUNK_TYPE_RAW:
+		if ((uint64_t)chunk_header->total_sz != ((uint64_t)sparse_header->chunk_hdr_sz +
+												 chunk_data_sz))
 		{
-			fastboot_fail("size too large");
-			return;
+			fastboot_fail("Bogus chunk size for chunk type Raw");
+			return -1;
 		}
-		/* Read and skip over chunk header */
-		chunk_header = (chunk_header_t *)data;
-		data += sizeof(chunk_header_t);
+		s->state = STREAM_CHUNK_RAW;
+		break;
 
-		if (data_end < (uintptr_t)data)
+	case CHUNK_TYPE_FILL:
+		if (chunk_header->total_sz != (sparse_header->chunk_hdr_sz + sizeof(uint32_t)))
 		{
-			fastboot_fail("buffer overreads occured due to invalid sparse header");
-			return;
+			fastboot_fail("Bogus chunk size for chunk type FILL");
+			return -1;
 		}
+		s->state = STREAM_CHUNK_FILL;
+		break;
 
-		dprintf(SPEW, "=== Chunk Header ===\n");
-		dprintf(SPEW, "chunk_type: 0x%x\n", chunk_header->chunk_type);
-		dprintf(SPEW, "chunk_data_sz: 0x%x\n", chunk_header->chunk_sz);
-		dprintf(SPEW, "total_size: 0x%x\n", chunk_header->total_sz);
+	case CHUNK_TYPE_DONT_CARE:
+		/* Let the card reuse the blocks, their content does not matter */
+		if (use_discard && !s->bdev && chunk_data_sz &&
+			mmc_trim_card(s->ptn + s->offset, chunk_data_sz, true))
+			dprintf(CRITICAL, "Failed to discard chunk %u, ignoring\n", s->chunk);
+		s->left = 0;
+		s->state = STREAM_CHUNK_SKIP;
+		break;
 
-		if (sparse_header->chunk_hdr_sz != sizeof(chunk_header_t))
+	case CHUNK_TYPE_CRC32:
+		if (chunk_header->total_sz != sparse_header->chunk_hdr_sz)
 		{
-			fastboot_fail("chunk header size mismatch");
-			return;
+			fastboot_fail("Bogus chunk size for chunk type CRC");
+			return -1;
 		}
+		s->state = STREAM_CHUNK_SKIP;
+		break;
 
-		chunk_data_sz = (uint64_t)sparse_header->blk_sz * chunk_header->chunk_sz;
+	default:
+		dprintf(CRITICAL, "Unkown chunk type: %x\n", chunk_header->chunk_type);
+		fastboot_fail("Unknown chunk type");
+		return -1;
+	}
 
-		/* Make sure that the chunk size calculated from sparse image does not
-		 * exceed partition size
-		 */
-		if ((uint64_t)total_blocks * (uint64_t)sparse_header->blk_sz + chunk_data_sz > size)
-		{
-			fastboot_fail("Chunk data size exceeds partition size");
-			return;
-		}
+	return 0;
+}
 
-		switch (chunk_header->chunk_type)
-		{
-		case CHUNK_TYPE_RAW:
-			if ((uint64_t)chunk_header->total_sz != ((uint64_t)sparse_header->chunk_hdr_sz +
-													 chunk_data_sz))
-			{
-				fastboot_fail("Bogus chunk size for chunk type Raw");
-				return;
-			}
+static void stream_flash_next_chunk(struct stream_flash *s)
+{
+	s->chunk++;
+	s->state = (s->chunk < s->sparse_header.total_chunks) ? STREAM_CHUNK_HDR : STREAM_SPARSE_DONE;
+}
 
-			if (data_end < (uintptr_t)data + chunk_data_sz)
-			{
-				fastboot_fail("buffer overreads occured due to invalid sparse header");
-				return;
-			}
+static int stream_flash_sink(void *priv, void *data, unsigned len)
+{
+	struct stream_flash *s = priv;
+	uint8_t *buf = data;
+	uint32_t n;
 
-			/* chunk_header->total_sz is uint32,So chunk_data_sz is now less than 2^32
-			   otherwise it will return in the line above
-			 */
-			if (mmc_write(ptn + ((uint64_t)total_blocks * sparse_header->blk_sz),
-						  (uint32_t)chunk_data_sz,
-						  (unsigned int *)data))
+	if (!s->started)
+	{
+		s->started = true;
+		if (len >= sizeof(uint32_t) && *(uint32_t *)buf == SPARSE_HEADER_MAGIC)
+			s->state = STREAM_SPARSE_HDR;
+	}
+
+	while (len)
+	{
+		switch (s->state)
+		{
+		case STREAM_RAW:
+			if (s->offset + s->carry_len + len > s->size)
 			{
-				fastboot_fail("flash write failure");
-				return;
+				fastboot_fail("size too large");
+				return -1;
 			}
-			if (total_blocks > (UINT_MAX - chunk_header->chunk_sz))
+			if (stream_flash_write(s, buf, len))
 			{
-				fastboot_fail("Bogus size for RAW chunk type");
-				return;
+				fastboot_fail("flash write failure");
+				return -1;
 			}
-			total_blocks += chunk_header->chunk_sz;
-			data += (uint32_t)chunk_data_sz;
-			break;
+			return 0;
 
-		case CHUNK_TYPE_FILL:
-			if (chunk_header->total_sz != (sparse_header->chunk_hdr_sz +
-										   sizeof(uint32_t)))
+		case STREAM_SPARSE_HDR:
+			n = stream_flash_collect(s, buf, len, sizeof(sparse_header_t));
+			if (s->hdr_len == sizeof(sparse_header_t))
 			{
-				fastboot_fail("Bogus chunk size for chunk type FILL");
-				return;
+				s->hdr_len = 0;
+				if (stream_flash_sparse_hdr(s))
+					return -1;
 			}
+			break;
 
-			blk_sz_actual = ROUNDUP(sparse_header->blk_sz, CACHE_LINE);
-			/* Integer overflow detected */
-			if (blk_sz_actual < sparse_header->blk_sz)
+		case STREAM_CHUNK_HDR:
+			n = stream_flash_collect(s, buf, len, sizeof(chunk_header_t));
+			if (s->hdr_len == sizeof(chunk_header_t))
 			{
-				fastboot_fail("Invalid block size");
-				return;
+				s->hdr_len = 0;
+				if (stream_flash_chunk_hdr(s))
+					return -1;
+				if (s->state == STREAM_CHUNK_SKIP && !s->left)
+					stream_flash_next_chunk(s);
 			}
+			break;
 
-			fill_buf = (uint32_t *)memalign(CACHE_LINE, blk_sz_actual);
-			if (!fill_buf)
+		case STREAM_CHUNK_RAW:
+			n = (uint32_t)MIN((uint64_t)len, s->left);
+			if (stream_flash_write(s, buf, n))
 			{
-				fastboot_fail("Malloc failed for: CHUNK_TYPE_FILL");
-				return;
+				fastboot_fail("flash write failure");
+				return -1;
 			}
+			s->left -= n;
+			if (!s->left)
+				stream_flash_next_chunk(s);
+			break;
 
-			if (data_end < (uintptr_t)data + sizeof(uint32_t))
+		case STREAM_CHUNK_FILL:
+			n = stream_flash_collect(s, buf, len, sizeof(uint32_t));
+			if (s->hdr_len == sizeof(uint32_t))
 			{
-				fastboot_fail("buffer overreads occured due to invalid sparse header");
-				free(fill_buf);
-				return;
+				s->hdr_len = 0;
+				if (s->left && sparse_fill_chunk(s->bdev, s->ptn + s->offset, s->left,
+												 *(uint32_t *)s->hdr, s->sparse_header.blk_sz))
+					return -1;
+				stream_flash_next_chunk(s);
 			}
-			fill_val = *(uint32_t *)data;
-			data = (char *)data + sizeof(uint32_t);
+			break;
 
-			for (i = 0; i < (sparse_header->blk_sz / sizeof(fill_val)); i++)
-			{
-				fill_buf[i] = fill_val;
-			}
+		case STREAM_CHUNK_SKIP:
+			n = (uint32_t)MIN((uint64_t)len, s->left);
+			s->left -= n;
+			if (!s->left)
+				stream_flash_next_chunk(s);
+			break;
 
-			if (total_blocks > (UINT_MAX - chunk_header->chunk_sz))
-			{
-				fastboot_fail("bogus size for chunk FILL type");
-				free(fill_buf);
-				return;
-			}
+		case STREAM_SPARSE_DONE:
+		default:
+			/* Ignore any padding after the last chunk */
+			return 0;
+		}
 
-			for (i = 0; i < chunk_header->chunk_sz; i++)
-			{
-				/* Make sure that the data written to partition does not exceed partition size */
-				if ((uint64_t)total_blocks * (uint64_t)sparse_header->blk_sz + sparse_header->blk_sz > size)
-				{
-					fastboot_fail("Chunk data size for fill type exceeds partition size");
-					free(fill_buf);
-					return;
-				}
+		buf += n;
+		len -= n;
+	}
 
-				if (mmc_write(ptn + ((uint64_t)total_blocks * sparse_header->blk_sz),
-							  sparse_header->blk_sz,
-							  fill_buf))
-				{
-					fastboot_fail("flash write failure");
-					free(fill_buf);
-					return;
-				}
+	return 0;
+}
 
-				total_blocks++;
-			}
+static unsigned long long parse_hex_u64(const char *str, char **end)
+{
+	unsigned long long val = 0;
+	int digit;
 
-			free(fill_buf);
+	for (; *str; str++)
+	{
+		if (*str >= '0' && *str <= '9')
+			digit = *str - '0';
+		else if (*str >= 'a' && *str <= 'f')
+			digit = *str - 'a' + 10;
+		else if (*str >= 'A' && *str <= 'F')
+			digit = *str - 'A' + 10;
+		else
 			break;
 
-		case CHUNK_TYPE_DONT_CARE:
-			if (total_blocks > (UINT_MAX - chunk_header->chunk_sz))
-			{
-				fastboot_fail("bogus size for chunk DONT CARE type");
-				return;
-			}
-			total_blocks += chunk_header->chunk_sz;
+		if (val >> 60)
 			break;
+		val = (val << 4) | digit;
+	}
 
-		case CHUNK_TYPE_CRC32:
-			if (chunk_header->total_sz != sparse_header->chunk_hdr_sz)
-			{
-				fastboot_fail("Bogus chunk size for chunk type CRC");
-				return;
-			}
-			if (total_blocks > (UINT_MAX - chunk_header->chunk_sz))
-			{
-				fastboot_fail("bogus size for chunk CRC type");
-				return;
-			}
-			total_blocks += chunk_header->chunk_sz;
-			if ((uintptr_t)data > UINT_MAX - chunk_data_sz)
-			{
-				fastboot_fail("integer overflow occured");
-				return;
-			}
-			data += (uint32_t)chunk_data_sz;
-			if (data_end < (uintptr_t)data)
+	*end = (char *)str;
+	return val;
+}
+
+/* Check & prepare the partition for a streamed image, fails on error */
+static int stream_flash_open(struct stream_flash *s, const char *pname)
+{
+	int index;
+
+	/* These need the whole image at once */
+	if (!strcmp(pname, "partition") ||
+		!strncmp(pname, "frp-unlock", strlen("frp-unlock")) ||
+		!strcmp(pname, "keystore") ||
+		!strncmp(pname, "avb_custom_key", strlen("avb_custom_key")))
+	{
+		fastboot_fail("partition cannot be streamed");
+		return -1;
+	}
+
+	if (!target_is_emmc_boot())
+	{
+		fastboot_fail("streaming is only supported on mmc & ufs");
+		return -1;
+	}
+
+	if (flash_mmc_check_allowed(pname))
+		return -1;
+
+	index = partition_get_index(pname);
+	s->ptn = partition_get_offset(index);
+	if (s->ptn == 0)
+	{
+		fastboot_fail("partition table doesn't exist");
+		return -1;
+	}
+
+	s->size = partition_get_size(index);
+	if (partition_multislot_is_supported() &&
+		(!strncmp(pname, "boot", strlen("boot")) || !strcmp(pname, "recovery")))
+		partition_reset_attributes(index);
+
+	mmc_set_lun(partition_get_lun(index));
+
+	s->blk_sz = mmc_get_device_blocksize();
+	s->carry = memalign(CACHE_LINE, ROUNDUP(s->blk_sz, CACHE_LINE));
+	if (!s->carry)
+	{
+		fastboot_fail("Malloc failed for stream buffer");
+		return -1;
+	}
+
+	return 0;
+}
+
+/* Write the rest of the image once all data was received, then respond */
+static void stream_flash_finish(struct stream_flash *s)
+{
+	if (s->state == STREAM_RAW)
+	{
+		/* The size was checked against the partition while receiving */
+		if (s->carry_len)
+		{
+			memset(s->carry + s->carry_len, 0, s->blk_sz - s->carry_len);
+			if (flash_dev_write(s->bdev, s->ptn + s->offset, s->blk_sz, s->carry))
 			{
-				fastboot_fail("buffer overreads occured due to invalid sparse header");
+				fastboot_fail("flash write failure");
 				return;
 			}
-			break;
+		}
+	}
+	else if (s->state != STREAM_SPARSE_DONE)
+	{
+		fastboot_fail("sparse image is truncated");
+		return;
+	}
+	else
+	{
+		dprintf(INFO, "Wrote %u blocks, expected to write %u blocks\n",
+				s->total_blocks, s->sparse_header.total_blks);
+		if (s->total_blocks != s->sparse_header.total_blks)
+		{
+			fastboot_fail("sparse image write failure");
+			return;
+		}
+	}
+
+	fastboot_okay("");
+}
+
+/* Parse "<partition>:<size in hex>" of the streaming flash commands */
+static char *stream_flash_parse_args(const char *arg, unsigned long long *len,
+									 const char *usage)
+{
+	char *pname, *token, *end;
+	char *sp;
+
+	pname = strtok_r((char *)arg, ":", &sp);
+	token = strtok_r(NULL, ":", &sp);
+	if (!pname || !token)
+	{
+		fastboot_fail(usage);
+		return NULL;
+	}
+
+	*len = parse_hex_u64(token, &end);
+	if (*end || !*len)
+	{
+		fastboot_fail("invalid size");
+		return NULL;
+	}
+
+	return pname;
+}
+
+/*
+ * "oem stream-flash:<partition>:<size in hex>" receives a raw or sparse
+ * image of any size and writes it to the partition while it is still being
+ * downloaded. It replies with "DATA" and the size as 16 hex digits.
+ */
+void cmd_oem_stream_flash(const char *arg, void *data, unsigned sz)
+{
+	struct stream_flash s = {0};
+	unsigned long long len;
+	char *pname;
+
+	pname = stream_flash_parse_args(arg, &len, "usage: oem stream-flash:<partition>:<size>");
+	if (!pname || stream_flash_open(&s, pname))
+		return;
 
-		default:
-			dprintf(CRITICAL, "Unkown chunk type: %x\n", chunk_header->chunk_type);
-			fastboot_fail("Unknown chunk type");
-			return;
-		}
+	flash_cache_begin();
+
+	/* Failures of the sink are reported by fastboot_stream() */
+	if (!fastboot_stream(len, stream_flash_sink, &s))
+		stream_flash_finish(&s);
+
+	free(s.carry);
+}
+
+#if WITH_LK2ND_HW_BDEV
+/*
+ * "oem bdev-flash:<bdev>:<size in hex>" works like "oem stream-flash", but
+ * writes the raw or sparse image to an lk2nd block device (e.g. "mmc1" for
+ * the SD card) instead of a partition of the boot device.
+ */
+static void cmd_oem_bdev_flash(const char *arg, void *data, unsigned sz)
+{
+	struct stream_flash s = {0};
+	unsigned long long len;
+	char *name;
+
+	name = stream_flash_parse_args(arg, &len, "usage: oem bdev-flash:<bdev>:<size>");
+	if (!name)
+		return;
+
+	s.bdev = bio_open(name);
+	if (!s.bdev)
+	{
+		fastboot_fail("unknown block device");
+		return;
 	}
 
-	dprintf(INFO, "Wrote %d blocks, expected to write %d blocks\n",
-			total_blocks, sparse_header->total_blks);
+	if (!s.bdev->write && !s.bdev->write_block)
+	{
+		fastboot_fail("block device is read-only");
+		goto out;
+	}
 
-	if (total_blocks != sparse_header->total_blks)
+	s.size = s.bdev->size;
+	s.blk_sz = s.bdev->block_size;
+	s.carry = memalign(CACHE_LINE, ROUNDUP(s.blk_sz, CACHE_LINE));
+	if (!s.carry)
 	{
-		fastboot_fail("sparse image write failure");
+		fastboot_fail("Malloc failed for stream buffer");
+		goto out;
 	}
 
-	fastboot_okay("");
-	return;
+	/* Failures of the sink are reported by fastboot_stream() */
+	if (!fastboot_stream(len, stream_flash_sink, &s))
+		stream_flash_finish(&s);
+
+	free(s.carry);
+out:
+	bio_close(s.bdev);
 }
+#endif
 
-static bool CheckVirtualAbCriticalPartition(const char *PartitionName)
+/*
+ * State of "oem flash-compressed". The compressed image is decompressed
+ * while it is received and the output is passed on to stream_flash_sink(),
+ * so it may contain a raw or a sparse image.
+ */
+enum flash_compressed_type
 {
-	VirtualAbMergeStatus SnapshotMergeStatus;
-	uint32 Iter = 0;
+	FLASH_COMPRESSED_DETECT,
+	FLASH_COMPRESSED_GZIP,
+	FLASH_COMPRESSED_LZ4,
+};
 
-	SnapshotMergeStatus = GetSnapshotMergeStatus();
-	if ((SnapshotMergeStatus == MERGING || SnapshotMergeStatus == SNAPSHOTTED))
+struct flash_compressed
+{
+	struct stream_flash flash;
+	enum flash_compressed_type type;
+	/* The sink of the decompressed data already failed & responded */
+	bool flash_failed;
+	/* Anything after the end of the gzip stream is ignored */
+	bool gzip_end;
+	struct decompress_stream gzip;
+	struct lz4_stream lz4;
+	/* Staging buffer for gzip output or LZ4 work buffer */
+	uint8_t *work;
+	unsigned work_size;
+};
+
+static int flash_compressed_write(void *priv, const void *buf, size_t len)
+{
+	struct flash_compressed *c = priv;
+
+	if (stream_flash_sink(&c->flash, (void *)buf, len))
 	{
-		for (Iter = 0; Iter < ARRAY_SIZE(VirtualAbCriticalPartitions); Iter++)
-		{
-			if (!strncmp(PartitionName, VirtualAbCriticalPartitions[Iter],
-						 strlen(VirtualAbCriticalPartitions[Iter])))
-				return true;
-		}
+		c->flash_failed = true;
+		return -1;
 	}
-	return false;
+	return 0;
 }
 
-void cmd_flash_mmc(const char *arg, void *data, unsigned sz)
+/* Pass on the decompressed data once the staging buffer is full */
+static int flash_compressed_gzip_flush(struct flash_compressed *c)
 {
-	sparse_header_t *sparse_header;
-	meta_header_t *meta_header;
-	VirtualAbMergeStatus SnapshotMergeStatus;
-	char FlashResultStr[MAX_RSP_SIZE] = "";
+	unsigned len = c->work_size - c->gzip.avail_out;
 
-#ifdef SSD_ENABLE
-	/* 8 Byte Magic + 2048 Byte xml + Encrypted Data */
-	unsigned int *magic_number = (unsigned int *)data;
-	int ret = 0;
-	uint32 major_version = 0;
-	uint32 minor_version = 0;
+	c->gzip.next_out = c->work;
+	c->gzip.avail_out = c->work_size;
+	return len ? flash_compressed_write(c, c->work, len) : 0;
+}
 
-	ret = scm_svc_version(&major_version, &minor_version);
-	if (!ret)
+static int flash_compressed_gzip(struct flash_compressed *c, uint8_t *buf, unsigned len)
+{
+	int ret;
+
+	c->gzip.next_in = buf;
+	c->gzip.avail_in = len;
+
+	while (c->gzip.avail_in && !c->gzip_end)
 	{
-		if (major_version >= 2)
+		ret = decompress_feed(&c->gzip);
+		if (ret < 0)
 		{
-			if (!strcmp(arg, "ssd") || !strcmp(arg, "tqs"))
-			{
-				ret = encrypt_scm((uint32 **)&data, &sz);
-				if (ret != 0)
-				{
-					dprintf(CRITICAL, "ERROR: Encryption Failure\n");
-					return;
-				}
+			fastboot_fail("gzip image is corrupted");
+			return -1;
+		}
 
-				/* Protect only for SSD */
-				if (!strcmp(arg, "ssd"))
-				{
-					ret = scm_protect_keystore((uint32 *)data, sz);
-					if (ret != 0)
-					{
-						dprintf(CRITICAL, "ERROR: scm_protect_keystore Failed\n");
-						return;
-					}
-				}
-			}
-			else
+		if (!c->gzip.avail_out && flash_compressed_gzip_flush(c))
+			return -1;
+
+		/* Padding after the last member */
+		if (ret == DECOMPRESS_STREAM_END && c->gzip.avail_in)
+			c->gzip_end = true;
+	}
+
+	return 0;
+}
+
+static int flash_compressed_sink(void *priv, void *data, unsigned len)
+{
+	struct flash_compressed *c = priv;
+	uint8_t *buf = data;
+	int ret;
+
+	if (c->type == FLASH_COMPRESSED_DETECT)
+	{
+		if (len >= 2 && buf[0] == 0x1f && buf[1] == 0x8b)
+		{
+			if (decompress_init(&c->gzip))
 			{
-				ret = decrypt_scm_v2((uint32 **)&data, &sz);
-				if (ret != 0)
-				{
-					dprintf(CRITICAL, "ERROR: Decryption Failure\n");
-					return;
-				}
+				fastboot_fail("failed to initialize gzip");
+				return -1;
 			}
+			c->gzip.next_out = c->work;
+			c->gzip.avail_out = c->work_size;
+			c->type = FLASH_COMPRESSED_GZIP;
+		}
+		else if (lz4_is_compressed(buf, len))
+		{
+			lz4_stream_init(&c->lz4, c->work, flash_compressed_write, c);
+			c->type = FLASH_COMPRESSED_LZ4;
 		}
 		else
 		{
-			if (magic_number[0] == DECRYPT_MAGIC_0 &&
-				magic_number[1] == DECRYPT_MAGIC_1)
-			{
-				ret = decrypt_scm((uint32 **)&data, &sz);
-				if (ret != 0)
-				{
-					dprintf(CRITICAL, "ERROR: Invalid secure image\n");
-					return;
-				}
-			}
-			else if (magic_number[0] == ENCRYPT_MAGIC_0 &&
-					 magic_number[1] == ENCRYPT_MAGIC_1)
-			{
-				ret = encrypt_scm((uint32 **)&data, &sz);
-				if (ret != 0)
-				{
-					dprintf(CRITICAL, "ERROR: Encryption Failure\n");
-					return;
-				}
-			}
+			fastboot_fail("image is not gzip or lz4 compressed");
+			return -1;
 		}
 	}
-	else
-	{
-		dprintf(CRITICAL, "INVALID SVC Version\n");
-		return;
-	}
-#endif /* SSD_ENABLE */
 
-#if VERIFIED_BOOT || VERIFIED_BOOT_2
-	if (target_build_variant_user())
-	{
-		/* if device is locked:
-		 * common partition will not allow to be flashed
-		 * critical partition will allow to flash image.
-		 */
-		if (!device.is_unlocked && !critical_flash_allowed(arg))
-		{
-			fastboot_fail("Partition flashing is not allowed");
-			return;
-		}
+	if (c->type == FLASH_COMPRESSED_GZIP)
+		return flash_compressed_gzip(c, buf, len);
 
-		/* if device critical is locked:
-		 * common partition will allow to be flashed
-		 * critical partition will not allow to flash image.
-		 */
-		if (VB_M <= target_get_vb_version() &&
-			!device.is_unlock_critical &&
-			critical_flash_allowed(arg))
+	ret = lz4_stream_decompress(&c->lz4, buf, len);
+	if (ret && !c->flash_failed)
+		fastboot_fail("lz4 image is corrupted");
+	return ret;
+}
+
+/* Decompress what is left after the end of the input */
+static int flash_compressed_end(struct flash_compressed *c)
+{
+	int ret;
+
+	if (c->type == FLASH_COMPRESSED_LZ4)
+	{
+		if (lz4_stream_end(&c->lz4))
 		{
-			fastboot_fail("Critical partition flashing is not allowed");
-			return;
+			fastboot_fail("lz4 image is truncated");
+			return -1;
 		}
+		return 0;
 	}
-#endif
 
-	if (target_virtual_ab_supported())
+	while (!c->gzip_end)
 	{
-		if (CheckVirtualAbCriticalPartition(arg))
+		ret = decompress_feed(&c->gzip);
+		if (ret < 0)
 		{
-			snprintf(FlashResultStr, MAX_RSP_SIZE, "Flashing of %s is not allowed in %s state",
-					 arg, SnapshotMergeState);
-			fastboot_fail(FlashResultStr);
-			return;
+			fastboot_fail("gzip image is corrupted");
+			return -1;
 		}
 
-		SnapshotMergeStatus = GetSnapshotMergeStatus();
-		if (((SnapshotMergeStatus == MERGING) || (SnapshotMergeStatus == SNAPSHOTTED)) &&
-			!strncmp(arg, "super", strlen("super")))
+		c->gzip_end = (ret == DECOMPRESS_STREAM_END);
+		if (!c->gzip_end && c->gzip.avail_out)
 		{
-			if (SetSnapshotMergeStatus(CANCELLED))
-			{
-				fastboot_fail("Failed to update snapshot state to cancel");
-				return;
-			}
-
-			// updating fbvar snapshot-merge-state
-			snprintf(SnapshotMergeState, strlen(VabSnapshotMergeStatus[NONE_MERGE_STATUS]) + 1,
-					 "%s", VabSnapshotMergeStatus[NONE_MERGE_STATUS]);
+			fastboot_fail("gzip image is truncated");
+			return -1;
 		}
+
+		if (!c->gzip.avail_out && flash_compressed_gzip_flush(c))
+			return -1;
 	}
 
-#if VERIFIED_BOOT_2
-	if (!strncmp(arg, "avb_custom_key", strlen("avb_custom_key")))
-	{
-		dprintf(INFO, "flashing avb_custom_key\n");
-		if (store_userkey(data, sz))
-		{
-			fastboot_fail("Flashing avb_custom_key failed");
-		}
-		else
-		{
-			fastboot_okay("");
-		}
+	return flash_compressed_gzip_flush(c);
+}
+
+/*
+ * "oem flash-compressed:<partition>:<size in hex>" works like
+ * "oem stream-flash", but receives a gzip or LZ4 compressed (raw or sparse)
+ * image and decompresses it on the fly. The size is the compressed size.
+ */
+void cmd_oem_flash_compressed(const char *arg, void *data, unsigned sz)
+{
+	struct flash_compressed c = {0};
+	unsigned long long len;
+	char *pname;
+
+	pname = stream_flash_parse_args(arg, &len, "usage: oem flash-compressed:<partition>:<size>");
+	if (!pname || stream_flash_open(&c.flash, pname))
 		return;
+
+	/* The heap is too small for LZ4 blocks, use the end of the download buffer */
+	c.work_size = LZ4_STREAM_WORK_SIZE;
+	c.work = fastboot_stream_scratch(c.work_size);
+	if (!c.work)
+	{
+		fastboot_fail("download buffer too small");
+		goto out;
 	}
-#endif
 
-	sparse_header = (sparse_header_t *)data;
-	meta_header = (meta_header_t *)data;
-	if (sparse_header->magic == SPARSE_HEADER_MAGIC)
-		cmd_flash_mmc_sparse_img(arg, data, sz);
-	else if (meta_header->magic == META_HEADER_MAGIC)
-		cmd_flash_meta_img(arg, data, sz);
-	else
-		cmd_flash_mmc_img(arg, data, sz);
+	flash_cache_begin();
 
-#if VERIFIED_BOOT
-	if (VB_M <= target_get_vb_version() &&
-		(!strncmp(arg, "system", 6)) &&
-		!device.verity_mode)
-		// reset dm_verity mode to enforcing
-		device.verity_mode = 1;
-	write_device_info(&device);
-#endif
+	if (!fastboot_stream(len, flash_compressed_sink, &c) && !flash_compressed_end(&c))
+		stream_flash_finish(&c.flash);
 
-	return;
+	if (c.type == FLASH_COMPRESSED_GZIP)
+		decompress_finish(&c.gzip);
+out:
+	free(c.flash.carry);
 }
 
 void cmd_updatevol(const char *vol_name, void *data, unsigned sz)
@@ -5112,7 +6847,7 @@ void cmd_flash_nand(const char *arg, void *data, unsigned sz)
 				return;
 			}
 			if (((uintptr_t)data + sz + bytes_to_round_page) >
-				((uintptr_t)target_get_scratch_address() + target_get_max_flash_size()))
+				((uintptr_t)target_get_scratch_address() + aboot_download_size()))
 			{
 				fastboot_fail("Buffer size is not aligned to page_size");
 				return;
@@ -5171,13 +6906,17 @@ static inline uint64_t validate_partition_size(struct ptentry *ptn)
 void cmd_flash(const char *arg, void *data, unsigned sz)
 {
 	if (target_is_emmc_boot())
+	{
+		flash_cache_begin();
 		cmd_flash_mmc(arg, data, sz);
+	}
 	else
 		cmd_flash_nand(arg, data, sz);
 }
 
 void cmd_continue(const char *arg, void *data, unsigned sz)
 {
+	flash_cache_end();
 	fastboot_okay("");
 	fastboot_stop();
 
@@ -5201,6 +6940,7 @@ void cmd_continue(const char *arg, void *data, unsigned sz)
 void cmd_reboot(const char *arg, void *data, unsigned sz)
 {
 	dprintf(INFO, "rebooting the device\n");
+	flash_cache_end();
 	fastboot_okay("");
 	reboot_device(0);
 }
@@ -5271,6 +7011,7 @@ void cmd_reboot_fastboot(const char *arg, void *data, unsigned sz)
 		fastboot_fail("Failed to update recovery command");
 		return;
 	}
+	flash_cache_end();
 	fastboot_okay("");
 	reboot_device(RECOVERY_MODE);
 
@@ -5288,6 +7029,7 @@ void cmd_reboot_recovery(const char *arg, void *data, unsigned sz)
 		fastboot_fail("Failed to update recovery command");
 		return;
 	}
+	flash_cache_end();
 	fastboot_okay("");
 	reboot_device(RECOVERY_MODE);
 
@@ -5350,6 +7092,7 @@ void CmdUpdateSnapshot(const char *arg, void *data, unsigned sz)
 void cmd_reboot_bootloader(const char *arg, void *data, unsigned sz)
 {
 	dprintf(INFO, "rebooting the device\n");
+	flash_cache_end();
 	fastboot_okay("");
 	reboot_device(FASTBOOT_MODE);
 }
@@ -5371,6 +7114,28 @@ void cmd_oem_disable_charger_screen(const char *arg, void *data, unsigned size)
 	fastboot_okay("");
 }
 
+void cmd_oem_enable_discard(const char *arg, void *data, unsigned size)
+{
+	if (!target_is_emmc_boot() || !mmc_trim_supported())
+	{
+		fastboot_fail("discard is not supported by the storage");
+		return;
+	}
+
+	dprintf(INFO, "Enabling discard for erase & sparse images\n");
+	use_discard = true;
+	snprintf(discard_enabled, MAX_RSP_SIZE, "%d", use_discard);
+	fastboot_okay("");
+}
+
+void cmd_oem_disable_discard(const char *arg, void *data, unsigned size)
+{
+	dprintf(INFO, "Disabling discard for erase & sparse images\n");
+	use_discard = false;
+	snprintf(discard_enabled, MAX_RSP_SIZE, "%d", use_discard);
+	fastboot_okay("");
+}
+
 void cmd_oem_off_mode_charger(const char *arg, void *data, unsigned size)
 {
 	char *p = NULL;
@@ -5930,6 +7695,13 @@ void aboot_fastboot_register_commands(void)
 		{"oem enable-charger-screen", cmd_oem_enable_charger_screen},
 		{"oem disable-charger-screen", cmd_oem_disable_charger_screen},
 		{"oem off-mode-charge", cmd_oem_off_mode_charger},
+		{"oem enable-discard", cmd_oem_enable_discard},
+		{"oem disable-discard", cmd_oem_disable_discard},
+		{"oem stream-flash:", cmd_oem_stream_flash},
+		{"oem flash-compressed:", cmd_oem_flash_compressed},
+#if WITH_LK2ND_HW_BDEV
+		{"oem bdev-flash:", cmd_oem_bdev_flash},
+#endif
 		{"oem select-display-panel", cmd_oem_select_display_panel},
 #endif
 #if DYNAMIC_PARTITION_SUPPORT
@@ -5939,6 +7711,9 @@ void aboot_fastboot_register_commands(void)
 #ifdef VIRTUAL_AB_OTA
 		{"snapshot-update", CmdUpdateSnapshot},
 #endif
+#if WITH_LK2ND_DEVICE_2ND
+		{"oem boot-lk2nd", cmd_oem_boot_lk2nd},
+#endif
 #if UNITTEST_FW_SUPPORT
 		{"oem run-tests", cmd_oem_runtests},
 #endif
@@ -5980,7 +7755,7 @@ void aboot_fastboot_register_commands(void)
 	/* Max download size supported */
 #if !VERIFIED_BOOT_2
 	snprintf(max_download_size, MAX_RSP_SIZE, "\t0x%x",
-			 target_get_max_flash_size());
+			 aboot_download_size());
 #else
 	snprintf(max_download_size, MAX_RSP_SIZE, "\t0x%x",
 			 SUB_SALT_BUFF_OFFSET(target_get_max_flash_size()));
@@ -6011,6 +7786,10 @@ void aboot_fastboot_register_commands(void)
 	snprintf(block_size_string, MAX_RSP_SIZE, "0x%x", mmc_blocksize);
 	fastboot_publish("erase-block-size", (const char *)block_size_string);
 	fastboot_publish("logical-block-size", (const char *)block_size_string);
+	snprintf(discard_enabled, MAX_RSP_SIZE, "%d", use_discard);
+	fastboot_publish("discard-enabled", (const char *)discard_enabled);
+	fastboot_publish("discard-supported",
+					 (target_is_emmc_boot() && mmc_trim_supported()) ? "yes" : "no");
 #if PRODUCT_IOT
 	get_bootloader_version_iot(&bootloader_version_string);
 	fastboot_publish("version-bootloader", (const char *)bootloader_version_string);
@@ -6155,6 +7934,8 @@ void aboot_init(const struct app_descriptor *app)
 			target_display_init(device.display_panel); // 初始化目标平台显示
 		else
 			display_image_on_screen(); // 在屏幕上显示图像
+#elif DISPLAY_INIT_ASYNC
+	aboot_display_init_async();
 #else
 	target_display_init(device.display_panel); // 初始化显示面板
 #endif
@@ -6353,10 +8134,15 @@ fastboot:
 	if (target_is_emmc_boot())
 		partition_dump(); // 打印eMMC分区信息
 
+#if WITH_LK2ND
+	/* Run the lk2nd init hooks that were deferred until fastboot */
+	lk2nd_init_require(LK2ND_INIT_NEED_FASTBOOT);
+#endif
+
 	/* 初始化并启动fastboot */
 #if !VERIFIED_BOOT_2
 	// 初始化fastboot，传入scratch地址和最大flash大小
-	fastboot_init(target_get_scratch_address(), target_get_max_flash_size());
+	fastboot_init(target_get_scratch_address(), aboot_download_size());
 #else
 	/* 在镜像地址开头添加salt缓冲区偏移量以复制VB salt */
 	// 验证启动v2版本需要额外的salt缓冲区
@@ -6364,6 +8150,7 @@ fastboot:
 				  SUB_SALT_BUFF_OFFSET(target_get_max_flash_size()));
 #endif
 #if FBCON_DISPLAY_MSG || WITH_LK2ND_DEVICE_MENU
+	aboot_display_wait();
 	display_fastboot_menu(); // 显示fastboot菜单界面
 #endif
 }
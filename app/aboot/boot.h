@@ -18,11 +18,20 @@ unsigned char *update_cmdline(const char *cmdline);
 struct dt_update_handler {
 	const char *name;
 	int (*update_dt)(void *fdt, const char *cmdline, enum boot_type type);
+	/* Maximum number of bytes the handler adds to the device tree */
+	unsigned int size;
 };
-#define DEV_TREE_UPDATE(func) \
+/*
+ * The device tree is opened once with enough free space for all handlers.
+ * Handlers that add more than a few small properties should declare how
+ * much they need with DEV_TREE_UPDATE_SIZE().
+ */
+#define DEV_TREE_UPDATE_SIZE(func, sz) \
 	static const struct dt_update_handler _dt_update_##func \
-		__SECTION(".dt_update") __USED = { #func, (func) }
+		__SECTION(".dt_update") __USED = { #func, (func), (sz) }
+#define DEV_TREE_UPDATE(func)	DEV_TREE_UPDATE_SIZE(func, 0)
 #else
+#define DEV_TREE_UPDATE_SIZE(func, sz)
 #define DEV_TREE_UPDATE(func)
 #endif
 
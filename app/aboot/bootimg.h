@@ -198,6 +198,115 @@ struct boot_img_hdr_v2 {
  *    else: jump to kernel_addr
  */
 
+#define BOOT_HEADER_VERSION_THREE 3
+#define BOOT_HEADER_VERSION_FOUR 4
+#define BOOT_IMG_V3_PAGE_SIZE 4096
+#define BOOT_IMG_V3_ARGS_SIZE 1536
+
+/* Header versions 3 and 4 use a fixed page size and keep the load
+ * addresses in the vendor_boot image. header_version is at the same
+ * offset as in the older versions.
+ */
+struct boot_img_hdr_v3 {
+    unsigned char magic[BOOT_MAGIC_SIZE];
+
+    uint32_t kernel_size;    /* size in bytes */
+    uint32_t ramdisk_size;   /* size in bytes */
+    uint32_t os_version;
+    uint32_t header_size;
+    uint32_t reserved[4];
+    uint32_t header_version;
+
+    unsigned char cmdline[BOOT_IMG_V3_ARGS_SIZE];
+} __attribute__((packed));
+
+struct boot_img_hdr_v4 {
+    struct boot_img_hdr_v3 v3;
+    uint32_t signature_size; /* size in bytes of the boot signature */
+} __attribute__((packed));
+
+/*
+ * +-----------------+
+ * | boot header     | 1 page
+ * +-----------------+
+ * | kernel          | n pages
+ * +-----------------+
+ * | ramdisk         | m pages
+ * +-----------------+
+ * | boot signature  | g pages (v4 only)
+ * +-----------------+
+ * n = (kernel_size + 4096 - 1) / 4096
+ * m = (ramdisk_size + 4096 - 1) / 4096
+ * g = (signature_size + 4096 - 1) / 4096
+ */
+
+#define VENDOR_BOOT_MAGIC "VNDRBOOT"
+#define VENDOR_BOOT_MAGIC_SIZE 8
+#define VENDOR_BOOT_ARGS_SIZE 2048
+#define VENDOR_BOOT_NAME_SIZE 16
+
+struct vendor_boot_img_hdr_v3 {
+    unsigned char magic[VENDOR_BOOT_MAGIC_SIZE];
+    uint32_t header_version;
+    uint32_t page_size;      /* flash page size we assume */
+
+    uint32_t kernel_addr;    /* physical load addr */
+    uint32_t ramdisk_addr;   /* physical load addr */
+
+    uint32_t vendor_ramdisk_size; /* size in bytes */
+
+    unsigned char cmdline[VENDOR_BOOT_ARGS_SIZE];
+
+    uint32_t tags_addr;      /* physical addr for kernel tags */
+    unsigned char name[VENDOR_BOOT_NAME_SIZE]; /* asciiz product name */
+
+    uint32_t header_size;
+
+    uint32_t dtb_size;       /* size in bytes for DTB image */
+    uint64_t dtb_addr;       /* physical load address for DTB image */
+} __attribute__((packed));
+
+struct vendor_boot_img_hdr_v4 {
+    struct vendor_boot_img_hdr_v3 v3;
+
+    uint32_t vendor_ramdisk_table_size;       /* size in bytes */
+    uint32_t vendor_ramdisk_table_entry_num;
+    uint32_t vendor_ramdisk_table_entry_size; /* size in bytes */
+    uint32_t bootconfig_size;                 /* size in bytes */
+} __attribute__((packed));
+
+/*
+ * +------------------------+
+ * | vendor boot header     | o pages
+ * +------------------------+
+ * | vendor ramdisk section | p pages
+ * +------------------------+
+ * | dtb                    | q pages
+ * +------------------------+
+ * | vendor ramdisk table   | r pages (v4 only)
+ * +------------------------+
+ * | bootconfig             | s pages (v4 only)
+ * +------------------------+
+ * o = (header_size + page_size - 1) / page_size
+ * p = (vendor_ramdisk_size + page_size - 1) / page_size
+ * q = (dtb_size + page_size - 1) / page_size
+ * r = (vendor_ramdisk_table_size + page_size - 1) / page_size
+ * s = (bootconfig_size + page_size - 1) / page_size
+ *
+ * 0. The vendor ramdisk section contains all vendor ramdisk fragments back
+ *    to back, the table only describes them. The kernel unpacks the vendor
+ *    ramdisk and the generic ramdisk from boot as one concatenated initrd,
+ *    vendor ramdisk first.
+ * 1. The kernel command line is the vendor_boot cmdline followed by the
+ *    boot cmdline.
+ * 2. The bootconfig is appended to the initrd, followed by its size,
+ *    checksum and the "#BOOTCONFIG\n" trailer.
+ */
+
+#define BOOTCONFIG_MAGIC "#BOOTCONFIG\n"
+#define BOOTCONFIG_MAGIC_SIZE 12
+#define BOOTCONFIG_ALIGN 4
+
 boot_img_hdr *mkbootimg(void *kernel, unsigned kernel_size,
                         void *ramdisk, unsigned ramdisk_size,
                         void *second, unsigned second_size,
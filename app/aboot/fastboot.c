@@ -38,6 +38,10 @@
 #include <dev/udc.h>
 #include "fastboot.h"
 
+#if LK2ND_FASTBOOT_EARLY
+#include <lk2nd/init.h>
+#endif
+
 #ifdef USB30_SUPPORT
 #include <usb30_udc.h>
 #endif
@@ -60,8 +64,14 @@ typedef struct
 
 usb_controller_interface_t usb_if;
 
-#define MAX_USBFS_BULK_SIZE (32 * 1024)
-#define MAX_USBSS_BULK_SIZE (0x1000000)
+/* hsusb chains up to 256 TDs of at least 16 KiB in one request */
+#define MAX_USBFS_BULK_SIZE (4 * 1024 * 1024)
+/*
+ * usb30_udc chains 65 TRBs of almost 16 MiB (+ 1 for padding) per request,
+ * so a whole download of up to 1 GiB can be queued without stopping the
+ * endpoint in between.
+ */
+#define MAX_USBSS_BULK_SIZE (0x40000000)
 
 void boot_linux(void *bootimg, unsigned sz);
 static void fastboot_notify(struct udc_gadget *gadget, unsigned event);
@@ -118,6 +128,13 @@ struct fastboot_cmd {
 	const char *prefix;
 	unsigned prefix_len;
 	void (*handle)(const char *arg, void *data, unsigned sz);
+
+	/* Statistics for "oem cmd-stats" */
+	unsigned calls;
+	bigtime_t total_usecs;
+	bigtime_t max_usecs;
+	bigtime_t usb_usecs;
+	unsigned long long bytes;
 };
 
 struct fastboot_var {
@@ -132,7 +149,7 @@ void fastboot_register(const char *prefix,
 		       void (*handle)(const char *arg, void *data, unsigned sz))
 {
 	struct fastboot_cmd *cmd;
-	cmd = malloc(sizeof(*cmd));
+	cmd = calloc(1, sizeof(*cmd));
 	if (cmd) {
 		cmd->prefix = prefix;
 		cmd->prefix_len = strlen(prefix);
@@ -171,9 +188,14 @@ static unsigned download_size;
 #define STATE_COMMAND	1
 #define STATE_COMPLETE	2
 #define STATE_ERROR	3
+#define STATE_STREAM	4
 
 static unsigned fastboot_state = STATE_OFFLINE;
 
+/* Response of a command handler, deferred until the stream is received */
+static char stream_code[5];
+static char stream_reason[LARGE_RSP_SIZE];
+
 static void req_complete(struct udc_request *req, unsigned actual, int status)
 {
 	txn_status = status;
@@ -386,15 +408,41 @@ oops:
 	return -1;
 }
 
+/* Run before the response of the current command, see fastboot_set_sync() */
+static int (*ack_sync)(void);
+
+void fastboot_set_sync(int (*sync)(void))
+{
+	ack_sync = sync;
+}
+
 void fastboot_ack(const char *code, const char *reason)
 {
 	STACKBUF_DMA_ALIGN(response, LARGE_RSP_SIZE);
+	int (*sync)(void) = ack_sync;
+
+	if (reason == 0)
+		reason = "";
+
+	/* usb is busy receiving the stream, keep only the first response */
+	if (fastboot_state == STATE_STREAM)
+	{
+		if (!stream_code[0]) {
+			strlcpy(stream_code, code, sizeof(stream_code));
+			strlcpy(stream_reason, reason, sizeof(stream_reason));
+		}
+		return;
+	}
 
 	if (fastboot_state != STATE_COMMAND)
 		return;
 
-	if (reason == 0)
-		reason = "";
+	/* Data the host considers written must not be lost anymore */
+	ack_sync = NULL;
+	if (sync && sync() && !strcmp(code, "OKAY")) {
+		code = "FAIL";
+		reason = "failed to write back storage cache";
+	}
 
 	snprintf((char *)response, LARGE_RSP_SIZE, "%s%s", code, reason);
 	fastboot_state = STATE_COMPLETE;
@@ -460,10 +508,14 @@ static void getvar_all(void)
 	fastboot_okay("");
 }
 
+static char staged_size[11];
+
 static void cmd_getvar(const char *arg, void *data, unsigned sz)
 {
 	struct fastboot_var *var;
 
+	snprintf(staged_size, sizeof(staged_size), "0x%x", download_size);
+
 #if CHECK_BAT_VOLTAGE
 	update_battery_status();
 #endif
@@ -484,10 +536,33 @@ static void cmd_getvar(const char *arg, void *data, unsigned sz)
 	fastboot_okay("");
 }
 
+/* Duration of the data phase of the last download & upload */
+static struct fastboot_xfer_stats last_xfer[2];
+
+/*
+ * Totals of all data phases (including the streaming threads) and of the
+ * time spent waiting for the next command from the host.
+ */
+static unsigned long long usb_data_bytes;
+static bigtime_t usb_data_usecs;
+static bigtime_t host_wait_usecs;
+
+static void fastboot_account_data(unsigned len, bigtime_t start)
+{
+	usb_data_bytes += len;
+	usb_data_usecs += current_time_hires() - start;
+}
+
+void fastboot_get_xfer_stats(int upload, struct fastboot_xfer_stats *stats)
+{
+	*stats = last_xfer[!!upload];
+}
+
 static void cmd_download(const char *arg, void *data, unsigned sz)
 {
 	STACKBUF_DMA_ALIGN(response, MAX_RSP_SIZE);
 	unsigned len = hex2unsigned(arg);
+	bigtime_t start;
 	int r;
 
 	download_size = 0;
@@ -504,29 +579,365 @@ static void cmd_download(const char *arg, void *data, unsigned sz)
 	 */
 	arch_invalidate_cache_range((addr_t) download_base, ROUNDUP(len, CACHE_LINE));
 
+	start = current_time_hires();
 	r = usb_if.usb_read(download_base, len);
 	if ((r < 0) || ((unsigned) r != len)) {
 		fastboot_state = STATE_ERROR;
 		return;
 	}
+	last_xfer[0].size = len;
+	last_xfer[0].usecs = current_time_hires() - start;
+	fastboot_account_data(len, start);
 	download_size = len;
 	fastboot_okay("");
 }
 
+/*
+ * "oem download-at:<offset>:<size>" (hex) receives a piece of the payload at
+ * an offset into the download buffer, so a large download can be resumed or
+ * assembled from several pieces without sending the rest again. A piece at
+ * offset 0 starts a new payload. The staged size (getvar staged-size) is the
+ * end of the last piece, so after a failed piece it is the offset to resume
+ * from. The host is responsible for filling any gaps between pieces.
+ */
+static void cmd_download_at(const char *arg, void *data, unsigned sz)
+{
+	STACKBUF_DMA_ALIGN(response, MAX_RSP_SIZE);
+	unsigned long offset, len;
+	bigtime_t start;
+	char *end;
+	int r;
+
+	offset = strtoul(arg, &end, 16);
+	if (*end != ':') {
+		fastboot_fail("usage: oem download-at:<offset>:<size>");
+		return;
+	}
+	len = strtoul(end + 1, &end, 16);
+	if (*end || !len) {
+		fastboot_fail("invalid size");
+		return;
+	}
+	if (offset > download_max || len > download_max - offset) {
+		fastboot_fail("data too large");
+		return;
+	}
+
+	/* Data that was staged behind the offset is overwritten */
+	if (!offset || download_size > offset)
+		download_size = offset;
+
+	snprintf((char *)response, MAX_RSP_SIZE, "DATA%08lx", len);
+	if (usb_if.usb_write(response, strlen((const char *)response)) < 0)
+		return;
+
+	/* The offset is not necessarily aligned to the cache lines */
+	arch_clean_invalidate_cache_range((addr_t) download_base + offset, len);
+
+	start = current_time_hires();
+	r = usb_if.usb_read((char *) download_base + offset, len);
+	if ((r < 0) || ((unsigned) r != len)) {
+		fastboot_state = STATE_ERROR;
+		return;
+	}
+	last_xfer[0].size = len;
+	last_xfer[0].usecs = current_time_hires() - start;
+	fastboot_account_data(len, start);
+	download_size = MAX(download_size, offset + len);
+	fastboot_okay("");
+}
+
+/*
+ * Streaming transfers use the two halves of the download buffer in turn: a
+ * separate thread transfers one half over usb while the command handler
+ * passes the other half to (or fills it from) the storage.
+ */
+#define STREAM_BUF_MAX	(16 * 1024 * 1024)
+/* Keep the pieces a multiple of the storage block size */
+#define STREAM_BUF_ALIGN	4096
+/* Don't let fastboot_stream_scratch() make the pieces too small */
+#define STREAM_BUF_MIN		(1024 * 1024)
+
+/* End of the download buffer reserved for the sink of the next stream */
+static unsigned stream_reserved;
+
+struct fastboot_stream {
+	void *buf[2];
+	unsigned len[2];
+	unsigned buf_size;
+	unsigned long long left;
+	bool error;
+	event_t full[2];
+	event_t empty[2];
+	event_t done;
+};
+
+static int fastboot_stream_reader(void *arg)
+{
+	struct fastboot_stream *s = arg;
+	bigtime_t start;
+	unsigned i = 0;
+	unsigned len;
+	int r;
+
+	while (s->left) {
+		event_wait(&s->empty[i]);
+
+		len = (s->left > s->buf_size) ? s->buf_size : (unsigned) s->left;
+		arch_invalidate_cache_range((addr_t) s->buf[i], ROUNDUP(len, CACHE_LINE));
+
+		start = current_time_hires();
+		r = usb_if.usb_read(s->buf[i], len);
+		if ((r < 0) || ((unsigned) r != len)) {
+			s->error = true;
+			event_signal(&s->full[i], false);
+			break;
+		}
+		fastboot_account_data(len, start);
+
+		s->len[i] = len;
+		s->left -= len;
+		event_signal(&s->full[i], false);
+		i ^= 1;
+	}
+
+	/* s is gone once this is signalled */
+	event_signal(&s->done, false);
+	return 0;
+}
+
+static int fastboot_stream_writer(void *arg)
+{
+	struct fastboot_stream *s = arg;
+	bigtime_t start;
+	unsigned i = 0;
+	int r;
+
+	while (s->left) {
+		event_wait(&s->full[i]);
+
+		start = current_time_hires();
+		r = usb_if.usb_write(s->buf[i], s->len[i]);
+		if ((r < 0) || ((unsigned) r != s->len[i])) {
+			s->error = true;
+			event_signal(&s->empty[0], false);
+			event_signal(&s->empty[1], false);
+			break;
+		}
+		fastboot_account_data(s->len[i], start);
+
+		s->left -= s->len[i];
+		event_signal(&s->empty[i], false);
+		i ^= 1;
+	}
+
+	/* s is gone once this is signalled */
+	event_signal(&s->done, false);
+	return 0;
+}
+
+/* Set up the buffers & send the DATA response, the thread runs afterwards */
+static int fastboot_stream_start(struct fastboot_stream *s, unsigned long long len,
+				 thread_start_routine func, const char *response)
+{
+	STACKBUF_DMA_ALIGN(buf, MAX_RSP_SIZE);
+	thread_t *thr;
+
+	/* The staged data is overwritten */
+	download_size = 0;
+
+	s->buf_size = ROUNDDOWN((download_max - stream_reserved) / 2, STREAM_BUF_ALIGN);
+	stream_reserved = 0;
+	if (s->buf_size > STREAM_BUF_MAX)
+		s->buf_size = STREAM_BUF_MAX;
+	s->buf[0] = download_base;
+	s->buf[1] = (char *) download_base + s->buf_size;
+	s->left = len;
+
+	if (!len || !s->buf_size) {
+		fastboot_fail("invalid stream size");
+		return -1;
+	}
+
+	event_init(&s->full[0], false, EVENT_FLAG_AUTOUNSIGNAL);
+	event_init(&s->full[1], false, EVENT_FLAG_AUTOUNSIGNAL);
+	event_init(&s->empty[0], true, EVENT_FLAG_AUTOUNSIGNAL);
+	event_init(&s->empty[1], true, EVENT_FLAG_AUTOUNSIGNAL);
+	event_init(&s->done, false, 0);
+
+	thr = thread_create("fastboot stream", func, s,
+			    DEFAULT_PRIORITY, DEFAULT_STACK_SIZE);
+	if (!thr) {
+		fastboot_fail("failed to create stream thread");
+		return -1;
+	}
+
+	strlcpy((char *)buf, response, MAX_RSP_SIZE);
+	if (usb_if.usb_write(buf, strlen((const char *)buf)) < 0) {
+		/* Let the thread exit without transferring anything */
+		s->left = 0;
+		thread_resume(thr);
+		event_wait(&s->done);
+		return -1;
+	}
+
+	stream_code[0] = 0;
+	fastboot_state = STATE_STREAM;
+	thread_resume(thr);
+	return 0;
+}
+
+/* Wait for the thread, then send the deferred response if there is one */
+static int fastboot_stream_finish(struct fastboot_stream *s, int ret)
+{
+	event_wait(&s->done);
+	event_destroy(&s->full[0]);
+	event_destroy(&s->full[1]);
+	event_destroy(&s->empty[0]);
+	event_destroy(&s->empty[1]);
+	event_destroy(&s->done);
+
+	if (s->error || fastboot_state == STATE_ERROR) {
+		fastboot_state = STATE_ERROR;
+		return -1;
+	}
+
+	fastboot_state = STATE_COMMAND;
+	if (stream_code[0]) {
+		/* The callback already responded, e.g. with a failure */
+		fastboot_ack(stream_code, stream_reason);
+		return ret ? ret : -1;
+	}
+
+	return ret;
+}
+
+/*
+ * Reserve size bytes at the end of the download buffer as work memory for the
+ * sink of the next fastboot_stream() in the current command. The streaming
+ * buffers get smaller instead, with the default size of the download buffer
+ * there is enough space left for them. Returns NULL if there is not.
+ */
+void *fastboot_stream_scratch(unsigned size)
+{
+	unsigned offset;
+
+	if (size > download_max)
+		return NULL;
+
+	offset = ROUNDDOWN(download_max - size, STREAM_BUF_ALIGN);
+	if (offset / 2 < STREAM_BUF_MIN)
+		return NULL;
+
+	stream_reserved = download_max - offset;
+	return (char *) download_base + offset;
+}
+
+/*
+ * Receive len bytes of data for the current command and pass them to the
+ * sink in pieces, overlapping usb transfers with the sink. The size of the
+ * data is not limited by the download buffer.
+ *
+ * The sink must not talk to the host: fastboot_fail() and fastboot_okay()
+ * are deferred until all data is received, fastboot_info() is dropped.
+ * Once the sink fails the remaining data is still received but discarded.
+ */
+int fastboot_stream(unsigned long long len, int (*sink)(void *priv, void *buf, unsigned len), void *priv)
+{
+	char response[MAX_RSP_SIZE];
+	struct fastboot_stream s = {0};
+	unsigned long long received = 0;
+	unsigned i = 0;
+	int ret = 0;
+
+	snprintf(response, MAX_RSP_SIZE, "DATA%016llx", len);
+	if (fastboot_stream_start(&s, len, fastboot_stream_reader, response))
+		return -1;
+
+	while (received < len) {
+		event_wait(&s.full[i]);
+		if (s.error)
+			break;
+
+		if (!ret)
+			ret = sink(priv, s.buf[i], s.len[i]);
+
+		received += s.len[i];
+		event_signal(&s.empty[i], false);
+		i ^= 1;
+	}
+
+	return fastboot_stream_finish(&s, ret);
+}
+
+/*
+ * Send len bytes of data to the host like fastboot_write_data(), but fill
+ * the buffers from the source in pieces while the previous one is sent.
+ *
+ * The same restrictions as for the sink of fastboot_stream() apply to the
+ * source. Once it fails zeros are sent for the rest of the data, followed
+ * by a failure. Responds with OKAY on success.
+ */
+int fastboot_write_stream(unsigned len, int (*source)(void *priv, void *buf, unsigned len), void *priv)
+{
+	char response[MAX_RSP_SIZE];
+	struct fastboot_stream s = {0};
+	unsigned filled = 0;
+	unsigned n, i = 0;
+	int ret = 0;
+
+	snprintf(response, MAX_RSP_SIZE, "DATA%08x", len);
+	if (fastboot_stream_start(&s, len, fastboot_stream_writer, response))
+		return -1;
+
+	while (filled < len) {
+		event_wait(&s.empty[i]);
+		if (s.error)
+			break;
+
+		n = MIN(len - filled, s.buf_size);
+		if (!ret)
+			ret = source(priv, s.buf[i], n);
+		/* The host expects the announced size */
+		if (ret)
+			memset(s.buf[i], 0, n);
+
+		s.len[i] = n;
+		filled += n;
+		event_signal(&s.full[i], false);
+		i ^= 1;
+	}
+
+	ret = fastboot_stream_finish(&s, ret);
+	if (fastboot_state != STATE_COMMAND)
+		return ret;
+
+	if (ret)
+		fastboot_fail("failed to read data");
+	else
+		fastboot_okay("");
+	return ret;
+}
+
 void fastboot_write_data(void *data, unsigned sz)
 {
 	STACKBUF_DMA_ALIGN(response, MAX_RSP_SIZE);
+	bigtime_t start;
 	int r;
 
 	snprintf((char *)response, MAX_RSP_SIZE, "DATA%08x", sz);
 	if (usb_if.usb_write(response, strlen((const char *)response)) < 0)
 		return;
 
+	start = current_time_hires();
 	r = usb_if.usb_write(data, sz);
 	if ((r < 0) || ((unsigned) r != sz)) {
 		fastboot_state = STATE_ERROR;
 		return;
 	}
+	last_xfer[1].size = sz;
+	last_xfer[1].usecs = current_time_hires() - start;
+	fastboot_account_data(sz, start);
 	fastboot_okay("");
 }
 
@@ -552,9 +963,73 @@ static void cmd_oem_help(const char *arg, void *data, unsigned sz)
 	fastboot_okay("");
 }
 
+/*
+ * "oem cmd-stats" shows how often each command was handled, the time spent
+ * in its handler and how much of that was spent on usb data transfers, then
+ * resets the counters. Flash commands count the staged data they were given
+ * if they did not receive any data themselves. The time in between commands
+ * is spent waiting for the host.
+ */
+static void cmd_oem_cmd_stats(const char *arg, void *data, unsigned sz)
+{
+	char response[MAX_RSP_SIZE];
+	struct fastboot_cmd *cmd;
+
+	snprintf(response, sizeof(response), "host wait: %llu ms",
+		 host_wait_usecs / 1000);
+	fastboot_info(response);
+
+	for (cmd = cmdlist; cmd; cmd = cmd->next) {
+		if (!cmd->calls)
+			continue;
+
+		snprintf(response, sizeof(response), "%s: %ux, %llu ms, max %llu ms",
+			 cmd->prefix, cmd->calls, cmd->total_usecs / 1000,
+			 cmd->max_usecs / 1000);
+		fastboot_info(response);
+		if (cmd->bytes) {
+			snprintf(response, sizeof(response),
+				 "  %llu KiB, usb %llu ms, other %llu ms",
+				 cmd->bytes / 1024, cmd->usb_usecs / 1000,
+				 (cmd->total_usecs - cmd->usb_usecs) / 1000);
+			fastboot_info(response);
+		}
+
+		cmd->calls = 0;
+		cmd->total_usecs = cmd->max_usecs = cmd->usb_usecs = 0;
+		cmd->bytes = 0;
+	}
+	host_wait_usecs = 0;
+	fastboot_okay("");
+}
+
+static void fastboot_handle_command(struct fastboot_cmd *cmd, const char *arg)
+{
+	unsigned long long bytes = usb_data_bytes;
+	bigtime_t usb_usecs = usb_data_usecs;
+	bigtime_t start = current_time_hires();
+	unsigned sz = download_size;
+	bigtime_t usecs;
+
+	cmd->handle(arg, download_base, sz);
+
+	usecs = current_time_hires() - start;
+	bytes = usb_data_bytes - bytes;
+	if (!bytes && !strncmp(cmd->prefix, "flash", 5))
+		bytes = sz;
+
+	cmd->calls++;
+	cmd->total_usecs += usecs;
+	if (usecs > cmd->max_usecs)
+		cmd->max_usecs = usecs;
+	cmd->usb_usecs += usb_data_usecs - usb_usecs;
+	cmd->bytes += bytes;
+}
+
 static void fastboot_command_loop(void)
 {
 	struct fastboot_cmd *cmd;
+	bigtime_t start;
 	int r;
 #if CHECK_BAT_VOLTAGE
 	boolean is_first_erase_flash = false;
@@ -578,8 +1053,10 @@ again:
 		memset(buffer, 0, MAX_RSP_SIZE);
 		arch_clean_invalidate_cache_range((addr_t) buffer, MAX_RSP_SIZE);
 
+		start = current_time_hires();
 		r = usb_if.usb_read(buffer, MAX_RSP_SIZE);
 		if (r < 0) break;
+		host_wait_usecs += current_time_hires() - start;
 		buffer[r] = 0;
 		dprintf(INFO,"fastboot: %s\n", buffer);
 
@@ -621,9 +1098,10 @@ again:
 			else if (arg[0] && arg[-1] != ':')
 				continue;
 
-			cmd->handle(arg, download_base, download_size);
+			fastboot_handle_command(cmd, arg);
 			if (fastboot_state == STATE_COMMAND)
 				fastboot_fail("unknown reason");
+			ack_sync = NULL;
 
 #if CHECK_BAT_VOLTAGE
 			if (!strncmp((const char*) buffer, "erase", 5) ||
@@ -647,10 +1125,15 @@ again:
 	free(buffer);
 }
 
+static event_t fastboot_ready;
+static bool usb_started;
+
 static int fastboot_handler(void *arg)
 {
 	for (;;) {
 		event_wait(&usb_online);
+		/* Commands are only handled once fastboot mode is entered */
+		event_wait(&fastboot_ready);
 		fastboot_command_loop();
 	}
 	return 0;
@@ -663,17 +1146,11 @@ static void fastboot_notify(struct udc_gadget *gadget, unsigned event)
 	}
 }
 
-int fastboot_init(void *base, unsigned size)
+/* Bring up USB and the fastboot gadget, commands stay blocked until ready */
+static int fastboot_usb_init(void)
 {
-	char sn_buf[13];
+	static char sn_buf[13];
 	thread_t *thr;
-	dprintf(INFO, "fastboot_init()\n");
-
-	download_base = base;
-	download_max = size;
-
-	/* target specific initialization before going into fastboot. */
-	target_fastboot_init();
 
 	/* setup serialno */
 	target_serialno((unsigned char *) sn_buf);
@@ -723,6 +1200,7 @@ int fastboot_init(void *base, unsigned size)
 
 	event_init(&usb_online, 0, EVENT_FLAG_AUTOUNSIGNAL);
 	event_init(&txn_done, 0, EVENT_FLAG_AUTOUNSIGNAL);
+	event_init(&fastboot_ready, 0, 0);
 
 	in = usb_if.udc_endpoint_alloc(UDC_TYPE_BULK_IN, 512);
 	if (!in)
@@ -742,14 +1220,6 @@ int fastboot_init(void *base, unsigned size)
 	if (usb_if.udc_register_gadget(&fastboot_gadget))
 		goto fail_udc_register;
 
-	if (IS_ENABLED(FASTBOOT_HELP))
-		fastboot_register("oem help", cmd_oem_help);
-
-	fastboot_register("getvar:", cmd_getvar);
-	fastboot_register("download:", cmd_download);
-	fastboot_register("upload", cmd_upload);
-	fastboot_publish("version", "0.5");
-
 	thr = thread_create("fastboot", fastboot_handler, 0, DEFAULT_PRIORITY, DEFAULT_STACK_SIZE);
 	if (!thr)
 	{
@@ -758,6 +1228,7 @@ int fastboot_init(void *base, unsigned size)
 	thread_resume(thr);
 
 	usb_if.udc_start();
+	usb_started = true;
 
 	return 0;
 
@@ -771,7 +1242,86 @@ fail_alloc_in:
 	return -1;
 }
 
+#if LK2ND_FASTBOOT_EARLY
+static event_t early_done;
+static bool early_pending;
+
+static int fastboot_early_thread(void *arg)
+{
+	if (fastboot_usb_init())
+		dprintf(CRITICAL, "Failed to start fastboot USB gadget early\n");
+	event_signal(&early_done, false);
+	return 0;
+}
+
+/*
+ * Enumerate on USB while the rest of lk2nd is still starting, so that
+ * entering fastboot mode later does not have to wait for the host. The
+ * device shows up in "fastboot devices" right away, commands are blocked
+ * until fastboot_init() is called.
+ */
+static void fastboot_init_early(void)
+{
+	thread_t *thr;
+
+	event_init(&early_done, 0, 0);
+	thr = thread_create("fastboot-early", fastboot_early_thread, NULL,
+			    DEFAULT_PRIORITY, DEFAULT_STACK_SIZE);
+	if (!thr)
+		return;
+
+	early_pending = true;
+	thread_resume(thr);
+}
+LK2ND_INIT(fastboot_init_early);
+
+static void fastboot_early_wait(void)
+{
+	if (!early_pending)
+		return;
+
+	event_wait(&early_done);
+	early_pending = false;
+}
+#else
+static inline void fastboot_early_wait(void) { }
+#endif
+
+int fastboot_init(void *base, unsigned size)
+{
+	dprintf(INFO, "fastboot_init()\n");
+
+	download_base = base;
+	download_max = size;
+
+	/* target specific initialization before going into fastboot. */
+	target_fastboot_init();
+
+	fastboot_early_wait();
+	if (!usb_started && fastboot_usb_init())
+		return -1;
+
+	if (IS_ENABLED(FASTBOOT_HELP))
+		fastboot_register("oem help", cmd_oem_help);
+
+	fastboot_register("getvar:", cmd_getvar);
+	fastboot_register("download:", cmd_download);
+	fastboot_register("upload", cmd_upload);
+	fastboot_register("oem download-at:", cmd_download_at);
+	fastboot_register("oem cmd-stats", cmd_oem_cmd_stats);
+	fastboot_publish("version", "0.5");
+	fastboot_publish("staged-size", staged_size);
+
+	event_signal(&fastboot_ready, true);
+	return 0;
+}
+
 void fastboot_stop(void)
 {
+	fastboot_early_wait();
+	if (!usb_started)
+		return;
+
 	usb_if.udc_stop();
+	usb_started = false;
 }
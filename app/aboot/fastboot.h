@@ -54,8 +54,32 @@ void fastboot_okay(const char *result);
 void fastboot_fail(const char *reason);
 void fastboot_info(const char *reason);
 void fastboot_stage(const void *data, unsigned sz);
+/* call sync() right before responding, the command fails if sync() fails */
+void fastboot_set_sync(int (*sync)(void));
 void fastboot_write_data(void *data, unsigned sz);
 
+/* receive data of any size for the current command, with double buffering
+ * - the sink is called for each piece of data as it arrives
+ * - the sink must not respond, fastboot_okay()/fastboot_fail() are deferred
+ */
+int fastboot_stream(unsigned long long len, int (*sink)(void *priv, void *buf, unsigned len), void *priv);
+
+/* work memory for the sink of the next fastboot_stream(), NULL if too large */
+void *fastboot_stream_scratch(unsigned size);
+
+/* send data to the host like fastboot_write_data(), with double buffering
+ * - the source is called to fill each piece of data before it is sent
+ * - the same restrictions as for fastboot_stream() apply to the source
+ */
+int fastboot_write_stream(unsigned len, int (*source)(void *priv, void *buf, unsigned len), void *priv);
+
+/* duration of the data phase of the last download or upload */
+struct fastboot_xfer_stats {
+	unsigned size;
+	unsigned long long usecs;
+};
+void fastboot_get_xfer_stats(int upload, struct fastboot_xfer_stats *stats);
+
 static inline void fastboot_register_commands(void)
 {
 	extern void (*__fastboot_init_start)(void);
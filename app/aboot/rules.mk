@@ -4,7 +4,7 @@ INCLUDES += -I$(LK_TOP_DIR)/platform/msm_shared/include -I$(LK_TOP_DIR)/lib/zlib
 
 DEFINES += ASSERT_ON_TAMPER=1
 
-MODULES += lib/zlib_inflate
+MODULES += lib/zlib_inflate lib/lz4
 
 OBJS += \
 	$(LOCAL_DIR)/aboot.o \
@@ -36,6 +36,7 @@ static uint8_t *dst2;
 #define BUFFER_SIZE (1024*1024)
 #define ITERATIONS 16
 
+/* integer only versions, to compare against the NEON libc routines */
 extern void *mymemcpy(void *dst, const void *src, size_t len);
 extern void *mymemset(void *dst, int c, size_t len);
 
@@ -88,6 +89,36 @@ static void bench_memcpy(void)
 	}
 }
 
+static time_t bench_memmove_routine(void *memmove_routine(void *, const void *, size_t), size_t distance)
+{
+	int i;
+	time_t t0;
+
+	t0 = current_time();
+	for (i=0; i < ITERATIONS; i++) {
+		memmove_routine(src + distance, src, BUFFER_SIZE);
+	}
+	return current_time() - t0;
+}
+
+static void bench_memmove(void)
+{
+	time_t libc, mine;
+	size_t distance;
+
+	printf("memmove (backwards overlap) speed test\n");
+	thread_sleep(200); // let the debug string clear the serial port
+
+	for (distance = 1; distance <= 256; distance <<= 2) {
+		libc = bench_memmove_routine(&memmove, distance);
+		mine = bench_memmove_routine(&mymemcpy, distance);
+
+		printf("distance %lu\n", distance);
+		printf("   libc memmove %u msecs, %llu bytes/sec\n", libc, BUFFER_SIZE * ITERATIONS * 1000ULL / libc);
+		printf("   my   memmove %u msecs, %llu bytes/sec\n", mine, BUFFER_SIZE * ITERATIONS * 1000ULL / mine);
+	}
+}
+
 static void fillbuf(void *ptr, size_t len, uint32_t seed)
 {
 	size_t i;
@@ -260,6 +291,8 @@ usage:
 			bench_memcpy();
 		} else if (!strcmp(argv[2].str, "memset")) {
 			bench_memset();
+		} else if (!strcmp(argv[2].str, "memmove")) {
+			bench_memmove();
 		}
 	} else {
 		goto usage;
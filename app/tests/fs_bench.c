@@ -0,0 +1,227 @@
+// SPDX-License-Identifier: BSD-3-Clause
+
+#include <debug.h>
+#include <err.h>
+#include <platform.h>
+#include <printf.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * fs_bench.c - Repeatable benchmark for lib/fs and lib/bcache.
+ *
+ * Mounts a file system (e.g. an ext2 image passed to the emulator as its
+ * block device) and measures file loads, path lookups, the block cache hit
+ * rate, inflate and heap churn. Runs with a fixed seed and iteration
+ * counts, so the results can be compared between builds without hardware.
+ * Each result is printed as a "bench: <name> <value> <unit>" line.
+ *
+ * With the armemu-test project the image is exposed as "block0", e.g.
+ * "fs_bench block0 /boot/vmlinuz /boot/initramfs.gz".
+ */
+
+#if WITH_LIB_CONSOLE && WITH_LIB_FS && WITH_LIB_BCACHE
+#include <lib/bcache.h>
+#include <lib/console.h>
+#include <lib/fs.h>
+
+#if WITH_LIB_ZLIB_INFLATE
+#include <decompress.h>
+#endif
+
+#define FS_BENCH_MOUNT		"/bench"
+#define FS_BENCH_CHUNK		(64 * 1024)
+#define FS_BENCH_LOOKUPS	256
+#define FS_BENCH_HEAP_OPS	4096
+#define FS_BENCH_HEAP_SLOTS	64
+#define FS_BENCH_HEAP_MAX	(16 * 1024)
+#define FS_BENCH_INFLATE_MAX	(256 * 1024)
+
+static void fs_bench_result(const char *name, const char *path, uint64_t val,
+			    const char *unit)
+{
+	printf("bench: %s%s%s %llu %s\n", name, path ? ":" : "", path ? path : "",
+	       val, unit);
+}
+
+static uint64_t fs_bench_kibps(uint64_t bytes, bigtime_t usecs)
+{
+	return usecs ? bytes * 1000000 / 1024 / usecs : 0;
+}
+
+/* Read the whole file in chunks, return the time in us or a negative error */
+static int64_t fs_bench_read(const char *path, void *buf, off_t *size)
+{
+	struct file_stat stat;
+	filehandle *file;
+	bigtime_t start;
+	off_t offset;
+	ssize_t ret;
+	size_t len;
+
+	start = current_time_hires();
+	ret = fs_open_file(path, &file);
+	if (ret < 0)
+		return ret;
+
+	ret = fs_stat_file(file, &stat);
+	if (ret < 0 || stat.is_dir) {
+		fs_close_file(file);
+		return ret < 0 ? ret : ERR_NOT_FILE;
+	}
+
+	for (offset = 0; offset < stat.size; offset += len) {
+		len = MIN((uint64_t)FS_BENCH_CHUNK, (uint64_t)(stat.size - offset));
+		ret = fs_read_file(file, buf, offset, len);
+		if (ret != (ssize_t)len) {
+			fs_close_file(file);
+			return ret < 0 ? ret : ERR_IO;
+		}
+	}
+
+	fs_close_file(file);
+	*size = stat.size;
+	return current_time_hires() - start;
+}
+
+static void fs_bench_file(const char *path, void *buf)
+{
+	struct bcache_stats before, after;
+	uint32_t finds;
+	bigtime_t start;
+	filehandle *file;
+	int64_t t;
+	off_t size;
+	int i;
+
+	/* First read mostly misses the block cache, the second one hits it */
+	bcache_get_stats(&before);
+	t = fs_bench_read(path, buf, &size);
+	if (t < 0) {
+		printf("fs_bench: failed to read %s: %lld\n", path, t);
+		return;
+	}
+	fs_bench_result("load-cold", path, fs_bench_kibps(size, t), "KiB/s");
+
+	t = fs_bench_read(path, buf, &size);
+	bcache_get_stats(&after);
+	if (t >= 0)
+		fs_bench_result("load-warm", path, fs_bench_kibps(size, t), "KiB/s");
+
+	finds = (after.hits - before.hits) + (after.misses - before.misses);
+	fs_bench_result("bcache-hits", path,
+			finds ? (uint64_t)(after.hits - before.hits) * 100 / finds : 0, "%");
+	fs_bench_result("bcache-reads", path, after.reads - before.reads, "blocks");
+
+	/* Path lookups, with metadata in the block cache after the loads */
+	start = current_time_hires();
+	for (i = 0; i < FS_BENCH_LOOKUPS; i++) {
+		if (fs_open_file(path, &file) < 0)
+			break;
+		fs_close_file(file);
+	}
+	t = current_time_hires() - start;
+	fs_bench_result("lookup", path, t * 1000 / FS_BENCH_LOOKUPS, "ns/op");
+}
+
+#if WITH_LIB_ZLIB_INFLATE
+static void fs_bench_inflate(const char *path)
+{
+	unsigned int pos = 0, out_len = 0;
+	unsigned char *in, *out;
+	bigtime_t start, t;
+	ssize_t len;
+
+	in = malloc(FS_BENCH_INFLATE_MAX);
+	out = malloc(FS_BENCH_INFLATE_MAX * 4);
+	if (!in || !out)
+		goto out;
+
+	len = fs_load_file(path, in, FS_BENCH_INFLATE_MAX);
+	if (len <= 0 || !is_gzip_package(in, len))
+		goto out;
+
+	start = current_time_hires();
+	if (decompress(in, len, out, FS_BENCH_INFLATE_MAX * 4, &pos, &out_len)) {
+		printf("fs_bench: failed to decompress %s\n", path);
+		goto out;
+	}
+	t = current_time_hires() - start;
+	fs_bench_result("inflate", path, fs_bench_kibps(out_len, t), "KiB/s");
+
+out:
+	free(in);
+	free(out);
+}
+#else
+static void fs_bench_inflate(const char *path) { }
+#endif
+
+/* Allocate and free blocks of random sizes in a fixed pattern */
+static void fs_bench_heap(void)
+{
+	void *slots[FS_BENCH_HEAP_SLOTS] = {0};
+	uint32_t seed = 1;
+	bigtime_t start, t;
+	unsigned int i, n;
+
+	start = current_time_hires();
+	for (i = 0; i < FS_BENCH_HEAP_OPS; i++) {
+		seed = seed * 1103515245 + 12345;
+		n = (seed >> 16) % FS_BENCH_HEAP_SLOTS;
+
+		free(slots[n]);
+		slots[n] = malloc((seed >> 4) % FS_BENCH_HEAP_MAX + 1);
+	}
+	for (i = 0; i < FS_BENCH_HEAP_SLOTS; i++)
+		free(slots[i]);
+	t = current_time_hires() - start;
+
+	fs_bench_result("heap-churn", NULL, t * 1000 / FS_BENCH_HEAP_OPS, "ns/op");
+}
+
+/* fs_bench <bdev> [<fs type>] <path>... (relative to the mount point) */
+static int cmd_fs_bench(int argc, const cmd_args *argv)
+{
+	char path[128];
+	const char *type = "ext2";
+	void *buf;
+	int i = 2;
+	status_t ret;
+
+	if (argc < 3) {
+		printf("usage: %s <bdev> [<fs type>] <path>...\n", argv[0].str);
+		return ERR_INVALID_ARGS;
+	}
+	if (argv[2].str[0] != '/') {
+		type = argv[2].str;
+		i++;
+	}
+
+	buf = malloc(FS_BENCH_CHUNK);
+	if (!buf)
+		return ERR_NO_MEMORY;
+
+	ret = fs_mount(FS_BENCH_MOUNT, type, argv[1].str);
+	if (ret < 0) {
+		printf("fs_bench: failed to mount %s (%s): %d\n", argv[1].str, type, ret);
+		free(buf);
+		return ret;
+	}
+
+	for (; i < argc; i++) {
+		snprintf(path, sizeof(path), FS_BENCH_MOUNT "%s", argv[i].str);
+		fs_bench_file(path, buf);
+		fs_bench_inflate(path);
+	}
+	fs_bench_heap();
+
+	fs_unmount(FS_BENCH_MOUNT);
+	free(buf);
+	return 0;
+}
+
+STATIC_COMMAND_START
+	{ "fs_bench", "benchmark lib/fs and lib/bcache", &cmd_fs_bench },
+STATIC_COMMAND_END(fs_bench);
+#endif
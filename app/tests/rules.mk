@@ -6,7 +6,8 @@ OBJS += \
 	$(LOCAL_DIR)/tests.o \
 	$(LOCAL_DIR)/thread_tests.o \
 	$(LOCAL_DIR)/spi_test.o \
-	$(LOCAL_DIR)/printf_tests.o
+	$(LOCAL_DIR)/printf_tests.o \
+	$(LOCAL_DIR)/fs_bench.o
 
 ifeq ($(VERIFIED_BOOT),1)
 OBJS += \
@@ -41,3 +41,53 @@
 
 	arch_clean_invalidate_cache_range(actual_start, actual_size);
  }
+
+#define CACHE_BATCH_MAX	8
+
+static struct {
+	addr_t start;
+	size_t len;
+} cache_batch[CACHE_BATCH_MAX];
+static unsigned cache_batch_count;
+static size_t cache_batch_size;
+
+/*
+ * Queue a range for clean & invalidate instead of doing it right away.
+ * Meant for the large buffers prepared for the next boot stage, which are
+ * handed over together by arch_cache_batch_flush(). Not thread safe.
+ */
+void arch_cache_batch_add(addr_t start, size_t len)
+{
+	if (cache_batch_count == CACHE_BATCH_MAX)
+		arch_cache_batch_flush();
+
+	cache_batch[cache_batch_count].start = start;
+	cache_batch[cache_batch_count].len = len;
+	cache_batch_count++;
+	cache_batch_size += len;
+}
+
+void arch_cache_batch_flush(void)
+{
+	unsigned i;
+
+#if ARM_CPU_CORTEX_A8
+	/* One set/way pass instead of several that each stay below the threshold */
+	if (cache_batch_size >= CACHE_SETWAY_THRESHOLD) {
+		arch_clean_invalidate_cache_all();
+		arch_cache_batch_discard();
+		return;
+	}
+#endif
+
+	for (i = 0; i < cache_batch_count; i++)
+		arch_clean_invalidate_cache_range(cache_batch[i].start, cache_batch[i].len);
+	arch_cache_batch_discard();
+}
+
+/* Drop the queued ranges, e.g. when the whole cache is cleaned anyway */
+void arch_cache_batch_discard(void)
+{
+	cache_batch_count = 0;
+	cache_batch_size = 0;
+}
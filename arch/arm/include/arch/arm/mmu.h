@@ -45,6 +45,8 @@ void arm_mmu_init(void);
 #define MMU_MEMORY_TYPE_NORMAL_WRITE_THROUGH          ((0x0 << 12) | (0x2 << 2))
 #define MMU_MEMORY_TYPE_NORMAL_WRITE_BACK_NO_ALLOCATE ((0x0 << 12) | (0x3 << 2))
 #define MMU_MEMORY_TYPE_NORMAL_WRITE_BACK_ALLOCATE    ((0x1 << 12) | (0x3 << 2))
+/* Normal non-cacheable: stores are merged in the write buffer, not cached */
+#define MMU_MEMORY_TYPE_NORMAL_WRITE_COMBINE          MMU_MEMORY_TYPE_NORMAL
 
 #define MMU_MEMORY_AP_NO_ACCESS     (0x0 << 10)
 #define MMU_MEMORY_AP_READ_ONLY     (0x7 << 10)
@@ -88,6 +90,7 @@ typedef enum
 #define MMU_MEMORY_TYPE_NORMAL_WRITE_THROUGH           ATTR_INDEX(7)
 #define MMU_MEMORY_TYPE_NORMAL_WRITE_BACK_ALLOCATE     ATTR_INDEX(4)
 #define MMU_MEMORY_TYPE_NORMAL_WRITE_BACK_NO_ALLOCATE  ATTR_INDEX(5)
+#define MMU_MEMORY_TYPE_NORMAL_WRITE_COMBINE           MMU_MEMORY_TYPE_NORMAL
 
 #define MMU_MEMORY_AP_READ_WRITE                       (1 << 6) /* Read/Write at any priveledge */
 #define MMU_MEMORY_AP_READ_ONLY                        (0x3 << 6) /* Read only priveledge */
@@ -123,8 +126,20 @@ void arm_mmu_map_entry(mmu_section_t *entry);
 
 #endif
 
+#ifdef LPAE
+/* The execute-never bits of the long descriptors are in the upper word */
+typedef uint64_t arm_mmu_flags_t;
+#else
+typedef uint arm_mmu_flags_t;
+#endif
+
 void arm_mmu_map_section(addr_t paddr, addr_t vaddr, uint flags);
-bool arm_mmu_try_map_sections(addr_t paddr, addr_t vaddr, uint size, uint flags);
+bool arm_mmu_try_map_sections(addr_t paddr, addr_t vaddr, uint size, arm_mmu_flags_t flags);
+void arm_mmu_map_free_sections(addr_t paddr, addr_t vaddr, uint size, arm_mmu_flags_t flags);
+bool arm_mmu_remap_sections(addr_t vaddr, uint size, arm_mmu_flags_t flags);
+bool arm_mmu_remap_pages(addr_t vaddr, uint size, uint flags);
+uint32_t arm_mmu_get_section_desc(addr_t vaddr);
+void arm_mmu_set_section_desc(addr_t vaddr, uint32_t desc);
 void arm_mmu_flush(void);
 uint64_t virtual_to_physical_mapping(uint32_t vaddr);
 uint32_t physical_to_virtual_mapping(uint64_t paddr);
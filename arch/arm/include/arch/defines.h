@@ -42,6 +42,15 @@
  #error unknown cpu
 #endif
 
+/*
+ * Range cache maintenance above this size is done on the whole cache by
+ * set/way instead, which is much faster than walking a multi-MiB range
+ * line by line once the range is larger than the caches.
+ */
+#ifndef CACHE_SETWAY_THRESHOLD
+#define CACHE_SETWAY_THRESHOLD (4 * 1024 * 1024)
+#endif
+
 #define IS_CACHE_LINE_ALIGNED(addr)  !((uint32_t) (addr) & (CACHE_LINE - 1))
 
 #if ARM_ISA_ARMV7
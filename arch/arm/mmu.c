@@ -29,10 +29,12 @@
 #include <arch/ops.h>
 #include <arch/arm/mmu.h>
 #include <platform.h>
+#include <stdlib.h>
 
 #if ARM_WITH_MMU
 
 #define MB (1024*1024)
+#define SUPERSECTION (16*MB)
 
 /* the location of the table may be brought in from outside */
 #if WITH_EXTERNAL_TRANSLATION_TABLE
@@ -45,6 +47,15 @@ static uint32_t *tt = (void *)MMU_TRANSLATION_TABLE_ADDR;
 static uint32_t tt[4096] __ALIGNED(16384);
 #endif
 
+/* page tables for sections that are split into 4 KiB pages */
+#ifndef ARM_MMU_PAGE_TABLES
+#define ARM_MMU_PAGE_TABLES 2
+#endif
+#define PAGES_PER_MB (MB / PAGE_SIZE)
+
+static uint32_t pt[ARM_MMU_PAGE_TABLES][PAGES_PER_MB] __ALIGNED(1024);
+static uint32_t pt_section[ARM_MMU_PAGE_TABLES];
+
 static inline uint32_t arm_mmu_section_desc(addr_t paddr, uint flags)
 {
 	/*
@@ -55,6 +66,73 @@ static inline uint32_t arm_mmu_section_desc(addr_t paddr, uint flags)
 	return (paddr & ~(MB-1)) | (0<<5) | (2<<0) | flags;
 }
 
+static inline uint32_t arm_mmu_supersection_desc(addr_t paddr, uint flags)
+{
+	/*
+	 * (1<<18): Supersection, repeated in 16 consecutive entries
+	 * (0<<5): Extended base address = 0
+	 *  flags: Same TEX, CB and AP bit settings as for sections.
+	 */
+	return (paddr & ~(SUPERSECTION-1)) | (1<<18) | (0<<5) | (2<<0) | flags;
+}
+
+static inline bool arm_mmu_is_supersection(uint32_t desc)
+{
+	return (desc & 3) == 2 && (desc & (1<<18));
+}
+
+static bool arm_mmu_has_supersections(void)
+{
+	uint32_t mmfr3;
+
+	/* ID_MMFR3.Supersec: 0 = supported, 0xf = not supported */
+	__asm__ volatile("mrc	p15, 0, %0, c0, c1, 7" : "=r" (mmfr3));
+	return (mmfr3 >> 28) != 0xf;
+}
+
+/* Replace the supersection around index with the equivalent 16 sections */
+static void arm_mmu_split_supersection(uint index)
+{
+	uint i, first = index & ~(SUPERSECTION/MB - 1);
+	uint32_t desc = tt[first];
+
+	if (!arm_mmu_is_supersection(desc))
+		return;
+
+	/* Keep the TEX, CB, AP, XN, S, nG and NS bits */
+	for (i = 0; i < SUPERSECTION/MB; i++)
+		tt[first + i] = (desc & ~(SUPERSECTION-1)) + i * MB + (2<<0) +
+				(desc & 0x000bfe1c);
+}
+
+/* Add mappings for all entries in the range that are not mapped yet */
+static void arm_mmu_fill_sections(addr_t paddr, uint index, uint mb, uint flags)
+{
+	uint i, j, n;
+
+	paddr &= ~(MB-1);
+	for (i = 0; i < mb; i += n) {
+		n = 1;
+
+		/* Use a supersection if a whole aligned 16 MiB block is free */
+		if ((paddr + i * MB) % SUPERSECTION == 0 &&
+		    (index + i) % (SUPERSECTION/MB) == 0 &&
+		    mb - i >= SUPERSECTION/MB && arm_mmu_has_supersections()) {
+			for (j = 0; j < SUPERSECTION/MB && !tt[index + i + j]; j++)
+				;
+			if (j == SUPERSECTION/MB) {
+				n = j;
+				for (j = 0; j < n; j++)
+					tt[index + i + j] = arm_mmu_supersection_desc(paddr + i * MB, flags);
+				continue;
+			}
+		}
+
+		if (!tt[index + i])
+			tt[index + i] = arm_mmu_section_desc(paddr + i * MB, flags);
+	}
+}
+
 void arm_mmu_map_section(addr_t paddr, addr_t vaddr, uint flags)
 {
 	int index;
@@ -62,12 +140,34 @@ void arm_mmu_map_section(addr_t paddr, addr_t vaddr, uint flags)
 	/* Get the index into the translation table */
 	index = vaddr / MB;
 
+	/* Supersections must not be modified partially */
+	arm_mmu_split_supersection(index);
+
 	/* Set the entry value */
 	tt[index] = arm_mmu_section_desc(paddr, flags);
 
 	arm_invalidate_tlb();
 }
 
+/*
+ * Get the section descriptor for vaddr, to temporarily change its mapping
+ * and restore it later with arm_mmu_set_section_desc(). Supersections are
+ * split first so the descriptor is only valid for this section.
+ */
+uint32_t arm_mmu_get_section_desc(addr_t vaddr)
+{
+	int index = vaddr / MB;
+
+	arm_mmu_split_supersection(index);
+	return tt[index];
+}
+
+void arm_mmu_set_section_desc(addr_t vaddr, uint32_t desc)
+{
+	tt[vaddr / MB] = desc;
+	arm_invalidate_tlb();
+}
+
 void arm_mmu_init(void)
 {
 	int i;
@@ -127,11 +227,15 @@ bool arm_mmu_try_map_sections(addr_t paddr, addr_t vaddr, uint size, uint flags)
 
 	/* Check if any existing mappings conflict */
 	for (i = 0; i < mb; ++i) {
-		uint32_t desc = arm_mmu_section_desc(paddr + i * MB, flags);
+		uint32_t desc;
 		if (!tt[index + i]) {
 			fully_mapped = false;
 			continue;
 		}
+		if (arm_mmu_is_supersection(tt[index + i]))
+			desc = arm_mmu_supersection_desc(paddr + i * MB, flags);
+		else
+			desc = arm_mmu_section_desc(paddr + i * MB, flags);
 		if (tt[index + i] != desc) {
 			dprintf(CRITICAL, "MMU mapping mismatch @ %#08x: %#08x != %#08x\n",
 				(index + i) * MB, tt[index + i], desc);
@@ -142,9 +246,130 @@ bool arm_mmu_try_map_sections(addr_t paddr, addr_t vaddr, uint size, uint flags)
 		return true;
 
 	/* Add the new mappings */
+	arm_mmu_fill_sections(paddr, index, mb, flags);
+	arm_mmu_flush();
+	return true;
+}
+
+void arm_mmu_map_free_sections(addr_t paddr, addr_t vaddr, uint size, uint flags)
+{
+	uint mb = (size + (paddr % MB) + MB - 1) / MB;
+
+	if (size == 0 || (paddr % MB) != (vaddr % MB))
+		return;
+
+	arm_mmu_fill_sections(paddr, vaddr / MB, mb, flags);
+	arm_mmu_flush();
+}
+
+/* Convert the TEX, CB, AP, APX, S, nG and XN bits of a section to a small page */
+static uint32_t arm_mmu_page_flags(uint32_t flags)
+{
+	return (flags & (3<<2)) |
+	       (((flags >> 12) & 7) << 6) |
+	       (((flags >> 10) & 3) << 4) |
+	       (((flags >> 15) & 1) << 9) |
+	       (((flags >> 16) & 3) << 10) |
+	       ((flags >> 4) & 1);
+}
+
+/* Get the page table for a section, split it with the same mapping if needed */
+static uint32_t *arm_mmu_page_table(uint index)
+{
+	uint32_t desc;
+	uint i, j;
+
+	if ((tt[index] & 3) == 1) {
+		for (i = 0; i < ARM_MMU_PAGE_TABLES; i++)
+			if ((tt[index] & ~0x3ff) == (uint32_t)pt[i])
+				return pt[i];
+		return NULL;
+	}
+	if ((tt[index] & 3) != 2)
+		return NULL;
+
+	for (i = 0; i < ARM_MMU_PAGE_TABLES && pt_section[i]; i++)
+		;
+	if (i == ARM_MMU_PAGE_TABLES) {
+		dprintf(CRITICAL, "No free page table for %#08x\n", index * MB);
+		return NULL;
+	}
+
+	arm_mmu_split_supersection(index);
+	desc = tt[index];
+	for (j = 0; j < PAGES_PER_MB; j++)
+		pt[i][j] = ((desc & ~(MB-1)) + j * PAGE_SIZE) |
+			   arm_mmu_page_flags(desc) | (1<<1);
+	pt_section[i] = desc;
+	arch_clean_cache_range((addr_t)pt[i], sizeof(pt[i]));
+
+	/* (1<<0): Page table, domain 0 */
+	tt[index] = (uint32_t)pt[i] | (1<<0);
+	return pt[i];
+}
+
+/*
+ * Change the memory type of single 4 KiB pages within existing section
+ * mappings, keeping their physical address. Their sections are split into
+ * page tables first, which are only available for a few sections, so this
+ * is meant for small regions that are never unmapped (e.g. buffers for DMA).
+ * The caches are maintained as for arm_mmu_remap_sections().
+ */
+bool arm_mmu_remap_pages(addr_t vaddr, uint size, uint flags)
+{
+	addr_t start = ROUNDDOWN(vaddr, PAGE_SIZE);
+	addr_t end = ROUNDUP(vaddr + size, PAGE_SIZE);
+	uint32_t *table;
+	addr_t addr;
+
+	if (size == 0)
+		return false;
+
+	for (addr = start; addr < end; addr = ROUNDDOWN(addr, MB) + MB)
+		if (!arm_mmu_page_table(addr / MB))
+			return false;
+
+	arch_clean_invalidate_cache_range(start, end - start);
+	for (addr = start; addr < end; addr += PAGE_SIZE) {
+		uint32_t *pte = &arm_mmu_page_table(addr / MB)[(addr % MB) / PAGE_SIZE];
+
+		*pte = (*pte & ~(PAGE_SIZE-1)) | arm_mmu_page_flags(flags) | (1<<1);
+	}
+	for (addr = start; addr < end; addr = ROUNDDOWN(addr, MB) + MB) {
+		table = arm_mmu_page_table(addr / MB);
+		arch_clean_cache_range((addr_t)table, sizeof(pt[0]));
+	}
+	arm_mmu_flush();
+	arch_invalidate_cache_range(start, end - start);
+	return true;
+}
+
+/*
+ * Change the memory type of existing section mappings, keeping their
+ * physical address. Nothing is changed if any part of the range is unmapped.
+ * The caches are cleaned before so no dirty lines are lost, and invalidated
+ * again afterwards in case lines were fetched speculatively meanwhile.
+ */
+bool arm_mmu_remap_sections(addr_t vaddr, uint size, uint flags)
+{
+	uint mb = (size + (vaddr % MB) + MB - 1) / MB;
+	uint i, index = vaddr / MB;
+	addr_t start = vaddr & ~(MB-1);
+
+	if (size == 0)
+		return false;
+
 	for (i = 0; i < mb; ++i)
-		tt[index + i] = arm_mmu_section_desc(paddr + i * MB, flags);
+		if ((tt[index + i] & 3) != 2)
+			return false;
+
+	arch_clean_invalidate_cache_range(start, mb * MB);
+	for (i = 0; i < mb; ++i) {
+		arm_mmu_split_supersection(index + i);
+		tt[index + i] = arm_mmu_section_desc(tt[index + i], flags);
+	}
 	arm_mmu_flush();
+	arch_invalidate_cache_range(start, mb * MB);
 	return true;
 }
 
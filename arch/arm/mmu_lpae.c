@@ -190,6 +190,183 @@ void arm_mmu_map_entry(mmu_section_t *entry)
 		dprintf(CRITICAL, "Invalid mapping type in the mmu table: %d\n", entry->type);
 }
 
+/************************************************************/
+/* Dynamic mappings with 2MB granules, used after the MMU is on */
+/***********************************************************/
+
+#define L1_BLOCK_ADDR_MASK      0xFFC0000000ULL
+#define L2_BLOCK_ATTR_MASK      (~0xFFFFFFF000ULL & ~0x3ULL)
+
+static uint64_t mmu_l2_block_desc(uint64_t paddr, arm_mmu_flags_t flags)
+{
+	return (paddr & L2_PT_MASK) | flags | MMU_AP_FLAG | MMU_PT_BLOCK_DESCRIPTOR;
+}
+
+/* Descriptor of the 2MB granule at vaddr, taken from 1GB blocks if needed */
+static uint64_t mmu_get_l2_desc(addr_t vaddr)
+{
+	uint64_t l1 = mmu_l1_pagetable[(vaddr & LPAE_MASK) >> 30];
+	uint64_t *l2_pt;
+
+	if ((l1 & MMU_PT_TABLE_DESCRIPTOR) == MMU_PT_BLOCK_DESCRIPTOR)
+		return (l1 & L1_BLOCK_ADDR_MASK) + (vaddr & 0x3FE00000) +
+		       (l1 & L2_BLOCK_ATTR_MASK) + MMU_PT_BLOCK_DESCRIPTOR;
+	if ((l1 & MMU_PT_TABLE_DESCRIPTOR) != MMU_PT_TABLE_DESCRIPTOR)
+		return 0;
+
+	l2_pt = (uint64_t *)(uintptr_t)(l1 & 0x0FFFFFFF000);
+	return l2_pt[(vaddr & L2_INDEX_MASK) >> 21];
+}
+
+/* L2 page table for vaddr, allocated (or split from a 1GB block) if needed */
+static uint64_t *mmu_get_l2_pt(addr_t vaddr)
+{
+	uint32_t l1_index = (vaddr & LPAE_MASK) >> 30;
+	uint64_t l1 = mmu_l1_pagetable[l1_index];
+	uint64_t *l2_pt;
+	uint32_t i;
+
+	if ((l1 & MMU_PT_TABLE_DESCRIPTOR) == MMU_PT_TABLE_DESCRIPTOR)
+		return (uint64_t *)(uintptr_t)(l1 & 0x0FFFFFFF000);
+
+	if (!avail_l2_pt)
+	{
+		dprintf(CRITICAL, "No free L2 page table for %#08lx\n", vaddr);
+		return NULL;
+	}
+
+	l2_pt = empty_l2_pt;
+	empty_l2_pt += MMU_L2_PT_SIZE;
+	avail_l2_pt--;
+
+	for (i = 0; i < MMU_L2_PT_SIZE; i++)
+	{
+		if ((l1 & MMU_PT_TABLE_DESCRIPTOR) == MMU_PT_BLOCK_DESCRIPTOR)
+			l2_pt[i] = (l1 & L1_BLOCK_ADDR_MASK) + i * SIZE_2MB +
+				   (l1 & L2_BLOCK_ATTR_MASK) + MMU_PT_BLOCK_DESCRIPTOR;
+		else
+			l2_pt[i] = 0;
+	}
+	arch_clean_cache_range((addr_t)l2_pt, MMU_L2_PT_SIZE * sizeof(*l2_pt));
+
+	mmu_l1_pagetable[l1_index] = ((uint64_t)(uintptr_t)l2_pt & 0x0FFFFFFF000) | MMU_PT_TABLE_DESCRIPTOR;
+	return l2_pt;
+}
+
+static bool mmu_fill_l2(addr_t paddr, addr_t vaddr, uint count, arm_mmu_flags_t flags)
+{
+	uint64_t *l2_pt;
+	uint32_t i;
+
+	for (i = 0; i < count; i++, paddr += SIZE_2MB, vaddr += SIZE_2MB)
+	{
+		if (mmu_get_l2_desc(vaddr))
+			continue;
+
+		l2_pt = mmu_get_l2_pt(vaddr);
+		if (!l2_pt)
+			return false;
+		l2_pt[(vaddr & L2_INDEX_MASK) >> 21] = mmu_l2_block_desc(paddr, flags);
+	}
+	return true;
+}
+
+/*
+ * The API of the short descriptor MMU code, with 2MB instead of 1MB
+ * sections. sizes are still arbitrary, the range is extended to whole 2MB.
+ */
+bool arm_mmu_try_map_sections(addr_t paddr, addr_t vaddr, uint size, arm_mmu_flags_t flags)
+{
+	uint count = (size + (paddr % SIZE_2MB) + SIZE_2MB - 1) / SIZE_2MB;
+	bool fully_mapped = true;
+	uint64_t desc, expected;
+	uint32_t i;
+	bool ret;
+
+	if (size == 0 || (paddr % SIZE_2MB) != (vaddr % SIZE_2MB))
+		return false;
+
+	paddr = ROUNDDOWN(paddr, SIZE_2MB);
+	vaddr = ROUNDDOWN(vaddr, SIZE_2MB);
+
+	/* Check if any existing mappings conflict */
+	for (i = 0; i < count; i++)
+	{
+		desc = mmu_get_l2_desc(vaddr + i * SIZE_2MB);
+		if (!desc)
+		{
+			fully_mapped = false;
+			continue;
+		}
+
+		expected = mmu_l2_block_desc(paddr + i * SIZE_2MB, flags);
+		if (desc != expected)
+		{
+			dprintf(CRITICAL, "MMU mapping mismatch @ %#08lx: %#llx != %#llx\n",
+				vaddr + i * SIZE_2MB, desc, expected);
+			return false;
+		}
+	}
+	if (fully_mapped)
+		return true;
+
+	ret = mmu_fill_l2(paddr, vaddr, count, flags);
+	arm_mmu_flush();
+	return ret;
+}
+
+void arm_mmu_map_free_sections(addr_t paddr, addr_t vaddr, uint size, arm_mmu_flags_t flags)
+{
+	uint count = (size + (paddr % SIZE_2MB) + SIZE_2MB - 1) / SIZE_2MB;
+
+	if (size == 0 || (paddr % SIZE_2MB) != (vaddr % SIZE_2MB))
+		return;
+
+	mmu_fill_l2(ROUNDDOWN(paddr, SIZE_2MB), ROUNDDOWN(vaddr, SIZE_2MB), count, flags);
+	arm_mmu_flush();
+}
+
+/*
+ * Change the memory type of existing mappings, keeping their physical
+ * address. The caches are maintained as for the short descriptor version.
+ */
+bool arm_mmu_remap_sections(addr_t vaddr, uint size, arm_mmu_flags_t flags)
+{
+	uint count = (size + (vaddr % SIZE_2MB) + SIZE_2MB - 1) / SIZE_2MB;
+	addr_t start = ROUNDDOWN(vaddr, SIZE_2MB);
+	uint64_t *l2_pt;
+	uint64_t *pte;
+	uint32_t i;
+
+	if (size == 0)
+		return false;
+
+	for (i = 0; i < count; i++)
+		if (!mmu_get_l2_desc(start + i * SIZE_2MB) || !mmu_get_l2_pt(start + i * SIZE_2MB))
+			return false;
+
+	arch_clean_invalidate_cache_range(start, count * SIZE_2MB);
+	for (i = 0; i < count; i++)
+	{
+		l2_pt = mmu_get_l2_pt(start + i * SIZE_2MB);
+		pte = &l2_pt[((start + i * SIZE_2MB) & L2_INDEX_MASK) >> 21];
+		*pte = mmu_l2_block_desc(*pte, flags);
+	}
+	arm_mmu_flush();
+	arch_invalidate_cache_range(start, count * SIZE_2MB);
+	return true;
+}
+
+void arm_mmu_flush(void)
+{
+	arch_clean_cache_range((addr_t)mmu_l1_pagetable, sizeof(mmu_l1_pagetable));
+	arch_clean_cache_range((addr_t)mmu_l2_pagetable, sizeof(mmu_l2_pagetable));
+	dsb();
+	arm_invalidate_tlb();
+	dsb();
+	isb();
+}
+
 void arm_mmu_init(void)
 {
 	/* set some mmu specific control bits:
@@ -39,6 +39,11 @@ struct context_switch_frame {
 	vaddr_t lr;
 	vaddr_t usp;
 	vaddr_t ulr;
+#if ARM_WITH_NEON
+	vaddr_t pad;
+	vaddr_t fpscr;
+	uint64_t d[32];
+#endif
 };
 
 extern void arm_context_switch(addr_t *old_sp, addr_t new_sp);
@@ -54,6 +54,22 @@ struct fb_color {
 
 static struct fbcon_config *config = NULL;
 
+/* Lines changed since the last flush, for partial display updates */
+static unsigned dirty_start = ~0U;
+static unsigned dirty_end;
+
+/* Buffer on the display while drawing to config->base, if double buffered */
+static char *front;
+static void *front_orig, *back_alloc;
+
+static void fbcon_mark_dirty(unsigned y, unsigned height)
+{
+	if (y < dirty_start)
+		dirty_start = y;
+	if (y + height > dirty_end)
+		dirty_end = y + height;
+}
+
 #define RGB565_BLACK		0x0000
 #define RGB565_WHITE		0xffff
 #define RGB565_CYAN		0x07ff
@@ -110,14 +126,95 @@ static struct fb_color		fb_color_formats_888[] = {
 					[FBCON_SELECT_MSG_BG_COLOR] = {RGB888_WHITE, RGB888_BLUE}};
 
 
+/*
+ * A row of a glyph has only FONT_WIDTH bits, so all possible rows are expanded
+ * once for the current colors and scale. Drawing a glyph is then a copy of
+ * whole rows instead of setting each pixel.
+ */
+static struct {
+	uint32_t fg, bg;
+	unsigned scale, bpp;
+	unsigned row_size;
+	unsigned alloc_size;
+	uint8_t *rows;
+} glyph_cache;
+
+static bool fbcon_glyph_cache_update(uint32_t fg, uint32_t bg, unsigned scale, unsigned bpp)
+{
+	unsigned row_size = FONT_WIDTH * scale * bpp;
+	unsigned p, x, j, k;
+	uint32_t color;
+	uint8_t *row;
+
+	if (glyph_cache.rows && glyph_cache.fg == fg && glyph_cache.bg == bg &&
+	    glyph_cache.scale == scale && glyph_cache.bpp == bpp)
+		return true;
+
+	if (row_size << FONT_WIDTH > glyph_cache.alloc_size) {
+		free(glyph_cache.rows);
+		glyph_cache.alloc_size = 0;
+		glyph_cache.rows = malloc(row_size << FONT_WIDTH);
+		if (!glyph_cache.rows)
+			return false;
+		glyph_cache.alloc_size = row_size << FONT_WIDTH;
+	}
+
+	row = glyph_cache.rows;
+	for (p = 0; p < (1 << FONT_WIDTH); p++) {
+		for (x = 0; x < FONT_WIDTH; x++) {
+			for (j = 0; j < scale; j++) {
+				color = (p & (1 << x)) ? fg : bg;
+				for (k = 0; k < bpp; k++) {
+					*row++ = (uint8_t) color;
+					color >>= 8;
+				}
+			}
+		}
+	}
+
+	glyph_cache.fg = fg;
+	glyph_cache.bg = bg;
+	glyph_cache.scale = scale;
+	glyph_cache.bpp = bpp;
+	glyph_cache.row_size = row_size;
+	return true;
+}
+
+static void fbcon_drawglyph_rows(char *pixels, unsigned stride, unsigned bpp,
+				 unsigned *glyph, unsigned scale_factor)
+{
+	const uint8_t *row;
+	unsigned half, y, i;
+	unsigned data;
+
+	for (half = 0; half < 2; half++) {
+		data = glyph[half];
+		for (y = 0; y < FONT_HEIGHT / 2; y++) {
+			row = glyph_cache.rows + (data & ((1 << FONT_WIDTH) - 1)) * glyph_cache.row_size;
+			for (i = 0; i < scale_factor; i++) {
+				memcpy(pixels, row, glyph_cache.row_size);
+				pixels += stride * bpp;
+			}
+			data >>= FONT_WIDTH;
+		}
+	}
+}
+
 static void fbcon_drawglyph(char *pixels, uint32_t paint, unsigned stride,
 			    unsigned bpp, unsigned *glyph, unsigned scale_factor)
 {
 	unsigned x, y, i, j, k;
 	unsigned data, temp;
 	uint32_t fg_color = paint;
-	stride -= FONT_WIDTH * scale_factor;
+
 	last_scale_factor = scale_factor;
+	if (fbcon_glyph_cache_update(paint, BGCOLOR, scale_factor, bpp)) {
+		fbcon_drawglyph_rows(pixels, stride, bpp, glyph, scale_factor);
+		return;
+	}
+
+	/* not enough memory, draw transparent glyphs pixel by pixel */
+	stride -= FONT_WIDTH * scale_factor;
 
 	data = glyph[0];
 	for (y = 0; y < FONT_HEIGHT / 2; ++y) {
@@ -218,27 +315,107 @@ void fbcon_draw_msg_background(unsigned y_start, unsigned y_end,
 			pixels += config->bpp / 8;
 		}
 	}
+	fbcon_mark_dirty(y_start * FONT_HEIGHT, (y_end - y_start) * FONT_HEIGHT);
 	fbcon_flush();
 }
 
+/* Only the buffer set up by the display driver can be write-combine */
+static bool fbcon_is_cached(void *buf)
+{
+	return !config->write_combine || buf == back_alloc;
+}
+
 void fbcon_flush(void)
 {
-	unsigned total_x, total_y;
-	unsigned bytes_per_bpp;
+	unsigned line_size;
+	unsigned y = 0, height;
+	char *back;
 
 	/* ignore anything that happens before fbcon is initialized */
 	if (!config)
 		return;
 
-	if (config->update_start)
+	/* anything that wasn't drawn by fbcon updates the whole screen */
+	height = config->height;
+	if (dirty_start < dirty_end && dirty_start < config->height) {
+		y = dirty_start;
+		height = MIN(dirty_end, config->height) - y;
+	}
+	dirty_start = ~0U;
+	dirty_end = 0;
+
+	line_size = config->width * (config->bpp / 8);
+	if (fbcon_is_cached(config->base))
+		arch_clean_invalidate_cache_range((addr_t) config->base + y * line_size,
+						  height * line_size);
+
+	back = config->base;
+	if (front)
+		config->flip(back);
+
+	if (config->update_region)
+		config->update_region(y, height);
+	else if (config->update_start)
 		config->update_start();
 	if (config->update_done)
 		while (!config->update_done());
 
-	total_x = config->width;
-	total_y = config->height;
-	bytes_per_bpp = ((config->bpp) / 8);
-	arch_clean_invalidate_cache_range((addr_t) config->base, (total_x * total_y * bytes_per_bpp));
+	if (front) {
+		/* Bring the old front buffer up to date and draw to it next */
+		line_size = config->stride * (config->bpp / 8);
+		memcpy(front + y * line_size, back + y * line_size, height * line_size);
+		if (fbcon_is_cached(front))
+			arch_clean_cache_range((addr_t) front + y * line_size, height * line_size);
+		config->base = front;
+		front = back;
+	}
+}
+
+/*
+ * Draw to an off-screen buffer and flip it to the display in fbcon_flush(),
+ * so that partially drawn frames are never visible.
+ */
+int fbcon_enable_double_buffer(void)
+{
+	size_t size;
+
+	if (!config || !config->flip)
+		return ERR_NOT_SUPPORTED;
+	if (front)
+		return NO_ERROR;
+
+	size = config->stride * (config->bpp / 8) * config->height;
+	back_alloc = memalign(4096, size);
+	if (!back_alloc)
+		return ERR_NO_MEMORY;
+
+	memcpy(back_alloc, config->base, size);
+	front = config->base;
+	front_orig = front;
+	config->base = back_alloc;
+	return NO_ERROR;
+}
+
+/* Scan out from the original framebuffer again, e.g. before booting */
+void fbcon_disable_double_buffer(void)
+{
+	if (!front)
+		return;
+
+	/* Both buffers have the same content after a flush */
+	fbcon_flush();
+	if (front != front_orig) {
+		config->flip(front_orig);
+		if (config->update_start)
+			config->update_start();
+		if (config->update_done)
+			while (!config->update_done());
+	}
+
+	config->base = front_orig;
+	front = NULL;
+	free(back_alloc);
+	back_alloc = NULL;
 }
 
 static void fbcon_scroll_up(void)
@@ -262,6 +439,7 @@ static void fbcon_scroll_up(void)
 	count = config->width * font_h * bpp;
 	memset(dst, 0, count); /* FIXME: ignores color */
 
+	fbcon_mark_dirty(0, config->height);
 	fbcon_flush();
 }
 
@@ -290,6 +468,7 @@ void fbcon_draw_line(uint32_t type)
 			pixels++;
 		}
 	}
+	fbcon_mark_dirty(cur_pos.y * FONT_HEIGHT, 1);
 
 	cur_pos.y += 1;
 	cur_pos.x = 0;
@@ -306,12 +485,36 @@ static void fbcon_set_colors(int type)
 	FGCOLOR = fb_color_formats[type].fg;
 }
 
+/*
+ * Fill count pixels with a color. Only the first pixel is written directly,
+ * the rest is copied from the already filled part in chunks of up to a line.
+ */
+static void fbcon_fill(void *pixels, uint32_t color, unsigned count)
+{
+	unsigned bpp = config->bpp / 8;
+	unsigned size = count * bpp;
+	unsigned line = config->width * bpp;
+	unsigned done, n, j;
+	char *p = pixels;
+
+	if (!size)
+		return;
+
+	for (j = 0; j < bpp; j++) {
+		p[j] = (unsigned char) color;
+		color = color >> 8;
+	}
+
+	for (done = bpp; done < size; done += n) {
+		n = MIN(MIN(done, line), size - done);
+		memcpy(p + done, p, n);
+	}
+}
+
 void fbcon_clear(void)
 {
-	unsigned long i = 0, j = 0;
 	unsigned char *pixels = NULL;
 	unsigned count;
-	uint32_t bg_color;
 
 	/* ignore anything that happens before fbcon is initialized */
 	if (!config)
@@ -321,22 +524,14 @@ void fbcon_clear(void)
 	count =  config->width * config->height;
 
 	fbcon_set_colors(FBCON_COMMON_MSG);
-	for (i = 0; i < count; i++) {
-		bg_color = BGCOLOR;
-		for (j = 0; j < (config->bpp / 8); j++) {
-			*pixels = (unsigned char) bg_color;
-			bg_color = bg_color >> 8;
-			pixels++;
-		}
-	}
+	fbcon_fill(pixels, BGCOLOR, count);
 	cur_pos.x = 0;
 	cur_pos.y = 0;
+	fbcon_mark_dirty(0, config->height);
 }
 
 void fbcon_clear_msg(unsigned y_start, unsigned y_end)
 {
-	unsigned i, j;
-	uint32_t bg_color;
 	char *pixels;
 	unsigned count;
 
@@ -349,14 +544,8 @@ void fbcon_clear_msg(unsigned y_start, unsigned y_end)
 	pixels += y_start * ((config->bpp / 8) * FONT_HEIGHT * config->width);
 
 	fbcon_set_colors(FBCON_COMMON_MSG);
-	for (i = 0; i < count; i++) {
-		bg_color = BGCOLOR;
-		for (j = 0; j < (config->bpp / 8); j++) {
-			*pixels = (unsigned char) bg_color;
-			bg_color = bg_color >> 8;
-			pixels++;
-		}
-	}
+	fbcon_fill(pixels, BGCOLOR, count);
+	fbcon_mark_dirty(y_start * FONT_HEIGHT, (y_end - y_start) * FONT_HEIGHT);
 }
 
 void fbcon_putc_factor_xy(char c, int type, unsigned scale_factor, int x, int y)
@@ -378,6 +567,7 @@ void fbcon_putc_factor_xy(char c, int type, unsigned scale_factor, int x, int y)
 
 	fbcon_drawglyph(pixels, FGCOLOR, config->stride, (config->bpp / 8),
 			font5x12 + (c - 32) * 2, scale_factor);
+	fbcon_mark_dirty(y, FONT_HEIGHT * scale_factor);
 }
 
 void fbcon_putc_factor(char c, int type, unsigned scale_factor, int y_start)
@@ -420,6 +610,7 @@ void fbcon_putc_factor(char c, int type, unsigned scale_factor, int y_start)
 
 	fbcon_drawglyph(pixels, FGCOLOR, config->stride, (config->bpp / 8),
 			font5x12 + (c - 32) * 2, scale_factor);
+	fbcon_mark_dirty(cur_pos.y * FONT_HEIGHT, FONT_HEIGHT * scale_factor);
 
 	cur_pos.x++;
 	if (cur_pos.x >= (int)(max_pos.x / scale_factor))
@@ -37,6 +37,19 @@
 
 static struct mdss_dsi_pll_config pll_data;
 
+/*
+ * The dividers only depend on the bit clock, the PLL type, bpp and lanes,
+ * which stay the same for a panel (except with dynamic fps). Keep the result
+ * instead of calculating it again on every clock enable.
+ */
+static struct {
+	bool valid;
+	uint32_t bit_clock;
+	int pll_type;
+	uint32_t bpp;
+	char lanes;
+} pll_calc;
+
 static void calculate_bitclock(struct msm_panel_info *pinfo)
 {
 	uint32_t h_period = 0, v_period = 0;
@@ -454,6 +467,14 @@ uint32_t calculate_clock_config(struct msm_panel_info *pinfo)
 
 	calculate_bitclock(pinfo);
 
+	if (pll_calc.valid && pll_calc.bit_clock == pll_data.bit_clock &&
+	    pll_calc.pll_type == pinfo->mipi.mdss_dsi_phy_db->pll_type &&
+	    pll_calc.bpp == pinfo->bpp &&
+	    pll_calc.lanes == pinfo->mipi.num_of_lanes) {
+		pinfo->mipi.dsi_pll_config = &pll_data;
+		return NO_ERROR;
+	}
+
 	switch (pinfo->mipi.mdss_dsi_phy_db->pll_type) {
 	case DSI_PLL_TYPE_20NM:
 		config_20nm_pll_vco_range();
@@ -473,5 +494,11 @@ uint32_t calculate_clock_config(struct msm_panel_info *pinfo)
 
 	pinfo->mipi.dsi_pll_config = &pll_data;
 
+	pll_calc.valid = (ret == NO_ERROR);
+	pll_calc.bit_clock = pll_data.bit_clock;
+	pll_calc.pll_type = pinfo->mipi.mdss_dsi_phy_db->pll_type;
+	pll_calc.bpp = pinfo->bpp;
+	pll_calc.lanes = pinfo->mipi.num_of_lanes;
+
 	return ret;
 }
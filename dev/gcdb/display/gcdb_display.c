@@ -48,6 +48,10 @@
 #include "target/display.h"
 #include "gcdb_autopll.h"
 
+#if WITH_LK2ND_PERSIST
+#include <lk2nd/persist.h>
+#endif
+
 /*---------------------------------------------------------------------------*/
 /* static                                                                    */
 /*---------------------------------------------------------------------------*/
@@ -647,6 +651,46 @@ error_gcdb_display_init:
 	return ret;
 }
 
+/* Name of the panel chosen by oem_panel_select(), if the target supports it */
+__WEAK const char *oem_panel_name(void)
+{
+	return NULL;
+}
+
+/*
+ * The panel found by auto detection is kept for the next (warm) boot, so it
+ * can be tried first. It is still verified like any other detected panel
+ * (DSI panel signature or SPI panel ID), the full detection only runs if that
+ * fails.
+ */
+bool gcdb_panel_cache_load(char *name)
+{
+#if WITH_LK2ND_PERSIST
+	if (lk2nd_persist_load(LK2ND_PERSIST_PANEL, name, MAX_PANEL_ID_LEN)) {
+		name[MAX_PANEL_ID_LEN - 1] = '\0';
+		dprintf(INFO, "Trying panel detected in previous boot: %s\n", name);
+		return true;
+	}
+#endif
+	return false;
+}
+
+void gcdb_panel_cache_store(bool detected)
+{
+#if WITH_LK2ND_PERSIST
+	const char *name = oem_panel_name();
+	char buf[MAX_PANEL_ID_LEN] = {0};
+
+	if (!detected || !name) {
+		lk2nd_persist_clear(LK2ND_PERSIST_PANEL);
+		return;
+	}
+
+	strlcpy(buf, name, sizeof(buf));
+	lk2nd_persist_store(LK2ND_PERSIST_PANEL, buf, sizeof(buf));
+#endif
+}
+
 void gcdb_display_shutdown(void)
 {
 	if (display_enable)
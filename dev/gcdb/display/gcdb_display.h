@@ -60,6 +60,9 @@ int target_dsi_phy_config(struct mdss_dsi_phy_ctrl *phy_db);
 int gcdb_display_init(const char *panel_name, uint32_t rev, void *base);
 bool gcdb_display_cmdline_arg(char *pbuf, uint16_t buf_size);
 void gcdb_display_shutdown(void);
+const char *oem_panel_name(void);
+bool gcdb_panel_cache_load(char *name);
+void gcdb_panel_cache_store(bool detected);
 int oem_panel_select(const char *panel_name, struct panel_struct *panelstruct,
 	struct msm_panel_info *pinfo, struct mdss_dsi_phy_ctrl *phy_db);
 void set_panel_cmd_string(const char *panel_name);
@@ -547,3 +547,17 @@ int32_t panel_name_to_id(struct panel_list supp_panels[],
 
 	return panel_id;
 }
+
+const char *panel_id_to_name(struct panel_list supp_panels[],
+			     uint32_t supp_panels_size,
+			     uint32_t panel_id)
+{
+	uint32_t i;
+
+	for (i = 0; i < supp_panels_size; i++) {
+		if (supp_panels[i].id == panel_id)
+			return supp_panels[i].name;
+	}
+
+	return NULL;
+}
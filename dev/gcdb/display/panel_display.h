@@ -95,4 +95,6 @@ int oem_panel_off(void);
 /* OEM support API */
 int32_t panel_name_to_id(struct panel_list supp_panels[],
 	uint32_t supp_panels_size, const char *panel_name);
+const char *panel_id_to_name(struct panel_list supp_panels[],
+	uint32_t supp_panels_size, uint32_t panel_id);
 #endif /*_PLATFORM_DISPLAY_H_ */
@@ -512,6 +512,7 @@ int pm8x41_ldo_set_voltage(struct pm8x41_ldo *ldo, uint32_t voltage)
 	uint32_t step = 0;
 	uint32_t mult = 0;
 	uint32_t val = 0;
+	uint8_t vset[2];
 	uint32_t vmin = 0;
 
 	if (!ldo)
@@ -559,15 +560,10 @@ int pm8x41_ldo_set_voltage(struct pm8x41_ldo *ldo, uint32_t voltage)
 
 	mult = (voltage - vmin) / step;
 
-	/* Set Range in voltage ctrl register */
-	val = 0x0;
-	val = range << LDO_RANGE_SEL_BIT;
-	REG_WRITE((ldo->base + LDO_RANGE_CTRL), val);
-
-	/* Set multiplier in voltage ctrl register */
-	val = 0x0;
-	val = mult << LDO_VSET_SEL_BIT;
-	REG_WRITE((ldo->base + LDO_STEP_CTRL), val);
+	/* Set range and multiplier in voltage ctrl registers with one command */
+	vset[0] = range << LDO_RANGE_SEL_BIT;
+	vset[1] = mult << LDO_VSET_SEL_BIT;
+	pmic_spmi_reg_write_burst(ldo->base + LDO_RANGE_CTRL, vset, sizeof(vset));
 
 	return 0;
 }
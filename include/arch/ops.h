@@ -54,6 +54,12 @@ void arch_clean_invalidate_cache_range(addr_t start, size_t len);
 void arch_invalidate_cache_range(addr_t start, size_t len);
 void arch_sync_cache_range(addr_t start, size_t len);
 void cache_clean_invalidate_unaligned_start_addr(addr_t start, size_t size);
+void arch_clean_cache_all(void);
+void arch_clean_invalidate_cache_all(void);
+
+void arch_cache_batch_add(addr_t start, size_t len);
+void arch_cache_batch_flush(void);
+void arch_cache_batch_discard(void);
 	
 void arch_idle(void);
 
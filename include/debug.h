@@ -55,7 +55,22 @@ int _dvprintf(const char *fmt, va_list ap);
 
 #define dputc(level, str) do { if ((level) <= DEBUGLEVEL) { _dputc(str); } } while (0)
 #define dputs(level, str) do { if ((level) <= DEBUGLEVEL) { _dputs(str); } } while (0)
+#if WITH_DEBUG_LOG_BINARY
+/*
+ * Messages above CRITICAL are only recorded in binary form (format string
+ * pointer and arguments) and formatted later, when the CPU is idle, the log is
+ * read or before the next synchronous message.
+ */
+int _dlog(const char *fmt, ...) __PRINTFLIKE(1, 2);
+void dlog_flush(void);
+
+#define dprintf(level, x...) do { if ((level) <= DEBUGLEVEL) { \
+	if ((level) > CRITICAL) { _dlog(x); } else { _dprintf(x); } } } while (0)
+#else
+static inline void dlog_flush(void) { }
+
 #define dprintf(level, x...) do { if ((level) <= DEBUGLEVEL) { _dprintf(x); } } while (0)
+#endif
 #define dvprintf(level, x...) do { if ((level) <= DEBUGLEVEL) { _dvprintf(x); } } while (0)
 
 /* input */
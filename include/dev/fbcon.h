@@ -31,6 +31,7 @@
 #ifndef __DEV_FBCON_H
 #define __DEV_FBCON_H
 
+#include <stdbool.h>
 #include <stdint.h>
 #define LOGO_IMG_OFFSET (12*1024*1024)
 #define LOGO_IMG_MAGIC "SPLASH!!"
@@ -102,6 +103,12 @@ struct fbcon_config {
 
 	void		(*update_start)(void);
 	int		(*update_done)(void);
+	/* Optional, replaces update_start() if only some lines changed */
+	void		(*update_region)(unsigned y, unsigned height);
+	/* Optional, scan out from another buffer starting with the next frame */
+	void		(*flip)(void *base);
+	/* Set if base is mapped write-combine, so it needs no cache flushes */
+	bool		write_combine;
 };
 
 void fbcon_setup(struct fbcon_config *cfg);
@@ -121,5 +128,7 @@ uint32_t fbcon_get_max_x(void);
 uint32_t fbcon_get_width(void);
 uint32_t fbcon_get_height(void);
 void fbcon_flush(void);
+int fbcon_enable_double_buffer(void);
+void fbcon_disable_double_buffer(void);
 int fetch_image_from_partition(void);
 #endif /* __DEV_FBCON_H */
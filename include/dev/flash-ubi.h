@@ -134,6 +134,75 @@ struct __attribute__ ((packed)) ubi_vid_hdr {
 #define UBI_VID_DYNAMIC 1
 #define UBI_LAYOUT_VOLUME_TYPE UBI_VID_DYNAMIC
 #define UBI_FM_SB_VOLUME_ID	(UBI_INTERNAL_VOL_START + 1)
+#define UBI_FM_DATA_VOLUME_ID	(UBI_INTERNAL_VOL_START + 2)
+
+/* Fastmap on-flash data structures */
+#define UBI_FM_FMT_VERSION	2
+/* The fastmap superblock is always within the first PEBs */
+#define UBI_FM_MAX_START	64
+#define UBI_FM_MAX_BLOCKS	32
+#define UBI_FM_MAX_POOL_SIZE	256
+#define UBI_FM_SB_MAGIC		0x7B11D69F
+#define UBI_FM_HDR_MAGIC	0xD4B82EF7
+#define UBI_FM_VHDR_MAGIC	0xFA370ED1
+#define UBI_FM_POOL_MAGIC	0x67AF4D08
+#define UBI_FM_EBA_MAGIC	0xF0C040A8
+
+/* Fastmap superblock, stored at the start of LEB 0 of the fastmap */
+struct __attribute__ ((packed)) ubi_fm_sb {
+	uint32_t  magic;
+	uint8_t   version;
+	uint8_t   padding1[3];
+	uint32_t  data_crc;
+	uint32_t  used_blocks;
+	uint32_t  block_loc[UBI_FM_MAX_BLOCKS];
+	uint32_t  block_ec[UBI_FM_MAX_BLOCKS];
+	uint64_t  sqnum;
+	uint8_t   padding2[32];
+};
+
+/* Fastmap header, follows the superblock */
+struct __attribute__ ((packed)) ubi_fm_hdr {
+	uint32_t  magic;
+	uint32_t  free_peb_count;
+	uint32_t  used_peb_count;
+	uint32_t  scrub_peb_count;
+	uint32_t  bad_peb_count;
+	uint32_t  erase_peb_count;
+	uint32_t  vol_count;
+	uint8_t   padding[4];
+};
+
+/* PEBs that may have been written after the fastmap */
+struct __attribute__ ((packed)) ubi_fm_scan_pool {
+	uint32_t  magic;
+	uint16_t  size;
+	uint16_t  max_size;
+	uint32_t  pebs[UBI_FM_MAX_POOL_SIZE];
+	uint32_t  padding[4];
+};
+
+struct __attribute__ ((packed)) ubi_fm_ec {
+	uint32_t  pnum;
+	uint32_t  ec;
+};
+
+struct __attribute__ ((packed)) ubi_fm_volhdr {
+	uint32_t  magic;
+	uint32_t  vol_id;
+	uint8_t   vol_type;
+	uint8_t   padding1[3];
+	uint32_t  data_pad;
+	uint32_t  used_ebs;
+	uint32_t  last_eb_bytes;
+	uint8_t   padding2[8];
+};
+
+/* Followed by reserved_pebs PEB numbers, -1 for unmapped LEBs */
+struct __attribute__ ((packed)) ubi_fm_eba {
+	uint32_t  magic;
+	uint32_t  reserved_pebs;
+};
 
 /* A record in the UBI volume table. */
 struct __attribute__ ((packed)) ubi_vtbl_record {
@@ -167,11 +236,15 @@ enum {
  * @status: status of this PEB: UBI_BAD_PEB/USED/FREE/EMPTY
  * @volume: if status = UBI_USED_PEB this is the volume
  * 		ID this PEB belongs to -1 for any other status
+ * @lnum: if status = UBI_USED_PEB the LEB number in the volume
+ * @sqnum: sequence number of the VID header, the newest copy of a LEB wins
  */
 struct peb_info {
 	uint64_t ec;
 	int status;
 	int volume;
+	uint32_t lnum;
+	uint64_t sqnum;
 };
 
 /**
@@ -187,6 +260,7 @@ struct peb_info {
  * @free_cnt: count of free eraseblocks
  * @used_cnt: count of used eraseblocks
  * @fastmap_sb: PEB number holding FM superblock. If FM is not present: -1
+ * @fastmap_sb_cnt: count of found FM superblocks
  * @vid_hdr_offs: volume ID header offset from the found EC headers (%-1 means
  *                undefined)
  * @data_offs: data offset from the found EC headers (%-1 means undefined)
@@ -203,12 +277,35 @@ struct ubi_scan_info {
 	int free_cnt;
 	int used_cnt;
 	int fastmap_sb;
+	int fastmap_sb_cnt;
 	unsigned vid_hdr_offs;
 	unsigned data_offs;
 	uint32_t  image_seq;
 	uint32_t  read_image_seq;
 };
 
+/**
+ * struct ubi_volume - Read-only view of a UBI volume
+ * @name: volume name
+ * @vol_id: volume ID
+ * @leb_size: usable size of each LEB (without the data padding)
+ * @leb_count: number of LEBs reserved for the volume
+ * @data_offs: offset of the LEB data in the PEBs
+ * @pebs: absolute PEB number each LEB is mapped to, -1 if unmapped
+ */
+struct ubi_volume {
+	char name[UBI_VOL_NAME_MAX + 1];
+	int vol_id;
+	unsigned leb_size;
+	unsigned leb_count;
+	unsigned data_offs;
+	int *pebs;
+};
+
+int ubi_scan_volumes(struct ptentry *ptn, struct ubi_volume **vols);
+int ubi_read_leb(const struct ubi_volume *vol, unsigned lnum,
+		unsigned offset, void *buf, unsigned len);
+
 int flash_ubi_img(struct ptentry *ptn, void *data, unsigned size);
 int update_ubi_vol(struct ptentry *ptn, const char* vol_name,
 				void *data, unsigned size);
@@ -0,0 +1,31 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+#ifndef __KERNEL_KTRACE_H
+#define __KERNEL_KTRACE_H
+
+#include <stdint.h>
+
+/*
+ * Lightweight binary event trace, implemented in lk2nd/trace and exported
+ * with "fastboot oem trace". The trace points compile to nothing otherwise.
+ */
+enum ktrace_type {
+	KTRACE_THREAD_SWITCH,	/* a: old thread, b: new thread */
+	KTRACE_IRQ_ENTER,	/* a: interrupt number */
+	KTRACE_IRQ_EXIT,	/* a: interrupt number */
+	KTRACE_EVENT_WAIT,	/* a: event */
+	KTRACE_EVENT_SIGNAL,	/* a: event */
+	KTRACE_MUTEX_WAIT,	/* a: mutex */
+	KTRACE_MMC_CMD_START,	/* a: command index, b: argument, c: blocks */
+	KTRACE_MMC_CMD_END,	/* a: command index, b: error */
+	KTRACE_USB_DONE,	/* a: request, b: actual length, c: status */
+	KTRACE_FS_READ_START,	/* a: offset, b: length */
+	KTRACE_FS_READ_END,	/* a: result */
+};
+
+#if WITH_LK2ND_TRACE
+void ktrace(enum ktrace_type type, uint32_t a, uint32_t b, uint32_t c);
+#else
+static inline void ktrace(enum ktrace_type type, uint32_t a, uint32_t b, uint32_t c) {}
+#endif
+
+#endif /* __KERNEL_KTRACE_H */
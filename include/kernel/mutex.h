@@ -37,8 +37,19 @@ typedef struct mutex {
 /* Rules for Mutexes:
  * - Mutexes are only safe to use from thread context.
  * - Mutexes are non-recursive.
+ * - A thread holding a mutex runs with the priority of the highest waiter
+ *   (priority inheritance) until it released all mutexes it holds.
 */
 
+/* contention counters, for debugging */
+struct mutex_stats {
+	unsigned int acquires;
+	unsigned int contended; /* acquires that had to wait */
+	unsigned int boosts; /* holders that got a higher priority from a waiter */
+};
+
+extern struct mutex_stats mutex_stats;
+
 void mutex_init(mutex_t *);
 void mutex_destroy(mutex_t *);
 status_t mutex_acquire(mutex_t *);
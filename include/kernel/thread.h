@@ -54,6 +54,8 @@ typedef struct thread {
 	/* active bits */
 	struct list_node queue_node;
 	int priority;
+	int base_priority;	/* priority without mutex priority inheritance */
+	int mutexes_held;
 	enum thread_state state;	
 	int saved_critical_section_count;
 	int remaining_quantum;
@@ -95,17 +97,28 @@ typedef struct thread {
 /* stack size  - 12kb per thread (12 * 1024) */
 #define DEFAULT_STACK_SIZE 12288
 
+/* pattern for unused stack, used for the high-water mark */
+#define THREAD_STACK_PAINT 0x99
+#define THREAD_STACK_PAINT_WORD 0x99999999
+
 /* functions */
 void thread_init_early(void);
 void thread_init(void);
 void thread_become_idle(void) __NO_RETURN;
 void thread_set_name(const char *name);
 void thread_set_priority(int priority);
+void thread_set_effective_priority(thread_t *t, int priority);
 thread_t *thread_create(const char *name, thread_start_routine entry, void *arg, int priority, size_t stack_size);
 status_t thread_resume(thread_t *);
 void thread_exit(int retcode) __NO_RETURN;
 void thread_sleep(time_t delay);
 
+/* delays from this many ms on sleep instead of spinning, see delay_or_sleep() */
+#define DELAY_SLEEP_THRESHOLD 10
+void delay_or_sleep(time_t delay);
+
+size_t thread_stack_used(thread_t *t);
+
 void dump_thread(thread_t *t);
 void dump_all_threads(void);
 
@@ -123,6 +136,9 @@ extern thread_t *current_thread;
 /* the idle thread */
 extern thread_t *idle_thread;
 
+/* list of all threads, protected by the critical section */
+extern struct list_node thread_list;
+
 /* critical sections */
 extern int critical_section_count;
 
@@ -35,7 +35,11 @@ typedef enum handler_return (*timer_callback)(struct timer *, time_t now, void *
 
 typedef struct timer {
 	int magic;
-	struct list_node node;
+
+	/* pairing heap links, prev is the parent for the first child */
+	struct timer *prev;
+	struct timer *child;
+	struct timer *sibling;
 
 	time_t scheduled_time;
 	time_t periodic_time;
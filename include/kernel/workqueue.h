@@ -0,0 +1,52 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+#ifndef __KERNEL_WORKQUEUE_H
+#define __KERNEL_WORKQUEUE_H
+
+#include <list.h>
+#include <stdbool.h>
+#include <sys/types.h>
+#include <kernel/event.h>
+
+/*
+ * Simple work queue: work items are run by a pool of WORKQUEUE_THREADS
+ * worker threads, or by the DPC thread if it is set to 0. Work items are
+ * usually collected in a group, which allows waiting for all of them at once.
+ */
+#ifndef WORKQUEUE_THREADS
+#define WORKQUEUE_THREADS 2
+#endif
+
+typedef void (*work_func)(void *arg);
+
+struct work_group {
+	int pending;
+	event_t done;
+};
+
+struct work {
+	struct list_node node;
+	work_func func;
+	void *arg;
+	struct work_group *group;
+	bool queued;
+};
+
+void workqueue_init(void);
+
+void work_group_init(struct work_group *group);
+void work_init(struct work *work, work_func func, void *arg);
+
+/* queue the work item, the group (can be NULL) is counted as busy until it ran */
+status_t work_submit(struct work *work, struct work_group *group);
+
+/* remove the work item from the queue, returns false if it already started */
+bool work_cancel(struct work *work);
+
+/*
+ * wait until all work items of the group have been run. Items that were not
+ * started yet are run directly by the waiting thread. Must not be called from
+ * a work item for its own group.
+ */
+void work_group_wait(struct work_group *group);
+
+#endif
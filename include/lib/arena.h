@@ -0,0 +1,24 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+#ifndef __LIB_ARENA_H
+#define __LIB_ARENA_H
+
+#include <sys/types.h>
+
+/*
+ * Arena (bump) allocator for many small allocations with the same lifetime.
+ * Nothing is freed individually, arena_reset() releases all allocations at
+ * once. The memory comes from the heap in blocks of the size passed to
+ * arena_create(), larger allocations get a block of their own.
+ */
+struct arena;
+
+struct arena *arena_create(size_t block_size);
+void arena_destroy(struct arena *arena);
+void arena_reset(struct arena *arena);
+
+void *arena_alloc(struct arena *arena, size_t size);
+void *arena_calloc(struct arena *arena, size_t count, size_t size);
+char *arena_strdup(struct arena *arena, const char *str);
+char *arena_strndup(struct arena *arena, const char *str, size_t max);
+
+#endif
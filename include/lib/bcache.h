@@ -27,14 +27,40 @@
 
 typedef void * bcache_t;
 
+struct bcache_stats {
+	uint32_t hits;
+	uint32_t depth;	// total hash chain entries visited by the hits
+	uint32_t misses;
+	uint32_t reads;
+	uint32_t writes;
+};
+
 bcache_t bcache_create(bdev_t *dev, size_t block_size, int block_count);
 void bcache_destroy(bcache_t);
 
+// like bcache_create(), but share the blocks with the other subdevices of the same device
+bcache_t bcache_open(bdev_t *dev, size_t block_size, int block_count);
+
 int bcache_read_block(bcache_t, void *, uint block);
 
+// read the blocks of the range that are not cached yet with as few requests as possible
+int bcache_prefetch(bcache_t, uint block, uint count);
+// maximum number of blocks read by a single request of bcache_prefetch()
+uint bcache_prefetch_max(bcache_t);
+
 // get and put a pointer directly to the block
 int bcache_get_block(bcache_t, void **, uint block);
 int bcache_put_block(bcache_t, uint block);
 
+// write back a block changed through the pointer with the next flush
+int bcache_mark_block_dirty(bcache_t, uint block);
+int bcache_flush(bcache_t);
+
+// forget the cached copies of blocks that were written to the device directly
+void bcache_invalidate(bcache_t, uint block, uint count);
+
+// totals over all caches, including the destroyed ones
+void bcache_get_stats(struct bcache_stats *stats);
+
 #endif
 
@@ -27,9 +27,59 @@
 #include <list.h>
 
 #include <kernel/mutex.h>
+#include <kernel/event.h>
 
 typedef uint32_t bnum_t;
 
+struct bdev;
+
+/*
+ * asynchronous read request. the block device layer may change dev and offset
+ * while the request is passed down to the parent device.
+ */
+struct bio_request {
+	struct list_node node;	// for use by the block device
+	struct bdev *dev;
+	void *buf;
+	off_t offset;
+	size_t len;
+
+	// optional, called from the completing thread before done is signaled
+	void (*callback)(struct bio_request *req);
+	void *cookie;
+
+	ssize_t result;		// bytes read or error
+	event_t done;
+	bigtime_t start;	// for the statistics
+};
+
+/* memory segment of a vectored read */
+struct bio_vec {
+	void *buf;
+	size_t len;
+};
+
+/* reads by latency in us, bucket n counts [2^n, 2^(n+1)), the last one all longer ones */
+#define BIO_LATENCY_BUCKETS	20
+
+struct bio_op_stats {
+	uint32_t ops;		// requests passed to the driver
+	uint64_t bytes;
+	bigtime_t time;		// us
+};
+
+/*
+ * statistics of a block device. a read of a subdevice is counted for it
+ * and again for its parent. asynchronous reads are counted for the device
+ * that completes them.
+ */
+struct bio_stats {
+	struct bio_op_stats read;
+	struct bio_op_stats write;
+	struct bio_op_stats erase;
+	uint32_t latency[BIO_LATENCY_BUCKETS];
+};
+
 typedef struct bdev {
 	struct list_node node;
 	volatile int ref;
@@ -42,12 +92,16 @@ typedef struct bdev {
 	char *label;
 	bool is_leaf;
 
+	struct bio_stats stats;
+
 	/* function pointers */
 	ssize_t (*read)(struct bdev *, void *buf, off_t offset, size_t len);
 	ssize_t (*read_block)(struct bdev *, void *buf, bnum_t block, uint count);
 	ssize_t (*write)(struct bdev *, const void *buf, off_t offset, size_t len);
 	ssize_t (*write_block)(struct bdev *, const void *buf, bnum_t block, uint count);
 	ssize_t (*erase)(struct bdev *, off_t offset, size_t len);
+	status_t (*submit)(struct bdev *, struct bio_request *req); // optional, async read
+	ssize_t (*readv)(struct bdev *, const struct bio_vec *iov, uint iovcnt, off_t offset); // optional
 	int (*ioctl)(struct bdev *, int request, void *argp);
 	void (*close)(struct bdev *);
 } bdev_t;
@@ -62,11 +116,18 @@ bdev_t *bio_open(const char *name);
 void bio_close(bdev_t *dev);
 ssize_t bio_read(bdev_t *dev, void *buf, off_t offset, size_t len);
 ssize_t bio_read_block(bdev_t *dev, void *buf, bnum_t block, uint count);
+ssize_t bio_readv(bdev_t *dev, const struct bio_vec *iov, uint iovcnt, off_t offset);
 ssize_t bio_write(bdev_t *dev, const void *buf, off_t offset, size_t len);
 ssize_t bio_write_block(bdev_t *dev, const void *buf, bnum_t block, uint count);
 ssize_t bio_erase(bdev_t *dev, off_t offset, size_t len);
 int bio_ioctl(bdev_t *dev, int request, void *argp);
 
+/* async api, emulated with a synchronous read if the device has no submit hook */
+status_t bio_read_async(bdev_t *dev, struct bio_request *req, void *buf, off_t offset, size_t len);
+status_t bio_submit(bdev_t *dev, struct bio_request *req);
+ssize_t bio_wait(struct bio_request *req);
+void bio_complete(struct bio_request *req, ssize_t result); // for block devices
+
 /* intialize the block device layer */
 void bio_init(void);
 
@@ -79,12 +140,15 @@ void bio_initialize_bdev(bdev_t *dev, const char *name, size_t block_size, bnum_
 
 /* debug stuff */
 void bio_dump_devices(void);
+void bio_dump_stats(bdev_t *dev);
 
 /* low level access to the device list, user must lock the mutex */
 struct bdev_struct *bio_get_bdevs(void);
 
 /* subdevice support */
 status_t bio_publish_subdevice(const char *parent_dev, const char *subdev, bnum_t startblock, size_t len);
+/* the device below all subdevices of dev, and the offset of dev in it */
+bdev_t *bio_get_root(bdev_t *dev, off_t *offset);
 
 /* memory based block device */
 int create_membdev(const char *name, void *ptr, size_t len);
@@ -32,11 +32,31 @@ typedef struct cbuf {
 	uint len_pow2;
 	char *buf;
 	event_t event;
+	bool spsc;
 } cbuf_t;
 
 void cbuf_initialize(cbuf_t *cbuf, size_t len);
+
+/*
+ * Single producer, single consumer mode: one context (e.g. an interrupt
+ * handler) writes and one other reads, without disabling interrupts. Only
+ * a blocking read on an empty buffer, and a write to it, touch the event.
+ * buf can be NULL to allocate it.
+ */
+void cbuf_initialize_spsc(cbuf_t *cbuf, size_t len, void *buf);
+
 size_t cbuf_read(cbuf_t *cbuf, void *_buf, size_t buflen, bool block);
 size_t cbuf_write(cbuf_t *cbuf, const void *_buf, size_t len, bool canreschedule);
 
+/*
+ * Zero-copy access, e.g. to DMA straight into or out of the buffer: get the
+ * contiguous free space (or data) at the current position, then commit how
+ * much of it was used. Only one writer and one reader may use them at once.
+ */
+size_t cbuf_write_bulk(cbuf_t *cbuf, void **buf);
+void cbuf_write_commit(cbuf_t *cbuf, size_t len, bool canreschedule);
+size_t cbuf_read_bulk(cbuf_t *cbuf, void **buf);
+void cbuf_read_commit(cbuf_t *cbuf, size_t len);
+
 #endif
 
@@ -0,0 +1,44 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+#ifndef __LIB_DMAPOOL_H
+#define __LIB_DMAPOOL_H
+
+#include <stdbool.h>
+#include <sys/types.h>
+
+/*
+ * Pool of fixed-size buffers for DMA, carved from a single allocation. The
+ * buffers are aligned and padded to cache lines, so they never share a line
+ * with other data. Allocating and freeing a buffer takes constant time.
+ */
+struct dma_pool {
+	void *base;
+	size_t size;		// of each buffer, a multiple of CACHE_LINE
+	unsigned int count;
+	unsigned int used;
+	unsigned int max_used;
+	bool uncached;
+	void *free_list;
+};
+
+/*
+ * Map the pool non-cacheable if possible, so the buffers need no cache
+ * maintenance for DMA. This is slower to access for the CPU, so it is meant
+ * for small buffers like descriptors. Uncached pools cannot be destroyed.
+ */
+#define DMA_POOL_UNCACHED	(1 << 0)
+
+status_t dma_pool_init(struct dma_pool *pool, size_t size, unsigned int count, uint flags);
+void dma_pool_destroy(struct dma_pool *pool);
+
+void *dma_pool_alloc(struct dma_pool *pool);
+void dma_pool_free(struct dma_pool *pool, void *buf);
+bool dma_pool_contains(const struct dma_pool *pool, const void *buf);
+
+/*
+ * Cache maintenance before and after DMA. For uncached pools only the write
+ * buffer is drained, so the device sees all preceding writes.
+ */
+void dma_pool_clean(const struct dma_pool *pool, void *buf, size_t len);
+void dma_pool_invalidate(const struct dma_pool *pool, void *buf, size_t len);
+
+#endif
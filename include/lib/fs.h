@@ -30,15 +30,34 @@ void fs_init(void);
 struct file_stat {
     bool is_dir;
     off_t size;
+    uint32_t mtime; /* seconds since the epoch, 0 if unknown */
 };
 
 struct dirent {
     char name[FS_MAX_FILE_LEN];
 };
 
+/* run of file data on the block device */
+struct file_extent {
+    uint64_t offset; /* bytes from the start of the device, 0 for holes */
+    uint64_t len;
+};
+
+/*
+ * identifies the on-disk version of a file, so it can be checked without
+ * mounting the file system that it belongs to
+ */
+#define FS_FILE_KEY_LEN 32
+struct file_key {
+    char fs[8];
+    uint8_t data[FS_FILE_KEY_LEN];
+};
+
 typedef struct filehandle filehandle;
 typedef struct dirhandle dirhandle;
 
+/* cheap check if the device may contain the fs, without mounting it */
+status_t fs_probe(const char *fs, const char *device) __NONNULL();
 status_t fs_mount(const char *path, const char *fs, const char *device) __NONNULL();
 status_t fs_unmount(const char *path) __NONNULL();
 
@@ -47,8 +66,14 @@ status_t fs_create_file(const char *path, filehandle **handle, uint64_t len) __N
 status_t fs_open_file(const char *path, filehandle **handle) __NONNULL();
 ssize_t fs_read_file(filehandle *handle, void *buf, off_t offset, size_t len) __NONNULL();
 ssize_t fs_write_file(filehandle *handle, const void *buf, off_t offset, size_t len) __NONNULL();
+status_t fs_truncate_file(filehandle *handle, uint64_t len) __NONNULL();
 status_t fs_close_file(filehandle *handle) __NONNULL();
 status_t fs_stat_file(filehandle *handle, struct file_stat *) __NONNULL((1));
+status_t fs_map_file(filehandle *handle, off_t offset, struct file_extent *ext) __NONNULL();
+status_t fs_file_key(filehandle *handle, struct file_key *key) __NONNULL();
+
+/* check that the file is still unchanged, ERR_NOT_VALID if it is not */
+status_t fs_check_key(const char *device, const struct file_key *key) __NONNULL();
 
 /* dir api */
 status_t fs_make_dir(const char *path) __NONNULL();
@@ -68,6 +93,7 @@ typedef struct filecookie filecookie;
 typedef struct dircookie dircookie;
 struct bdev;
 struct fs_api {
+    status_t (*probe)(struct bdev *);
     status_t (*mount)(struct bdev *, fscookie **);
     status_t (*unmount)(fscookie *);
     status_t (*open)(fscookie *, const char *, filecookie **);
@@ -76,6 +102,10 @@ struct fs_api {
     ssize_t (*read)(filecookie *, void *, off_t, size_t);
     ssize_t (*write)(filecookie *, const void *, off_t, size_t);
     status_t (*close)(filecookie *);
+    status_t (*truncate)(filecookie *, uint64_t);                // optional
+    status_t (*map)(filecookie *, off_t, struct file_extent *);  // optional
+    status_t (*get_key)(filecookie *, uint8_t *);                // optional
+    status_t (*check_key)(struct bdev *, const uint8_t *);       // optional
 
     status_t (*mkdir)(fscookie *, const char *);
     status_t (*opendir)(fscookie *, const char *, dircookie **) __NONNULL();
@@ -31,6 +31,29 @@ void heap_free(void *);
 
 void heap_init(void);
 
+struct heap_stats {
+	void *base;
+	size_t len;
+	size_t used;		// including the overhead of each allocation
+	size_t max_used;
+	size_t free;
+	size_t largest_free;
+	unsigned int free_chunks;
+	unsigned int allocs;
+	unsigned int total_allocs;
+	unsigned int failed_allocs;
+};
+
+void heap_get_stats(struct heap_stats *stats);
+
+// percentage of the free memory that is not part of the largest free chunk
+static inline unsigned int heap_fragmentation(const struct heap_stats *stats)
+{
+	if (!stats->free)
+		return 0;
+	return 100 - (unsigned int)((unsigned long long)stats->largest_free * 100 / stats->free);
+}
+
 
 
 #endif
@@ -0,0 +1,74 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+#ifndef __LIB_LZ4_H
+#define __LIB_LZ4_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+/* true if buf starts with a LZ4 frame or legacy (Linux Image.lz4) stream */
+bool lz4_is_compressed(const void *buf, size_t len);
+
+/*
+ * Decompress LZ4 data (frame or legacy format) from in to out.
+ * in_used  - returns the amount of consumed input, may be NULL
+ * out_used - returns the amount of decompressed data, may be NULL
+ *
+ * Returns 0 on success, ERR_NOT_ENOUGH_BUFFER if out got filled before the
+ * end of the stream (out then contains the first out_len bytes of the
+ * data), or another negative error if the input is corrupted.
+ *
+ * Nothing is printed and no memory is allocated, so this can also run on the
+ * lk2nd SMP worker cores.
+ */
+int lz4_decompress(const void *in, size_t in_len, void *out, size_t out_len,
+		   size_t *in_used, size_t *out_used);
+
+/*
+ * Decompress a single raw LZ4 block without any frame header, e.g. from a
+ * squashfs image. Returns like lz4_decompress().
+ */
+int lz4_decompress_block(const void *in, size_t in_len, void *out, size_t out_len,
+			 size_t *out_used);
+
+/*
+ * Incremental decompression of LZ4 frames and legacy streams that arrive in
+ * pieces of arbitrary size, e.g. over usb. The caller provides a work buffer
+ * of LZ4_STREAM_WORK_SIZE bytes for the largest compressed block, the largest
+ * decompressed block and the history of linked blocks.
+ *
+ * The decompressed data is passed to write() one block at a time. If write()
+ * returns an error, decompression stops and the error is returned.
+ */
+#define LZ4_STREAM_WORK_SIZE	(16 * 1024 * 1024 + 8 * 1024 * 1024 / 255 + 16 + 64 * 1024)
+
+struct lz4_stream {
+	int (*write)(void *priv, const void *buf, size_t len);
+	void *priv;
+
+	/* private */
+	int state;
+	int next;
+	uint8_t hdr[4];
+	size_t hdr_len;
+	size_t need;
+	unsigned frames;
+	bool legacy;
+	bool uncompressed;
+	uint8_t flg;
+	size_t block_max;
+	size_t block;
+	size_t in_len;
+	size_t hist;
+	uint8_t *in;
+	uint8_t *out;
+};
+
+void lz4_stream_init(struct lz4_stream *s, void *work,
+		     int (*write)(void *priv, const void *buf, size_t len), void *priv);
+/* Returns 0 or a negative error, e.g. ERR_NOT_VALID for corrupted input */
+int lz4_stream_decompress(struct lz4_stream *s, const void *in, size_t len);
+/* Returns 0 if the input ended at the end of a frame, ERR_NOT_VALID if not */
+int lz4_stream_end(struct lz4_stream *s);
+
+#endif
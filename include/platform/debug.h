@@ -34,6 +34,7 @@ extern "C" {
 
 void debug_init(void);
 unsigned log_copy(void *dst);
+unsigned log_copy_since(void *dst, unsigned *seq);
 
 void debug_dump_regs(void);
 
@@ -27,6 +27,11 @@ typedef enum handler_return (*platform_timer_callback)(void *arg, time_t now);
 
 status_t platform_set_periodic_timer(platform_timer_callback callback, void *arg, time_t interval);
 
+#if PLATFORM_HAS_DYNAMIC_TIMER
+status_t platform_set_oneshot_timer(platform_timer_callback callback, void *arg, time_t interval);
+void platform_stop_timer(void);
+#endif
+
 void mdelay(unsigned msecs);
 void udelay(unsigned usecs);
 
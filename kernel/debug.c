@@ -32,6 +32,7 @@
  */
 
 #include <debug.h>
+#include <kernel/mutex.h>
 #include <kernel/thread.h>
 #include <kernel/timer.h>
 #include <platform.h>
@@ -76,6 +77,9 @@ static int cmd_threadstats(int argc, const cmd_args *argv)
 	printf("\tinterrupts: %d\n", thread_stats.interrupts);
 	printf("\ttimer interrupts: %d\n", thread_stats.timer_ints);
 	printf("\ttimers: %d\n", thread_stats.timers);
+	printf("\tmutex acquires: %u\n", mutex_stats.acquires);
+	printf("\tmutex contended: %u\n", mutex_stats.contended);
+	printf("\tmutex priority boosts: %u\n", mutex_stats.boosts);
 
 	return 0;
 }
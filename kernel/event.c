@@ -43,6 +43,7 @@
 #include <debug.h>
 #include <err.h>
 #include <kernel/event.h>
+#include <kernel/ktrace.h>
 
 #if DEBUGLEVEL > 1
 #define EVENT_CHECK 1
@@ -125,6 +126,7 @@ status_t event_wait_timeout(event_t *e, time_t timeout)
 		}
 	} else {
 		/* unsignalled, block here */
+		ktrace(KTRACE_EVENT_WAIT, (uintptr_t)e, 0, 0);
 		ret = wait_queue_block(&e->wait, timeout);
 		if (ret < 0)
 			goto err;
@@ -169,6 +171,8 @@ status_t event_signal(event_t *e, bool reschedule)
 	ASSERT(e->magic == EVENT_MAGIC);
 #endif
 
+	ktrace(KTRACE_EVENT_SIGNAL, (uintptr_t)e, 0, 0);
+
 	if (!e->signalled) {
 		if (e->flags & EVENT_FLAG_AUTOUNSIGNAL) {
 			/* try to release one thread and leave unsignalled if successful */
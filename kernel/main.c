@@ -33,6 +33,7 @@
 #include <kernel/thread.h>
 #include <kernel/timer.h>
 #include <kernel/dpc.h>
+#include <kernel/workqueue.h>
 #include <boot_stats.h>
 
 #if WITH_LIB_BIO
@@ -119,6 +120,10 @@ void kmain(void)
 	dprintf(SPEW, "initializing dpc\n");
 	dpc_init();
 
+	// 初始化工作队列及其工作线程
+	dprintf(SPEW, "initializing work queue\n");
+	workqueue_init();
+
 	// 初始化内核定时器系统
 	dprintf(SPEW, "initializing timers\n");
 	timer_init();
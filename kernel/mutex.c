@@ -31,6 +31,7 @@
 
 #include <debug.h>
 #include <err.h>
+#include <kernel/ktrace.h>
 #include <kernel/mutex.h>
 #include <kernel/thread.h>
 
@@ -38,6 +39,42 @@
 #define MUTEX_CHECK 1
 #endif
 
+struct mutex_stats mutex_stats;
+
+/*
+ * Basic priority inheritance: The holder of a contended mutex runs with the
+ * priority of the highest waiter, so a low priority thread holding a mutex
+ * cannot be starved by medium priority threads while a high priority thread
+ * waits for it. The boost is kept until the holder released all its mutexes.
+ * It does not propagate further if the holder itself waits for another mutex.
+ */
+static void mutex_boost_holder(mutex_t *m)
+{
+	thread_t *t;
+	int priority = m->holder->priority;
+
+	list_for_every_entry(&m->wait.list, t, thread_t, queue_node) {
+		if (t->priority > priority)
+			priority = t->priority;
+	}
+
+	if (priority > m->holder->priority) {
+		thread_set_effective_priority(m->holder, priority);
+		mutex_stats.boosts++;
+	}
+}
+
+/* called in a critical section once the current thread got the mutex */
+static void mutex_acquired(mutex_t *m)
+{
+	m->holder = current_thread;
+	current_thread->mutexes_held++;
+
+	/* there might be higher priority threads still waiting behind us */
+	if (unlikely(m->count > 1))
+		mutex_boost_holder(m);
+}
+
 /**
  * @brief  Initialize a mutex_t
  */
@@ -101,8 +138,17 @@ status_t mutex_acquire(mutex_t *m)
 
 //	dprintf("mutex_acquire: m %p, count %d, curr %p\n", m, m->count, current_thread);
 
+	mutex_stats.acquires++;
 	m->count++;
 	if (unlikely(m->count > 1)) {
+		mutex_stats.contended++;
+
+		/* the holder is NULL if it was just handed over to a woken thread */
+		if (m->holder && m->holder->priority < current_thread->priority) {
+			thread_set_effective_priority(m->holder, current_thread->priority);
+			mutex_stats.boosts++;
+		}
+
 		/* 
 		 * block on the wait queue. If it returns an error, it was likely destroyed
 		 * out from underneath us, so make sure we dont scribble thread ownership 
@@ -112,7 +158,7 @@ status_t mutex_acquire(mutex_t *m)
 		if (ret < 0)
 			goto err;
 	}
-	m->holder = current_thread;	
+	mutex_acquired(m);
 
 err:
 	exit_critical_section();
@@ -149,8 +195,17 @@ status_t mutex_acquire_timeout(mutex_t *m, time_t timeout)
 
 //	dprintf("mutex_acquire_timeout: m %p, count %d, curr %p, timeout %d\n", m, m->count, current_thread, timeout);
 
+	mutex_stats.acquires++;
 	m->count++;
 	if (unlikely(m->count > 1)) {
+		mutex_stats.contended++;
+
+		if (m->holder && m->holder->priority < current_thread->priority) {
+			thread_set_effective_priority(m->holder, current_thread->priority);
+			mutex_stats.boosts++;
+		}
+
+		ktrace(KTRACE_MUTEX_WAIT, (uintptr_t)m, 0, 0);
 		ret = wait_queue_block(&m->wait, timeout);
 		if (ret < NO_ERROR) {
 			/* if the acquisition timed out, back out the acquire and exit */
@@ -168,7 +223,7 @@ status_t mutex_acquire_timeout(mutex_t *m, time_t timeout)
 			 */
 		}	
 	}
-	m->holder = current_thread;	
+	mutex_acquired(m);
 
 err:
 	exit_critical_section();
@@ -181,6 +236,8 @@ err:
  */
 status_t mutex_release(mutex_t *m)
 {
+	bool unboosted = false;
+
 	if (current_thread != m->holder)
 		panic("mutex_release: thread %p (%s) tried to release mutex %p it doesn't own. owned by %p (%s)\n", 
 				current_thread, current_thread->name, m, m->holder, m->holder ? m->holder->name : "none");
@@ -195,10 +252,21 @@ status_t mutex_release(mutex_t *m)
 
 	m->holder = 0;
 	m->count--;
+
+	/* drop an inherited priority once the last mutex is released */
+	if (--current_thread->mutexes_held == 0 &&
+	    current_thread->priority != current_thread->base_priority) {
+		thread_set_effective_priority(current_thread, current_thread->base_priority);
+		unboosted = true;
+	}
+
 	if (unlikely(m->count >= 1)) {
 		/* release a thread */
 //		dprintf("releasing thread\n");
 		wait_queue_wake_one(&m->wait, true, NO_ERROR);
+	} else if (unboosted) {
+		/* the waiter that boosted us timed out and may be ready now */
+		thread_preempt();
 	}
 
 	exit_critical_section();
@@ -40,7 +40,9 @@
 #include <kernel/thread.h>
 #include <kernel/timer.h>
 #include <kernel/dpc.h>
+#include <kernel/ktrace.h>
 #include <platform.h>
+#include <platform/timer.h>
 
 #if DEBUGLEVEL > 1
 #define THREAD_CHECKS 1
@@ -51,7 +53,7 @@ struct thread_stats thread_stats;
 #endif
 
 /* global thread list */
-static struct list_node thread_list;
+struct list_node thread_list;
 
 /* the current thread */
 thread_t *current_thread;
@@ -76,6 +78,11 @@ static void idle_thread_routine(void) __NO_RETURN;
 #if PLATFORM_HAS_DYNAMIC_TIMER
 /* preemption timer */
 static timer_t preempt_timer;
+
+static enum handler_return preempt_timer_tick(struct timer *t, time_t now, void *arg)
+{
+	return thread_timer_tick();
+}
 #endif
 
 /* run queue manipulation */
@@ -152,6 +159,7 @@ thread_t *thread_create(const char *name, thread_start_routine entry, void *arg,
 	t->entry = entry;
 	t->arg = arg;
 	t->priority = priority;
+	t->base_priority = priority;
 	t->saved_critical_section_count = 1; /* we always start inside a critical section */
 	t->state = THREAD_SUSPENDED;
 	t->blocking_wait_queue = NULL;
@@ -166,6 +174,9 @@ thread_t *thread_create(const char *name, thread_start_routine entry, void *arg,
 
 	t->stack_size = stack_size;
 
+	/* paint the stack to find out how much of it was used later */
+	memset(t->stack, THREAD_STACK_PAINT, stack_size);
+
 	/* inheirit thread local storage from the parent */
 	int i;
 	for (i=0; i < MAX_TLS_ENTRY; i++)
@@ -269,8 +280,11 @@ void thread_exit(int retcode)
 
 static void idle_thread_routine(void)
 {
-	for(;;)
+	for(;;) {
+		/* format deferred log messages while there is nothing else to do */
+		dlog_flush();
 		arch_idle();
+	}
 }
 
 /**
@@ -344,6 +358,13 @@ void thread_resched(void)
 		newthread->remaining_quantum = 5; // XXX make this smarter
 	}
 
+	/* the bottom of the stack should never be touched */
+	if (unlikely(oldthread->stack &&
+		     *(uint32_t *)oldthread->stack != THREAD_STACK_PAINT_WORD))
+		panic("stack overflow in thread %p (%s)\n", oldthread, oldthread->name);
+
+	ktrace(KTRACE_THREAD_SWITCH, (uintptr_t)oldthread, (uintptr_t)newthread, 0);
+
 #if THREAD_STATS
 	thread_stats.context_switches++;
 
@@ -366,7 +387,7 @@ void thread_resched(void)
 	 * timer to run our preemption tick.
 	 */
 	if (oldthread == idle_thread) {
-		timer_set_periodic(&preempt_timer, 10, (timer_callback)thread_timer_tick, NULL);
+		timer_set_periodic(&preempt_timer, 10, preempt_timer_tick, NULL);
 	} else if (newthread == idle_thread) {
 		timer_cancel(&preempt_timer);
 	}
@@ -531,6 +552,22 @@ void thread_sleep(time_t delay)
 	exit_critical_section();
 }
 
+/**
+ * @brief  Wait for at least the specified delay in ms
+ *
+ * Longer delays put the current thread to sleep, so that other threads can
+ * run in the meantime. Since the sleep might end up to one timer tick later,
+ * shorter delays busy-wait instead, as well as all delays in a critical
+ * section (e.g. before threading is up or in interrupt handlers).
+ */
+void delay_or_sleep(time_t delay)
+{
+	if (delay >= DELAY_SLEEP_THRESHOLD && !in_critical_section())
+		thread_sleep(delay);
+	else
+		mdelay(delay);
+}
+
 /**
  * @brief  Initialize threading system
  *
@@ -553,6 +590,7 @@ void thread_init_early(void)
 
 	/* half construct this thread, since we're already running */
 	t->priority = HIGHEST_PRIORITY;
+	t->base_priority = HIGHEST_PRIORITY;
 	t->state = THREAD_RUNNING;
 	t->saved_critical_section_count = 1;
 	list_add_head(&thread_list, &t->thread_list_node);
@@ -590,7 +628,41 @@ void thread_set_priority(int priority)
 		priority = LOWEST_PRIORITY;
 	if (priority > HIGHEST_PRIORITY)
 		priority = HIGHEST_PRIORITY;
-	current_thread->priority = priority;
+	current_thread->base_priority = priority;
+
+	/* keep a priority inherited through a mutex until it is released */
+	if (!current_thread->mutexes_held || priority > current_thread->priority)
+		current_thread->priority = priority;
+}
+
+/**
+ * @brief Change the priority a thread is currently scheduled with
+ *
+ * Used for priority inheritance by the mutex code. Unlike thread_set_priority()
+ * this does not touch the base priority of the thread, and moves it to the
+ * run queue of the new priority if it is ready to run.
+ *
+ * Must be called with interrupts disabled.
+ */
+void thread_set_effective_priority(thread_t *t, int priority)
+{
+#if THREAD_CHECKS
+	ASSERT(t->magic == THREAD_MAGIC);
+	ASSERT(in_critical_section());
+#endif
+
+	if (t->priority == priority)
+		return;
+
+	if (t->state == THREAD_READY) {
+		list_delete(&t->queue_node);
+		if (list_is_empty(&run_queue[t->priority]))
+			run_queue_bitmap &= ~(1<<t->priority);
+		t->priority = priority;
+		insert_in_run_queue_head(t);
+	} else {
+		t->priority = priority;
+	}
 }
 
 /**
@@ -608,6 +680,28 @@ void thread_become_idle(void)
 	idle_thread_routine();
 }
 
+/**
+ * @brief  Get the maximum number of stack bytes used by a thread so far
+ *
+ * The stack is painted with a pattern when the thread is created, so the
+ * deepest point ever reached is where the pattern was first overwritten.
+ *
+ * @return  Number of bytes used, or 0 if unknown (e.g. for the bootstrap thread)
+ */
+size_t thread_stack_used(thread_t *t)
+{
+	const uint32_t *p = t->stack;
+	const uint32_t *end = (const uint32_t *)((uint8_t *)t->stack + t->stack_size);
+
+	if (!p)
+		return 0;
+
+	while (p < end && *p == THREAD_STACK_PAINT_WORD)
+		p++;
+
+	return (uint8_t *)end - (uint8_t *)p;
+}
+
 /**
  * @brief  Dump debugging info about the specified thread.
  */
@@ -615,7 +709,7 @@ void dump_thread(thread_t *t)
 {
 	dprintf(INFO, "dump_thread: t %p (%s)\n", t, t->name);
 	dprintf(INFO, "\tstate %d, priority %d, remaining quantum %d, critical section %d\n", t->state, t->priority, t->remaining_quantum, t->saved_critical_section_count);
-	dprintf(INFO, "\tstack %p, stack_size %zd\n", t->stack, t->stack_size);
+	dprintf(INFO, "\tstack %p, stack_size %zd, used %zd\n", t->stack, t->stack_size, thread_stack_used(t));
 	dprintf(INFO, "\tentry %p, arg %p\n", t->entry, t->arg);
 	dprintf(INFO, "\twait queue %p, wait queue ret %d\n", t->blocking_wait_queue, t->wait_queue_block_ret);
 	dprintf(INFO, "\ttls:");
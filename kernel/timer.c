@@ -43,7 +43,13 @@
 #include <platform/timer.h>
 #include <platform.h>
 
-static struct list_node timer_queue;
+/*
+ * Pending timers are kept in a pairing heap ordered by scheduled_time:
+ * Inserting a timer is O(1), removing the first timer or cancelling an
+ * arbitrary one is O(log n) amortized. The heap is intrusive, so no memory
+ * needs to be allocated for queueing a timer.
+ */
+static timer_t *timer_queue;
 
 static enum handler_return timer_tick(void *arg, time_t now);
 
@@ -53,28 +59,113 @@ static enum handler_return timer_tick(void *arg, time_t now);
 void timer_initialize(timer_t *timer)
 {
 	timer->magic = TIMER_MAGIC;
-	list_clear_node(&timer->node);
+	timer->prev = NULL;
+	timer->child = NULL;
+	timer->sibling = NULL;
 	timer->scheduled_time = 0;
 	timer->periodic_time = 0;
 	timer->callback = 0;
 	timer->arg = 0;
 }
 
-static void insert_timer_in_queue(timer_t *timer)
+static inline bool timer_queued(timer_t *timer)
+{
+	return timer->prev || timer == timer_queue;
+}
+
+/* make the later of the two heaps the first child of the other one */
+static timer_t *timer_heap_meld(timer_t *a, timer_t *b)
 {
-	timer_t *entry;
+	timer_t *tmp;
 
-//	TRACEF("timer %p, scheduled %d, periodic %d\n", timer, timer->scheduled_time, timer->periodic_time);
+	if (TIME_LT(b->scheduled_time, a->scheduled_time)) {
+		tmp = a;
+		a = b;
+		b = tmp;
+	}
 
-	list_for_every_entry(&timer_queue, entry, timer_t, node) {
-		if (TIME_GT(entry->scheduled_time, timer->scheduled_time)) {
-			list_add_before(&entry->node, &timer->node);
-			return;
+	b->prev = a;
+	b->sibling = a->child;
+	if (a->child)
+		a->child->prev = b;
+	a->child = b;
+
+	return a;
+}
+
+/* combine the children of a removed timer into a single heap */
+static timer_t *timer_heap_merge_pairs(timer_t *first)
+{
+	timer_t *a, *b, *next, *list = NULL;
+
+	if (!first)
+		return NULL;
+
+	/* first pass: meld pairs from left to right, collect them in reverse */
+	while (first) {
+		a = first;
+		b = a->sibling;
+		if (b) {
+			next = b->sibling;
+			a = timer_heap_meld(a, b);
+		} else {
+			next = NULL;
 		}
+		a->sibling = list;
+		list = a;
+		first = next;
 	}
 
-	/* walked off the end of the list */
-	list_add_tail(&timer_queue, &timer->node);
+	/* second pass: meld everything from right to left */
+	first = list;
+	list = list->sibling;
+	while (list) {
+		next = list->sibling;
+		first = timer_heap_meld(first, list);
+		list = next;
+	}
+
+	first->prev = NULL;
+	first->sibling = NULL;
+	return first;
+}
+
+static void insert_timer_in_queue(timer_t *timer)
+{
+//	TRACEF("timer %p, scheduled %d, periodic %d\n", timer, timer->scheduled_time, timer->periodic_time);
+
+	timer->prev = NULL;
+	timer->child = NULL;
+	timer->sibling = NULL;
+
+	if (timer_queue)
+		timer_queue = timer_heap_meld(timer_queue, timer);
+	else
+		timer_queue = timer;
+}
+
+static void remove_timer_from_queue(timer_t *timer)
+{
+	timer_t *children = timer_heap_merge_pairs(timer->child);
+
+	if (timer == timer_queue) {
+		timer_queue = children;
+	} else {
+		/* unlink from the list of siblings */
+		if (timer->prev->child == timer)
+			timer->prev->child = timer->sibling;
+		else
+			timer->prev->sibling = timer->sibling;
+		if (timer->sibling)
+			timer->sibling->prev = timer->prev;
+
+		if (children)
+			timer_queue = timer_heap_meld(timer_queue, children);
+	}
+
+	timer->prev = NULL;
+	timer->child = NULL;
+	timer->sibling = NULL;
 }
 
 static void timer_set(timer_t *timer, time_t delay, time_t period, timer_callback callback, void *arg)
@@ -85,7 +176,7 @@ static void timer_set(timer_t *timer, time_t delay, time_t period, timer_callbac
 
 	DEBUG_ASSERT(timer->magic == TIMER_MAGIC);	
 
-	if (list_in_list(&timer->node)) {
+	if (timer_queued(timer)) {
 		panic("timer %p already in list\n", timer);
 	}
 
@@ -102,7 +193,7 @@ static void timer_set(timer_t *timer, time_t delay, time_t period, timer_callbac
 	insert_timer_in_queue(timer);
 
 #if PLATFORM_HAS_DYNAMIC_TIMER
-	if (list_peek_head_type(&timer_queue, timer_t, node) == timer) {
+	if (timer_queue == timer) {
 		/* we just modified the head of the timer queue */
 //		TRACEF("setting new timer for %u msecs\n", (uint)delay);
 		platform_set_oneshot_timer(timer_tick, NULL, delay);
@@ -164,11 +255,11 @@ void timer_cancel(timer_t *timer)
 	enter_critical_section();
 
 #if PLATFORM_HAS_DYNAMIC_TIMER
-	timer_t *oldhead = list_peek_head_type(&timer_queue, timer_t, node);
+	timer_t *oldhead = timer_queue;
 #endif
 
-	if (list_in_list(&timer->node))
-		list_delete(&timer->node);
+	if (timer_queued(timer))
+		remove_timer_from_queue(timer);
 
 	/* to keep it from being reinserted into the queue if called from 
 	 * periodic timer callback.
@@ -179,7 +270,7 @@ void timer_cancel(timer_t *timer)
 
 #if PLATFORM_HAS_DYNAMIC_TIMER
 	/* see if we've just modified the head of the timer queue */
-	timer_t *newhead = list_peek_head_type(&timer_queue, timer_t, node);
+	timer_t *newhead = timer_queue;
 	if (newhead == NULL) {
 //		TRACEF("clearing old hw timer, nothing in the queue\n");
 		platform_stop_timer();
@@ -214,15 +305,13 @@ static enum handler_return timer_tick(void *arg, time_t now)
 
 	for (;;) {
 		/* see if there's an event to process */
-		timer = list_peek_head_type(&timer_queue, timer_t, node);
+		timer = timer_queue;
 		if (likely(!timer || TIME_LT(now, timer->scheduled_time)))
 			break;
 
 		/* process it */
 		DEBUG_ASSERT(timer->magic == TIMER_MAGIC);
-		list_delete(&timer->node);
-//		timer = list_remove_head_type(&timer_queue, timer_t, node);
-//		ASSERT(timer);
+		remove_timer_from_queue(timer);
 
 //		TRACEF("dequeued timer %p, scheduled %d periodic %d\n", timer, timer->scheduled_time, timer->periodic_time);
 
@@ -239,7 +328,7 @@ static enum handler_return timer_tick(void *arg, time_t now)
 		/* if it was a periodic timer and it hasn't been requeued
 		 * by the callback put it back in the list
 		 */
-		if (periodic && !list_in_list(&timer->node) && timer->periodic_time > 0) {
+		if (periodic && !timer_queued(timer) && timer->periodic_time > 0) {
 //			TRACEF("periodic timer, period %u\n", (uint)timer->periodic_time);
 			timer->scheduled_time = now + timer->periodic_time;
 			insert_timer_in_queue(timer);
@@ -248,7 +337,7 @@ static enum handler_return timer_tick(void *arg, time_t now)
 
 #if PLATFORM_HAS_DYNAMIC_TIMER
 	/* reset the timer to the next event */
-	timer = list_peek_head_type(&timer_queue, timer_t, node);
+	timer = timer_queue;
 	if (timer) {
 		/* has to be the case or it would have fired already */
 		ASSERT(TIME_GT(timer->scheduled_time, now));
@@ -272,10 +361,12 @@ static enum handler_return timer_tick(void *arg, time_t now)
 
 void timer_init(void)
 {
-	list_initialize(&timer_queue);
+	timer_queue = NULL;
 
+#if !PLATFORM_HAS_DYNAMIC_TIMER
 	/* register for a periodic timer tick */
 	platform_set_periodic_timer(timer_tick, NULL, 10); /* 10ms */
+#endif
 }
 
 
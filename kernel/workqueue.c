@@ -0,0 +1,175 @@
+// SPDX-License-Identifier: BSD-3-Clause
+
+#include <debug.h>
+#include <err.h>
+#include <list.h>
+#include <kernel/dpc.h>
+#include <kernel/event.h>
+#include <kernel/thread.h>
+#include <kernel/workqueue.h>
+
+static struct list_node work_list = LIST_INITIAL_VALUE(work_list);
+static event_t work_event;
+
+/* must be called in a critical section */
+static void work_done(struct work_group *group)
+{
+	if (group && --group->pending == 0)
+		event_signal(&group->done, false);
+}
+
+/* must be called in a critical section */
+static struct work *work_take(struct work_group *group)
+{
+	struct work *work;
+
+	list_for_every_entry(&work_list, work, struct work, node) {
+		if (!group || work->group == group) {
+			list_delete(&work->node);
+			work->queued = false;
+			return work;
+		}
+	}
+
+	return NULL;
+}
+
+static void work_run(struct work *work)
+{
+	/* the work item may be reused as soon as the function is called */
+	struct work_group *group = work->group;
+
+	work->func(work->arg);
+
+	enter_critical_section();
+	work_done(group);
+	exit_critical_section();
+}
+
+#if WORKQUEUE_THREADS
+static int work_thread_routine(void *arg)
+{
+	struct work *work;
+
+	for (;;) {
+		event_wait(&work_event);
+
+		enter_critical_section();
+		work = work_take(NULL);
+		if (!work)
+			event_unsignal(&work_event);
+		exit_critical_section();
+
+		if (work)
+			work_run(work);
+	}
+
+	return 0;
+}
+#else
+/* one DPC is queued per work item, it runs whatever is next in the queue */
+static void work_dpc(void *arg)
+{
+	struct work *work;
+
+	enter_critical_section();
+	work = work_take(NULL);
+	exit_critical_section();
+
+	if (work)
+		work_run(work);
+}
+#endif
+
+void workqueue_init(void)
+{
+#if WORKQUEUE_THREADS
+	thread_t *thr;
+	int i;
+
+	event_init(&work_event, false, 0);
+
+	for (i = 0; i < WORKQUEUE_THREADS; i++) {
+		thr = thread_create("worker", &work_thread_routine, NULL,
+				    DEFAULT_PRIORITY, DEFAULT_STACK_SIZE);
+		if (!thr)
+			panic("failed to create worker thread\n");
+		thread_resume(thr);
+	}
+#endif
+}
+
+void work_group_init(struct work_group *group)
+{
+	group->pending = 0;
+	event_init(&group->done, true, 0);
+}
+
+void work_init(struct work *work, work_func func, void *arg)
+{
+	work->func = func;
+	work->arg = arg;
+	work->group = NULL;
+	work->queued = false;
+}
+
+status_t work_submit(struct work *work, struct work_group *group)
+{
+	enter_critical_section();
+	if (work->queued) {
+		exit_critical_section();
+		return ERR_ALREADY_STARTED;
+	}
+
+	work->group = group;
+	work->queued = true;
+	if (group && group->pending++ == 0)
+		event_unsignal(&group->done);
+	list_add_tail(&work_list, &work->node);
+
+	/* let the caller submit more work before the workers start */
+#if WORKQUEUE_THREADS
+	event_signal(&work_event, false);
+#endif
+	exit_critical_section();
+
+#if !WORKQUEUE_THREADS
+	return dpc_queue(work_dpc, NULL, DPC_FLAG_NORESCHED);
+#else
+	return NO_ERROR;
+#endif
+}
+
+bool work_cancel(struct work *work)
+{
+	bool queued;
+
+	enter_critical_section();
+	queued = work->queued;
+	if (queued) {
+		list_delete(&work->node);
+		work->queued = false;
+		work_done(work->group);
+	}
+	exit_critical_section();
+
+	return queued;
+}
+
+void work_group_wait(struct work_group *group)
+{
+	struct work *work;
+
+	/* rather than waiting for a worker, run what was not started yet */
+	for (;;) {
+		enter_critical_section();
+		work = work_take(group);
+		exit_critical_section();
+
+		if (!work)
+			break;
+		work_run(work);
+	}
+
+	event_wait(&group->done);
+}
@@ -25,28 +25,34 @@
 #include <string.h>
 #include <sys/types.h>
 #include <debug.h>
+#include <err.h>
 #include <lib/bcache.h>
 #include <lib/bio.h>
+#include <lib/dmapool.h>
 
 #define LOCAL_TRACE 0
 
+/* memory for the blocks of all shared caches, see bcache_open() */
+#ifndef BCACHE_SHARED_SIZE
+#define BCACHE_SHARED_SIZE (256 * 1024)
+#endif
+
+/* maximum number of blocks fetched by a single read-ahead */
+#ifndef BCACHE_READAHEAD_MAX
+#define BCACHE_READAHEAD_MAX 8
+#endif
+
 struct bcache_block {
 	struct list_node node;
+	struct list_node hash_node;
 	bnum_t blocknum;
 	int ref_count;
 	bool is_dirty;
 	void *ptr;
 };
 
-struct bcache_stats {
-	uint32_t hits;
-	uint32_t depth;
-	uint32_t misses;
-	uint32_t reads;
-	uint32_t writes;
-};
-
 struct bcache {
+	struct list_node node;
 	bdev_t *dev;
 	size_t block_size;
 	int count;
@@ -55,36 +61,169 @@ struct bcache {
 	struct list_node free_list;
 	struct list_node lru_list;
 
+	/* blocks in use, hashed by block number */
+	struct list_node *hash;
+	uint hash_mask;
+
+	/* sequential read-ahead */
+	uint ra_next;	// block that continues the current sequence
+	uint ra_window;	// blocks read by the next sequential miss
+	uint ra_max;
+	void *ra_buf;
+
 	struct bcache_block *blocks;
+	struct dma_pool pool;	// memory of the blocks
+
+	/* a handle of a shared cache, with the first block of the subdevice */
+	struct bcache *shared;
+	bnum_t offset;
+
+	/* a shared cache, with the number of handles */
+	struct list_node shared_node;
+	int users;
 };
 
+/* all caches, and the statistics of the destroyed ones */
+static struct list_node cache_list = LIST_INITIAL_VALUE(cache_list);
+static struct bcache_stats old_stats;
+
+/* caches of whole devices that are shared by their subdevices */
+static struct list_node shared_list = LIST_INITIAL_VALUE(shared_list);
+static size_t shared_size;
+
+static inline struct list_node *hash_bucket(struct bcache *cache, uint blocknum)
+{
+	/* Fibonacci hashing, spreads out neighbouring blocks */
+	return &cache->hash[(blocknum * 2654435761U >> 16) & cache->hash_mask];
+}
+
 bcache_t bcache_create(bdev_t *dev, size_t block_size, int block_count)
 {
 	struct bcache *cache;
+	uint buckets = 1;
+	int i;
+
+	cache = calloc(1, sizeof(struct bcache));
+	if (!cache)
+		return NULL;
 
-	cache = malloc(sizeof(struct bcache));
-	
 	cache->dev = dev;
 	cache->block_size = block_size;
-	cache->count = block_count;
-	memset(&cache->stats, 0, sizeof(cache->stats));
 
 	list_initialize(&cache->free_list);
 	list_initialize(&cache->lru_list);
 
-	cache->blocks = malloc(sizeof(struct bcache_block) * block_count);
-	int i;
-	for (i=0; i < block_count; i++) {
-		cache->blocks[i].ref_count = 0;
-		cache->blocks[i].is_dirty = false;
-		cache->blocks[i].ptr = memalign(CACHE_LINE, block_size);
+	/* about two blocks per bucket */
+	while (buckets * 2 < (uint)block_count)
+		buckets <<= 1;
+	cache->hash_mask = buckets - 1;
+	cache->hash = malloc(sizeof(struct list_node) * buckets);
+	cache->blocks = calloc(block_count, sizeof(struct bcache_block));
+	if (!cache->hash || !cache->blocks) {
+		free(cache->hash);
+		free(cache->blocks);
+		free(cache);
+		return NULL;
+	}
+
+	for (i = 0; i < (int)buckets; i++)
+		list_initialize(&cache->hash[i]);
+
+	/* all blocks in one allocation, use what fits into the heap */
+	for (i = block_count; i > 0; i /= 2)
+		if (dma_pool_init(&cache->pool, block_size, i, 0) == NO_ERROR)
+			break;
+	cache->count = i;
+
+	for (i = 0; i < cache->count; i++) {
+		cache->blocks[i].ptr = dma_pool_alloc(&cache->pool);
 		// add to the free list
-		list_add_head(&cache->free_list, &cache->blocks[i].node);	
+		list_add_head(&cache->free_list, &cache->blocks[i].node);
+	}
+
+	if (cache->count < block_count)
+		dprintf(INFO, "bcache: only %d of %d blocks allocated\n", cache->count, block_count);
+
+	/* don't let the read-ahead push out more than a quarter of the cache */
+	cache->ra_max = MIN(BCACHE_READAHEAD_MAX, cache->count / 4);
+	if (cache->ra_max > 1 && !dev->readv) {
+		/* the device cannot scatter the data into the blocks itself */
+		cache->ra_buf = memalign(CACHE_LINE, cache->ra_max * block_size);
+		if (!cache->ra_buf)
+			cache->ra_max = 1;
+	}
+	cache->ra_window = 1;
+
+	list_add_tail(&cache_list, &cache->node);
+	return (bcache_t)cache;
+}
+
+/*
+ * Instead of a cache for each partition of a disk, the subdevices share one
+ * cache of the whole device. The partitions mounted at the same time then
+ * stay within a single memory budget instead of allocating a cache each.
+ * The shared cache is freed together with its last handle, so nothing stale
+ * is left behind once nothing is mounted (e.g. after flashing a partition).
+ */
+bcache_t bcache_open(bdev_t *dev, size_t block_size, int block_count)
+{
+	struct bcache *cache, *shared;
+	bdev_t *root;
+	off_t offset;
+
+	root = bio_get_root(dev, &offset);
+	if (offset % block_size)
+		return bcache_create(dev, block_size, block_count);
+
+	list_for_every_entry(&shared_list, shared, struct bcache, shared_node) {
+		if (shared->dev == root && shared->block_size == block_size)
+			goto found;
+	}
+
+	if (shared_size + block_count * block_size > BCACHE_SHARED_SIZE)
+		return bcache_create(dev, block_size, block_count);
+
+	shared = bcache_create(root, block_size, block_count);
+	if (!shared)
+		return NULL;
+
+	LTRACEF("new shared cache for %s with %d blocks of %zu\n", root->name, shared->count, block_size);
+
+	shared_size += shared->count * block_size;
+	list_add_tail(&shared_list, &shared->shared_node);
+
+found:
+	cache = calloc(1, sizeof(struct bcache));
+	if (!cache) {
+		if (!shared->users) {
+			list_delete(&shared->shared_node);
+			shared_size -= shared->count * block_size;
+			bcache_destroy(shared);
+		}
+		return NULL;
 	}
 
+	cache->dev = dev;
+	cache->block_size = block_size;
+	cache->shared = shared;
+	cache->offset = offset / block_size;
+	shared->users++;
+
 	return (bcache_t)cache;
 }
 
+/* the cache holding the blocks, with blocknum translated for it */
+static struct bcache *resolve_cache(bcache_t _cache, uint *blocknum)
+{
+	struct bcache *cache = _cache;
+
+	if (!cache->shared)
+		return cache;
+
+	*blocknum += cache->offset;
+	return cache->shared;
+}
+
 static int flush_block(struct bcache *cache, struct bcache_block *block)
 {
 	int rc;
@@ -107,6 +246,18 @@ void bcache_destroy(bcache_t _cache)
 	struct bcache *cache = _cache;
 	int i;
 
+	if (cache->shared) {
+		struct bcache *shared = cache->shared;
+
+		free(cache);
+		if (--shared->users)
+			return;
+
+		list_delete(&shared->shared_node);
+		shared_size -= shared->count * shared->block_size;
+		cache = shared;
+	}
+
 	for (i=0; i < cache->count; i++) {
 		DEBUG_ASSERT(cache->blocks[i].ref_count == 0);
 
@@ -114,12 +265,52 @@ void bcache_destroy(bcache_t _cache)
 			printf("warning: freeing dirty block %u\n",
 				cache->blocks[i].blocknum);
 
-		free(cache->blocks[i].ptr);
+		dma_pool_free(&cache->pool, cache->blocks[i].ptr);
 	}
-
+	dma_pool_destroy(&cache->pool);
+
+	old_stats.hits += cache->stats.hits;
+	old_stats.depth += cache->stats.depth;
+	old_stats.misses += cache->stats.misses;
+	old_stats.reads += cache->stats.reads;
+	old_stats.writes += cache->stats.writes;
+
+	list_delete(&cache->node);
+	free(cache->ra_buf);
+	free(cache->blocks);
+	free(cache->hash);
 	free(cache);
 }
 
+void bcache_get_stats(struct bcache_stats *stats)
+{
+	struct bcache *cache;
+
+	*stats = old_stats;
+	list_for_every_entry(&cache_list, cache, struct bcache, node) {
+		stats->hits += cache->stats.hits;
+		stats->depth += cache->stats.depth;
+		stats->misses += cache->stats.misses;
+		stats->reads += cache->stats.reads;
+		stats->writes += cache->stats.writes;
+	}
+}
+
+static struct bcache_block *lookup_block(struct bcache *cache, uint blocknum, uint32_t *depth)
+{
+	struct bcache_block *block;
+
+	list_for_every_entry(hash_bucket(cache, blocknum), block, struct bcache_block, hash_node) {
+		LTRACEF("looking at entry %p, num %u\n", block, block->blocknum);
+		(*depth)++;
+
+		if (block->blocknum == blocknum)
+			return block;
+	}
+
+	return NULL;
+}
+
 /* find a block if it's already present */
 static struct bcache_block *find_block(struct bcache *cache, uint blocknum)
 {
@@ -128,18 +319,14 @@ static struct bcache_block *find_block(struct bcache *cache, uint blocknum)
 
 	LTRACEF("num %u\n", blocknum);
 
-	block = NULL;
-	list_for_every_entry(&cache->lru_list, block, struct bcache_block, node) {
-		LTRACEF("looking at entry %p, num %u\n", block, block->blocknum);
-		depth++;
-
-		if (block->blocknum == blocknum) {
-			list_delete(&block->node);
-			list_add_tail(&cache->lru_list, &block->node);
-			cache->stats.hits++;
-			cache->stats.depth += depth;
-			return block;
-		}
+	block = lookup_block(cache, blocknum, &depth);
+	if (block) {
+		/* move to the end of the lru, it is now the most recently used */
+		list_delete(&block->node);
+		list_add_tail(&cache->lru_list, &block->node);
+		cache->stats.hits++;
+		cache->stats.depth += depth;
+		return block;
 	}
 
 	cache->stats.misses++;
@@ -174,6 +361,8 @@ static struct bcache_block *alloc_block(struct bcache *cache)
 			// add it to the tail of the lru
 			list_delete(&block->node);
 			list_add_tail(&cache->lru_list, &block->node);
+			if (list_in_list(&block->hash_node))
+				list_delete(&block->hash_node);
 			return block;
 		}
 	}
@@ -181,34 +370,132 @@ static struct bcache_block *alloc_block(struct bcache *cache)
 	return NULL;
 }
 
-static struct bcache_block *find_or_fill_block(struct bcache *cache, uint blocknum)
+/* number of blocks to fetch for a miss at blocknum, including blocknum itself */
+static uint readahead_count(struct bcache *cache, uint blocknum)
 {
-	int err;
+	uint32_t depth = 0;
+	uint count, i;
 
-	LTRACEF("block %u\n", blocknum);
+	if (cache->ra_window < 2)
+		return 1;
 
-	/* see if it's already in the cache */
-	struct bcache_block *block = find_block(cache, blocknum);
-	if (block == NULL) {
-		LTRACEF("wasn't allocated\n");
+	/* stay within the device */
+	count = cache->ra_window;
+	if (cache->dev->size > 0)
+		count = MIN((off_t)count, cache->dev->size / (off_t)cache->block_size - blocknum);
 
-		/* allocate a new block and fill it */
-		block = alloc_block(cache);
-		DEBUG_ASSERT(block);
+	/* stop at the first block that is cached already */
+	for (i = 1; i < count; i++)
+		if (lookup_block(cache, blocknum + i, &depth))
+			break;
 
-		LTRACEF("wasn't allocated, new block %p\n", block);
+	return MAX(i, 1U);
+}
 
-		block->blocknum = blocknum;
-		err = bio_read(cache->dev, block->ptr, (off_t)blocknum * cache->block_size, cache->block_size);
+static void release_block(struct bcache *cache, struct bcache_block *block)
+{
+	block->ref_count--;
+	list_delete(&block->node);
+	list_add_tail(&cache->free_list, &block->node);
+}
+
+/* fetch blocknum and read-ahead the following ones, returns blocknum's block */
+static struct bcache_block *fill_blocks(struct bcache *cache, uint blocknum, uint count)
+{
+	struct bcache_block *blocks[BCACHE_READAHEAD_MAX];
+	struct bio_vec iov[BCACHE_READAHEAD_MAX];
+	size_t len = 0;
+	ssize_t err = -1;
+	uint i, n;
+
+	/* the blocks are referenced during the read, so they are not recycled for each other */
+	for (n = 0; n < count; n++) {
+		blocks[n] = alloc_block(cache);
+		if (!blocks[n]) {
+			/* every block is referenced or could not be written back */
+			break;
+		}
+
+		LTRACEF("wasn't allocated, new block %p\n", blocks[n]);
+
+		blocks[n]->blocknum = blocknum + n;
+		blocks[n]->ref_count++;
+		iov[n].buf = blocks[n]->ptr;
+		iov[n].len = cache->block_size;
+		len += cache->block_size;
+	}
+
+	if (n == 0)
+		return NULL;
+
+	if (n > 1) {
+		if (cache->dev->readv) {
+			/* read straight into the blocks */
+			err = bio_readv(cache->dev, iov, n, (off_t)blocknum * cache->block_size);
+		} else {
+			err = bio_read(cache->dev, cache->ra_buf, (off_t)blocknum * cache->block_size, len);
+			if (err == (ssize_t)len) {
+				for (i = 0; i < n; i++)
+					memcpy(blocks[i]->ptr, (uint8_t *)cache->ra_buf + i * cache->block_size, cache->block_size);
+			}
+		}
+
+		if (err != (ssize_t)len) {
+			/* maybe only the read-ahead part failed */
+			for (i = 1; i < n; i++)
+				release_block(cache, blocks[i]);
+			n = 1;
+		}
+	}
+
+	if (n == 1) {
+		err = bio_read(cache->dev, blocks[0]->ptr, (off_t)blocknum * cache->block_size, cache->block_size);
 		if (err < 0) {
 			/* free the block, return an error */
-			list_add_tail(&cache->free_list, &block->node);
+			release_block(cache, blocks[0]);
 			return NULL;
 		}
+	}
 
+	for (i = 0; i < n; i++) {
+		list_add_head(hash_bucket(cache, blocks[i]->blocknum), &blocks[i]->hash_node);
+		blocks[i]->ref_count--;
 		cache->stats.reads++;
 	}
 
+	return blocks[0];
+}
+
+static struct bcache_block *find_or_fill_block(struct bcache *cache, uint blocknum)
+{
+	bool sequential = blocknum == cache->ra_next;
+
+	LTRACEF("block %u\n", blocknum);
+
+	/* see if it's already in the cache */
+	struct bcache_block *block = find_block(cache, blocknum);
+	if (block == NULL) {
+		LTRACEF("wasn't allocated\n");
+
+		/*
+		 * Grow the read-ahead window while the misses continue where
+		 * the previous access stopped, go back to single blocks on
+		 * random access.
+		 */
+		if (sequential)
+			cache->ra_window = MIN(cache->ra_window * 2, cache->ra_max);
+		else
+			cache->ra_window = 1;
+
+		block = fill_blocks(cache, blocknum, readahead_count(cache, blocknum));
+		if (block == NULL)
+			return NULL;
+		cache->ra_next = blocknum + 1;
+	} else if (sequential) {
+		/* random hits (e.g. inode tables) don't interrupt a sequence */
+		cache->ra_next = blocknum + 1;
+	}
+
 	DEBUG_ASSERT(block->blocknum == blocknum);
 
 	return block;
@@ -216,7 +503,7 @@ static struct bcache_block *find_or_fill_block(struct bcache *cache, uint blockn
 
 int bcache_read_block(bcache_t _cache, void *buf, uint blocknum)
 {
-	struct bcache *cache = _cache;
+	struct bcache *cache = resolve_cache(_cache, &blocknum);
 
 	LTRACEF("buf %p, blocknum %u\n", buf, blocknum);
 
@@ -230,9 +517,50 @@ int bcache_read_block(bcache_t _cache, void *buf, uint blocknum)
 	return 0;
 }
 
+/*
+ * Fetch metadata that is known to be needed soon (e.g. inode table blocks)
+ * in one go, instead of a separate request for each block on the first
+ * access. Runs of uncached blocks are read like the sequential read-ahead,
+ * so a single prefetch never takes more than ra_max blocks of the cache.
+ */
+int bcache_prefetch(bcache_t _cache, uint blocknum, uint count)
+{
+	struct bcache *cache = resolve_cache(_cache, &blocknum);
+	uint32_t depth = 0;
+	uint end, n;
+
+	if (cache->dev->size > 0)
+		count = MIN((off_t)count, cache->dev->size / (off_t)cache->block_size - blocknum);
+
+	for (end = blocknum + count; blocknum < end; blocknum += n) {
+		for (n = 0; blocknum + n < end && n < MAX(cache->ra_max, 1U); n++)
+			if (lookup_block(cache, blocknum + n, &depth))
+				break;
+
+		if (n == 0) {
+			n = 1;
+			continue;
+		}
+
+		LTRACEF("block %u, count %u\n", blocknum, n);
+		if (!fill_blocks(cache, blocknum, n))
+			return ERR_IO;
+	}
+
+	return NO_ERROR;
+}
+
+uint bcache_prefetch_max(bcache_t _cache)
+{
+	uint blocknum = 0;
+	struct bcache *cache = resolve_cache(_cache, &blocknum);
+
+	return MAX(cache->ra_max, 1U);
+}
+
 int bcache_get_block(bcache_t _cache, void **ptr, uint blocknum)
 {
-	struct bcache *cache = _cache;
+	struct bcache *cache = resolve_cache(_cache, &blocknum);
 
 	LTRACEF("ptr %p, blocknum %u\n", ptr, blocknum);
 
@@ -253,7 +581,7 @@ int bcache_get_block(bcache_t _cache, void **ptr, uint blocknum)
 
 int bcache_put_block(bcache_t _cache, uint blocknum)
 {
-	struct bcache *cache = _cache;
+	struct bcache *cache = resolve_cache(_cache, &blocknum);
 
 	LTRACEF("blocknum %u\n", blocknum);
 
@@ -271,7 +599,7 @@ int bcache_put_block(bcache_t _cache, uint blocknum)
 int bcache_mark_block_dirty(bcache_t priv, uint blocknum)
 {
 	int err;
-	struct bcache *cache = priv;
+	struct bcache *cache = resolve_cache(priv, &blocknum);
 	struct bcache_block *block;
 
 	block = find_block(cache, blocknum);
@@ -289,7 +617,7 @@ exit:
 int bcache_zero_block(bcache_t priv, uint blocknum)
 {
 	int err;
-	struct bcache *cache = priv;
+	struct bcache *cache = resolve_cache(priv, &blocknum);
 	struct bcache_block *block;
 
 	block = find_block(cache, blocknum);
@@ -301,6 +629,7 @@ int bcache_zero_block(bcache_t priv, uint blocknum)
 		}
 
 		block->blocknum = blocknum;
+		list_add_head(hash_bucket(cache, blocknum), &block->hash_node);
 	}
 
 	memset(block->ptr, 0, cache->block_size);
@@ -310,10 +639,34 @@ exit:
 	return (err);
 }
 
+void bcache_invalidate(bcache_t priv, uint blocknum, uint count)
+{
+	struct bcache *cache = resolve_cache(priv, &blocknum);
+	struct bcache_block *block;
+	uint32_t depth = 0;
+	uint i;
+
+	for (i = 0; i < count; i++) {
+		block = lookup_block(cache, blocknum + i, &depth);
+		if (!block)
+			continue;
+
+		DEBUG_ASSERT(block->ref_count == 0);
+		list_delete(&block->hash_node);
+		list_delete(&block->node);
+		list_add_tail(&cache->free_list, &block->node);
+		block->is_dirty = false;
+	}
+}
+
 int bcache_flush(bcache_t priv)
 {
 	int err;
 	struct bcache *cache = priv;
+
+	/* flushes the blocks of the other subdevices too */
+	if (cache->shared)
+		cache = cache->shared;
 	struct bcache_block *block;
 
 	list_for_every_entry(&cache->lru_list, block, struct bcache_block, node) {
@@ -334,6 +687,9 @@ void bcache_dump(bcache_t priv, const char *name)
 	uint32_t finds;
 	struct bcache *cache = priv;
 
+	if (cache->shared)
+		cache = cache->shared;
+
 	finds = cache->stats.hits + cache->stats.misses;
 
 	printf("%s: hits=%u(%u%%) depth=%u misses=%u(%u%%) reads=%u writes=%u\n",
@@ -1,6 +1,8 @@
 LOCAL_DIR := $(GET_LOCAL_DIR)
 
-MODULES += lib/bio
+MODULES += \
+	lib/bio \
+	lib/dmapool
 
 OBJS += \
 	$(LOCAL_DIR)/bcache.o
@@ -27,6 +27,7 @@
 #include <list.h>
 #include <lib/bio.h>
 #include <kernel/mutex.h>
+#include <platform.h>
 
 #define LOCAL_TRACE 0
 
@@ -35,6 +36,26 @@ static struct bdev_struct *bdevs;
 /* low level access to the device list, user must lock the mutex */
 struct bdev_struct *bio_get_bdevs(void) { return bdevs; }
 
+static void bio_account(struct bio_op_stats *op, ssize_t result, bigtime_t start)
+{
+	op->ops++;
+	if (result > 0)
+		op->bytes += result;
+	op->time += current_time_hires() - start;
+}
+
+static void bio_account_read(bdev_t *dev, ssize_t result, bigtime_t start)
+{
+	bigtime_t t = current_time_hires() - start;
+	uint bucket = 0;
+
+	bio_account(&dev->stats.read, result, start);
+
+	while (bucket < BIO_LATENCY_BUCKETS - 1 && t >= (2ULL << bucket))
+		bucket++;
+	dev->stats.latency[bucket]++;
+}
+
 /* default implementation is to use the read_block hook to 'deblock' the device */
 static ssize_t bio_default_read(struct bdev *dev, void *_buf, off_t offset, size_t len)
 {
@@ -289,7 +310,118 @@ ssize_t bio_read(bdev_t *dev, void *buf, off_t offset, size_t len)
 	if (offset + len > dev->size)
 		len = dev->size - offset;
 
-	return dev->read(dev, buf, offset, len);
+	/* the default implementation is accounted in bio_read_block() */
+	if (dev->read == bio_default_read)
+		return dev->read(dev, buf, offset, len);
+
+	bigtime_t start = current_time_hires();
+	ssize_t ret = dev->read(dev, buf, offset, len);
+	bio_account_read(dev, ret, start);
+	return ret;
+}
+
+/*
+ * read consecutive data from the device into several buffers. devices that
+ * support it do this with a single transfer, otherwise every buffer is read
+ * separately.
+ */
+ssize_t bio_readv(bdev_t *dev, const struct bio_vec *iov, uint iovcnt, off_t offset)
+{
+	ssize_t bytes_read = 0, err;
+	size_t len = 0;
+	uint i;
+
+	LTRACEF("dev '%s', iovcnt %u, offset %lld\n", dev->name, iovcnt, offset);
+
+	DEBUG_ASSERT(dev->ref > 0);
+
+	for (i = 0; i < iovcnt; i++)
+		len += iov[i].len;
+
+	/* range check */
+	if (offset < 0)
+		return -1;
+	if (offset >= dev->size || len == 0)
+		return 0;
+
+	/* the fast path can only do complete requests */
+	if (dev->readv && offset + (off_t)len <= dev->size) {
+		bigtime_t start = current_time_hires();
+		err = dev->readv(dev, iov, iovcnt, offset);
+		if (err != ERR_NOT_SUPPORTED) {
+			bio_account_read(dev, err, start);
+			return err;
+		}
+	}
+
+	for (i = 0; i < iovcnt; i++) {
+		err = bio_read(dev, iov[i].buf, offset + bytes_read, iov[i].len);
+		if (err < 0)
+			return err;
+		bytes_read += err;
+		if ((size_t)err < iov[i].len)
+			break;
+	}
+
+	return bytes_read;
+}
+
+/*
+ * start an asynchronous read of req->len bytes at req->offset into req->buf.
+ * the request must stay valid until it is completed. devices without native
+ * support complete it immediately with a synchronous read.
+ */
+status_t bio_submit(bdev_t *dev, struct bio_request *req)
+{
+	LTRACEF("dev '%s', buf %p, offset %lld, len %zd\n", dev->name, req->buf, req->offset, req->len);
+
+	DEBUG_ASSERT(dev->ref > 0);
+
+	req->dev = dev;
+	req->start = current_time_hires();
+	event_init(&req->done, false, 0);
+
+	/* range check */
+	if (req->offset < 0)
+		return -1;
+	if (req->offset >= dev->size || req->len == 0) {
+		bio_complete(req, 0);
+		return 0;
+	}
+	if (req->offset + (off_t)req->len > dev->size)
+		req->len = dev->size - req->offset;
+
+	if (dev->submit)
+		return dev->submit(dev, req);
+
+	bio_complete(req, dev->read(dev, req->buf, req->offset, req->len));
+	return 0;
+}
+
+status_t bio_read_async(bdev_t *dev, struct bio_request *req, void *buf, off_t offset, size_t len)
+{
+	req->buf = buf;
+	req->offset = offset;
+	req->len = len;
+	return bio_submit(dev, req);
+}
+
+/* wait until a submitted request is complete, returns its result */
+ssize_t bio_wait(struct bio_request *req)
+{
+	event_wait(&req->done);
+	return req->result;
+}
+
+void bio_complete(struct bio_request *req, ssize_t result)
+{
+	if (req->len)
+		bio_account_read(req->dev, result, req->start);
+
+	req->result = result;
+	if (req->callback)
+		req->callback(req);
+	event_signal(&req->done, false);
 }
 
 ssize_t bio_read_block(bdev_t *dev, void *buf, bnum_t block, uint count)
@@ -306,7 +438,10 @@ ssize_t bio_read_block(bdev_t *dev, void *buf, bnum_t block, uint count)
 	if (block + count > dev->block_count)
 		count = dev->block_count - block;
 
-	return dev->read_block(dev, buf, block, count);
+	bigtime_t start = current_time_hires();
+	ssize_t ret = dev->read_block(dev, buf, block, count);
+	bio_account_read(dev, ret, start);
+	return ret;
 }
 
 ssize_t bio_write(bdev_t *dev, const void *buf, off_t offset, size_t len)
@@ -325,7 +460,14 @@ ssize_t bio_write(bdev_t *dev, const void *buf, off_t offset, size_t len)
 	if (offset + len > dev->size)
 		len = dev->size - offset;
 
-	return dev->write(dev, buf, offset, len);
+	/* the default implementation is accounted in bio_write_block() */
+	if (dev->write == bio_default_write)
+		return dev->write(dev, buf, offset, len);
+
+	bigtime_t start = current_time_hires();
+	ssize_t ret = dev->write(dev, buf, offset, len);
+	bio_account(&dev->stats.write, ret, start);
+	return ret;
 }
 
 ssize_t bio_write_block(bdev_t *dev, const void *buf, bnum_t block, uint count)
@@ -342,7 +484,10 @@ ssize_t bio_write_block(bdev_t *dev, const void *buf, bnum_t block, uint count)
 	if (block + count > dev->block_count)
 		count = dev->block_count - block;
 
-	return dev->write_block(dev, buf, block, count);
+	bigtime_t start = current_time_hires();
+	ssize_t ret = dev->write_block(dev, buf, block, count);
+	bio_account(&dev->stats.write, ret, start);
+	return ret;
 }
 
 ssize_t bio_erase(bdev_t *dev, off_t offset, size_t len)
@@ -361,7 +506,10 @@ ssize_t bio_erase(bdev_t *dev, off_t offset, size_t len)
 	if (offset + len > dev->size)
 		len = dev->size - offset;
 
-	return dev->erase(dev, offset, len);
+	bigtime_t start = current_time_hires();
+	ssize_t ret = dev->erase(dev, offset, len);
+	bio_account(&dev->stats.erase, ret, start);
+	return ret;
 }
 
 int bio_ioctl(bdev_t *dev, int request, void *argp)
@@ -390,6 +538,7 @@ void bio_initialize_bdev(bdev_t *dev, const char *name, size_t block_size, bnum_
 
 	dev->is_leaf = false;
 	dev->label = NULL;
+	memset(&dev->stats, 0, sizeof(dev->stats));
 
 	/* set up the default hooks, the sub driver should override the block operations at least */
 	dev->read = bio_default_read;
@@ -397,6 +546,8 @@ void bio_initialize_bdev(bdev_t *dev, const char *name, size_t block_size, bnum_
 	dev->write = bio_default_write;
 	dev->write_block = bio_default_write_block;
 	dev->erase = bio_default_erase;
+	dev->submit = NULL;
+	dev->readv = NULL;
 	dev->close = NULL;
 }
 
@@ -438,6 +589,46 @@ void bio_dump_devices(void)
 	mutex_release(&bdevs->lock);
 }
 
+static void bio_dump_op_stats(const char *name, const struct bio_op_stats *op, size_t block_size)
+{
+	if (!op->ops)
+		return;
+
+	printf("\t\t%s: %u ops, %llu bytes (%llu blocks, %llu avg), %llu us (%llu avg)\n",
+	       name, op->ops, op->bytes, op->bytes / block_size, op->bytes / op->ops,
+	       op->time, op->time / op->ops);
+}
+
+/* dump the statistics of dev, or of all devices that were used if it is NULL */
+void bio_dump_stats(bdev_t *dev)
+{
+	bdev_t *entry;
+	uint i;
+
+	mutex_acquire(&bdevs->lock);
+	list_for_every_entry(&bdevs->list, entry, bdev_t, node) {
+		struct bio_stats *stats = &entry->stats;
+
+		if (dev ? entry != dev : !(stats->read.ops || stats->write.ops || stats->erase.ops))
+			continue;
+
+		printf("\t%s:\n", entry->name);
+		bio_dump_op_stats("read", &stats->read, entry->block_size);
+		bio_dump_op_stats("write", &stats->write, entry->block_size);
+		bio_dump_op_stats("erase", &stats->erase, entry->block_size);
+
+		if (!dev)
+			continue;
+
+		for (i = 0; i < BIO_LATENCY_BUCKETS; i++) {
+			if (stats->latency[i])
+				printf("\t\t%s%u us: %u reads\n", i == BIO_LATENCY_BUCKETS - 1 ? ">= " : "< ",
+				       2U << (i == BIO_LATENCY_BUCKETS - 1 ? i - 1 : i), stats->latency[i]);
+		}
+	}
+	mutex_release(&bdevs->lock);
+}
+
 void bio_init(void)
 {
 	bdevs = malloc(sizeof(*bdevs));
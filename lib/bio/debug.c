@@ -45,6 +45,7 @@ static int cmd_bio(int argc, const cmd_args *argv)
 		printf("not enough arguments:\n");
 usage:
 		printf("%s list\n", argv[0].str);
+		printf("%s stats [<device>]\n", argv[0].str);
 		printf("%s read <device> <address> <offset> <len>\n", argv[0].str);
 		printf("%s write <device> <address> <offset> <len>\n", argv[0].str);
 		printf("%s erase <device> <offset> <len>\n", argv[0].str);
@@ -58,6 +59,21 @@ usage:
 
 	if (!strcmp(argv[1].str, "list")) {
 		bio_dump_devices();
+	} else if (!strcmp(argv[1].str, "stats")) {
+		bdev_t *dev = NULL;
+
+		if (argc > 2) {
+			dev = bio_open(argv[2].str);
+			if (!dev) {
+				printf("error opening block device\n");
+				return -1;
+			}
+		}
+
+		bio_dump_stats(dev);
+
+		if (dev)
+			bio_close(dev);
 	} else if (!strcmp(argv[1].str, "read")) {
 		if (argc < 6) {
 			printf("not enough arguments:\n");
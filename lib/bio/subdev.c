@@ -44,6 +44,21 @@ static ssize_t subdev_read(struct bdev *_dev, void *buf, off_t offset, size_t le
 	return bio_read(subdev->parent, buf, offset + (off_t)subdev->offset * subdev->dev.block_size, len);
 }
 
+static status_t subdev_submit(struct bdev *_dev, struct bio_request *req)
+{
+	subdev_t *subdev = (subdev_t *)_dev;
+
+	req->offset += (off_t)subdev->offset * subdev->dev.block_size;
+	return bio_submit(subdev->parent, req);
+}
+
+static ssize_t subdev_readv(struct bdev *_dev, const struct bio_vec *iov, uint iovcnt, off_t offset)
+{
+	subdev_t *subdev = (subdev_t *)_dev;
+
+	return bio_readv(subdev->parent, iov, iovcnt, offset + (off_t)subdev->offset * subdev->dev.block_size);
+}
+
 static ssize_t subdev_read_block(struct bdev *_dev, void *buf, bnum_t block, uint count)
 {
 	subdev_t *subdev = (subdev_t *)_dev;
@@ -80,6 +95,20 @@ static void subdev_close(struct bdev *_dev)
 	subdev->parent = NULL;
 }
 
+bdev_t *bio_get_root(bdev_t *dev, off_t *offset)
+{
+	*offset = 0;
+
+	while (dev->read == &subdev_read) {
+		subdev_t *subdev = (subdev_t *)dev;
+
+		*offset += (off_t)subdev->offset * subdev->dev.block_size;
+		dev = subdev->parent;
+	}
+
+	return dev;
+}
+
 status_t bio_publish_subdevice(const char *parent_dev, const char *subdev, bnum_t startblock, size_t len)
 {
 	LTRACEF("parent %s, sub %s, startblock %u, len %zd\n", parent_dev, subdev, startblock, len);
@@ -107,6 +136,10 @@ status_t bio_publish_subdevice(const char *parent_dev, const char *subdev, bnum_
 
 	sub->dev.read = &subdev_read;
 	sub->dev.read_block = &subdev_read_block;
+	if (parent->submit)
+		sub->dev.submit = &subdev_submit;
+	if (parent->readv)
+		sub->dev.readv = &subdev_readv;
 	sub->dev.write = &subdev_write;
 	sub->dev.write_block = &subdev_write_block;
 	sub->dev.erase = &subdev_erase;
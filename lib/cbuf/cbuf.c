@@ -25,14 +25,37 @@
 #include <pow2.h>
 #include <string.h>
 #include <lib/cbuf.h>
+#include <arch/defines.h>
 #include <kernel/event.h>
+#include <kernel/thread.h>
 
 #define LOCAL_TRACE 0
 
 #define INC_POINTER(cbuf, ptr, inc) \
 	modpow2(((ptr) + (inc)), (cbuf)->len_pow2)
 
-void cbuf_initialize(cbuf_t *cbuf, size_t len)
+/*
+ * In SPSC mode the producer only writes head and the consumer only writes
+ * tail. The barrier orders the accesses to the data before publishing the
+ * new index to the other side.
+ */
+#ifdef dmb
+#define cbuf_barrier() dmb()
+#else
+#define cbuf_barrier() __sync_synchronize()
+#endif
+
+static inline uint cbuf_load(const uint *index)
+{
+	return *(const volatile uint *)index;
+}
+
+static inline void cbuf_store(uint *index, uint val)
+{
+	*(volatile uint *)index = val;
+}
+
+static void cbuf_init(cbuf_t *cbuf, size_t len, void *buf, bool spsc)
 {
 	DEBUG_ASSERT(cbuf);
 	DEBUG_ASSERT(len > 0);
@@ -40,21 +63,86 @@ void cbuf_initialize(cbuf_t *cbuf, size_t len)
 
 	cbuf->head = 0;
 	cbuf->tail = 0;
-	cbuf->len_pow2 = log2(len);
-	cbuf->buf = malloc(len);
+	cbuf->len_pow2 = log2_uint(len);
+	cbuf->buf = buf ? buf : malloc(len);
+	cbuf->spsc = spsc;
 	event_init(&cbuf->event, false, 0);
 
-	LTRACEF("len %zd, len_pow2 %u\n", len, cbuf->len_pow2);
+	LTRACEF("len %zd, len_pow2 %u, spsc %d\n", len, cbuf->len_pow2, spsc);
+}
+
+void cbuf_initialize(cbuf_t *cbuf, size_t len)
+{
+	cbuf_init(cbuf, len, NULL, false);
+}
+
+void cbuf_initialize_spsc(cbuf_t *cbuf, size_t len, void *buf)
+{
+	cbuf_init(cbuf, len, buf, true);
+}
+
+/* Contiguous free space at head, one byte stays free to tell full from empty */
+static size_t cbuf_write_span(cbuf_t *cbuf, uint head, uint tail)
+{
+	if (head >= tail)
+		return valpow2(cbuf->len_pow2) - head - (tail == 0);
+	return tail - head - 1;
+}
+
+/* Contiguous data at tail */
+static size_t cbuf_read_span(cbuf_t *cbuf, uint head, uint tail)
+{
+	if (head >= tail)
+		return head - tail;
+	return valpow2(cbuf->len_pow2) - tail;
 }
 
-static size_t cbuf_space_avail(cbuf_t *cbuf)
+size_t cbuf_write_bulk(cbuf_t *cbuf, void **buf)
 {
-	return (cbuf->head + valpow2(cbuf->len_pow2) - cbuf->tail - 1);
+	uint head = cbuf->head;
+
+	*buf = cbuf->buf + head;
+	return cbuf_write_span(cbuf, head, cbuf_load(&cbuf->tail));
+}
+
+/* Returns whether the buffer was empty before */
+static bool cbuf_advance_head(cbuf_t *cbuf, size_t len)
+{
+	uint head = cbuf->head;
+
+	DEBUG_ASSERT(len <= cbuf_write_span(cbuf, head, cbuf_load(&cbuf->tail)));
+
+	cbuf_barrier();
+	cbuf_store(&cbuf->head, INC_POINTER(cbuf, head, len));
+	cbuf_barrier();
+	return head == cbuf_load(&cbuf->tail);
+}
+
+void cbuf_write_commit(cbuf_t *cbuf, size_t len, bool canreschedule)
+{
+	bool was_empty;
+
+	if (!len)
+		return;
+
+	if (!cbuf->spsc)
+		enter_critical_section();
+
+	was_empty = cbuf_advance_head(cbuf, len);
+	if (was_empty || !cbuf->spsc)
+		event_signal(&cbuf->event, canreschedule);
+
+	if (!cbuf->spsc)
+		exit_critical_section();
 }
 
 size_t cbuf_write(cbuf_t *cbuf, const void *_buf, size_t len, bool canreschedule)
 {
 	const char *buf = (const char *)_buf;
+	bool was_empty = false;
+	size_t write_len;
+	size_t pos = 0;
+	void *span;
 
 	LTRACEF("len %zd\n", len);
 
@@ -62,85 +150,113 @@ size_t cbuf_write(cbuf_t *cbuf, const void *_buf, size_t len, bool canreschedule
 	DEBUG_ASSERT(_buf);
 	DEBUG_ASSERT(len < valpow2(cbuf->len_pow2));
 
-	enter_critical_section();
+	if (!cbuf->spsc)
+		enter_critical_section();
 
-	size_t write_len;
-	size_t pos = 0;
+	// at most two passes to deal with wraparound, stop if it's full
+	while (pos < len && (write_len = cbuf_write_bulk(cbuf, &span)) > 0) {
+		write_len = MIN(write_len, len - pos);
+		memcpy(span, buf + pos, write_len);
+		was_empty |= cbuf_advance_head(cbuf, write_len);
+		pos += write_len;
+	}
 
-	while (pos < len && cbuf_space_avail(cbuf) > 0) {
-		if (cbuf->head >= cbuf->tail) {
-			write_len = MIN(valpow2(cbuf->len_pow2) - cbuf->head, len - pos);
-		} else {
-			write_len = MIN(cbuf->tail - cbuf->head - 1, len - pos);
-		}
+	if (cbuf->spsc) {
+		if (was_empty)
+			event_signal(&cbuf->event, canreschedule);
+	} else {
+		if (cbuf->head != cbuf->tail)
+			event_signal(&cbuf->event, canreschedule);
+		exit_critical_section();
+	}
 
-		// if it's full, abort and return how much we've written
-		if (write_len == 0) {
-			break;
-		}
+	return pos;
+}
 
-		memcpy(cbuf->buf + cbuf->head, buf + pos, write_len);
+size_t cbuf_read_bulk(cbuf_t *cbuf, void **buf)
+{
+	uint tail = cbuf->tail;
+	size_t len = cbuf_read_span(cbuf, cbuf_load(&cbuf->head), tail);
 
-		cbuf->head = INC_POINTER(cbuf, cbuf->head, write_len);
-		pos += write_len;
-	}
+	/* Read the data only after seeing the new head */
+	cbuf_barrier();
+	*buf = cbuf->buf + tail;
+	return len;
+}
 
-	if (cbuf->head != cbuf->tail)
-		event_signal(&cbuf->event, canreschedule);
+static void cbuf_advance_tail(cbuf_t *cbuf, size_t len)
+{
+	DEBUG_ASSERT(len <= cbuf_read_span(cbuf, cbuf_load(&cbuf->head), cbuf->tail));
+
+	cbuf_barrier();
+	cbuf_store(&cbuf->tail, INC_POINTER(cbuf, cbuf->tail, len));
+}
+
+void cbuf_read_commit(cbuf_t *cbuf, size_t len)
+{
+	if (!len)
+		return;
+
+	if (cbuf->spsc) {
+		cbuf_advance_tail(cbuf, len);
+		return;
+	}
 
+	enter_critical_section();
+	cbuf_advance_tail(cbuf, len);
+	if (cbuf->tail == cbuf->head)
+		event_unsignal(&cbuf->event);
 	exit_critical_section();
+}
 
-	return pos;
+/* Wait for data without blocking the producer, see cbuf_write_commit() */
+static void cbuf_wait_spsc(cbuf_t *cbuf)
+{
+	while (cbuf_load(&cbuf->head) == cbuf->tail) {
+		event_unsignal(&cbuf->event);
+		cbuf_barrier();
+		if (cbuf_load(&cbuf->head) != cbuf->tail)
+			break;
+		event_wait(&cbuf->event);
+	}
 }
 
 size_t cbuf_read(cbuf_t *cbuf, void *_buf, size_t buflen, bool block)
 {
-	size_t ret;
 	char *buf = (char *)_buf;
+	size_t read_len;
+	size_t pos = 0;
+	void *span;
 
 	DEBUG_ASSERT(cbuf);
 	DEBUG_ASSERT(_buf);
 
-	enter_critical_section();
-
-	if (block)
-		event_wait(&cbuf->event);
+	if (cbuf->spsc) {
+		if (block)
+			cbuf_wait_spsc(cbuf);
+	} else {
+		enter_critical_section();
+		if (block)
+			event_wait(&cbuf->event);
+	}
 
-	// see if there's data available
-	if (cbuf->tail != cbuf->head) {
-		size_t pos = 0;
-
-		// loop until we've read everything we need
-		// at most this will make two passes to deal with wraparound
-		while (pos < buflen && cbuf->tail != cbuf->head) {
-			size_t read_len;
-			if (cbuf->head > cbuf->tail) {
-				// simple case where there is no wraparound
-				read_len = MIN(cbuf->head - cbuf->tail, buflen - pos);
-			} else {
-				// read to the end of buffer in this pass
-				read_len = MIN(valpow2(cbuf->len_pow2) - cbuf->tail, buflen - pos);
-			}
-
-			memcpy(buf + pos, cbuf->buf + cbuf->tail, read_len);
-
-			cbuf->tail = INC_POINTER(cbuf, cbuf->tail, read_len);
-			pos += read_len;
-		}
+	// loop until we've read everything we need
+	// at most this will make two passes to deal with wraparound
+	while (pos < buflen && (read_len = cbuf_read_bulk(cbuf, &span)) > 0) {
+		read_len = MIN(read_len, buflen - pos);
+		memcpy(buf + pos, span, read_len);
+		cbuf_advance_tail(cbuf, read_len);
+		pos += read_len;
+	}
 
+	if (!cbuf->spsc) {
 		if (cbuf->tail == cbuf->head) {
 			// we've emptied the buffer, unsignal the event
 			event_unsignal(&cbuf->event);
 		}
-
-		ret = pos;
-	} else {
-		DEBUG_ASSERT(!block);
-		ret = 0;
+		exit_critical_section();
 	}
 
-	exit_critical_section();
-
-	return ret;
+	DEBUG_ASSERT(pos > 0 || !block);
+	return pos;
 }
-
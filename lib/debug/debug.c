@@ -85,6 +85,7 @@ void _panic(void *caller, const char *fmt, ...)
 
 int _dputs(const char *str)
 {
+	dlog_flush();
 	while(*str != 0) {
 		_dputc(*str++);
 	}
@@ -104,6 +105,7 @@ int _dprintf(const char *fmt, ...)
 	char ts_buf[13];
 	int err;
 
+	dlog_flush();
 	snprintf(ts_buf, sizeof(ts_buf), "[%u] ",(unsigned int)current_time());
 	dputs(ALWAYS, ts_buf);
 
@@ -119,6 +121,7 @@ int _dvprintf(const char *fmt, va_list ap)
 {
 	int err;
 
+	dlog_flush();
 	err = _printf_engine(&_dprintf_output_func, NULL, fmt, ap);
 
 	return err;
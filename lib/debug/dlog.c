@@ -0,0 +1,343 @@
+// SPDX-License-Identifier: BSD-3-Clause
+
+#include <debug.h>
+#include <limits.h>
+#include <platform.h>
+#include <printf.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <kernel/thread.h>
+
+/*
+ * dlog.c - Deferred binary log for dprintf(INFO/SPEW, ...).
+ *
+ * Instead of formatting each message right away, only the timestamp, the
+ * format string pointer and the raw arguments are copied into a ring buffer.
+ * Strings are copied as well since they often live on the stack. The records
+ * are formatted into the normal output (log buffer, UART, display) by the idle
+ * thread, before the next synchronous message and when the log is read.
+ *
+ * Messages that cannot be recorded (format string outside of the lk image,
+ * %n, too many or too long arguments) are printed synchronously as before.
+ * The conversions are parsed exactly like _printf_engine() does it.
+ */
+
+#if WITH_DEBUG_LOG_BINARY
+
+#ifndef DLOG_RING_SIZE
+#define DLOG_RING_SIZE		8192	/* bytes, must be a power of two */
+#endif
+
+#define DLOG_RING_WORDS		(DLOG_RING_SIZE / sizeof(uint32_t))
+#define DLOG_RECORD_WORDS	64
+#define DLOG_SPEC_MAX		16
+
+enum dlog_arg {
+	DLOG_ARG_NONE,		/* conversion without argument, e.g. %% */
+	DLOG_ARG_INT,
+	DLOG_ARG_LONG,
+	DLOG_ARG_LLONG,
+	DLOG_ARG_SIZE,
+	DLOG_ARG_STR,
+	DLOG_ARG_INVALID,	/* %n or end of the format string */
+};
+
+struct dlog_record {
+	unsigned words;
+	uint32_t data[DLOG_RECORD_WORDS];
+};
+
+static uint32_t dlog_ring[DLOG_RING_WORDS];
+static unsigned dlog_head, dlog_tail;
+static bool dlog_flushing;
+
+/* Parse the conversion behind a '%', *fmt is moved behind it */
+static enum dlog_arg dlog_parse(const char **fmt)
+{
+	bool half = false, size = false;
+	int longs = 0;
+
+	for (;;) {
+		switch (*(*fmt)++) {
+		case '0' ... '9':
+		case '.':
+		case '-':
+		case '+':
+		case '#':
+			continue;
+		case 'l':
+			longs++;
+			continue;
+		case 'h':
+			half = true;
+			continue;
+		case 'z':
+			size = true;
+			continue;
+		case 'c':
+			return DLOG_ARG_INT;
+		case 's':
+			return DLOG_ARG_STR;
+		case 'p':
+			return DLOG_ARG_LONG;
+		case 'D':
+		case 'U':
+			longs = MAX(longs, 1);
+			/* fallthrough */
+		case 'd':
+		case 'i':
+		case 'u':
+		case 'x':
+		case 'X':
+			if (longs > 1)
+				return DLOG_ARG_LLONG;
+			if (longs)
+				return DLOG_ARG_LONG;
+			if (!half && size)
+				return DLOG_ARG_SIZE;
+			return DLOG_ARG_INT;
+		case 'n':
+			return DLOG_ARG_INVALID;
+		case '\0':
+			(*fmt)--;
+			return DLOG_ARG_INVALID;
+		default:
+			return DLOG_ARG_NONE;
+		}
+	}
+}
+
+static bool dlog_put(struct dlog_record *rec, const void *val, size_t len)
+{
+	unsigned words = ROUNDUP(len, sizeof(uint32_t)) / sizeof(uint32_t);
+
+	if (rec->words + words > DLOG_RECORD_WORDS)
+		return false;
+
+	rec->data[rec->words + words - 1] = 0;
+	memcpy(&rec->data[rec->words], val, len);
+	rec->words += words;
+	return true;
+}
+
+static void dlog_get(const struct dlog_record *rec, unsigned *pos,
+		     void *val, size_t len)
+{
+	memcpy(val, &rec->data[*pos], len);
+	*pos += ROUNDUP(len, sizeof(uint32_t)) / sizeof(uint32_t);
+}
+
+#define dlog_put_arg(rec, ap, type) ({ \
+	type _v = va_arg(ap, type); \
+	dlog_put(rec, &_v, sizeof(_v)); \
+})
+
+#define dlog_get_arg(rec, pos, type) ({ \
+	type _v; \
+	dlog_get(rec, pos, &_v, sizeof(_v)); \
+	_v; \
+})
+
+static bool dlog_push(const struct dlog_record *rec)
+{
+	unsigned i;
+
+	enter_critical_section();
+	if (dlog_head - dlog_tail + rec->words + 1 > DLOG_RING_WORDS) {
+		exit_critical_section();
+		return false;
+	}
+
+	dlog_ring[dlog_head++ % DLOG_RING_WORDS] = rec->words;
+	for (i = 0; i < rec->words; i++)
+		dlog_ring[dlog_head++ % DLOG_RING_WORDS] = rec->data[i];
+	exit_critical_section();
+	return true;
+}
+
+static bool dlog_pop(struct dlog_record *rec)
+{
+	unsigned i;
+
+	enter_critical_section();
+	if (dlog_head == dlog_tail) {
+		exit_critical_section();
+		return false;
+	}
+
+	rec->words = dlog_ring[dlog_tail++ % DLOG_RING_WORDS];
+	for (i = 0; i < rec->words; i++)
+		rec->data[i] = dlog_ring[dlog_tail++ % DLOG_RING_WORDS];
+	exit_critical_section();
+	return true;
+}
+
+static int dlog_output_func(char c, void *state)
+{
+	_dputc(c);
+
+	return INT_MAX;
+}
+
+static void dlog_printf(const char *fmt, ...)
+{
+	va_list ap;
+
+	va_start(ap, fmt);
+	_printf_engine(&dlog_output_func, NULL, fmt, ap);
+	va_end(ap);
+}
+
+static void dlog_format(const struct dlog_record *rec)
+{
+	char spec[DLOG_SPEC_MAX];
+	const char *fmt, *p, *s;
+	unsigned pos = 0;
+	enum dlog_arg arg;
+	uint32_t time;
+
+	dlog_get(rec, &pos, &time, sizeof(time));
+	dlog_get(rec, &pos, &fmt, sizeof(fmt));
+	dlog_printf("[%u] ", time);
+
+	for (p = fmt; *p;) {
+		if (*p != '%') {
+			_dputc(*p++);
+			continue;
+		}
+
+		s = p++;
+		arg = dlog_parse(&p);
+		memcpy(spec, s, p - s);
+		spec[p - s] = '\0';
+
+		switch (arg) {
+		case DLOG_ARG_NONE:
+			dlog_printf(spec);
+			break;
+		case DLOG_ARG_INT:
+			dlog_printf(spec, dlog_get_arg(rec, &pos, int));
+			break;
+		case DLOG_ARG_LONG:
+			dlog_printf(spec, dlog_get_arg(rec, &pos, long));
+			break;
+		case DLOG_ARG_LLONG:
+			dlog_printf(spec, dlog_get_arg(rec, &pos, long long));
+			break;
+		case DLOG_ARG_SIZE:
+			dlog_printf(spec, dlog_get_arg(rec, &pos, size_t));
+			break;
+		case DLOG_ARG_STR:
+			s = (const char *)&rec->data[pos];
+			pos += ROUNDUP(strlen(s) + 1, sizeof(uint32_t)) / sizeof(uint32_t);
+			dlog_printf(spec, s);
+			break;
+		case DLOG_ARG_INVALID:
+			return;
+		}
+	}
+}
+
+/* Record the message, returns false if it must be printed synchronously */
+static bool dlog_record(uint32_t time, const char *fmt, va_list ap)
+{
+	extern const char _start[], __rodata_end[];
+	struct dlog_record rec = {0};
+	const char *p = fmt, *spec, *s;
+	bool ok = true;
+
+	/* The format string must still be there when it is formatted */
+	if (fmt < _start || fmt >= __rodata_end)
+		return false;
+
+	dlog_put(&rec, &time, sizeof(time));
+	dlog_put(&rec, &fmt, sizeof(fmt));
+
+	while (ok && (spec = strchr(p, '%'))) {
+		p = spec + 1;
+		switch (dlog_parse(&p)) {
+		case DLOG_ARG_NONE:
+			break;
+		case DLOG_ARG_INT:
+			ok = dlog_put_arg(&rec, ap, int);
+			break;
+		case DLOG_ARG_LONG:
+			ok = dlog_put_arg(&rec, ap, long);
+			break;
+		case DLOG_ARG_LLONG:
+			ok = dlog_put_arg(&rec, ap, long long);
+			break;
+		case DLOG_ARG_SIZE:
+			ok = dlog_put_arg(&rec, ap, size_t);
+			break;
+		case DLOG_ARG_STR:
+			s = va_arg(ap, const char *);
+			if (!s)
+				s = "<null>";
+			ok = dlog_put(&rec, s, strlen(s) + 1);
+			break;
+		case DLOG_ARG_INVALID:
+			ok = *p == '\0';
+			break;
+		}
+		ok = ok && p - spec < DLOG_SPEC_MAX;
+	}
+	if (!ok)
+		return false;
+
+	if (dlog_push(&rec))
+		return true;
+
+	/* Make room by formatting everything that is still pending */
+	dlog_flush();
+	return dlog_push(&rec);
+}
+
+int _dlog(const char *fmt, ...)
+{
+	uint32_t time = current_time();
+	char ts_buf[13];
+	va_list ap;
+	bool done;
+	int err;
+
+	va_start(ap, fmt);
+	done = dlog_record(time, fmt, ap);
+	va_end(ap);
+	if (done)
+		return 0;
+
+	snprintf(ts_buf, sizeof(ts_buf), "[%u] ", time);
+	_dputs(ts_buf);
+
+	va_start(ap, fmt);
+	err = _dvprintf(fmt, ap);
+	va_end(ap);
+
+	return err;
+}
+
+/*
+ * Format all pending records. If another thread is doing that already (e.g.
+ * the idle thread that was preempted), the remaining records are left to it.
+ */
+void dlog_flush(void)
+{
+	struct dlog_record rec;
+
+	enter_critical_section();
+	if (dlog_flushing || dlog_head == dlog_tail) {
+		exit_critical_section();
+		return;
+	}
+	dlog_flushing = true;
+	exit_critical_section();
+
+	while (dlog_pop(&rec))
+		dlog_format(&rec);
+
+	dlog_flushing = false;
+}
+
+#endif /* WITH_DEBUG_LOG_BINARY */
@@ -1,4 +1,5 @@
 LOCAL_DIR := $(GET_LOCAL_DIR)
 
 OBJS += \
-	$(LOCAL_DIR)/debug.o
+	$(LOCAL_DIR)/debug.o \
+	$(LOCAL_DIR)/dlog.o
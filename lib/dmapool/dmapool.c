@@ -0,0 +1,126 @@
+// SPDX-License-Identifier: BSD-3-Clause
+
+#include <assert.h>
+#include <debug.h>
+#include <err.h>
+#include <stdlib.h>
+#include <string.h>
+#include <arch/defines.h>
+#include <arch/ops.h>
+#include <kernel/thread.h>
+#include <lib/dmapool.h>
+
+#if ARM_WITH_MMU && !defined(LPAE)
+#include <arch/arm/mmu.h>
+
+static bool dma_pool_map_uncached(void *base, size_t len)
+{
+	return arm_mmu_remap_pages((addr_t)base, len,
+				   MMU_MEMORY_TYPE_NORMAL_WRITE_COMBINE |
+				   MMU_MEMORY_AP_READ_WRITE | MMU_MEMORY_XN);
+}
+#else
+static bool dma_pool_map_uncached(void *base, size_t len)
+{
+	return false;
+}
+#endif
+
+status_t dma_pool_init(struct dma_pool *pool, size_t size, unsigned int count, uint flags)
+{
+	size_t len;
+	unsigned int i;
+	uint8_t *buf;
+
+	memset(pool, 0, sizeof(*pool));
+	if (!size || !count)
+		return ERR_INVALID_ARGS;
+
+	pool->size = ROUNDUP(size, CACHE_LINE);
+	pool->count = count;
+	len = pool->size * count;
+
+	/* Uncached pools need whole pages, which are not shared with the heap */
+	if (flags & DMA_POOL_UNCACHED) {
+		len = ROUNDUP(len, PAGE_SIZE);
+		pool->base = memalign(PAGE_SIZE, len);
+		if (pool->base)
+			pool->uncached = dma_pool_map_uncached(pool->base, len);
+	} else {
+		pool->base = memalign(CACHE_LINE, len);
+	}
+	if (!pool->base)
+		return ERR_NO_MEMORY;
+
+	/* The free buffers are linked through their first word */
+	buf = pool->base;
+	for (i = 0; i < count; i++, buf += pool->size) {
+		*(void **)buf = pool->free_list;
+		pool->free_list = buf;
+	}
+	return NO_ERROR;
+}
+
+void dma_pool_destroy(struct dma_pool *pool)
+{
+	DEBUG_ASSERT(pool->used == 0);
+
+	/* The heap must not get the memory back without its cacheable mapping */
+	if (!pool->uncached)
+		free(pool->base);
+	pool->base = NULL;
+	pool->free_list = NULL;
+}
+
+void *dma_pool_alloc(struct dma_pool *pool)
+{
+	void *buf;
+
+	enter_critical_section();
+	buf = pool->free_list;
+	if (buf) {
+		pool->free_list = *(void **)buf;
+		if (++pool->used > pool->max_used)
+			pool->max_used = pool->used;
+	}
+	exit_critical_section();
+
+	return buf;
+}
+
+void dma_pool_free(struct dma_pool *pool, void *buf)
+{
+	if (!buf)
+		return;
+
+	DEBUG_ASSERT(dma_pool_contains(pool, buf) &&
+		     ((uint8_t *)buf - (uint8_t *)pool->base) % pool->size == 0);
+
+	enter_critical_section();
+	*(void **)buf = pool->free_list;
+	pool->free_list = buf;
+	pool->used--;
+	exit_critical_section();
+}
+
+bool dma_pool_contains(const struct dma_pool *pool, const void *buf)
+{
+	const uint8_t *p = buf, *base = pool->base;
+
+	return base && p >= base && p < base + pool->size * pool->count;
+}
+
+void dma_pool_clean(const struct dma_pool *pool, void *buf, size_t len)
+{
+	if (pool->uncached) {
+		dsb();
+	} else {
+		arch_clean_cache_range((addr_t)buf, len);
+	}
+}
+
+void dma_pool_invalidate(const struct dma_pool *pool, void *buf, size_t len)
+{
+	if (!pool->uncached)
+		arch_invalidate_cache_range((addr_t)buf, len);
+}
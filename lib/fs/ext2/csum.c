@@ -0,0 +1,172 @@
+// SPDX-License-Identifier: BSD-3-Clause
+/*
+ * Verification of the ext4 metadata checksums (metadata_csum), compatible
+ * with the ones written by Linux and e2fsprogs. Only the metadata used by
+ * the driver is checked: superblock, group descriptors, inodes and extent
+ * tree blocks. Directory blocks are not verified. Inodes are the only
+ * metadata that is ever written, see ext2_write_inode().
+ */
+
+#include <debug.h>
+#include <stdlib.h>
+#include <string.h>
+#include <crc32.h>
+#include "ext2_priv.h"
+
+#define LOCAL_TRACE 0
+
+static const uint8_t ext2_csum_zero[2];
+
+/* the raw superblock read from disk, before endian swapping */
+bool ext2_csum_init(ext2_t *ext2, const struct ext2_super_block *sb)
+{
+    uint32_t crc;
+
+    ext2->csum = LE32(sb->s_feature_ro_compat) & EXT4_FEATURE_RO_COMPAT_METADATA_CSUM;
+    if (!ext2->csum)
+        return true;
+
+    crc = crc32c(~0U, sb, offsetof(struct ext2_super_block, s_checksum));
+    if (crc != LE32(sb->s_checksum)) {
+        dprintf(INFO, "ext2: superblock checksum mismatch (%#x != %#x)\n",
+                crc, LE32(sb->s_checksum));
+        return false;
+    }
+
+    if (LE32(sb->s_feature_incompat) & EXT4_FEATURE_INCOMPAT_CSUM_SEED)
+        ext2->csum_seed = LE32(sb->s_checksum_seed);
+    else
+        ext2->csum_seed = crc32c(~0U, sb->s_uuid, sizeof(sb->s_uuid));
+
+    return true;
+}
+
+/* the raw descriptor read from disk, with the full size of the file system */
+bool ext2_csum_group_desc(ext2_t *ext2, groupnum_t group, const void *desc, size_t size)
+{
+    uint32_t le_group = LE32(group);
+    uint16_t csum;
+    uint32_t crc;
+
+    if (!ext2->csum)
+        return true;
+
+    crc = crc32c(ext2->csum_seed, &le_group, sizeof(le_group));
+    crc = crc32c(crc, desc, EXT4_BG_CHECKSUM);
+    crc = crc32c(crc, ext2_csum_zero, sizeof(csum));
+    if (size > EXT4_BG_CHECKSUM + sizeof(csum))
+        crc = crc32c(crc, (const uint8_t *)desc + EXT4_BG_CHECKSUM + sizeof(csum),
+                     size - EXT4_BG_CHECKSUM - sizeof(csum));
+
+    memcpy(&csum, (const uint8_t *)desc + EXT4_BG_CHECKSUM, sizeof(csum));
+    if ((crc & 0xffff) != LE16(csum)) {
+        dprintf(INFO, "ext2: group %u descriptor checksum mismatch\n", group);
+        return false;
+    }
+
+    return true;
+}
+
+/*
+ * the raw inode in the inode table, before endian swapping. the checksum
+ * fields are skipped, which is the same as zeroing them. *has_hi is set if
+ * the inode has room for the upper 16 bits of the checksum.
+ */
+static uint32_t ext2_calc_inode_csum(ext2_t *ext2, inodenum_t num, const uint8_t *raw,
+                                     uint32_t *seed, bool *has_hi)
+{
+    size_t size = EXT2_INODE_SIZE(ext2->sb);
+    uint32_t le_num = LE32(num), crc;
+    uint16_t extra_isize = 0;
+
+    if (size > EXT2_GOOD_OLD_INODE_SIZE) {
+        memcpy(&extra_isize, raw + EXT4_INODE_EXTRA_ISIZE, sizeof(extra_isize));
+        extra_isize = LE16(extra_isize);
+    }
+    *has_hi = EXT2_GOOD_OLD_INODE_SIZE + extra_isize >= EXT4_INODE_CSUM_HI_END &&
+              size >= EXT4_INODE_CSUM_HI_END;
+
+    crc = crc32c(ext2->csum_seed, &le_num, sizeof(le_num));
+    crc = crc32c(crc, raw + offsetof(struct ext2_inode, i_generation), sizeof(uint32_t));
+    *seed = crc;
+
+    crc = crc32c(crc, raw, EXT4_INODE_CSUM_LO);
+    crc = crc32c(crc, ext2_csum_zero, sizeof(uint16_t));
+    if (*has_hi) {
+        crc = crc32c(crc, raw + EXT4_INODE_CSUM_LO + sizeof(uint16_t),
+                     EXT4_INODE_CSUM_HI - EXT4_INODE_CSUM_LO - sizeof(uint16_t));
+        crc = crc32c(crc, ext2_csum_zero, sizeof(uint16_t));
+        crc = crc32c(crc, raw + EXT4_INODE_CSUM_HI_END, size - EXT4_INODE_CSUM_HI_END);
+    } else {
+        crc = crc32c(crc, raw + EXT4_INODE_CSUM_LO + sizeof(uint16_t),
+                     size - EXT4_INODE_CSUM_LO - sizeof(uint16_t));
+        crc &= 0xffff;
+    }
+
+    return crc;
+}
+
+bool ext2_csum_inode(ext2_t *ext2, inodenum_t num, const uint8_t *raw, uint32_t *seed)
+{
+    uint32_t crc, stored;
+    uint16_t lo, hi = 0;
+    bool has_hi;
+
+    if (!ext2->csum)
+        return true;
+
+    crc = ext2_calc_inode_csum(ext2, num, raw, seed, &has_hi);
+    memcpy(&lo, raw + EXT4_INODE_CSUM_LO, sizeof(lo));
+    if (has_hi)
+        memcpy(&hi, raw + EXT4_INODE_CSUM_HI, sizeof(hi));
+    stored = LE16(lo) | (uint32_t)LE16(hi) << 16;
+    if (crc != stored) {
+        dprintf(INFO, "ext2: inode %u checksum mismatch (%#x != %#x)\n", num, crc, stored);
+        return false;
+    }
+
+    return true;
+}
+
+/* store the checksum of a raw inode that was changed */
+void ext2_csum_inode_update(ext2_t *ext2, inodenum_t num, uint8_t *raw)
+{
+    uint16_t lo, hi;
+    uint32_t crc, seed;
+    bool has_hi;
+
+    if (!ext2->csum)
+        return;
+
+    crc = ext2_calc_inode_csum(ext2, num, raw, &seed, &has_hi);
+    lo = LE16(crc & 0xffff);
+    memcpy(raw + EXT4_INODE_CSUM_LO, &lo, sizeof(lo));
+    if (has_hi) {
+        hi = LE16(crc >> 16);
+        memcpy(raw + EXT4_INODE_CSUM_HI, &hi, sizeof(hi));
+    }
+}
+
+/* an extent tree block (not the root in the inode), using the seed of its inode */
+bool ext4_csum_extent_block(ext2_t *ext2, const struct ext2_inode *inode, const void *block)
+{
+    const struct ext4_extent_header *eh = block;
+    size_t offset = sizeof(*eh) + LE16(eh->eh_max) * sizeof(struct ext4_extent);
+    struct ext4_extent_tail tail;
+    uint32_t crc;
+
+    if (!ext2->csum)
+        return true;
+
+    if (offset + sizeof(tail) > EXT2_BLOCK_SIZE(ext2->sb))
+        return false;
+
+    crc = crc32c(inode->i_csum_seed, block, offset);
+    memcpy(&tail, (const uint8_t *)block + offset, sizeof(tail));
+    if (crc != LE32(tail.et_checksum)) {
+        LTRACEF("extent block checksum mismatch (%#x != %#x)\n", crc, LE32(tail.et_checksum));
+        return false;
+    }
+
+    return true;
+}
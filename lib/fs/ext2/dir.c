@@ -28,8 +28,167 @@
 
 #define LOCAL_TRACE 0
 
+/* walk through the directory entries of a block, looking for the one that matches */
+static bool ext2_dir_block_find(const uint8_t *buf, size_t size, const char *name, size_t namelen, inodenum_t *inum)
+{
+    const struct ext2_dir_entry_2 *ent;
+    uint pos = 0;
+
+    while (pos + 8 <= size) {
+        ent = (const struct ext2_dir_entry_2 *)&buf[pos];
+
+        LTRACEF("ent %d: inode 0x%x, reclen %d, namelen %d\n",
+                pos, LE32(ent->inode), LE16(ent->rec_len), ent->name_len/* , ent->name*/);
+
+        /* sanity check the record length */
+        if (LE16(ent->rec_len) == 0)
+            break;
+
+        if (ent->inode != 0 && ent->name_len == namelen && memcmp(name, ent->name, ent->name_len) == 0) {
+            // match
+            *inum = LE32(ent->inode);
+            LTRACEF("match: inode %d\n", *inum);
+            return true;
+        }
+
+        pos += ROUNDUP(LE16(ent->rec_len), 4);
+    }
+
+    return false;
+}
+
+/*
+ * look for the entry using the htree index. returns 1 if found, 0 if the index
+ * says it does not exist and a negative value if the index cannot be used.
+ */
+static int ext2_dx_lookup(ext2_t *ext2, struct ext2_inode *dir_inode, const char *name, size_t namelen,
+                          uint8_t *buf, inodenum_t *inum)
+{
+    size_t block_size = EXT2_BLOCK_SIZE(ext2->sb);
+    const struct ext2_dx_root_info *info = (const void *)&buf[EXT2_DX_ROOT_INFO_OFFSET];
+    const struct ext2_dx_countlimit *cl;
+    const struct ext2_dx_entry *entries;
+    uint8_t *leaf = buf + block_size;
+    uint32_t hash, next_hash, up_hash = 0;
+    bool up_valid = false;
+    uint level, levels, count, lo, hi, mid, i;
+    blocknum_t block;
+
+    if (ext2_read_inode(ext2, dir_inode, buf, 0, block_size) != (ssize_t)block_size)
+        return -1;
+
+    /* ext4 "largedir" has up to 3 levels, this is only used as a hint anyway */
+    levels = info->indirect_levels;
+    if (info->reserved_zero != 0 || info->info_length < sizeof(*info) || levels > 2)
+        return -1;
+    if (ext2_dirhash(ext2, info->hash_version, name, namelen, &hash) < 0)
+        return -1;
+
+    cl = (const void *)((const uint8_t *)info + info->info_length);
+    for (level = 0;; level++) {
+        entries = (const void *)cl;
+        count = LE16(cl->count);
+        if (count == 0 || count > LE16(cl->limit) || (const uint8_t *)&entries[count] > buf + block_size)
+            return -1;
+
+        /* find the last entry with a hash below or equal, the first one has none */
+        lo = 1;
+        hi = count;
+        while (lo < hi) {
+            mid = (lo + hi) / 2;
+            if (LE32(entries[mid].hash) <= hash)
+                lo = mid + 1;
+            else
+                hi = mid;
+        }
+        i = lo - 1;
+        block = LE32(entries[i].block) & 0x0fffffff;
+
+        LTRACEF("level %u: hash 0x%x, entry %u/%u, block %u\n", level, hash, i, count, block);
+
+        if (level == levels)
+            break;
+
+        /* where the blocks continue after this subtree */
+        if (i + 1 < count) {
+            up_hash = LE32(entries[i + 1].hash);
+            up_valid = true;
+        }
+
+        if (ext2_read_inode(ext2, dir_inode, buf, (off_t)block * block_size, block_size) != (ssize_t)block_size)
+            return -1;
+        cl = (const void *)&buf[EXT2_DX_NODE_OFFSET];
+    }
+
+    for (;;) {
+        if (ext2_read_inode(ext2, dir_inode, leaf, (off_t)block * block_size, block_size) != (ssize_t)block_size)
+            return -1;
+
+        if (ext2_dir_block_find(leaf, block_size, name, namelen, inum))
+            return 1;
+
+        /* names with the same hash continue in the next block if its hash has bit 0 set */
+        if (i + 1 < count)
+            next_hash = LE32(entries[i + 1].hash);
+        else if (up_valid)
+            next_hash = up_hash;
+        else
+            return 0;
+
+        if (!(next_hash & 1) || (next_hash & ~1U) != hash)
+            return 0;
+
+        /* continues in the next index node, rare enough to just scan everything */
+        if (i + 1 >= count)
+            return -1;
+
+        i++;
+        block = LE32(entries[i].block) & 0x0fffffff;
+    }
+}
+
+/*
+ * small directories with inline data have no "." and "..", instead the parent
+ * is stored in front of the entries
+ */
+static int ext2_dir_lookup_inline(ext2_t *ext2, inodenum_t dir, struct ext2_inode *dir_inode,
+                                  const char *name, size_t namelen, uint8_t *buf, inodenum_t *inum)
+{
+    ssize_t len;
+
+    if (strcmp(name, ".") == 0) {
+        *inum = dir;
+        return 1;
+    }
+
+    if (dir_inode->i_size > EXT2_INODE_SIZE(ext2->sb))
+        return ERR_NOT_VALID;
+
+    len = ext2_read_inline_data(ext2, dir, dir_inode, buf, dir_inode->i_size);
+    if (len < 0)
+        return len;
+    if (len < EXT4_INLINE_DOTDOT_SIZE)
+        return ERR_NOT_VALID;
+
+    if (strcmp(name, "..") == 0) {
+        *inum = LE32(*(const uint32_t *)buf);
+        return 1;
+    }
+
+    /* the entries in i_block and in the attribute are both complete */
+    if (ext2_dir_block_find(buf + EXT4_INLINE_DOTDOT_SIZE, EXT4_MIN_INLINE_DATA_SIZE - EXT4_INLINE_DOTDOT_SIZE,
+                            name, namelen, inum))
+        return 1;
+    if (len > EXT4_MIN_INLINE_DATA_SIZE &&
+        ext2_dir_block_find(buf + EXT4_MIN_INLINE_DATA_SIZE, len - EXT4_MIN_INLINE_DATA_SIZE, name, namelen, inum))
+        return 1;
+
+    return ERR_NOT_FOUND;
+}
+
 /* read in the dir, look for the entry */
-static int ext2_dir_lookup(ext2_t *ext2, struct ext2_inode *dir_inode, const char *name, inodenum_t *inum)
+static int ext2_dir_lookup(ext2_t *ext2, inodenum_t dir, struct ext2_inode *dir_inode, const char *name,
+                           inodenum_t *inum)
 {
     uint file_blocknum;
     int err;
@@ -39,7 +198,25 @@ static int ext2_dir_lookup(ext2_t *ext2, struct ext2_inode *dir_inode, const cha
     if (!S_ISDIR(dir_inode->i_mode))
         return ERR_NOT_DIR;
 
-    buf = malloc(EXT2_BLOCK_SIZE(ext2->sb));
+    /* room for an htree index node and a leaf */
+    buf = malloc(EXT2_BLOCK_SIZE(ext2->sb) * 2);
+    if (!buf)
+        return ERR_NO_MEMORY;
+
+    if (dir_inode->i_flags & EXT4_INLINE_DATA_FL) {
+        err = ext2_dir_lookup_inline(ext2, dir, dir_inode, name, namelen, buf, inum);
+        free(buf);
+        return err;
+    }
+
+    if ((dir_inode->i_flags & EXT2_INDEX_FL) && (ext2->sb.s_feature_compat & EXT2_FEATURE_COMPAT_DIR_INDEX)) {
+        err = ext2_dx_lookup(ext2, dir_inode, name, namelen, buf, inum);
+        if (err >= 0) {
+            free(buf);
+            return err ? 1 : ERR_NOT_FOUND;
+        }
+        LTRACEF("htree lookup of '%s' failed, falling back to linear scan\n", name);
+    }
 
     file_blocknum = 0;
     for (;;) {
@@ -47,31 +224,12 @@ static int ext2_dir_lookup(ext2_t *ext2, struct ext2_inode *dir_inode, const cha
         err = ext2_read_inode(ext2, dir_inode, buf, file_blocknum * EXT2_BLOCK_SIZE(ext2->sb), EXT2_BLOCK_SIZE(ext2->sb));
         if (err <= 0) {
             free(buf);
-            return -1;
+            return err < 0 ? err : ERR_NOT_FOUND;
         }
 
-        /* walk through the directory entries, looking for the one that matches */
-        struct ext2_dir_entry_2 *ent;
-        uint pos = 0;
-        while (pos < EXT2_BLOCK_SIZE(ext2->sb)) {
-            ent = (struct ext2_dir_entry_2 *)&buf[pos];
-
-            LTRACEF("ent %d:%d: inode 0x%x, reclen %d, namelen %d\n",
-                    file_blocknum, pos, LE32(ent->inode), LE16(ent->rec_len), ent->name_len/* , ent->name*/);
-
-            /* sanity check the record length */
-            if (LE16(ent->rec_len) == 0)
-                break;
-
-            if (ent->name_len == namelen && memcmp(name, ent->name, ent->name_len) == 0) {
-                // match
-                *inum = LE32(ent->inode);
-                LTRACEF("match: inode %d\n", *inum);
-                free(buf);
-                return 1;
-            }
-
-            pos += ROUNDUP(LE16(ent->rec_len), 4);
+        if (ext2_dir_block_find(buf, EXT2_BLOCK_SIZE(ext2->sb), name, namelen, inum)) {
+            free(buf);
+            return 1;
         }
 
         file_blocknum++;
@@ -84,12 +242,58 @@ static int ext2_dir_lookup(ext2_t *ext2, struct ext2_inode *dir_inode, const cha
     }
 }
 
+static struct ext2_dcache_entry *ext2_dcache_slot(ext2_t *ext2, inodenum_t dir, const char *name, size_t namelen)
+{
+    uint32_t hash = dir * 2654435761U;
+    size_t i;
+
+    /* FNV-1a */
+    for (i = 0; i < namelen; i++)
+        hash = (hash ^ (uint8_t)name[i]) * 16777619U;
+
+    return &ext2->dcache[hash % EXT2_DCACHE_SIZE];
+}
+
+/* look up a name in a directory, remembering the result (also if it does not exist) */
+int ext2_lookup_name(ext2_t *ext2, inodenum_t dir, struct ext2_inode *dir_inode,
+                     const char *name, inodenum_t *inum)
+{
+    struct ext2_dcache_entry *ent = NULL;
+    size_t namelen = strlen(name);
+    int err;
+
+    if (ext2->dcache && namelen <= EXT2_DCACHE_NAME_LEN) {
+        ent = ext2_dcache_slot(ext2, dir, name, namelen);
+        if (ent->dir == dir && ent->namelen == namelen && memcmp(ent->name, name, namelen) == 0) {
+            LTRACEF("cached: '%s' in %u -> %u\n", name, dir, ent->inum);
+            if (!ent->inum)
+                return ERR_NOT_FOUND;
+            *inum = ent->inum;
+            return 1;
+        }
+    }
+
+    err = ext2_dir_lookup(ext2, dir, dir_inode, name, inum);
+
+    /* only remember definite answers, not read errors */
+    if (ent && (err >= 0 || err == ERR_NOT_FOUND)) {
+        ent->dir = dir;
+        ent->inum = err >= 0 ? *inum : 0;
+        ent->namelen = namelen;
+        memcpy(ent->name, name, namelen);
+    }
+
+    return err;
+}
+
 /* note, trashes path */
-static int ext2_walk(ext2_t *ext2, char *path, struct ext2_inode *start_inode, inodenum_t *inum, int recurse)
+static int ext2_walk(ext2_t *ext2, char *path, inodenum_t start_inum, struct ext2_inode *start_inode,
+                     inodenum_t *inum, int recurse)
 {
     char *ptr;
     struct ext2_inode inode;
     struct ext2_inode dir_inode;
+    inodenum_t dir_inum = start_inum;
     int err;
     bool done;
 
@@ -119,7 +323,7 @@ static int ext2_walk(ext2_t *ext2, char *path, struct ext2_inode *start_inode, i
         LTRACEF("component '%s', done %d\n", ptr, done);
 
         /* do the lookup on this component */
-        err = ext2_dir_lookup(ext2, &dir_inode, ptr, inum);
+        err = ext2_lookup_name(ext2, dir_inum, &dir_inode, ptr, inum);
         if (err < 0)
             return err;
 
@@ -137,7 +341,7 @@ nextcomponent:
 
             LTRACEF("hit symlink\n");
 
-            err = ext2_read_link(ext2, &inode, link, sizeof(link));
+            err = ext2_read_link(ext2, *inum, &inode, link, sizeof(link));
             if (err < 0)
                 return err;
 
@@ -146,9 +350,9 @@ nextcomponent:
             /* recurse, parsing the link */
             if (link[0] == '/') {
                 /* link starts with '/', so start over again at the rootfs */
-                err = ext2_walk(ext2, link, &ext2->root_inode, inum, recurse + 1);
+                err = ext2_walk(ext2, link, EXT2_ROOT_INO, &ext2->root_inode, inum, recurse + 1);
             } else {
-                err = ext2_walk(ext2, link, &dir_inode, inum, recurse + 1);
+                err = ext2_walk(ext2, link, dir_inum, &dir_inode, inum, recurse + 1);
             }
 
             LTRACEF("recursive walk returns %d\n", err);
@@ -163,6 +367,7 @@ nextcomponent:
         } else if (S_ISDIR(inode.i_mode)) {
             /* for the next cycle, point the dir inode at our new directory */
             memcpy(&dir_inode, &inode, sizeof(struct ext2_inode));
+            dir_inum = *inum;
         } else {
             if (!done) {
                 /* we aren't done and this walked over a nondir, abort */
@@ -192,7 +397,7 @@ int ext2_lookup(ext2_t *ext2, const char *_path, inodenum_t *inum)
     char path[512];
     strlcpy(path, _path, sizeof(path));
 
-    return ext2_walk(ext2, path, &ext2->root_inode, inum, 1);
+    return ext2_walk(ext2, path, EXT2_ROOT_INO, &ext2->root_inode, inum, 1);
 }
 
 status_t ext2_open_directory(fscookie *cookie, const char *path, dircookie **dcookie) {
@@ -222,7 +427,8 @@ status_t ext2_open_directory(fscookie *cookie, const char *path, dircookie **dco
 
 	entry_len = ext2_file_len(dir->file->ext2, &dir->file->inode);
 
-	dir->offset = 0;
+	/* skip the parent inode number in front of inline entries */
+	dir->offset = dir->file->inline_data ? EXT4_INLINE_DOTDOT_SIZE : 0;
 	dir->length = entry_len;
 
 	*dcookie = (dircookie *)dir;
@@ -239,7 +445,7 @@ status_t ext2_read_directory(dircookie *dircookie, struct dirent *ent) {
 	if (dir->offset >= dir->length)
 		return ERR_NOT_FOUND;
 
-	ret = ext2_read_inode(dir->file->ext2, &dir->file->inode, &direntry, dir->offset, sizeof(struct ext2_dir_entry_2));
+	ret = ext2_read_file_data(dir->file, &direntry, dir->offset, sizeof(struct ext2_dir_entry_2));
 	if (ret < 0)
 		return ret;
 
@@ -24,11 +24,23 @@
 #include <string.h>
 #include <stdlib.h>
 #include <debug.h>
+#include <err.h>
 #include <lib/fs.h>
 #include "ext2_priv.h"
 
 #define LOCAL_TRACE 0
 
+/* memory used for the block cache of each mounted file system */
+#ifndef EXT2_CACHE_SIZE
+#define EXT2_CACHE_SIZE (128 * 1024)
+#endif
+#define EXT2_CACHE_MIN_BLOCKS 4
+
+/* memory used for the inode cache of each mounted file system */
+#ifndef EXT2_ICACHE_SIZE
+#define EXT2_ICACHE_SIZE (8 * 1024)
+#endif
+
 static void endian_swap_superblock(struct ext2_super_block *sb)
 {
     LE32SWAP(sb->s_inodes_count);
@@ -68,8 +80,17 @@ static void endian_swap_superblock(struct ext2_super_block *sb)
     LE32SWAP(sb->s_journal_inum);
     LE32SWAP(sb->s_journal_dev);
     LE32SWAP(sb->s_last_orphan);
+    LE16SWAP(sb->s_desc_size);
     LE32SWAP(sb->s_default_mount_opts);
     LE32SWAP(sb->s_first_meta_bg);
+
+    /* htree */
+    LE32SWAP(sb->s_hash_seed[0]);
+    LE32SWAP(sb->s_hash_seed[1]);
+    LE32SWAP(sb->s_hash_seed[2]);
+    LE32SWAP(sb->s_hash_seed[3]);
+    LE32SWAP(sb->s_flags);
+    LE32SWAP(sb->s_checksum_seed);
 }
 
 static void endian_swap_inode(struct ext2_inode *inode)
@@ -107,6 +128,25 @@ static void endian_swap_group_desc(struct ext2_group_desc *gd)
     LE16SWAP(gd->bg_used_dirs_count);
 }
 
+status_t ext2_probe(bdev_t *dev)
+{
+    uint16_t magic;
+    ssize_t err;
+
+    /* only the superblock magic, this reads a single block */
+    err = bio_read(dev, &magic, 1024 + offsetof(struct ext2_super_block, s_magic), sizeof(magic));
+    if (err < 0)
+        return err;
+
+    if (LE16(magic) != EXT2_SUPER_MAGIC)
+        return ERR_NOT_VALID;
+
+    return NO_ERROR;
+}
+
+static void ext2_prefetch_inode_table(ext2_t *ext2);
+static void ext2_prefetch_boot_inodes(ext2_t *ext2);
+
 status_t ext2_mount(bdev_t *dev, fscookie **cookie)
 {
     int err;
@@ -120,14 +160,20 @@ status_t ext2_mount(bdev_t *dev, fscookie **cookie)
     if (err < 0)
         goto err;
 
-    endian_swap_superblock(&ext2->sb);
-
     /* see if the superblock is good */
-    if (ext2->sb.s_magic != EXT2_SUPER_MAGIC) {
+    if (LE16(ext2->sb.s_magic) != EXT2_SUPER_MAGIC) {
         err = -1;
         return err;
     }
 
+    /* checksums are calculated over the raw data */
+    if (!ext2_csum_init(ext2, &ext2->sb)) {
+        err = ERR_NOT_VALID;
+        goto err;
+    }
+
+    endian_swap_superblock(&ext2->sb);
+
     /* calculate group count, rounded up */
     ext2->s_group_count = (ext2->sb.s_blocks_count + ext2->sb.s_blocks_per_group - 1) / ext2->sb.s_blocks_per_group;
 
@@ -150,40 +196,54 @@ status_t ext2_mount(bdev_t *dev, fscookie **cookie)
     }
 
     /* make sure it doesn't have any ro features we don't support */
-    if (ext2->sb.s_feature_ro_compat & ~(EXT2_FEATURE_RO_COMPAT_SPARSE_SUPER|EXT2_FEATURE_RO_COMPAT_LARGE_FILE)) {
+    /* the ext4 ones only matter for writing (huge files, nlink), except metadata_csum */
+    if (ext2->sb.s_feature_ro_compat & ~(EXT2_FEATURE_RO_COMPAT_SPARSE_SUPER|EXT2_FEATURE_RO_COMPAT_LARGE_FILE|
+                                         EXT4_FEATURE_RO_COMPAT_HUGE_FILE|EXT4_FEATURE_RO_COMPAT_GDT_CSUM|
+                                         EXT4_FEATURE_RO_COMPAT_DIR_NLINK|EXT4_FEATURE_RO_COMPAT_EXTRA_ISIZE|
+                                         EXT4_FEATURE_RO_COMPAT_METADATA_CSUM)) {
         err = -3;
         return err;
     }
 
-    /* read in all the group descriptors */
-    ext2->gd = malloc(sizeof(struct ext2_group_desc) * ext2->s_group_count);
-    err = bio_read(ext2->dev, (void *)ext2->gd,
-                   (EXT2_BLOCK_SIZE(ext2->sb) == 4096) ? 4096 : 2048,
-                   sizeof(struct ext2_group_desc) * ext2->s_group_count);
-    if (err < 0) {
-        err = -4;
-        return err;
+    /* 64bit file systems have larger group descriptors, only the first part is used */
+    ext2->desc_size = sizeof(struct ext2_group_desc);
+    if ((ext2->sb.s_feature_incompat & EXT4_FEATURE_INCOMPAT_64BIT) && ext2->sb.s_desc_size > ext2->desc_size)
+        ext2->desc_size = ext2->sb.s_desc_size;
+    if (ext2->desc_size > EXT2_BLOCK_SIZE(ext2->sb)) {
+        err = ERR_NOT_VALID;
+        goto err;
     }
 
-    int i;
-    for (i=0; i < ext2->s_group_count; i++) {
-        endian_swap_group_desc(&ext2->gd[i]);
-        LTRACEF("group %d:\n", i);
-        LTRACEF("\tblock bitmap %d\n", ext2->gd[i].bg_block_bitmap);
-        LTRACEF("\tinode bitmap %d\n", ext2->gd[i].bg_inode_bitmap);
-        LTRACEF("\tinode table %d\n", ext2->gd[i].bg_inode_table);
-        LTRACEF("\tfree blocks %d\n", ext2->gd[i].bg_free_blocks_count);
-        LTRACEF("\tfree inodes %d\n", ext2->gd[i].bg_free_inodes_count);
-        LTRACEF("\tused dirs %d\n", ext2->gd[i].bg_used_dirs_count);
+    /* the group descriptors are read when they are first used, see ext2_get_group_desc() */
+    ext2->gd = calloc(ext2->s_group_count, sizeof(struct ext2_group_desc));
+    if (!ext2->gd) {
+        err = ERR_NO_MEMORY;
+        goto err;
+    }
+
+    /* initialize the block cache, shared with the other partitions of the disk */
+    ext2->cache = bcache_open(ext2->dev, EXT2_BLOCK_SIZE(ext2->sb),
+                              MAX(EXT2_CACHE_SIZE / EXT2_BLOCK_SIZE(ext2->sb), EXT2_CACHE_MIN_BLOCKS));
+    if (!ext2->cache) {
+        free(ext2->gd);
+        err = ERR_NO_MEMORY;
+        goto err;
     }
 
-    /* initialize the block cache */
-    ext2->cache = bcache_create(ext2->dev, EXT2_BLOCK_SIZE(ext2->sb), 4);
+    /* the lookup, symlink and inode caches are optional */
+    ext2->dcache = calloc(EXT2_DCACHE_SIZE, sizeof(struct ext2_dcache_entry));
+    ext2->lcache = calloc(EXT2_LCACHE_SIZE, sizeof(struct ext2_lcache_entry));
+    ext2->icache_count = EXT2_ICACHE_SIZE / sizeof(struct ext2_icache_entry);
+    ext2->icache = calloc(ext2->icache_count, sizeof(struct ext2_icache_entry));
+    if (!ext2->icache)
+        ext2->icache_count = 0;
 
-    /* load the first inode */
+    /* load the first inode, together with the ones that are usually created next */
+    ext2_prefetch_inode_table(ext2);
     err = ext2_load_inode(ext2, EXT2_ROOT_INO, &ext2->root_inode);
     if (err < 0)
         goto err;
+    ext2_prefetch_boot_inodes(ext2);
 
 //  TRACE("successfully mounted volume\n");
 
@@ -204,36 +264,170 @@ status_t ext2_unmount(fscookie *cookie)
     ext2_t *ext2 = (ext2_t *)cookie;
 
     bcache_destroy(ext2->cache);
+    free(ext2->dcache);
+    free(ext2->icache);
+    free(ext2->lcache);
     free(ext2->gd);
     free(ext2);
 
     return 0;
 }
 
-static void get_inode_addr(ext2_t *ext2, inodenum_t num, blocknum_t *block, size_t *block_offset)
+/*
+ * read the block of group descriptors that contains the group. descriptors
+ * that are not loaded yet have an inode table at block 0, where there is
+ * always the boot block or the superblock instead.
+ */
+static int ext2_load_group_descs(ext2_t *ext2, groupnum_t group)
 {
+    uint32_t per_block = EXT2_BLOCK_SIZE(ext2->sb) / ext2->desc_size;
+    groupnum_t first = group - group % per_block;
+    groupnum_t i;
+    void *ptr;
+    int err;
+
+    err = bcache_get_block(ext2->cache, &ptr, ext2->sb.s_first_data_block + 1 + group / per_block);
+    if (err < 0)
+        return err;
+
+    for (i = first; i < first + per_block && i < (groupnum_t)ext2->s_group_count; i++) {
+        const uint8_t *raw = (uint8_t *)ptr + (i - first) * ext2->desc_size;
+
+        if (!ext2_csum_group_desc(ext2, i, raw, ext2->desc_size)) {
+            bcache_put_block(ext2->cache, ext2->sb.s_first_data_block + 1 + group / per_block);
+            return ERR_NOT_VALID;
+        }
+
+        memcpy(&ext2->gd[i], raw, sizeof(struct ext2_group_desc));
+        endian_swap_group_desc(&ext2->gd[i]);
+        LTRACEF("group %u: inode table %u\n", i, ext2->gd[i].bg_inode_table);
+    }
+
+    bcache_put_block(ext2->cache, ext2->sb.s_first_data_block + 1 + group / per_block);
+    return 0;
+}
+
+static struct ext2_group_desc *ext2_get_group_desc(ext2_t *ext2, groupnum_t group)
+{
+    if (group >= (groupnum_t)ext2->s_group_count)
+        return NULL;
+
+    if (ext2->gd[group].bg_inode_table == 0 && ext2_load_group_descs(ext2, group) < 0)
+        return NULL;
+
+    return &ext2->gd[group];
+}
+
+static int get_inode_addr(ext2_t *ext2, inodenum_t num, blocknum_t *block, size_t *block_offset)
+{
+    struct ext2_group_desc *gd;
+
+    if (num == 0)
+        return ERR_NOT_VALID;
     num--;
 
     uint32_t group = num / ext2->sb.s_inodes_per_group;
 
     // calculate the start of the inode table for the group it's in
-    *block = ext2->gd[group].bg_inode_table;
+    gd = ext2_get_group_desc(ext2, group);
+    if (!gd)
+        return ERR_NOT_VALID;
+    *block = gd->bg_inode_table;
 
     // add the offset of the inode within the group
     size_t offset = (num % EXT2_INODES_PER_GROUP(ext2->sb)) * EXT2_INODE_SIZE(ext2->sb);
     *block_offset = offset % EXT2_BLOCK_SIZE(ext2->sb);
     *block += offset / EXT2_BLOCK_SIZE(ext2->sb);
+    return 0;
+}
+
+/*
+ * the root directory is at the start of the inode table of the first group,
+ * followed by the files and directories that were created first. fetch these
+ * inode table blocks with one request when mounting.
+ */
+static void ext2_prefetch_inode_table(ext2_t *ext2)
+{
+    blocknum_t bnum;
+    size_t block_offset;
+
+    if (get_inode_addr(ext2, EXT2_ROOT_INO, &bnum, &block_offset) < 0)
+        return;
+
+    bcache_prefetch(ext2->cache, bnum, bcache_prefetch_max(ext2->cache));
+}
+
+/* names in the root directory that are looked up right after mounting */
+static const char *const ext2_boot_names[] = { "boot", "extlinux" };
+
+/*
+ * directories created later (e.g. by linux, which spreads them across the
+ * groups) are elsewhere. look them up and fetch their inodes together if
+ * they are close enough to each other, as with flex_bg.
+ */
+static void ext2_prefetch_boot_inodes(ext2_t *ext2)
+{
+    blocknum_t blocks[countof(ext2_boot_names)], first = 0, last = 0;
+    uint max = bcache_prefetch_max(ext2->cache);
+    size_t block_offset;
+    inodenum_t inum;
+    uint i, n = 0;
+
+    for (i = 0; i < countof(ext2_boot_names); i++) {
+        if (ext2_lookup_name(ext2, EXT2_ROOT_INO, &ext2->root_inode, ext2_boot_names[i], &inum) < 0 ||
+            get_inode_addr(ext2, inum, &blocks[n], &block_offset) < 0)
+            continue;
+
+        first = n ? MIN(first, blocks[n]) : blocks[n];
+        last = n ? MAX(last, blocks[n]) : blocks[n];
+        n++;
+    }
+
+    /* a single inode is not worth it, it is loaded with one request anyway */
+    if (n > 1 && last - first < max)
+        bcache_prefetch(ext2->cache, first, last - first + 1);
+}
+
+/* find the inode in the cache, or the least recently used entry to replace */
+static struct ext2_icache_entry *ext2_icache_slot(ext2_t *ext2, inodenum_t num)
+{
+    struct ext2_icache_entry *ent, *victim = NULL;
+    uint32_t i;
+
+    for (i = 0; i < ext2->icache_count; i++) {
+        ent = &ext2->icache[i];
+        if (ent->num == num)
+            return ent;
+        if (!victim || ent->last_used < victim->last_used)
+            victim = ent;
+    }
+
+    return victim;
 }
 
 int ext2_load_inode(ext2_t *ext2, inodenum_t num, struct ext2_inode *inode)
 {
+    struct ext2_icache_entry *ent = NULL;
     int err;
 
     LTRACEF("num %d, inode %p\n", num, inode);
 
+    /* inodes are only changed by ext2_write_inode(), which updates the cache */
+    if (ext2->icache_count && num) {
+        ent = ext2_icache_slot(ext2, num);
+        ent->last_used = ++ext2->icache_clock;
+        if (ent->num == num) {
+            LTRACEF("cached inode %u\n", num);
+            memcpy(inode, &ent->inode, sizeof(struct ext2_inode));
+            return 0;
+        }
+    }
+
     blocknum_t bnum;
     size_t block_offset;
-    get_inode_addr(ext2, num, &bnum, &block_offset);
+    err = get_inode_addr(ext2, num, &bnum, &block_offset);
+    if (err < 0)
+        return err;
 
     LTRACEF("bnum %u, offset %zd\n", bnum, block_offset);
 
@@ -243,7 +437,12 @@ int ext2_load_inode(ext2_t *ext2, inodenum_t num, struct ext2_inode *inode)
     if (err < 0)
         return err;
 
-    /* copy the inode out */
+    /* verify and copy the inode out */
+    uint32_t seed = 0;
+    if (!ext2_csum_inode(ext2, num, (uint8_t *)cache_ptr + block_offset, &seed)) {
+        bcache_put_block(ext2->cache, bnum);
+        return ERR_NOT_VALID;
+    }
     memcpy(inode, (uint8_t *)cache_ptr + block_offset, sizeof(struct ext2_inode));
 
     /* put the cache block */
@@ -251,19 +450,223 @@ int ext2_load_inode(ext2_t *ext2, inodenum_t num, struct ext2_inode *inode)
 
     /* endian swap it */
     endian_swap_inode(inode);
+    inode->i_csum_seed = seed;
+
+    if (ent) {
+        ent->num = num;
+        memcpy(&ent->inode, inode, sizeof(struct ext2_inode));
+    }
 
     LTRACEF("read inode: mode 0x%x, size %d\n", inode->i_mode, inode->i_size);
 
     return 0;
 }
 
+/*
+ * store the size and timestamps of a changed inode, which is all that is ever
+ * written. the rest of the inode stays as it is on disk.
+ */
+int ext2_write_inode(ext2_t *ext2, inodenum_t num, const struct ext2_inode *inode)
+{
+    struct ext2_icache_entry *ent;
+    blocknum_t bnum;
+    size_t block_offset;
+    void *cache_ptr;
+    uint8_t *raw;
+    uint32_t val;
+    int err;
+
+    err = get_inode_addr(ext2, num, &bnum, &block_offset);
+    if (err < 0)
+        return err;
+
+    err = bcache_get_block(ext2->cache, &cache_ptr, bnum);
+    if (err < 0)
+        return err;
+
+    raw = (uint8_t *)cache_ptr + block_offset;
+    val = LE32(inode->i_size);
+    memcpy(raw + offsetof(struct ext2_inode, i_size), &val, sizeof(val));
+    val = LE32(inode->i_size_high);
+    memcpy(raw + offsetof(struct ext2_inode, i_size_high), &val, sizeof(val));
+    val = LE32(inode->i_ctime);
+    memcpy(raw + offsetof(struct ext2_inode, i_ctime), &val, sizeof(val));
+    val = LE32(inode->i_mtime);
+    memcpy(raw + offsetof(struct ext2_inode, i_mtime), &val, sizeof(val));
+    ext2_csum_inode_update(ext2, num, raw);
+
+    bcache_mark_block_dirty(ext2->cache, bnum);
+    bcache_put_block(ext2->cache, bnum);
+    err = bcache_flush(ext2->cache);
+    if (err < 0)
+        return err;
+
+    if (ext2->icache_count) {
+        ent = ext2_icache_slot(ext2, num);
+        if (ent->num == num)
+            memcpy(&ent->inode, inode, sizeof(struct ext2_inode));
+    }
+
+    LTRACEF("wrote inode %u: size %u\n", num, inode->i_size);
+
+    return 0;
+}
+
+/* the journal is never replayed, so nothing may be written while it has pending changes */
+int ext2_check_writable(ext2_t *ext2)
+{
+    if (ext2->sb.s_feature_incompat & EXT3_FEATURE_INCOMPAT_RECOVER) {
+        dprintf(INFO, "ext2: journal needs recovery, not writing\n");
+        return ERR_NOT_ALLOWED;
+    }
+
+    return 0;
+}
+
+/*
+ * what ext2_check_key() compares, changed by any write or replacement of the
+ * file. must fit into FS_FILE_KEY_LEN.
+ */
+struct ext2_file_key {
+    uint64_t inode_offset; // on the device
+    uint32_t size;
+    uint32_t size_high;
+    uint32_t ctime;
+    uint32_t mtime;
+    uint32_t generation;
+    uint32_t reserved;
+};
+
+status_t ext2_get_key(filecookie *fcookie, uint8_t *data)
+{
+    ext2_file_t *file = (ext2_file_t *)fcookie;
+    ext2_t *ext2 = file->ext2;
+    struct ext2_file_key key = {0};
+    blocknum_t bnum;
+    size_t block_offset;
+
+    if (get_inode_addr(ext2, file->inum, &bnum, &block_offset) < 0)
+        return ERR_NOT_VALID;
+    key.inode_offset = (uint64_t)bnum * EXT2_BLOCK_SIZE(ext2->sb) + block_offset;
+    key.size = file->inode.i_size;
+    key.size_high = file->inode.i_size_high;
+    key.ctime = file->inode.i_ctime;
+    key.mtime = file->inode.i_mtime;
+    key.generation = file->inode.i_generation;
+
+    memcpy(data, &key, sizeof(key));
+    return 0;
+}
+
+/* read the inode directly, without the superblock and group descriptors */
+status_t ext2_check_key(bdev_t *dev, const uint8_t *data)
+{
+    struct ext2_file_key key;
+    struct ext2_inode inode;
+    ssize_t ret;
+
+    memcpy(&key, data, sizeof(key));
+    ret = bio_read(dev, &inode, key.inode_offset, sizeof(inode));
+    if (ret != sizeof(inode))
+        return ret < 0 ? ret : ERR_IO;
+
+    endian_swap_inode(&inode);
+    if (!inode.i_links_count || inode.i_dtime ||
+        inode.i_size != key.size || inode.i_size_high != key.size_high ||
+        inode.i_ctime != key.ctime || inode.i_mtime != key.mtime ||
+        inode.i_generation != key.generation)
+        return ERR_NOT_VALID;
+
+    return 0;
+}
+
+/*
+ * read the contents of an inode with inline data: the part in i_block and
+ * the rest from the system.data attribute in the inode body
+ */
+ssize_t ext2_read_inline_data(ext2_t *ext2, inodenum_t num, struct ext2_inode *inode, void *_buf, size_t len)
+{
+    size_t isize = EXT2_INODE_SIZE(ext2->sb);
+    const struct ext4_xattr_entry *ent;
+    const uint8_t *raw;
+    uint8_t *buf = _buf;
+    size_t n, pos, base, value_offs;
+    ssize_t ret = ERR_NOT_VALID;
+    int err;
+
+    LTRACEF("num %u, len %zu, size %u\n", num, len, inode->i_size);
+
+    if (len > inode->i_size)
+        len = inode->i_size;
+
+    n = MIN(len, EXT4_MIN_INLINE_DATA_SIZE);
+    memcpy(buf, inode->i_block, n);
+    if (n == len)
+        return len;
+
+    /* the in-inode attributes follow the extra fields of the inode */
+    if (isize <= EXT2_GOOD_OLD_INODE_SIZE + 4)
+        return ERR_NOT_VALID;
+
+    blocknum_t bnum;
+    size_t block_offset;
+    err = get_inode_addr(ext2, num, &bnum, &block_offset);
+    if (err < 0)
+        return err;
+
+    void *cache_ptr;
+    err = bcache_get_block(ext2->cache, &cache_ptr, bnum);
+    if (err < 0)
+        return err;
+
+    raw = (const uint8_t *)cache_ptr + block_offset;
+    pos = EXT2_GOOD_OLD_INODE_SIZE + LE16(*(const uint16_t *)&raw[EXT2_GOOD_OLD_INODE_SIZE]);
+    if (pos + 4 > isize || LE32(*(const uint32_t *)&raw[pos]) != EXT4_XATTR_MAGIC)
+        goto out;
+
+    /* value offsets are relative to the first entry */
+    pos += 4;
+    base = pos;
+
+    /* the entries end with 4 zero bytes */
+    while (pos + sizeof(*ent) <= isize && *(const uint32_t *)&raw[pos] != 0) {
+        ent = (const struct ext4_xattr_entry *)&raw[pos];
+        if (pos + sizeof(*ent) + ent->e_name_len > isize)
+            break;
+
+        if (ent->e_name_index == EXT4_XATTR_INDEX_SYSTEM && ent->e_name_len == 4 &&
+            memcmp(ent->e_name, "data", 4) == 0) {
+            value_offs = base + LE16(ent->e_value_offs);
+            if (ent->e_value_inum || LE32(ent->e_value_size) < len - n ||
+                value_offs + len - n > isize)
+                break;
+
+            memcpy(buf + n, &raw[value_offs], len - n);
+            ret = len;
+            break;
+        }
+
+        pos += ROUNDUP(sizeof(*ent) + ent->e_name_len, 4);
+    }
+
+out:
+    bcache_put_block(ext2->cache, bnum);
+    return ret;
+}
+
 static const struct fs_api ext2_api = {
+    .probe = ext2_probe,
     .mount = ext2_mount,
     .unmount = ext2_unmount,
     .open = ext2_open_file,
     .stat = ext2_stat_file,
     .read = ext2_read_file,
+    .write = ext2_write_file,
     .close = ext2_close_file,
+    .truncate = ext2_truncate_file,
+    .map = ext2_map_file,
+    .get_key = ext2_get_key,
+    .check_key = ext2_check_key,
     .opendir = ext2_open_directory,
     .readdir = ext2_read_directory,
     .closedir = ext2_close_directory
@@ -156,6 +156,61 @@ struct ext2_inode {
 
 #define i_size_high i_dir_acl
 
+/*
+ * Inode flags
+ */
+#define EXT2_INDEX_FL       0x00001000 /* hash-indexed directory */
+#define EXT4_EXTENTS_FL     0x00080000 /* Inode uses extents */
+#define EXT4_INLINE_DATA_FL 0x10000000 /* Inode has inline data */
+
+/*
+ * ext4 inline data: the first 60 bytes are stored in i_block, the rest in
+ * the "system.data" extended attribute in the inode body. Inline directories
+ * start with the parent inode number instead of "." and "..".
+ */
+#define EXT4_MIN_INLINE_DATA_SIZE   (EXT2_N_BLOCKS * 4)
+#define EXT4_INLINE_DOTDOT_SIZE     4
+#define EXT4_XATTR_MAGIC            0xEA020000
+#define EXT4_XATTR_INDEX_SYSTEM     7
+
+struct ext4_xattr_entry {
+    uint8_t     e_name_len;     /* length of name */
+    uint8_t     e_name_index;   /* attribute name index */
+    uint16_t    e_value_offs;   /* offset in disk block of value */
+    uint32_t    e_value_inum;   /* inode in which the value is stored */
+    uint32_t    e_value_size;   /* size of attribute value */
+    uint32_t    e_hash;         /* hash value of name and value */
+    char        e_name[];       /* attribute name */
+};
+
+/*
+ * ext4 extent tree, stored in i_block and in the tree blocks
+ */
+#define EXT4_EXT_MAGIC          0xF30A
+#define EXT4_EXT_INIT_MAX_LEN   32768   /* longer extents are uninitialized */
+
+struct ext4_extent_header {
+    uint16_t    eh_magic;   /* EXT4_EXT_MAGIC */
+    uint16_t    eh_entries; /* number of valid entries */
+    uint16_t    eh_max;     /* capacity of store in entries */
+    uint16_t    eh_depth;   /* has tree real underlying blocks? */
+    uint32_t    eh_generation;  /* generation of the tree */
+};
+
+struct ext4_extent_idx {
+    uint32_t    ei_block;   /* index covers logical blocks from 'block' */
+    uint32_t    ei_leaf_lo; /* pointer to the physical block of the next level */
+    uint16_t    ei_leaf_hi; /* high 16 bits of physical block */
+    uint16_t    ei_unused;
+};
+
+struct ext4_extent {
+    uint32_t    ee_block;   /* first logical block extent covers */
+    uint16_t    ee_len;     /* number of blocks covered by extent */
+    uint16_t    ee_start_hi;    /* high 16 bits of physical block */
+    uint32_t    ee_start_lo;    /* low 32 bits of physical block */
+};
+
 #define i_reserved1 osd1.linux1.l_i_reserved1
 #define i_frag      osd2.linux2.l_i_frag
 #define i_fsize     osd2.linux2.l_i_fsize
@@ -165,6 +220,25 @@ struct ext2_inode {
 #define i_gid_high  osd2.linux2.l_i_gid_high
 #define i_reserved2 osd2.linux2.l_i_reserved2
 
+/*
+ * ext4 metadata checksums (crc32c) of inodes. The high half is only present
+ * in large inodes with enough extra space. Once verified, i_csum_seed holds
+ * the checksum seed of the inode in memory, for its extent tree blocks.
+ */
+#define EXT4_INODE_CSUM_LO          0x7c    /* offsets in the on-disk inode */
+#define EXT4_INODE_EXTRA_ISIZE      0x80
+#define EXT4_INODE_CSUM_HI          0x82
+#define EXT4_INODE_CSUM_HI_END      0x84
+#define i_csum_seed i_reserved2
+
+/* checksum of extent tree blocks, behind eh_max entries */
+struct ext4_extent_tail {
+    uint32_t    et_checksum;
+};
+
+/* checksum of group descriptors (low 16 bits of the crc32c) */
+#define EXT4_BG_CHECKSUM            0x1e    /* offset in the descriptor */
+
 /*
  * File system states
  */
@@ -288,6 +362,14 @@ struct ext2_super_block {
     uint32_t    s_reserved[190];    /* Padding to the end of the block */
 };
 
+#define s_desc_size s_reserved_word_pad /* ext4: group descriptor size (64bit) */
+#define s_flags s_reserved[22]  /* ext4: miscellaneous flags (offset 0x160) */
+#define s_checksum_seed s_reserved[90]  /* ext4: crc32c(~0, s_uuid) if CSUM_SEED (0x270) */
+#define s_checksum s_reserved[189]  /* ext4: crc32c of the superblock up to here (0x3fc) */
+
+#define EXT2_FLAGS_SIGNED_HASH      0x0001  /* htree uses signed char hashes */
+#define EXT2_FLAGS_UNSIGNED_HASH    0x0002  /* htree uses unsigned char hashes */
+
 /*
  * Codes for operating systems
  */
@@ -342,6 +424,11 @@ struct ext2_super_block {
 #define EXT2_FEATURE_RO_COMPAT_SPARSE_SUPER 0x0001
 #define EXT2_FEATURE_RO_COMPAT_LARGE_FILE   0x0002
 #define EXT2_FEATURE_RO_COMPAT_BTREE_DIR    0x0004
+#define EXT4_FEATURE_RO_COMPAT_HUGE_FILE    0x0008
+#define EXT4_FEATURE_RO_COMPAT_GDT_CSUM     0x0010
+#define EXT4_FEATURE_RO_COMPAT_DIR_NLINK    0x0020
+#define EXT4_FEATURE_RO_COMPAT_EXTRA_ISIZE  0x0040
+#define EXT4_FEATURE_RO_COMPAT_METADATA_CSUM    0x0400
 #define EXT2_FEATURE_RO_COMPAT_ANY      0xffffffff
 
 #define EXT2_FEATURE_INCOMPAT_COMPRESSION   0x0001
@@ -349,6 +436,11 @@ struct ext2_super_block {
 #define EXT3_FEATURE_INCOMPAT_RECOVER       0x0004
 #define EXT3_FEATURE_INCOMPAT_JOURNAL_DEV   0x0008
 #define EXT2_FEATURE_INCOMPAT_META_BG       0x0010
+#define EXT4_FEATURE_INCOMPAT_EXTENTS       0x0040
+#define EXT4_FEATURE_INCOMPAT_64BIT     0x0080
+#define EXT4_FEATURE_INCOMPAT_FLEX_BG       0x0200
+#define EXT4_FEATURE_INCOMPAT_CSUM_SEED     0x2000
+#define EXT4_FEATURE_INCOMPAT_INLINE_DATA   0x8000
 #define EXT2_FEATURE_INCOMPAT_ANY       0xffffffff
 
 #define EXT2_FEATURE_COMPAT_SUPP    EXT2_FEATURE_COMPAT_EXT_ATTR
@@ -406,6 +498,39 @@ struct ext2_dir_entry_2 {
     char    name[EXT2_NAME_LEN];    /* File name */
 };
 
+/*
+ * htree directory index. The root is in the first directory block after the
+ * "." and ".." entries, index nodes are hidden in an empty directory entry.
+ */
+struct ext2_dx_root_info {
+    uint32_t    reserved_zero;
+    uint8_t hash_version;
+    uint8_t info_length;    /* 8 */
+    uint8_t indirect_levels;
+    uint8_t unused_flags;
+};
+
+struct ext2_dx_countlimit {
+    uint16_t    limit;
+    uint16_t    count;
+};
+
+/* the first entry of each node starts with the countlimit instead of a hash */
+struct ext2_dx_entry {
+    uint32_t    hash;
+    uint32_t    block;      /* file block in the directory */
+};
+
+#define EXT2_DX_ROOT_INFO_OFFSET    24  /* after the "." and ".." entries */
+#define EXT2_DX_NODE_OFFSET     8   /* after the empty directory entry */
+
+#define EXT2_HASH_LEGACY            0
+#define EXT2_HASH_HALF_MD4          1
+#define EXT2_HASH_TEA               2
+#define EXT2_HASH_LEGACY_UNSIGNED   3
+#define EXT2_HASH_HALF_MD4_UNSIGNED 4
+#define EXT2_HASH_TEA_UNSIGNED      5
+
 /*
  * Ext2 directory file types.  Only the low 3 bits are used.  The
  * other bits are reserved for now.
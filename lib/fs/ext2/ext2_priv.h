@@ -33,14 +33,54 @@ typedef uint32_t blocknum_t;
 typedef uint32_t inodenum_t;
 typedef uint32_t groupnum_t;
 
+/* returned by the block mapping for metadata with a wrong checksum */
+#define EXT2_BLOCK_BAD UINT32_MAX
+
+/* cached result of a directory lookup, the file system is read-only */
+#define EXT2_DCACHE_SIZE 64
+#define EXT2_DCACHE_NAME_LEN 46
+
+struct ext2_dcache_entry {
+    inodenum_t dir; // 0 if unused
+    inodenum_t inum; // 0 if the name does not exist
+    uint8_t namelen;
+    char name[EXT2_DCACHE_NAME_LEN];
+};
+
+/* targets of symlinks that are not stored in i_block */
+#define EXT2_LCACHE_SIZE 8
+#define EXT2_LCACHE_LEN 120
+
+struct ext2_lcache_entry {
+    inodenum_t num; // 0 if unused
+    uint32_t len;
+    char target[EXT2_LCACHE_LEN];
+};
+
+/* copies of recently used inodes, replaced least recently used first */
+struct ext2_icache_entry {
+    inodenum_t num; // 0 if unused
+    uint32_t last_used;
+    struct ext2_inode inode; // already endian swapped
+};
+
 typedef struct {
     bdev_t *dev;
     bcache_t cache;
+    struct ext2_dcache_entry *dcache; // path components to inodes, may be NULL
+    struct ext2_icache_entry *icache; // inode numbers to inodes, may be NULL
+    struct ext2_lcache_entry *lcache; // symlink inodes to targets, may be NULL
+    uint32_t icache_count;
+    uint32_t icache_clock;
 
     struct ext2_super_block sb;
     int s_group_count;
-    struct ext2_group_desc *gd;
+    size_t desc_size; // on disk
+    struct ext2_group_desc *gd; // loaded on demand
     struct ext2_inode root_inode;
+
+    bool csum; // metadata_csum, verify the checksums
+    uint32_t csum_seed;
 } ext2_t;
 
 struct cache_block {
@@ -48,12 +88,28 @@ struct cache_block {
     void *ptr;
 };
 
+/* last extent used by a file, saves walking the extent tree for every read */
+struct ext4_extent_cache {
+    uint32_t lblk;
+    uint32_t len; // 0 if empty
+    blocknum_t pblk; // 0 for holes
+};
+
+/* block mapping state of an open file, saves going through the metadata for every read */
+struct ext2_map_cache {
+    struct cache_block ind[3]; // copies of the last block table at each indirection level
+    struct ext4_extent_cache extent;
+};
+
 /* open file handle */
 typedef struct {
     ext2_t *ext2;
 
-    struct cache_block ind_cache[3]; // cache of indirect blocks as they're scanned
+    struct ext2_map_cache map_cache;
     struct ext2_inode inode;
+    inodenum_t inum;
+    uint8_t *inline_data; // contents of files with inline data, NULL otherwise
+    bool dirty; // inode changed by a write, stored when the file is closed
 } ext2_file_t;
 
 typedef struct {
@@ -64,7 +120,12 @@ typedef struct {
 
 /* internal routines */
 int ext2_load_inode(ext2_t *ext2, inodenum_t num, struct ext2_inode *inode);
+int ext2_write_inode(ext2_t *ext2, inodenum_t num, const struct ext2_inode *inode);
+int ext2_check_writable(ext2_t *ext2);
+ssize_t ext2_read_inline_data(ext2_t *ext2, inodenum_t num, struct ext2_inode *inode, void *buf, size_t len);
 int ext2_lookup(ext2_t *ext2, const char *path, inodenum_t *inum); // path to inode
+int ext2_lookup_name(ext2_t *ext2, inodenum_t dir, struct ext2_inode *dir_inode,
+                     const char *name, inodenum_t *inum); // one name in a directory
 
 /* io */
 int ext2_read_block(ext2_t *ext2, void *buf, blocknum_t bnum);
@@ -73,16 +134,39 @@ int ext2_put_block(ext2_t *ext2, blocknum_t bnum);
 
 off_t ext2_file_len(ext2_t *ext2, struct ext2_inode *inode);
 ssize_t ext2_read_inode(ext2_t *ext2, struct ext2_inode *inode, void *buf, off_t offset, size_t len);
-int ext2_read_link(ext2_t *ext2, struct ext2_inode *inode, char *str, size_t len);
+ssize_t ext2_read_inode_cached(ext2_t *ext2, struct ext2_inode *inode, struct ext2_map_cache *cache,
+                               void *buf, off_t offset, size_t len);
+ssize_t ext2_read_file_data(ext2_file_t *file, void *buf, off_t offset, size_t len);
+int ext2_read_link(ext2_t *ext2, inodenum_t num, struct ext2_inode *inode, char *str, size_t len);
+
+/* htree */
+int ext2_dirhash(ext2_t *ext2, uint version, const char *name, size_t len, uint32_t *hash);
+
+/* checksums */
+bool ext2_csum_init(ext2_t *ext2, const struct ext2_super_block *sb);
+bool ext2_csum_group_desc(ext2_t *ext2, groupnum_t group, const void *desc, size_t size);
+bool ext2_csum_inode(ext2_t *ext2, inodenum_t num, const uint8_t *raw, uint32_t *seed);
+void ext2_csum_inode_update(ext2_t *ext2, inodenum_t num, uint8_t *raw);
+bool ext4_csum_extent_block(ext2_t *ext2, const struct ext2_inode *inode, const void *block);
+
+/* extents */
+blocknum_t ext4_extent_map(ext2_t *ext2, struct ext2_inode *inode, struct ext4_extent_cache *cache,
+                           uint fileblock, uint max, uint *count);
 
 /* fs api */
+status_t ext2_probe(bdev_t *dev);
 status_t ext2_mount(bdev_t *dev, fscookie **cookie);
 status_t ext2_unmount(fscookie *cookie);
 
 status_t ext2_open_file(fscookie *cookie, const char *path, filecookie **fcookie);
 ssize_t ext2_read_file(filecookie *fcookie, void *buf, off_t offset, size_t len);
+ssize_t ext2_write_file(filecookie *fcookie, const void *buf, off_t offset, size_t len);
+status_t ext2_truncate_file(filecookie *fcookie, uint64_t len);
 status_t ext2_close_file(filecookie *fcookie);
 status_t ext2_stat_file(filecookie *fcookie, struct file_stat *);
+status_t ext2_map_file(filecookie *fcookie, off_t offset, struct file_extent *ext);
+status_t ext2_get_key(filecookie *fcookie, uint8_t *data);
+status_t ext2_check_key(bdev_t *dev, const uint8_t *data);
 
 status_t ext2_open_directory(fscookie *cookie, const char *path, dircookie **dircookie);
 status_t ext2_read_directory(dircookie *dircookie, struct dirent *ent);
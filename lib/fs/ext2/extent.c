@@ -0,0 +1,140 @@
+// SPDX-License-Identifier: BSD-3-Clause
+/*
+ * Read-only support for the ext4 extent tree. Only 32-bit block numbers are
+ * supported, like in the rest of the ext2 driver.
+ */
+
+#include <stdlib.h>
+#include <debug.h>
+#include "ext2_priv.h"
+
+#define LOCAL_TRACE 0
+
+/* same limit as linux, the tree never gets deeper than this */
+#define EXT4_EXT_MAX_DEPTH 5
+
+static bool ext4_ext_header_valid(const struct ext4_extent_header *eh, size_t size)
+{
+    if (LE16(eh->eh_magic) != EXT4_EXT_MAGIC)
+        return false;
+
+    /* extents and index entries have the same size */
+    return sizeof(*eh) + LE16(eh->eh_entries) * sizeof(struct ext4_extent) <= size;
+}
+
+/*
+ * translate a file block to a physical block using the extent tree and count
+ * how many of the following file blocks (up to max) are contiguous. holes and
+ * uninitialized extents are returned as block 0, tree blocks with a wrong
+ * checksum as EXT2_BLOCK_BAD.
+ */
+blocknum_t ext4_extent_map(ext2_t *ext2, struct ext2_inode *inode, struct ext4_extent_cache *cache,
+                           uint fileblock, uint max, uint *count)
+{
+    const struct ext4_extent_header *eh = (const void *)inode->i_block;
+    size_t size = sizeof(inode->i_block);
+    struct ext4_extent_cache found = { 0 };
+    uint32_t next = UINT32_MAX; // start of the next extent, ends a hole
+    blocknum_t bnum = 0;
+    void *ptr = NULL;
+    uint depth, entries, i;
+
+    *count = 1;
+
+    if (cache && cache->len && fileblock >= cache->lblk && fileblock - cache->lblk < cache->len) {
+        found = *cache;
+        goto done;
+    }
+
+    /* walk down the index nodes */
+    for (depth = 0;; depth++) {
+        if (depth > EXT4_EXT_MAX_DEPTH || !ext4_ext_header_valid(eh, size)) {
+            LTRACEF("corrupted extent tree at depth %u\n", depth);
+            goto out;
+        }
+
+        entries = LE16(eh->eh_entries);
+        if (LE16(eh->eh_depth) == 0)
+            break;
+        if (entries == 0)
+            goto out;
+
+        /* use the last index that starts at or before the block */
+        const struct ext4_extent_idx *idx = (const void *)(eh + 1);
+        for (i = 1; i < entries && LE32(idx[i].ei_block) <= fileblock; i++)
+            ;
+        if (i < entries)
+            next = LE32(idx[i].ei_block);
+        i--;
+
+        if (LE16(idx[i].ei_leaf_hi)) {
+            LTRACEF("extent tree block above 32 bits\n");
+            goto out;
+        }
+
+        if (ptr)
+            ext2_put_block(ext2, bnum);
+        bnum = LE32(idx[i].ei_leaf_lo);
+        if (ext2_get_block(ext2, &ptr, bnum) < 0) {
+            ptr = NULL;
+            goto out;
+        }
+
+        eh = ptr;
+        size = EXT2_BLOCK_SIZE(ext2->sb);
+        if (!ext4_csum_extent_block(ext2, inode, eh)) {
+            LTRACEF("corrupted extent tree block %u\n", bnum);
+            ext2_put_block(ext2, bnum);
+            return EXT2_BLOCK_BAD;
+        }
+    }
+
+    /* find the extent in the leaf */
+    const struct ext4_extent *ex = (const void *)(eh + 1);
+    for (i = 0; i < entries; i++) {
+        uint32_t start = LE32(ex[i].ee_block);
+        uint32_t len = LE16(ex[i].ee_len);
+        bool uninit = len > EXT4_EXT_INIT_MAX_LEN;
+
+        if (uninit)
+            len -= EXT4_EXT_INIT_MAX_LEN;
+
+        if (fileblock < start) {
+            next = MIN(next, start);
+            break;
+        }
+        if (fileblock - start >= len)
+            continue;
+
+        if (LE16(ex[i].ee_start_hi)) {
+            LTRACEF("extent above 32 bits\n");
+            break;
+        }
+
+        found.lblk = start;
+        found.len = len;
+        found.pblk = uninit ? 0 : LE32(ex[i].ee_start_lo);
+        break;
+    }
+
+out:
+    if (ptr)
+        ext2_put_block(ext2, bnum);
+
+    if (!found.len) {
+        /* not mapped, read as zeroes up to the next extent */
+        *count = MAX(MIN(max, next - fileblock), 1U);
+        return 0;
+    }
+
+    if (cache)
+        *cache = found;
+
+done:
+    *count = MIN(max, found.len - (fileblock - found.lblk));
+
+    LTRACEF("fileblock %u: extent %u+%u @ %u, count %u\n",
+            fileblock, found.lblk, found.len, found.pblk, *count);
+
+    return found.pblk ? found.pblk + (fileblock - found.lblk) : 0;
+}
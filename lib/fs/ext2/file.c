@@ -52,7 +52,29 @@ int ext2_open_file(fscookie *cookie, const char *path, filecookie **fcookie)
         return err;
     }
 
+    /* small files can be stored in the inode itself, keep a copy */
+    if (file->inode.i_flags & EXT4_INLINE_DATA_FL) {
+        if (file->inode.i_size > EXT2_INODE_SIZE(ext2->sb)) {
+            free(file);
+            return ERR_NOT_VALID;
+        }
+
+        file->inline_data = malloc(file->inode.i_size + 1);
+        if (!file->inline_data) {
+            free(file);
+            return ERR_NO_MEMORY;
+        }
+
+        err = ext2_read_inline_data(ext2, inum, &file->inode, file->inline_data, file->inode.i_size);
+        if (err < 0) {
+            free(file->inline_data);
+            free(file);
+            return err;
+        }
+    }
+
     file->ext2 = ext2;
+    file->inum = inum;
     *fcookie = (filecookie *)file;
 
     return 0;
@@ -70,26 +92,139 @@ ssize_t ext2_read_file(filecookie *fcookie, void *buf, off_t offset, size_t len)
     }
 
     // read from the inode
-    err = ext2_read_inode(file->ext2, &file->inode, buf, offset, len);
+    err = ext2_read_file_data(file, buf, offset, len);
 
     return err;
 }
 
+/* read from an open file or directory, also if it has inline data */
+ssize_t ext2_read_file_data(ext2_file_t *file, void *buf, off_t offset, size_t len)
+{
+    off_t size;
+
+    if (!file->inline_data)
+        return ext2_read_inode_cached(file->ext2, &file->inode, &file->map_cache, buf, offset, len);
+
+    size = file->inode.i_size;
+    if (offset >= size)
+        return 0;
+    if (offset + len > size)
+        len = size - offset;
+
+    memcpy(buf, file->inline_data + offset, len);
+    return len;
+}
+
+/*
+ * overwrite the data of a file in place. no blocks are allocated, so writes
+ * past the end of the file or into holes (including unwritten extents) fail.
+ * the data goes straight to the device, the inode is updated on close.
+ */
+ssize_t ext2_write_file(filecookie *fcookie, const void *_buf, off_t offset, size_t len)
+{
+    ext2_file_t *file = (ext2_file_t *)fcookie;
+    ext2_t *ext2 = file->ext2;
+    size_t block_size = EXT2_BLOCK_SIZE(ext2->sb);
+    const uint8_t *buf = _buf;
+    struct file_extent ext;
+    size_t written = 0, n;
+    ssize_t ret;
+    int err = 0;
+
+    if (!S_ISREG(file->inode.i_mode) || file->inline_data)
+        return ERR_NOT_SUPPORTED;
+    if (offset < 0 || offset + (off_t)len > ext2_file_len(ext2, &file->inode))
+        return ERR_INVALID_ARGS;
+
+    err = ext2_check_writable(ext2);
+    if (err < 0)
+        return err;
+
+    while (written < len) {
+        err = ext2_map_file(fcookie, offset + written, &ext);
+        if (err < 0)
+            break;
+        if (ext.offset == 0) {
+            LTRACEF("offset %lld is not allocated\n", offset + written);
+            err = ERR_NOT_SUPPORTED;
+            break;
+        }
+
+        n = MIN(ext.len, len - written);
+        ret = bio_write(ext2->dev, buf + written, ext.offset, n);
+
+        /* the block cache still has the old data, also if the write failed halfway */
+        bcache_invalidate(ext2->cache, ext.offset / block_size,
+                          (ext.offset % block_size + n + block_size - 1) / block_size);
+        file->dirty = true;
+        if (ret != (ssize_t)n) {
+            err = (ret < 0) ? ret : ERR_IO;
+            break;
+        }
+
+        written += n;
+    }
+
+    LTRACEF("err %d, written %zu\n", err, written);
+
+    return (err < 0) ? err : (ssize_t)written;
+}
+
+/*
+ * shrink a file without freeing any blocks. e2fsck does not accept allocated
+ * blocks after the end of a file, so only the unused part of the last block can
+ * be cut off. files cannot grow since nothing is allocated.
+ */
+status_t ext2_truncate_file(filecookie *fcookie, uint64_t len)
+{
+    ext2_file_t *file = (ext2_file_t *)fcookie;
+    ext2_t *ext2 = file->ext2;
+    size_t block_size = EXT2_BLOCK_SIZE(ext2->sb);
+    uint64_t size = ext2_file_len(ext2, &file->inode);
+    int err;
+
+    if (!S_ISREG(file->inode.i_mode) || file->inline_data)
+        return ERR_NOT_SUPPORTED;
+    if (len == size)
+        return 0;
+    if (len > size || len == 0 || (len - 1) / block_size != (size - 1) / block_size)
+        return ERR_NOT_SUPPORTED;
+
+    err = ext2_check_writable(ext2);
+    if (err < 0)
+        return err;
+
+    file->inode.i_size = len;
+    file->inode.i_size_high = len >> 32;
+    file->dirty = true;
+    return 0;
+}
+
 int ext2_close_file(filecookie *fcookie)
 {
     ext2_file_t *file = (ext2_file_t *)fcookie;
+    int err = 0;
+
+    /*
+     * there is no clock, so just advance the timestamps. the keys of the file
+     * (see ext2_get_key()) and anything cached for it become invalid.
+     */
+    if (file->dirty) {
+        file->inode.i_mtime = MAX(file->inode.i_mtime, file->inode.i_ctime) + 1;
+        file->inode.i_ctime = file->inode.i_mtime;
+        err = ext2_write_inode(file->ext2, file->inum, &file->inode);
+    }
 
-    // see if we need to free any of the cache blocks
+    // free the cached block tables
     int i;
     for (i=0; i < 3; i++) {
-        if (file->ind_cache[i].num != 0) {
-            free(file->ind_cache[i].ptr);
-        }
+        free(file->map_cache.ind[i].ptr);
     }
 
+    free(file->inline_data);
     free(file);
 
-    return 0;
+    return err;
 }
 
 off_t ext2_file_len(ext2_t *ext2, struct ext2_inode *inode)
@@ -109,6 +244,7 @@ int ext2_stat_file(filecookie *fcookie, struct file_stat *stat)
     ext2_file_t *file = (ext2_file_t *)fcookie;
 
     stat->size = ext2_file_len(file->ext2, &file->inode);
+    stat->mtime = file->inode.i_mtime;
 
     /* is it a dir? */
     stat->is_dir = false;
@@ -118,23 +254,50 @@ int ext2_stat_file(filecookie *fcookie, struct file_stat *stat)
     return 0;
 }
 
-int ext2_read_link(ext2_t *ext2, struct ext2_inode *inode, char *str, size_t len)
+int ext2_read_link(ext2_t *ext2, inodenum_t num, struct ext2_inode *inode, char *str, size_t len)
 {
-    LTRACEF("inode %p, str %p, len %zu\n", inode, str, len);
+    struct ext2_lcache_entry *ent = NULL;
+    int err;
+
+    LTRACEF("num %u, inode %p, str %p, len %zu\n", num, inode, str, len);
 
     off_t linklen = ext2_file_len(ext2, inode);
 
     if ((linklen < 0) || (linklen + 1 > len))
         return ERR_NO_MEMORY;
 
-    if (linklen > 60) {
-        int err = ext2_read_inode(ext2, inode, str, 0, linklen);
-        if (err < 0)
-            return err;
-        str[linklen] = 0;
-    } else {
+    /* fast symlinks are stored in i_block, only shorter ones including the terminator */
+    if (!(inode->i_flags & EXT4_INLINE_DATA_FL) && linklen < EXT4_MIN_INLINE_DATA_SIZE) {
         memcpy(str, &inode->i_block[0], linklen);
         str[linklen] = 0;
+        LTRACEF("read link '%s'\n", str);
+        return linklen;
+    }
+
+    /* the others need another read, so remember them */
+    if (ext2->lcache && linklen < EXT2_LCACHE_LEN) {
+        ent = &ext2->lcache[num % EXT2_LCACHE_SIZE];
+        if (ent->num == num && ent->len == linklen) {
+            memcpy(str, ent->target, linklen + 1);
+            LTRACEF("cached link '%s'\n", str);
+            return linklen;
+        }
+    }
+
+    if (inode->i_flags & EXT4_INLINE_DATA_FL)
+        err = ext2_read_inline_data(ext2, num, inode, str, linklen);
+    else
+        err = ext2_read_inode(ext2, inode, str, 0, linklen);
+    if (err < 0)
+        return err;
+    if (err != linklen)
+        return ERR_IO;
+    str[linklen] = 0;
+
+    if (ent) {
+        ent->num = num;
+        ent->len = linklen;
+        memcpy(ent->target, str, linklen + 1);
     }
 
     LTRACEF("read link '%s'\n", str);
@@ -0,0 +1,187 @@
+// SPDX-License-Identifier: BSD-3-Clause
+/*
+ * Directory name hashes of the htree directory index, compatible with the
+ * ones used by Linux and e2fsprogs.
+ */
+
+#include <err.h>
+#include <stdlib.h>
+#include <string.h>
+#include "ext2_priv.h"
+
+#define ROL32(x, s) (((x) << (s)) | ((x) >> (32 - (s))))
+
+#define TEA_DELTA 0x9e3779b9
+
+static void tea_transform(uint32_t buf[4], const uint32_t in[4])
+{
+    uint32_t sum = 0, b0 = buf[0], b1 = buf[1];
+    int n;
+
+    for (n = 0; n < 16; n++) {
+        sum += TEA_DELTA;
+        b0 += ((b1 << 4) + in[0]) ^ (b1 + sum) ^ ((b1 >> 5) + in[1]);
+        b1 += ((b0 << 4) + in[2]) ^ (b0 + sum) ^ ((b0 >> 5) + in[3]);
+    }
+
+    buf[0] += b0;
+    buf[1] += b1;
+}
+
+#define F(x, y, z) ((z) ^ ((x) & ((y) ^ (z))))
+#define G(x, y, z) (((x) & (y)) + (((x) ^ (y)) & (z)))
+#define H(x, y, z) ((x) ^ (y) ^ (z))
+
+#define ROUND(f, a, b, c, d, x, s) ((a) += f((b), (c), (d)) + (x), (a) = ROL32((a), (s)))
+#define K1 0
+#define K2 013240474631U
+#define K3 015666365641U
+
+/* MD4 with 3 rounds of 8 steps, on 32 bytes of input */
+static void half_md4_transform(uint32_t buf[4], const uint32_t in[8])
+{
+    uint32_t a = buf[0], b = buf[1], c = buf[2], d = buf[3];
+
+    ROUND(F, a, b, c, d, in[0] + K1, 3);
+    ROUND(F, d, a, b, c, in[1] + K1, 7);
+    ROUND(F, c, d, a, b, in[2] + K1, 11);
+    ROUND(F, b, c, d, a, in[3] + K1, 19);
+    ROUND(F, a, b, c, d, in[4] + K1, 3);
+    ROUND(F, d, a, b, c, in[5] + K1, 7);
+    ROUND(F, c, d, a, b, in[6] + K1, 11);
+    ROUND(F, b, c, d, a, in[7] + K1, 19);
+
+    ROUND(G, a, b, c, d, in[1] + K2, 3);
+    ROUND(G, d, a, b, c, in[3] + K2, 5);
+    ROUND(G, c, d, a, b, in[5] + K2, 9);
+    ROUND(G, b, c, d, a, in[7] + K2, 13);
+    ROUND(G, a, b, c, d, in[0] + K2, 3);
+    ROUND(G, d, a, b, c, in[2] + K2, 5);
+    ROUND(G, c, d, a, b, in[4] + K2, 9);
+    ROUND(G, b, c, d, a, in[6] + K2, 13);
+
+    ROUND(H, a, b, c, d, in[3] + K3, 3);
+    ROUND(H, d, a, b, c, in[7] + K3, 9);
+    ROUND(H, c, d, a, b, in[2] + K3, 11);
+    ROUND(H, b, c, d, a, in[6] + K3, 15);
+    ROUND(H, a, b, c, d, in[1] + K3, 3);
+    ROUND(H, d, a, b, c, in[5] + K3, 9);
+    ROUND(H, c, d, a, b, in[0] + K3, 11);
+    ROUND(H, b, c, d, a, in[4] + K3, 15);
+
+    buf[0] += a;
+    buf[1] += b;
+    buf[2] += c;
+    buf[3] += d;
+}
+
+/* the original hash, before the cryptographic ones were added */
+static uint32_t dx_hack_hash(const char *name, size_t len, bool is_unsigned)
+{
+    uint32_t hash, hash0 = 0x12a3fe2d, hash1 = 0x37abe8f9;
+    size_t i;
+    int c;
+
+    for (i = 0; i < len; i++) {
+        c = is_unsigned ? (int)(unsigned char)name[i] : (int)(signed char)name[i];
+        hash = hash1 + (hash0 ^ (uint32_t)(c * 7152373));
+        if (hash & 0x80000000)
+            hash -= 0x7fffffff;
+        hash1 = hash0;
+        hash0 = hash;
+    }
+
+    return hash0 << 1;
+}
+
+/* pack up to num words of the name, padded with its length */
+static void str2hashbuf(const char *msg, size_t len, uint32_t *buf, int num, bool is_unsigned)
+{
+    uint32_t pad, val;
+    size_t i;
+    int c;
+
+    pad = (uint32_t)len | ((uint32_t)len << 8);
+    pad |= pad << 16;
+
+    val = pad;
+    if (len > (size_t)num * 4)
+        len = num * 4;
+
+    for (i = 0; i < len; i++) {
+        c = is_unsigned ? (int)(unsigned char)msg[i] : (int)(signed char)msg[i];
+        val = (uint32_t)c + (val << 8);
+        if ((i % 4) == 3) {
+            *buf++ = val;
+            val = pad;
+            num--;
+        }
+    }
+
+    if (--num >= 0)
+        *buf++ = val;
+    while (--num >= 0)
+        *buf++ = pad;
+}
+
+/*
+ * calculate the major hash of a name for the hash version stored in the htree
+ * root. returns ERR_NOT_SUPPORTED for unknown versions (e.g. siphash).
+ */
+int ext2_dirhash(ext2_t *ext2, uint version, const char *name, size_t len, uint32_t *hash)
+{
+    uint32_t buf[4] = { 0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476 };
+    uint32_t in[8];
+    bool is_unsigned;
+    uint32_t h;
+    int i;
+
+    /* the file system records the signedness of char on the machine that created it */
+    if (version <= EXT2_HASH_TEA && (ext2->sb.s_flags & EXT2_FLAGS_UNSIGNED_HASH))
+        version += EXT2_HASH_LEGACY_UNSIGNED;
+    is_unsigned = version >= EXT2_HASH_LEGACY_UNSIGNED;
+
+    for (i = 0; i < 4; i++) {
+        if (ext2->sb.s_hash_seed[i]) {
+            memcpy(buf, ext2->sb.s_hash_seed, sizeof(buf));
+            break;
+        }
+    }
+
+    switch (version) {
+        case EXT2_HASH_LEGACY:
+        case EXT2_HASH_LEGACY_UNSIGNED:
+            h = dx_hack_hash(name, len, is_unsigned);
+            break;
+        case EXT2_HASH_HALF_MD4:
+        case EXT2_HASH_HALF_MD4_UNSIGNED:
+            while (len > 0) {
+                str2hashbuf(name, len, in, 8, is_unsigned);
+                half_md4_transform(buf, in);
+                name += MIN(len, 32U);
+                len -= MIN(len, 32U);
+            }
+            h = buf[1];
+            break;
+        case EXT2_HASH_TEA:
+        case EXT2_HASH_TEA_UNSIGNED:
+            while (len > 0) {
+                str2hashbuf(name, len, in, 4, is_unsigned);
+                tea_transform(buf, in);
+                name += MIN(len, 16U);
+                len -= MIN(len, 16U);
+            }
+            h = buf[0];
+            break;
+        default:
+            return ERR_NOT_SUPPORTED;
+    }
+
+    /* the lowest bit marks hash collisions in the index, 0xfffffffe is end of dir */
+    h &= ~1U;
+    if (h == 0xfffffffe)
+        h = 0xfffffffc;
+
+    *hash = h;
+    return 0;
+}
@@ -24,6 +24,7 @@
 #include <string.h>
 #include <stdlib.h>
 #include <debug.h>
+#include <err.h>
 #include "ext2_priv.h"
 
 #define LOCAL_TRACE 0
@@ -141,45 +142,180 @@ error:
     return err;
 }
 
-/* translate a file block to a physical block */
-static blocknum_t file_block_to_fs_block(ext2_t *ext2, struct ext2_inode *inode, uint fileblock)
+/*
+ * get the block table that holds the pointer at pos[level]. with a per-file cache
+ * the tables on the way are kept in it, so sequential lookups only read each of
+ * them once. *put_block is the bcache block to put afterwards, or 0.
+ */
+static int ext2_get_block_table(ext2_t *ext2, struct ext2_inode *inode, struct ext2_map_cache *cache,
+                                uint32_t level, uint32_t pos[], blocknum_t **table, blocknum_t *put_block)
 {
+    struct cache_block *cb = NULL;
+    blocknum_t bnum;
+    uint32_t depth;
     int err;
-    blocknum_t block;
 
-    LTRACEF("inode %p, fileblock %u\n", inode, fileblock);
+    if (!cache)
+        return ext2_get_indirect_block_pointer_cache_block(ext2, inode, table, level, pos, put_block);
+
+    bnum = LE32(inode->i_block[pos[0]]);
+    for (depth = 0; depth < level; depth++) {
+        if (bnum == 0)
+            return -1;
+
+        cb = &cache->ind[depth];
+        if (cb->num != bnum) {
+            if (!cb->ptr) {
+                cb->ptr = malloc(EXT2_BLOCK_SIZE(ext2->sb));
+                if (!cb->ptr)
+                    return ext2_get_indirect_block_pointer_cache_block(ext2, inode, table, level, pos, put_block);
+            }
+
+            cb->num = 0;
+            err = ext2_read_block(ext2, cb->ptr, bnum);
+            if (err < 0)
+                return err;
+            cb->num = bnum;
+        }
+
+        if (depth + 1 < level)
+            bnum = LE32(((blocknum_t *)cb->ptr)[pos[depth + 1]]);
+    }
+
+    *table = cb->ptr;
+    *put_block = 0;
+    return 0;
+}
 
+/*
+ * translate a file block to a physical block and count how many of the following
+ * file blocks (up to max) are stored contiguously after it, looking only at the
+ * block table that contains the first one. holes are returned as block 0, with
+ * the number of holes that follow.
+ */
+static blocknum_t file_block_to_fs_run(ext2_t *ext2, struct ext2_inode *inode, struct ext2_map_cache *cache,
+                                       uint fileblock, uint max, uint *count)
+{
     uint32_t pos[4];
     uint32_t level = 0;
-    ext2_calculate_block_pointer_pos(ext2, fileblock, &level, pos);
+    uint32_t *table;
+    blocknum_t block, next, table_block = 0;
+    uint entries, i;
 
-    LTRACEF("level %d, pos 0x%x 0x%x 0x%x 0x%x\n", level, pos[0], pos[1], pos[2], pos[3]);
+    *count = 1;
+    if (ext2_calculate_block_pointer_pos(ext2, fileblock, &level, pos) < 0)
+        return 0;
 
     if (level == 0) {
-        /* direct block, just return it directly */
-        block = LE32(inode->i_block[fileblock]);
+        table = inode->i_block;
+        entries = EXT2_NDIR_BLOCKS;
     } else {
-        /* at least one level of indirection, get a pointer to the final indirect block table and dereference it */
-        blocknum_t *ind_table;
-        blocknum_t phys_block;
-        err = ext2_get_indirect_block_pointer_cache_block(ext2, inode, &ind_table, level, pos, &phys_block);
-        if (err < 0)
+        if (ext2_get_block_table(ext2, inode, cache, level, pos, &table, &table_block) < 0)
             return 0;
+        entries = EXT2_ADDR_PER_BLOCK(ext2->sb);
+    }
 
-        /* dereference the final entry in the final table */
-        block = LE32(ind_table[pos[level]]);
-        LTRACEF("block %u, indirect_block %u\n", block, phys_block);
-
-        /* release the ref on the cache block */
-        ext2_put_block(ext2, phys_block);
+    block = LE32(table[pos[level]]);
+    max = MIN(max, entries - pos[level]);
+    for (i = 1; i < max; i++) {
+        next = LE32(table[pos[level] + i]);
+        if (next != (block ? block + i : 0))
+            break;
     }
+    *count = i;
 
-    LTRACEF("returning %u\n", block);
+    if (table_block)
+        ext2_put_block(ext2, table_block);
+
+    LTRACEF("fileblock %u: block %u, count %u\n", fileblock, block, i);
 
     return block;
 }
 
-ssize_t ext2_read_inode(ext2_t *ext2, struct ext2_inode *inode, void *_buf, off_t offset, size_t len)
+/* translate a file block to a physical block run, for block maps or extents */
+static blocknum_t file_block_map(ext2_t *ext2, struct ext2_inode *inode, struct ext2_map_cache *cache,
+                                 uint fileblock, uint max, uint *count)
+{
+    if (inode->i_flags & EXT4_EXTENTS_FL)
+        return ext4_extent_map(ext2, inode, cache ? &cache->extent : NULL, fileblock, max, count);
+
+    return file_block_to_fs_run(ext2, inode, cache, fileblock, max, count);
+}
+
+/* find the run of blocks on the device that contains the file offset */
+status_t ext2_map_file(filecookie *fcookie, off_t offset, struct file_extent *ext)
+{
+    ext2_file_t *file = (ext2_file_t *)fcookie;
+    ext2_t *ext2 = file->ext2;
+    size_t block_size = EXT2_BLOCK_SIZE(ext2->sb);
+    off_t file_size = ext2_file_len(ext2, &file->inode);
+    uint file_block = offset / block_size;
+    uint max_blocks, count, more;
+    blocknum_t phys_block, next;
+
+    if (file->inline_data)
+        return ERR_NOT_SUPPORTED;
+    if (offset < 0 || offset >= file_size)
+        return ERR_INVALID_ARGS;
+
+    max_blocks = (file_size + block_size - 1) / block_size - file_block;
+    phys_block = file_block_map(ext2, &file->inode, &file->map_cache, file_block, max_blocks, &count);
+    if (phys_block == EXT2_BLOCK_BAD)
+        return ERR_IO;
+
+    /* like in ext2_read_inode_cached(), runs may continue in the next table */
+    while (count < max_blocks) {
+        next = file_block_map(ext2, &file->inode, &file->map_cache, file_block + count,
+                              max_blocks - count, &more);
+        if (next != (phys_block ? phys_block + count : 0))
+            break;
+        count += more;
+    }
+
+    ext->offset = phys_block ? (uint64_t)phys_block * block_size + offset % block_size : 0;
+    ext->len = MIN((uint64_t)count * block_size - offset % block_size,
+                   (uint64_t)(file_size - offset));
+    return 0;
+}
+
+/*
+ * read part of a block. larger fragments for aligned buffers are read straight
+ * into the buffer, the block device only bounces partial sectors. the rest is
+ * copied out of the block cache.
+ */
+static int ext2_read_fragment(ext2_t *ext2, blocknum_t bnum, size_t block_offset, void *buf, size_t len)
+{
+    void *ptr;
+    int err;
+
+    if (bnum == 0) {
+        memset(buf, 0, len);
+        return 0;
+    }
+    if (bnum == EXT2_BLOCK_BAD)
+        return ERR_IO;
+
+    if ((addr_t)buf % CACHE_LINE == 0 && len >= ext2->dev->block_size) {
+        err = bio_read(ext2->dev, buf, (off_t)EXT2_BLOCK_SIZE(ext2->sb) * bnum + block_offset, len);
+        return (err < 0) ? err : 0;
+    }
+
+    err = ext2_get_block(ext2, &ptr, bnum);
+    if (err < 0)
+        return err;
+
+    memcpy(buf, (uint8_t *)ptr + block_offset, len);
+    ext2_put_block(ext2, bnum);
+    return 0;
+}
+
+ssize_t ext2_read_inode(ext2_t *ext2, struct ext2_inode *inode, void *buf, off_t offset, size_t len)
+{
+    return ext2_read_inode_cached(ext2, inode, NULL, buf, offset, len);
+}
+
+ssize_t ext2_read_inode_cached(ext2_t *ext2, struct ext2_inode *inode, struct ext2_map_cache *cache,
+                               void *_buf, off_t offset, size_t len)
 {
     int err = 0;
     size_t bytes_read = 0;
@@ -190,6 +326,10 @@ ssize_t ext2_read_inode(ext2_t *ext2, struct ext2_inode *inode, void *_buf, off_
 
     LTRACEF("inode %p, offset %lld, len %zd, file_size %lld\n", inode, offset, len, file_size);
 
+    /* there are no blocks to map, see ext2_read_inline_data() */
+    if (inode->i_flags & EXT4_INLINE_DATA_FL)
+        return ERR_NOT_SUPPORTED;
+
     /* trim the read */
     if (offset > file_size)
         return 0;
@@ -200,23 +340,18 @@ ssize_t ext2_read_inode(ext2_t *ext2, struct ext2_inode *inode, void *_buf, off_
 
     /* calculate the starting file block */
     uint file_block = offset / EXT2_BLOCK_SIZE(ext2->sb);
+    uint count;
 
     /* handle partial first block */
     if ((offset % EXT2_BLOCK_SIZE(ext2->sb)) != 0) {
-        uint8_t temp[EXT2_BLOCK_SIZE(ext2->sb)];
-
-        /* calculate the block and read it */
-        blocknum_t phys_block = file_block_to_fs_block(ext2, inode, file_block);
-        if (phys_block == 0) {
-            memset(temp, 0, EXT2_BLOCK_SIZE(ext2->sb));
-        } else {
-            ext2_read_block(ext2, temp, phys_block);
-        }
-
-        /* copy out what we need */
         size_t block_offset = offset % EXT2_BLOCK_SIZE(ext2->sb);
         size_t tocopy = MIN(len, EXT2_BLOCK_SIZE(ext2->sb) - block_offset);
-        memcpy(buf, temp + block_offset, tocopy);
+
+        /* calculate the block and read what we need */
+        blocknum_t phys_block = file_block_map(ext2, inode, cache, file_block, 1, &count);
+        err = ext2_read_fragment(ext2, phys_block, block_offset, buf, tocopy);
+        if (err < 0)
+            goto done;
 
         /* increment our stuff */
         file_block++;
@@ -225,51 +360,61 @@ ssize_t ext2_read_inode(ext2_t *ext2, struct ext2_inode *inode, void *_buf, off_
         buf += tocopy;
     }
 
-    /* handle middle blocks */
+    /* handle middle blocks, reading contiguous runs with a single request */
     while (len >= EXT2_BLOCK_SIZE(ext2->sb)) {
-        /* calculate the block and read it */
-        blocknum_t phys_block = file_block_to_fs_block(ext2, inode, file_block);
-        blocknum_t count_cont_blks = 1;
-        blocknum_t max_blocks = len / EXT2_BLOCK_SIZE(ext2->sb);
-        if (phys_block == 0) {
-            memset(buf, 0, EXT2_BLOCK_SIZE(ext2->sb));
+        uint max_blocks = len / EXT2_BLOCK_SIZE(ext2->sb);
+        uint more, i;
+        blocknum_t phys_block, next;
+
+        phys_block = file_block_map(ext2, inode, cache, file_block, max_blocks, &count);
+
+        /* the run may continue in the next indirect block table or extent */
+        while (count < max_blocks) {
+            next = file_block_map(ext2, inode, cache, file_block + count, max_blocks - count, &more);
+            if (next != (phys_block ? phys_block + count : 0))
+                break;
+            count += more;
+        }
+
+        size_t run_len = (size_t)EXT2_BLOCK_SIZE(ext2->sb) * count;
+        if (phys_block == EXT2_BLOCK_BAD) {
+            err = ERR_IO;
+            goto done;
+        } else if (phys_block == 0) {
+            memset(buf, 0, run_len);
+        } else if ((addr_t)buf % CACHE_LINE) {
+            /* unaligned buffers cannot be used for DMA, go through the cache */
+            for (i = 0; i < count; i++) {
+                err = ext2_read_block(ext2, buf + i * EXT2_BLOCK_SIZE(ext2->sb), phys_block + i);
+                if (err < 0)
+                    goto done;
+            }
         } else {
-	    if ((addr_t)buf % CACHE_LINE) {
-	        ext2_read_block(ext2, buf, phys_block);
-	    } else {
-                while (count_cont_blks < max_blocks && file_block_to_fs_block(ext2, inode, file_block + count_cont_blks) == phys_block + count_cont_blks) {
-                    count_cont_blks++;
-                }
-                bio_read(ext2->dev, buf, EXT2_BLOCK_SIZE(ext2->sb) * phys_block, EXT2_BLOCK_SIZE(ext2->sb) * count_cont_blks);
-	    }
+            err = bio_read(ext2->dev, buf, (off_t)EXT2_BLOCK_SIZE(ext2->sb) * phys_block, run_len);
+            if (err < 0)
+                goto done;
         }
 
         /* increment our stuff */
-        file_block += count_cont_blks;
-        len -= EXT2_BLOCK_SIZE(ext2->sb) * count_cont_blks;
-        bytes_read += EXT2_BLOCK_SIZE(ext2->sb) * count_cont_blks;
-        buf += EXT2_BLOCK_SIZE(ext2->sb) * count_cont_blks;
+        file_block += count;
+        len -= run_len;
+        bytes_read += run_len;
+        buf += run_len;
     }
 
     /* handle partial last block */
     if (len > 0) {
-        uint8_t temp[EXT2_BLOCK_SIZE(ext2->sb)];
-
-        /* calculate the block and read it */
-        blocknum_t phys_block = file_block_to_fs_block(ext2, inode, file_block);
-        if (phys_block == 0) {
-            memset(temp, 0, EXT2_BLOCK_SIZE(ext2->sb));
-        } else {
-            ext2_read_block(ext2, temp, phys_block);
-        }
-
-        /* copy out what we need */
-        memcpy(buf, temp, len);
+        /* calculate the block and read what we need */
+        blocknum_t phys_block = file_block_map(ext2, inode, cache, file_block, 1, &count);
+        err = ext2_read_fragment(ext2, phys_block, 0, buf, len);
+        if (err < 0)
+            goto done;
 
         /* increment our stuff */
         bytes_read += len;
     }
 
+done:
     LTRACEF("err %d, bytes_read %zu\n", err, bytes_read);
 
     return (err < 0) ? err : (ssize_t)bytes_read;
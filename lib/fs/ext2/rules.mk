@@ -7,6 +7,9 @@ MODULES += \
 
 OBJS += \
 	$(LOCAL_DIR)/ext2.o \
+	$(LOCAL_DIR)/csum.o \
 	$(LOCAL_DIR)/dir.o \
+	$(LOCAL_DIR)/extent.o \
+	$(LOCAL_DIR)/hash.o \
 	$(LOCAL_DIR)/io.o \
 	$(LOCAL_DIR)/file.o
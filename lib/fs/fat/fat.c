@@ -0,0 +1,935 @@
+// SPDX-License-Identifier: BSD-3-Clause
+/*
+ * Read-only support for FAT12/16/32 with long file names (VFAT), e.g. for
+ * extlinux.conf and kernels on an EFI system partition.
+ *
+ * The cluster chain of a file is walked once when it is opened and kept as
+ * a list of runs of consecutive clusters. Reads are mapped directly to the
+ * device, so every contiguous part of the file is read with a single
+ * bio_read() into the destination buffer.
+ */
+
+#include <ctype.h>
+#include <debug.h>
+#include <endian.h>
+#include <err.h>
+#include <pow2.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <lib/bio.h>
+#include <lib/fs.h>
+
+#define LOCAL_TRACE 0
+
+#define FAT_SIGNATURE           0xaa55
+
+#define FAT_ATTR_VOLUME_ID      0x08
+#define FAT_ATTR_DIRECTORY      0x10
+#define FAT_ATTR_LFN            0x0f
+#define FAT_ATTR_LFN_MASK       0x3f
+
+#define FAT_ENTRY_END           0x00
+#define FAT_ENTRY_DELETED       0xe5
+#define FAT_ENTRY_KANJI_E5      0x05
+
+#define FAT_NTRES_LOWER_BASE    0x08
+#define FAT_NTRES_LOWER_EXT     0x10
+
+#define FAT_LFN_LAST            0x40
+#define FAT_LFN_SEQ_MASK        0x1f
+#define FAT_LFN_CHARS           13
+#define FAT_LFN_MAX             255
+
+/* the spec limits directories to 65536 entries */
+#define FAT_DIR_MAX_SIZE        (65536 * sizeof(struct fat_dir_entry))
+
+/* part of the FAT that is read at once while walking cluster chains */
+#define FAT_TABLE_BUF           (16 * 1024)
+
+/* directory entries read at once */
+#define FAT_DIR_BUF             4096
+
+struct fat_boot_sector {
+    uint8_t jump[3];
+    char oem_name[8];
+    uint16_t bytes_per_sector;
+    uint8_t sectors_per_cluster;
+    uint16_t reserved_sectors;
+    uint8_t fats;
+    uint16_t root_entries;
+    uint16_t sectors16;
+    uint8_t media;
+    uint16_t fat_size16;
+    uint16_t sectors_per_track;
+    uint16_t heads;
+    uint32_t hidden_sectors;
+    uint32_t sectors32;
+    /* FAT32 only */
+    uint32_t fat_size32;
+    uint16_t ext_flags;
+    uint16_t fs_version;
+    uint32_t root_cluster;
+    uint16_t fs_info;
+    uint16_t backup_boot;
+    uint8_t reserved[12];
+    uint8_t drive;
+    uint8_t reserved1;
+    uint8_t boot_sig;
+    uint32_t volume_id;
+    char volume_label[11];
+    char fs_type[8];
+    uint8_t boot_code[420];
+    uint16_t signature;
+} __PACKED;
+
+struct fat_dir_entry {
+    uint8_t name[11];
+    uint8_t attr;
+    uint8_t ntres;
+    uint8_t ctime_tenth;
+    uint16_t ctime;
+    uint16_t cdate;
+    uint16_t adate;
+    uint16_t cluster_hi;
+    uint16_t mtime;
+    uint16_t mdate;
+    uint16_t cluster_lo;
+    uint32_t size;
+} __PACKED;
+
+struct fat_lfn_entry {
+    uint8_t seq;
+    uint16_t name1[5];
+    uint8_t attr;
+    uint8_t type;
+    uint8_t checksum;
+    uint16_t name2[6];
+    uint16_t cluster;
+    uint16_t name3[2];
+} __PACKED;
+
+/* consecutive clusters of a file */
+struct fat_run {
+    uint32_t off;       /* offset in the file */
+    uint32_t len;
+    uint64_t pos;       /* byte offset on the device */
+};
+
+typedef struct {
+    bdev_t *dev;
+    uint type;          /* 12, 16 or 32 */
+    uint cluster_shift;
+    uint32_t clusters;  /* number of data clusters */
+    uint32_t eoc;       /* first end of chain marker */
+    uint64_t fat_start;
+    uint32_t fat_size;
+    uint64_t data_start;
+
+    /* fixed root directory of FAT12/16, or the root cluster of FAT32 */
+    uint64_t root_start;
+    uint32_t root_size;
+    uint32_t root_cluster;
+
+    uint8_t *table_buf;
+    uint32_t table_pos;
+    uint32_t table_len;
+} fat_t;
+
+typedef struct {
+    fat_t *fat;
+    bool is_dir;
+    uint32_t size;
+    uint32_t mtime;
+    uint nruns;
+    struct fat_run *runs;
+} fat_file_t;
+
+typedef struct {
+    fat_file_t file;
+    uint32_t pos;       /* offset of the next entry */
+    uint32_t buf_pos;
+    uint32_t buf_len;
+    uint8_t buf[FAT_DIR_BUF];
+} fat_dir_t;
+
+/* a directory entry with its long or short name */
+struct fat_dirent {
+    char name[FAT_LFN_MAX * 3 + 1];
+    uint8_t attr;
+    uint32_t cluster;
+    uint32_t size;
+    uint32_t mtime;
+};
+
+static bool fat_is_eoc(fat_t *fat, uint32_t cluster)
+{
+    return cluster >= fat->eoc;
+}
+
+/* get the next cluster of the chain from the FAT */
+static int fat_next_cluster(fat_t *fat, uint32_t cluster, uint32_t *next)
+{
+    uint32_t off, val;
+    const uint8_t *p;
+    uint need;
+    ssize_t ret;
+
+    switch (fat->type) {
+        case 12:
+            off = cluster + cluster / 2;
+            need = 2;
+            break;
+        case 16:
+            off = cluster * 2;
+            need = 2;
+            break;
+        default:
+            off = cluster * 4;
+            need = 4;
+            break;
+    }
+
+    if (off + need > fat->fat_size)
+        return ERR_NOT_VALID;
+
+    if (off < fat->table_pos || off + need > fat->table_pos + fat->table_len) {
+        fat->table_pos = ROUNDDOWN(off, 512);
+        fat->table_len = MIN(FAT_TABLE_BUF, fat->fat_size - fat->table_pos);
+
+        LTRACEF("FAT at %u, %u bytes\n", fat->table_pos, fat->table_len);
+
+        ret = bio_read(fat->dev, fat->table_buf, fat->fat_start + fat->table_pos, fat->table_len);
+        if (ret < (ssize_t)fat->table_len) {
+            fat->table_len = 0;
+            return ERR_IO;
+        }
+    }
+
+    p = fat->table_buf + off - fat->table_pos;
+    switch (fat->type) {
+        case 12:
+            val = p[0] | p[1] << 8;
+            val = (cluster & 1) ? val >> 4 : val & 0xfff;
+            break;
+        case 16:
+            val = p[0] | p[1] << 8;
+            break;
+        default:
+            val = (p[0] | p[1] << 8 | p[2] << 16 | (uint32_t)p[3] << 24) & 0x0fffffff;
+            break;
+    }
+
+    *next = val;
+    return 0;
+}
+
+/*
+ * Walk the cluster chain starting at cluster and store it as runs of
+ * consecutive clusters. At most max bytes are mapped, 0 maps the whole chain.
+ */
+static int fat_map_chain(fat_t *fat, fat_file_t *file, uint32_t cluster, uint32_t max)
+{
+    uint32_t cluster_size = 1U << fat->cluster_shift;
+    uint32_t count, total = 0, next;
+    struct fat_run *run = NULL;
+    uint alloc = 0;
+    int err;
+
+    file->nruns = 0;
+    file->runs = NULL;
+
+    for (count = 0; cluster != 0 && !fat_is_eoc(fat, cluster); count++) {
+        if (cluster < 2 || cluster >= fat->clusters + 2 || count >= fat->clusters)
+            goto invalid;
+
+        if (run && run->pos + run->len == fat->data_start +
+                ((uint64_t)(cluster - 2) << fat->cluster_shift)) {
+            run->len += cluster_size;
+        } else {
+            if (file->nruns == alloc) {
+                struct fat_run *runs;
+
+                alloc = alloc ? alloc * 2 : 8;
+                runs = realloc(file->runs, alloc * sizeof(*runs));
+                if (!runs) {
+                    err = ERR_NO_MEMORY;
+                    goto err;
+                }
+                file->runs = runs;
+            }
+
+            run = &file->runs[file->nruns++];
+            run->off = total;
+            run->len = cluster_size;
+            run->pos = fat->data_start + ((uint64_t)(cluster - 2) << fat->cluster_shift);
+        }
+
+        total += cluster_size;
+        if (max && total >= max)
+            break;
+
+        err = fat_next_cluster(fat, cluster, &next);
+        if (err < 0)
+            goto err;
+        cluster = next;
+    }
+
+    if (max && total < max)
+        goto invalid;
+
+    LTRACEF("%u clusters in %u runs\n", count, file->nruns);
+    return 0;
+
+invalid:
+    dprintf(INFO, "fat: invalid cluster chain\n");
+    err = ERR_NOT_VALID;
+err:
+    free(file->runs);
+    file->runs = NULL;
+    file->nruns = 0;
+    return err;
+}
+
+static int fat_open_node(fat_t *fat, const struct fat_dirent *ent, fat_file_t *file)
+{
+    uint32_t max = 0;
+    int err;
+
+    memset(file, 0, sizeof(*file));
+    file->fat = fat;
+    file->is_dir = ent->attr & FAT_ATTR_DIRECTORY;
+    file->mtime = ent->mtime;
+
+    /* ".." in a subdirectory of the root points to cluster 0 */
+    if (file->is_dir && ent->cluster == 0 && fat->type != 32) {
+        file->size = fat->root_size;
+        if (!file->size)
+            return 0;
+
+        file->runs = malloc(sizeof(*file->runs));
+        if (!file->runs)
+            return ERR_NO_MEMORY;
+
+        file->nruns = 1;
+        file->runs[0].off = 0;
+        file->runs[0].len = fat->root_size;
+        file->runs[0].pos = fat->root_start;
+        return 0;
+    }
+
+    if (!file->is_dir) {
+        if (!ent->size)
+            return 0;
+        if (!ent->cluster)
+            return ERR_NOT_VALID;
+        max = ent->size;
+    }
+
+    err = fat_map_chain(fat, file, ent->cluster ? ent->cluster : fat->root_cluster, max);
+    if (err < 0)
+        return err;
+
+    if (file->is_dir) {
+        file->size = file->nruns ? file->runs[file->nruns - 1].off + file->runs[file->nruns - 1].len : 0;
+        file->size = MIN(file->size, FAT_DIR_MAX_SIZE);
+    } else {
+        file->size = ent->size;
+    }
+
+    return 0;
+}
+
+static void fat_close_node(fat_file_t *file)
+{
+    free(file->runs);
+    file->runs = NULL;
+    file->nruns = 0;
+}
+
+static const struct fat_run *fat_find_run(const fat_file_t *file, uint32_t off)
+{
+    uint lo = 0, hi = file->nruns, mid;
+
+    while (lo < hi) {
+        mid = (lo + hi) / 2;
+        if (off < file->runs[mid].off)
+            hi = mid;
+        else if (off - file->runs[mid].off >= file->runs[mid].len)
+            lo = mid + 1;
+        else
+            return &file->runs[mid];
+    }
+
+    return NULL;
+}
+
+static ssize_t fat_read_node(const fat_file_t *file, void *_buf, uint32_t off, size_t len)
+{
+    const struct fat_run *run;
+    uint8_t *buf = _buf;
+    size_t total = 0, n;
+    ssize_t ret;
+
+    if (off >= file->size)
+        return 0;
+    if (len > file->size - off)
+        len = file->size - off;
+
+    while (len) {
+        run = fat_find_run(file, off);
+        if (!run)
+            return ERR_NOT_VALID;
+
+        n = MIN(len, run->off + run->len - off);
+
+        LTRACEF("offset %u: %zu bytes at %llu\n", off, n, run->pos + (off - run->off));
+
+        ret = bio_read(file->fat->dev, buf, run->pos + (off - run->off), n);
+        if (ret < (ssize_t)n)
+            return ERR_IO;
+
+        buf += n;
+        off += n;
+        total += n;
+        len -= n;
+    }
+
+    return total;
+}
+
+static uint8_t fat_checksum(const uint8_t *name)
+{
+    uint8_t sum = 0;
+    int i;
+
+    for (i = 0; i < 11; i++)
+        sum = ((sum & 1) << 7) + (sum >> 1) + name[i];
+
+    return sum;
+}
+
+/* also handles "." and ".." */
+static void fat_short_name(const struct fat_dir_entry *de, char *name)
+{
+    int i, len;
+
+    for (len = 8; len > 0 && de->name[len - 1] == ' '; len--)
+        ;
+    for (i = 0; i < len; i++) {
+        *name = de->name[i];
+        if (de->ntres & FAT_NTRES_LOWER_BASE)
+            *name = tolower(*name);
+        name++;
+    }
+
+    for (len = 3; len > 0 && de->name[8 + len - 1] == ' '; len--)
+        ;
+    if (len)
+        *name++ = '.';
+    for (i = 0; i < len; i++) {
+        *name = de->name[8 + i];
+        if (de->ntres & FAT_NTRES_LOWER_EXT)
+            *name = tolower(*name);
+        name++;
+    }
+
+    *name = '\0';
+}
+
+static void fat_lfn_to_utf8(const uint16_t *lfn, uint len, char *name)
+{
+    uint i;
+
+    for (i = 0; i < len && lfn[i]; i++) {
+        uint16_t c = lfn[i];
+
+        if (c < 0x80) {
+            *name++ = c;
+        } else if (c < 0x800) {
+            *name++ = 0xc0 | c >> 6;
+            *name++ = 0x80 | (c & 0x3f);
+        } else {
+            *name++ = 0xe0 | c >> 12;
+            *name++ = 0x80 | ((c >> 6) & 0x3f);
+            *name++ = 0x80 | (c & 0x3f);
+        }
+    }
+
+    *name = '\0';
+}
+
+/* seconds since the epoch, the time zone of FAT time stamps is unknown */
+static uint32_t fat_time(uint16_t date, uint16_t time)
+{
+    uint year = 1980 + (date >> 9), month = (date >> 5) & 0xf, day = date & 0x1f;
+    uint32_t days;
+
+    if (!date || month < 1 || month > 12 || day < 1)
+        return 0;
+
+    /* days since 1970-01-01, counting the year from March */
+    if (month <= 2) {
+        year--;
+        month += 12;
+    }
+    days = 365 * year + year / 4 - year / 100 + year / 400 +
+           (153 * (month - 3) + 2) / 5 + day - 1 - 719468;
+
+    return days * 86400 + (time >> 11) * 3600 + ((time >> 5) & 0x3f) * 60 + (time & 0x1f) * 2;
+}
+
+static const struct fat_dir_entry *fat_dir_entry(fat_dir_t *dir, int *err)
+{
+    const fat_file_t *file = &dir->file;
+    ssize_t ret;
+
+    if (dir->pos + sizeof(struct fat_dir_entry) > file->size) {
+        *err = ERR_NOT_FOUND;
+        return NULL;
+    }
+
+    if (dir->pos < dir->buf_pos || dir->pos + sizeof(struct fat_dir_entry) > dir->buf_pos + dir->buf_len) {
+        dir->buf_pos = ROUNDDOWN(dir->pos, sizeof(dir->buf));
+        ret = fat_read_node(file, dir->buf, dir->buf_pos, sizeof(dir->buf));
+        if (ret < 0) {
+            dir->buf_len = 0;
+            *err = ret;
+            return NULL;
+        }
+        dir->buf_len = ret;
+    }
+
+    return (const struct fat_dir_entry *)(dir->buf + dir->pos - dir->buf_pos);
+}
+
+/* return the next entry of the directory, skipping "." and ".." */
+static int fat_dir_next(fat_dir_t *dir, struct fat_dirent *ent)
+{
+    const struct fat_dir_entry *de;
+    const struct fat_lfn_entry *le;
+    uint16_t lfn[FAT_LFN_MAX + FAT_LFN_CHARS];
+    uint seq = 0, lfn_len = 0;
+    uint8_t checksum = 0;
+    int err;
+
+    while ((de = fat_dir_entry(dir, &err))) {
+        dir->pos += sizeof(*de);
+
+        if (de->name[0] == FAT_ENTRY_END) {
+            /* the rest of the directory is unused */
+            dir->pos = dir->file.size;
+            return ERR_NOT_FOUND;
+        }
+        if (de->name[0] == FAT_ENTRY_DELETED) {
+            seq = 0;
+            continue;
+        }
+
+        if ((de->attr & FAT_ATTR_LFN_MASK) == FAT_ATTR_LFN) {
+            uint n;
+
+            le = (const struct fat_lfn_entry *)de;
+            n = le->seq & FAT_LFN_SEQ_MASK;
+            if (le->seq & FAT_LFN_LAST) {
+                if (n == 0 || n * FAT_LFN_CHARS > FAT_LFN_MAX + FAT_LFN_CHARS) {
+                    seq = 0;
+                    continue;
+                }
+                lfn_len = n * FAT_LFN_CHARS;
+                checksum = le->checksum;
+            } else if (n == 0 || n != seq - 1 || le->checksum != checksum) {
+                seq = 0;
+                continue;
+            }
+            seq = n;
+
+            /* the entries are unaligned, don't access the names directly */
+            memcpy(&lfn[(n - 1) * FAT_LFN_CHARS], le->name1, sizeof(le->name1));
+            memcpy(&lfn[(n - 1) * FAT_LFN_CHARS + 5], le->name2, sizeof(le->name2));
+            memcpy(&lfn[(n - 1) * FAT_LFN_CHARS + 11], le->name3, sizeof(le->name3));
+            continue;
+        }
+
+        if (de->attr & FAT_ATTR_VOLUME_ID) {
+            seq = 0;
+            continue;
+        }
+
+        if (de->name[0] == '.' && (de->name[1] == ' ' || (de->name[1] == '.' && de->name[2] == ' '))) {
+            seq = 0;
+            continue;
+        }
+
+        if (seq == 1 && checksum == fat_checksum(de->name)) {
+            uint i;
+
+            for (i = 0; i < lfn_len; i++)
+                lfn[i] = LE16(lfn[i]);
+            fat_lfn_to_utf8(lfn, MIN(lfn_len, FAT_LFN_MAX), ent->name);
+        } else {
+            fat_short_name(de, ent->name);
+            if ((uint8_t)ent->name[0] == FAT_ENTRY_KANJI_E5)
+                ent->name[0] = (char)FAT_ENTRY_DELETED;
+        }
+        seq = 0;
+
+        ent->attr = de->attr;
+        ent->cluster = LE16(de->cluster_lo);
+        if (dir->file.fat->type == 32)
+            ent->cluster |= (uint32_t)LE16(de->cluster_hi) << 16;
+        ent->size = LE32(de->size);
+        ent->mtime = fat_time(LE16(de->mdate), LE16(de->mtime));
+
+        return 0;
+    }
+
+    return err;
+}
+
+static void fat_dir_rewind(fat_dir_t *dir)
+{
+    dir->pos = 0;
+    dir->buf_pos = 0;
+    dir->buf_len = 0;
+}
+
+/* FAT names are case insensitive */
+static bool fat_name_eq(const char *a, const char *b)
+{
+    while (*a && tolower((unsigned char)*a) == tolower((unsigned char)*b)) {
+        a++;
+        b++;
+    }
+    return *a == *b;
+}
+
+static int fat_lookup(fat_t *fat, const char *_path, fat_file_t *file)
+{
+    char path[FS_MAX_PATH_LEN];
+    char *ptr = path, *next_sep;
+    struct fat_dirent *ent;
+    fat_dir_t *dir;
+    int err = 0;
+
+    LTRACEF("path '%s'\n", _path);
+
+    strlcpy(path, _path, sizeof(path));
+
+    dir = malloc(sizeof(*dir));
+    ent = malloc(sizeof(*ent));
+    if (!dir || !ent) {
+        err = ERR_NO_MEMORY;
+        goto out;
+    }
+
+    /* start at the root directory */
+    memset(ent, 0, sizeof(*ent));
+    ent->attr = FAT_ATTR_DIRECTORY;
+    err = fat_open_node(fat, ent, file);
+    if (err < 0)
+        goto out;
+
+    for (;;) {
+        /* consume separators */
+        while (*ptr == '/')
+            ptr++;
+        if (*ptr == '\0')
+            break;
+
+        next_sep = strchr(ptr, '/');
+        if (next_sep)
+            *next_sep++ = '\0';
+        else
+            next_sep = ptr + strlen(ptr);
+
+        if (!file->is_dir) {
+            LTRACEF("not finished and component is nondir\n");
+            err = ERR_NOT_FOUND;
+            break;
+        }
+
+        if (strcmp(ptr, ".")) {
+            dir->file = *file;
+            fat_dir_rewind(dir);
+
+            while ((err = fat_dir_next(dir, ent)) == 0) {
+                if (fat_name_eq(ent->name, ptr))
+                    break;
+            }
+            fat_close_node(file);
+            if (err < 0)
+                break;
+
+            err = fat_open_node(fat, ent, file);
+            if (err < 0)
+                break;
+        }
+
+        ptr = next_sep;
+    }
+
+    if (err < 0)
+        fat_close_node(file);
+out:
+    free(ent);
+    free(dir);
+    return err;
+}
+
+static int fat_read_boot(bdev_t *dev, struct fat_boot_sector *bs)
+{
+    ssize_t err;
+
+    err = bio_read(dev, bs, 0, sizeof(*bs));
+    if (err < 0)
+        return err;
+    if (err < (ssize_t)sizeof(*bs))
+        return ERR_IO;
+
+    if (LE16(bs->signature) != FAT_SIGNATURE || (bs->jump[0] != 0xeb && bs->jump[0] != 0xe9))
+        return ERR_NOT_VALID;
+
+    if (LE16(bs->bytes_per_sector) < 512 || LE16(bs->bytes_per_sector) > 4096 ||
+        !ispow2(LE16(bs->bytes_per_sector)) ||
+        bs->sectors_per_cluster == 0 || !ispow2(bs->sectors_per_cluster) ||
+        LE16(bs->reserved_sectors) == 0 || bs->fats == 0)
+        return ERR_NOT_VALID;
+
+    if (LE16(bs->fat_size16) == 0 && LE32(bs->fat_size32) == 0)
+        return ERR_NOT_VALID;
+    if (LE16(bs->sectors16) == 0 && LE32(bs->sectors32) == 0)
+        return ERR_NOT_VALID;
+
+    return NO_ERROR;
+}
+
+static status_t fat_probe(bdev_t *dev)
+{
+    struct fat_boot_sector bs;
+
+    return fat_read_boot(dev, &bs);
+}
+
+static status_t fat_mount(bdev_t *dev, fscookie **cookie)
+{
+    struct fat_boot_sector bs;
+    uint32_t sectors, fat_sectors, root_sectors, meta_sectors;
+    uint sector_shift, active = 0;
+    fat_t *fat;
+    int err;
+
+    err = fat_read_boot(dev, &bs);
+    if (err < 0)
+        return err;
+
+    fat = calloc(1, sizeof(*fat));
+    if (!fat)
+        return ERR_NO_MEMORY;
+
+    fat->dev = dev;
+    sector_shift = log2_uint(LE16(bs.bytes_per_sector));
+    fat->cluster_shift = sector_shift + log2_uint(bs.sectors_per_cluster);
+
+    sectors = LE16(bs.sectors16) ? LE16(bs.sectors16) : LE32(bs.sectors32);
+    fat_sectors = LE16(bs.fat_size16) ? LE16(bs.fat_size16) : LE32(bs.fat_size32);
+    root_sectors = ROUNDUP(LE16(bs.root_entries) * sizeof(struct fat_dir_entry),
+                           LE16(bs.bytes_per_sector)) >> sector_shift;
+    meta_sectors = LE16(bs.reserved_sectors) + bs.fats * fat_sectors + root_sectors;
+    if (meta_sectors >= sectors || fat->cluster_shift > 17) {
+        err = ERR_NOT_VALID;
+        goto err;
+    }
+
+    /* the type only depends on the number of clusters */
+    fat->clusters = (sectors - meta_sectors) >> (fat->cluster_shift - sector_shift);
+    if (fat->clusters < 4085) {
+        fat->type = 12;
+        fat->eoc = 0xff8;
+    } else if (fat->clusters < 65525) {
+        fat->type = 16;
+        fat->eoc = 0xfff8;
+    } else {
+        fat->type = 32;
+        fat->eoc = 0x0ffffff8;
+    }
+
+    if ((fat->type == 32) != (LE16(bs.root_entries) == 0)) {
+        err = ERR_NOT_VALID;
+        goto err;
+    }
+
+    /* FAT32 can disable mirroring and use only one of the FATs */
+    if (fat->type == 32 && (LE16(bs.ext_flags) & 0x80))
+        active = LE16(bs.ext_flags) & 0xf;
+    if (active >= bs.fats) {
+        err = ERR_NOT_VALID;
+        goto err;
+    }
+
+    fat->fat_size = MIN((uint64_t)fat_sectors << sector_shift,
+                        (uint64_t)(fat->clusters + 2) * fat->type / 8 + 1);
+    fat->fat_start = (uint64_t)(LE16(bs.reserved_sectors) + active * fat_sectors) << sector_shift;
+    fat->root_start = (uint64_t)(LE16(bs.reserved_sectors) + bs.fats * fat_sectors) << sector_shift;
+    fat->root_size = root_sectors << sector_shift;
+    fat->root_cluster = fat->type == 32 ? LE32(bs.root_cluster) : 0;
+    fat->data_start = (uint64_t)meta_sectors << sector_shift;
+
+    LTRACEF("FAT%u, %u clusters of %u bytes, FAT at %llu, data at %llu\n",
+            fat->type, fat->clusters, 1U << fat->cluster_shift, fat->fat_start, fat->data_start);
+
+    if (fat->data_start + ((uint64_t)fat->clusters << fat->cluster_shift) > (uint64_t)dev->size) {
+        dprintf(INFO, "fat: file system larger than the device\n");
+        err = ERR_NOT_VALID;
+        goto err;
+    }
+
+    fat->table_buf = malloc(FAT_TABLE_BUF);
+    if (!fat->table_buf) {
+        err = ERR_NO_MEMORY;
+        goto err;
+    }
+
+    *cookie = (fscookie *)fat;
+    return 0;
+
+err:
+    LTRACEF("exiting with err code %d\n", err);
+    free(fat);
+    return err;
+}
+
+static status_t fat_unmount(fscookie *cookie)
+{
+    fat_t *fat = (fat_t *)cookie;
+
+    free(fat->table_buf);
+    free(fat);
+    return 0;
+}
+
+static status_t fat_open_file(fscookie *cookie, const char *path, filecookie **fcookie)
+{
+    fat_t *fat = (fat_t *)cookie;
+    fat_file_t *file;
+    int err;
+
+    file = malloc(sizeof(*file));
+    if (!file)
+        return ERR_NO_MEMORY;
+
+    err = fat_lookup(fat, path, file);
+    if (err < 0) {
+        free(file);
+        return err;
+    }
+
+    *fcookie = (filecookie *)file;
+    return 0;
+}
+
+static ssize_t fat_read_file(filecookie *fcookie, void *buf, off_t offset, size_t len)
+{
+    fat_file_t *file = (fat_file_t *)fcookie;
+
+    if (file->is_dir)
+        return ERR_NOT_FILE;
+
+    if (offset < 0 || offset >= file->size)
+        return 0;
+
+    return fat_read_node(file, buf, offset, len);
+}
+
+static status_t fat_stat_file(filecookie *fcookie, struct file_stat *stat)
+{
+    fat_file_t *file = (fat_file_t *)fcookie;
+
+    stat->is_dir = file->is_dir;
+    stat->size = file->is_dir ? 0 : file->size;
+    stat->mtime = file->mtime;
+
+    return 0;
+}
+
+static status_t fat_close_file(filecookie *fcookie)
+{
+    fat_file_t *file = (fat_file_t *)fcookie;
+
+    fat_close_node(file);
+    free(file);
+
+    return 0;
+}
+
+static status_t fat_open_directory(fscookie *cookie, const char *path, dircookie **dcookie)
+{
+    fat_t *fat = (fat_t *)cookie;
+    fat_dir_t *dir;
+    int err;
+
+    dir = malloc(sizeof(*dir));
+    if (!dir)
+        return ERR_NO_MEMORY;
+
+    err = fat_lookup(fat, path, &dir->file);
+    if (err < 0) {
+        free(dir);
+        return err;
+    }
+
+    if (!dir->file.is_dir) {
+        fat_close_node(&dir->file);
+        free(dir);
+        return ERR_NOT_DIR;
+    }
+
+    fat_dir_rewind(dir);
+    *dcookie = (dircookie *)dir;
+    return 0;
+}
+
+static status_t fat_read_directory(dircookie *dcookie, struct dirent *ent)
+{
+    fat_dir_t *dir = (fat_dir_t *)dcookie;
+    struct fat_dirent *fent;
+    int err;
+
+    fent = malloc(sizeof(*fent));
+    if (!fent)
+        return ERR_NO_MEMORY;
+
+    err = fat_dir_next(dir, fent);
+    if (err == 0)
+        strlcpy(ent->name, fent->name, sizeof(ent->name));
+
+    free(fent);
+    return err;
+}
+
+static status_t fat_close_directory(dircookie *dcookie)
+{
+    fat_dir_t *dir = (fat_dir_t *)dcookie;
+
+    fat_close_node(&dir->file);
+    free(dir);
+    return 0;
+}
+
+static const struct fs_api fat_api = {
+    .probe = fat_probe,
+    .mount = fat_mount,
+    .unmount = fat_unmount,
+    .open = fat_open_file,
+    .stat = fat_stat_file,
+    .read = fat_read_file,
+    .close = fat_close_file,
+    .opendir = fat_open_directory,
+    .readdir = fat_read_directory,
+    .closedir = fat_close_directory
+};
+
+void fat_init(void)
+{
+    fs_register_type("fat", &fat_api);
+}
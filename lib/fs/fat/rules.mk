@@ -0,0 +1,8 @@
+LOCAL_DIR := $(GET_LOCAL_DIR)
+
+MODULES += \
+	lib/fs \
+	lib/bio
+
+OBJS += \
+	$(LOCAL_DIR)/fat.o
@@ -25,6 +25,7 @@
 #include <err.h>
 #include <string.h>
 #include <stdlib.h>
+#include <kernel/ktrace.h>
 #include <lib/fs.h>
 #include <lib/bio.h>
 
@@ -61,9 +62,13 @@ static struct list_node fses = LIST_INITIAL_VALUE(fses);
 
 /* qualcomm runs fs_init() manually, so we use it to init filesystem submodules */
 void ext2_init(void);
+void squashfs_init(void);
+void fat_init(void);
 
 void fs_init(void) {
 	ext2_init();
+	squashfs_init();
+	fat_init();
 }
 
 static struct fs *find_fs(const char *name)
@@ -152,6 +157,26 @@ static status_t mount(const char *path, const char *device, const struct fs_api
     return 0;
 }
 
+status_t fs_probe(const char *fsname, const char *device)
+{
+    struct fs *fs = find_fs(fsname);
+    if (!fs)
+        return ERR_NOT_FOUND;
+
+    /* no way to tell without mounting */
+    if (!fs->api->probe)
+        return NO_ERROR;
+
+    bdev_t *dev = bio_open(device);
+    if (!dev)
+        return ERR_NOT_FOUND;
+
+    status_t err = fs->api->probe(dev);
+    bio_close(dev);
+
+    return err;
+}
+
 status_t fs_mount(const char *path, const char *fsname, const char *device)
 {
     struct fs *fs = find_fs(fsname);
@@ -250,7 +275,13 @@ status_t fs_create_file(const char *path, filehandle **handle, uint64_t len)
 
 ssize_t fs_read_file(filehandle *handle, void *buf, off_t offset, size_t len)
 {
-    return handle->mount->api->read(handle->cookie, buf, offset, len);
+    ssize_t ret;
+
+    ktrace(KTRACE_FS_READ_START, offset, len, 0);
+    ret = handle->mount->api->read(handle->cookie, buf, offset, len);
+    ktrace(KTRACE_FS_READ_END, ret, 0, 0);
+
+    return ret;
 }
 
 ssize_t fs_write_file(filehandle *handle, const void *buf, off_t offset, size_t len)
@@ -261,15 +292,22 @@ ssize_t fs_write_file(filehandle *handle, const void *buf, off_t offset, size_t
     return handle->mount->api->write(handle->cookie, buf, offset, len);
 }
 
+status_t fs_truncate_file(filehandle *handle, uint64_t len)
+{
+    if (!handle->mount->api->truncate)
+        return ERR_NOT_SUPPORTED;
+
+    return handle->mount->api->truncate(handle->cookie, len);
+}
+
 status_t fs_close_file(filehandle *handle)
 {
+    /* the cookie is gone also if storing the changes failed */
     status_t err = handle->mount->api->close(handle->cookie);
-    if (err < 0)
-        return err;
 
     put_mount(handle->mount);
     free(handle);
-    return 0;
+    return err;
 }
 
 status_t fs_stat_file(filehandle *handle, struct file_stat *stat)
@@ -277,6 +315,52 @@ status_t fs_stat_file(filehandle *handle, struct file_stat *stat)
     return handle->mount->api->stat(handle->cookie, stat);
 }
 
+/* find the extent of the file that contains the offset */
+status_t fs_map_file(filehandle *handle, off_t offset, struct file_extent *ext)
+{
+    if (!handle->mount->api->map)
+        return ERR_NOT_SUPPORTED;
+
+    return handle->mount->api->map(handle->cookie, offset, ext);
+}
+
+status_t fs_file_key(filehandle *handle, struct file_key *key)
+{
+    struct fs *fs;
+
+    if (!handle->mount->api->get_key)
+        return ERR_NOT_SUPPORTED;
+
+    memset(key, 0, sizeof(*key));
+    list_for_every_entry(&fses, fs, struct fs, node) {
+        if (fs->api == handle->mount->api) {
+            strlcpy(key->fs, fs->name, sizeof(key->fs));
+            break;
+        }
+    }
+
+    return handle->mount->api->get_key(handle->cookie, key->data);
+}
+
+status_t fs_check_key(const char *device, const struct file_key *key)
+{
+    char name[sizeof(key->fs) + 1];
+
+    strlcpy(name, key->fs, sizeof(name));
+    struct fs *fs = find_fs(name);
+    if (!fs || !fs->api->check_key)
+        return ERR_NOT_FOUND;
+
+    bdev_t *dev = bio_open(device);
+    if (!dev)
+        return ERR_NOT_FOUND;
+
+    status_t err = fs->api->check_key(dev, key->data);
+    bio_close(dev);
+
+    return err;
+}
+
 status_t fs_make_dir(const char *path)
 {
     char temppath[512];
@@ -1,7 +1,9 @@
 LOCAL_DIR := $(GET_LOCAL_DIR)
 
 MODULES += \
-	lib/fs/ext2
+	lib/fs/ext2 \
+	lib/fs/squashfs \
+	lib/fs/fat
 
 OBJS += \
 	$(LOCAL_DIR)/fs.o \
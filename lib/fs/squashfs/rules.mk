@@ -0,0 +1,12 @@
+LOCAL_DIR := $(GET_LOCAL_DIR)
+
+MODULES += \
+	lib/fs \
+	lib/bio \
+	lib/lz4 \
+	lib/zlib_inflate
+
+INCLUDES += -I$(LK_TOP_DIR)/lib/zlib_inflate
+
+OBJS += \
+	$(LOCAL_DIR)/squashfs.o
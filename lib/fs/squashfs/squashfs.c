@@ -0,0 +1,1142 @@
+// SPDX-License-Identifier: BSD-3-Clause
+/*
+ * Read-only support for squashfs 4.0 with zlib or lz4 compression, e.g. for
+ * a root file system in a UBI volume on NAND (see lk2nd/hw/bdev/ubi.c).
+ * Extended attributes, the export table and the directory index are ignored.
+ *
+ * See https://dr-emann.github.io/squashfs/
+ */
+
+#include <debug.h>
+#include <endian.h>
+#include <err.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <lib/bio.h>
+#include <lib/fs.h>
+#include <lib/lz4.h>
+#include <zlib.h>
+
+#define LOCAL_TRACE 0
+
+#define SQUASHFS_MAGIC          0x73717368
+#define SQUASHFS_MAJOR          4
+#define SQUASHFS_MINOR          0
+
+#define SQUASHFS_COMP_ZLIB      1
+#define SQUASHFS_COMP_LZ4       5
+
+#define SQUASHFS_METADATA_SIZE  8192
+#define SQUASHFS_META_UNCOMPRESSED  (1 << 15)
+#define SQUASHFS_DATA_UNCOMPRESSED  (1 << 24)
+#define SQUASHFS_INVALID_FRAG   0xffffffff
+#define SQUASHFS_FRAGS_PER_META (SQUASHFS_METADATA_SIZE / sizeof(struct squashfs_fragment_entry))
+
+#define SQUASHFS_DIR_TYPE       1
+#define SQUASHFS_REG_TYPE       2
+#define SQUASHFS_SYMLINK_TYPE   3
+#define SQUASHFS_LDIR_TYPE      8
+#define SQUASHFS_LREG_TYPE      9
+#define SQUASHFS_LSYMLINK_TYPE  10
+
+/* decompressed metadata blocks kept in memory for each mounted file system */
+#ifndef SQUASHFS_META_CACHE
+#define SQUASHFS_META_CACHE     8
+#endif
+
+/* consecutive data blocks of a file are read from the device at once */
+#define SQUASHFS_READ_BATCH     (256 * 1024)
+
+struct squashfs_super_block {
+    uint32_t s_magic;
+    uint32_t inodes;
+    uint32_t mkfs_time;
+    uint32_t block_size;
+    uint32_t fragments;
+    uint16_t compression;
+    uint16_t block_log;
+    uint16_t flags;
+    uint16_t no_ids;
+    uint16_t s_major;
+    uint16_t s_minor;
+    uint64_t root_inode;
+    uint64_t bytes_used;
+    uint64_t id_table_start;
+    uint64_t xattr_id_table_start;
+    uint64_t inode_table_start;
+    uint64_t directory_table_start;
+    uint64_t fragment_table_start;
+    uint64_t lookup_table_start;
+} __PACKED;
+
+struct squashfs_base_inode {
+    uint16_t inode_type;
+    uint16_t mode;
+    uint16_t uid;
+    uint16_t guid;
+    uint32_t mtime;
+    uint32_t inode_number;
+} __PACKED;
+
+struct squashfs_dir_inode {
+    struct squashfs_base_inode base;
+    uint32_t start_block;
+    uint32_t nlink;
+    uint16_t file_size;
+    uint16_t offset;
+    uint32_t parent_inode;
+} __PACKED;
+
+struct squashfs_ldir_inode {
+    struct squashfs_base_inode base;
+    uint32_t nlink;
+    uint32_t file_size;
+    uint32_t start_block;
+    uint32_t parent_inode;
+    uint16_t i_count;
+    uint16_t offset;
+    uint32_t xattr;
+} __PACKED;
+
+struct squashfs_reg_inode {
+    struct squashfs_base_inode base;
+    uint32_t start_block;
+    uint32_t fragment;
+    uint32_t offset;
+    uint32_t file_size;
+} __PACKED;
+
+struct squashfs_lreg_inode {
+    struct squashfs_base_inode base;
+    uint64_t start_block;
+    uint64_t file_size;
+    uint64_t sparse;
+    uint32_t nlink;
+    uint32_t fragment;
+    uint32_t offset;
+    uint32_t xattr;
+} __PACKED;
+
+struct squashfs_symlink_inode {
+    struct squashfs_base_inode base;
+    uint32_t nlink;
+    uint32_t symlink_size;
+} __PACKED;
+
+struct squashfs_dir_header {
+    uint32_t count;
+    uint32_t start_block;
+    uint32_t inode_number;
+} __PACKED;
+
+struct squashfs_dir_entry {
+    uint16_t offset;
+    int16_t inode_number;
+    uint16_t type;
+    uint16_t size;
+} __PACKED;
+
+struct squashfs_fragment_entry {
+    uint64_t start_block;
+    uint32_t size;
+    uint32_t unused;
+} __PACKED;
+
+/* position in the metadata: start of the compressed block and offset in it */
+struct squashfs_meta_pos {
+    uint64_t block;
+    uint offset;
+};
+
+struct squashfs_meta_block {
+    uint64_t pos;       /* 0 if unused, the super block is never metadata */
+    uint64_t next;
+    uint len;
+    uint lru;
+    uint8_t data[SQUASHFS_METADATA_SIZE];
+};
+
+struct squashfs_inode {
+    uint type;
+    uint32_t mtime;
+    uint64_t size;
+    uint64_t start_block;
+    uint32_t fragment;
+    uint32_t frag_offset;
+    uint dir_offset;
+    /* the block list of files, the target of symlinks */
+    struct squashfs_meta_pos data;
+};
+
+typedef struct {
+    bdev_t *dev;
+    struct squashfs_super_block sb;
+    struct squashfs_inode root;
+
+    z_stream zstream;
+
+    struct squashfs_meta_block meta[SQUASHFS_META_CACHE];
+    uint meta_lru;
+    uint8_t *meta_buf;  /* a single compressed metadata block */
+
+    uint64_t *frag_index;
+
+    /* a single decompressed data or fragment block */
+    uint8_t *block_buf;
+    uint64_t block_pos;
+    uint block_len;
+
+    uint8_t *read_buf;  /* compressed data blocks */
+    size_t read_len;
+} squashfs_t;
+
+typedef struct {
+    squashfs_t *sqfs;
+    struct squashfs_inode inode;
+    uint nblocks;
+    uint32_t *sizes;    /* on disk size of each data block */
+    uint64_t *pos;      /* and its position */
+} squashfs_file_t;
+
+typedef struct {
+    squashfs_t *sqfs;
+    struct squashfs_meta_pos pos;
+    uint64_t remaining;
+    uint count;         /* entries left with the current header */
+    struct squashfs_dir_header hdr;
+} squashfs_dir_t;
+
+static void *squashfs_zalloc(voidpf opaque, uInt items, uInt size)
+{
+    return malloc(items * size);
+}
+
+static void squashfs_zfree(voidpf opaque, voidpf addr)
+{
+    free(addr);
+}
+
+/* decompress a block, returns the decompressed length */
+static ssize_t squashfs_decompress(squashfs_t *sqfs, const void *in, size_t in_len,
+                                   void *out, size_t out_len)
+{
+    size_t used;
+    int ret;
+
+    if (sqfs->sb.compression == SQUASHFS_COMP_LZ4) {
+        ret = lz4_decompress_block(in, in_len, out, out_len, &used);
+        if (ret < 0)
+            return ret;
+        return used;
+    }
+
+    z_stream *strm = &sqfs->zstream;
+    if (inflateReset(strm) != Z_OK)
+        return ERR_NOT_VALID;
+
+    strm->next_in = (Bytef *)in;
+    strm->avail_in = in_len;
+    strm->next_out = out;
+    strm->avail_out = out_len;
+
+    ret = inflate(strm, Z_FINISH);
+    if (ret != Z_STREAM_END) {
+        LTRACEF("inflate failed: %d\n", ret);
+        return ERR_NOT_VALID;
+    }
+
+    return out_len - strm->avail_out;
+}
+
+/* get a decompressed metadata block from the cache */
+static struct squashfs_meta_block *squashfs_get_meta(squashfs_t *sqfs, uint64_t pos)
+{
+    struct squashfs_meta_block *meta = &sqfs->meta[0];
+    uint16_t hdr;
+    ssize_t ret;
+    uint len;
+    int i;
+
+    if (pos < sizeof(sqfs->sb) || pos + sizeof(hdr) > sqfs->sb.bytes_used)
+        return NULL;
+
+    for (i = 0; i < SQUASHFS_META_CACHE; i++) {
+        if (sqfs->meta[i].pos == pos) {
+            meta = &sqfs->meta[i];
+            goto done;
+        }
+        if (sqfs->meta[i].lru < meta->lru)
+            meta = &sqfs->meta[i];
+    }
+
+    /* replace the least recently used block */
+    meta->pos = 0;
+
+    ret = bio_read(sqfs->dev, &hdr, pos, sizeof(hdr));
+    if (ret < (ssize_t)sizeof(hdr))
+        return NULL;
+
+    hdr = LE16(hdr);
+    len = hdr & ~SQUASHFS_META_UNCOMPRESSED;
+    if (len == 0 || len > SQUASHFS_METADATA_SIZE || pos + sizeof(hdr) + len > sqfs->sb.bytes_used)
+        return NULL;
+
+    if (hdr & SQUASHFS_META_UNCOMPRESSED) {
+        ret = bio_read(sqfs->dev, meta->data, pos + sizeof(hdr), len);
+        if (ret < (ssize_t)len)
+            return NULL;
+    } else {
+        ret = bio_read(sqfs->dev, sqfs->meta_buf, pos + sizeof(hdr), len);
+        if (ret < (ssize_t)len)
+            return NULL;
+
+        ret = squashfs_decompress(sqfs, sqfs->meta_buf, len, meta->data, sizeof(meta->data));
+        if (ret <= 0)
+            return NULL;
+    }
+
+    LTRACEF("metadata block at %llu: %u -> %zd bytes\n", pos, len, ret);
+
+    meta->pos = pos;
+    meta->next = pos + sizeof(hdr) + len;
+    meta->len = ret;
+
+done:
+    meta->lru = ++sqfs->meta_lru;
+    return meta;
+}
+
+/* read from the metadata, possibly across blocks, and advance the position */
+static int squashfs_read_meta(squashfs_t *sqfs, struct squashfs_meta_pos *pos, void *buf, size_t len)
+{
+    struct squashfs_meta_block *meta;
+    size_t n;
+
+    while (len) {
+        meta = squashfs_get_meta(sqfs, pos->block);
+        if (!meta || pos->offset > meta->len)
+            return ERR_IO;
+
+        if (pos->offset == meta->len) {
+            pos->block = meta->next;
+            pos->offset = 0;
+            continue;
+        }
+
+        n = MIN(len, meta->len - pos->offset);
+        if (buf) {
+            memcpy(buf, meta->data + pos->offset, n);
+            buf = (uint8_t *)buf + n;
+        }
+        pos->offset += n;
+        len -= n;
+    }
+
+    return 0;
+}
+
+static int squashfs_load_inode(squashfs_t *sqfs, uint64_t ref, struct squashfs_inode *inode)
+{
+    struct squashfs_meta_pos pos = {
+        .block = sqfs->sb.inode_table_start + (ref >> 16),
+        .offset = ref & 0xffff,
+    };
+    union {
+        struct squashfs_base_inode base;
+        struct squashfs_dir_inode dir;
+        struct squashfs_ldir_inode ldir;
+        struct squashfs_reg_inode reg;
+        struct squashfs_lreg_inode lreg;
+        struct squashfs_symlink_inode symlink;
+    } i;
+    size_t len;
+    int err;
+
+    LTRACEF("inode %llu:%llu\n", ref >> 16, ref & 0xffff);
+
+    err = squashfs_read_meta(sqfs, &pos, &i.base, sizeof(i.base));
+    if (err < 0)
+        return err;
+
+    memset(inode, 0, sizeof(*inode));
+    inode->type = LE16(i.base.inode_type);
+    inode->mtime = LE32(i.base.mtime);
+    inode->fragment = SQUASHFS_INVALID_FRAG;
+
+    switch (inode->type) {
+        case SQUASHFS_DIR_TYPE:
+            len = sizeof(i.dir);
+            break;
+        case SQUASHFS_LDIR_TYPE:
+            len = sizeof(i.ldir);
+            break;
+        case SQUASHFS_REG_TYPE:
+            len = sizeof(i.reg);
+            break;
+        case SQUASHFS_LREG_TYPE:
+            len = sizeof(i.lreg);
+            break;
+        case SQUASHFS_SYMLINK_TYPE:
+        case SQUASHFS_LSYMLINK_TYPE:
+            len = sizeof(i.symlink);
+            break;
+        default:
+            /* devices, fifos and sockets have no content */
+            return 0;
+    }
+
+    err = squashfs_read_meta(sqfs, &pos, &i.base + 1, len - sizeof(i.base));
+    if (err < 0)
+        return err;
+
+    switch (inode->type) {
+        case SQUASHFS_DIR_TYPE:
+            inode->start_block = LE32(i.dir.start_block);
+            inode->dir_offset = LE16(i.dir.offset);
+            inode->size = LE16(i.dir.file_size);
+            break;
+        case SQUASHFS_LDIR_TYPE:
+            inode->start_block = LE32(i.ldir.start_block);
+            inode->dir_offset = LE16(i.ldir.offset);
+            inode->size = LE32(i.ldir.file_size);
+            break;
+        case SQUASHFS_REG_TYPE:
+            inode->start_block = LE32(i.reg.start_block);
+            inode->fragment = LE32(i.reg.fragment);
+            inode->frag_offset = LE32(i.reg.offset);
+            inode->size = LE32(i.reg.file_size);
+            break;
+        case SQUASHFS_LREG_TYPE:
+            inode->start_block = LE64(i.lreg.start_block);
+            inode->fragment = LE32(i.lreg.fragment);
+            inode->frag_offset = LE32(i.lreg.offset);
+            inode->size = LE64(i.lreg.file_size);
+            break;
+        case SQUASHFS_SYMLINK_TYPE:
+        case SQUASHFS_LSYMLINK_TYPE:
+            inode->size = LE32(i.symlink.symlink_size);
+            break;
+    }
+
+    inode->data = pos;
+    return 0;
+}
+
+static bool squashfs_is_dir(const struct squashfs_inode *inode)
+{
+    return inode->type == SQUASHFS_DIR_TYPE || inode->type == SQUASHFS_LDIR_TYPE;
+}
+
+static bool squashfs_is_reg(const struct squashfs_inode *inode)
+{
+    return inode->type == SQUASHFS_REG_TYPE || inode->type == SQUASHFS_LREG_TYPE;
+}
+
+static bool squashfs_is_symlink(const struct squashfs_inode *inode)
+{
+    return inode->type == SQUASHFS_SYMLINK_TYPE || inode->type == SQUASHFS_LSYMLINK_TYPE;
+}
+
+static int squashfs_dir_start(squashfs_t *sqfs, const struct squashfs_inode *inode, squashfs_dir_t *dir)
+{
+    if (!squashfs_is_dir(inode))
+        return ERR_NOT_DIR;
+
+    memset(dir, 0, sizeof(*dir));
+    dir->sqfs = sqfs;
+    dir->pos.block = sqfs->sb.directory_table_start + inode->start_block;
+    dir->pos.offset = inode->dir_offset;
+
+    /* the size includes the implicit "." and ".." entries */
+    dir->remaining = inode->size > 3 ? inode->size - 3 : 0;
+
+    return 0;
+}
+
+/* return the next entry of the directory, name must have room for 257 bytes */
+static int squashfs_dir_next(squashfs_dir_t *dir, char *name, uint64_t *ref)
+{
+    struct squashfs_dir_entry ent;
+    uint len;
+    int err;
+
+    if (dir->count == 0) {
+        if (dir->remaining < sizeof(dir->hdr) + sizeof(ent))
+            return ERR_NOT_FOUND;
+
+        err = squashfs_read_meta(dir->sqfs, &dir->pos, &dir->hdr, sizeof(dir->hdr));
+        if (err < 0)
+            return err;
+
+        dir->remaining -= sizeof(dir->hdr);
+        dir->count = LE32(dir->hdr.count) + 1;
+        if (dir->count > 256)
+            return ERR_NOT_VALID;
+    }
+
+    if (dir->remaining < sizeof(ent))
+        return ERR_NOT_VALID;
+
+    err = squashfs_read_meta(dir->sqfs, &dir->pos, &ent, sizeof(ent));
+    if (err < 0)
+        return err;
+
+    len = LE16(ent.size) + 1;
+    if (len > 256 || dir->remaining < sizeof(ent) + len)
+        return ERR_NOT_VALID;
+
+    err = squashfs_read_meta(dir->sqfs, &dir->pos, name, len);
+    if (err < 0)
+        return err;
+    name[len] = '\0';
+
+    dir->remaining -= sizeof(ent) + len;
+    dir->count--;
+
+    if (ref)
+        *ref = ((uint64_t)LE32(dir->hdr.start_block) << 16) | LE16(ent.offset);
+
+    return 0;
+}
+
+static int squashfs_dir_lookup(squashfs_t *sqfs, const struct squashfs_inode *dir_inode,
+                               const char *name, struct squashfs_inode *inode)
+{
+    squashfs_dir_t dir;
+    char entry[257];
+    uint64_t ref;
+    int err;
+
+    err = squashfs_dir_start(sqfs, dir_inode, &dir);
+    if (err < 0)
+        return err;
+
+    while ((err = squashfs_dir_next(&dir, entry, &ref)) == 0) {
+        if (!strcmp(entry, name))
+            return squashfs_load_inode(sqfs, ref, inode);
+    }
+
+    return err;
+}
+
+static int squashfs_read_link(squashfs_t *sqfs, const struct squashfs_inode *inode, char *buf, size_t len)
+{
+    struct squashfs_meta_pos pos = inode->data;
+    int err;
+
+    if (inode->size >= len)
+        return ERR_TOO_BIG;
+
+    err = squashfs_read_meta(sqfs, &pos, buf, inode->size);
+    if (err < 0)
+        return err;
+
+    buf[inode->size] = '\0';
+    return inode->size;
+}
+
+/* note, trashes path */
+static int squashfs_walk(squashfs_t *sqfs, char *path, const struct squashfs_inode *start,
+                         struct squashfs_inode *inode, int recurse)
+{
+    struct squashfs_inode dir = *start;
+    char *ptr = path, *next_sep;
+    bool done = false;
+    int err;
+
+    LTRACEF("path '%s', recurse %d\n", path, recurse);
+
+    if (recurse > 4)
+        return ERR_RECURSE_TOO_DEEP;
+
+    *inode = dir;
+
+    while (!done) {
+        /* consume separators */
+        while (*ptr == '/')
+            ptr++;
+        if (*ptr == '\0')
+            break;
+
+        next_sep = strchr(ptr, '/');
+        if (next_sep)
+            *next_sep = '\0';
+        else
+            done = true;
+
+        if (!strcmp(ptr, ".")) {
+            *inode = dir;
+        } else {
+            err = squashfs_dir_lookup(sqfs, &dir, ptr, inode);
+            if (err < 0)
+                return err;
+        }
+
+        if (squashfs_is_symlink(inode)) {
+            char link[512];
+
+            err = squashfs_read_link(sqfs, inode, link, sizeof(link));
+            if (err < 0)
+                return err;
+
+            LTRACEF("symlink '%s'\n", link);
+
+            /* links starting with '/' start over again at the root */
+            err = squashfs_walk(sqfs, link, link[0] == '/' ? &sqfs->root : &dir,
+                                inode, recurse + 1);
+            if (err < 0)
+                return err;
+        }
+
+        if (!done) {
+            if (!squashfs_is_dir(inode)) {
+                LTRACEF("not finished and component is nondir\n");
+                return ERR_NOT_FOUND;
+            }
+            dir = *inode;
+            ptr = next_sep + 1;
+        }
+    }
+
+    return 0;
+}
+
+static int squashfs_lookup(squashfs_t *sqfs, const char *_path, struct squashfs_inode *inode)
+{
+    char path[FS_MAX_PATH_LEN];
+
+    strlcpy(path, _path, sizeof(path));
+
+    return squashfs_walk(sqfs, path, &sqfs->root, inode, 1);
+}
+
+static int squashfs_read_super(bdev_t *dev, struct squashfs_super_block *sb)
+{
+    ssize_t err;
+
+    err = bio_read(dev, sb, 0, sizeof(*sb));
+    if (err < 0)
+        return err;
+    if (err < (ssize_t)sizeof(*sb))
+        return ERR_IO;
+
+    if (LE32(sb->s_magic) != SQUASHFS_MAGIC)
+        return ERR_NOT_VALID;
+
+    if (LE16(sb->s_major) != SQUASHFS_MAJOR || LE16(sb->s_minor) != SQUASHFS_MINOR) {
+        dprintf(INFO, "squashfs: unsupported version %u.%u\n", LE16(sb->s_major), LE16(sb->s_minor));
+        return ERR_NOT_SUPPORTED;
+    }
+
+    if (LE16(sb->compression) != SQUASHFS_COMP_ZLIB && LE16(sb->compression) != SQUASHFS_COMP_LZ4) {
+        dprintf(INFO, "squashfs: unsupported compression %u\n", LE16(sb->compression));
+        return ERR_NOT_SUPPORTED;
+    }
+
+    return NO_ERROR;
+}
+
+static status_t squashfs_probe(bdev_t *dev)
+{
+    struct squashfs_super_block sb;
+
+    return squashfs_read_super(dev, &sb);
+}
+
+static void squashfs_free(squashfs_t *sqfs)
+{
+    if (sqfs->sb.compression == SQUASHFS_COMP_ZLIB)
+        inflateEnd(&sqfs->zstream);
+
+    free(sqfs->read_buf);
+    free(sqfs->block_buf);
+    free(sqfs->frag_index);
+    free(sqfs->meta_buf);
+    free(sqfs);
+}
+
+static status_t squashfs_mount(bdev_t *dev, fscookie **cookie)
+{
+    struct squashfs_super_block *sb;
+    squashfs_t *sqfs;
+    uint frag_blocks, i;
+    int err;
+
+    sqfs = calloc(1, sizeof(*sqfs));
+    if (!sqfs)
+        return ERR_NO_MEMORY;
+
+    sqfs->dev = dev;
+    sb = &sqfs->sb;
+
+    err = squashfs_read_super(dev, sb);
+    if (err < 0) {
+        free(sqfs);
+        return err;
+    }
+
+    sb->inodes = LE32(sb->inodes);
+    sb->block_size = LE32(sb->block_size);
+    sb->fragments = LE32(sb->fragments);
+    sb->compression = LE16(sb->compression);
+    sb->block_log = LE16(sb->block_log);
+    sb->flags = LE16(sb->flags);
+    sb->root_inode = LE64(sb->root_inode);
+    sb->bytes_used = LE64(sb->bytes_used);
+    sb->inode_table_start = LE64(sb->inode_table_start);
+    sb->directory_table_start = LE64(sb->directory_table_start);
+    sb->fragment_table_start = LE64(sb->fragment_table_start);
+
+    LTRACEF("block size %u, inodes %u, fragments %u, compression %u, bytes used %llu\n",
+            sb->block_size, sb->inodes, sb->fragments, sb->compression, sb->bytes_used);
+
+    if (sb->block_log < 12 || sb->block_log > 20 || sb->block_size != 1U << sb->block_log ||
+        sb->bytes_used > (uint64_t)dev->size) {
+        dprintf(INFO, "squashfs: invalid super block\n");
+        free(sqfs);
+        return ERR_NOT_VALID;
+    }
+
+    if (sb->compression == SQUASHFS_COMP_ZLIB) {
+        sqfs->zstream.zalloc = squashfs_zalloc;
+        sqfs->zstream.zfree = squashfs_zfree;
+        if (inflateInit(&sqfs->zstream) != Z_OK) {
+            err = ERR_NO_MEMORY;
+            goto err;
+        }
+    }
+
+    sqfs->read_len = MAX(sb->block_size, SQUASHFS_READ_BATCH);
+    sqfs->read_buf = malloc(sqfs->read_len);
+    sqfs->block_buf = malloc(sb->block_size);
+    sqfs->meta_buf = malloc(SQUASHFS_METADATA_SIZE);
+    if (!sqfs->read_buf || !sqfs->block_buf || !sqfs->meta_buf) {
+        err = ERR_NO_MEMORY;
+        goto err;
+    }
+
+    /* the locations of the metadata blocks with the fragment entries */
+    frag_blocks = (sb->fragments + SQUASHFS_FRAGS_PER_META - 1) / SQUASHFS_FRAGS_PER_META;
+    if (frag_blocks) {
+        sqfs->frag_index = malloc(frag_blocks * sizeof(uint64_t));
+        if (!sqfs->frag_index) {
+            err = ERR_NO_MEMORY;
+            goto err;
+        }
+
+        err = bio_read(dev, sqfs->frag_index, sb->fragment_table_start, frag_blocks * sizeof(uint64_t));
+        if (err < (int)(frag_blocks * sizeof(uint64_t))) {
+            err = ERR_IO;
+            goto err;
+        }
+
+        for (i = 0; i < frag_blocks; i++)
+            sqfs->frag_index[i] = LE64(sqfs->frag_index[i]);
+    }
+
+    err = squashfs_load_inode(sqfs, sb->root_inode, &sqfs->root);
+    if (err < 0)
+        goto err;
+    if (!squashfs_is_dir(&sqfs->root)) {
+        err = ERR_NOT_VALID;
+        goto err;
+    }
+
+    *cookie = (fscookie *)sqfs;
+    return 0;
+
+err:
+    LTRACEF("exiting with err code %d\n", err);
+    squashfs_free(sqfs);
+    return err;
+}
+
+static status_t squashfs_unmount(fscookie *cookie)
+{
+    squashfs_free((squashfs_t *)cookie);
+    return 0;
+}
+
+static status_t squashfs_open_file(fscookie *cookie, const char *path, filecookie **fcookie)
+{
+    squashfs_t *sqfs = (squashfs_t *)cookie;
+    squashfs_file_t *file;
+    uint64_t pos;
+    uint i;
+    int err;
+
+    file = calloc(1, sizeof(*file));
+    if (!file)
+        return ERR_NO_MEMORY;
+
+    file->sqfs = sqfs;
+
+    err = squashfs_lookup(sqfs, path, &file->inode);
+    if (err < 0)
+        goto err;
+
+    if (squashfs_is_reg(&file->inode)) {
+        /* all full blocks, and the tail if it isn't stored in a fragment */
+        if (file->inode.fragment == SQUASHFS_INVALID_FRAG)
+            file->nblocks = (file->inode.size + sqfs->sb.block_size - 1) >> sqfs->sb.block_log;
+        else
+            file->nblocks = file->inode.size >> sqfs->sb.block_log;
+
+        /* index the block list once, so reads can seek directly */
+        if (file->nblocks) {
+            file->sizes = malloc(file->nblocks * sizeof(uint32_t));
+            file->pos = malloc(file->nblocks * sizeof(uint64_t));
+            if (!file->sizes || !file->pos) {
+                err = ERR_NO_MEMORY;
+                goto err;
+            }
+
+            err = squashfs_read_meta(sqfs, &file->inode.data, file->sizes,
+                                     file->nblocks * sizeof(uint32_t));
+            if (err < 0)
+                goto err;
+        }
+
+        pos = file->inode.start_block;
+        for (i = 0; i < file->nblocks; i++) {
+            file->sizes[i] = LE32(file->sizes[i]);
+            file->pos[i] = pos;
+            pos += file->sizes[i] & ~SQUASHFS_DATA_UNCOMPRESSED;
+        }
+
+        if (pos > sqfs->sb.bytes_used) {
+            err = ERR_NOT_VALID;
+            goto err;
+        }
+    }
+
+    *fcookie = (filecookie *)file;
+    return 0;
+
+err:
+    free(file->pos);
+    free(file->sizes);
+    free(file);
+    return err;
+}
+
+/* decompress a data or fragment block into the block buffer */
+static int squashfs_load_block(squashfs_t *sqfs, uint64_t pos, uint32_t size)
+{
+    uint32_t len = size & ~SQUASHFS_DATA_UNCOMPRESSED;
+    ssize_t ret;
+
+    if (sqfs->block_len && sqfs->block_pos == pos)
+        return 0;
+
+    sqfs->block_len = 0;
+    if (len > sqfs->sb.block_size || pos + len > sqfs->sb.bytes_used)
+        return ERR_NOT_VALID;
+
+    if (size & SQUASHFS_DATA_UNCOMPRESSED) {
+        ret = bio_read(sqfs->dev, sqfs->block_buf, pos, len);
+        if (ret < (ssize_t)len)
+            return ERR_IO;
+    } else {
+        ret = bio_read(sqfs->dev, sqfs->read_buf, pos, len);
+        if (ret < (ssize_t)len)
+            return ERR_IO;
+
+        ret = squashfs_decompress(sqfs, sqfs->read_buf, len, sqfs->block_buf, sqfs->sb.block_size);
+        if (ret < 0)
+            return ret;
+    }
+
+    sqfs->block_pos = pos;
+    sqfs->block_len = ret;
+    return 0;
+}
+
+/* read the tail of a file from its fragment block */
+static ssize_t squashfs_read_fragment(squashfs_file_t *file, void *buf, uint offset, size_t len)
+{
+    squashfs_t *sqfs = file->sqfs;
+    struct squashfs_fragment_entry frag;
+    struct squashfs_meta_pos pos;
+    uint32_t index = file->inode.fragment;
+    int err;
+
+    if (index >= sqfs->sb.fragments)
+        return ERR_NOT_VALID;
+
+    pos.block = sqfs->frag_index[index / SQUASHFS_FRAGS_PER_META];
+    pos.offset = (index % SQUASHFS_FRAGS_PER_META) * sizeof(frag);
+    err = squashfs_read_meta(sqfs, &pos, &frag, sizeof(frag));
+    if (err < 0)
+        return err;
+
+    err = squashfs_load_block(sqfs, LE64(frag.start_block), LE32(frag.size));
+    if (err < 0)
+        return err;
+
+    offset += file->inode.frag_offset;
+    if (offset + len > sqfs->block_len)
+        return ERR_NOT_VALID;
+
+    memcpy(buf, sqfs->block_buf + offset, len);
+    return len;
+}
+
+/* count the following compressed blocks whose data fits into limit bytes */
+static uint squashfs_batch(squashfs_file_t *file, uint block, uint count, size_t limit, uint32_t *bytes)
+{
+    uint32_t size, batch = 0;
+    uint n;
+
+    for (n = 0; n < count; n++) {
+        size = file->sizes[block + n];
+        if (!size || (size & SQUASHFS_DATA_UNCOMPRESSED) || batch + size > limit)
+            break;
+        batch += size;
+    }
+
+    *bytes = batch;
+    return n;
+}
+
+/*
+ * Read whole blocks of a file directly to buf. The compressed data of as many
+ * consecutive blocks as fit into the read buffer is read at once. If the read
+ * buffer holds at least two blocks, it is split in two halves: the next batch
+ * is read into one half while the other one is decompressed, so the device
+ * and the decompression are busy at the same time.
+ */
+static ssize_t squashfs_read_blocks(squashfs_file_t *file, void *buf, uint block, uint count)
+{
+    squashfs_t *sqfs = file->sqfs;
+    uint bs = sqfs->sb.block_size;
+    size_t limit = sqfs->read_len / 2 >= bs ? sqfs->read_len / 2 : sqfs->read_len;
+    struct bio_request req[2];
+    uint32_t size, len, want[2];
+    uint i, n, next_n = 0, cur = 0;
+    bool pending = false;
+    size_t off;
+    ssize_t ret;
+    uint j;
+
+    for (i = 0; i < count; i += n) {
+        size = file->sizes[block + i];
+        len = size & ~SQUASHFS_DATA_UNCOMPRESSED;
+
+        if (len == 0) {
+            /* sparse block */
+            memset(buf, 0, bs);
+            buf = (uint8_t *)buf + bs;
+            n = 1;
+            continue;
+        }
+
+        if (size & SQUASHFS_DATA_UNCOMPRESSED) {
+            if (len != bs)
+                return ERR_NOT_VALID;
+
+            ret = bio_read(sqfs->dev, buf, file->pos[block + i], bs);
+            if (ret < (ssize_t)bs)
+                return ERR_IO;
+
+            buf = (uint8_t *)buf + bs;
+            n = 1;
+            continue;
+        }
+
+        /* a read of this batch may already be in progress */
+        if (pending) {
+            n = next_n;
+        } else {
+            n = squashfs_batch(file, block + i, count - i, limit, &want[cur]);
+            if (!n)
+                return ERR_NOT_VALID;
+
+            LTRACEF("block %u + %u: %u bytes\n", block + i, n, want[cur]);
+            if (bio_read_async(sqfs->dev, &req[cur], sqfs->read_buf + cur * limit,
+                               file->pos[block + i], want[cur]) < 0)
+                return ERR_IO;
+        }
+
+        ret = bio_wait(&req[cur]);
+        pending = false;
+        if (ret < (ssize_t)want[cur])
+            return ERR_IO;
+
+        /* start reading the next batch into the other half */
+        if (limit < sqfs->read_len && i + n < count) {
+            next_n = squashfs_batch(file, block + i + n, count - i - n, limit, &want[!cur]);
+            if (next_n) {
+                LTRACEF("block %u + %u: %u bytes (ahead)\n", block + i + n, next_n, want[!cur]);
+                pending = bio_read_async(sqfs->dev, &req[!cur], sqfs->read_buf + !cur * limit,
+                                         file->pos[block + i + n], want[!cur]) >= 0;
+            }
+        }
+
+        off = 0;
+        for (j = 0; j < n; j++) {
+            len = file->sizes[block + i + j];
+            ret = squashfs_decompress(sqfs, sqfs->read_buf + cur * limit + off, len, buf, bs);
+            if (ret >= 0 && ret != (ssize_t)bs)
+                ret = ERR_NOT_VALID;
+            if (ret < 0) {
+                /* the buffer must not be in use after returning */
+                if (pending)
+                    bio_wait(&req[!cur]);
+                return ret;
+            }
+
+            off += len;
+            buf = (uint8_t *)buf + bs;
+        }
+
+        if (pending)
+            cur = !cur;
+    }
+
+    return (ssize_t)count * bs;
+}
+
+static ssize_t squashfs_read_file(filecookie *fcookie, void *_buf, off_t offset, size_t len)
+{
+    squashfs_file_t *file = (squashfs_file_t *)fcookie;
+    squashfs_t *sqfs = file->sqfs;
+    uint bs = sqfs->sb.block_size;
+    uint8_t *buf = _buf;
+    size_t total = 0, n;
+    uint block, off, count;
+    ssize_t err;
+
+    if (!squashfs_is_reg(&file->inode))
+        return ERR_NOT_FILE;
+
+    if (offset < 0 || (uint64_t)offset >= file->inode.size)
+        return 0;
+    if (len > file->inode.size - offset)
+        len = file->inode.size - offset;
+
+    while (len) {
+        block = offset >> sqfs->sb.block_log;
+        off = offset & (bs - 1);
+
+        if (block >= file->nblocks) {
+            /* the tail of the file in the fragment */
+            err = squashfs_read_fragment(file, buf, off, len);
+            if (err < 0)
+                return err;
+            n = len;
+        } else if (off == 0 && len >= bs) {
+            count = MIN(len / bs, file->nblocks - block);
+            err = squashfs_read_blocks(file, buf, block, count);
+            if (err < 0)
+                return err;
+            n = (size_t)count * bs;
+        } else {
+            /* partial block, or the last block if it is shorter */
+            n = MIN(len, bs - off);
+            if ((file->sizes[block] & ~SQUASHFS_DATA_UNCOMPRESSED) == 0) {
+                memset(buf, 0, n);
+            } else {
+                err = squashfs_load_block(sqfs, file->pos[block], file->sizes[block]);
+                if (err < 0)
+                    return err;
+                if (off + n > sqfs->block_len)
+                    return ERR_NOT_VALID;
+                memcpy(buf, sqfs->block_buf + off, n);
+            }
+        }
+
+        buf += n;
+        offset += n;
+        total += n;
+        len -= n;
+    }
+
+    return total;
+}
+
+static status_t squashfs_stat_file(filecookie *fcookie, struct file_stat *stat)
+{
+    squashfs_file_t *file = (squashfs_file_t *)fcookie;
+
+    stat->is_dir = squashfs_is_dir(&file->inode);
+    stat->size = file->inode.size;
+    stat->mtime = file->inode.mtime;
+
+    return 0;
+}
+
+static status_t squashfs_close_file(filecookie *fcookie)
+{
+    squashfs_file_t *file = (squashfs_file_t *)fcookie;
+
+    free(file->pos);
+    free(file->sizes);
+    free(file);
+
+    return 0;
+}
+
+static status_t squashfs_open_directory(fscookie *cookie, const char *path, dircookie **dcookie)
+{
+    squashfs_t *sqfs = (squashfs_t *)cookie;
+    struct squashfs_inode inode;
+    squashfs_dir_t *dir;
+    int err;
+
+    err = squashfs_lookup(sqfs, path, &inode);
+    if (err < 0)
+        return err;
+
+    dir = malloc(sizeof(*dir));
+    if (!dir)
+        return ERR_NO_MEMORY;
+
+    err = squashfs_dir_start(sqfs, &inode, dir);
+    if (err < 0) {
+        free(dir);
+        return err;
+    }
+
+    *dcookie = (dircookie *)dir;
+    return 0;
+}
+
+static status_t squashfs_read_directory(dircookie *dcookie, struct dirent *ent)
+{
+    squashfs_dir_t *dir = (squashfs_dir_t *)dcookie;
+    char name[257];
+    int err;
+
+    err = squashfs_dir_next(dir, name, NULL);
+    if (err < 0)
+        return err;
+
+    strlcpy(ent->name, name, sizeof(ent->name));
+    return 0;
+}
+
+static status_t squashfs_close_directory(dircookie *dcookie)
+{
+    free(dcookie);
+    return 0;
+}
+
+static const struct fs_api squashfs_api = {
+    .probe = squashfs_probe,
+    .mount = squashfs_mount,
+    .unmount = squashfs_unmount,
+    .open = squashfs_open_file,
+    .stat = squashfs_stat_file,
+    .read = squashfs_read_file,
+    .close = squashfs_close_file,
+    .opendir = squashfs_open_directory,
+    .readdir = squashfs_read_directory,
+    .closedir = squashfs_close_directory
+};
+
+void squashfs_init(void)
+{
+    fs_register_type("squashfs", &squashfs_api);
+}
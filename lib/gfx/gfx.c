@@ -138,108 +138,81 @@ static void putpixel32(gfx_surface *surface, uint x, uint y, uint color)
 	*dest = color;
 }
 
-static void copyrect16(gfx_surface *surface, uint x, uint y, uint width, uint height, uint x2, uint y2)
+/*
+ * Copy the rows in an order that does not overwrite source rows before they
+ * are copied. memmove() takes care of overlap within the row.
+ */
+static void copyrect(gfx_surface *surface, uint x, uint y, uint width, uint height, uint x2, uint y2)
 {
-	// copy
-	const uint16_t *src = &((const uint16_t *)surface->ptr)[x + y * surface->stride];
-	uint16_t *dest = &((uint16_t *)surface->ptr)[x2 + y2 * surface->stride];
-	uint stride_diff = surface->stride - width;
-
-	if (dest < src) {
-		uint i, j;
-		for (i=0; i < height; i++) {
-			for (j=0; j < width; j++) {
-				*dest = *src;
-				dest++;
-				src++;
-			}
-			dest += stride_diff;
-			src += stride_diff;
-		}
+	size_t pitch = surface->stride * surface->pixelsize;
+	size_t len = width * surface->pixelsize;
+	const uint8_t *src = (const uint8_t *)surface->ptr + y * pitch + x * surface->pixelsize;
+	uint8_t *dest = (uint8_t *)surface->ptr + y2 * pitch + x2 * surface->pixelsize;
+	uint i;
+
+	if (dest <= src) {
+		for (i = 0; i < height; i++)
+			memmove(dest + i * pitch, src + i * pitch, len);
 	} else {
-		// copy backwards
-		src += height * surface->stride + width;
-		dest += height * surface->stride + width;
-
-		uint i, j;
-		for (i=0; i < height; i++) {
-			for (j=0; j < width; j++) {
-				*dest = *src;
-				dest--;
-				src--;
-			}
-			dest -= stride_diff;
-			src -= stride_diff;
-		}
+		for (i = height; i > 0; i--)
+			memmove(dest + (i - 1) * pitch, src + (i - 1) * pitch, len);
 	}
 }
 
-static void fillrect16(gfx_surface *surface, uint x, uint y, uint width, uint height, uint color)
+#if ARM_WITH_NEON
+/* arch/arm/gfx-neon.S, count must be a multiple of the block size */
+void gfx_fill16_neon(uint16_t *dest, uint16_t color, uint count);	/* 16 pixels */
+void gfx_fill32_neon(uint32_t *dest, uint32_t color, uint count);	/* 8 pixels */
+void gfx_blend32_neon(uint32_t *dest, const uint32_t *src, uint count);	/* 8 pixels */
+#endif
+
+static void fill16_row(uint16_t *dest, uint16_t color, uint width)
 {
-	uint16_t *dest = &((uint16_t *)surface->ptr)[x + y * surface->stride];
-	uint stride_diff = surface->stride - width;
+#if ARM_WITH_NEON
+	uint n = ROUNDDOWN(width, 16);
 
-	uint16_t color16 = ARGB8888_to_RGB565(color);
-	
-	uint i, j;
-	for (i=0; i < height; i++) {
-		for (j=0; j < width; j++) {
-			*dest = color16;
-			dest++;
-		}
-		dest += stride_diff;
+	if (n) {
+		gfx_fill16_neon(dest, color, n);
+		dest += n;
+		width -= n;
 	}
+#endif
+	while (width--)
+		*dest++ = color;
 }
 
-static void copyrect32(gfx_surface *surface, uint x, uint y, uint width, uint height, uint x2, uint y2)
+static void fill32_row(uint32_t *dest, uint32_t color, uint width)
 {
-	// copy
-	const uint32_t *src = &((const uint32_t *)surface->ptr)[x + y * surface->stride];
-	uint32_t *dest = &((uint32_t *)surface->ptr)[x2 + y2 * surface->stride];
-	uint stride_diff = surface->stride - width;
+#if ARM_WITH_NEON
+	uint n = ROUNDDOWN(width, 8);
 
-	if (dest < src) {
-		uint i, j;
-		for (i=0; i < height; i++) {
-			for (j=0; j < width; j++) {
-				*dest = *src;
-				dest++;
-				src++;
-			}
-			dest += stride_diff;
-			src += stride_diff;
-		}
-	} else {
-		// copy backwards
-		src += height * surface->stride + width;
-		dest += height * surface->stride + width;
-
-		uint i, j;
-		for (i=0; i < height; i++) {
-			for (j=0; j < width; j++) {
-				*dest = *src;
-				dest--;
-				src--;
-			}
-			dest -= stride_diff;
-			src -= stride_diff;
-		}
+	if (n) {
+		gfx_fill32_neon(dest, color, n);
+		dest += n;
+		width -= n;
 	}
+#endif
+	while (width--)
+		*dest++ = color;
+}
+
+static void fillrect16(gfx_surface *surface, uint x, uint y, uint width, uint height, uint color)
+{
+	uint16_t *dest = &((uint16_t *)surface->ptr)[x + y * surface->stride];
+	uint16_t color16 = ARGB8888_to_RGB565(color);
+	uint i;
+
+	for (i = 0; i < height; i++, dest += surface->stride)
+		fill16_row(dest, color16, width);
 }
 
 static void fillrect32(gfx_surface *surface, uint x, uint y, uint width, uint height, uint color)
 {
 	uint32_t *dest = &((uint32_t *)surface->ptr)[x + y * surface->stride];
-	uint stride_diff = surface->stride - width;
-	
-	uint i, j;
-	for (i=0; i < height; i++) {
-		for (j=0; j < width; j++) {
-			*dest = color;
-			dest++;
-		}
-		dest += stride_diff;
-	}
+	uint i;
+
+	for (i = 0; i < height; i++, dest += surface->stride)
+		fill32_row(dest, color, width);
 }
 
 uint32_t alpha32_add_ignore_destalpha(uint32_t dest, uint32_t src)
@@ -279,6 +252,26 @@ uint32_t alpha32_add_ignore_destalpha(uint32_t dest, uint32_t src)
 	return (srca << 24) | (cres[0] << 16) | (cres[1] << 8) | (cres[2]);
 }
 
+static void blend32_row(uint32_t *dest, const uint32_t *src, uint width)
+{
+#if ARM_WITH_NEON
+	uint n = ROUNDDOWN(width, 8);
+
+	if (n) {
+		gfx_blend32_neon(dest, src, n);
+		dest += n;
+		src += n;
+		width -= n;
+	}
+#endif
+	while (width--) {
+		// XXX ignores destination alpha
+		*dest = alpha32_add_ignore_destalpha(*dest, *src);
+		dest++;
+		src++;
+	}
+}
+
 /**
  * @brief  Copy pixels from source to dest.
  *
@@ -308,59 +301,40 @@ void gfx_surface_blend(struct gfx_surface *target, struct gfx_surface *source, u
 		// 16 bit to 16 bit
 		const uint16_t *src = (const uint16_t *)source->ptr;
 		uint16_t *dest = &((uint16_t *)target->ptr)[destx + desty * target->stride];
-		uint dest_stride_diff = target->stride - width;
-		uint source_stride_diff = source->stride - width;
 
-		LTRACEF("w %u h %u dstride %u sstride %u\n", width, height, dest_stride_diff, source_stride_diff);
+		LTRACEF("w %u h %u dstride %u sstride %u\n", width, height, target->stride, source->stride);
 
-		uint i, j;
+		uint i;
 		for (i=0; i < height; i++) {
-			for (j=0; j < width; j++) {
-				*dest = *src;
-				dest++;
-				src++;
-			}
-			dest += dest_stride_diff;
-			src += source_stride_diff;
+			memcpy(dest, src, width * sizeof(*dest));
+			dest += target->stride;
+			src += source->stride;
 		}
 	} else if (source->format == GFX_FORMAT_ARGB_8888 && target->format == GFX_FORMAT_ARGB_8888) {
 		// both are 32 bit modes, both alpha
 		const uint32_t *src = (const uint32_t *)source->ptr;
 		uint32_t *dest = &((uint32_t *)target->ptr)[destx + desty * target->stride];
-		uint dest_stride_diff = target->stride - width;
-		uint source_stride_diff = source->stride - width;
 
-		LTRACEF("w %u h %u dstride %u sstride %u\n", width, height, dest_stride_diff, source_stride_diff);
+		LTRACEF("w %u h %u dstride %u sstride %u\n", width, height, target->stride, source->stride);
 
-		uint i, j;
+		uint i;
 		for (i=0; i < height; i++) {
-			for (j=0; j < width; j++) {
-				// XXX ignores destination alpha
-				*dest = alpha32_add_ignore_destalpha(*dest, *src);
-				dest++;
-				src++;
-			}
-			dest += dest_stride_diff;
-			src += source_stride_diff;
+			blend32_row(dest, src, width);
+			dest += target->stride;
+			src += source->stride;
 		}
 	} else if (source->format == GFX_FORMAT_RGB_x888 && target->format == GFX_FORMAT_RGB_x888) {
 		// both are 32 bit modes, no alpha
 		const uint32_t *src = (const uint32_t *)source->ptr;
 		uint32_t *dest = &((uint32_t *)target->ptr)[destx + desty * target->stride];
-		uint dest_stride_diff = target->stride - width;
-		uint source_stride_diff = source->stride - width;
 
-		LTRACEF("w %u h %u dstride %u sstride %u\n", width, height, dest_stride_diff, source_stride_diff);
+		LTRACEF("w %u h %u dstride %u sstride %u\n", width, height, target->stride, source->stride);
 
-		uint i, j;
+		uint i;
 		for (i=0; i < height; i++) {
-			for (j=0; j < width; j++) {
-				*dest = *src;
-				dest++;
-				src++;
-			}
-			dest += dest_stride_diff;
-			src += source_stride_diff;
+			memcpy(dest, src, width * sizeof(*dest));
+			dest += target->stride;
+			src += source->stride;
 		}
 	} else {
 		panic("gfx_surface_blend: unimplemented colorspace combination (source %d target %d)\n", source->format, target->format);
@@ -424,7 +398,7 @@ gfx_surface *gfx_create_surface(void *ptr, uint width, uint height, uint stride,
 	// set up some function pointers
 	switch (format) {
 		case GFX_FORMAT_RGB_565:
-			surface->copyrect = &copyrect16;
+			surface->copyrect = &copyrect;
 			surface->fillrect = &fillrect16;
 			surface->putpixel = &putpixel16;
 			surface->pixelsize = 2;
@@ -432,7 +406,7 @@ gfx_surface *gfx_create_surface(void *ptr, uint width, uint height, uint stride,
 			break;
 		case GFX_FORMAT_RGB_x888:
 		case GFX_FORMAT_ARGB_8888:
-			surface->copyrect = &copyrect32;
+			surface->copyrect = &copyrect;
 			surface->fillrect = &fillrect32;
 			surface->putpixel = &putpixel32;
 			surface->pixelsize = 4;
@@ -2,3 +2,8 @@ LOCAL_DIR := $(GET_LOCAL_DIR)
 
 OBJS += \
 	$(LOCAL_DIR)/gfx.o
+
+ifeq ($(ARM_CPU),cortex-a8)
+OBJS += \
+	$(LOCAL_DIR)/arch/arm/gfx-neon.o
+endif
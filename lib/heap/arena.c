@@ -0,0 +1,141 @@
+// SPDX-License-Identifier: BSD-3-Clause
+
+#include <debug.h>
+#include <stdlib.h>
+#include <string.h>
+#include <lib/arena.h>
+
+#define ARENA_ALIGN 8
+
+struct arena_block {
+	struct arena_block *next;
+	size_t size;
+	size_t used;
+	uint8_t data[] __ALIGNED(ARENA_ALIGN);
+};
+
+struct arena {
+	/* Block that is currently bump allocated from, the others are full */
+	struct arena_block *cur;
+	size_t block_size;
+	/* The first block is part of the arena and kept on reset */
+	struct arena_block first;
+};
+
+/**
+ * arena_create() - Create a new arena.
+ * @block_size: Size of the blocks allocated from the heap
+ *
+ * Return: The new arena, or NULL if there is not enough memory.
+ */
+struct arena *arena_create(size_t block_size)
+{
+	struct arena *arena;
+
+	block_size = ROUNDUP(block_size, ARENA_ALIGN);
+	arena = malloc(sizeof(*arena) + block_size);
+	if (!arena)
+		return NULL;
+
+	arena->cur = &arena->first;
+	arena->block_size = block_size;
+	arena->first.next = NULL;
+	arena->first.size = block_size;
+	arena->first.used = 0;
+	return arena;
+}
+
+/**
+ * arena_reset() - Release all allocations of an arena at once.
+ * @arena: The arena
+ *
+ * Only the first block is kept for the next allocations, all other blocks
+ * are returned to the heap.
+ */
+void arena_reset(struct arena *arena)
+{
+	struct arena_block *block, *next;
+
+	for (block = arena->cur; block != &arena->first; block = next) {
+		next = block->next;
+		free(block);
+	}
+
+	arena->cur = &arena->first;
+	arena->first.used = 0;
+}
+
+/**
+ * arena_destroy() - Release all allocations and the arena itself.
+ * @arena: The arena (or NULL)
+ */
+void arena_destroy(struct arena *arena)
+{
+	if (!arena)
+		return;
+
+	arena_reset(arena);
+	free(arena);
+}
+
+/**
+ * arena_alloc() - Allocate memory from an arena.
+ * @arena: The arena
+ * @size: Number of bytes to allocate
+ *
+ * Return: Memory aligned to 8 bytes that is valid until the arena is reset,
+ * or NULL if there is not enough memory.
+ */
+void *arena_alloc(struct arena *arena, size_t size)
+{
+	struct arena_block *block = arena->cur;
+	void *ptr;
+
+	size = ROUNDUP(size, ARENA_ALIGN);
+	if (size > block->size - block->used) {
+		size_t block_size = MAX(size, arena->block_size);
+
+		block = malloc(sizeof(*block) + block_size);
+		if (!block)
+			return NULL;
+
+		block->size = block_size;
+		block->used = 0;
+		block->next = arena->cur;
+		arena->cur = block;
+	}
+
+	ptr = block->data + block->used;
+	block->used += size;
+	return ptr;
+}
+
+void *arena_calloc(struct arena *arena, size_t count, size_t size)
+{
+	void *ptr;
+
+	if (size && count > ~(size_t)0 / size)
+		return NULL;
+
+	ptr = arena_alloc(arena, count * size);
+	if (ptr)
+		memset(ptr, 0, count * size);
+	return ptr;
+}
+
+char *arena_strndup(struct arena *arena, const char *str, size_t max)
+{
+	size_t len = strnlen(str, max);
+	char *copy = arena_alloc(arena, len + 1);
+
+	if (copy) {
+		memcpy(copy, str, len);
+		copy[len] = '\0';
+	}
+	return copy;
+}
+
+char *arena_strdup(struct arena *arena, const char *str)
+{
+	return arena_strndup(arena, str, ~(size_t)0);
+}
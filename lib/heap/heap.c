@@ -58,15 +58,44 @@ extern int _end_of_ram;
 #define HEAP_LEN ((size_t)&_end_of_ram - (size_t)&_end)
 #endif
 
+/*
+ * Free chunks are kept in segregated lists by size (two-level, like TLSF), so
+ * finding a free chunk and coalescing on free take constant time.
+ *
+ * Every chunk starts with a tag: its length plus the HEAP_CHUNK_* flags below.
+ * Free chunks also repeat their length in the last word, so that the chunk
+ * after it can find the start of a free chunk before it for coalescing.
+ * Two free chunks are never next to each other.
+ */
+#define HEAP_CHUNK_FREE		1
+#define HEAP_CHUNK_PREV_FREE	2
+#define HEAP_CHUNK_FLAGS	(HEAP_CHUNK_FREE | HEAP_CHUNK_PREV_FREE)
+
 struct free_heap_chunk {
+	size_t tag;
 	struct list_node node;
-	size_t len;
 };
 
+#define HEAP_MIN_CHUNK (sizeof(struct free_heap_chunk) + sizeof(size_t))
+
+// each power of 2 is split into HEAP_SL_COUNT lists
+#define HEAP_SL_BITS 2
+#define HEAP_SL_COUNT (1 << HEAP_SL_BITS)
+#define HEAP_FL_COUNT 32
+
 struct heap {
 	void *base;
 	size_t len;
-	struct list_node free_list;
+	uint32_t fl_bitmap;
+	uint32_t sl_bitmap[HEAP_FL_COUNT];
+	struct list_node free_lists[HEAP_FL_COUNT][HEAP_SL_COUNT];
+
+	// statistics, sizes include the overhead of each chunk
+	size_t used;
+	size_t max_used;
+	unsigned int allocs;
+	unsigned int total_allocs;
+	unsigned int failed_allocs;
 };
 
 // heap static vars
@@ -83,21 +112,124 @@ struct alloc_struct_begin {
 #endif
 };
 
+static inline size_t chunk_len(const struct free_heap_chunk *chunk)
+{
+	return chunk->tag & ~HEAP_CHUNK_FLAGS;
+}
+
+static inline struct free_heap_chunk *chunk_next(const struct free_heap_chunk *chunk)
+{
+	vaddr_t next = (vaddr_t)chunk + chunk_len(chunk);
+
+	if (next >= (vaddr_t)theheap.base + theheap.len)
+		return NULL;
+	return (struct free_heap_chunk *)next;
+}
+
+static inline void chunk_set_footer(struct free_heap_chunk *chunk)
+{
+	*(size_t *)((vaddr_t)chunk + chunk_len(chunk) - sizeof(size_t)) = chunk_len(chunk);
+}
+
+// find the list for chunks of this length
+static inline void heap_mapping(size_t len, unsigned int *fl, unsigned int *sl)
+{
+	unsigned int f = 31 - __builtin_clz(len);
+
+	*fl = f;
+	*sl = (len >> (f - HEAP_SL_BITS)) & (HEAP_SL_COUNT - 1);
+}
+
+static void heap_insert_free_list(struct free_heap_chunk *chunk)
+{
+	unsigned int fl, sl;
+
+	heap_mapping(chunk_len(chunk), &fl, &sl);
+	list_add_head(&theheap.free_lists[fl][sl], &chunk->node);
+	theheap.fl_bitmap |= 1U << fl;
+	theheap.sl_bitmap[fl] |= 1U << sl;
+}
+
+static void heap_remove_free_list(struct free_heap_chunk *chunk)
+{
+	unsigned int fl, sl;
+
+	heap_mapping(chunk_len(chunk), &fl, &sl);
+	list_delete(&chunk->node);
+	if (list_is_empty(&theheap.free_lists[fl][sl])) {
+		theheap.sl_bitmap[fl] &= ~(1U << sl);
+		if (!theheap.sl_bitmap[fl])
+			theheap.fl_bitmap &= ~(1U << fl);
+	}
+}
+
+// find a free chunk of at least len bytes
+static struct free_heap_chunk *heap_find_free_chunk(size_t len)
+{
+	struct free_heap_chunk *chunk;
+	unsigned int fl, sl;
+	uint32_t map;
+
+	// round up to the next list, all chunks there are large enough
+	size_t round = len + (1U << (31 - __builtin_clz(len) - HEAP_SL_BITS)) - 1;
+	if (round > len) {
+		heap_mapping(round, &fl, &sl);
+
+		map = fl < HEAP_FL_COUNT ? theheap.sl_bitmap[fl] & (~0U << sl) : 0;
+		if (!map && fl + 1 < HEAP_FL_COUNT) {
+			uint32_t fl_map = theheap.fl_bitmap & (~0U << (fl + 1));
+			if (fl_map) {
+				fl = __builtin_ctz(fl_map);
+				map = theheap.sl_bitmap[fl];
+			}
+		}
+
+		if (map) {
+			sl = __builtin_ctz(map);
+			return list_peek_head_type(&theheap.free_lists[fl][sl],
+						   struct free_heap_chunk, node);
+		}
+	}
+
+	// otherwise only the chunks in the same list might still fit
+	heap_mapping(len, &fl, &sl);
+	list_for_every_entry(&theheap.free_lists[fl][sl], chunk, struct free_heap_chunk, node) {
+		if (chunk_len(chunk) >= len)
+			return chunk;
+	}
+
+	return NULL;
+}
+
 static void dump_free_chunk(struct free_heap_chunk *chunk)
 {
-	dprintf(INFO, "\t\tbase %p, end 0x%lx, len 0x%zx\n", chunk, (vaddr_t)chunk + chunk->len, chunk->len);
+	dprintf(INFO, "\t\tbase %p, end 0x%lx, len 0x%zx\n", chunk, (vaddr_t)chunk + chunk_len(chunk), chunk_len(chunk));
 }
 
 static void heap_dump(void)
 {
+	struct free_heap_chunk *chunk;
+	struct heap_stats stats;
+	unsigned int fl, sl;
+
 	dprintf(INFO, "Heap dump:\n");
 	dprintf(INFO, "\tbase %p, len 0x%zx\n", theheap.base, theheap.len);
-	dprintf(INFO, "\tfree list:\n");
+	dprintf(INFO, "\tfree lists:\n");
 
-	struct free_heap_chunk *chunk;
-	list_for_every_entry(&theheap.free_list, chunk, struct free_heap_chunk, node) {
-		dump_free_chunk(chunk);
+	for (fl = 0; fl < HEAP_FL_COUNT; fl++) {
+		for (sl = 0; sl < HEAP_SL_COUNT; sl++) {
+			list_for_every_entry(&theheap.free_lists[fl][sl], chunk, struct free_heap_chunk, node) {
+				dump_free_chunk(chunk);
+			}
+		}
 	}
+
+	heap_get_stats(&stats);
+	dprintf(INFO, "\tused 0x%zx (max 0x%zx) in %u allocations (%u total, %u failed)\n",
+		stats.used, stats.max_used, stats.allocs, stats.total_allocs, stats.failed_allocs);
+	// how much of the free memory is not usable for the largest allocation
+	dprintf(INFO, "\tfree 0x%zx in %u chunks, largest 0x%zx, fragmentation %u%%\n",
+		stats.free, stats.free_chunks, stats.largest_free, heap_fragmentation(&stats));
 }
 
 static void heap_test(void)
@@ -152,61 +284,44 @@ static void heap_test(void)
 	heap_dump();
 }
 
-// try to insert this free chunk into the free list, consuming the chunk by merging it with
-// nearby ones if possible. Returns base of whatever chunk it became in the list.
+// insert the free chunk into the lists, merging it with the chunks next to it if they
+// are free. Returns base of whatever chunk it became in the list.
 static struct free_heap_chunk *heap_insert_free_chunk(struct free_heap_chunk *chunk)
 {
 #if DEBUG_HEAP
-	vaddr_t chunk_end = (vaddr_t)chunk + chunk->len;
+	vaddr_t chunk_end = (vaddr_t)chunk + chunk_len(chunk);
 	dprintf(CRITICAL,"%s: chunk ptr %p, size 0x%lx, chunk_end 0x%x\n",
-				__FUNCTION__, chunk, chunk->len, chunk_end);
+				__FUNCTION__, chunk, chunk_len(chunk), chunk_end);
 #endif
 
-	struct free_heap_chunk *next_chunk;
-	struct free_heap_chunk *last_chunk;
-
-	// walk through the list, finding the node to insert before
-	list_for_every_entry(&theheap.free_list, next_chunk, struct free_heap_chunk, node) {
-		if (chunk < next_chunk) {
-			DEBUG_ASSERT(((vaddr_t)chunk + chunk->len) <= (vaddr_t)next_chunk);
-
-			list_add_before(&next_chunk->node, &chunk->node);
-
-			goto try_merge;
-		}
-	}
-
-	// walked off the end of the list, add it at the tail
-	list_add_tail(&theheap.free_list, &chunk->node);
+	struct free_heap_chunk *next_chunk = chunk_next(chunk);
+	size_t len = chunk_len(chunk);
 
 	// try to merge with the previous chunk
-try_merge:
-	last_chunk = list_prev_type(&theheap.free_list, &chunk->node, struct free_heap_chunk, node);
-	if (last_chunk) {
-		if ((vaddr_t)last_chunk + last_chunk->len == (vaddr_t)chunk) {
-			// easy, just extend the previous chunk
-			last_chunk->len += chunk->len;
-			
-			// remove ourself from the list
-			list_delete(&chunk->node);
-			
-			// set the chunk pointer to the newly extended chunk, in case 
-			// it needs to merge with the next chunk below
-			chunk = last_chunk;
-		}
+	if (chunk->tag & HEAP_CHUNK_PREV_FREE) {
+		size_t prev_len = *(size_t *)((vaddr_t)chunk - sizeof(size_t));
+		struct free_heap_chunk *last_chunk = (struct free_heap_chunk *)((vaddr_t)chunk - prev_len);
+
+		DEBUG_ASSERT(last_chunk->tag & HEAP_CHUNK_FREE);
+		heap_remove_free_list(last_chunk);
+		len += prev_len;
+		chunk = last_chunk;
 	}
 
 	// try to merge with the next chunk
-	if (next_chunk) {
-		if ((vaddr_t)chunk + chunk->len == (vaddr_t)next_chunk) {
-			// extend our chunk
-			chunk->len += next_chunk->len;
-
-			// remove them from the list
-			list_delete(&next_chunk->node);
-		}
+	if (next_chunk && (next_chunk->tag & HEAP_CHUNK_FREE)) {
+		heap_remove_free_list(next_chunk);
+		len += chunk_len(next_chunk);
+		next_chunk = chunk_next(next_chunk);
 	}
 
+	// the chunk before a free chunk is never free
+	chunk->tag = len | HEAP_CHUNK_FREE;
+	chunk_set_footer(chunk);
+	if (next_chunk)
+		next_chunk->tag |= HEAP_CHUNK_PREV_FREE;
+
+	heap_insert_free_list(chunk);
 	return chunk;
 }
 
@@ -219,7 +334,7 @@ struct free_heap_chunk *heap_create_free_chunk(void *ptr, size_t len)
 #endif
 
 	struct free_heap_chunk *chunk = (struct free_heap_chunk *)ptr;
-	chunk->len = len;
+	chunk->tag = len;
 
 	return chunk;
 }
@@ -237,22 +352,22 @@ void *heap_alloc(size_t size, unsigned int alignment)
 	if (alignment & (alignment - 1))
 		return NULL;
 
-	if(size > (size + sizeof(struct alloc_struct_begin)))
+	if(size > (size + sizeof(size_t) + sizeof(struct alloc_struct_begin)))
 	{
 		dprintf(CRITICAL, "invalid input size\n");
 		return NULL;
 	}
-	// we always put a size field + base pointer + magic in front of the allocation
-	size += sizeof(struct alloc_struct_begin);
+	// we always put the chunk tag and a size field + base pointer + magic in front of the allocation
+	size += sizeof(size_t) + sizeof(struct alloc_struct_begin);
 #if DEBUG_HEAP
 	size += PADDING_SIZE;
 #endif
 
-	// make sure we allocate at least the size of a struct free_heap_chunk so that
-	// when we free it, we can create a struct free_heap_chunk struct and stick it
-	// in the spot
-	if (size < sizeof(struct free_heap_chunk))
-		size = sizeof(struct free_heap_chunk);
+	// make sure we allocate at least the size of a free chunk so that
+	// when we free it, we can create a struct free_heap_chunk struct and a
+	// footer in the spot
+	if (size < HEAP_MIN_CHUNK)
+		size = HEAP_MIN_CHUNK;
 
 	// round up size to a multiple of native pointer size
 	if(size > (size + sizeof(void *)))
@@ -279,66 +394,70 @@ void *heap_alloc(size_t size, unsigned int alignment)
 	// critical section
 	enter_critical_section();
 
-	// walk through the list
-	ptr = NULL;
-	struct free_heap_chunk *chunk;
-	list_for_every_entry(&theheap.free_list, chunk, struct free_heap_chunk, node) {
-		DEBUG_ASSERT((chunk->len % sizeof(void *)) == 0); // len should always be a multiple of pointer size
+	struct free_heap_chunk *chunk = heap_find_free_chunk(size);
+	ptr = chunk;
+	if (chunk) {
+		struct free_heap_chunk *next_chunk = chunk_next(chunk);
 
-		// is it big enough to service our allocation?
-		if (chunk->len >= size) {
-			ptr = chunk;
+		DEBUG_ASSERT((chunk_len(chunk) % sizeof(void *)) == 0); // len should always be a multiple of pointer size
 
-			// remove it from the list
-			struct list_node *next_node = list_next(&theheap.free_list, &chunk->node);
-			list_delete(&chunk->node);
+		heap_remove_free_list(chunk);
 
-			if (chunk->len > size + sizeof(struct free_heap_chunk)) {
-				// there's enough space in this chunk to create a new one after the allocation
-				struct free_heap_chunk *newchunk = heap_create_free_chunk((uint8_t *)ptr + size, chunk->len - size);
+		if (chunk_len(chunk) >= size + HEAP_MIN_CHUNK) {
+			// there's enough space in this chunk to create a new one after the allocation
+			struct free_heap_chunk *newchunk = heap_create_free_chunk((uint8_t *)ptr + size, chunk_len(chunk) - size);
 
-				// truncate this chunk
-				chunk->len -= chunk->len - size;
+			// the chunk after it stays marked as HEAP_CHUNK_PREV_FREE
+			newchunk->tag |= HEAP_CHUNK_FREE;
+			chunk_set_footer(newchunk);
+			heap_insert_free_list(newchunk);
 
-				// add the new one where chunk used to be
-				if (next_node)
-					list_add_before(next_node, &newchunk->node);
-				else
-					list_add_tail(&theheap.free_list, &newchunk->node);
-			}
+			// truncate this chunk
+			chunk->tag = size;
+		} else {
+			chunk->tag = chunk_len(chunk);
+			if (next_chunk)
+				next_chunk->tag &= ~HEAP_CHUNK_PREV_FREE;
+		}
+
+		// the allocated size is actually the length of this chunk, not the size requested
+		DEBUG_ASSERT(chunk_len(chunk) >= size);
+		size = chunk_len(chunk);
 
-			// the allocated size is actually the length of this chunk, not the size requested
-			DEBUG_ASSERT(chunk->len >= size);
-			size = chunk->len;
+		theheap.used += size;
+		if (theheap.used > theheap.max_used)
+			theheap.max_used = theheap.used;
+		theheap.allocs++;
+		theheap.total_allocs++;
 
 #if DEBUG_HEAP
-			memset(ptr, ALLOC_FILL, size);
+		memset((uint8_t *)ptr + sizeof(size_t), ALLOC_FILL, size - sizeof(size_t));
 #endif
 
-			ptr = (void *)((addr_t)ptr + sizeof(struct alloc_struct_begin));
+		ptr = (void *)((addr_t)ptr + sizeof(size_t) + sizeof(struct alloc_struct_begin));
 
-			// align the output if requested
-			if (alignment > 0) {
-				ptr = (void *)ROUNDUP((addr_t)ptr, alignment);
-			}
+		// align the output if requested
+		if (alignment > 0) {
+			ptr = (void *)ROUNDUP((addr_t)ptr, (addr_t)alignment);
+		}
 
-			struct alloc_struct_begin *as = (struct alloc_struct_begin *)ptr;
-			as--;
-			as->magic = HEAP_MAGIC;
-			as->ptr = (void *)chunk;
-			as->size = size;
+		struct alloc_struct_begin *as = (struct alloc_struct_begin *)ptr;
+		as--;
+		as->magic = HEAP_MAGIC;
+		as->ptr = (void *)chunk;
+		as->size = size;
 #if DEBUG_HEAP
-			as->padding_start = ((uint8_t *)ptr + original_size);
-			as->padding_size = (((addr_t)chunk + size) - ((addr_t)ptr + original_size));
-//			printf("padding start %p, size %u, chunk %p, size %u\n", as->padding_start, as->padding_size, chunk, size);
+		as->padding_start = ((uint8_t *)ptr + original_size);
+		as->padding_size = (((addr_t)chunk + size) - ((addr_t)ptr + original_size));
+//		printf("padding start %p, size %u, chunk %p, size %u\n", as->padding_start, as->padding_size, chunk, size);
 
-			memset(as->padding_start, PADDING_FILL, as->padding_size);
+		memset(as->padding_start, PADDING_FILL, as->padding_size);
 #endif
-
-			break;
-		}
 	}
 
+	if (!ptr)
+		theheap.failed_allocs++;
+
 	LTRACEF("returning ptr %p\n", ptr);
 
 //	heap_dump();
@@ -400,26 +519,66 @@ void heap_free(void *ptr)
 
 	LTRACEF("allocation was %zd bytes long at ptr %p\n", as->size, as->ptr);
 
-	// looks good, create a free chunk and add it to the pool
+	// looks good, turn it back into a free chunk and add it to the pool
 	enter_critical_section();
-	heap_insert_free_chunk(heap_create_free_chunk(as->ptr, as->size));
+	struct free_heap_chunk *chunk = as->ptr;
+	DEBUG_ASSERT(chunk_len(chunk) == as->size);
+	theheap.used -= as->size;
+	theheap.allocs--;
+#if DEBUG_HEAP
+	memset((uint8_t *)chunk + sizeof(size_t), FREE_FILL, as->size - sizeof(size_t));
+#endif
+	heap_insert_free_chunk(chunk);
 	exit_critical_section();
 
 //	heap_dump();
 }
 
+void heap_get_stats(struct heap_stats *stats)
+{
+	struct free_heap_chunk *chunk;
+	unsigned int fl, sl;
+
+	memset(stats, 0, sizeof(*stats));
+
+	enter_critical_section();
+
+	stats->base = theheap.base;
+	stats->len = theheap.len;
+	stats->used = theheap.used;
+	stats->max_used = theheap.max_used;
+	stats->allocs = theheap.allocs;
+	stats->total_allocs = theheap.total_allocs;
+	stats->failed_allocs = theheap.failed_allocs;
+
+	for (fl = 0; fl < HEAP_FL_COUNT; fl++) {
+		for (sl = 0; sl < HEAP_SL_COUNT; sl++) {
+			list_for_every_entry(&theheap.free_lists[fl][sl], chunk, struct free_heap_chunk, node) {
+				stats->free += chunk_len(chunk);
+				if (chunk_len(chunk) > stats->largest_free)
+					stats->largest_free = chunk_len(chunk);
+				stats->free_chunks++;
+			}
+		}
+	}
+
+	exit_critical_section();
+}
+
 void heap_init(void)
 {
 	LTRACE_ENTRY;
 
 	// set the heap range
-	theheap.base = (void *)HEAP_START;
-	theheap.len = HEAP_LEN;
+	theheap.base = (void *)ROUNDUP(HEAP_START, sizeof(void *));
+	theheap.len = (HEAP_LEN - ((addr_t)theheap.base - HEAP_START)) & ~(sizeof(void *) - 1);
 
 	LTRACEF("base %p size %zd bytes\n", theheap.base, theheap.len);
 
-	// initialize the free list
-	list_initialize(&theheap.free_list);
+	// initialize the free lists
+	for (unsigned int fl = 0; fl < HEAP_FL_COUNT; fl++)
+		for (unsigned int sl = 0; sl < HEAP_SL_COUNT; sl++)
+			list_initialize(&theheap.free_lists[fl][sl]);
 
 	// create an initial free chunk
 	heap_insert_free_chunk(heap_create_free_chunk(theheap.base, theheap.len));
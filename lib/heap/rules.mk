@@ -1,4 +1,5 @@
 LOCAL_DIR := $(GET_LOCAL_DIR)
 
 OBJS += \
+	$(LOCAL_DIR)/arena.o \
 	$(LOCAL_DIR)/heap.o
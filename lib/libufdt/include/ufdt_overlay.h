@@ -39,4 +39,13 @@ struct fdt_header *ufdt_apply_overlay(struct fdt_header *main_fdt_header,
                                       void *overlay_fdtp,
                                       size_t overlay_size);
 
+/* Like ufdt_apply_overlay(), but applies overlay_count overlays in order and
+ * flattens the resulting tree only once.
+ * The overlay buffers must stay valid until it returns.
+ */
+struct fdt_header *ufdt_apply_multioverlay(struct fdt_header *main_fdt_header,
+                                           size_t main_fdt_size,
+                                           void *overlay_fdtp[],
+                                           size_t overlay_count);
+
 #endif /* UFDT_OVERLAY_H */
@@ -706,3 +706,83 @@ fail:
 
   return NULL;
 }
+
+/*
+ * Applies all overlays in order to the same unflattened tree and flattens it
+ * only once at the end. Will dto_malloc a new fdt blob and return it. The
+ * overlays must stay valid until this returns, they are referenced by the
+ * tree until it is flattened.
+ */
+struct fdt_header *ufdt_apply_multioverlay(struct fdt_header *main_fdt_header,
+                                           size_t main_fdt_size,
+                                           void *overlay_fdtp[],
+                                           size_t overlay_count) {
+  size_t out_fdt_size;
+  size_t i;
+  int err;
+
+  if (main_fdt_header == NULL) {
+    return NULL;
+  }
+
+  if (main_fdt_size < 8 || main_fdt_size != fdt_totalsize(main_fdt_header)) {
+    dto_error("Bad fdt size!\n");
+    return NULL;
+  }
+
+  out_fdt_size = fdt_totalsize(main_fdt_header);
+  for (i = 0; i < overlay_count; i++) {
+    if (fdt_check_header(overlay_fdtp[i]) < 0) {
+      dto_error("Bad overlay %zu!\n", i);
+      return NULL;
+    }
+    out_fdt_size += fdt_totalsize(overlay_fdtp[i]);
+  }
+
+  struct fdt_header *out_fdt_header = memalign(sizeof(uint64_t), out_fdt_size);
+  if (out_fdt_header == NULL) {
+    dto_error("failed to allocate memory for DTB blob with overlays\n");
+    return NULL;
+  }
+
+  struct ufdt_node_pool pool;
+  ufdt_node_pool_construct(&pool);
+  struct ufdt *main_tree = ufdt_from_fdt(main_fdt_header, main_fdt_size, &pool);
+
+  for (i = 0; i < overlay_count; i++) {
+    size_t overlay_size = fdt_totalsize(overlay_fdtp[i]);
+    struct ufdt *overlay_tree =
+        ufdt_from_fdt(overlay_fdtp[i], overlay_size, &pool);
+
+    err = ufdt_overlay_apply(main_tree, overlay_tree, overlay_size, &pool);
+    ufdt_destruct(overlay_tree, &pool);
+    if (err < 0) {
+      goto fail;
+    }
+
+    /*
+     * The next overlay must get phandles above the ones added by this
+     * overlay, so the phandle table of the main tree is rebuilt.
+     */
+    dto_free(main_tree->phandle_table.data);
+    main_tree->phandle_table = build_phandle_table(main_tree);
+  }
+
+  err = ufdt_to_fdt(main_tree, out_fdt_header, out_fdt_size);
+  if (err < 0) {
+    dto_error("Failed to dump the device tree to out_fdt_header\n");
+    goto fail;
+  }
+
+  ufdt_destruct(main_tree, &pool);
+  ufdt_node_pool_destruct(&pool);
+
+  return out_fdt_header;
+
+fail:
+  ufdt_destruct(main_tree, &pool);
+  ufdt_node_pool_destruct(&pool);
+  dto_free(out_fdt_header);
+
+  return NULL;
+}
@@ -0,0 +1,546 @@
+// SPDX-License-Identifier: BSD-3-Clause
+/*
+ * LZ4 decompressor supporting the LZ4 frame format, the legacy format
+ * used by the Linux kernel (Image.lz4, lz4 -l) and raw LZ4 blocks. Content
+ * and block checksums are skipped, not verified.
+ *
+ * See https://github.com/lz4/lz4/blob/dev/doc/lz4_Block_format.md
+ * and https://github.com/lz4/lz4/blob/dev/doc/lz4_Frame_format.md
+ */
+
+#include <err.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <lib/lz4.h>
+
+#define LZ4_FRAME_MAGIC		0x184D2204
+#define LZ4_LEGACY_MAGIC	0x184C2102
+#define LZ4_SKIPPABLE_MAGIC	0x184D2A50
+#define LZ4_SKIPPABLE_MASK	0xfffffff0
+
+#define LZ4_MIN_MATCH		4
+
+/* legacy blocks decompress to 8 MiB at most, compressBound() of that */
+#define LZ4_LEGACY_BLOCK_SIZE	(8 * 1024 * 1024)
+#define LZ4_LEGACY_BLOCK_BOUND	(LZ4_LEGACY_BLOCK_SIZE + LZ4_LEGACY_BLOCK_SIZE / 255 + 16)
+
+#define LZ4_FLG_VERSION_MASK	0xc0
+#define LZ4_FLG_VERSION		0x40
+#define LZ4_FLG_BLOCK_INDEP	0x20
+#define LZ4_FLG_BLOCK_CHECKSUM	0x10
+#define LZ4_FLG_CONTENT_SIZE	0x08
+#define LZ4_FLG_CONTENT_CHECKSUM 0x04
+#define LZ4_FLG_DICT_ID		0x01
+
+#define LZ4_BLOCK_UNCOMPRESSED	0x80000000
+
+struct lz4_out {
+	uint8_t *start;
+	uint8_t *pos;
+	uint8_t *end;
+};
+
+static inline uint32_t get_le32(const uint8_t *p)
+{
+	return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static int lz4_read_len(const uint8_t **ip, const uint8_t *iend, size_t *len)
+{
+	uint8_t b;
+
+	do {
+		if (*ip >= iend)
+			return ERR_NOT_VALID;
+		b = *(*ip)++;
+		*len += b;
+	} while (b == 255);
+
+	return 0;
+}
+
+static int lz4_copy(struct lz4_out *out, const uint8_t *src, size_t len)
+{
+	if (len > (size_t)(out->end - out->pos)) {
+		memcpy(out->pos, src, out->end - out->pos);
+		out->pos = out->end;
+		return ERR_NOT_ENOUGH_BUFFER;
+	}
+
+	memcpy(out->pos, src, len);
+	out->pos += len;
+	return 0;
+}
+
+static int lz4_copy_match(struct lz4_out *out, size_t offset, size_t len)
+{
+	const uint8_t *match = out->pos - offset;
+	int ret = 0;
+
+	if (len > (size_t)(out->end - out->pos)) {
+		len = out->end - out->pos;
+		ret = ERR_NOT_ENOUGH_BUFFER;
+	}
+
+	if (offset >= len) {
+		memcpy(out->pos, match, len);
+		out->pos += len;
+	} else {
+		/* overlapping match repeats the last offset bytes */
+		while (len--)
+			*out->pos++ = *match++;
+	}
+
+	return ret;
+}
+
+/* decode a single block, matches may refer to all the data decoded before */
+static int lz4_decode_block(const uint8_t *ip, size_t in_len, struct lz4_out *out)
+{
+	const uint8_t *iend = ip + in_len;
+	size_t len, offset;
+	uint8_t token;
+	int ret;
+
+	while (ip < iend) {
+		token = *ip++;
+
+		/* literals */
+		len = token >> 4;
+		if (len == 15) {
+			ret = lz4_read_len(&ip, iend, &len);
+			if (ret)
+				return ret;
+		}
+		if (len > (size_t)(iend - ip))
+			return ERR_NOT_VALID;
+
+		ret = lz4_copy(out, ip, len);
+		if (ret)
+			return ret;
+		ip += len;
+
+		/* the last sequence consists of literals only */
+		if (ip == iend)
+			break;
+
+		/* match */
+		if (iend - ip < 2)
+			return ERR_NOT_VALID;
+		offset = ip[0] | (ip[1] << 8);
+		ip += 2;
+		if (offset == 0 || offset > (size_t)(out->pos - out->start))
+			return ERR_NOT_VALID;
+
+		len = token & 15;
+		if (len == 15) {
+			ret = lz4_read_len(&ip, iend, &len);
+			if (ret)
+				return ret;
+		}
+
+		ret = lz4_copy_match(out, offset, len + LZ4_MIN_MATCH);
+		if (ret)
+			return ret;
+	}
+
+	return 0;
+}
+
+static int lz4_decode_frame(const uint8_t **ipp, const uint8_t *iend, struct lz4_out *out)
+{
+	const uint8_t *ip = *ipp + sizeof(uint32_t);
+	uint32_t block;
+	uint8_t flg;
+	int ret;
+
+	if (iend - ip < 3)
+		return ERR_NOT_VALID;
+
+	flg = ip[0];
+	if ((flg & LZ4_FLG_VERSION_MASK) != LZ4_FLG_VERSION)
+		return ERR_NOT_SUPPORTED;
+
+	/* FLG, BD, header checksum and optional content size and dict id */
+	ip += 3;
+	if (flg & LZ4_FLG_CONTENT_SIZE)
+		ip += 8;
+	if (flg & LZ4_FLG_DICT_ID)
+		ip += 4;
+
+	for (;;) {
+		if (iend - ip < 4)
+			return ERR_NOT_VALID;
+
+		block = get_le32(ip);
+		ip += 4;
+
+		/* end mark */
+		if (block == 0)
+			break;
+
+		if ((block & ~LZ4_BLOCK_UNCOMPRESSED) > (size_t)(iend - ip))
+			return ERR_NOT_VALID;
+
+		if (block & LZ4_BLOCK_UNCOMPRESSED) {
+			block &= ~LZ4_BLOCK_UNCOMPRESSED;
+			ret = lz4_copy(out, ip, block);
+		} else {
+			ret = lz4_decode_block(ip, block, out);
+		}
+		if (ret)
+			return ret;
+
+		ip += block;
+		if (flg & LZ4_FLG_BLOCK_CHECKSUM)
+			ip += 4;
+	}
+
+	if (flg & LZ4_FLG_CONTENT_CHECKSUM)
+		ip += 4;
+	if (ip > iend)
+		return ERR_NOT_VALID;
+
+	*ipp = ip;
+	return 0;
+}
+
+static int lz4_decode_legacy(const uint8_t **ipp, const uint8_t *iend, struct lz4_out *out)
+{
+	const uint8_t *ip = *ipp + sizeof(uint32_t);
+	uint32_t block;
+	int ret;
+
+	/*
+	 * The legacy format has no end mark, the stream ends with the input
+	 * or with something that can't be a block size (e.g. appended DTB).
+	 */
+	while (iend - ip >= 4) {
+		block = get_le32(ip);
+		if (block == LZ4_LEGACY_MAGIC || block > LZ4_LEGACY_BLOCK_BOUND)
+			break;
+
+		ip += 4;
+		if (block > (size_t)(iend - ip))
+			return ERR_NOT_VALID;
+
+		ret = lz4_decode_block(ip, block, out);
+		if (ret)
+			return ret;
+		ip += block;
+	}
+
+	*ipp = ip;
+	return 0;
+}
+
+bool lz4_is_compressed(const void *buf, size_t len)
+{
+	uint32_t magic;
+
+	if (!buf || len < sizeof(magic))
+		return false;
+
+	magic = get_le32(buf);
+	return magic == LZ4_FRAME_MAGIC || magic == LZ4_LEGACY_MAGIC;
+}
+
+int lz4_decompress(const void *in, size_t in_len, void *out_buf, size_t out_len,
+		   size_t *in_used, size_t *out_used)
+{
+	const uint8_t *ip = in, *iend = ip + in_len;
+	struct lz4_out out = {
+		.start = out_buf,
+		.pos = out_buf,
+		.end = (uint8_t *)out_buf + out_len,
+	};
+	uint32_t magic;
+	int ret = ERR_NOT_VALID;
+
+	/* frames may be concatenated */
+	while (iend - ip >= 4) {
+		magic = get_le32(ip);
+
+		if (magic == LZ4_FRAME_MAGIC) {
+			ret = lz4_decode_frame(&ip, iend, &out);
+		} else if (magic == LZ4_LEGACY_MAGIC) {
+			ret = lz4_decode_legacy(&ip, iend, &out);
+		} else if ((magic & LZ4_SKIPPABLE_MASK) == LZ4_SKIPPABLE_MAGIC &&
+			   iend - ip >= 8) {
+			ip += 8 + get_le32(ip + 4);
+			continue;
+		} else {
+			break;
+		}
+
+		if (ret)
+			break;
+	}
+
+	if (in_used)
+		*in_used = MIN((size_t)(ip - (const uint8_t *)in), in_len);
+	if (out_used)
+		*out_used = out.pos - out.start;
+
+	return ret;
+}
+
+int lz4_decompress_block(const void *in, size_t in_len, void *out_buf, size_t out_len,
+			 size_t *out_used)
+{
+	struct lz4_out out = {
+		.start = out_buf,
+		.pos = out_buf,
+		.end = (uint8_t *)out_buf + out_len,
+	};
+	int ret;
+
+	ret = lz4_decode_block(in, in_len, &out);
+	if (out_used)
+		*out_used = out.pos - out.start;
+
+	return ret;
+}
+
+/* Streaming decompression, see lz4_stream_init() */
+#define LZ4_STREAM_HISTORY	(64 * 1024)
+
+enum {
+	LZ4S_MAGIC,
+	LZ4S_SKIP_SIZE,
+	LZ4S_FRAME_HDR,
+	LZ4S_BLOCK_SIZE,
+	LZ4S_LEGACY_SIZE,
+	LZ4S_BLOCK,
+	LZ4S_SKIP,
+};
+
+static void lz4_stream_expect(struct lz4_stream *s, int state, size_t need)
+{
+	s->state = state;
+	s->need = need;
+	s->hdr_len = 0;
+}
+
+static void lz4_stream_skip(struct lz4_stream *s, size_t len, int next)
+{
+	if (!len) {
+		lz4_stream_expect(s, next, sizeof(uint32_t));
+		return;
+	}
+
+	s->state = LZ4S_SKIP;
+	s->need = len;
+	s->next = next;
+}
+
+static void lz4_stream_next_block(struct lz4_stream *s)
+{
+	if (s->legacy)
+		lz4_stream_expect(s, LZ4S_LEGACY_SIZE, sizeof(uint32_t));
+	else if (s->flg & LZ4_FLG_BLOCK_CHECKSUM)
+		lz4_stream_skip(s, sizeof(uint32_t), LZ4S_BLOCK_SIZE);
+	else
+		lz4_stream_expect(s, LZ4S_BLOCK_SIZE, sizeof(uint32_t));
+}
+
+static int lz4_stream_block(struct lz4_stream *s, const uint8_t *data)
+{
+	struct lz4_out out = {
+		.start = s->out - s->hist,
+		.pos = s->out,
+		.end = s->out + s->block_max,
+	};
+	size_t len, keep;
+	int ret;
+
+	if (s->uncompressed)
+		ret = lz4_copy(&out, data, s->block);
+	else
+		ret = lz4_decode_block(data, s->block, &out);
+	if (ret)
+		return ERR_NOT_VALID;
+
+	len = out.pos - s->out;
+	ret = s->write(s->priv, s->out, len);
+	if (ret)
+		return ret;
+
+	/* Linked blocks may refer to the last 64 KiB of the previous ones */
+	if (!s->legacy && !(s->flg & LZ4_FLG_BLOCK_INDEP)) {
+		keep = MIN(s->hist + len, (size_t)LZ4_STREAM_HISTORY);
+		memmove(s->out - keep, s->out + len - keep, keep);
+		s->hist = keep;
+	}
+
+	lz4_stream_next_block(s);
+	return 0;
+}
+
+/* Handle a complete header field collected in s->hdr */
+static int lz4_stream_header(struct lz4_stream *s)
+{
+	uint32_t val = get_le32(s->hdr);
+	size_t extra;
+	uint8_t bd;
+
+	switch (s->state) {
+	case LZ4S_MAGIC:
+		if (val == LZ4_FRAME_MAGIC) {
+			s->legacy = false;
+			lz4_stream_expect(s, LZ4S_FRAME_HDR, 2);
+		} else if (val == LZ4_LEGACY_MAGIC) {
+			s->legacy = true;
+			s->block_max = LZ4_LEGACY_BLOCK_SIZE;
+			s->hist = 0;
+			lz4_stream_expect(s, LZ4S_LEGACY_SIZE, sizeof(uint32_t));
+		} else if ((val & LZ4_SKIPPABLE_MASK) == LZ4_SKIPPABLE_MAGIC) {
+			lz4_stream_expect(s, LZ4S_SKIP_SIZE, sizeof(uint32_t));
+		} else {
+			return ERR_NOT_VALID;
+		}
+		s->frames++;
+		return 0;
+
+	case LZ4S_SKIP_SIZE:
+		s->frames--;
+		lz4_stream_skip(s, val, LZ4S_MAGIC);
+		return 0;
+
+	case LZ4S_FRAME_HDR:
+		s->flg = s->hdr[0];
+		if ((s->flg & LZ4_FLG_VERSION_MASK) != LZ4_FLG_VERSION)
+			return ERR_NOT_SUPPORTED;
+
+		/* 64 KiB, 256 KiB, 1 MiB or 4 MiB */
+		bd = (s->hdr[1] >> 4) & 0x7;
+		if (bd < 4)
+			return ERR_NOT_VALID;
+		s->block_max = 1 << (8 + 2 * bd);
+		s->hist = 0;
+
+		/* Header checksum and optional content size and dict id */
+		extra = 1;
+		if (s->flg & LZ4_FLG_CONTENT_SIZE)
+			extra += 8;
+		if (s->flg & LZ4_FLG_DICT_ID)
+			extra += 4;
+		lz4_stream_skip(s, extra, LZ4S_BLOCK_SIZE);
+		return 0;
+
+	case LZ4S_BLOCK_SIZE:
+		/* End mark */
+		if (val == 0) {
+			if (s->flg & LZ4_FLG_CONTENT_CHECKSUM)
+				lz4_stream_skip(s, sizeof(uint32_t), LZ4S_MAGIC);
+			else
+				lz4_stream_expect(s, LZ4S_MAGIC, sizeof(uint32_t));
+			return 0;
+		}
+
+		s->uncompressed = val & LZ4_BLOCK_UNCOMPRESSED;
+		s->block = val & ~LZ4_BLOCK_UNCOMPRESSED;
+		if (s->block > s->block_max)
+			return ERR_NOT_VALID;
+		break;
+
+	case LZ4S_LEGACY_SIZE:
+		if (val == LZ4_LEGACY_MAGIC) {
+			/* Concatenated legacy streams */
+			return 0;
+		}
+		if (val > LZ4_LEGACY_BLOCK_BOUND) {
+			/* The legacy stream has ended, this may be the next frame */
+			s->state = LZ4S_MAGIC;
+			return lz4_stream_header(s);
+		}
+
+		s->uncompressed = false;
+		s->block = val;
+		break;
+
+	default:
+		return ERR_NOT_VALID;
+	}
+
+	s->in_len = 0;
+	s->state = LZ4S_BLOCK;
+	if (!s->block)
+		lz4_stream_next_block(s);
+	return 0;
+}
+
+void lz4_stream_init(struct lz4_stream *s, void *work,
+		     int (*write)(void *priv, const void *buf, size_t len), void *priv)
+{
+	memset(s, 0, sizeof(*s));
+	s->write = write;
+	s->priv = priv;
+	s->in = work;
+	s->out = s->in + LZ4_LEGACY_BLOCK_BOUND + LZ4_STREAM_HISTORY;
+	lz4_stream_expect(s, LZ4S_MAGIC, sizeof(uint32_t));
+}
+
+int lz4_stream_decompress(struct lz4_stream *s, const void *in, size_t len)
+{
+	const uint8_t *ip = in;
+	size_t n;
+	int ret;
+
+	while (len) {
+		switch (s->state) {
+		case LZ4S_SKIP:
+			n = MIN(len, s->need);
+			s->need -= n;
+			if (!s->need)
+				lz4_stream_expect(s, s->next, sizeof(uint32_t));
+			break;
+
+		case LZ4S_BLOCK:
+			n = MIN(len, s->block - s->in_len);
+			if (!s->in_len && n == s->block) {
+				/* The whole block is there, no need to collect it */
+				ret = lz4_stream_block(s, ip);
+			} else {
+				memcpy(s->in + s->in_len, ip, n);
+				s->in_len += n;
+				ret = 0;
+				if (s->in_len == s->block)
+					ret = lz4_stream_block(s, s->in);
+			}
+			if (ret)
+				return ret;
+			break;
+
+		default:
+			n = MIN(len, s->need - s->hdr_len);
+			memcpy(s->hdr + s->hdr_len, ip, n);
+			s->hdr_len += n;
+			if (s->hdr_len == s->need) {
+				s->hdr_len = 0;
+				ret = lz4_stream_header(s);
+				if (ret)
+					return ret;
+			}
+			break;
+		}
+
+		ip += n;
+		len -= n;
+	}
+
+	return 0;
+}
+
+int lz4_stream_end(struct lz4_stream *s)
+{
+	if (!s->frames || s->hdr_len)
+		return ERR_NOT_VALID;
+
+	/* The legacy format has no end mark */
+	if (s->state == LZ4S_MAGIC || s->state == LZ4S_LEGACY_SIZE)
+		return 0;
+
+	return ERR_NOT_VALID;
+}
@@ -44,6 +44,35 @@ struct mbr_part {
 	uint32_t lba_length;
 } __PACKED;
 
+struct gpt_header {
+	uint8_t signature[8];
+	uint32_t revision;
+	uint32_t header_size;
+	uint32_t header_crc;
+	uint32_t reserved;
+	uint64_t my_lba;
+	uint64_t alternate_lba;
+	uint64_t first_usable_lba;
+	uint64_t last_usable_lba;
+	uint8_t disk_guid[16];
+	uint64_t entries_lba;
+	uint32_t num_entries;
+	uint32_t entry_size;
+	uint32_t entries_crc;
+} __PACKED;
+
+struct gpt_entry {
+	uint8_t type_guid[16];
+	uint8_t unique_guid[16];
+	uint64_t first_lba;
+	uint64_t last_lba;
+	uint64_t attributes;
+	uint16_t name[36];
+} __PACKED;
+
+#define MBR_TYPE_GPT_PROTECTIVE 0xee
+#define MAX_PARTITIONS 128
+
 static status_t validate_mbr_partition(bdev_t *dev, const struct mbr_part *part)
 {
 	/* check for invalid types */
@@ -64,6 +93,62 @@ static status_t validate_mbr_partition(bdev_t *dev, const struct mbr_part *part)
 	return 0;
 }
 
+static int gpt_publish(bdev_t *dev, const char *device, off_t offset, uint8_t *buf)
+{
+	static const uint8_t unused_guid[16];
+	struct gpt_header hdr;
+	struct gpt_entry entry;
+	uint32_t i, per_block;
+	int err, count = 0;
+
+	/* the header is in the block right after the protective MBR */
+	err = bio_read(dev, buf, offset + dev->block_size, dev->block_size);
+	if (err < 0)
+		return err;
+
+	memcpy(&hdr, buf, sizeof(hdr));
+	if (memcmp(hdr.signature, "EFI PART", sizeof(hdr.signature)) ||
+	    hdr.entry_size < sizeof(entry) || hdr.entry_size > dev->block_size ||
+	    dev->block_size % hdr.entry_size) {
+		dprintf(INFO, "gpt: invalid header\n");
+		return -1;
+	}
+
+	per_block = dev->block_size / hdr.entry_size;
+	for (i = 0; i < hdr.num_entries && i < MAX_PARTITIONS; i++) {
+		if (i % per_block == 0) {
+			err = bio_read(dev, buf, offset + (hdr.entries_lba + i / per_block) * dev->block_size,
+				       dev->block_size);
+			if (err < 0)
+				return err;
+		}
+
+		memcpy(&entry, buf + (i % per_block) * hdr.entry_size, sizeof(entry));
+		if (!memcmp(entry.type_guid, unused_guid, sizeof(unused_guid)))
+			continue;
+
+		dprintf(SPEW, "\tgpt %u: start 0x%llx, end 0x%llx\n", i, entry.first_lba, entry.last_lba);
+
+		/* make sure the range fits within the device */
+		if (entry.first_lba > entry.last_lba || entry.last_lba >= dev->block_count)
+			continue;
+
+		char subdevice[128];
+
+		sprintf(subdevice, "%sp%u", device, i);
+
+		err = bio_publish_subdevice(device, subdevice, entry.first_lba,
+					    entry.last_lba - entry.first_lba + 1);
+		if (err < 0) {
+			dprintf(INFO, "error publishing subdevice '%s'\n", subdevice);
+			continue;
+		}
+		count++;
+	}
+
+	return count;
+}
+
 int partition_publish(const char *device, off_t offset)
 {
 	int err = 0;
@@ -104,6 +189,18 @@ int partition_publish(const char *device, off_t offset)
 		}
 #endif
 
+		/* a protective MBR means the real partition table is a GPT */
+		for (i=0; i < 4; i++) {
+			if (part[i].type == MBR_TYPE_GPT_PROTECTIVE)
+				break;
+		}
+		if (i < 4) {
+			err = gpt_publish(dev, device, offset, buf);
+			if (err >= 0)
+				count = err;
+			break;
+		}
+
 		/* validate each of the partition entries */
 		for (i=0; i < 4; i++) {
 			if (validate_mbr_partition(dev, &part[i]) >= 0) {
@@ -136,7 +233,7 @@ int partition_unpublish(const char *device)
 	char devname[512];	
 
 	count = 0;
-	for (i=0; i < 16; i++) {
+	for (i=0; i < MAX_PARTITIONS; i++) {
 		sprintf(devname, "%sp%d", device, i);
 
 		dev = bio_open(devname);
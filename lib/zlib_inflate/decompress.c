@@ -53,11 +53,43 @@ static void zlib_free(voidpf qpaque, void *addr)
 	return free(addr);
 }
 
-static void *zlib_alloc(voidpf qpaque, uInt items, size_t size)
+static void *zlib_alloc(voidpf qpaque, uInt items, uInt size)
 {
 	return malloc(items * size);
 }
 
+static uint32_t gzip_get_le32(const unsigned char *p)
+{
+	return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+/*
+ * Check the CRC32 and ISIZE in the trailer of a member. crc32() is the
+ * platform implementation that does not invert the value before/after.
+ */
+static int gzip_verify(uint32_t crc, uint32_t isize, const unsigned char *trailer)
+{
+	if ((crc ^ ~0U) != gzip_get_le32(trailer)) {
+		dprintf(INFO, "gzip crc32 mismatch\n");
+		return -1;
+	}
+	if (isize != gzip_get_le32(trailer + 4)) {
+		dprintf(INFO, "gzip size mismatch\n");
+		return -1;
+	}
+	return 0;
+}
+
+static int gzip_check_trailer(const unsigned char *trailer, unsigned int avail,
+			      const unsigned char *out, unsigned int out_len)
+{
+	/* some callers only pass the start of the image, can't check then */
+	if (avail < 8)
+		return 0;
+
+	return gzip_verify(crc32(~0U, out, out_len), out_len, trailer);
+}
+
 /* decompress gzip file "in_buf", return 0 if decompressed successful,
  * return -1 if decompressed failed.
  * in_buf - input gzip file
@@ -98,7 +130,7 @@ int decompress(unsigned char *in_buf, unsigned int in_len,
 
 	/* skip over gzip header */
 	stream->next_in = in_buf + GZIP_HEADER_LEN;
-	stream->avail_in = out_buf_len - GZIP_HEADER_LEN;
+	stream->avail_in = in_len - GZIP_HEADER_LEN;
 	/* skip over asciz filename */
 	if (in_buf[3] & 0x8) {
 		for (i = 0; i < GZIP_FILENAME_LIMIT && *stream->next_in++; i++) {
@@ -119,7 +151,8 @@ int decompress(unsigned char *in_buf, unsigned int in_len,
 	rc = inflate(stream, 0);
 	/* Z_STREAM_END is "we unpacked it all" */
 	if (rc == Z_STREAM_END) {
-		rc = 0;
+		rc = gzip_check_trailer(stream->next_in, stream->avail_in,
+					out_buf, stream->total_out);
 	} else if (rc != Z_OK) {
 		dprintf(INFO, "uncompression error \n");
 		rc = -1;
@@ -151,3 +184,422 @@ int is_gzip_package(unsigned char *buf, unsigned int len)
 
 	return true;
 }
+
+/*
+ * Incremental gzip decompression
+ *
+ * Unlike decompress() the input may be supplied in arbitrarily sized chunks
+ * and the output buffer may be changed between calls, e.g. to inspect the
+ * first few bytes of the decompressed data before deciding where to place
+ * the rest of it. Usage is similar to zlib:
+ *
+ *   decompress_init(&strm);
+ *   set next_in/avail_in and next_out/avail_out
+ *   call decompress_feed(&strm) until it returns DECOMPRESS_STREAM_END,
+ *   refilling the input whenever avail_in drops to zero
+ *   decompress_finish(&strm);
+ *
+ * The CRC32 and size in the trailer of each member are verified. If another
+ * gzip member follows (e.g. concatenated .gz files) it is decompressed as
+ * well. Members that start after DECOMPRESS_STREAM_END was returned with
+ * avail_in == 0 are picked up by calling decompress_feed() again with more
+ * input. Anything else after a member is left unconsumed in next_in.
+ */
+
+#define GZIP_FHCRC	0x02
+#define GZIP_FEXTRA	0x04
+#define GZIP_FNAME	0x08
+#define GZIP_FCOMMENT	0x10
+
+enum gzip_hdr_state {
+	GZIP_HDR_FIXED,
+	GZIP_HDR_XLEN,
+	GZIP_HDR_EXTRA,
+	GZIP_HDR_NAME,
+	GZIP_HDR_COMMENT,
+	GZIP_HDR_HCRC,
+	GZIP_HDR_DONE,
+	GZIP_TRAILER,
+	GZIP_END,
+};
+
+struct decompress_state {
+	struct z_stream_s zs;
+	enum gzip_hdr_state hdr_state;
+	unsigned int hdr_pos;
+	unsigned int hdr_skip;
+	unsigned char flags;
+	unsigned char trailer[8];
+	uint32_t crc;
+};
+
+static bool gzip_state_needed(struct decompress_state *st, enum gzip_hdr_state state)
+{
+	switch (state) {
+	case GZIP_HDR_XLEN:
+		return st->flags & GZIP_FEXTRA;
+	case GZIP_HDR_EXTRA:
+		return (st->flags & GZIP_FEXTRA) && st->hdr_skip;
+	case GZIP_HDR_NAME:
+		return st->flags & GZIP_FNAME;
+	case GZIP_HDR_COMMENT:
+		return st->flags & GZIP_FCOMMENT;
+	case GZIP_HDR_HCRC:
+		return st->flags & GZIP_FHCRC;
+	default:
+		return true;
+	}
+}
+
+static void gzip_next_state(struct decompress_state *st)
+{
+	st->hdr_pos = 0;
+	do {
+		st->hdr_state++;
+	} while (!gzip_state_needed(st, st->hdr_state));
+}
+
+/* consume the gzip header or trailer, return 1 if more input is needed */
+static int gzip_parse_header(struct decompress_stream *strm, struct decompress_state *st)
+{
+	unsigned char c;
+
+	while (st->hdr_state != GZIP_HDR_DONE && st->hdr_state != GZIP_END) {
+		if (strm->avail_in == 0)
+			return 1;
+
+		c = *strm->next_in++;
+		strm->avail_in--;
+
+		switch (st->hdr_state) {
+		case GZIP_HDR_FIXED:
+			if ((st->hdr_pos == 0 && c != 0x1f) ||
+			    (st->hdr_pos == 1 && c != 0x8b) ||
+			    (st->hdr_pos == 2 && c != 0x08)) {
+				dprintf(INFO, "the input data is not a gzip package.\n");
+				return -1;
+			}
+			if (st->hdr_pos == 3)
+				st->flags = c;
+			if (++st->hdr_pos == GZIP_HEADER_LEN)
+				gzip_next_state(st);
+			break;
+		case GZIP_HDR_XLEN:
+			st->hdr_skip |= c << (8 * st->hdr_pos);
+			if (++st->hdr_pos == 2)
+				gzip_next_state(st);
+			break;
+		case GZIP_HDR_EXTRA:
+			if (--st->hdr_skip == 0)
+				gzip_next_state(st);
+			break;
+		case GZIP_HDR_NAME:
+		case GZIP_HDR_COMMENT:
+			if (c == 0) {
+				gzip_next_state(st);
+			} else if (++st->hdr_pos >= GZIP_FILENAME_LIMIT) {
+				dprintf(INFO, "header error\n");
+				return -1;
+			}
+			break;
+		case GZIP_HDR_HCRC:
+			if (++st->hdr_pos == 2)
+				gzip_next_state(st);
+			break;
+		case GZIP_TRAILER:
+			st->trailer[st->hdr_pos] = c;
+			if (++st->hdr_pos == sizeof(st->trailer)) {
+				if (gzip_verify(st->crc, st->zs.total_out, st->trailer))
+					return -1;
+				gzip_next_state(st);
+			}
+			break;
+		default:
+			break;
+		}
+	}
+
+	return 0;
+}
+
+int decompress_init(struct decompress_stream *strm)
+{
+	struct decompress_state *st;
+
+	st = calloc(1, sizeof(*st));
+	if (st == NULL) {
+		dprintf(INFO, "allocating z_stream failed.\n");
+		return -1;
+	}
+
+	st->zs.zalloc = zlib_alloc;
+	st->zs.zfree = zlib_free;
+
+	if (inflateInit2(&st->zs, -MAX_WBITS) != Z_OK) {
+		dprintf(INFO, "inflateInit2 failed!\n");
+		free(st);
+		return -1;
+	}
+
+	st->crc = ~0U;
+	strm->total_out = 0;
+	strm->priv = st;
+	return 0;
+}
+
+/* start over with the next member if there is one */
+static bool gzip_next_member(struct decompress_stream *strm, struct decompress_state *st)
+{
+	if (strm->avail_in == 0 || strm->next_in[0] != 0x1f)
+		return false;
+
+	inflateReset(&st->zs);
+	st->hdr_state = GZIP_HDR_FIXED;
+	st->hdr_pos = 0;
+	st->hdr_skip = 0;
+	st->crc = ~0U;
+	return true;
+}
+
+/* returns DECOMPRESS_STREAM_END when done, 0 if more input or output
+ * space is needed and a negative value on error.
+ */
+int decompress_feed(struct decompress_stream *strm)
+{
+	struct decompress_state *st = strm->priv;
+	unsigned int avail_out;
+	unsigned char *out;
+	int rc;
+
+	for (;;) {
+		if (st->hdr_state == GZIP_END && !gzip_next_member(strm, st))
+			return DECOMPRESS_STREAM_END;
+
+		rc = gzip_parse_header(strm, st);
+		if (rc)
+			return rc < 0 ? rc : 0;
+		if (st->hdr_state == GZIP_END)
+			continue;
+
+		out = strm->next_out;
+		avail_out = strm->avail_out;
+
+		st->zs.next_in = strm->next_in;
+		st->zs.avail_in = strm->avail_in;
+		st->zs.next_out = strm->next_out;
+		st->zs.avail_out = strm->avail_out;
+
+		rc = inflate(&st->zs, Z_NO_FLUSH);
+
+		strm->next_in = (unsigned char *)st->zs.next_in;
+		strm->avail_in = st->zs.avail_in;
+		strm->next_out = st->zs.next_out;
+		strm->avail_out = st->zs.avail_out;
+		strm->total_out += avail_out - strm->avail_out;
+		st->crc = crc32(st->crc, out, avail_out - strm->avail_out);
+
+		if (rc == Z_STREAM_END) {
+			gzip_next_state(st);
+			continue;
+		}
+		/* no progress possible, caller needs to provide more input or space */
+		if (rc == Z_BUF_ERROR)
+			return 0;
+		if (rc != Z_OK) {
+			dprintf(INFO, "uncompression error \n");
+			return -1;
+		}
+
+		return 0;
+	}
+}
+
+void decompress_finish(struct decompress_stream *strm)
+{
+	struct decompress_state *st = strm->priv;
+
+	if (!st)
+		return;
+
+	inflateEnd(&st->zs);
+	free(st);
+	strm->priv = NULL;
+}
+
+/*
+ * Indexed gzip files
+ *
+ * A file made of independently compressed gzip members whose first header
+ * has an FEXTRA subfield "LK" with an index: the number of members followed
+ * by the compressed and decompressed size of each member (all little endian
+ * 32 bit). Regular gzip tools just decompress the members one after the
+ * other, but the index allows decompressing them at the same time (see
+ * lk2nd/scripts/gzip-indexed.py).
+ *
+ * decompress_member() does not use the heap or any global state, so it can
+ * run on the secondary CPU cores. The CRC32 is checked separately with
+ * decompress_check_member().
+ */
+
+#define GZIP_INDEX_SI1	'L'
+#define GZIP_INDEX_SI2	'K'
+
+/* length of the gzip header, 0 if incomplete or invalid */
+static unsigned int gzip_header_len(const unsigned char *buf, unsigned int len)
+{
+	unsigned int pos = GZIP_HEADER_LEN;
+	unsigned char flags;
+
+	if (!is_gzip_package((unsigned char *)buf, len))
+		return 0;
+	flags = buf[3];
+
+	if (flags & GZIP_FEXTRA) {
+		if (pos + 2 > len)
+			return 0;
+		pos += 2 + (buf[pos] | (buf[pos + 1] << 8));
+	}
+	if (flags & GZIP_FNAME) {
+		while (pos < len && buf[pos])
+			pos++;
+		pos++;
+	}
+	if (flags & GZIP_FCOMMENT) {
+		while (pos < len && buf[pos])
+			pos++;
+		pos++;
+	}
+	if (flags & GZIP_FHCRC)
+		pos += 2;
+
+	return pos <= len ? pos : 0;
+}
+
+/* returns the number of members, 0 if there is no index or -1 if invalid */
+int decompress_get_index(const unsigned char *buf, unsigned int len,
+			 struct decompress_member **members)
+{
+	struct decompress_member *m;
+	const unsigned char *sub, *end;
+	unsigned int in_offset = 0, out_offset = 0;
+	unsigned int count, i, sublen;
+
+	*members = NULL;
+	if (!gzip_header_len(buf, len) || !(buf[3] & GZIP_FEXTRA))
+		return 0;
+
+	sub = buf + GZIP_HEADER_LEN + 2;
+	end = sub + (buf[GZIP_HEADER_LEN] | (buf[GZIP_HEADER_LEN + 1] << 8));
+	for (; sub + 4 <= end; sub += 4 + sublen) {
+		sublen = sub[2] | (sub[3] << 8);
+		if (sub[0] == GZIP_INDEX_SI1 && sub[1] == GZIP_INDEX_SI2)
+			break;
+	}
+	if (sub + 8 > end)
+		return 0;
+
+	count = gzip_get_le32(sub + 4);
+	if (!count || sublen != 4 + count * 8 || sub + 4 + sublen > end) {
+		dprintf(INFO, "invalid gzip index\n");
+		return -1;
+	}
+
+	m = malloc(count * sizeof(*m));
+	if (!m)
+		return -1;
+
+	for (i = 0; i < count; i++) {
+		m[i].in_offset = in_offset;
+		m[i].in_len = gzip_get_le32(sub + 8 + i * 8);
+		m[i].out_offset = out_offset;
+		m[i].out_len = gzip_get_le32(sub + 12 + i * 8);
+
+		if (m[i].in_len > len - in_offset ||
+		    m[i].out_len > ~0U - out_offset) {
+			dprintf(INFO, "invalid gzip index\n");
+			free(m);
+			return -1;
+		}
+		in_offset += m[i].in_len;
+		out_offset += m[i].out_len;
+	}
+
+	*members = m;
+	return count;
+}
+
+struct decompress_work {
+	unsigned char *next;
+	unsigned int left;
+	struct z_stream_s zs;
+	unsigned char mem[];
+};
+
+static voidpf work_alloc(voidpf opaque, uInt items, uInt size)
+{
+	struct decompress_work *w = opaque;
+	unsigned int n = (items * size + 7) & ~7;
+	void *p;
+
+	if (n > w->left)
+		return Z_NULL;
+
+	p = w->next;
+	w->next += n;
+	w->left -= n;
+	return p;
+}
+
+static void work_free(voidpf opaque, voidpf addr)
+{
+}
+
+/*
+ * decompress one complete member of in_len bytes into out, using work
+ * (DECOMPRESS_WORK_SIZE bytes, 8 byte aligned) instead of the heap.
+ * Returns 0 on success.
+ */
+int decompress_member(const unsigned char *in, unsigned int in_len,
+		      unsigned char *out, unsigned int out_len,
+		      void *work, unsigned int *out_used)
+{
+	struct decompress_work *w = work;
+	unsigned int hdr = gzip_header_len(in, in_len);
+	int rc;
+
+	*out_used = 0;
+	if (!hdr || in_len - hdr < 8)
+		return -1;
+
+	memset(w, 0, sizeof(*w));
+	w->next = w->mem;
+	w->left = DECOMPRESS_WORK_SIZE - sizeof(*w);
+	w->zs.zalloc = work_alloc;
+	w->zs.zfree = work_free;
+	w->zs.opaque = w;
+
+	if (inflateInit2(&w->zs, -MAX_WBITS) != Z_OK)
+		return -1;
+
+	/* everything is available, so the sliding window is never needed */
+	w->zs.next_in = (unsigned char *)in + hdr;
+	w->zs.avail_in = in_len - hdr - 8;
+	w->zs.next_out = out;
+	w->zs.avail_out = out_len;
+	rc = inflate(&w->zs, Z_FINISH);
+	*out_used = w->zs.total_out;
+	inflateEnd(&w->zs);
+
+	if (rc != Z_STREAM_END || w->zs.avail_in)
+		return -1;
+	if (gzip_get_le32(in + in_len - 4) != *out_used)
+		return -1;
+	return 0;
+}
+
+/* check the CRC32 of a member decompressed with decompress_member() */
+int decompress_check_member(const unsigned char *in, unsigned int in_len,
+			    const unsigned char *out, unsigned int out_len)
+{
+	return gzip_check_trailer(in + in_len - 8, 8, out, out_len);
+}
@@ -32,4 +32,38 @@
 int is_gzip_package(unsigned char *, unsigned int);
 
 int decompress(unsigned char *, unsigned int, unsigned char *, unsigned int, unsigned int *, unsigned int *);
+
+/* incremental gzip decompression, see decompress.c for details */
+#define DECOMPRESS_STREAM_END	1
+
+struct decompress_stream {
+	unsigned char *next_in;
+	unsigned int avail_in;
+	unsigned char *next_out;
+	unsigned int avail_out;
+	unsigned int total_out;
+	void *priv;
+};
+
+int decompress_init(struct decompress_stream *strm);
+int decompress_feed(struct decompress_stream *strm);
+void decompress_finish(struct decompress_stream *strm);
+
+/* independently decompressed members of indexed gzip files */
+#define DECOMPRESS_WORK_SIZE	(16 * 1024)
+
+struct decompress_member {
+	unsigned int in_offset;
+	unsigned int in_len;
+	unsigned int out_offset;
+	unsigned int out_len;
+};
+
+int decompress_get_index(const unsigned char *buf, unsigned int len,
+			 struct decompress_member **members);
+int decompress_member(const unsigned char *in, unsigned int in_len,
+		      unsigned char *out, unsigned int out_len,
+		      void *work, unsigned int *out_used);
+int decompress_check_member(const unsigned char *in, unsigned int in_len,
+			    const unsigned char *out, unsigned int out_len);
 #endif /* __PLATFORM_MSM_SHARED_DECOMPRESS_H */
@@ -12,6 +12,50 @@
 #  pragma message("Assembler code may have bugs -- use at your own risk")
 #else
 
+#if INFLATE_FAST_CHUNK
+/*
+   Faster variant for 32-bit ARM (lk2nd): the bit buffer is 64 bits wide and
+   refilled with one unaligned 32-bit load, so a length/distance pair needs
+   at most two refills instead of up to six byte loads. Matches are copied
+   in chunks of INFLATE_FAST_CHUNK_SIZE bytes, which may write up to
+   INFLATE_FAST_CHUNK_SIZE - 1 bytes past the end of the match. That is
+   fine because the output space check leaves room for it and the bytes are
+   overwritten by the following codes.
+ */
+typedef unsigned long long bitbuf_t;
+
+local inline unsigned load32(z_const unsigned char FAR *p) {
+    unsigned v;
+
+    __builtin_memcpy(&v, p, 4);
+    return v;   /* little endian only */
+}
+
+local inline unsigned char FAR *chunkcopy(unsigned char FAR *out,
+                                          const unsigned char FAR *from,
+                                          unsigned len) {
+    unsigned char FAR *end = out + len;
+
+    do {
+        __builtin_memcpy(out, from, INFLATE_FAST_CHUNK_SIZE);
+        out += INFLATE_FAST_CHUNK_SIZE;
+        from += INFLATE_FAST_CHUNK_SIZE;
+    } while (out < end);
+    return end;
+}
+
+#  define REFILL(need) \
+    do { \
+        if (bits < (need)) { \
+            hold += (bitbuf_t)load32(in) << bits; \
+            in += 4; \
+            bits += 32; \
+        } \
+    } while (0)
+#else
+typedef unsigned long bitbuf_t;
+#endif
+
 /*
    Decode literal, length, and distance codes and write out the resulting
    literal and match bytes until either not enough input or output is
@@ -61,7 +105,7 @@ void ZLIB_INTERNAL inflate_fast(z_streamp strm, unsigned start) {
     unsigned whave;             /* valid bytes in the window */
     unsigned wnext;             /* window write index */
     unsigned char FAR *window;  /* allocated sliding window, if wsize != 0 */
-    unsigned long hold;         /* local strm->hold */
+    bitbuf_t hold;              /* local strm->hold */
     unsigned bits;              /* local strm->bits */
     code const FAR *lcode;      /* local strm->lencode */
     code const FAR *dcode;      /* local strm->distcode */
@@ -77,10 +121,10 @@ void ZLIB_INTERNAL inflate_fast(z_streamp strm, unsigned start) {
     /* copy state to local variables */
     state = (struct inflate_state FAR *)strm->state;
     in = strm->next_in;
-    last = in + (strm->avail_in - 5);
+    last = in + (strm->avail_in - (INFLATE_FAST_MIN_INPUT - 1));
     out = strm->next_out;
     beg = out - (start - strm->avail_out);
-    end = out + (strm->avail_out - 257);
+    end = out + (strm->avail_out - (INFLATE_FAST_MIN_OUTPUT - 1));
 #ifdef INFLATE_STRICT
     dmax = state->dmax;
 #endif
@@ -98,12 +142,17 @@ void ZLIB_INTERNAL inflate_fast(z_streamp strm, unsigned start) {
     /* decode literals and length/distances until end-of-block or not enough
        input data or output space */
     do {
+#if INFLATE_FAST_CHUNK
+        /* enough for the length code and its extra bits */
+        REFILL(20);
+#else
         if (bits < 15) {
             hold += (unsigned long)(*in++) << bits;
             bits += 8;
             hold += (unsigned long)(*in++) << bits;
             bits += 8;
         }
+#endif
         here = lcode + (hold & lmask);
       dolen:
         op = (unsigned)(here->bits);
@@ -120,21 +169,28 @@ void ZLIB_INTERNAL inflate_fast(z_streamp strm, unsigned start) {
             len = (unsigned)(here->val);
             op &= 15;                           /* number of extra bits */
             if (op) {
+#if !INFLATE_FAST_CHUNK
                 if (bits < op) {
                     hold += (unsigned long)(*in++) << bits;
                     bits += 8;
                 }
+#endif
                 len += (unsigned)hold & ((1U << op) - 1);
                 hold >>= op;
                 bits -= op;
             }
             Tracevv((stderr, "inflate:         length %u\n", len));
+#if INFLATE_FAST_CHUNK
+            /* enough for the distance code and its extra bits */
+            REFILL(28);
+#else
             if (bits < 15) {
                 hold += (unsigned long)(*in++) << bits;
                 bits += 8;
                 hold += (unsigned long)(*in++) << bits;
                 bits += 8;
             }
+#endif
             here = dcode + (hold & dmask);
           dodist:
             op = (unsigned)(here->bits);
@@ -144,6 +200,7 @@ void ZLIB_INTERNAL inflate_fast(z_streamp strm, unsigned start) {
             if (op & 16) {                      /* distance base */
                 dist = (unsigned)(here->val);
                 op &= 15;                       /* number of extra bits */
+#if !INFLATE_FAST_CHUNK
                 if (bits < op) {
                     hold += (unsigned long)(*in++) << bits;
                     bits += 8;
@@ -152,6 +209,7 @@ void ZLIB_INTERNAL inflate_fast(z_streamp strm, unsigned start) {
                         bits += 8;
                     }
                 }
+#endif
                 dist += (unsigned)hold & ((1U << op) - 1);
 #ifdef INFLATE_STRICT
                 if (dist > dmax) {
@@ -245,6 +303,16 @@ void ZLIB_INTERNAL inflate_fast(z_streamp strm, unsigned start) {
                             *out++ = *from++;
                     }
                 }
+#if INFLATE_FAST_CHUNK
+                else if (dist >= INFLATE_FAST_CHUNK_SIZE) {
+                    /* the chunks never overlap */
+                    out = chunkcopy(out, out - dist, len);
+                }
+                else if (dist == 1) {           /* run of the same byte */
+                    memset(out, out[-1], len);
+                    out += len;
+                }
+#endif
                 else {
                     from = out - dist;          /* copy direct from output */
                     do {                        /* minimum length is three */
@@ -295,10 +363,13 @@ void ZLIB_INTERNAL inflate_fast(z_streamp strm, unsigned start) {
     /* update state and return */
     strm->next_in = in;
     strm->next_out = out;
-    strm->avail_in = (unsigned)(in < last ? 5 + (last - in) : 5 - (in - last));
+    strm->avail_in = (unsigned)(in < last ?
+                                (INFLATE_FAST_MIN_INPUT - 1) + (last - in) :
+                                (INFLATE_FAST_MIN_INPUT - 1) - (in - last));
     strm->avail_out = (unsigned)(out < end ?
-                                 257 + (end - out) : 257 - (out - end));
-    state->hold = hold;
+                                 (INFLATE_FAST_MIN_OUTPUT - 1) + (end - out) :
+                                 (INFLATE_FAST_MIN_OUTPUT - 1) - (out - end));
+    state->hold = (unsigned long)hold;
     state->bits = bits;
     return;
 }
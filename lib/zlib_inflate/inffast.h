@@ -8,4 +8,20 @@
    subject to change. Applications should only use zlib.h.
  */
 
+/*
+   inflate_fast() needs this much input and output space available. The
+   chunked version reads the input 4 bytes at a time (at most 8 bytes per
+   length/distance pair) and may write one chunk past the end of a match.
+ */
+#if INFLATE_FAST_CHUNK
+#  ifndef INFLATE_FAST_CHUNK_SIZE
+#    define INFLATE_FAST_CHUNK_SIZE 16
+#  endif
+#  define INFLATE_FAST_MIN_INPUT 8
+#  define INFLATE_FAST_MIN_OUTPUT (258 + INFLATE_FAST_CHUNK_SIZE - 1)
+#else
+#  define INFLATE_FAST_MIN_INPUT 6
+#  define INFLATE_FAST_MIN_OUTPUT 258
+#endif
+
 void ZLIB_INTERNAL inflate_fast(z_streamp strm, unsigned start);
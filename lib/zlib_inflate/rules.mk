@@ -8,3 +8,7 @@ OBJS += \
 	$(LOCAL_DIR)/inffast.o \
 	$(LOCAL_DIR)/uncompr.o \
 	$(LOCAL_DIR)/decompress.o
+
+# Wide bit buffer refills and chunked match copies in inflate_fast()
+INFLATE_FAST_CHUNK ?= 1
+DEFINES += INFLATE_FAST_CHUNK=$(INFLATE_FAST_CHUNK)
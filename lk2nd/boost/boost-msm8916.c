@@ -0,0 +1,77 @@
+// SPDX-License-Identifier: BSD-3-Clause
+
+#include <bits.h>
+#include <boot.h>
+#include <debug.h>
+#include <platform/iomap.h>
+#include <platform/timer.h>
+#include <reg.h>
+
+#include <lk2nd/init.h>
+
+/*
+ * boost-msm8916.c - Run the boot CPU cluster from GPLL0 (800 MHz) in lk2nd.
+ *
+ * The primary bootloader often leaves the CPU on a low rate, e.g. GPLL0/2.
+ * GPLL0 at 800 MHz is also the "safe" rate Linux switches the CPUs to while
+ * reprogramming the A53 PLL, so it works with the voltage set up at boot.
+ * The original configuration is restored before booting the next OS.
+ */
+
+#define RCGR_CMD_UPDATE		BIT(0)
+#define RCGR_CFG_SRC_DIV(cfg)	BITS_SHIFT(cfg, 4, 0)
+#define RCGR_CFG_SRC_SEL(cfg)	BITS_SHIFT(cfg, 10, 8)
+
+#define SRC_GPLL0		4
+#define SRC_DIV_1		1 /* 2 * div - 1 */
+
+static uint32_t saved_cfg;
+
+static void a53ssmux_set_cfg(uint32_t cfg)
+{
+	int timeout = 100;
+
+	writel(cfg, APCS_CFG_RCGR);
+	writel(RCGR_CMD_UPDATE, APCS_CMD_RCGR);
+	while (readl(APCS_CMD_RCGR) & RCGR_CMD_UPDATE) {
+		if (--timeout == 0) {
+			dprintf(CRITICAL, "boost: CPU clock switch timed out\n");
+			return;
+		}
+		udelay(1);
+	}
+}
+
+static void lk2nd_boost_init(void)
+{
+	uint32_t cfg = readl(APCS_CFG_RCGR);
+	uint32_t src = RCGR_CFG_SRC_SEL(cfg);
+
+	/*
+	 * Only remove the divider if the CPU already runs from GPLL0, so it is
+	 * known to be enabled. Anything else is probably the A53 PLL, which is
+	 * already faster.
+	 */
+	if (src != SRC_GPLL0 || RCGR_CFG_SRC_DIV(cfg) <= SRC_DIV_1) {
+		dprintf(INFO, "boost: Keeping CPU clock configuration %#x\n", cfg);
+		return;
+	}
+
+	dprintf(INFO, "boost: Switching CPU clock to GPLL0 (was %#x)\n", cfg);
+	saved_cfg = cfg;
+	a53ssmux_set_cfg(SRC_GPLL0 << 8 | SRC_DIV_1);
+}
+LK2ND_INIT_PRIO(lk2nd_boost_init, LK2ND_INIT_PRIO_EARLY);
+
+static int lk2nd_boost_restore(void *dtb, const char *cmdline,
+			       enum boot_type boot_type)
+{
+	if (!saved_cfg)
+		return 0;
+
+	dprintf(INFO, "boost: Restoring CPU clock configuration %#x\n", saved_cfg);
+	a53ssmux_set_cfg(saved_cfg);
+	saved_cfg = 0;
+	return 0;
+}
+DEV_TREE_UPDATE(lk2nd_boost_restore);
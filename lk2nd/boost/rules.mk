@@ -0,0 +1,4 @@
+# SPDX-License-Identifier: BSD-3-Clause
+LOCAL_DIR := $(GET_LOCAL_DIR)
+
+OBJS += $(patsubst %.c,%.o, $(wildcard $(LOCAL_DIR)/boost-$(PLATFORM).c))
@@ -2,6 +2,8 @@
 /* Copyright (c) 2023 Nikita Travkin <nikita@trvn.ru> */
 
 #include <debug.h>
+#include <err.h>
+#include <fastboot.h>
 #include <lib/bio.h>
 #include <lib/fs.h>
 #include <list.h>
@@ -9,7 +11,10 @@
 #include <target.h>
 
 #include <lk2nd/boot.h>
+#include <lk2nd/bootstats.h>
+#include <lk2nd/persist.h>
 #include <lk2nd/hw/bdev.h>
+#include <lk2nd/util/scratch.h>
 
 #include "boot.h"
 
@@ -17,22 +22,200 @@
 #define LK2ND_BOOT_MIN_SIZE (16 * 1024 * 1024)
 #endif
 
+/*
+ * The partition that was booted last time is remembered across reboots
+ * and tried first to avoid mounting all other partitions before it.
+ */
+struct boot_hint {
+	char name[16];
+	char label[40];
+	uint64_t size;
+};
+
+static void boot_hint_fill(struct boot_hint *hint, bdev_t *bdev)
+{
+	memset(hint, 0, sizeof(*hint));
+	strlcpy(hint->name, bdev->name, sizeof(hint->name));
+	if (bdev->label)
+		strlcpy(hint->label, bdev->label, sizeof(hint->label));
+	hint->size = bdev->size;
+}
+
+static bdev_t *boot_hint_find(struct bdev_struct *bdevs)
+{
+	struct boot_hint hint, cur;
+	bdev_t *bdev;
+
+	if (!lk2nd_persist_load(LK2ND_PERSIST_BOOT_HINT, &hint, sizeof(hint)))
+		return NULL;
+
+	list_for_every_entry(&bdevs->list, bdev, bdev_t, node) {
+		if (!bdev->is_leaf)
+			continue;
+
+		boot_hint_fill(&cur, bdev);
+		if (!memcmp(&hint, &cur, sizeof(hint)))
+			return bdev;
+	}
+
+	return NULL;
+}
+
+/*
+ * Every mounted file system keeps its caches allocated, so the partitions
+ * without a boot config are unmounted again right after they were scanned.
+ * Only the ones that are still needed (e.g. for fastboot commands or for
+ * retrying another label) are kept around.
+ */
+struct boot_mount {
+	struct list_node node;
+	char mountpoint[16];
+	bool keep;
+};
+
+static struct list_node boot_mounts = LIST_INITIAL_VALUE(boot_mounts);
+
+static struct boot_mount *boot_mount_find(const char *mountpoint)
+{
+	struct boot_mount *m;
+
+	list_for_every_entry(&boot_mounts, m, struct boot_mount, node)
+		if (!strcmp(m->mountpoint, mountpoint))
+			return m;
+
+	return NULL;
+}
+
+/**
+ * lk2nd_mount_bdev() - Mount the block device at /<name> unless it already is
+ */
+static int lk2nd_mount_bdev(bdev_t *bdev, char *mountpoint, size_t len)
+{
+	static const char * const fs_types[] = { "ext2", "squashfs", "fat" };
+	struct boot_mount *m;
+	const char *fs = NULL;
+	unsigned int i;
+	int ret, bs;
+
+	snprintf(mountpoint, len, "/%s", bdev->name);
+	if (boot_mount_find(mountpoint))
+		return 0;
+
+	for (i = 0; i < ARRAY_SIZE(fs_types); i++) {
+		if (fs_probe(fs_types[i], bdev->name) == 0) {
+			fs = fs_types[i];
+			break;
+		}
+	}
+	if (!fs)
+		return ERR_NOT_VALID;
+
+	bs = lk2nd_bootstats_start("mount %s", bdev->name);
+	ret = fs_mount(mountpoint, fs, bdev->name);
+	lk2nd_bootstats_end(bs);
+
+	/* Mounted by someone else (e.g. the shell), leave it alone */
+	if (ret == ERR_ALREADY_MOUNTED)
+		return 0;
+	if (ret < 0)
+		return ret;
+
+	m = calloc(1, sizeof(*m));
+	if (m) {
+		strlcpy(m->mountpoint, mountpoint, sizeof(m->mountpoint));
+		list_add_tail(&boot_mounts, &m->node);
+	}
+	return 0;
+}
+
+/**
+ * lk2nd_keep_bdev() - Keep the file system mounted for later use
+ */
+static void lk2nd_keep_bdev(const char *mountpoint)
+{
+	struct boot_mount *m = boot_mount_find(mountpoint);
+
+	if (m)
+		m->keep = true;
+}
+
+/**
+ * lk2nd_release_bdev() - Unmount the file system unless it should be kept
+ *
+ * This releases the caches of the file system. File systems that were not
+ * mounted by lk2nd_mount_bdev() are left alone.
+ */
+static void lk2nd_release_bdev(const char *mountpoint)
+{
+	struct boot_mount *m = boot_mount_find(mountpoint);
+
+	if (!m || m->keep)
+		return;
+
+	fs_unmount(m->mountpoint);
+	list_delete(&m->node);
+	free(m);
+}
+
+/**
+ * lk2nd_try_bdev() - Mount the block device and try to boot from it
+ */
+static void lk2nd_try_bdev(bdev_t *bdev)
+{
+	struct boot_hint hint;
+	char mountpoint[16];
+	int ret;
+
+	if (lk2nd_mount_bdev(bdev, mountpoint, sizeof(mountpoint)) < 0)
+		goto fail;
+
+	if (DEBUGLEVEL >= SPEW) {
+		dprintf(SPEW, "Scanning %s ...\n", bdev->name);
+		dprintf(SPEW, "%s\n", mountpoint);
+		lk2nd_print_file_tree(mountpoint, " ");
+	}
+
+	/* Booting doesn't return, so record the hint in advance */
+	boot_hint_fill(&hint, bdev);
+	lk2nd_persist_store(LK2ND_PERSIST_BOOT_HINT, &hint, sizeof(hint));
+
+	lk2nd_bootstats_source(bdev->name);
+	ret = lk2nd_try_extlinux(mountpoint);
+	lk2nd_bootstats_source("");
+
+	/* Keep the partition with the config for fastboot and retries */
+	if (ret == ERR_NOT_FOUND)
+		lk2nd_release_bdev(mountpoint);
+	else
+		lk2nd_keep_bdev(mountpoint);
+
+fail:
+	lk2nd_persist_clear(LK2ND_PERSIST_BOOT_HINT);
+}
+
 /**
  * lk2nd_scan_devices() - Scan filesystems and try to boot
  */
 static void lk2nd_scan_devices(void)
 {
 	struct bdev_struct *bdevs = bio_get_bdevs();
-	char mountpoint[16];
-	bdev_t *bdev;
-	int ret;
+	bdev_t *bdev, *hinted;
 
 	dprintf(INFO, "boot: Trying to boot from the file system...\n");
 
+	/* Skip mounting anything if the files of the last boot are unchanged */
+	lk2nd_boot_manifest();
+
+	hinted = boot_hint_find(bdevs);
+	if (hinted) {
+		dprintf(INFO, "boot: Trying %s first, it was booted last time\n", hinted->name);
+		lk2nd_try_bdev(hinted);
+	}
+
 	list_for_every_entry(&bdevs->list, bdev, bdev_t, node) {
 
 		/* Skip top level block devices. */
-		if (!bdev->is_leaf)
+		if (!bdev->is_leaf || bdev == hinted)
 			continue;
 
 		/*
@@ -46,23 +229,26 @@ static void lk2nd_scan_devices(void)
 		    !(bdev->label && !strncmp(bdev->label, "boot", strlen("boot"))))
 			continue;
 
-		snprintf(mountpoint, sizeof(mountpoint), "/%s", bdev->name);
-		ret = fs_mount(mountpoint, "ext2", bdev->name);
-		if (ret < 0)
-			continue;
-
-		if (DEBUGLEVEL >= SPEW) {
-			dprintf(SPEW, "Scanning %s ...\n", bdev->name);
-			dprintf(SPEW, "%s\n", mountpoint);
-			lk2nd_print_file_tree(mountpoint, " ");
-		}
-
-		lk2nd_try_extlinux(mountpoint);
+		lk2nd_try_bdev(bdev);
 	}
 
 	dprintf(INFO, "boot: Bootable file system not found. Reverting to android boot.\n");
 }
 
+static void lk2nd_boot_init(void)
+{
+	static bool init_done = false;
+	int bs;
+
+	if (init_done)
+		return;
+
+	bs = lk2nd_bootstats_start("lk2nd_bdev_init");
+	lk2nd_bdev_init();
+	lk2nd_bootstats_end(bs);
+	init_done = true;
+}
+
 /**
  * lk2nd_boot() - Try to boot the OS.
  *
@@ -72,12 +258,183 @@ static void lk2nd_scan_devices(void)
  */
 void lk2nd_boot(void)
 {
-	static bool init_done = false;
+	lk2nd_boot_init();
+	lk2nd_scan_devices();
+}
+
+static void fastboot_boot_prepare(void)
+{
+	fastboot_okay("");
+	fastboot_stop();
+}
+
+/* Split off the kernel command line given after " -- " */
+static char *fastboot_split_cmdline(char *args)
+{
+	char *cmdline = strstr(args, " -- ");
+
+	if (!cmdline)
+		return NULL;
 
-	if (!init_done) {
-		lk2nd_bdev_init();
-		init_done = true;
+	*cmdline = '\0';
+	return cmdline + strlen(" -- ");
+}
+
+static void cmd_oem_boot_label(const char *arg, void *data, unsigned sz)
+{
+	struct bdev_struct *bdevs;
+	char *args = strdup(arg);
+	char *cmdline = fastboot_split_cmdline(args);
+	char mountpoint[16];
+	bdev_t *bdev;
+	int ret = ERR_NOT_FOUND;
+
+	if (!*args) {
+		free(args);
+		fastboot_fail("missing label");
+		return;
 	}
 
-	lk2nd_scan_devices();
+	lk2nd_boot_init();
+	bdevs = bio_get_bdevs();
+
+	list_for_every_entry(&bdevs->list, bdev, bdev_t, node) {
+		if (!bdev->is_leaf)
+			continue;
+		if (lk2nd_mount_bdev(bdev, mountpoint, sizeof(mountpoint)) < 0)
+			continue;
+
+		ret = lk2nd_boot_extlinux(mountpoint, args, cmdline, fastboot_boot_prepare);
+		if (ret != ERR_NOT_FOUND) {
+			lk2nd_keep_bdev(mountpoint);
+			break;
+		}
+		lk2nd_release_bdev(mountpoint);
+	}
+
+	free(args);
+	fastboot_fail(ret == ERR_NOT_FOUND ? "label not found" : "failed to boot label");
+}
+FASTBOOT_REGISTER("oem boot-label", cmd_oem_boot_label);
+
+/* Mount the block device of a /<name>/... path in case it is not yet */
+static void fastboot_mount_path(const char *path)
+{
+	char name[16];
+	const char *end;
+	char mountpoint[16];
+	bdev_t *bdev;
+
+	if (!path || path[0] != '/')
+		return;
+
+	end = strchr(path + 1, '/');
+	if (!end || end - path > (int)sizeof(name))
+		return;
+	strlcpy(name, path + 1, end - path);
+
+	bdev = bio_open(name);
+	if (!bdev)
+		return;
+
+	if (lk2nd_mount_bdev(bdev, mountpoint, sizeof(mountpoint)) == 0)
+		lk2nd_keep_bdev(mountpoint);
+	bio_close(bdev);
+}
+
+static void cmd_oem_boot_file(const char *arg, void *data, unsigned sz)
+{
+	char *args = strdup(arg);
+	char *cmdline = fastboot_split_cmdline(args);
+	char *saveptr;
+	char *kernel = strtok_r(args, " ", &saveptr);
+	char *dtb = strtok_r(NULL, " ", &saveptr);
+	char *initramfs = strtok_r(NULL, " ", &saveptr);
+	int ret;
+
+	if (!kernel || !dtb) {
+		free(args);
+		fastboot_fail("missing kernel/dtb");
+		return;
+	}
+
+	lk2nd_boot_init();
+	fastboot_mount_path(kernel);
+	fastboot_mount_path(dtb);
+	fastboot_mount_path(initramfs);
+
+	ret = lk2nd_boot_files(kernel, dtb, initramfs, cmdline, fastboot_boot_prepare);
+
+	free(args);
+	fastboot_fail(ret == ERR_NOT_FOUND ? "file not found" : "failed to boot");
+}
+FASTBOOT_REGISTER("oem boot-file", cmd_oem_boot_file);
+
+/*
+ * "oem boot-staged" boots from an ext2, squashfs or FAT image with an
+ * extlinux.conf that was downloaded with "fastboot stage", like a PXE boot
+ * directory. The files are loaded straight from the download buffer to their
+ * load addresses, without an Android boot image in between.
+ */
+#define STAGED_BDEV		"fastboot"
+#define STAGED_MOUNTPOINT	"/" STAGED_BDEV
+
+static void cmd_oem_boot_staged(const char *arg, void *data, unsigned sz)
+{
+	static bool registered;
+	char *args = strdup(arg);
+	char *cmdline = fastboot_split_cmdline(args);
+	unsigned int scratch_size = target_get_max_flash_size();
+	char mountpoint[16];
+	struct boot_mount *m;
+	bdev_t *bdev;
+	int ret;
+
+	if (!sz) {
+		free(args);
+		fastboot_fail("nothing staged, use fastboot stage <image>");
+		return;
+	}
+
+	/* The rest of the scratch area is still needed to load the files */
+	if (!lk2nd_scratch_claim("staged", data, sz)) {
+		free(args);
+		fastboot_fail("staged image too large");
+		return;
+	}
+
+	lk2nd_boot_init();
+
+	/* The whole download buffer, the file system knows its own size */
+	if (!registered) {
+		create_membdev(STAGED_BDEV, data, scratch_size);
+		registered = true;
+	}
+
+	/* A different image may be staged than last time */
+	m = boot_mount_find(STAGED_MOUNTPOINT);
+	if (m) {
+		m->keep = false;
+		lk2nd_release_bdev(STAGED_MOUNTPOINT);
+	}
+
+	bdev = bio_open(STAGED_BDEV);
+	if (!bdev || lk2nd_mount_bdev(bdev, mountpoint, sizeof(mountpoint)) < 0) {
+		if (bdev)
+			bio_close(bdev);
+		lk2nd_scratch_release("staged", data);
+		free(args);
+		fastboot_fail("no ext2/squashfs/FAT image staged");
+		return;
+	}
+	bio_close(bdev);
+
+	ret = lk2nd_boot_extlinux(mountpoint, *args ? args : NULL, cmdline,
+				  fastboot_boot_prepare);
+	lk2nd_release_bdev(mountpoint);
+	lk2nd_scratch_release("staged", data);
+
+	free(args);
+	fastboot_fail(ret == ERR_NOT_FOUND ? "no extlinux.conf or label" : "failed to boot");
 }
+FASTBOOT_REGISTER("oem boot-staged", cmd_oem_boot_staged);
@@ -2,7 +2,10 @@
 #ifndef LK2ND_BOOT_BOOT_H
 #define LK2ND_BOOT_BOOT_H
 
+#include <err.h>
 #include <list.h>
+#include <stddef.h>
+#include <stdint.h>
 #include <string.h>
 
 #include <lk2nd/boot.h>
@@ -10,7 +13,60 @@
 /* util.c */
 void lk2nd_print_file_tree(char *root, char *prefix);
 
+/* layout.c */
+void lk2nd_layout_init(void *base);
+void lk2nd_layout_reserve_fdt(const void *fdt);
+void *lk2nd_layout_find(void *start, uint32_t size, uint32_t align, uint32_t *max_size);
+
+/* firmware.c */
+void lk2nd_boot_firmware_preload(void *fdt, size_t fdt_size, const char **regions,
+				 const char **paths, const char **names);
+
+/* cache.c */
+struct file_stat;
+#ifdef LK2ND_BOOT_CACHE
+void lk2nd_boot_cache_reset(void);
+int lk2nd_boot_cache_lookup(const char *path, const struct file_stat *stat,
+			    const void *head, size_t head_len, uint32_t *size);
+int lk2nd_boot_cache_read(int handle, void *buf, size_t len);
+void lk2nd_boot_cache_store(int handle, const void *data, uint32_t size);
+void lk2nd_boot_cache_commit(void);
+#else
+static inline void lk2nd_boot_cache_reset(void) { }
+static inline int lk2nd_boot_cache_lookup(const char *path, const struct file_stat *stat,
+					  const void *head, size_t head_len, uint32_t *size)
+{
+	*size = 0;
+	return ERR_NOT_SUPPORTED;
+}
+static inline int lk2nd_boot_cache_read(int handle, void *buf, size_t len)
+{
+	return ERR_NOT_SUPPORTED;
+}
+static inline void lk2nd_boot_cache_store(int handle, const void *data, uint32_t size) { }
+static inline void lk2nd_boot_cache_commit(void) { }
+#endif
+
+/* manifest.c */
+#ifdef LK2ND_BOOT_MANIFEST
+void lk2nd_boot_manifest(void);
+void lk2nd_boot_manifest_record(const char *conf, const char *kernel, const char *dtb,
+				const char **overlays, const char **initramfs,
+				const char *cmdline);
+#else
+static inline void lk2nd_boot_manifest(void) { }
+static inline void lk2nd_boot_manifest_record(const char *conf, const char *kernel,
+					      const char *dtb, const char **overlays,
+					      const char **initramfs, const char *cmdline) { }
+#endif
+
 /* extlinux.c */
-void lk2nd_try_extlinux(const char *mountpoint);
+int lk2nd_try_extlinux(const char *mountpoint);
+int lk2nd_boot_extlinux(const char *root, const char *name, const char *cmdline,
+			void (*prepare)(void));
+int lk2nd_boot_files(const char *kernel, const char *dtb, const char *initramfs,
+		     const char *cmdline, void (*prepare)(void));
+void lk2nd_boot_manifest_files(const char *kernel, const char *dtb, const char **overlays,
+			       const char **initramfs, const char *cmdline);
 
 #endif /* LK2ND_BOOT_BOOT_H */
@@ -0,0 +1,335 @@
+// SPDX-License-Identifier: BSD-3-Clause
+
+#include <arch/ops.h>
+#include <crc32.h>
+#include <debug.h>
+#include <err.h>
+#include <lib/bio.h>
+#include <lib/fs.h>
+#include <list.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <lk2nd/bootstats.h>
+
+#include "boot.h"
+
+/*
+ * cache.c - Keep decompressed boot files on a raw partition.
+ *
+ * Inflating a gzip kernel and initramfs takes much longer than reading the
+ * uncompressed data from eMMC. The decompressed files are written to the
+ * partition selected with LK2ND_BOOT_CACHE once, and later boots read them
+ * from there directly to their final location.
+ *
+ * Entries are identified by the path of the compressed file (including the
+ * mount point), its size and modification time, and a checksum of the first
+ * bytes of it. The partition starts with a header listing the entries, the
+ * data of each of them follows aligned to CACHE_ALIGN. Only the files of the
+ * label that was booted last are kept.
+ */
+
+#define CACHE_MAGIC		0x43324b4c /* LK2C */
+#define CACHE_VERSION		1
+#define CACHE_MAX_ENTRIES	8
+#define CACHE_ALIGN		4096
+
+struct cache_entry {
+	char path[112];
+	uint64_t src_size;
+	uint32_t src_mtime;
+	uint32_t src_crc;
+	uint64_t offset;
+	uint32_t size;
+	uint32_t reserved;
+};
+
+struct cache_hdr {
+	uint32_t magic;
+	uint32_t crc;		/* Of everything below */
+	uint32_t version;
+	uint32_t count;
+	struct cache_entry entries[CACHE_MAX_ENTRIES];
+};
+
+/* Files looked up during the current boot attempt */
+struct cache_pending {
+	struct cache_entry key;
+	const void *data;	/* Decompressed data to write, NULL for a hit */
+	bool hit;
+};
+
+static bdev_t *cache_dev;
+static bool cache_probed;
+static struct cache_hdr cache_hdr __ALIGNED(CACHE_LINE);
+static struct cache_pending pending[CACHE_MAX_ENTRIES];
+static unsigned int pending_count;
+
+static uint32_t cache_crc(const void *data, size_t size)
+{
+	return crc32(~0L, data, size) ^ ~0L;
+}
+
+static uint32_t cache_hdr_crc(const struct cache_hdr *hdr)
+{
+	return cache_crc(&hdr->version, sizeof(*hdr) - offsetof(struct cache_hdr, version));
+}
+
+static bdev_t *cache_find_dev(void)
+{
+	struct bdev_struct *bdevs = bio_get_bdevs();
+	bdev_t *bdev;
+
+	list_for_every_entry(&bdevs->list, bdev, bdev_t, node) {
+		if (bdev->label && !strcmp(bdev->label, LK2ND_BOOT_CACHE))
+			return bio_open(bdev->name);
+	}
+
+	return NULL;
+}
+
+/* Open the partition and read the header, once. */
+static bool cache_probe(void)
+{
+	ssize_t ret;
+
+	if (cache_probed)
+		return cache_dev;
+	cache_probed = true;
+
+	cache_dev = cache_find_dev();
+	if (!cache_dev) {
+		dprintf(INFO, "boot-cache: No partition with label %s\n", LK2ND_BOOT_CACHE);
+		return false;
+	}
+
+	if (cache_dev->block_size > CACHE_ALIGN || cache_dev->size <= CACHE_ALIGN) {
+		dprintf(INFO, "boot-cache: %s cannot be used\n", cache_dev->name);
+		goto err;
+	}
+
+	ret = bio_read(cache_dev, &cache_hdr, 0, sizeof(cache_hdr));
+	if (ret != sizeof(cache_hdr)) {
+		dprintf(INFO, "boot-cache: Failed to read the header: %ld\n", ret);
+		goto err;
+	}
+
+	if (cache_hdr.magic != CACHE_MAGIC || cache_hdr.version != CACHE_VERSION ||
+	    cache_hdr.count > CACHE_MAX_ENTRIES || cache_hdr.crc != cache_hdr_crc(&cache_hdr))
+		memset(&cache_hdr, 0, sizeof(cache_hdr));
+
+	return true;
+
+err:
+	bio_close(cache_dev);
+	cache_dev = NULL;
+	return false;
+}
+
+/**
+ * lk2nd_boot_cache_reset() - Forget the files looked up for a previous label.
+ */
+void lk2nd_boot_cache_reset(void)
+{
+	pending_count = 0;
+}
+
+/**
+ * lk2nd_boot_cache_lookup() - Look up the decompressed data of a file.
+ * @path:     Normalized path of the compressed file
+ * @stat:     File information of the compressed file
+ * @head:     First bytes of the compressed file
+ * @head_len: Length of @head
+ * @size:     Returns the size of the cached data, or 0 if there is none
+ *
+ * Returns: Handle for lk2nd_boot_cache_read() and lk2nd_boot_cache_store(),
+ * or negative error if the file cannot be cached.
+ */
+int lk2nd_boot_cache_lookup(const char *path, const struct file_stat *stat,
+			    const void *head, size_t head_len, uint32_t *size)
+{
+	struct cache_pending *p;
+	unsigned int i;
+
+	*size = 0;
+
+	/* Without a modification time changes of the file might go unnoticed */
+	if (!stat->mtime || strlen(path) >= sizeof(p->key.path))
+		return ERR_NOT_SUPPORTED;
+	if (pending_count == CACHE_MAX_ENTRIES || !cache_probe())
+		return ERR_NOT_SUPPORTED;
+
+	p = &pending[pending_count];
+	memset(p, 0, sizeof(*p));
+	strlcpy(p->key.path, path, sizeof(p->key.path));
+	p->key.src_size = stat->size;
+	p->key.src_mtime = stat->mtime;
+	p->key.src_crc = cache_crc(head, head_len);
+
+	for (i = 0; i < cache_hdr.count; i++) {
+		struct cache_entry *e = &cache_hdr.entries[i];
+
+		if (!strcmp(e->path, p->key.path) && e->src_size == p->key.src_size &&
+		    e->src_mtime == p->key.src_mtime && e->src_crc == p->key.src_crc) {
+			p->key.offset = e->offset;
+			p->key.size = e->size;
+			p->hit = true;
+			*size = e->size;
+			break;
+		}
+	}
+
+	return pending_count++;
+}
+
+/**
+ * lk2nd_boot_cache_read() - Read the start of the cached data.
+ * @handle: Handle from lk2nd_boot_cache_lookup() that found the data
+ * @buf:    Buffer for the data
+ * @len:    Number of bytes to read, at most the size of the cached data
+ *
+ * Returns: 0 on success or negative error.
+ */
+int lk2nd_boot_cache_read(int handle, void *buf, size_t len)
+{
+	struct cache_pending *p;
+	ssize_t ret;
+
+	if (handle < 0 || !pending[handle].hit || len > pending[handle].key.size)
+		return ERR_INVALID_ARGS;
+	p = &pending[handle];
+
+	ret = bio_read(cache_dev, buf, p->key.offset, len);
+	if (ret != (ssize_t)len) {
+		dprintf(INFO, "boot-cache: Failed to read %s: %ld\n", p->key.path, ret);
+		p->hit = false;
+		return ret < 0 ? ret : ERR_IO;
+	}
+
+	return 0;
+}
+
+/**
+ * lk2nd_boot_cache_store() - Remember decompressed data to be cached.
+ * @handle: Handle from lk2nd_boot_cache_lookup() (negative values are ignored)
+ * @data:   Decompressed data, must stay intact until lk2nd_boot_cache_commit()
+ * @size:   Size of the decompressed data
+ */
+void lk2nd_boot_cache_store(int handle, const void *data, uint32_t size)
+{
+	if (handle < 0 || pending[handle].hit)
+		return;
+
+	pending[handle].data = data;
+	pending[handle].key.size = size;
+}
+
+/* Find space for @size bytes in between the entries in @hdr. */
+static uint64_t cache_alloc(const struct cache_hdr *hdr, uint32_t size)
+{
+	uint64_t start = CACHE_ALIGN, end;
+	unsigned int i;
+	bool moved;
+
+	do {
+		moved = false;
+		end = start + ROUNDUP(size, CACHE_ALIGN);
+		for (i = 0; i < hdr->count; i++) {
+			const struct cache_entry *e = &hdr->entries[i];
+
+			if (start < e->offset + e->size && e->offset < end) {
+				start = ROUNDUP(e->offset + e->size, CACHE_ALIGN);
+				moved = true;
+			}
+		}
+	} while (moved);
+
+	if (end > (uint64_t)cache_dev->size)
+		return 0;
+	return start;
+}
+
+static bool cache_write_hdr(struct cache_hdr *hdr)
+{
+	ssize_t ret;
+
+	hdr->magic = CACHE_MAGIC;
+	hdr->version = CACHE_VERSION;
+	hdr->crc = cache_hdr_crc(hdr);
+
+	ret = bio_write(cache_dev, hdr, 0, sizeof(*hdr));
+	if (ret != sizeof(*hdr)) {
+		dprintf(INFO, "boot-cache: Failed to write the header: %ld\n", ret);
+		return false;
+	}
+	return true;
+}
+
+/**
+ * lk2nd_boot_cache_commit() - Write the files that were not cached yet.
+ *
+ * The header is first rewritten with only the entries that are still in use,
+ * so nothing refers to the data that is overwritten afterwards. The new
+ * entries are added once all their data has been written.
+ */
+void lk2nd_boot_cache_commit(void)
+{
+	unsigned int i, hits = 0;
+	bool added = false;
+	ssize_t ret;
+	int bs;
+
+	for (i = 0; i < pending_count; i++) {
+		if (pending[i].hit)
+			hits++;
+		if (pending[i].data)
+			added = true;
+	}
+	if (!added && hits == cache_hdr.count)
+		return;
+
+	bs = lk2nd_bootstats_start("write boot cache");
+
+	memset(&cache_hdr, 0, sizeof(cache_hdr));
+	for (i = 0; i < pending_count; i++)
+		if (pending[i].hit)
+			cache_hdr.entries[cache_hdr.count++] = pending[i].key;
+	if (!cache_write_hdr(&cache_hdr))
+		goto err;
+
+	for (i = 0; i < pending_count; i++) {
+		struct cache_pending *p = &pending[i];
+
+		if (!p->data)
+			continue;
+
+		p->key.offset = cache_alloc(&cache_hdr, p->key.size);
+		if (!p->key.offset) {
+			dprintf(INFO, "boot-cache: No space for %s (%u bytes)\n",
+				p->key.path, p->key.size);
+			continue;
+		}
+
+		dprintf(INFO, "boot-cache: Writing %s (%u bytes)\n", p->key.path, p->key.size);
+		ret = bio_write(cache_dev, p->data, p->key.offset, p->key.size);
+		if (ret != (ssize_t)p->key.size) {
+			dprintf(INFO, "boot-cache: Failed to write %s: %ld\n", p->key.path, ret);
+			goto err;
+		}
+
+		cache_hdr.entries[cache_hdr.count++] = p->key;
+		p->data = NULL;
+		p->hit = true;
+	}
+
+	if (cache_write_hdr(&cache_hdr))
+		goto out;
+
+err:
+	/* Make sure nothing refers to partially written data */
+	memset(&cache_hdr, 0, sizeof(cache_hdr));
+	pending_count = 0;
+out:
+	lk2nd_bootstats_end(bs);
+}
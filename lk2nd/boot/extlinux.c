@@ -1,9 +1,15 @@
 // SPDX-License-Identifier: BSD-3-Clause
 /* Copyright (c) 2023 Nikita Travkin <nikita@trvn.ru> */
 
+#include <arch/ops.h>
 #include <debug.h>
 #include <decompress.h>
+#include <kernel/event.h>
+#include <kernel/thread.h>
+#include <err.h>
+#include <lib/arena.h>
 #include <lib/fs.h>
+#include <lib/lz4.h>
 #include <libfdt.h>
 #include <platform.h>
 #include <platform/iomap.h>
@@ -12,32 +18,82 @@
 #include <stdlib.h>
 #include <target.h>
 
+#if WITH_LIB_LIBUFDT
+#include <ufdt_overlay.h>
+#endif
+
 #include "../../app/aboot/bootimg.h"
 
 #include <lk2nd/boot.h>
+#include <lk2nd/bootstats.h>
 #include <lk2nd/device.h>
+#include <lk2nd/device/menu.h>
+#include <lk2nd/persist.h>
+#include <lk2nd/smp-worker.h>
+#include <lk2nd/util/scratch.h>
 
 #include "boot.h"
 
+/*
+ * The parsed extlinux.conf is kept in the arena, so booting another label
+ * from the same file (e.g. an older kernel after the default one failed)
+ * does not need to read and parse it again. The arena is released when
+ * a different (or changed) file is parsed.
+ */
+#define CONF_ARENA_BLOCK_SIZE	4096
+static struct arena *conf_arena;
+
 struct label {
+	struct label *next;
 	const char *name;
+	const char *menu_label;
 	const char *kernel;
-	const char *initramfs;
+	const char **initramfs;
 	const char *dtb;
 	const char *dtbdir;
 	const char **dtboverlays;
+	const char **fw_regions;	/* /reserved-memory nodes for fwpreload */
+	const char **fw_paths;
+	const char **fw_names;		/* fwpreload paths as written */
 	const char *cmdline;
+	const char *conf;	/* extlinux.conf if it was booted by default */
+	bool expanded;
+	bool bootable;
 };
 
+struct extlinux_conf {
+	struct label *labels;
+	unsigned int labels_count;
+	const char *default_name;
+	struct label *menu_default;
+	const char *title;
+	unsigned int timeout;	/* in 1/10 s, 0 to boot without a menu */
+};
+
+/*
+ * The cached config is identified by the path of the file (which includes
+ * the mount point) together with the size and modification time of it.
+ */
+static struct {
+	char path[64];
+	off_t size;
+	uint32_t mtime;
+	struct extlinux_conf conf;
+	bool valid;
+} conf_cache;
+
 enum token {
 	CMD_LABEL,
 	CMD_DEFAULT,
+	CMD_TIMEOUT,
+	CMD_MENU,
 	CMD_KERNEL,
 	CMD_APPEND,
 	CMD_INITRD,
 	CMD_FDT,
 	CMD_FDTDIR,
 	CMD_FDTOVERLAY,
+	CMD_FWPRELOAD,
 	CMD_UNKNOWN,
 };
 
@@ -47,6 +103,8 @@ static const struct {
 } token_map[] = {
 	{"label",		CMD_LABEL},
 	{"default",		CMD_DEFAULT},
+	{"timeout",		CMD_TIMEOUT},
+	{"menu",		CMD_MENU},
 	{"kernel",		CMD_KERNEL},
 	{"linux",		CMD_KERNEL},
 	{"fdtdir",		CMD_FDTDIR},
@@ -57,6 +115,7 @@ static const struct {
 	{"devicetree-overlay",	CMD_FDTOVERLAY},
 	{"initrd",		CMD_INITRD},
 	{"append",		CMD_APPEND},
+	{"fwpreload",		CMD_FWPRELOAD},
 };
 
 static enum token cmd_to_tok(char *command)
@@ -175,148 +234,190 @@ static int parse_command(char **data, size_t *size, char **command, char **value
 }
 
 /**
- * count_lines() - Count the amount of lines in the string.
+ * split_list() - Split a value into a NULL terminated list.
+ * @arena: Arena for the allocations
+ * @value: Value to split, the separators are replaced with nulls
+ * @delim: Separator characters
+ *
+ * Returns: The list, or NULL if there is not enough memory.
  */
-static int count_lines(char *data, size_t size)
+static const char **split_list(struct arena *arena, char *value, const char *delim)
 {
-	int acc = 0;
-	size_t i;
+	const char **list;
+	char *item, *saveptr;
+	int cnt = 2;
+	char *c;
 
-	for (i = 0; i < size; ++i) {
-		if (data[i] == '\n')
-			acc++;
+	for (c = value; *c; c++)
+		if (strchr(delim, *c))
+			cnt++;
 
-		if (data[i] == '\0')
-			break;
+	list = arena_calloc(arena, cnt, sizeof(*list));
+	if (!list)
+		return NULL;
+
+	cnt = 0;
+	for (item = strtok_r(value, delim, &saveptr); item;
+	     item = strtok_r(NULL, delim, &saveptr))
+		list[cnt++] = item;
+
+	return list;
+}
+
+/**
+ * parse_menu() - Handle the "menu" commands.
+ * @conf:  Config that is being parsed
+ * @label: Label that is being parsed (or NULL)
+ * @value: Value of the command, e.g. "label Name"
+ *
+ * Only the "menu title", "menu label" and "menu default" commands are
+ * supported, everything else (colors, "menu hide", ...) is ignored.
+ */
+static void parse_menu(struct extlinux_conf *conf, struct label *label, char *value)
+{
+	char *arg = value + strcspn(value, " \t");
+
+	if (*arg) {
+		*arg++ = '\0';
+		arg += strspn(arg, " \t");
 	}
 
-	return acc;
+	if (!strcasecmp(value, "title"))
+		conf->title = arg;
+	else if (!strcasecmp(value, "label") && label)
+		label->menu_label = arg;
+	else if (!strcasecmp(value, "default") && label)
+		conf->menu_default = label;
 }
 
 /**
- * parse_conf() - Extract default label from extlinux.conf
+ * parse_conf() - Parse all labels from extlinux.conf
+ * @arena: Arena for the allocations
  * @data: File contents
  * @size: Length of the file
- * @label: structure to write strings to
+ * @conf: structure to write the labels to
  *
- * Find the default label in the file and extract strings from it.
- * This function may destroy the file by changing some newlines to nulls
- * as it may be implemented by pointing into the data buffer to return
- * the configuration strings.
+ * Parse the file in a single pass, adding a label to the list for each
+ * "label" command. This function may destroy the file by changing some
+ * newlines to nulls as it may be implemented by pointing into the data
+ * buffer to return the configuration strings.
  *
  * NOTE: The data buffer must be one byte longer than the actual data.
  *
  * Returns: 0 on success or negative error on parse failure.
  */
-static int parse_conf(char *data, size_t size, struct label *label)
+static int parse_conf(struct arena *arena, char *data, size_t size,
+		      struct extlinux_conf *conf)
 {
 	char *command = NULL, *value = NULL;
-	char *overlay, *saveptr;
-	int cnt = 0;
-	struct {
-		enum token cmd;
-		char *val;
-	} *commands;
-	int commands_count;
-	struct label *labels;
-	struct label *default_label = NULL;
-	const char *default_name = "";
-	int labels_count = 0;
-	int label_idx;
-	int i;
+	struct label **tail = &conf->labels;
+	struct label *label = NULL;
+	int timeout;
 
-	commands_count = count_lines(data, size);
-	commands = calloc(commands_count, sizeof(*commands));
+	memset(conf, 0, sizeof(*conf));
+	conf->default_name = "";
 
-	i = 0;
 	while (parse_command(&data, &size, &command, &value) == 0) {
-		if (i >= commands_count) {
-			dprintf(INFO, "Failed to parse the extlinux.conf\n");
-			free(commands);
-			return -1;
+		enum token cmd = cmd_to_tok(command);
+
+		switch (cmd) {
+		case CMD_DEFAULT:
+			conf->default_name = value;
+			continue;
+		case CMD_TIMEOUT:
+			timeout = atoi(value);
+			conf->timeout = timeout > 0 ? timeout : 0;
+			continue;
+		case CMD_MENU:
+			parse_menu(conf, label, value);
+			continue;
+		case CMD_LABEL:
+			label = arena_calloc(arena, 1, sizeof(*label));
+			if (!label)
+				return ERR_NO_MEMORY;
+			label->name = value;
+			*tail = label;
+			tail = &label->next;
+			conf->labels_count++;
+			continue;
+		default:
+			break;
 		}
 
-		commands[i].cmd = cmd_to_tok(command);
-		commands[i].val = value;
-		i++;
-	}
-
-	commands_count = i;
+		/* Everything else belongs to a label */
+		if (!label)
+			continue;
 
-	i = 0;
-	for (i = 0; i < commands_count; ++i) {
-		if (commands[i].cmd == CMD_LABEL)
-			labels_count++;
+		switch (cmd) {
+		case CMD_KERNEL:
+			label->kernel = value;
+			break;
+		case CMD_INITRD:
+			label->initramfs = split_list(arena, value, ",");
+			if (!label->initramfs)
+				return ERR_NO_MEMORY;
+			break;
+		case CMD_APPEND:
+			label->cmdline = value;
+			break;
+		case CMD_FDT:
+			label->dtb = value;
+			break;
+		case CMD_FDTDIR:
+			label->dtbdir = value;
+			break;
+		case CMD_FDTOVERLAY:
+			label->dtboverlays = split_list(arena, value, " ");
+			if (!label->dtboverlays)
+				return ERR_NO_MEMORY;
+			break;
+		case CMD_FWPRELOAD:
+			label->fw_names = split_list(arena, value, " ");
+			if (!label->fw_names)
+				return ERR_NO_MEMORY;
+			break;
+		default:
+			break;
+		}
 	}
 
-	if (labels_count == 0) {
+	if (!conf->labels) {
 		dprintf(INFO, "No labels in the extlinux.conf\n");
-		free(commands);
 		return -1;
 	}
 
-	labels = calloc(labels_count, sizeof(*labels));
+	return 0;
+}
 
-	label_idx = -1;
-	for (i = 0; i < commands_count; ++i) {
-		if (commands[i].cmd == CMD_DEFAULT) {
-			default_name = commands[i].val;
-		} else if (commands[i].cmd == CMD_LABEL) {
-			label_idx++;
-			labels[label_idx].name = commands[i].val;
-		} else if (label_idx >= 0 && label_idx < labels_count) {
-			switch (commands[i].cmd) {
-			case CMD_KERNEL:
-				labels[label_idx].kernel = commands[i].val;
-				break;
-			case CMD_INITRD:
-				labels[label_idx].initramfs = commands[i].val;
-				break;
-			case CMD_APPEND:
-				labels[label_idx].cmdline = commands[i].val;
-				break;
-			case CMD_FDT:
-				labels[label_idx].dtb = commands[i].val;
-				break;
-			case CMD_FDTDIR:
-				labels[label_idx].dtbdir = commands[i].val;
-				break;
-			case CMD_FDTOVERLAY:
-				for (char *c = commands[i].val; *c; c++)
-					if (*c == ' ')
-						cnt++;
-
-				cnt += 2;
-
-				labels[label_idx].dtboverlays = calloc(cnt, sizeof(*labels[label_idx].dtboverlays));
-				cnt = 0;
-				for (overlay = strtok_r(commands[i].val, " ", &saveptr); overlay;
-				     overlay = strtok_r(NULL,  " ", &saveptr)) {
-					labels[label_idx].dtboverlays[cnt] = overlay;
-					cnt++;
-				}
-				break;
-			default:
-				break;
-			}
-		}
-	}
+static struct label *find_label(struct extlinux_conf *conf, const char *name)
+{
+	struct label *label;
 
-	default_label = &labels[0];
+	for (label = conf->labels; label; label = label->next)
+		if (!strcmp(name, label->name))
+			return label;
 
-	for (i = 0; i < labels_count; ++i) {
-		if (!strcmp(default_name, labels[i].name)) {
-			default_label = &labels[i];
-			break;
-		}
-	}
+	return NULL;
+}
+
+/**
+ * default_label() - Get the label to boot if nothing else is requested.
+ *
+ * This is the label marked with "menu default", or else the one named by
+ * the "default" command, or else the first label in the file.
+ */
+static struct label *default_label(struct extlinux_conf *conf)
+{
+	struct label *label;
 
-	memcpy(label, default_label, sizeof(*label));
+	if (conf->menu_default)
+		return conf->menu_default;
 
-	free(labels);
-	free(commands);
+	label = find_label(conf, conf->default_name);
+	if (label)
+		return label;
 
-	return 0;
+	return conf->labels;
 }
 
 static bool fs_file_exists(const char *file)
@@ -335,6 +436,20 @@ static bool fs_file_exists(const char *file)
 	return true;
 }
 
+static int fs_stat_path(const char *path, struct file_stat *stat)
+{
+	struct filehandle *fileh;
+	int ret;
+
+	ret = fs_open_file(path, &fileh);
+	if (ret < 0)
+		return ret;
+
+	ret = fs_stat_file(fileh, stat);
+	fs_close_file(fileh);
+	return ret;
+}
+
 /**
  * normalize_path() - Normalize path against given root.
  *
@@ -342,10 +457,10 @@ static bool fs_file_exists(const char *file)
  * the lk "vfs" path; prepending /extlinux/ if the path is
  * relative.
  *
- * Returns: Newly allocated copy of the string with normalized
- * path.
+ * Returns: Copy of the string with normalized path, allocated
+ * from the arena.
  */
-static char *normalize_path(const char *path, const char *root)
+static char *normalize_path(struct arena *arena, const char *path, const char *root)
 {
 	char tmp[256];
 
@@ -354,7 +469,170 @@ static char *normalize_path(const char *path, const char *root)
 	else
 		snprintf(tmp, sizeof(tmp), "%s/extlinux/%s", root, path);
 
-	return strndup(tmp, sizeof(tmp));
+	return arena_strndup(arena, tmp, sizeof(tmp));
+}
+
+/**
+ * expand_firmware() - Split the "fwpreload" entries into region and path.
+ *
+ * Entries are written as <region>:<path>. Invalid entries and missing files
+ * are left out, Linux then loads the firmware itself.
+ *
+ * Returns: false if there is not enough memory.
+ */
+static bool expand_firmware(struct arena *arena, struct label *label, const char *root)
+{
+	const char **names = label->fw_names;
+	unsigned int i, n = 0;
+	char *sep;
+
+	for (i = 0; names[i]; i++)
+		;
+
+	label->fw_regions = arena_calloc(arena, i + 1, sizeof(*label->fw_regions));
+	label->fw_paths = arena_calloc(arena, i + 1, sizeof(*label->fw_paths));
+	if (!label->fw_regions || !label->fw_paths)
+		return false;
+
+	for (i = 0; names[i]; i++) {
+		sep = strchr(names[i], ':');
+		if (!sep || sep == names[i] || !sep[1]) {
+			dprintf(INFO, "Invalid fwpreload entry %s\n", names[i]);
+			continue;
+		}
+
+		*sep = '\0';
+		label->fw_paths[n] = normalize_path(arena, sep + 1, root);
+		if (!label->fw_paths[n])
+			return false;
+		if (!fs_file_exists(label->fw_paths[n])) {
+			dprintf(INFO, "Firmware %s does not exist\n", label->fw_paths[n]);
+			continue;
+		}
+
+		label->fw_regions[n] = names[i];
+		names[n++] = sep + 1;
+	}
+	names[n] = NULL;
+	label->fw_regions[n] = NULL;
+	label->fw_paths[n] = NULL;
+
+	return true;
+}
+
+/*
+ * Places of the DTBs in "fdtdir", in order of preference for the same hint.
+ * The path is <fdtdir>/<dir><prefix><hint>.dtb.
+ */
+static const struct {
+	const char *dir;
+	const char *prefix;
+} dtb_patterns[] = {
+	{ "qcom/", "" },	/* arm64 style path */
+	{ "", "qcom-" },	/* arm32 style path */
+	{ "", "" },		/* boot-deploy drops the vendor dir when copying dtbs */
+};
+
+/*
+ * The DTB chosen last time is remembered across reboots and tried first,
+ * before reading the directories again.
+ */
+struct dtb_hint {
+	uint32_t pattern;
+	char hint[92];
+};
+
+static char *dtb_path(struct arena *arena, const char *dtbdir, const char *root,
+		      unsigned int pattern, const char *hint)
+{
+	char dtb[128];
+
+	snprintf(dtb, sizeof(dtb), "%s/%s%s%s.dtb", dtbdir, dtb_patterns[pattern].dir,
+		 dtb_patterns[pattern].prefix, hint);
+	return normalize_path(arena, dtb, root);
+}
+
+static bool dtb_name_matches(const char *name, const char *prefix, const char *hint)
+{
+	size_t plen = strlen(prefix), hlen = strlen(hint);
+
+	return !strncmp(name, prefix, plen) && !strncmp(name + plen, hint, hlen) &&
+	       !strcmp(name + plen + hlen, ".dtb");
+}
+
+/*
+ * Match all entries of <fdtdir>/<dir> against the hints in memory. *best is
+ * hint * ARRAY_SIZE(dtb_patterns) + pattern of the best match so far.
+ */
+static void dtb_scan_dir(struct arena *arena, const char *dtbdir, const char *root,
+			 const char *dir, const char *const *dtbfiles, unsigned int *best)
+{
+	char path[128];
+	struct dirhandle *dirh;
+	struct dirent ent;
+	unsigned int i, p, n;
+
+	snprintf(path, sizeof(path), "%s/%s", dtbdir, dir);
+	if (fs_open_dir(normalize_path(arena, path, root), &dirh) < 0)
+		return;
+
+	while (*best && fs_read_dir(dirh, &ent) >= 0) {
+		for (i = 0; dtbfiles[i]; i++) {
+			for (p = 0; p < ARRAY_SIZE(dtb_patterns); p++) {
+				n = i * ARRAY_SIZE(dtb_patterns) + p;
+				if (n >= *best)
+					break;
+				if (!strcmp(dtb_patterns[p].dir, dir) &&
+				    dtb_name_matches(ent.name, dtb_patterns[p].prefix, dtbfiles[i]))
+					*best = n;
+			}
+		}
+	}
+	fs_close_dir(dirh);
+}
+
+/**
+ * find_dtb() - Find the DTB for this device in "fdtdir".
+ *
+ * Instead of trying to open all possible paths for each of the dtb hints of
+ * the device, the two directories are read once and the entries are matched
+ * against all of them. The first hint (and the first pattern for it) wins.
+ *
+ * Returns: Normalized path of the DTB allocated from the arena, or NULL.
+ */
+static char *find_dtb(struct arena *arena, const char *dtbdir, const char *root,
+		      const char *const *dtbfiles)
+{
+	const unsigned int none = UINT_MAX;
+	unsigned int i, best = none;
+	struct dtb_hint hint;
+	char *dtb;
+
+	if (lk2nd_persist_load(LK2ND_PERSIST_DTB_HINT, &hint, sizeof(hint)) &&
+	    hint.pattern < ARRAY_SIZE(dtb_patterns)) {
+		for (i = 0; dtbfiles[i]; i++) {
+			if (strncmp(dtbfiles[i], hint.hint, sizeof(hint.hint)))
+				continue;
+
+			dtb = dtb_path(arena, dtbdir, root, hint.pattern, dtbfiles[i]);
+			if (fs_file_exists(dtb))
+				return dtb;
+			break;
+		}
+	}
+
+	dtb_scan_dir(arena, dtbdir, root, "qcom/", dtbfiles, &best);
+	dtb_scan_dir(arena, dtbdir, root, "", dtbfiles, &best);
+	if (best == none)
+		return NULL;
+
+	i = best / ARRAY_SIZE(dtb_patterns);
+	memset(&hint, 0, sizeof(hint));
+	hint.pattern = best % ARRAY_SIZE(dtb_patterns);
+	strlcpy(hint.hint, dtbfiles[i], sizeof(hint.hint));
+	lk2nd_persist_store(LK2ND_PERSIST_DTB_HINT, &hint, sizeof(hint));
+
+	return dtb_path(arena, dtbdir, root, hint.pattern, dtbfiles[i]);
 }
 
 /**
@@ -363,11 +641,12 @@ static char *normalize_path(const char *path, const char *root)
  * This function checks if all the values in the config are sane,
  * all mentioned files exists. It then appends the paths with the
  * root directory and rewrites the dtb field based on dtbdir if
- * possible. This function allocates new strings for all values.
+ * possible. This function allocates new strings for all paths
+ * from the arena.
  *
  * Returns: True if the config seems bootable, false otherwise.
  */
-static bool expand_conf(struct label *label, const char *root)
+static bool expand_conf(struct arena *arena, struct label *label, const char *root)
 {
 	const char *const *dtbfiles = lk2nd_device_get_dtb_hints();
 	int i = 0;
@@ -378,7 +657,7 @@ static bool expand_conf(struct label *label, const char *root)
 		return false;
 	}
 
-	label->kernel = normalize_path(label->kernel, root);
+	label->kernel = normalize_path(arena, label->kernel, root);
 
 	if (!fs_file_exists(label->kernel)) {
 		dprintf(INFO, "Kernel %s does not exist\n", label->kernel);
@@ -397,41 +676,13 @@ static bool expand_conf(struct label *label, const char *root)
 			return false;
 		}
 
-		while (dtbfiles[i]) {
-			char dtb[128];
-			char *normalized = NULL;
-
-			/* Try arm64 style path. */
-			snprintf(dtb, sizeof(dtb), "%s/qcom/%s.dtb", label->dtbdir, dtbfiles[i]);
-			normalized = normalize_path(dtb, root);
-			if (fs_file_exists(normalized)) {
-				label->dtb = normalized;
-				break;
-			}
-			free(normalized);
-
-			/* Try arm32 style path. */
-			snprintf(dtb, sizeof(dtb), "%s/qcom-%s.dtb", label->dtbdir, dtbfiles[i]);
-			normalized = normalize_path(dtb, root);
-			if (fs_file_exists(normalized)) {
-				label->dtb = normalized;
-				break;
-			}
-			free(normalized);
-
-			/* boot-deploy drops the vendor dir when copying dtbs. */
-			snprintf(dtb, sizeof(dtb), "%s/%s.dtb", label->dtbdir, dtbfiles[i]);
-			normalized = normalize_path(dtb, root);
-			if (fs_file_exists(normalized)) {
-				label->dtb = normalized;
-				break;
-			}
-			free(normalized);
-
-			i++;
+		label->dtb = find_dtb(arena, label->dtbdir, root, dtbfiles);
+		if (!label->dtb) {
+			dprintf(INFO, "No dtb for this device found in %s\n", label->dtbdir);
+			return false;
 		}
 	} else {
-		label->dtb = normalize_path(label->dtb, root);
+		label->dtb = normalize_path(arena, label->dtb, root);
 	}
 
 	if (!fs_file_exists(label->dtb)) {
@@ -442,7 +693,7 @@ static bool expand_conf(struct label *label, const char *root)
 	if (label->dtboverlays) {
 		i = 0;
 		while (label->dtboverlays[i]) {
-			label->dtboverlays[i] = normalize_path(label->dtboverlays[i], root);
+			label->dtboverlays[i] = normalize_path(arena, label->dtboverlays[i], root);
 			if (!fs_file_exists(label->dtboverlays[i])) {
 				dprintf(INFO, "FDT overlay %s does not exist\n", label->dtboverlays[i]);
 				return false;
@@ -453,17 +704,22 @@ static bool expand_conf(struct label *label, const char *root)
 	}
 
 	if (label->initramfs) {
-		label->initramfs = normalize_path(label->initramfs, root);
+		i = 0;
+		while (label->initramfs[i]) {
+			label->initramfs[i] = normalize_path(arena, label->initramfs[i], root);
+			if (!fs_file_exists(label->initramfs[i])) {
+				dprintf(INFO, "Initramfs %s does not exist\n", label->initramfs[i]);
+				return false;
+			}
 
-		if (!fs_file_exists(label->initramfs)) {
-			dprintf(INFO, "Initramfs %s does not exist\n", label->initramfs);
-			return false;
+			i++;
 		}
 	}
 
-	if (label->cmdline)
-		label->cmdline = strdup(label->cmdline);
-	else
+	if (label->fw_names && !expand_firmware(arena, label, root))
+		return false;
+
+	if (!label->cmdline)
 		label->cmdline = "";
 
 	return true;
@@ -476,9 +732,10 @@ extern void boot_linux(void *kernel, unsigned *tags,
 
 #define IS_ARM64(ptr) (ptr->magic_64 == KERNEL64_HDR_MAGIC)
 
+/* Used when the kernel doesn't tell how much memory it needs */
 #define MAX_KERNEL_SIZE			(32 * 1024 * 1024)
 #define MAX_TAGS_SIZE			(2 * 1024 * 1024)
-#define MAX_RAMDISK_SIZE		(16 * 1024 * 1024)
+#define LOAD_ALIGN			4096
 
 struct load_addrs {
 	void *kernel;
@@ -488,21 +745,18 @@ struct load_addrs {
 	uint32_t ramdisk_max_size;
 };
 
-static void choose_addrs(const struct kernel64_hdr *kptr, struct load_addrs *addrs)
+static void *ram_base(void)
 {
-	uint32_t kernel_offset;
-	void *base;
-
 #ifdef DDR_START
-	base = (void *)(uintptr_t)DDR_START;
+	return (void *)(uintptr_t)DDR_START;
 #else
-	base = (void *)(uintptr_t)BASE_ADDR;
+	return (void *)(uintptr_t)BASE_ADDR;
 #endif
+}
 
-	/* FIXME: Find a better approach to allow larger ramdisks */
-	addrs->tags = base + MAX_KERNEL_SIZE;
-	addrs->ramdisk = addrs->tags + MAX_TAGS_SIZE;
-	addrs->ramdisk_max_size = MAX_RAMDISK_SIZE;
+static void choose_addrs(const struct kernel64_hdr *kptr, struct load_addrs *addrs)
+{
+	uint32_t kernel_offset;
 
 	/*
 	 * ARM64 kernels specify the expected text offset in kptr->text_offset.
@@ -526,163 +780,1274 @@ static void choose_addrs(const struct kernel64_hdr *kptr, struct load_addrs *add
 		kernel_offset = 0x8000;
 	}
 
-	addrs->kernel = base + kernel_offset;
-	addrs->kernel_max_size = MAX_KERNEL_SIZE - kernel_offset;
+	addrs->kernel = ram_base() + kernel_offset;
+
+	/* The kernel must go exactly there, so only the free space counts */
+	if (lk2nd_layout_find(addrs->kernel, 0, 1, &addrs->kernel_max_size) != addrs->kernel)
+		addrs->kernel_max_size = 0;
 }
 
 /**
- * lk2nd_boot_label() - Load all files from the label and boot.
+ * choose_tags_addr() - Place the dtb right after the memory used by the kernel.
+ * @addrs:       Load addresses, the kernel must be loaded already
+ * @kernel_size: Size of the loaded kernel image
+ *
+ * Returns: 0 on success or negative error.
  */
-static void lk2nd_boot_label(struct label *label)
+static int choose_tags_addr(struct load_addrs *addrs, uint32_t kernel_size)
 {
-	unsigned int scratch_size = target_get_max_flash_size();
-	void *scratch = target_get_scratch_address();
-	unsigned int kernel_size, ramdisk_size = 0;
-	struct load_addrs addrs;
-	void *kernel_scratch;
-	int ret, i = 0;
-
-	dprintf(INFO, "Trying to boot '%s'\n", label->name);
-
-	ret = fs_load_file(label->kernel, scratch, scratch_size);
-	if (ret < 0) {
-		dprintf(INFO, "Failed to load the kernel: %d\n", ret);
-		return;
-	}
-
-	kernel_size = ((ret >> 4) + 1) << 4;
-
-	if (is_gzip_package(scratch, kernel_size)) {
-		dprintf(INFO, "Decompressing the kernel...\n");
-		kernel_scratch = scratch + kernel_size;
-		ret = decompress(scratch, kernel_size, kernel_scratch,
-				 scratch_size - kernel_size, NULL, &kernel_size);
-		if (ret) {
-			dprintf(INFO, "Failed to decompress the kernel: %d\n", ret);
-			return;
+	const struct kernel64_hdr *kptr = addrs->kernel;
+	void *end;
+
+	if (IS_ARM64(kptr) && kptr->image_size) {
+		/* image_size also covers BSS and other memory used at runtime */
+		if (kptr->image_size > addrs->kernel_max_size) {
+			dprintf(INFO, "Kernel too big: %llu > %u\n",
+				kptr->image_size, addrs->kernel_max_size);
+			return -1;
 		}
+		end = addrs->kernel + MAX(kernel_size, kptr->image_size);
 	} else {
-		kernel_scratch = scratch;
+		end = MAX(addrs->kernel + kernel_size, ram_base() + MAX_KERNEL_SIZE);
 	}
 
-	choose_addrs(kernel_scratch, &addrs);
-
-	if (kernel_size > addrs.kernel_max_size) {
-		dprintf(INFO, "Kernel too big: %u > %u\n",
-			kernel_size, addrs.kernel_max_size);
-		return;
+	addrs->tags = lk2nd_layout_find(end, MAX_TAGS_SIZE, LOAD_ALIGN, NULL);
+	if (!addrs->tags) {
+		dprintf(INFO, "No free memory for the dtb\n");
+		return -1;
 	}
-	memmove(addrs.kernel, kernel_scratch, kernel_size);
 
-	ret = fs_load_file(label->dtb, addrs.tags, MAX_TAGS_SIZE);
-	if (ret < 0) {
-		dprintf(INFO, "Failed to load the dtb: %d\n", ret);
-		return;
-	}
-	if (ret == MAX_TAGS_SIZE) {
-		dprintf(INFO, "DTB is too big\n");
-		return;
-	}
+	return 0;
+}
 
-	if (label->dtboverlays) {
-		ret = fdt_open_into(addrs.tags, addrs.tags, MAX_TAGS_SIZE);
-		if (ret < 0) {
-			dprintf(INFO, "Failed to open the dtb: %d\n", ret);
-			return;
-		}
+#define KERNEL_CHUNK_SIZE		(1 * 1024 * 1024)
 
-		while (label->dtboverlays[i]) {
-			ret = fs_load_file(label->dtboverlays[i], scratch, scratch_size);
-			if (ret < 0) {
-				dprintf(INFO, "Failed to load the dtb overlay %s: %d\n", label->dtboverlays[i], ret);
-				return;
-			}
+/*
+ * Inflating the kernel keeps the CPU busy while reading files mostly waits
+ * for the storage. To overlap the two, gzip kernels are decompressed in a
+ * separate thread. The main thread reads the compressed file into scratch
+ * and then goes on to load the dtb and initramfs. All file system access
+ * stays in the main thread.
+ */
+struct kernel_inflate {
+	struct load_addrs *addrs;
+	unsigned char *buf;
+	volatile unsigned int avail;
+	volatile bool read_done;
+	bool started;
+	bool hdr_done;
+	event_t data_event;
+	event_t hdr_event;
+	event_t done_event;
+	int ret;
+	int cache;	/* Boot cache handle for the decompressed kernel */
+};
 
-			ret = fdt_overlay_apply(addrs.tags, scratch);
-			if (ret < 0) {
-				dprintf(INFO, "Failed to apply the dtb overlay %s: %d\n", label->dtboverlays[i], ret);
-				return;
+static int kernel_inflate_thread(void *arg)
+{
+	struct kernel_inflate *k = arg;
+	struct load_addrs *addrs = k->addrs;
+	struct decompress_stream strm = {0};
+	struct kernel64_hdr hdr;
+	unsigned int consumed;
+	uint32_t max_size;
+	int ret, bs;
+
+	bs = lk2nd_bootstats_start("gunzip kernel");
+
+	ret = decompress_init(&strm);
+	if (ret)
+		goto out;
+
+	strm.next_in = k->buf;
+	strm.next_out = (unsigned char *)&hdr;
+	strm.avail_out = sizeof(hdr);
+
+	do {
+		if (strm.avail_in == 0) {
+			consumed = strm.next_in - k->buf;
+			while (k->avail == consumed && !k->read_done)
+				event_wait(&k->data_event);
+
+			if (k->avail == consumed) {
+				/* No further gzip member */
+				if (ret == DECOMPRESS_STREAM_END)
+					break;
+				dprintf(INFO, "Kernel image is truncated\n");
+				ret = -1;
+				break;
 			}
-			i++;
+			strm.avail_in = k->avail - consumed;
 		}
 
-		ret = fdt_pack(addrs.tags);
-		if (ret < 0) {
-			dprintf(INFO, "Failed to pack the dtb: %d\n", ret);
-			return;
-		}
-	}
+		ret = decompress_feed(&strm);
+		if (ret < 0)
+			break;
 
-	if (label->initramfs) {
-		ret = fs_load_file(label->initramfs, addrs.ramdisk, addrs.ramdisk_max_size);
-		if (ret < 0) {
-			dprintf(INFO, "Failed to load the initramfs: %d\n", ret);
-			return;
+		if (!k->hdr_done && (strm.avail_out == 0 || ret == DECOMPRESS_STREAM_END)) {
+			choose_addrs(&hdr, addrs);
+
+			/* The dtb is placed before this finishes, so bound the size */
+			if (IS_ARM64((&hdr)) && hdr.image_size)
+				max_size = hdr.image_size;
+			else
+				max_size = ram_base() + MAX_KERNEL_SIZE - addrs->kernel;
+			addrs->kernel_max_size = MIN(addrs->kernel_max_size, max_size);
+
+			memcpy(addrs->kernel, &hdr, strm.total_out);
+			strm.next_out = addrs->kernel + strm.total_out;
+			strm.avail_out = addrs->kernel_max_size - strm.total_out;
+
+			k->hdr_done = true;
+			event_signal(&k->hdr_event, false);
+		} else if (strm.avail_out == 0 && ret != DECOMPRESS_STREAM_END) {
+			dprintf(INFO, "Kernel too big: > %u\n", addrs->kernel_max_size);
+			ret = -1;
+			break;
 		}
-		if ((uint32_t)ret == addrs.ramdisk_max_size) {
-			dprintf(INFO, "Initramfs is too big\n");
-			return;
+	} while (ret != DECOMPRESS_STREAM_END || strm.avail_in == 0);
+
+	decompress_finish(&strm);
+
+out:
+	lk2nd_bootstats_end(bs);
+	if (ret >= 0)
+		lk2nd_bootstats_unpacked(strm.next_in - k->buf, strm.total_out);
+	k->ret = ret < 0 ? ret : (int)strm.total_out;
+	if (!k->hdr_done)
+		event_signal(&k->hdr_event, false);
+	event_signal(&k->done_event, false);
+	return 0;
+}
+
+/**
+ * kernel_inflate_wait() - Wait until the kernel is decompressed.
+ * @k: Inflate state, may be unused if the kernel was not compressed
+ *
+ * Returns: Decompressed kernel size, 0 if nothing was decompressed in the
+ * background or negative error.
+ */
+static int kernel_inflate_wait(struct kernel_inflate *k)
+{
+	if (!k->started)
+		return 0;
+
+	event_wait(&k->done_event);
+	k->started = false;
+	return k->ret;
+}
+
+/**
+ * load_kernel_gzip() - Start decompressing the kernel to its load address.
+ * @fileh:  Opened kernel file
+ * @fsize:  Size of the kernel file
+ * @buf:    Buffer for the whole compressed file
+ * @len:    Amount of data already read into @buf from the file start
+ * @addrs:  Returns the load addresses chosen based on the kernel header
+ * @k:      Inflate state, kernel_inflate_wait() must be called on it later
+ *
+ * Returns: Maximum size of the kernel once decompressed or negative error.
+ */
+static int load_kernel_gzip(struct filehandle *fileh, off_t fsize, void *buf,
+			    unsigned int len, struct load_addrs *addrs,
+			    struct kernel_inflate *k)
+{
+	thread_t *thr;
+	int ret;
+
+	memset(k, 0, sizeof(*k));
+	k->addrs = addrs;
+	k->buf = buf;
+	k->avail = len;
+	event_init(&k->data_event, false, EVENT_FLAG_AUTOUNSIGNAL);
+	event_init(&k->hdr_event, false, 0);
+	event_init(&k->done_event, false, 0);
+
+	thr = thread_create("inflate", kernel_inflate_thread, k,
+			    DEFAULT_PRIORITY, DEFAULT_STACK_SIZE);
+	if (!thr) {
+		dprintf(INFO, "Failed to create the inflate thread\n");
+		return -1;
+	}
+	k->started = true;
+	thread_resume(thr);
+
+	while (k->avail < fsize) {
+		ret = fs_read_file(fileh, buf + k->avail, k->avail,
+				   MIN(fsize - k->avail, KERNEL_CHUNK_SIZE));
+		if (ret <= 0) {
+			dprintf(INFO, "Failed to read the kernel: %d\n", ret);
+			break;
 		}
-		ramdisk_size = ret;
-		arch_clean_invalidate_cache_range((addr_t)addrs.ramdisk, ramdisk_size);
+
+		k->avail += ret;
+		event_signal(&k->data_event, false);
 	}
+	k->read_done = true;
+	event_signal(&k->data_event, false);
 
-	boot_linux(addrs.kernel,
-		   addrs.tags,
-		   label->cmdline,
-		   board_machtype(),
-		   addrs.ramdisk, ramdisk_size,
-		   0);
+	event_wait(&k->hdr_event);
+	if (!k->hdr_done)
+		return kernel_inflate_wait(k);
+
+	return addrs->kernel_max_size;
 }
 
 /**
- * lk2nd_try_extlinux() - Try to boot with extlinux
+ * load_kernel_lz4() - Decompress an LZ4 kernel to its load address.
+ * @buf:   The whole compressed kernel file
+ * @len:   Size of the compressed file
+ * @addrs: Returns the load addresses chosen based on the kernel header
  *
- * Check if /extlinux/extlinux.conf exists and try to
- * boot it if so.
+ * Returns: Decompressed kernel size or negative error.
  */
-void lk2nd_try_extlinux(const char *root)
+static int load_kernel_lz4(void *buf, unsigned int len, struct load_addrs *addrs)
 {
-	struct filehandle *fileh;
-	struct file_stat stat;
-	struct label label = {0};
-	char path[64];
-	char *data;
+	struct kernel64_hdr hdr;
+	size_t out_used;
 	int ret;
 
-	snprintf(path, sizeof(path), "%s/extlinux/extlinux.conf", root);
-	ret = fs_open_file(path, &fileh);
+	/* Only the header is needed to figure out where the kernel goes */
+	ret = lz4_decompress(buf, len, &hdr, sizeof(hdr), NULL, &out_used);
+	if (ret < 0 && ret != ERR_NOT_ENOUGH_BUFFER) {
+		dprintf(INFO, "Failed to decompress the kernel: %d\n", ret);
+		return ret;
+	}
+	if (out_used < sizeof(hdr))
+		memset((char *)&hdr + out_used, 0, sizeof(hdr) - out_used);
+
+	choose_addrs(&hdr, addrs);
+
+	ret = lz4_decompress(buf, len, addrs->kernel, addrs->kernel_max_size,
+			     NULL, &out_used);
+	if (ret == ERR_NOT_ENOUGH_BUFFER) {
+		dprintf(INFO, "Kernel too big: > %u\n", addrs->kernel_max_size);
+		return -1;
+	}
 	if (ret < 0) {
-		dprintf(SPEW, "No extlinux config in %s: %d\n", root, ret);
-		return;
+		dprintf(INFO, "Failed to decompress the kernel: %d\n", ret);
+		return ret;
 	}
 
-	fs_stat_file(fileh, &stat);
-	data = malloc(stat.size + 1);
-	fs_read_file(fileh, data, 0, stat.size);
-	fs_close_file(fileh);
+	return out_used;
+}
+
+/**
+ * load_kernel_cached() - Read a decompressed kernel from the boot cache.
+ * @cache: Handle of the cached kernel
+ * @size:  Size of the cached kernel
+ * @addrs: Returns the load addresses chosen based on the kernel header
+ *
+ * Returns: Kernel size or negative error.
+ */
+static int load_kernel_cached(int cache, uint32_t size, struct load_addrs *addrs)
+{
+	struct kernel64_hdr hdr = {0};
+	int ret;
 
-	ret = parse_conf(data, stat.size, &label);
+	ret = lk2nd_boot_cache_read(cache, &hdr, MIN(size, sizeof(hdr)));
 	if (ret < 0)
-		goto error;
+		return ret;
 
-	if (!expand_conf(&label, root))
-		goto error;
+	choose_addrs(&hdr, addrs);
+	if (size > addrs->kernel_max_size) {
+		dprintf(INFO, "Kernel too big: %u > %u\n", size, addrs->kernel_max_size);
+		return -1;
+	}
 
-	free(data);
+	ret = lk2nd_boot_cache_read(cache, addrs->kernel, size);
+	if (ret < 0)
+		return ret;
 
-	dprintf(SPEW, "Parsed %s\n", path);
-	dprintf(SPEW, "kernel    = %s\n", label.kernel);
-	dprintf(SPEW, "dtb       = %s\n", label.dtb);
-	dprintf(SPEW, "dtbdir    = %s\n", label.dtbdir);
-	dprintf(SPEW, "initramfs = %s\n", label.initramfs);
-	dprintf(SPEW, "cmdline   = %s\n", label.cmdline);
+	return size;
+}
 
-	lk2nd_boot_label(&label);
+/**
+ * load_kernel() - Load the kernel to the address suitable for it.
+ * @path:    Path to the kernel file
+ * @scratch: Scratch buffer
+ * @scratch_size: Size of the scratch buffer
+ * @addrs:   Returns the load addresses chosen based on the kernel header
+ * @k:       Inflate state for gzip kernels decompressed in the background
+ *
+ * Returns: Kernel size (upper bound if still being decompressed) or
+ * negative error.
+ */
+static int load_kernel(const char *path, void *scratch, unsigned int scratch_size,
+		       struct load_addrs *addrs, struct kernel_inflate *k)
+{
+	struct filehandle *fileh;
+	struct file_stat stat;
+	uint32_t cached_size;
+	int ret, chunk, bs, cache = -1;
+
+	ret = fs_open_file(path, &fileh);
+	if (ret < 0)
+		return ret;
+
+	fs_stat_file(fileh, &stat);
+
+	/* The header is enough to detect compression and to place the kernel */
+	ret = fs_read_file(fileh, scratch, 0, MIN(stat.size, sizeof(struct kernel64_hdr)));
+	if (ret < 0)
+		goto out;
+
+	if (is_gzip_package(scratch, ret) || lz4_is_compressed(scratch, ret)) {
+		cache = lk2nd_boot_cache_lookup(path, &stat, scratch, ret, &cached_size);
+		if (cached_size) {
+			bs = lk2nd_bootstats_start("read cached kernel");
+			chunk = load_kernel_cached(cache, cached_size, addrs);
+			lk2nd_bootstats_end(bs);
+			if (chunk >= 0) {
+				ret = chunk;
+				goto out;
+			}
+			dprintf(INFO, "Failed to read the cached kernel: %d\n", chunk);
+		}
+
+		if (stat.size > scratch_size) {
+			dprintf(INFO, "Kernel too big: %lld > %u\n", stat.size, scratch_size);
+			ret = -1;
+			goto out;
+		}
+
+		/* Decompression starts with the first chunk in scratch */
+		if (stat.size > ret) {
+			chunk = fs_read_file(fileh, scratch + ret, ret,
+					     MIN(stat.size, KERNEL_CHUNK_SIZE) - ret);
+			if (chunk < 0) {
+				ret = chunk;
+				goto out;
+			}
+			ret += chunk;
+		}
+	}
+
+	if (is_gzip_package(scratch, ret)) {
+		dprintf(INFO, "Decompressing the kernel...\n");
+		ret = load_kernel_gzip(fileh, stat.size, scratch, ret, addrs, k);
+		k->cache = cache;
+		goto out;
+	}
+
+	if (lz4_is_compressed(scratch, ret)) {
+		if (stat.size > ret) {
+			ret = fs_read_file(fileh, scratch + ret, ret, stat.size - ret);
+			if (ret < 0)
+				goto out;
+		}
+
+		dprintf(INFO, "Decompressing the kernel...\n");
+		bs = lk2nd_bootstats_start("unlz4 kernel");
+		ret = load_kernel_lz4(scratch, stat.size, addrs);
+		lk2nd_bootstats_end(bs);
+		if (ret > 0) {
+			lk2nd_bootstats_unpacked(stat.size, ret);
+			lk2nd_boot_cache_store(cache, addrs->kernel, ret);
+		}
+		goto out;
+	}
+
+	choose_addrs(scratch, addrs);
+
+	if (stat.size > addrs->kernel_max_size) {
+		dprintf(INFO, "Kernel too big: %lld > %u\n",
+			stat.size, addrs->kernel_max_size);
+		ret = -1;
+		goto out;
+	}
+
+	/* Uncompressed kernels are read in place, without going through scratch */
+	ret = fs_read_file(fileh, addrs->kernel, 0, stat.size);
+	if (ret < 0)
+		goto out;
+	ret = stat.size;
+
+out:
+	fs_close_file(fileh);
+	return ret;
+}
+
+/**
+ * unpack_initramfs_gzip() - Decompress the gzip members of the initramfs.
+ *
+ * Returns: Decompressed size, ERR_NOT_SUPPORTED if there is more data after
+ * the members or other negative error.
+ */
+static int unpack_initramfs_gzip(void *buf, unsigned int len, void *out,
+				 unsigned int out_len)
+{
+	struct decompress_stream strm = {0};
+	unsigned int i;
+	int ret;
+
+	ret = decompress_init(&strm);
+	if (ret)
+		return ret;
+
+	strm.next_in = buf;
+	strm.avail_in = len;
+	strm.next_out = out;
+	strm.avail_out = out_len;
+
+	ret = decompress_feed(&strm);
+	decompress_finish(&strm);
+
+	if (ret != DECOMPRESS_STREAM_END)
+		return ret < 0 ? ret : ERR_NOT_ENOUGH_BUFFER;
+
+	/* Anything but padding afterwards is another archive that has to be
+	 * passed to Linux as is. */
+	for (i = 0; i < strm.avail_in; i++)
+		if (strm.next_in[i])
+			return ERR_NOT_SUPPORTED;
+
+	return strm.total_out;
+}
+
+/*
+ * Maximum number of members of an indexed gzip initramfs that are unpacked
+ * at the same time. Members that find no idle CPU core run on the boot CPU.
+ */
+#define UNPACK_MAX_JOBS			8
+
+static void unpack_gzip_job(struct lk2nd_smp_job *job)
+{
+	unsigned int out_used;
+
+	job->ret = decompress_member(job->in, job->in_len, job->out, job->out_len,
+				     job->priv, &out_used);
+	job->out_used = out_used;
+
+	/* The work memory is freed on the boot CPU afterwards */
+	arch_clean_invalidate_cache_range((addr_t)job->priv, DECOMPRESS_WORK_SIZE);
+}
+
+/**
+ * unpack_initramfs_indexed() - Decompress an indexed gzip file in parallel.
+ *
+ * The members listed in the index of the first gzip header are independent,
+ * so they are inflated on all available CPU cores. The CRC32 of each member
+ * is checked on the boot CPU while the others are still being decompressed.
+ *
+ * Returns: Decompressed size, 0 if there is no index, ERR_NOT_SUPPORTED if
+ * there is more data after the members or other negative error.
+ */
+static int unpack_initramfs_indexed(void *buf, unsigned int len, void *out,
+				    unsigned int out_len)
+{
+	struct lk2nd_smp_job jobs[UNPACK_MAX_JOBS] = {0};
+	struct lk2nd_smp_job *job;
+	struct decompress_member *m;
+	unsigned int njobs, in_end, out_end, i, j;
+	unsigned char *work;
+	int count, ret = 0;
+
+	count = decompress_get_index(buf, len, &m);
+	if (count <= 0)
+		return count ? ERR_NOT_VALID : 0;
+
+	in_end = m[count - 1].in_offset + m[count - 1].in_len;
+	out_end = m[count - 1].out_offset + m[count - 1].out_len;
+	if (out_end > out_len) {
+		dprintf(INFO, "Initramfs is too big: %u > %u\n", out_end, out_len);
+		ret = ERR_NOT_ENOUGH_BUFFER;
+		goto out;
+	}
+
+	njobs = MIN(lk2nd_smp_worker_start() + 1, UNPACK_MAX_JOBS);
+	work = memalign(CACHE_LINE, njobs * DECOMPRESS_WORK_SIZE);
+	if (!work) {
+		ret = ERR_NO_MEMORY;
+		goto out;
+	}
+	arch_clean_invalidate_cache_range((addr_t)work, njobs * DECOMPRESS_WORK_SIZE);
+
+	dprintf(INFO, "Decompressing %d initramfs members with %u jobs\n", count, njobs);
+
+	for (i = 0; i < count + njobs; i++) {
+		job = &jobs[i % njobs];
+
+		/* Finish the member that used this slot before */
+		if (job->func) {
+			j = i - njobs;
+			lk2nd_smp_job_wait(job);
+			job->func = NULL;
+
+			if (!ret && (job->ret || job->out_used != m[j].out_len ||
+				     decompress_check_member(buf + m[j].in_offset, m[j].in_len,
+							     job->out, job->out_used))) {
+				dprintf(INFO, "Failed to decompress initramfs member %u\n", j);
+				ret = ERR_NOT_VALID;
+			}
+		}
+
+		if (i >= (unsigned int)count || ret)
+			continue;
+
+		job->func = unpack_gzip_job;
+		job->in = buf + m[i].in_offset;
+		job->in_len = m[i].in_len;
+		job->out = out + m[i].out_offset;
+		job->out_len = m[i].out_len;
+		job->priv = work + (i % njobs) * DECOMPRESS_WORK_SIZE;
+		lk2nd_smp_job_queue(job);
+	}
+	free(work);
+
+	if (!ret) {
+		ret = out_end;
+		for (i = in_end; i < len; i++) {
+			if (((unsigned char *)buf)[i]) {
+				ret = ERR_NOT_SUPPORTED;
+				break;
+			}
+		}
+	}
+
+out:
+	free(m);
+	return ret;
+}
+
+/*
+ * Limit for the unpacked size of an LZ4 initramfs. The output area has to be
+ * synced between the CPU cores, so don't offer all free memory. Linux unpacks
+ * anything larger itself.
+ */
+#define LZ4_MAX_RATIO			16
+
+static void unpack_lz4_job(struct lk2nd_smp_job *job)
+{
+	job->ret = lz4_decompress(job->in, job->in_len, job->out, job->out_len,
+				  &job->in_used, &job->out_used);
+}
+
+/**
+ * unpack_initramfs_lz4() - Decompress a single LZ4 stream.
+ *
+ * This runs on a secondary CPU core if possible, so the gzip kernel can be
+ * inflated at the same time.
+ *
+ * Returns: Decompressed size, ERR_NOT_SUPPORTED if there is more data after
+ * the stream or other negative error.
+ */
+static int unpack_initramfs_lz4(void *buf, unsigned int len, void *out,
+				unsigned int out_len)
+{
+	struct lk2nd_smp_job job = {
+		.func = unpack_lz4_job,
+		.in = buf,
+		.in_len = len,
+		.out = out,
+		.out_len = MIN(out_len, (uint64_t)len * LZ4_MAX_RATIO),
+	};
+	size_t i;
+
+	lk2nd_smp_job_queue(&job);
+	lk2nd_smp_job_wait(&job);
+	if (job.ret < 0)
+		return job.ret;
+
+	for (i = job.in_used; i < len; i++)
+		if (((unsigned char *)buf)[i])
+			return ERR_NOT_SUPPORTED;
+
+	return job.out_used;
+}
+
+/**
+ * load_initramfs() - Load the initramfs, decompressing it if possible.
+ * @path:    Path to the initramfs file
+ * @scratch: Scratch buffer
+ * @scratch_size: Size of the scratch buffer
+ * @addrs:   Load addresses, the ramdisk address is chosen here
+ *
+ * gzip and LZ4 compressed images are unpacked directly into the ramdisk
+ * area so Linux does not have to decompress them again. Anything else,
+ * including concatenated archives, is passed as is.
+ *
+ * Returns: Ramdisk size or negative error.
+ */
+static int load_initramfs(const char *path, void *scratch, unsigned int scratch_size,
+			  unsigned char *out, unsigned int out_size)
+{
+	struct filehandle *fileh;
+	struct file_stat stat;
+	unsigned char magic[16];
+	unsigned int size;
+	uint32_t cached_size;
+	int ret, bs, cache;
+
+	ret = fs_open_file(path, &fileh);
+	if (ret < 0)
+		return ret;
+
+	fs_stat_file(fileh, &stat);
+	size = stat.size;
+
+	ret = fs_read_file(fileh, magic, 0, MIN(size, sizeof(magic)));
+	if (ret < 0)
+		goto out;
+
+	if (!is_gzip_package(magic, ret) && !lz4_is_compressed(magic, ret)) {
+		if (size > out_size) {
+			dprintf(INFO, "Initramfs is too big: %u > %u\n", size, out_size);
+			ret = -1;
+			goto out;
+		}
+		ret = fs_read_file(fileh, out, 0, size);
+		goto out;
+	}
+
+	cache = lk2nd_boot_cache_lookup(path, &stat, magic, ret, &cached_size);
+	if (cached_size && cached_size <= out_size) {
+		bs = lk2nd_bootstats_start("read cached initramfs");
+		ret = lk2nd_boot_cache_read(cache, out, cached_size);
+		lk2nd_bootstats_end(bs);
+		if (ret == 0) {
+			ret = cached_size;
+			goto out;
+		}
+		dprintf(INFO, "Failed to read the cached initramfs: %d\n", ret);
+	}
+
+	if (size > scratch_size) {
+		dprintf(INFO, "Initramfs is too big: %u > %u\n", size, scratch_size);
+		ret = -1;
+		goto out;
+	}
+
+	ret = fs_read_file(fileh, scratch, 0, size);
+	if (ret < 0)
+		goto out;
+
+	bs = lk2nd_bootstats_start("unpack initramfs");
+	if (is_gzip_package(scratch, size)) {
+		ret = unpack_initramfs_indexed(scratch, size, out, out_size);
+		if (ret == 0)
+			ret = unpack_initramfs_gzip(scratch, size, out, out_size);
+	} else
+		ret = unpack_initramfs_lz4(scratch, size, out, out_size);
+	lk2nd_bootstats_end(bs);
+	if (ret >= 0) {
+		lk2nd_bootstats_unpacked(size, ret);
+		lk2nd_boot_cache_store(cache, out, ret);
+		goto out;
+	}
+
+	if (ret != ERR_NOT_SUPPORTED)
+		dprintf(INFO, "Failed to decompress the initramfs (%d), passing it as is\n", ret);
+
+	if (size > out_size) {
+		dprintf(INFO, "Initramfs is too big: %u > %u\n", size, out_size);
+		ret = -1;
+		goto out;
+	}
+	memmove(out, scratch, size);
+	ret = size;
+
+out:
+	fs_close_file(fileh);
+	return ret;
+}
+
+/**
+ * load_initramfs_all() - Load all initramfs files right after each other.
+ * @paths:        NULL-terminated list of initramfs files
+ * @scratch:      Scratch buffer for compressed files
+ * @scratch_size: Size of @scratch
+ * @addrs:        Load addresses, the dtb must be placed already
+ *
+ * Linux unpacks concatenated cpio archives as one initramfs, as long as
+ * each of them starts 4-byte aligned. Each file is loaded (or decompressed)
+ * directly behind the previous one, so nothing needs to be merged on the
+ * device and nothing is copied.
+ *
+ * Returns: Total size of the initramfs or negative error.
+ */
+static int load_initramfs_all(const char **paths, void *scratch, unsigned int scratch_size,
+			      struct load_addrs *addrs)
+{
+	struct filehandle *fileh;
+	struct file_stat stat;
+	unsigned char *ramdisk;
+	unsigned int size = 0, pad;
+	int i, ret, bs;
+
+	/* Decompressed sizes are unknown, so make sure the files fit at least */
+	for (i = 0; paths[i]; i++) {
+		ret = fs_open_file(paths[i], &fileh);
+		if (ret < 0)
+			return ret;
+		fs_stat_file(fileh, &stat);
+		fs_close_file(fileh);
+		size += ROUNDUP(stat.size, 4);
+	}
+
+	addrs->ramdisk = lk2nd_layout_find(addrs->tags + MAX_TAGS_SIZE, size,
+					   LOAD_ALIGN, &addrs->ramdisk_max_size);
+	if (!addrs->ramdisk) {
+		dprintf(INFO, "Initramfs is too big: no %u bytes of free memory\n", size);
+		return -1;
+	}
+
+	ramdisk = addrs->ramdisk;
+	size = 0;
+	for (i = 0; paths[i]; i++) {
+		pad = ROUNDUP(size, 4) - size;
+		if (pad > addrs->ramdisk_max_size - size)
+			return -1;
+		memset(ramdisk + size, 0, pad);
+		size += pad;
+
+		bs = lk2nd_bootstats_start("load %s", paths[i]);
+		ret = load_initramfs(paths[i], scratch, scratch_size, ramdisk + size,
+				     addrs->ramdisk_max_size - size);
+		lk2nd_bootstats_end(bs);
+		if (ret < 0) {
+			dprintf(INFO, "Failed to load the initramfs %s: %d\n", paths[i], ret);
+			return ret;
+		}
+		size += ret;
+	}
+
+	return size;
+}
+
+#if WITH_LIB_LIBUFDT
+#define MAX_FDT_OVERLAYS		16
+
+/*
+ * Load all overlays next to each other and apply them together to the
+ * unflattened tree, which is then flattened only once. With libfdt each
+ * overlay moves the whole tree around again.
+ */
+static int apply_fdt_overlays_ufdt(void *fdt, const char **paths,
+				   void *scratch, unsigned int scratch_size)
+{
+	void *overlays[MAX_FDT_OVERLAYS];
+	struct fdt_header *merged;
+	int ret, bs, count;
+
+	for (count = 0; paths[count]; count++) {
+		if (count == MAX_FDT_OVERLAYS)
+			return -1;
+
+		bs = lk2nd_bootstats_start("load %s", paths[count]);
+		ret = fs_load_file(paths[count], scratch, scratch_size);
+		lk2nd_bootstats_end(bs);
+		if (ret < 0) {
+			dprintf(INFO, "Failed to load the dtb overlay %s: %d\n", paths[count], ret);
+			return ret;
+		}
+
+		overlays[count] = scratch;
+		ret = MIN(ROUNDUP((unsigned int)ret, LOAD_ALIGN), scratch_size);
+		scratch += ret;
+		scratch_size -= ret;
+	}
+
+	bs = lk2nd_bootstats_start("apply %d overlays", count);
+	merged = ufdt_apply_multioverlay(fdt, fdt_totalsize(fdt), overlays, count);
+	lk2nd_bootstats_end(bs);
+	if (!merged)
+		return -1;
+
+	ret = -1;
+	if (fdt_totalsize(merged) <= MAX_TAGS_SIZE) {
+		memcpy(fdt, merged, fdt_totalsize(merged));
+		ret = fdt_pack(fdt);
+	}
+	free(merged);
+	return ret;
+}
+#endif
+
+static int apply_fdt_overlays(void *fdt, const char **paths,
+			      void *scratch, unsigned int scratch_size)
+{
+	int ret, bs, i;
+
+#if WITH_LIB_LIBUFDT
+	if (apply_fdt_overlays_ufdt(fdt, paths, scratch, scratch_size) == 0)
+		return 0;
+
+	/* The overlays may have been modified already, so load them again */
+	dprintf(INFO, "Failed to apply the dtb overlays with libufdt, trying libfdt\n");
+#endif
 
+	ret = fdt_open_into(fdt, fdt, MAX_TAGS_SIZE);
+	if (ret < 0) {
+		dprintf(INFO, "Failed to open the dtb: %d\n", ret);
+		return ret;
+	}
+
+	for (i = 0; paths[i]; i++) {
+		bs = lk2nd_bootstats_start("load %s", paths[i]);
+		ret = fs_load_file(paths[i], scratch, scratch_size);
+		lk2nd_bootstats_end(bs);
+		if (ret < 0) {
+			dprintf(INFO, "Failed to load the dtb overlay %s: %d\n", paths[i], ret);
+			return ret;
+		}
+
+		bs = lk2nd_bootstats_start("apply %s", paths[i]);
+		ret = fdt_overlay_apply(fdt, scratch);
+		lk2nd_bootstats_end(bs);
+		if (ret < 0) {
+			dprintf(INFO, "Failed to apply the dtb overlay %s: %d\n", paths[i], ret);
+			return ret;
+		}
+	}
+
+	ret = fdt_pack(fdt);
+	if (ret < 0)
+		dprintf(INFO, "Failed to pack the dtb: %d\n", ret);
+	return ret;
+}
+
+/**
+ * lookup_fdt_cache() - Look up the dtb with the overlays applied in the boot cache.
+ * @dtb:      Path to the base dtb
+ * @overlays: NULL-terminated list of dtb overlays
+ * @buf:      Buffer to describe the files in
+ * @buf_size: Size of @buf
+ * @size:     Returns the size of the cached dtb, or 0 if there is none
+ *
+ * The result of applying the overlays only depends on the files, so it is
+ * identified by the base dtb together with the path, size and modification
+ * time of each overlay.
+ *
+ * Returns: Boot cache handle or negative error.
+ */
+static int lookup_fdt_cache(const char *dtb, const char **overlays,
+			    void *buf, unsigned int buf_size, uint32_t *size)
+{
+	struct file_stat stat, dtb_stat;
+	unsigned int len = 0, n;
+	uint32_t id[3];
+	int i, ret;
+
+	*size = 0;
+
+	ret = fs_stat_path(dtb, &dtb_stat);
+	if (ret < 0)
+		return ret;
+
+	for (i = 0; overlays[i]; i++) {
+		ret = fs_stat_path(overlays[i], &stat);
+		if (ret < 0)
+			return ret;
+
+		n = strlen(overlays[i]) + 1;
+		if (!stat.mtime || len + n + sizeof(id) > buf_size)
+			return ERR_NOT_SUPPORTED;
+
+		id[0] = stat.size;
+		id[1] = (uint64_t)stat.size >> 32;
+		id[2] = stat.mtime;
+		memcpy(buf + len, overlays[i], n);
+		memcpy(buf + len + n, id, sizeof(id));
+		len += n + sizeof(id);
+	}
+
+	return lk2nd_boot_cache_lookup(dtb, &dtb_stat, buf, len, size);
+}
+
+/**
+ * lk2nd_boot_label() - Load all files from the label and boot.
+ * @label: Label with the (normalized) paths of the files
+ * @prepare: Called once everything is loaded, right before booting (or NULL)
+ */
+static void lk2nd_boot_label(struct label *label, void (*prepare)(void))
+{
+	unsigned int scratch_size, ramdisk_size = 0;
+	void *scratch, *scratch_start;
+	size_t scratch_avail;
+	struct kernel_inflate inflate = {0};
+	struct load_addrs addrs;
+	uint32_t cached_size = 0;
+	int ret, bs, fdt_cache = -1;
+
+	dprintf(INFO, "Trying to boot '%s'\n", label->name);
+
+	/* Everything that is not in use, e.g. by a staged file system image */
+	scratch_start = lk2nd_scratch_alloc_max("boot", &scratch_avail);
+	if (!scratch_start)
+		return;
+	scratch = scratch_start;
+	scratch_size = scratch_avail;
+
+	lk2nd_layout_init(ram_base());
+	lk2nd_boot_cache_reset();
+
+	bs = lk2nd_bootstats_start("load %s", label->kernel);
+	ret = load_kernel(label->kernel, scratch, scratch_size, &addrs, &inflate);
+	lk2nd_bootstats_end(bs);
+	if (ret < 0) {
+		dprintf(INFO, "Failed to load the kernel: %d\n", ret);
+		goto release;
+	}
+
+	/* Keep the compressed kernel intact while it is being decompressed */
+	if (inflate.started) {
+		scratch += ROUNDUP(inflate.avail, LOAD_ALIGN);
+		scratch_size -= ROUNDUP(inflate.avail, LOAD_ALIGN);
+	}
+
+	ret = choose_tags_addr(&addrs, ret);
+	if (ret < 0)
+		goto err;
+
+	if (label->dtboverlays) {
+		fdt_cache = lookup_fdt_cache(label->dtb, label->dtboverlays,
+					     scratch, scratch_size, &cached_size);
+		if (cached_size > MAX_TAGS_SIZE ||
+		    (cached_size && lk2nd_boot_cache_read(fdt_cache, addrs.tags, cached_size) < 0))
+			cached_size = 0;
+	}
+
+	if (!cached_size) {
+		bs = lk2nd_bootstats_start("load %s", label->dtb);
+		ret = fs_load_file(label->dtb, addrs.tags, MAX_TAGS_SIZE);
+		lk2nd_bootstats_end(bs);
+		if (ret < 0) {
+			dprintf(INFO, "Failed to load the dtb: %d\n", ret);
+			goto err;
+		}
+		if (ret == MAX_TAGS_SIZE) {
+			dprintf(INFO, "DTB is too big\n");
+			goto err;
+		}
+	}
+
+	if (label->dtboverlays && !cached_size) {
+		ret = apply_fdt_overlays(addrs.tags, label->dtboverlays, scratch, scratch_size);
+		if (ret < 0)
+			goto err;
+		lk2nd_boot_cache_store(fdt_cache, addrs.tags, fdt_totalsize(addrs.tags));
+	}
+
+	lk2nd_layout_reserve_fdt(addrs.tags);
+
+	if (label->initramfs) {
+		ret = load_initramfs_all(label->initramfs, scratch, scratch_size, &addrs);
+		if (ret < 0)
+			goto err;
+		ramdisk_size = ret;
+		arch_cache_batch_add((addr_t)addrs.ramdisk, ramdisk_size);
+	}
+
+	/* The storage is idle while the kernel is still being decompressed */
+	if (label->fw_regions)
+		lk2nd_boot_firmware_preload(addrs.tags, MAX_TAGS_SIZE, label->fw_regions,
+					    label->fw_paths, label->fw_names);
+
+	ret = kernel_inflate_wait(&inflate);
+	if (ret < 0) {
+		dprintf(INFO, "Failed to decompress the kernel: %d\n", ret);
+		goto release;
+	}
+	if (ret > 0)
+		lk2nd_boot_cache_store(inflate.cache, addrs.kernel, ret);
+
+	/* Nothing is left in scratch, it can be used while preparing the boot */
+	lk2nd_scratch_release("boot", scratch_start);
+
+	lk2nd_boot_cache_commit();
+	/* The firmware files are not part of the manifest */
+	if (label->conf && !label->fw_regions)
+		lk2nd_boot_manifest_record(label->conf, label->kernel, label->dtb,
+					   label->dtboverlays, label->initramfs, label->cmdline);
+
+	if (prepare)
+		prepare();
+
+	boot_linux(addrs.kernel,
+		   addrs.tags,
+		   label->cmdline,
+		   board_machtype(),
+		   addrs.ramdisk, ramdisk_size,
+		   0);
 	return;
 
+err:
+	kernel_inflate_wait(&inflate);
+release:
+	lk2nd_scratch_release("boot", scratch_start);
+}
+
+/**
+ * load_conf() - Get the parsed extlinux.conf of a file system.
+ * @root: Mount point of the file system
+ * @conf: Returns the parsed config
+ *
+ * The config is parsed only if it is not cached already, or if the file
+ * has changed since it was parsed.
+ *
+ * Returns: 0 on success, ERR_NOT_FOUND if there is no extlinux.conf in
+ * @root, or other negative error if it could not be parsed.
+ */
+static int load_conf(const char *root, struct extlinux_conf **conf)
+{
+	struct filehandle *fileh;
+	struct file_stat stat;
+	char path[sizeof(conf_cache.path)];
+	char *data;
+	int ret, bs;
+
+	if (!conf_arena)
+		conf_arena = arena_create(CONF_ARENA_BLOCK_SIZE);
+	if (!conf_arena)
+		return ERR_NO_MEMORY;
+
+	snprintf(path, sizeof(path), "%s/extlinux/extlinux.conf", root);
+	ret = fs_open_file(path, &fileh);
+	if (ret < 0) {
+		dprintf(SPEW, "No extlinux config in %s: %d\n", root, ret);
+		return ERR_NOT_FOUND;
+	}
+
+	fs_stat_file(fileh, &stat);
+	if (conf_cache.valid && !strcmp(conf_cache.path, path) &&
+	    conf_cache.size == stat.size && conf_cache.mtime == stat.mtime) {
+		fs_close_file(fileh);
+		dprintf(SPEW, "Using the cached %s\n", path);
+		*conf = &conf_cache.conf;
+		return 0;
+	}
+
+	/* Release the previous config, nothing points into it anymore */
+	conf_cache.valid = false;
+	arena_reset(conf_arena);
+
+	bs = lk2nd_bootstats_start("parse %s", path);
+	data = arena_alloc(conf_arena, stat.size + 1);
+	if (!data) {
+		fs_close_file(fileh);
+		ret = ERR_NO_MEMORY;
+		goto error;
+	}
+	fs_read_file(fileh, data, 0, stat.size);
+	fs_close_file(fileh);
+
+	ret = parse_conf(conf_arena, data, stat.size, &conf_cache.conf);
+	if (ret < 0)
+		goto error;
+
+	lk2nd_bootstats_end(bs);
+
+	strlcpy(conf_cache.path, path, sizeof(conf_cache.path));
+	conf_cache.size = stat.size;
+	conf_cache.mtime = stat.mtime;
+	conf_cache.valid = true;
+
+	dprintf(SPEW, "Parsed %s: %u labels\n", path, conf_cache.conf.labels_count);
+	*conf = &conf_cache.conf;
+	return 0;
+
 error:
+	lk2nd_bootstats_end(bs);
 	dprintf(INFO, "Failed to parse extlinux.conf\n");
-	free(data);
+	arena_reset(conf_arena);
+	return ret == ERR_NO_MEMORY ? ERR_NO_MEMORY : ERR_NOT_VALID;
+}
+
+/**
+ * choose_label() - Show the boot menu for the labels.
+ * @conf: Parsed config
+ * @label: Label that is booted when the timeout expires
+ *
+ * Returns: The label selected by the user.
+ */
+static struct label *choose_label(struct extlinux_conf *conf, struct label *label)
+{
+	const char **items;
+	struct label *l;
+	unsigned int i, sel = 0;
+
+	items = arena_calloc(conf_arena, conf->labels_count, sizeof(*items));
+	if (!items)
+		return label;
+
+	for (l = conf->labels, i = 0; l; l = l->next, i++) {
+		items[i] = l->menu_label ? l->menu_label : l->name;
+		if (l == label)
+			sel = i;
+	}
+
+	sel = lk2nd_menu_select(conf->title, items, conf->labels_count, sel,
+				conf->timeout * 100);
+
+	for (l = conf->labels; sel--; l = l->next)
+		;
+
+	return l;
+}
+
+/**
+ * prepare_label() - Check the label and expand the paths, once.
+ *
+ * Returns: True if the label seems bootable, false otherwise.
+ */
+static bool prepare_label(struct label *label, const char *root)
+{
+	int bs;
+
+	if (label->expanded)
+		return label->bootable;
+
+	bs = lk2nd_bootstats_start("check %s", label->name);
+	label->bootable = expand_conf(conf_arena, label, root);
+	label->expanded = true;
+	lk2nd_bootstats_end(bs);
+
+	if (!label->bootable)
+		dprintf(INFO, "Label '%s' is not bootable\n", label->name);
+
+	return label->bootable;
+}
+
+/**
+ * lk2nd_boot_extlinux() - Boot a label from extlinux.conf
+ * @root: Mount point of the file system
+ * @name: Name of the label, or NULL for the default label
+ * @cmdline: Kernel command line to use instead of the one from the label
+ *           (or NULL)
+ * @prepare: Called right before booting (or NULL)
+ *
+ * If no @name is given and the file has several labels and a "timeout",
+ * a menu is shown to pick the label.
+ *
+ * Returns: Only returns on failure, with ERR_NOT_FOUND if there is no
+ * extlinux.conf (or no label with @name) in @root, or ERR_NOT_VALID if the
+ * label could not be booted.
+ */
+int lk2nd_boot_extlinux(const char *root, const char *name, const char *cmdline,
+			void (*prepare)(void))
+{
+	struct extlinux_conf *conf;
+	struct label *label;
+	struct label boot;
+	int ret;
+
+	ret = load_conf(root, &conf);
+	if (ret < 0)
+		return ret;
+
+	if (name) {
+		label = find_label(conf, name);
+		if (!label) {
+			dprintf(INFO, "No label '%s' in the extlinux.conf\n", name);
+			return ERR_NOT_FOUND;
+		}
+	} else {
+		label = default_label(conf);
+		if (conf->timeout && conf->labels_count > 1)
+			label = choose_label(conf, label);
+	}
+
+	if (!prepare_label(label, root))
+		return ERR_NOT_VALID;
+
+	/* Don't modify the cached label */
+	boot = *label;
+	if (cmdline)
+		boot.cmdline = cmdline;
+
+	/* Without a menu, the same label is booted again next time */
+	if (!name && !cmdline && !(conf->timeout && conf->labels_count > 1))
+		boot.conf = conf_cache.path;
+
+	dprintf(SPEW, "kernel    = %s\n", boot.kernel);
+	dprintf(SPEW, "dtb       = %s\n", boot.dtb);
+	dprintf(SPEW, "dtbdir    = %s\n", boot.dtbdir);
+	for (int i = 0; boot.initramfs && boot.initramfs[i]; i++)
+		dprintf(SPEW, "initramfs = %s\n", boot.initramfs[i]);
+	dprintf(SPEW, "cmdline   = %s\n", boot.cmdline);
+
+	lk2nd_boot_label(&boot, prepare);
+	return ERR_NOT_VALID;
+}
+
+/**
+ * lk2nd_boot_files() - Boot the specified files directly
+ * @kernel: Path of the kernel
+ * @dtb: Path of the dtb
+ * @initramfs: Path of the initramfs (or NULL)
+ * @cmdline: Kernel command line (or NULL)
+ * @prepare: Called right before booting (or NULL)
+ *
+ * This works like a label in extlinux.conf, except that all paths are
+ * absolute paths in the lk file system (e.g. /<partition>/vmlinuz).
+ *
+ * Returns: Only returns on failure, with ERR_NOT_FOUND if one of the files
+ * does not exist, or ERR_NOT_VALID if they could not be booted.
+ */
+int lk2nd_boot_files(const char *kernel, const char *dtb, const char *initramfs,
+		     const char *cmdline, void (*prepare)(void))
+{
+	const char *initramfs_list[] = { initramfs, NULL };
+	struct label label = {
+		.name = kernel,
+		.kernel = kernel,
+		.dtb = dtb,
+		.initramfs = initramfs ? initramfs_list : NULL,
+		.cmdline = cmdline ? cmdline : "",
+	};
+
+	if (!fs_file_exists(kernel)) {
+		dprintf(INFO, "Kernel %s does not exist\n", kernel);
+		return ERR_NOT_FOUND;
+	}
+	if (!fs_file_exists(dtb)) {
+		dprintf(INFO, "FDT %s does not exist\n", dtb);
+		return ERR_NOT_FOUND;
+	}
+	if (initramfs && !fs_file_exists(initramfs)) {
+		dprintf(INFO, "Initramfs %s does not exist\n", initramfs);
+		return ERR_NOT_FOUND;
+	}
+
+	lk2nd_boot_label(&label, prepare);
+	return ERR_NOT_VALID;
+}
+
+/**
+ * lk2nd_boot_manifest_files() - Boot the files recorded in the boot manifest
+ * @kernel: Path of the kernel
+ * @dtb: Path of the dtb
+ * @overlays: NULL-terminated list of dtb overlays (or NULL)
+ * @initramfs: NULL-terminated list of initramfs files (or NULL)
+ * @cmdline: Kernel command line
+ *
+ * Like lk2nd_boot_files(), but the paths are used as they are.
+ */
+void lk2nd_boot_manifest_files(const char *kernel, const char *dtb, const char **overlays,
+			       const char **initramfs, const char *cmdline)
+{
+	struct label label = {
+		.name = kernel,
+		.kernel = kernel,
+		.dtb = dtb,
+		.dtboverlays = overlays,
+		.initramfs = initramfs,
+		.cmdline = cmdline,
+	};
+
+	lk2nd_boot_label(&label, NULL);
+}
+
+/**
+ * lk2nd_try_extlinux() - Try to boot with extlinux
+ *
+ * Check if /extlinux/extlinux.conf exists and try to
+ * boot it if so.
+ *
+ * Returns: Only returns on failure, see lk2nd_boot_extlinux().
+ */
+int lk2nd_try_extlinux(const char *root)
+{
+	return lk2nd_boot_extlinux(root, NULL, NULL, NULL);
 }
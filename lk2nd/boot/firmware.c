@@ -0,0 +1,247 @@
+// SPDX-License-Identifier: BSD-3-Clause
+
+#include <arch/ops.h>
+#include <debug.h>
+#include <err.h>
+#include <lib/fs.h>
+#include <libfdt.h>
+#include <printf.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <lk2nd/bootstats.h>
+#include <lk2nd/util/lkfdt.h>
+#include <lk2nd/util/mmu.h>
+
+#include "boot.h"
+
+/*
+ * firmware.c - Load remoteproc firmware into its reserved memory early.
+ *
+ * The "fwpreload" command of extlinux.conf lists firmware files (ELF/MBN, or
+ * MDT with split .bNN segments) together with the /reserved-memory node they
+ * belong to. They are loaded the same way as by qcom_mdt_load() in Linux while
+ * the kernel is still being decompressed, and the reserved-memory node is
+ * marked with "lk2nd,firmware" so the driver knows that it can skip loading
+ * the segments again. Firmware that cannot be loaded is simply skipped, Linux
+ * will then load it as usual.
+ */
+
+#define FW_HDR_MAX		(64 * 1024)
+
+#define ELF_MAGIC		"\177ELF"
+#define ELFCLASS32		1
+#define PT_LOAD			1
+
+#define QCOM_MDT_TYPE_MASK	(7 << 24)
+#define QCOM_MDT_TYPE_HASH	(2 << 24)
+#define QCOM_MDT_RELOCATABLE	(1 << 27)
+
+struct elf32_ehdr {
+	uint8_t e_ident[16];
+	uint16_t e_type;
+	uint16_t e_machine;
+	uint32_t e_version;
+	uint32_t e_entry;
+	uint32_t e_phoff;
+	uint32_t e_shoff;
+	uint32_t e_flags;
+	uint16_t e_ehsize;
+	uint16_t e_phentsize;
+	uint16_t e_phnum;
+	uint16_t e_shentsize;
+	uint16_t e_shnum;
+	uint16_t e_shstrndx;
+};
+
+struct elf32_phdr {
+	uint32_t p_type;
+	uint32_t p_offset;
+	uint32_t p_vaddr;
+	uint32_t p_paddr;
+	uint32_t p_filesz;
+	uint32_t p_memsz;
+	uint32_t p_flags;
+	uint32_t p_align;
+};
+
+static bool fw_phdr_valid(const struct elf32_phdr *phdr)
+{
+	return phdr->p_type == PT_LOAD && phdr->p_memsz &&
+	       (phdr->p_flags & QCOM_MDT_TYPE_MASK) != QCOM_MDT_TYPE_HASH;
+}
+
+/* Segments that are not in the file itself are in <name>.bNN next to it */
+static int fw_load_split(const char *path, unsigned int i, void *dst, uint32_t size)
+{
+	char split[256];
+	size_t len = strlen(path);
+	ssize_t ret;
+
+	if (len < 4 || len >= sizeof(split))
+		return ERR_NOT_VALID;
+
+	memcpy(split, path, len - 3);
+	snprintf(split + len - 3, sizeof(split) - len + 3, "b%02u", i);
+	ret = fs_load_file(split, dst, size);
+	if (ret < 0)
+		return ret;
+	return ret == (ssize_t)size ? 0 : ERR_IO;
+}
+
+/**
+ * fw_load() - Load the segments of an ELF firmware file into a carveout.
+ * @path: Path of the file
+ * @base: Start of the reserved memory
+ * @size: Size of the reserved memory
+ *
+ * Returns: 0 on success, or negative error if it does not fit or could not
+ * be read.
+ */
+static int fw_load(const char *path, uintptr_t base, uint32_t size)
+{
+	const struct elf32_ehdr *ehdr;
+	const struct elf32_phdr *phdrs, *phdr;
+	uint32_t min_addr = UINT32_MAX, max_addr = 0;
+	struct filehandle *fileh;
+	struct file_stat stat;
+	bool relocate = false;
+	intptr_t offset = 0;
+	unsigned int i;
+	void *hdr;
+	ssize_t len;
+	int ret;
+
+	ret = fs_open_file(path, &fileh);
+	if (ret < 0)
+		return ret;
+
+	hdr = malloc(FW_HDR_MAX);
+	if (!hdr) {
+		fs_close_file(fileh);
+		return ERR_NO_MEMORY;
+	}
+
+	fs_stat_file(fileh, &stat);
+	len = fs_read_file(fileh, hdr, 0, MIN(stat.size, FW_HDR_MAX));
+	if (len < 0) {
+		ret = len;
+		goto out;
+	}
+
+	ehdr = hdr;
+	phdrs = hdr + ehdr->e_phoff;
+	if (len < (ssize_t)sizeof(*ehdr) || memcmp(ehdr->e_ident, ELF_MAGIC, 4) ||
+	    ehdr->e_ident[4] != ELFCLASS32 || ehdr->e_phentsize != sizeof(*phdr) ||
+	    ehdr->e_phoff + ehdr->e_phnum * sizeof(*phdr) > (size_t)len) {
+		dprintf(INFO, "%s: Not a 32-bit ELF firmware file\n", path);
+		ret = ERR_NOT_VALID;
+		goto out;
+	}
+
+	for (i = 0; i < ehdr->e_phnum; i++) {
+		phdr = &phdrs[i];
+		if (!fw_phdr_valid(phdr))
+			continue;
+		if (phdr->p_flags & QCOM_MDT_RELOCATABLE)
+			relocate = true;
+		min_addr = MIN(min_addr, phdr->p_paddr);
+		max_addr = MAX(max_addr, phdr->p_paddr + phdr->p_memsz);
+	}
+
+	if (relocate)
+		offset = base - min_addr;
+	if (min_addr > max_addr || min_addr + offset < base ||
+	    max_addr + offset > base + size) {
+		dprintf(INFO, "%s: Segments 0x%x-0x%x do not fit into 0x%lx+0x%x\n",
+			path, min_addr, max_addr, base, size);
+		ret = ERR_TOO_BIG;
+		goto out;
+	}
+
+	for (i = 0; i < ehdr->e_phnum; i++) {
+		void *dst;
+
+		phdr = &phdrs[i];
+		if (!fw_phdr_valid(phdr))
+			continue;
+
+		dst = (void *)(phdr->p_paddr + offset);
+		if (phdr->p_offset + phdr->p_filesz <= stat.size) {
+			len = fs_read_file(fileh, dst, phdr->p_offset, phdr->p_filesz);
+			ret = len == (ssize_t)phdr->p_filesz ? 0 : ERR_IO;
+		} else {
+			ret = fw_load_split(path, i, dst, phdr->p_filesz);
+		}
+		if (ret < 0) {
+			dprintf(INFO, "%s: Failed to load segment %u: %d\n", path, i, ret);
+			goto out;
+		}
+
+		if (phdr->p_memsz > phdr->p_filesz)
+			memset(dst + phdr->p_filesz, 0, phdr->p_memsz - phdr->p_filesz);
+	}
+
+	/* Linux maps the carveout uncached */
+	arch_clean_invalidate_cache_range(min_addr + offset, max_addr - min_addr);
+
+out:
+	free(hdr);
+	fs_close_file(fileh);
+	return ret;
+}
+
+/**
+ * lk2nd_boot_firmware_preload() - Load firmware files into reserved memory.
+ * @fdt: Device tree that is booted, with space up to @fdt_size
+ * @fdt_size: Space available for the device tree
+ * @regions: Names of the /reserved-memory nodes, NULL terminated
+ * @paths: Normalized paths of the firmware files, one for each region
+ * @names: Paths as written in extlinux.conf, used in the device tree
+ */
+void lk2nd_boot_firmware_preload(void *fdt, size_t fdt_size, const char **regions,
+				 const char **paths, const char **names)
+{
+	uint32_t base, size;
+	int rmem, node, ret, bs;
+	unsigned int i;
+
+	rmem = fdt_path_offset(fdt, "/reserved-memory");
+	if (rmem < 0) {
+		dprintf(INFO, "No /reserved-memory for the firmware\n");
+		return;
+	}
+
+	ret = fdt_open_into(fdt, fdt, fdt_size);
+	if (ret < 0) {
+		dprintf(INFO, "Failed to open the dtb: %d\n", ret);
+		return;
+	}
+
+	for (i = 0; regions[i]; i++) {
+		node = fdt_subnode_offset(fdt, rmem, regions[i]);
+		if (node < 0 || lkfdt_get_reg(fdt, rmem, node, &base, &size) < 0) {
+			dprintf(INFO, "No reserved memory %s for %s\n", regions[i], paths[i]);
+			continue;
+		}
+
+		if (!lk2nd_mmu_map_ram_dynamic("firmware", base, size))
+			continue;
+
+		bs = lk2nd_bootstats_start("load %s", paths[i]);
+		ret = fw_load(paths[i], base, size);
+		lk2nd_bootstats_end(bs);
+		if (ret < 0)
+			continue;
+
+		/* Offsets change, so look up the nodes again for the next one */
+		ret = fdt_setprop_string(fdt, node, "lk2nd,firmware", names[i]);
+		if (ret < 0)
+			dprintf(INFO, "Failed to mark %s as loaded: %d\n", regions[i], ret);
+		rmem = fdt_path_offset(fdt, "/reserved-memory");
+		if (rmem < 0)
+			return;
+
+		dprintf(INFO, "Loaded %s into %s\n", paths[i], regions[i]);
+	}
+}
@@ -0,0 +1,222 @@
+// SPDX-License-Identifier: BSD-3-Clause
+
+#include <debug.h>
+#include <dev/fbcon.h>
+#include <libfdt.h>
+#include <smem.h>
+#include <stdlib.h>
+#include <target.h>
+
+#include <lk2nd/boot.h>
+#include <lk2nd/util/lkfdt.h>
+#include <lk2nd/util/mmu.h>
+
+#if WITH_LK2ND_DEVICE
+#include "../device/device.h"
+#endif
+#include "boot.h"
+
+/*
+ * layout.c - Find free RAM to place the kernel, dtb and ramdisk.
+ *
+ * The usable memory is the DDR region that contains the kernel base
+ * address. Everything that is known to be in use (lk2nd itself, the
+ * scratch area, the framebuffer and reserved-memory from the dtb) is
+ * recorded as a hole that the images must not overlap.
+ */
+
+#define LAYOUT_MAX_HOLES	32
+
+struct layout_range {
+	uint64_t start;
+	uint64_t end;
+};
+
+static struct layout_range ddr;
+static struct layout_range holes[LAYOUT_MAX_HOLES];
+static unsigned int num_holes;
+static uint32_t download_size;
+
+static void layout_add_hole(uint64_t start, uint64_t size)
+{
+	if (!size || start + size <= ddr.start || start >= ddr.end)
+		return;
+
+	if (num_holes == LAYOUT_MAX_HOLES) {
+		dprintf(CRITICAL, "layout: Too many reserved regions, ignoring 0x%llx-0x%llx\n",
+			start, start + size);
+		return;
+	}
+
+	dprintf(SPEW, "layout: Reserved 0x%llx-0x%llx\n", start, start + size);
+	holes[num_holes].start = start;
+	holes[num_holes].end = start + size;
+	num_holes++;
+}
+
+static bool layout_find_ddr(uint64_t base)
+{
+	ram_partition ptn;
+	uint32_t i;
+
+	if (!smem_ram_ptable_init_v1())
+		return false;
+
+	for (i = 0; i < smem_get_ram_ptable_len(); i++) {
+		smem_get_ram_ptable_entry(&ptn, i);
+		if (!smem_ram_ptn_is_ddr(&ptn))
+			continue;
+
+		if (base >= ptn.start && base < ptn.start + ptn.size) {
+			ddr.start = ptn.start;
+			ddr.end = MIN(ptn.start + ptn.size, 0x100000000ULL);
+			return true;
+		}
+	}
+
+	return false;
+}
+
+/**
+ * lk2nd_layout_init() - Reset the memory layout for a new boot attempt.
+ * @base: Address somewhere in the RAM region used for the boot images
+ */
+void lk2nd_layout_init(void *base)
+{
+	uint64_t scratch = (uintptr_t)target_get_scratch_address();
+	uint32_t scratch_size = download_size ?: target_get_max_flash_size();
+	struct fbcon_config *fb = fbcon_display();
+
+	num_holes = 0;
+
+	if (!layout_find_ddr((uintptr_t)base)) {
+		/* The scratch area is always in RAM, don't go past it. */
+		dprintf(INFO, "layout: RAM partitions not found, assuming RAM up to scratch end\n");
+		ddr.start = (uintptr_t)base;
+		ddr.end = scratch + scratch_size;
+	}
+
+	dprintf(SPEW, "layout: Using RAM 0x%llx-0x%llx\n", ddr.start, ddr.end);
+
+	layout_add_hole(MEMBASE, MEMSIZE);
+	layout_add_hole(scratch, scratch_size);
+	if (fb)
+		layout_add_hole((uintptr_t)fb->base, fb->stride * fb->bpp / 8 * fb->height);
+}
+
+/**
+ * lk2nd_layout_reserve_fdt() - Add memory reserved in the dtb as holes.
+ * @fdt: Device tree blob that will be passed to the kernel
+ */
+void lk2nd_layout_reserve_fdt(const void *fdt)
+{
+	uint64_t addr, size;
+	uint32_t raddr, rsize;
+	int i, offset, node;
+
+	for (i = 0; i < fdt_num_mem_rsv(fdt); i++) {
+		if (fdt_get_mem_rsv(fdt, i, &addr, &size) == 0)
+			layout_add_hole(addr, size);
+	}
+
+	offset = fdt_path_offset(fdt, "/reserved-memory");
+	if (offset < 0)
+		return;
+
+	fdt_for_each_subnode(node, fdt, offset) {
+		if (!lkfdt_node_is_available(fdt, node))
+			continue;
+
+		/* Dynamic allocations without "reg" are placed by Linux itself */
+		if (lkfdt_get_reg(fdt, offset, node, &raddr, &rsize) == 0)
+			layout_add_hole(raddr, rsize);
+	}
+}
+
+/**
+ * lk2nd_layout_find() - Find free memory for an image.
+ * @start:    Lowest acceptable address
+ * @size:     Minimum size needed
+ * @align:    Required alignment, must be a power of two
+ * @max_size: Returns the size of the free area at the returned address
+ *
+ * Returns: Address of the free area or NULL if there is none.
+ */
+void *lk2nd_layout_find(void *start, uint32_t size, uint32_t align, uint32_t *max_size)
+{
+	uint64_t addr = ROUNDUP(MAX((uintptr_t)start, ddr.start), (uint64_t)align);
+	uint64_t end;
+	unsigned int i;
+
+retry:
+	if (addr + size > ddr.end)
+		return NULL;
+
+	end = ddr.end;
+	for (i = 0; i < num_holes; i++) {
+		if (holes[i].end <= addr)
+			continue;
+
+		if (holes[i].start < addr + MAX(size, 1)) {
+			addr = ROUNDUP(holes[i].end, (uint64_t)align);
+			goto retry;
+		}
+
+		end = MIN(end, holes[i].start);
+	}
+
+	if (max_size)
+		*max_size = MIN(end - addr, UINT32_MAX);
+	return (void *)(uintptr_t)addr;
+}
+
+/**
+ * lk2nd_layout_download_size() - Find how far the download buffer can extend.
+ *
+ * The download buffer starts at the scratch address. Instead of the fixed
+ * size from the target, it is extended over the free RAM behind it, up to
+ * the end of the DDR region or the first area in use (lk2nd, framebuffer and
+ * reserved memory from the device tree of the previous bootloader). The
+ * result is computed once and kept out of the layout for later boots.
+ *
+ * Returns: Size of the download buffer in bytes.
+ */
+uint32_t lk2nd_layout_download_size(void)
+{
+	void *scratch = target_get_scratch_address();
+	uint32_t size = target_get_max_flash_size();
+	struct fbcon_config *fb = fbcon_display();
+	uint32_t max_size;
+
+	if (download_size)
+		return download_size;
+	download_size = size;
+
+	num_holes = 0;
+	if (!layout_find_ddr((uintptr_t)scratch))
+		return size;
+
+	layout_add_hole(MEMBASE, MEMSIZE);
+	if (fb)
+		layout_add_hole((uintptr_t)fb->base, fb->stride * fb->bpp / 8 * fb->height);
+#if WITH_LK2ND_DEVICE
+	if (lk2nd_dev.dtb)
+		lk2nd_layout_reserve_fdt(lk2nd_dev.dtb);
+#endif
+
+	if (lk2nd_layout_find(scratch, size, 1, &max_size) != scratch)
+		return size;
+
+	/* Whole sections (to map the rest), and the end must fit in 32 bits */
+	max_size = ROUNDDOWN(MIN(max_size, UINT32_MAX - (uintptr_t)scratch), 1024 * 1024);
+	if (max_size <= size)
+		return size;
+
+	if (!lk2nd_mmu_map_ram_dynamic("download", (uintptr_t)scratch + size, max_size - size))
+		return size;
+
+	dprintf(INFO, "layout: Download buffer 0x%lx-0x%lx (%u MiB)\n",
+		(uintptr_t)scratch, (uintptr_t)scratch + max_size, max_size / (1024 * 1024));
+	download_size = max_size;
+	return max_size;
+}
@@ -0,0 +1,453 @@
+// SPDX-License-Identifier: BSD-3-Clause
+
+#include <arch/ops.h>
+#include <crc32.h>
+#include <debug.h>
+#include <err.h>
+#include <lib/bio.h>
+#include <lib/fs.h>
+#include <list.h>
+#include <printf.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <lk2nd/bootstats.h>
+#include <lk2nd/version.h>
+
+#include "boot.h"
+
+/*
+ * manifest.c - Boot the last label again without going through the fs.
+ *
+ * After loading the default label of an extlinux.conf, the location of all
+ * files on the block device is written to the partition selected with
+ * LK2ND_BOOT_MANIFEST, similar to the map file of LILO. Together with each
+ * file, a key from the file system is saved that changes when the file is
+ * modified or replaced (for ext2: inode location, size, times & generation).
+ *
+ * On the next boot, only the keys are checked by reading the inodes directly.
+ * If all of them still match, a small read-only file system is mounted in
+ * place of the real one, which reads the files straight from the recorded
+ * extents under the same paths. The label is then loaded as usual, so
+ * decompression and the boot cache work exactly the same. If anything does
+ * not match, the normal scan of all partitions follows.
+ *
+ * The extlinux.conf is part of the manifest as well, so changes of it (e.g.
+ * of the default label or the command line) are noticed.
+ */
+
+#define MANIFEST_MAGIC		0x4d324b4c /* LK2M */
+#define MANIFEST_VERSION	1
+#define MANIFEST_MAX_FILES	8
+#define MANIFEST_MAX_EXTENTS	256
+#define MANIFEST_BOUNCE_SIZE	(16 * 1024)
+
+enum manifest_type {
+	MANIFEST_CONF,
+	MANIFEST_KERNEL,
+	MANIFEST_DTB,
+	MANIFEST_OVERLAY,
+	MANIFEST_INITRAMFS,
+};
+
+struct manifest_extent {
+	uint64_t offset;	/* 0 for holes */
+	uint64_t len;
+};
+
+struct manifest_file {
+	char path[96];		/* Including the mount point */
+	struct file_key key;
+	uint64_t size;
+	uint32_t mtime;
+	uint16_t type;
+	uint16_t extent_count;
+	uint32_t extent;	/* Index of the first extent */
+	uint32_t reserved;
+};
+
+struct manifest_hdr {
+	uint32_t magic;
+	uint32_t crc;		/* Of everything below */
+	uint32_t version;
+	uint32_t file_count;
+	uint32_t extent_count;
+	uint32_t reserved;
+	char lk2nd_version[40];
+	char device[24];
+	char cmdline[512];
+	struct manifest_file files[MANIFEST_MAX_FILES];
+	struct manifest_extent extents[MANIFEST_MAX_EXTENTS];
+};
+
+static bdev_t *manifest_dev;
+static bool manifest_probed;
+static bool manifest_booting;
+static struct manifest_hdr manifest __ALIGNED(CACHE_LINE);
+
+/* Data device of the mounted manifest, see bootmap_mount() */
+static bdev_t *bootmap_dev;
+
+static uint32_t manifest_crc(const struct manifest_hdr *hdr)
+{
+	return crc32(~0L, (const void *)&hdr->version,
+		     sizeof(*hdr) - offsetof(struct manifest_hdr, version)) ^ ~0L;
+}
+
+static bdev_t *manifest_find_dev(void)
+{
+	struct bdev_struct *bdevs = bio_get_bdevs();
+	bdev_t *bdev;
+
+	list_for_every_entry(&bdevs->list, bdev, bdev_t, node) {
+		if (bdev->label && !strcmp(bdev->label, LK2ND_BOOT_MANIFEST))
+			return bio_open(bdev->name);
+	}
+
+	return NULL;
+}
+
+/* Open the partition and read the manifest, once. */
+static bool manifest_probe(void)
+{
+	ssize_t ret;
+
+	if (manifest_probed)
+		return manifest_dev;
+	manifest_probed = true;
+
+	manifest_dev = manifest_find_dev();
+	if (!manifest_dev) {
+		dprintf(INFO, "boot-manifest: No partition with label %s\n", LK2ND_BOOT_MANIFEST);
+		return false;
+	}
+
+	if (manifest_dev->size < (off_t)sizeof(manifest)) {
+		dprintf(INFO, "boot-manifest: %s is too small\n", manifest_dev->name);
+		bio_close(manifest_dev);
+		manifest_dev = NULL;
+		return false;
+	}
+
+	ret = bio_read(manifest_dev, &manifest, 0, sizeof(manifest));
+	if (ret != sizeof(manifest) || manifest.magic != MANIFEST_MAGIC ||
+	    manifest.version != MANIFEST_VERSION || manifest.crc != manifest_crc(&manifest) ||
+	    manifest.file_count > MANIFEST_MAX_FILES ||
+	    manifest.extent_count > MANIFEST_MAX_EXTENTS ||
+	    strncmp(manifest.lk2nd_version, LK2ND_VERSION, sizeof(manifest.lk2nd_version)))
+		memset(&manifest, 0, sizeof(manifest));
+
+	return true;
+}
+
+static status_t bootmap_mount(struct bdev *dev, fscookie **cookie)
+{
+	unsigned int i;
+	status_t ret;
+
+	for (i = 0; i < manifest.file_count; i++) {
+		struct manifest_file *f = &manifest.files[i];
+
+		if (f->extent > MANIFEST_MAX_EXTENTS ||
+		    f->extent_count > MANIFEST_MAX_EXTENTS - f->extent)
+			return ERR_NOT_VALID;
+
+		ret = fs_check_key(dev->name, &f->key);
+		if (ret < 0) {
+			dprintf(INFO, "boot-manifest: %s has changed: %d\n", f->path, ret);
+			return ret;
+		}
+	}
+
+	bootmap_dev = dev;
+	*cookie = (fscookie *)&manifest;
+	return 0;
+}
+
+static status_t bootmap_unmount(fscookie *cookie)
+{
+	bootmap_dev = NULL;
+	return 0;
+}
+
+static status_t bootmap_open(fscookie *cookie, const char *path, filecookie **fcookie)
+{
+	size_t skip = strlen(manifest.device) + 1;
+	unsigned int i;
+
+	for (i = 0; i < manifest.file_count; i++) {
+		if (!strcmp(manifest.files[i].path + skip, path)) {
+			*fcookie = (filecookie *)&manifest.files[i];
+			return 0;
+		}
+	}
+
+	return ERR_NOT_FOUND;
+}
+
+static status_t bootmap_stat(filecookie *fcookie, struct file_stat *stat)
+{
+	const struct manifest_file *f = (const struct manifest_file *)fcookie;
+
+	stat->is_dir = false;
+	stat->size = f->size;
+	stat->mtime = f->mtime;
+	return 0;
+}
+
+/* Read from the device, through a bounce buffer if @buf cannot be used for DMA */
+static ssize_t bootmap_read_dev(void *buf, uint64_t offset, size_t len)
+{
+	static uint8_t bounce[MANIFEST_BOUNCE_SIZE] __ALIGNED(CACHE_LINE);
+	size_t done, n;
+	ssize_t ret;
+
+	if ((addr_t)buf % CACHE_LINE == 0)
+		return bio_read(bootmap_dev, buf, offset, len);
+
+	for (done = 0; done < len; done += n) {
+		n = MIN(len - done, sizeof(bounce));
+		ret = bio_read(bootmap_dev, bounce, offset + done, n);
+		if (ret != (ssize_t)n)
+			return ret < 0 ? ret : ERR_IO;
+		memcpy((uint8_t *)buf + done, bounce, n);
+	}
+
+	return len;
+}
+
+static ssize_t bootmap_read(filecookie *fcookie, void *buf, off_t offset, size_t len)
+{
+	const struct manifest_file *f = (const struct manifest_file *)fcookie;
+	const struct manifest_extent *e = &manifest.extents[f->extent];
+	uint64_t start = 0, skip, n;
+	size_t done = 0;
+	unsigned int i;
+	ssize_t ret;
+
+	if (offset < 0 || (uint64_t)offset >= f->size)
+		return 0;
+	len = MIN((uint64_t)len, f->size - offset);
+
+	for (i = 0; i < f->extent_count && done < len; start += e[i].len, i++) {
+		if ((uint64_t)offset + done >= start + e[i].len)
+			continue;
+
+		skip = offset + done - start;
+		n = MIN(e[i].len - skip, (uint64_t)(len - done));
+		if (e[i].offset) {
+			ret = bootmap_read_dev((uint8_t *)buf + done, e[i].offset + skip, n);
+			if (ret != (ssize_t)n)
+				return ret < 0 ? ret : ERR_IO;
+		} else {
+			memset((uint8_t *)buf + done, 0, n);
+		}
+		done += n;
+	}
+
+	return done == len ? (ssize_t)len : ERR_IO;
+}
+
+static status_t bootmap_close(filecookie *fcookie)
+{
+	return 0;
+}
+
+static const struct fs_api bootmap_api = {
+	.mount = bootmap_mount,
+	.unmount = bootmap_unmount,
+	.open = bootmap_open,
+	.stat = bootmap_stat,
+	.read = bootmap_read,
+	.close = bootmap_close,
+};
+
+/* Collect the paths of the given type, NULL-terminated */
+static const char **manifest_paths(const char **paths, enum manifest_type type)
+{
+	unsigned int i, n = 0;
+
+	for (i = 0; i < manifest.file_count; i++)
+		if (manifest.files[i].type == type)
+			paths[n++] = manifest.files[i].path;
+	paths[n] = NULL;
+
+	return n ? paths : NULL;
+}
+
+/**
+ * lk2nd_boot_manifest() - Boot the files recorded in the boot manifest.
+ *
+ * Only returns if there is no valid manifest or if booting failed.
+ */
+void lk2nd_boot_manifest(void)
+{
+	static bool registered;
+	const char *overlays[MANIFEST_MAX_FILES + 1];
+	const char *initramfs[MANIFEST_MAX_FILES + 1];
+	const char *kernel[2], *dtb[2];
+	char mountpoint[sizeof(manifest.device) + 1];
+	int ret, bs;
+
+	if (!manifest_probe() || !manifest.magic)
+		return;
+
+	if (!manifest_paths(kernel, MANIFEST_KERNEL) || !manifest_paths(dtb, MANIFEST_DTB))
+		return;
+
+	if (!registered) {
+		fs_register_type("lk2nd-manifest", &bootmap_api);
+		registered = true;
+	}
+
+	snprintf(mountpoint, sizeof(mountpoint), "/%s", manifest.device);
+	bs = lk2nd_bootstats_start("check boot manifest");
+	ret = fs_mount(mountpoint, "lk2nd-manifest", manifest.device);
+	lk2nd_bootstats_end(bs);
+	if (ret < 0) {
+		dprintf(INFO, "boot-manifest: Not using the manifest: %d\n", ret);
+		return;
+	}
+
+	dprintf(INFO, "boot-manifest: Booting %s from %s\n", kernel[0], manifest.device);
+	manifest_booting = true;
+	lk2nd_bootstats_source(manifest.device);
+	lk2nd_boot_manifest_files(kernel[0], dtb[0], manifest_paths(overlays, MANIFEST_OVERLAY),
+				  manifest_paths(initramfs, MANIFEST_INITRAMFS), manifest.cmdline);
+	manifest_booting = false;
+	lk2nd_bootstats_source("");
+
+	/* Make room for the real file system */
+	fs_unmount(mountpoint);
+	dprintf(INFO, "boot-manifest: Failed to boot, scanning all partitions\n");
+}
+
+/* Add the file with all its extents, merging adjacent ones */
+static bool manifest_add(struct manifest_hdr *hdr, const char *path, enum manifest_type type)
+{
+	struct manifest_file *f;
+	struct manifest_extent *last = NULL;
+	struct file_extent ext;
+	struct file_stat stat;
+	filehandle *fileh;
+	uint64_t offset;
+	bool ok = false;
+
+	if (hdr->file_count == MANIFEST_MAX_FILES || strlen(path) >= sizeof(f->path) ||
+	    strncmp(path + 1, hdr->device, strlen(hdr->device)) ||
+	    path[strlen(hdr->device) + 1] != '/')
+		return false;
+
+	if (fs_open_file(path, &fileh) < 0)
+		return false;
+
+	f = &hdr->files[hdr->file_count];
+	strlcpy(f->path, path, sizeof(f->path));
+	f->type = type;
+	f->extent = hdr->extent_count;
+
+	if (fs_stat_file(fileh, &stat) < 0 || stat.is_dir || fs_file_key(fileh, &f->key) < 0)
+		goto out;
+	f->size = stat.size;
+	f->mtime = stat.mtime;
+
+	for (offset = 0; offset < f->size; offset += ext.len) {
+		if (fs_map_file(fileh, offset, &ext) < 0 || !ext.len)
+			goto out;
+
+		if (last && (last->offset ? ext.offset == last->offset + last->len : !ext.offset)) {
+			last->len += ext.len;
+			continue;
+		}
+
+		if (hdr->extent_count == MANIFEST_MAX_EXTENTS) {
+			dprintf(INFO, "boot-manifest: %s is too fragmented\n", path);
+			goto out;
+		}
+		last = &hdr->extents[hdr->extent_count++];
+		last->offset = ext.offset;
+		last->len = ext.len;
+		f->extent_count++;
+	}
+
+	hdr->file_count++;
+	ok = true;
+out:
+	fs_close_file(fileh);
+	return ok;
+}
+
+static bool manifest_add_list(struct manifest_hdr *hdr, const char **paths,
+			      enum manifest_type type)
+{
+	for (; paths && *paths; paths++)
+		if (!manifest_add(hdr, *paths, type))
+			return false;
+	return true;
+}
+
+/**
+ * lk2nd_boot_manifest_record() - Save the location of the files for next boot.
+ * @conf:      Path of the extlinux.conf with the booted (default) label
+ * @kernel:    Path of the kernel
+ * @dtb:       Path of the dtb
+ * @overlays:  NULL-terminated list of dtb overlays (or NULL)
+ * @initramfs: NULL-terminated list of initramfs files (or NULL)
+ * @cmdline:   Kernel command line
+ *
+ * All files must be on the same file system. Nothing is written if the
+ * manifest is up to date or if the file system cannot be mapped.
+ */
+void lk2nd_boot_manifest_record(const char *conf, const char *kernel, const char *dtb,
+				const char **overlays, const char **initramfs,
+				const char *cmdline)
+{
+	struct manifest_hdr *hdr;
+	const char *end;
+	ssize_t ret;
+	int bs;
+
+	if (manifest_booting || !manifest_probe())
+		return;
+
+	end = strchr(conf + 1, '/');
+	if (conf[0] != '/' || !end || end - conf - 1 >= (int)sizeof(hdr->device) ||
+	    strlen(cmdline) >= sizeof(hdr->cmdline))
+		return;
+
+	hdr = memalign(CACHE_LINE, sizeof(*hdr));
+	if (!hdr)
+		return;
+
+	bs = lk2nd_bootstats_start("write boot manifest");
+	memset(hdr, 0, sizeof(*hdr));
+	strlcpy(hdr->lk2nd_version, LK2ND_VERSION, sizeof(hdr->lk2nd_version));
+	strlcpy(hdr->device, conf + 1, end - conf);
+	strlcpy(hdr->cmdline, cmdline, sizeof(hdr->cmdline));
+
+	if (!manifest_add(hdr, conf, MANIFEST_CONF) ||
+	    !manifest_add(hdr, kernel, MANIFEST_KERNEL) ||
+	    !manifest_add(hdr, dtb, MANIFEST_DTB) ||
+	    !manifest_add_list(hdr, overlays, MANIFEST_OVERLAY) ||
+	    !manifest_add_list(hdr, initramfs, MANIFEST_INITRAMFS)) {
+		dprintf(INFO, "boot-manifest: Cannot map the files of %s\n", conf);
+		memset(hdr, 0, sizeof(*hdr));
+	} else {
+		hdr->magic = MANIFEST_MAGIC;
+		hdr->version = MANIFEST_VERSION;
+		hdr->crc = manifest_crc(hdr);
+	}
+
+	if (memcmp(hdr, &manifest, sizeof(*hdr))) {
+		dprintf(INFO, "boot-manifest: Writing the manifest for %s\n", kernel);
+		ret = bio_write(manifest_dev, hdr, 0, sizeof(*hdr));
+		if (ret != sizeof(*hdr))
+			dprintf(INFO, "boot-manifest: Failed to write: %ld\n", ret);
+		else
+			memcpy(&manifest, hdr, sizeof(*hdr));
+	}
+
+	lk2nd_bootstats_end(bs);
+	free(hdr);
+}
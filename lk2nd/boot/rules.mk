@@ -4,9 +4,23 @@ LOCAL_DIR := $(GET_LOCAL_DIR)
 MODULES += \
 	lib/bio \
 	lib/fs \
+	lib/lz4 \
 	lk2nd/hw/bdev \
+	lk2nd/persist \
 
 OBJS += \
 	$(LOCAL_DIR)/boot.o \
 	$(LOCAL_DIR)/extlinux.o \
+	$(LOCAL_DIR)/firmware.o \
+	$(LOCAL_DIR)/layout.o \
 	$(LOCAL_DIR)/util.o \
+
+ifneq ($(LK2ND_BOOT_CACHE),)
+DEFINES += LK2ND_BOOT_CACHE="$(LK2ND_BOOT_CACHE)"
+OBJS += $(LOCAL_DIR)/cache.o
+endif
+
+ifneq ($(LK2ND_BOOT_MANIFEST),)
+DEFINES += LK2ND_BOOT_MANIFEST="$(LK2ND_BOOT_MANIFEST)"
+OBJS += $(LOCAL_DIR)/manifest.o
+endif
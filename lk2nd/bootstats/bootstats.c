@@ -0,0 +1,260 @@
+// SPDX-License-Identifier: BSD-3-Clause
+
+#include <bits.h>
+#include <boot.h>
+#include <debug.h>
+#include <fastboot.h>
+#include <kernel/thread.h>
+#include <libfdt.h>
+#include <platform.h>
+#include <printf.h>
+#include <stdarg.h>
+#include <string.h>
+
+#include <lk2nd/bootstats.h>
+#include <lk2nd/pmu.h>
+
+#include "history.h"
+
+/*
+ * bootstats.c - Measure how long the individual boot phases take.
+ *
+ * The sleep clock keeps running since power on, so the timestamps also
+ * show how long it took until lk2nd was started. The table can be read
+ * with "fastboot oem boot-stats" and is passed to the OS in /chosen.
+ *
+ * With LK2ND_PMU, the CPU performance counters are recorded for each phase
+ * as well and can be fetched with "fastboot oem pmu".
+ */
+
+#define BOOTSTATS_MAX_ENTRIES	64
+#define BOOTSTATS_NAME_LEN	40
+#define SCLK_HZ			32768
+
+struct bootstats_entry {
+	char name[BOOTSTATS_NAME_LEN];
+	uint32_t start;		/* us */
+	uint32_t end;		/* us, 0 if still running */
+	unsigned int depth;
+#if WITH_LK2ND_PMU
+	struct lk2nd_pmu_counts pmu;	/* At start, difference once ended */
+#endif
+};
+
+static struct bootstats_entry entries[BOOTSTATS_MAX_ENTRIES];
+static unsigned int num_entries, depth;
+
+uint32_t bootstats_now(void)
+{
+	uint32_t sclk = platform_get_sclk_count();
+
+	if (sclk)
+		return (uint64_t)sclk * 1000000 / SCLK_HZ;
+
+	/* No sleep clock on this platform, timestamps start at lk2nd */
+	return current_time() * 1000;
+}
+
+static uint32_t bootstats_duration(const struct bootstats_entry *e)
+{
+	return (e->end ? e->end : bootstats_now()) - e->start;
+}
+
+/* When lk2nd started, or at least the first phase */
+uint32_t bootstats_first_start(void)
+{
+	return num_entries ? entries[0].start : 0;
+}
+
+/**
+ * bootstats_longest() - Find the longest finished phases.
+ * @phases: Returns the phases, longest first
+ * @max:    Size of @phases
+ *
+ * Return: Number of phases returned.
+ */
+unsigned int bootstats_longest(struct history_phase *phases, unsigned int max)
+{
+	unsigned int i, j, n = 0;
+	uint32_t duration;
+
+	for (i = 0; i < num_entries; i++) {
+		if (!entries[i].end)
+			continue;
+
+		duration = bootstats_duration(&entries[i]);
+		for (j = n; j > 0 && phases[j - 1].duration < duration; j--) {
+			if (j < max)
+				phases[j] = phases[j - 1];
+		}
+		if (j == max)
+			continue;
+
+		strlcpy(phases[j].name, entries[i].name, sizeof(phases[j].name));
+		phases[j].duration = duration;
+		if (n < max)
+			n++;
+	}
+
+	return n;
+}
+
+int lk2nd_bootstats_start(const char *fmt, ...)
+{
+	struct bootstats_entry *e;
+	va_list ap;
+
+	int id;
+
+	if (!num_entries)
+		lk2nd_pmu_start(BIT(LK2ND_PMU_NUM_COUNTERS) - 1);
+
+	enter_critical_section();
+	if (num_entries == BOOTSTATS_MAX_ENTRIES) {
+		exit_critical_section();
+		return -1;
+	}
+
+	id = num_entries++;
+	e = &entries[id];
+	va_start(ap, fmt);
+	vsnprintf(e->name, sizeof(e->name), fmt, ap);
+	va_end(ap);
+
+	e->depth = depth++;
+	e->end = 0;
+	e->start = bootstats_now();
+#if WITH_LK2ND_PMU
+	lk2nd_pmu_read(&e->pmu);
+#endif
+	exit_critical_section();
+
+	return id;
+}
+
+void lk2nd_bootstats_end(int id)
+{
+	if (id < 0 || (unsigned int)id >= num_entries || entries[id].end)
+		return;
+
+	enter_critical_section();
+	entries[id].end = bootstats_now();
+#if WITH_LK2ND_PMU
+	{
+		struct lk2nd_pmu_counts now;
+		unsigned int i;
+
+		lk2nd_pmu_read(&now);
+		for (i = 0; i < LK2ND_PMU_NUM_COUNTERS; i++)
+			entries[id].pmu.val[i] = now.val[i] - entries[id].pmu.val[i];
+	}
+#endif
+	if (depth)
+		depth--;
+	exit_critical_section();
+}
+
+static void cmd_oem_boot_stats(const char *arg, void *data, unsigned sz)
+{
+	char response[MAX_RSP_SIZE - 4];
+	struct bootstats_entry *e;
+	uint32_t duration;
+	unsigned int i;
+
+	fastboot_info("   start ms    took ms  phase");
+	for (i = 0; i < num_entries; i++) {
+		e = &entries[i];
+		duration = bootstats_duration(e);
+		snprintf(response, sizeof(response), "%7u.%03u %6u.%03u%c %*s%s",
+			 e->start / 1000, e->start % 1000,
+			 duration / 1000, duration % 1000,
+			 e->end ? ' ' : '+', e->depth * 2, "", e->name);
+		fastboot_info(response);
+	}
+	fastboot_okay("");
+}
+FASTBOOT_REGISTER("oem boot-stats", cmd_oem_boot_stats);
+
+#if WITH_LK2ND_PMU
+/*
+ * Stage a table with the PMU counter differences of each finished phase,
+ * too wide for the fastboot INFO responses.
+ */
+static void cmd_oem_pmu(const char *arg, void *data, unsigned sz)
+{
+	const struct lk2nd_pmu_counts *c;
+	char *out = data;
+	unsigned int i, j;
+	uint32_t ipc;
+
+	out += sprintf(out, "%-*s", BOOTSTATS_NAME_LEN + 8, "phase");
+	for (j = 0; j < LK2ND_PMU_NUM_COUNTERS; j++)
+		out += sprintf(out, " %12s", lk2nd_pmu_counter_name(j));
+	out += sprintf(out, "   ipc\n");
+
+	for (i = 0; i < num_entries; i++) {
+		if (!entries[i].end)
+			continue;
+
+		c = &entries[i].pmu;
+		out += sprintf(out, "%*s%-*s", entries[i].depth * 2, "",
+			       BOOTSTATS_NAME_LEN + 8 - entries[i].depth * 2, entries[i].name);
+		for (j = 0; j < LK2ND_PMU_NUM_COUNTERS; j++)
+			out += sprintf(out, " %12u", c->val[j]);
+
+		ipc = 0;
+		if (c->val[LK2ND_PMU_CYCLES])
+			ipc = (uint64_t)c->val[LK2ND_PMU_INSTRUCTIONS] * 100 /
+			      c->val[LK2ND_PMU_CYCLES];
+		out += sprintf(out, " %2u.%02u\n", ipc / 100, ipc % 100);
+	}
+
+	fastboot_stage(data, out - (char *)data);
+}
+FASTBOOT_REGISTER("oem pmu", cmd_oem_pmu);
+#endif
+
+static int lk2nd_bootstats_dt_update(void *dtb, const char *cmdline,
+				     enum boot_type boot_type)
+{
+	unsigned int i, n = num_entries;
+	int offset, len = 0;
+	fdt32_t *stats;
+	char *names;
+
+	if (boot_type & (BOOT_DOWNSTREAM | BOOT_LK2ND) || !n)
+		return 0;
+
+	offset = fdt_path_offset(dtb, "/chosen");
+	if (offset < 0)
+		return 0;
+
+	/*
+	 * lk2nd,boot-stats has a <start duration> pair in microseconds
+	 * for each name in lk2nd,boot-stats-names. Both are written at once,
+	 * appending entry by entry would move the rest of the tree each time.
+	 */
+	for (i = 0; i < n; i++)
+		len += strlen(entries[i].name) + 1;
+
+	if (fdt_setprop_placeholder(dtb, offset, "lk2nd,boot-stats-names",
+				    len, (void **)&names) < 0)
+		return 0;
+	for (i = 0; i < n; i++) {
+		len = strlen(entries[i].name) + 1;
+		memcpy(names, entries[i].name, len);
+		names += len;
+	}
+
+	if (fdt_setprop_placeholder(dtb, offset, "lk2nd,boot-stats",
+				    n * 2 * sizeof(*stats), (void **)&stats) < 0)
+		return 0;
+	for (i = 0; i < n; i++) {
+		*stats++ = cpu_to_fdt32(entries[i].start);
+		*stats++ = cpu_to_fdt32(bootstats_duration(&entries[i]));
+	}
+
+	return 0;
+}
+DEV_TREE_UPDATE_SIZE(lk2nd_bootstats_dt_update,
+		     BOOTSTATS_MAX_ENTRIES * (BOOTSTATS_NAME_LEN + 2 * sizeof(uint32_t)) + 64);
@@ -0,0 +1,290 @@
+// SPDX-License-Identifier: BSD-3-Clause
+
+#include <arch/ops.h>
+#include <boot.h>
+#include <crc32.h>
+#include <debug.h>
+#include <fastboot.h>
+#include <kernel/thread.h>
+#include <lib/bio.h>
+#include <libfdt.h>
+#include <printf.h>
+#include <string.h>
+#include <target.h>
+
+#include <lk2nd/bootstats.h>
+#include <lk2nd/init.h>
+#include <lk2nd/util/scratch.h>
+#include <lk2nd/version.h>
+
+#include "history.h"
+
+/*
+ * history.c - Keep a compact record of the last boots.
+ *
+ * Each boot adds a record with the lk2nd version, the boot source, the
+ * longest boot phases, how much was read from the boot source and how much
+ * was decompressed to a ring right below the persist region (and ramoops)
+ * at the end of the scratch area. The ring is reserved in the device tree,
+ * so it survives as long as the RAM is retained (i.e. warm reboots, not
+ * power cycles). The records are staged by "fastboot oem boot-history" and
+ * passed to the OS in /chosen, one line per boot, oldest first.
+ */
+
+#define HISTORY_ABOVE_SIZE	((512 + 64) * 1024)	/* ramoops and persist */
+#define HISTORY_REGION_SIZE	(8 * 1024)
+#define HISTORY_MAGIC		0x48324b4c /* LK2H */
+#define HISTORY_RECORDS		24
+#define HISTORY_VERSION_LEN	32
+#define HISTORY_SOURCE_LEN	16
+#define HISTORY_LINE_LEN	512
+
+struct history_record {
+	uint32_t crc;		/* of the rest of the record */
+	uint32_t seq;		/* 0 if unused */
+	char version[HISTORY_VERSION_LEN];
+	char source[HISTORY_SOURCE_LEN];
+	uint32_t start;		/* us since power on until lk2nd started */
+	uint32_t total;		/* us since power on until the kernel was started */
+	uint32_t read_bytes;	/* from the boot source */
+	uint32_t read_time;	/* us */
+	uint32_t packed;	/* compressed kernel and initramfs */
+	uint32_t unpacked;
+	struct history_phase phases[HISTORY_PHASES];
+};
+
+struct history_ring {
+	uint32_t magic;
+	uint32_t next;
+	struct history_record records[HISTORY_RECORDS];
+};
+
+static char source[HISTORY_SOURCE_LEN];
+static uint32_t packed, unpacked;
+
+static struct history_ring *history_base(void)
+{
+	return target_get_scratch_address() + target_get_max_flash_size()
+	       - HISTORY_ABOVE_SIZE - HISTORY_REGION_SIZE;
+}
+
+static uint32_t history_crc(const struct history_record *r)
+{
+	return crc32(~0L, (const void *)&r->seq, sizeof(*r) - sizeof(r->crc)) ^ ~0L;
+}
+
+static bool history_valid(const struct history_record *r)
+{
+	return r->seq && r->crc == history_crc(r);
+}
+
+/* Records that do not match their checksum are simply skipped later */
+static void history_init(void)
+{
+	struct history_ring *ring = history_base();
+
+	if (!lk2nd_scratch_claim("boot-history", ring, HISTORY_REGION_SIZE))
+		return;
+
+	if (ring->magic != HISTORY_MAGIC || ring->next >= HISTORY_RECORDS) {
+		memset(ring, 0, sizeof(*ring));
+		ring->magic = HISTORY_MAGIC;
+	}
+}
+LK2ND_INIT_PRIO(history_init, LK2ND_INIT_PRIO_EARLY);
+
+void lk2nd_bootstats_source(const char *name)
+{
+	strlcpy(source, name, sizeof(source));
+}
+
+void lk2nd_bootstats_unpacked(size_t in, size_t out)
+{
+	enter_critical_section();
+	packed += in;
+	unpacked += out;
+	exit_critical_section();
+}
+
+static void history_add(enum boot_type boot_type)
+{
+	struct history_ring *ring = history_base();
+	struct history_record *r;
+	uint32_t seq = 0;
+	unsigned int i;
+#if WITH_LIB_BIO
+	bdev_t *bdev;
+#endif
+
+	for (i = 0; i < HISTORY_RECORDS; i++) {
+		if (history_valid(&ring->records[i]) && ring->records[i].seq > seq)
+			seq = ring->records[i].seq;
+	}
+
+	r = &ring->records[ring->next];
+	memset(r, 0, sizeof(*r));
+	r->seq = seq + 1;
+	strlcpy(r->version, LK2ND_VERSION, sizeof(r->version));
+	if (*source)
+		strlcpy(r->source, source, sizeof(r->source));
+	else
+		strlcpy(r->source, boot_type & BOOT_ANDROID ? "android" : "unknown",
+			sizeof(r->source));
+
+	r->start = bootstats_first_start();
+	r->total = bootstats_now();
+	bootstats_longest(r->phases, HISTORY_PHASES);
+
+#if WITH_LIB_BIO
+	bdev = *source ? bio_open(source) : NULL;
+	if (bdev) {
+		r->read_bytes = bdev->stats.read.bytes;
+		r->read_time = bdev->stats.read.time;
+		bio_close(bdev);
+	}
+#endif
+
+	enter_critical_section();
+	r->packed = packed;
+	r->unpacked = unpacked;
+	exit_critical_section();
+
+	r->crc = history_crc(r);
+	ring->next = (ring->next + 1) % HISTORY_RECORDS;
+	arch_clean_invalidate_cache_range((addr_t)ring, sizeof(*ring));
+}
+
+/*
+ * One line of "key=value" pairs. The phases come last, separated by ';',
+ * each with its duration after the last ':' (names may contain spaces).
+ */
+static int history_format(const struct history_record *r, char *buf, size_t len)
+{
+	unsigned int i;
+	int n;
+
+	n = snprintf(buf, len, "seq=%u version=%s source=%s start_ms=%u total_ms=%u "
+		     "read_bytes=%u read_ms=%u packed=%u unpacked=%u phases=",
+		     r->seq, r->version, r->source, r->start / 1000, r->total / 1000,
+		     r->read_bytes, r->read_time / 1000, r->packed, r->unpacked);
+
+	for (i = 0; i < HISTORY_PHASES && r->phases[i].name[0] && n < (int)len; i++)
+		n += snprintf(buf + n, len - n, "%s%s:%u", i ? ";" : "",
+			      r->phases[i].name, r->phases[i].duration / 1000);
+
+	return MIN(n, (int)len - 1);
+}
+
+/* Valid records, oldest first */
+static const struct history_record *history_get(unsigned int i)
+{
+	struct history_ring *ring = history_base();
+	const struct history_record *r;
+
+	r = &ring->records[(ring->next + i) % HISTORY_RECORDS];
+	return history_valid(r) ? r : NULL;
+}
+
+static void cmd_oem_boot_history(const char *arg, void *data, unsigned sz)
+{
+	struct history_ring *ring = history_base();
+	const struct history_record *r;
+	char *out = data;
+	unsigned int i;
+
+	if (!strcmp(arg, "clear")) {
+		memset(ring->records, 0, sizeof(ring->records));
+		arch_clean_invalidate_cache_range((addr_t)ring, sizeof(*ring));
+		fastboot_okay("");
+		return;
+	}
+	if (*arg) {
+		fastboot_fail("invalid argument");
+		return;
+	}
+
+	for (i = 0; i < HISTORY_RECORDS; i++) {
+		r = history_get(i);
+		if (!r)
+			continue;
+
+		out += history_format(r, out, HISTORY_LINE_LEN);
+		*out++ = '\n';
+	}
+
+	fastboot_stage(data, out - (char *)data);
+}
+FASTBOOT_REGISTER("oem boot-history", cmd_oem_boot_history);
+
+/* Keep Linux away from the ring, so it survives until the next boot */
+static void history_dt_reserve(void *dtb)
+{
+	struct history_ring *ring = history_base();
+	int rmem, offset, ret;
+	char name[40];
+
+	rmem = fdt_path_offset(dtb, "/reserved-memory");
+	if (rmem < 0)
+		return;
+
+	snprintf(name, sizeof(name), "lk2nd-boot-history@%08x", (uint32_t)ring);
+	offset = fdt_add_subnode(dtb, rmem, name);
+	if (offset < 0)
+		return;
+
+	ret = fdt_setprop_empty(dtb, offset, "reg");
+	if (ret < 0)
+		return;
+
+	fdt_appendprop_addrrange(dtb, rmem, offset, "reg", (uint32_t)ring, HISTORY_REGION_SIZE);
+}
+
+static int lk2nd_boot_history_dt_update(void *dtb, const char *cmdline,
+					enum boot_type boot_type)
+{
+	static bool added;
+	char line[HISTORY_LINE_LEN];
+	const struct history_record *r;
+	unsigned int i;
+	int offset, len = 0;
+	char *lines;
+
+	/* The next lk2nd adds its own record */
+	if (boot_type & BOOT_LK2ND)
+		return 0;
+
+	if (!added) {
+		history_add(boot_type);
+		added = true;
+	}
+
+	if (boot_type & BOOT_DOWNSTREAM)
+		return 0;
+
+	history_dt_reserve(dtb);
+
+	offset = fdt_path_offset(dtb, "/chosen");
+	if (offset < 0)
+		return 0;
+
+	/* lk2nd,boot-history is a string list with one line for each boot */
+	for (i = 0; i < HISTORY_RECORDS; i++) {
+		r = history_get(i);
+		if (r)
+			len += history_format(r, line, sizeof(line)) + 1;
+	}
+
+	if (!len || fdt_setprop_placeholder(dtb, offset, "lk2nd,boot-history",
+					    len, (void **)&lines) < 0)
+		return 0;
+
+	for (i = 0; i < HISTORY_RECORDS; i++) {
+		r = history_get(i);
+		if (r)
+			lines += history_format(r, lines, HISTORY_LINE_LEN) + 1;
+	}
+
+	return 0;
+}
+DEV_TREE_UPDATE_SIZE(lk2nd_boot_history_dt_update,
+		     HISTORY_RECORDS * HISTORY_LINE_LEN + 128);
@@ -0,0 +1,20 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+#ifndef LK2ND_BOOTSTATS_HISTORY_H
+#define LK2ND_BOOTSTATS_HISTORY_H
+
+#include <stdint.h>
+
+#define HISTORY_PHASES		6
+#define HISTORY_NAME_LEN	20
+
+struct history_phase {
+	char name[HISTORY_NAME_LEN];
+	uint32_t duration;	/* us */
+};
+
+/* bootstats.c */
+uint32_t bootstats_now(void);
+uint32_t bootstats_first_start(void);
+unsigned int bootstats_longest(struct history_phase *phases, unsigned int max);
+
+#endif /* LK2ND_BOOTSTATS_HISTORY_H */
@@ -0,0 +1,11 @@
+# SPDX-License-Identifier: BSD-3-Clause
+LOCAL_DIR := $(GET_LOCAL_DIR)
+
+OBJS += \
+	$(LOCAL_DIR)/bootstats.o \
+
+ifneq ($(filter LK2ND_BOOT_HISTORY=1,$(DEFINES)),)
+OBJS += \
+	$(LOCAL_DIR)/history.o \
+
+endif
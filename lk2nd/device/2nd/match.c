@@ -97,7 +97,17 @@ static bool match_device_node(const void *dtb, int node)
 
 int lk2nd_device2nd_match_device_node(const void *dtb, int lk2nd_node)
 {
-	int node;
+	const fdt32_t *index;
+	int node, count, i;
+
+	count = lk2nd_device_get_index(dtb, lk2nd_node, &index);
+	for (i = 0; i < count; i++) {
+		node = lk2nd_node + fdt32_to_cpu(index[i]);
+		if (match_device_node(dtb, node))
+			return node;
+	}
+	if (count)
+		return -FDT_ERR_NOTFOUND;
 
 	fdt_for_each_subnode(node, dtb, lk2nd_node)
 		if (match_device_node(dtb, node))
@@ -185,6 +185,12 @@ const void *lk2nd_device2nd_parse_tags(void)
 	return NULL;
 }
 
+const void *lk2nd_device2nd_get_tags(unsigned *size)
+{
+	*size = parsed_tags_size;
+	return parsed_tags;
+}
+
 /* Fastboot */
 static void cmd_oem_parsed_tags(const char *arg, void *data, unsigned sz)
 {
@@ -25,11 +25,15 @@ endif
 include $(if $(BUILD_GPL),$(LOCAL_DIR)/gpl/rules.mk)
 
 ifneq ($(OUTBOOTIMG),)
+# Self-decompressing image
+OUTBINLK2ND := $(OUTBIN)
+include $(if $(filter 1, $(LK2ND_COMPRESS)), lk2nd/unpack/rules.mk)
+
 # Appended DTBs
-OUTBINDTB := $(OUTBIN)
+OUTBINDTB := $(OUTBINLK2ND)
 ifneq ($(ADTBS),)
 OUTBINDTB := $(OUTBIN)-dtb
-$(OUTBINDTB): $(OUTBIN) $(ADTBS)
+$(OUTBINDTB): $(OUTBINLK2ND) $(ADTBS)
 	@echo generating image with $(words $(ADTBS)) appended DTBs: $@
 	$(NOECHO)cat $^ > $@
 endif
@@ -2,10 +2,11 @@
 /* Copyright (c) 2019-2022, Stephan Gerhold <stephan@gerhold.net> */
 
 #include <debug.h>
+#include <kernel/thread.h>
 #include <platform/timer.h>
 
 #include <libfdt.h>
-#include <lk2nd/hw/gpio_i2c.h>
+#include <lk2nd/hw/i2c.h>
 
 #include "device.h"
 
@@ -27,21 +28,21 @@
 static int samsung_muic_reset(const void *dtb, int node)
 {
 	uint8_t addr, val = 1;
-	gpio_i2c_info_t i2c;
+	struct lk2nd_i2c i2c;
 	status_t status;
 
-	status = gpio_i2c_get(dtb, node, &i2c, &addr);
+	status = lk2nd_i2c_get(dtb, node, &i2c, &addr);
 	if (status)
 		return status;
 
-	status = gpio_i2c_write_reg_bytes(&i2c, addr, MUIC_RESET_REG, &val, 1);
+	status = lk2nd_i2c_write_reg_bytes(&i2c, addr, MUIC_RESET_REG, &val, 1);
 	if (status) {
 		dprintf(CRITICAL, "muic-reset: I2C write error: %d\n", status);
 		return status;
 	}
 
 	/* Wait a bit to let the MUIC detect the cable again */
-	mdelay(250);
+	delay_or_sleep(250);
 	dprintf(INFO, "muic-reset: Successful, earlier UART log might be lost!\n");
 	return 0;
 }
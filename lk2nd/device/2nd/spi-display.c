@@ -11,9 +11,10 @@
 
 #include "device.h"
 
-static void mdss_spi_flush(void)
+static void mdss_spi_flush(unsigned y, unsigned height)
 {
-	mdss_spi_on(NULL, fbcon_display());
+	/* Only send the rows that were changed since the last flush */
+	mdss_spi_update_region(fbcon_display(), y, height);
 }
 
 static void lk2nd_device2nd_init_spi_display(void)
@@ -41,7 +42,7 @@ static void lk2nd_device2nd_init_spi_display(void)
 	fb.stride = fb.width;
 	fb.bpp = 16;
 	fb.format = FB_FORMAT_RGB565;
-	fb.update_start = mdss_spi_flush;
+	fb.update_region = mdss_spi_flush;
 
 	ret = mdss_spi_init();
 	if (ret) {
@@ -11,6 +11,7 @@
 #include <lk2nd/init.h>
 #include <lk2nd/panel.h>
 #include <lk2nd/util/lkfdt.h>
+#include <lk2nd/util/mmu.h>
 
 #include "device.h"
 #include "sdhc.h"
@@ -33,9 +34,49 @@ uint32_t lk2nd_device_get_sd_mmc_slot_num(void)
 	return lk2nd_dev.sd_mmc_slot_number;
 }
 
+/**
+ * lk2nd_device_get_index() - Get the index of the device nodes in the DTB.
+ * @dtb: Device tree blob
+ * @lk2nd_node: Offset of the /lk2nd node
+ * @index: Output for the node offsets, relative to @lk2nd_node
+ *
+ * The index is generated at build time by lk2nd/scripts/dtb-match-index.py.
+ * It allows checking the device nodes without walking through the subtrees
+ * of all the other devices in between.
+ *
+ * Return: Number of device nodes in the index, 0 if there is no valid index.
+ */
+int lk2nd_device_get_index(const void *dtb, int lk2nd_node, const fdt32_t **index)
+{
+	const fdt32_t *val;
+	int len, count, i;
+
+	val = fdt_getprop(dtb, lk2nd_node, "lk2nd,match-index", &len);
+	if (!val || len < 2 * (int)sizeof(*val))
+		return 0;
+
+	/* The index is only valid for the tree it was generated for */
+	count = fdt32_to_cpu(val[1]);
+	if (fdt32_to_cpu(val[0]) != fdt_size_dt_struct(dtb) ||
+	    len != (2 + count) * (int)sizeof(*val))
+		return 0;
+
+	val += 2;
+	for (i = 0; i < count; i++) {
+		if (fdt_next_tag(dtb, lk2nd_node + fdt32_to_cpu(val[i]), NULL) != FDT_BEGIN_NODE) {
+			dprintf(CRITICAL, "Invalid lk2nd device index\n");
+			return 0;
+		}
+	}
+
+	*index = val;
+	return count;
+}
+
 static int find_device_node(const void *dtb)
 {
-	int lk2nd_node, node, ret;
+	const fdt32_t *index;
+	int lk2nd_node, node, ret, count, i;
 
 	lk2nd_node = fdt_path_offset(dtb, "/lk2nd");
 	if (lk2nd_node < 0)
@@ -50,6 +91,15 @@ static int find_device_node(const void *dtb)
 			return -FDT_ERR_NOTFOUND;
 
 		/* Search in subnodes instead */
+		count = lk2nd_device_get_index(dtb, lk2nd_node, &index);
+		for (i = 0; i < count; i++) {
+			node = lk2nd_node + fdt32_to_cpu(index[i]);
+			if (fdt_node_check_compatible(dtb, node, lk2nd_dev.compatible) == 0)
+				return node;
+		}
+		if (count)
+			return -FDT_ERR_NOTFOUND;
+
 		fdt_for_each_subnode(node, dtb, lk2nd_node)
 			if (fdt_node_check_compatible(dtb, node, lk2nd_dev.compatible) == 0)
 				return node;
@@ -64,16 +114,37 @@ static int find_device_node(const void *dtb)
 	return lk2nd_device2nd_match_device_node(dtb, lk2nd_node);
 }
 
+#define MAX_DEFERRED_INIT	8
+
+static struct {
+	const struct lk2nd_device_init *di;
+	int node;
+} deferred_init[MAX_DEFERRED_INIT];
+static unsigned int num_deferred_init;
+
+static void run_device_init(const void *dtb, int node,
+			    const struct lk2nd_device_init *di)
+{
+	int ret = di->init(dtb, node);
+
+	if (ret)
+		dprintf(CRITICAL, "lk2nd device init for %s failed: %d\n",
+			di->compatible, ret);
+}
+
 static bool do_device_init(const void *dtb, int node,
 			   const struct lk2nd_device_init *di)
 {
 	int ret = fdt_node_check_compatible(dtb, node, di->compatible);
 	switch (ret) {
 	case 0:
-		ret = di->init(dtb, node);
-		if (ret)
-			dprintf(CRITICAL, "lk2nd device init for %s failed: %d\n",
-				di->compatible, ret);
+		if (di->deferred && num_deferred_init < MAX_DEFERRED_INIT) {
+			deferred_init[num_deferred_init].di = di;
+			deferred_init[num_deferred_init].node = node;
+			num_deferred_init++;
+			return true;
+		}
+		run_device_init(dtb, node, di);
 		return true;
 	case 1:
 		return false;	/* Not compatible */
@@ -184,8 +255,23 @@ static void lk2nd_device_init(void)
 
 	lk2nd_dev.dtb = dtb;
 	parse_dtb(dtb);
+
+#if LK2ND_MAP_DDR
+	lk2nd_mmu_map_ddr(dtb);
+#endif
+}
+LK2ND_INIT_PRIO(lk2nd_device_init, LK2ND_INIT_PRIO_DEVICE);
+
+static void lk2nd_device_init_deferred(void)
+{
+	unsigned int i;
+
+	for (i = 0; i < num_deferred_init; i++)
+		run_device_init(lk2nd_dev.dtb, deferred_init[i].node,
+				deferred_init[i].di);
 }
-LK2ND_INIT(lk2nd_device_init);
+LK2ND_INIT_DEFERRED(lk2nd_device_init_deferred,
+		    LK2ND_INIT_NEED_FASTBOOT | LK2ND_INIT_NEED_MENU);
 
 static unsigned char *concat_cmdline(const char *a, const char *b)
 {
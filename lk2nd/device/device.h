@@ -2,6 +2,7 @@
 #ifndef LK2ND_DEVICE_DEVICE_H
 #define LK2ND_DEVICE_DEVICE_H
 
+#include <libfdt.h>
 #include <stdbool.h>
 
 struct lk2nd_panel {
@@ -48,6 +49,8 @@ struct lk2nd_device {
 };
 extern struct lk2nd_device lk2nd_dev;
 
+int lk2nd_device_get_index(const void *dtb, int lk2nd_node, const fdt32_t **index);
+
 #if WITH_LK2ND_DEVICE_2ND
 const void *lk2nd_device2nd_init(void);
 int lk2nd_device2nd_match_device_node(const void *dtb, int lk2nd_node);
@@ -59,9 +62,18 @@ static inline int lk2nd_device2nd_match_device_node(const void *dtb, int lk2nd_n
 struct lk2nd_device_init {
 	const char *compatible;
 	int (*init)(const void *dtb, int node);
+	bool deferred;
 };
 #define LK2ND_DEVICE_INIT(compatible, handler) \
 	static const struct lk2nd_device_init _lk2nd_device_init_##handler \
-		__SECTION(".lk2nd_device_init") __USED = { (compatible), (handler) }
+		__SECTION(".lk2nd_device_init") __USED = { (compatible), (handler), false }
+
+/*
+ * Like LK2ND_DEVICE_INIT(), but only run once fastboot or the menu is entered.
+ * For hardware that is only needed for user interaction within lk2nd.
+ */
+#define LK2ND_DEVICE_INIT_DEFERRED(compatible, handler) \
+	static const struct lk2nd_device_init _lk2nd_device_init_##handler \
+		__SECTION(".lk2nd_device_init") __USED = { (compatible), (handler), true }
 
 #endif /* LK2ND_DEVICE_DEVICE_H */
@@ -3,6 +3,7 @@ LOCAL_DIR := $(GET_LOCAL_DIR)
 
 INCLUDES += -I$(LOCAL_DIR)/include
 DT_INCLUDES := -I$(LOCAL_DIR) -I$(LOCAL_DIR)/include -I$(BUILDDIR)
+DTB_POSTPROCESS := lk2nd/scripts/dtb-match-index.py
 
 -include $(LOCAL_DIR)/$(TARGET)/rules.mk
 
@@ -50,4 +50,4 @@ static int lk2nd_leds_init(const void *dtb, int node)
 	return 0;
 }
 
-LK2ND_DEVICE_INIT("gpio-leds", lk2nd_leds_init);
+LK2ND_DEVICE_INIT_DEFERRED("gpio-leds", lk2nd_leds_init);
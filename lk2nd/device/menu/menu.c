@@ -13,6 +13,9 @@
 #include <sys/types.h>
 
 #include <lk2nd/device/keys.h>
+#include <lk2nd/device/menu.h>
+#include <lk2nd/init.h>
+#include <lk2nd/logo.h>
 #include <lk2nd/util/minmax.h>
 #include <lk2nd/version.h>
 
@@ -90,19 +93,36 @@ static uint16_t lk2nd_boot_pressed_key(void)
 
 #define LONG_PRESS_DURATION 1000
 
-static uint16_t wait_key(void)
+/*
+ * Reading the keys may involve several SPMI transactions, so polling them
+ * every millisecond keeps the CPU and the PMIC arbiter busy for no reason.
+ * A key press lasts at least 50-100 ms, so 20 ms is still plenty.
+ */
+#define KEY_POLL_INTERVAL 20
+
+/**
+ * wait_key_timeout() - Wait until a key is pressed and released.
+ * @timeout: Time in ms to wait for a key press, or 0 to wait forever
+ *
+ * Returns: The keycode, or 0 if no key was pressed within @timeout.
+ */
+static uint16_t wait_key_timeout(unsigned int timeout)
 {
+	time_t start = current_time();
 	uint16_t keycode = 0;
 	int press_start = 0;
 	int press_duration;
 
-	while (!(keycode = lk2nd_boot_pressed_key()))
-		thread_sleep(1);
+	while (!(keycode = lk2nd_boot_pressed_key())) {
+		if (timeout && current_time() - start >= timeout)
+			return 0;
+		thread_sleep(KEY_POLL_INTERVAL);
+	}
 
 	press_start = current_time();
 
 	while (lk2nd_keys_pressed(keycode)) {
-		thread_sleep(1);
+		thread_sleep(KEY_POLL_INTERVAL);
 
 		press_duration = current_time() - press_start;
 		if (lk2nd_dev.single_key && press_duration > LONG_PRESS_DURATION)
@@ -118,6 +138,11 @@ static uint16_t wait_key(void)
 	return keycode;
 }
 
+static uint16_t wait_key(void)
+{
+	return wait_key_timeout(0);
+}
+
 #define xstr(s) str(s)
 #define str(s) #s
 
@@ -159,6 +184,21 @@ static struct {
 		y += incr; \
 	} while(0)
 
+static int menu_draw_help(int y, int incr)
+{
+	if (lk2nd_dev.single_key) {
+		fbcon_puts_ln(SILVER, y, incr, true, "Short press to navigate.");
+		fbcon_puts_ln(SILVER, y, incr, true, "Long press to select.");
+	} else {
+		fbcon_printf_ln(SILVER, y, incr, true, "%s to navigate.",
+				(lk2nd_dev.menu_keys.navigate ? lk2nd_dev.menu_keys.navigate : "Volume keys"));
+		fbcon_printf_ln(SILVER, y, incr, true, "%s to select.",
+				(lk2nd_dev.menu_keys.select ? lk2nd_dev.menu_keys.select : "Power key"));
+	}
+
+	return y;
+}
+
 void display_fastboot_menu(void)
 {
 	struct fbcon_config *fb = fbcon_display();
@@ -166,9 +206,14 @@ void display_fastboot_menu(void)
 	unsigned int sel = 0, i;
 	bool armv8 = is_scm_armv8_support();
 
+	lk2nd_init_require(LK2ND_INIT_NEED_MENU);
+
 	if (!fb)
 		return;
 
+	/* Avoid flicker while the menu is redrawn, if supported */
+	fbcon_enable_double_buffer();
+
 	/*
 	 * Make sure the specified line lenght fits on the screen.
 	 */
@@ -205,15 +250,7 @@ void display_fastboot_menu(void)
 	y_menu = y;
 	y += incr * (ARRAY_SIZE(menu_options) + 1);
 
-	if (lk2nd_dev.single_key) {
-		fbcon_puts_ln(SILVER, y, incr, true, "Short press to navigate.");
-		fbcon_puts_ln(SILVER, y, incr, true, "Long press to select.");
-	} else {
-		fbcon_printf_ln(SILVER, y, incr, true, "%s to navigate.",
-				(lk2nd_dev.menu_keys.navigate ? lk2nd_dev.menu_keys.navigate : "Volume keys"));
-		fbcon_printf_ln(SILVER, y, incr, true, "%s to select.",
-				(lk2nd_dev.menu_keys.select ? lk2nd_dev.menu_keys.select : "Power key"));
-	}
+	y = menu_draw_help(y, incr);
 
 	/*
 	 * Draw the device-specific information at the bottom of the screen
@@ -267,6 +304,7 @@ void display_fastboot_menu(void)
 				y, incr, true, ">> %s <<",
 				menu_options[sel].name
 			);
+			fbcon_disable_double_buffer();
 			menu_options[sel].action();
 			break;
 		case KEY_VOLUMEUP:
@@ -284,6 +322,96 @@ void display_fastboot_menu(void)
 	}
 }
 
+#define MENU_TICK	1000U
+
+unsigned int lk2nd_menu_select(const char *title, const char *const *items,
+			       unsigned int count, unsigned int sel,
+			       unsigned int timeout)
+{
+	struct fbcon_config *fb;
+	int y, y_menu, y_timeout, incr;
+	unsigned int i;
+
+	lk2nd_init_require(LK2ND_INIT_NEED_MENU);
+
+	fb = fbcon_display();
+	if (!fb || count == 0)
+		return sel;
+
+	fbcon_enable_double_buffer();
+
+	scale_factor = max(1U, min(fb->width, fb->height) / (FONT_WIDTH * MIN_LINE));
+	incr = FONT_HEIGHT * scale_factor;
+	y = incr * 2;
+
+	fbcon_clear();
+
+	fbcon_puts_ln(WHITE, y, incr, true, title ? title : "Boot menu");
+	y += incr;
+
+	/* Skip lines for the entries */
+	y_menu = y;
+	y += incr * (count + 1);
+
+	y = menu_draw_help(y, incr);
+	y_timeout = y + incr;
+
+	while (true) {
+		y = y_menu;
+		fbcon_clear_msg(y / FONT_HEIGHT, (y / FONT_HEIGHT + count * scale_factor));
+		for (i = 0; i < count; ++i) {
+			fbcon_printf_ln(
+				i == sel ? WHITE : SILVER,
+				y, incr, true, "%c %s %c",
+				i == sel ? '>' : ' ',
+				items[i],
+				i == sel ? '<' : ' '
+			);
+		}
+
+		fbcon_clear_msg(y_timeout / FONT_HEIGHT, y_timeout / FONT_HEIGHT + scale_factor);
+		if (timeout)
+			fbcon_printf(SILVER, y_timeout, true, "Booting in %u s ...",
+				     (timeout + MENU_TICK - 1) / MENU_TICK);
+
+		fbcon_flush();
+
+		/* Wake up every second to update the countdown */
+		switch (wait_key_timeout(min(timeout, MENU_TICK))) {
+		case 0:
+			timeout -= min(timeout, MENU_TICK);
+			if (!timeout)
+				goto out;
+			break;
+		case KEY_POWER:
+			goto out;
+		case KEY_VOLUMEUP:
+			timeout = 0;
+			if (sel == 0)
+				sel = count - 1;
+			else
+				sel--;
+			break;
+		case KEY_VOLUMEDOWN:
+			timeout = 0;
+			sel++;
+			if (sel >= count)
+				sel = 0;
+			break;
+		default:
+			/* Any key stops the countdown */
+			timeout = 0;
+			break;
+		}
+	}
+
+out:
+	fbcon_clear();
+	fbcon_flush();
+	fbcon_disable_double_buffer();
+	return sel;
+}
+
 void display_default_image_on_screen(void);
 void display_default_image_on_screen(void)
 {
@@ -297,7 +425,8 @@ void display_default_image_on_screen(void)
 	incr = FONT_HEIGHT * scale_factor;
 	y = fb->height - 3 * incr;
 
-	fbcon_clear_msg(y / FONT_HEIGHT, y / FONT_HEIGHT + 3 * scale_factor);
+	if (!lk2nd_logo_draw())
+		fbcon_clear_msg(y / FONT_HEIGHT, y / FONT_HEIGHT + 3 * scale_factor);
 
 	fbcon_puts_ln(WHITE, y, incr, true, xstr(BOARD));
 	fbcon_puts_ln(SILVER, y, incr, true, LK2ND_VERSION);
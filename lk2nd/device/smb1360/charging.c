@@ -0,0 +1,116 @@
+// SPDX-License-Identifier: BSD-3-Clause
+
+#include <bits.h>
+#include <debug.h>
+#include <dev/keys.h>
+#include <kernel/thread.h>
+#include <platform.h>
+#include <target.h>
+
+#include <libfdt.h>
+#include <lk2nd/display.h>
+#include <lk2nd/hw/i2c.h>
+#include <lk2nd/init.h>
+#include <lk2nd/device/keys.h>
+#include <lk2nd/util/cmdline.h>
+
+#include "../device.h"
+
+/*
+ * charging.c - Low-power off-mode charging for smb1360 devices.
+ *
+ * When the device was powered on by plugging in the charger, wait in a loop
+ * with the panel turned off instead of showing the menu/booting the OS. The
+ * CPU is idle (WFI) between short polls of the power key and the charger
+ * status. A power key press reboots the device to boot normally, when the
+ * charger stops charging (battery full or unplugged) the device is powered
+ * off again.
+ *
+ * There is no interrupt support for the PMIC/charger in lk, so both are polled
+ * with a low rate. This works best with LK2ND_TICKLESS=1, so the CPU is only
+ * woken up for the polls.
+ */
+
+#define SMB1360_STATUS_3_REG		0x4b
+#define SMB1360_CHG_HOLD_OFF		BIT(3)
+#define SMB1360_CHG_TYPE(val)		BITS_SHIFT(val, 2, 1)	/* 0: not charging */
+
+#define CHARGING_KEY_POLL_MS		200
+#define CHARGING_STATUS_POLL_MS		10000
+#define CHARGING_IDLE_COUNT		3	/* "not charging" reads before power off */
+
+static struct lk2nd_i2c smb1360_i2c;
+static uint8_t smb1360_addr;
+static bool smb1360_charging;
+
+static int smb1360_charging_init(const void *dtb, int node)
+{
+	status_t status;
+
+	status = lk2nd_i2c_get(dtb, node, &smb1360_i2c, &smb1360_addr);
+	if (status) {
+		dprintf(CRITICAL, "smb1360: Failed to get I2C bus: %d\n", status);
+		return status;
+	}
+
+	smb1360_charging = true;
+	return 0;
+}
+LK2ND_DEVICE_INIT("qcom,smb1360-charging", smb1360_charging_init);
+
+static bool smb1360_is_charging(void)
+{
+	status_t status;
+	uint8_t val;
+
+	status = lk2nd_i2c_read_reg_bytes(&smb1360_i2c, smb1360_addr,
+					  SMB1360_STATUS_3_REG, &val, 1);
+	if (status) {
+		dprintf(CRITICAL, "smb1360: Failed to read status: %d\n", status);
+		return false;
+	}
+
+	dprintf(SPEW, "smb1360: status 3: %#x\n", val);
+	return SMB1360_CHG_TYPE(val) && !(val & SMB1360_CHG_HOLD_OFF);
+}
+
+static bool smb1360_charger_boot(void)
+{
+#if WITH_LK2ND_DEVICE_2ND
+	if (lk2nd_dev.cmdline &&
+	    lk2nd_cmdline_scan(lk2nd_dev.cmdline, "androidboot.mode=charger"))
+		return true;
+#endif
+	return target_pause_for_battery_charge();
+}
+
+static void smb1360_charging_loop(void)
+{
+	unsigned int idle = 0;
+	time_t next_status = 0;
+
+	if (!smb1360_charging || !smb1360_charger_boot())
+		return;
+
+	dprintf(INFO, "smb1360: Powered on by charger, entering off-mode charging\n");
+	lk2nd_display_off();
+
+	while (true) {
+		if (lk2nd_keys_pressed(KEY_POWER)) {
+			dprintf(INFO, "smb1360: Power key pressed, rebooting\n");
+			reboot_device(0);
+		}
+
+		if ((int)(current_time() - next_status) >= 0) {
+			next_status = current_time() + CHARGING_STATUS_POLL_MS;
+			idle = smb1360_is_charging() ? 0 : idle + 1;
+			if (idle >= CHARGING_IDLE_COUNT) {
+				dprintf(INFO, "smb1360: Not charging anymore, powering off\n");
+				shutdown_device();
+			}
+		}
+
+		thread_sleep(CHARGING_KEY_POLL_MS);
+	}
+}
+LK2ND_INIT(smb1360_charging_loop);
@@ -1,5 +1,10 @@
 # SPDX-License-Identifier: BSD-3-Clause
 LOCAL_DIR := $(GET_LOCAL_DIR)
 
-OBJS += $(LOCAL_DIR)/smb1360.o
+MODULES += lk2nd/hw/i2c
+
+OBJS += \
+	$(LOCAL_DIR)/charging.o \
+	$(LOCAL_DIR)/smb1360.o \
+
 include $(if $(BUILD_GPL), $(LOCAL_DIR)/gpl/rules.mk)
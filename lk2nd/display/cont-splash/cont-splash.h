@@ -11,6 +11,9 @@ void mdp_enable_autorefresh(struct fbcon_config *fb);
 void mdp_set_rgb565(struct fbcon_config *fb);
 void mdp_set_xrgb8888(struct fbcon_config *fb);
 void mdp_relocate(struct fbcon_config *fb, void *target);
+bool mdp_roi_supported(struct fbcon_config *fb);
+void mdp_set_roi(struct fbcon_config *fb, unsigned y, unsigned height);
+void mdp_reset_roi(struct fbcon_config *fb);
 
 void fb_convert_to_xrgb8888(struct fbcon_config *fb);
 
@@ -7,6 +7,9 @@
 #include <dev/fbcon.h>
 #include <reg.h>
 #include <arch/ops.h>
+#include <kernel/thread.h>
+
+#include <lk2nd/util/memcpy.h>
 
 #include "cont-splash.h"
 #include "mdp.h"
@@ -31,6 +34,7 @@
 struct mdp_pipe {
 	const char *name;
 	uint32_t base;
+	uint32_t flush;
 };
 
 static const struct mdp_pipe mdp_pipes[] = {
@@ -43,14 +47,17 @@ static const struct mdp_pipe mdp_pipes[] = {
 	{
 		.name = "VIG_0",
 		.base = MDP_VP_0_VIG_0_BASE,
+		.flush = BIT(0),
 	},
 	{
 		.name = "RGB_0",
 		.base = MDP_VP_0_RGB_0_BASE,
+		.flush = BIT(3),
 	},
 	{
 		.name = "DMA_0",
 		.base = MDP_VP_0_DMA_0_BASE,
+		.flush = BIT(11),
 	},
 #endif
 };
@@ -68,6 +75,32 @@ static const struct mdp_pipe *mdp_find_pipe(struct fbcon_config *fb)
 	return NULL;
 }
 
+#if MDP5
+static struct fbcon_config *flip_fb;
+static const struct mdp_pipe *flip_pipe;
+
+static void mdp_flip(void *base)
+{
+	int timeout = 50;
+
+	writel((uint32_t)base, flip_pipe->base + PIPE_SRC0_ADDR);
+	writel(flip_pipe->flush, MDP_CTL_0_BASE + CTL_FLUSH);
+
+	/* Command mode panels pick up the new address with the next refresh */
+	if (flip_fb->update_start)
+		return;
+
+	/* Otherwise wait until the flush was applied at the start of a frame */
+	while (readl(MDP_CTL_0_BASE + CTL_FLUSH) & flip_pipe->flush) {
+		if (--timeout == 0) {
+			dprintf(CRITICAL, "Display flip: flush timeout\n");
+			return;
+		}
+		thread_sleep(1);
+	}
+}
+#endif
+
 bool mdp_read_pipe_config(struct fbcon_config *fb)
 {
 	uint32_t src_size, img_size, src_xy, out_size, out_xy, stride, format, bpp;
@@ -110,6 +143,12 @@ bool mdp_read_pipe_config(struct fbcon_config *fb)
 	else
 		fb->format = FB_FORMAT_RGB888;
 
+#if MDP5
+	flip_fb = fb;
+	flip_pipe = pipe;
+	fb->flip = mdp_flip;
+#endif
+
 	return true;
 }
 
@@ -193,7 +232,7 @@ void mdp_relocate(struct fbcon_config *fb, void *target)
 
 	fb_size = fb->stride * (fb->bpp / 8) * fb->height;
 
-	memcpy(target, fb->base, fb_size);
+	lk2nd_memcpy(target, fb->base, fb_size);
 	arch_clean_cache_range((addr_t)target, fb_size);
 
 #if MDP4
@@ -207,3 +246,45 @@ void mdp_relocate(struct fbcon_config *fb, void *target)
 
 	fb->base = target;
 }
+
+#if MDP5
+#define CTL_FLUSH_LM0	BIT(6)
+
+/*
+ * Partial updates are only supported for the simple setup with one pipe
+ * that covers the whole layer mixer without cropping or scaling.
+ */
+bool mdp_roi_supported(struct fbcon_config *fb)
+{
+	const struct mdp_pipe *pipe;
+	uint32_t size = fb->height << 16 | fb->width;
+
+	pipe = mdp_find_pipe(fb);
+	if (!pipe)
+		return false;
+
+	return readl(pipe->base + PIPE_SRC_XY) == 0 &&
+	       readl(pipe->base + PIPE_OUT_XY) == 0 &&
+	       readl(pipe->base + PIPE_SRC_SIZE) == size &&
+	       readl(pipe->base + PIPE_SRC_OUT_SIZE) == size &&
+	       readl(MDP_VP_0_MIXER_0_BASE + LAYER_0_OUT_SIZE) == size;
+}
+
+/* Fetch and blend only the lines y to y + height - 1 with the next refresh */
+void mdp_set_roi(struct fbcon_config *fb, unsigned y, unsigned height)
+{
+	const struct mdp_pipe *pipe;
+	uint32_t size = height << 16 | fb->width;
+
+	pipe = mdp_find_pipe(fb);
+	if (!pipe)
+		return;
+
+	writel(y << 16, pipe->base + PIPE_SRC_XY);
+	writel(size, pipe->base + PIPE_SRC_SIZE);
+	writel(size, pipe->base + PIPE_SRC_OUT_SIZE);
+	writel(size, MDP_VP_0_MIXER_0_BASE + LAYER_0_OUT_SIZE);
+
+	writel(pipe->flush | CTL_FLUSH_LM0, MDP_CTL_0_BASE + CTL_FLUSH);
+}
+#endif
@@ -6,7 +6,11 @@
 #include <dev/fbcon.h>
 #include <kernel/event.h>
 #include <kernel/thread.h>
+#include <lk2nd/display.h>
+#include <mipi_dsi.h>
+#include <platform.h>
 #include <reg.h>
+#include <stdlib.h>
 
 #include "cont-splash.h"
 #include "mdp.h"
@@ -22,6 +26,117 @@ static void mdp_refresh(void)
 #endif
 }
 
+#if MDP5 && defined(COMMAND_MODE_MDP_STREAM0_TOTAL)
+#define MDP_PARTIAL_UPDATE	1
+
+/* Some panels need even page addresses, keep some margin for all of them */
+#define MDP_ROI_ALIGN		16
+/* Time for the panel TE signal and the transfer of a full frame at 60 Hz */
+#define MDP_CMD_FRAME_TIME	34 /* ms */
+
+#define DSI_STATUS		(CTRL + 0x4)
+#define DSI_STATUS_CMD_MODE_MDP_BUSY	BIT(2)
+
+static struct fbcon_config *roi_fb;
+static unsigned roi_y, roi_height;
+static time_t last_refresh;
+
+static void mdp_cmd_wait_idle(void)
+{
+	time_t elapsed = current_time() - last_refresh;
+	int timeout = 100;
+
+	/* The engine is only busy after the TE signal, so wait for that first */
+	if (elapsed < MDP_CMD_FRAME_TIME)
+		thread_sleep(MDP_CMD_FRAME_TIME - elapsed);
+
+	while (readl(MIPI_DSI0_BASE + DSI_STATUS) & DSI_STATUS_CMD_MODE_MDP_BUSY) {
+		if (--timeout == 0) {
+			dprintf(CRITICAL, "Display refresh: DSI still busy\n");
+			return;
+		}
+		thread_sleep(1);
+	}
+}
+
+/* Limit the window that the panel writes to and the size of the DSI stream */
+static void dsi_set_rows(unsigned y, unsigned height)
+{
+	unsigned end = y + height - 1;
+	char payload[12] = {
+		0x05, 0x00, 0x39, 0xc0,		/* DCS long write, 5 bytes */
+		0x2b, y >> 8, y & 0xff, end >> 8, end & 0xff,	/* set_page_address */
+		0xff, 0xff, 0xff,
+	};
+	struct mipi_dsi_cmd cmd = {
+		.size = sizeof(payload),
+		.payload = payload,
+	};
+	uint32_t total = readl(MIPI_DSI0_BASE + COMMAND_MODE_MDP_STREAM0_TOTAL);
+
+	mdss_dsi_cmds_tx(NULL, &cmd, 1, 0);
+	writel(height << 16 | MDP_X(total), MIPI_DSI0_BASE + COMMAND_MODE_MDP_STREAM0_TOTAL);
+}
+
+static void mdp_cmd_set_roi(unsigned y, unsigned height)
+{
+	if (y == roi_y && height == roi_height)
+		return;
+
+	mdp_cmd_wait_idle();
+	dsi_set_rows(y, height);
+	mdp_set_roi(roi_fb, y, height);
+
+	roi_y = y;
+	roi_height = height;
+}
+
+static void mdp_cmd_refresh_region(unsigned y, unsigned height)
+{
+	unsigned end = MIN(ROUNDUP(y + height, MDP_ROI_ALIGN), roi_fb->height);
+
+	y = ROUNDDOWN(y, MDP_ROI_ALIGN);
+	mdp_cmd_set_roi(y, end - y);
+	mdp_refresh();
+	last_refresh = current_time();
+}
+
+static void mdp_cmd_refresh_full(void)
+{
+	mdp_cmd_refresh_region(0, roi_fb->height);
+}
+
+/**
+ * mdp_reset_roi() - Restore full frame updates before handing over the display
+ */
+void mdp_reset_roi(struct fbcon_config *fb)
+{
+	if (!roi_fb)
+		return;
+
+	mdp_cmd_set_roi(0, roi_fb->height);
+	if (fb->update_start == mdp_cmd_refresh_full)
+		fb->update_start = mdp_refresh;
+	fb->update_region = NULL;
+	roi_fb = NULL;
+}
+
+static bool mdp_cmd_setup_partial(struct fbcon_config *fb)
+{
+	uint32_t total = readl(MIPI_DSI0_BASE + COMMAND_MODE_MDP_STREAM0_TOTAL);
+
+	if (MDP_Y(total) != fb->height || !mdp_roi_supported(fb))
+		return false;
+
+	roi_fb = fb;
+	roi_y = 0;
+	roi_height = fb->height;
+	return true;
+}
+#else
+void mdp_reset_roi(struct fbcon_config *fb) { }
+#endif
+
 static int mdp_cmd_refresh_loop(void *data)
 {
 	while (true) {
@@ -62,10 +177,24 @@ static void mdp_setup_cmd_refresh(struct fbcon_config *fb)
 	 * printed which is very slow. Throttle this using a thread that limits
 	 * refreshes to ~50 Hz.
 	 */
-	if (IS_ENABLED(FBCON_DISPLAY_MSG))
+	if (IS_ENABLED(FBCON_DISPLAY_MSG)) {
 		mdp_cmd_refresh_start_thread(fb);
-	else
-		fb->update_start = mdp_refresh;
+		return;
+	}
+
+	fb->update_start = mdp_refresh;
+
+#if MDP_PARTIAL_UPDATE
+	/*
+	 * The lk2nd menu only redraws a few lines at a time, so transfer only
+	 * the changed lines to the panel instead of the whole frame.
+	 */
+	if (mdp_cmd_setup_partial(fb)) {
+		dprintf(INFO, "Display refresh: partial updates enabled\n");
+		fb->update_start = mdp_cmd_refresh_full;
+		fb->update_region = mdp_cmd_refresh_region;
+	}
+#endif
 }
 
 bool mdp_setup_refresh(struct fbcon_config *fb)
@@ -154,6 +283,7 @@ void mdp_enable_autorefresh(struct fbcon_config *fb)
 	if (!fb || !fb->update_start)
 		return;
 
+	mdp_reset_roi(fb);
 	fb->update_start = NULL;
 	thread_sleep(42);
 
@@ -164,3 +294,63 @@ void mdp_enable_autorefresh(struct fbcon_config *fb)
 	mdp3_enable_auto_refresh(fb);
 #endif
 }
+
+#if MDP5
+uint32_t mdss_mdp_intf_offset(void);
+
+static bool mdp_panel_off(struct fbcon_config *fb)
+{
+	static char display_off[4] = {0x28, 0x00, 0x05, 0x80};
+	static char enter_sleep[4] = {0x10, 0x00, 0x05, 0x80};
+	struct mipi_dsi_cmd cmds[] = {
+		{ sizeof(display_off), display_off, 20 },
+		{ sizeof(enter_sleep), enter_sleep, 120 },
+	};
+	uint32_t ctrl;
+
+	if (fb->update_start) {
+		/* Wait for the last frame to be sent to the panel */
+		mdp_reset_roi(fb);
+		fb->update_start = NULL;
+		thread_sleep(42);
+	} else {
+		/*
+		 * Stop the video stream. The DSI controller must be reset after
+		 * that and switched to command mode to send the commands.
+		 */
+		writel(0, MDP_INTF_1_TIMING_ENGINE_EN + mdss_mdp_intf_offset());
+		thread_sleep(60);
+
+		ctrl = readl(MIPI_DSI0_BASE + CTRL);
+		writel(ctrl & ~BIT(0), MIPI_DSI0_BASE + CTRL);
+		writel(1, MIPI_DSI0_BASE + SOFT_RESET);
+		dsb();
+		writel(0, MIPI_DSI0_BASE + SOFT_RESET);
+		dsb();
+		writel((ctrl & ~BIT(1)) | BIT(2), MIPI_DSI0_BASE + CTRL);
+	}
+
+	return mdss_dsi_cmds_tx(NULL, cmds, ARRAY_SIZE(cmds), 0) == 0;
+}
+#else
+static bool mdp_panel_off(struct fbcon_config *fb)
+{
+	return false;
+}
+#endif
+
+bool lk2nd_display_off(void)
+{
+	struct fbcon_config *fb = fbcon_display();
+
+	if (!fb)
+		return false;
+
+	if (!mdp_panel_off(fb)) {
+		dprintf(INFO, "Display: Cannot turn off panel\n");
+		return false;
+	}
+
+	dprintf(INFO, "Display: Panel turned off\n");
+	return true;
+}
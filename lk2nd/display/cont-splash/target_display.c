@@ -20,6 +20,11 @@ static bool mdp_prepare_fb(struct fbcon_config *fb)
 	if (fb->stride == 0 || fb->width == 0 || fb->height == 0)
 		return false;
 
+	/* Drawing is a lot faster when the stores can be merged */
+	fb->write_combine = lk2nd_mmu_map_ram_wc("continuous splash", base, size);
+	if (fb->write_combine)
+		return true;
+
 	return lk2nd_mmu_map_ram_dynamic("continuous splash", base, size);
 }
 
@@ -67,3 +72,14 @@ void target_display_init(const char *panel_name)
 	if (fbcon_display() || mdp_setup_cont_splash())
 		display_image_on_screen();
 }
+
+void target_display_shutdown(void)
+{
+	struct fbcon_config *fb = fbcon_display();
+
+	/* The next OS expects the display as it was set up before lk2nd */
+	if (fb) {
+		fbcon_disable_double_buffer();
+		mdp_reset_roi(fb);
+	}
+}
@@ -0,0 +1,174 @@
+// SPDX-License-Identifier: BSD-3-Clause
+
+#include <compiler.h>
+#include <debug.h>
+#include <dev/fbcon.h>
+#include <string.h>
+
+#include <lk2nd/logo.h>
+
+/*
+ * The logo is stored as QOI image, see https://qoiformat.org/qoi-specification.pdf
+ * It is decoded directly into the framebuffer, so there is no need for a
+ * buffer of the uncompressed image.
+ */
+INCFILE(lk2nd_logo, lk2nd_logo_size, LK2ND_LOGO_FILE);
+
+#define QOI_OP_INDEX	0x00
+#define QOI_OP_DIFF	0x40
+#define QOI_OP_LUMA	0x80
+#define QOI_OP_RUN	0xc0
+#define QOI_OP_RGB	0xfe
+#define QOI_OP_RGBA	0xff
+#define QOI_OP_MASK	0xc0
+#define QOI_HEADER_SIZE	14
+
+struct qoi_px {
+	uint8_t r, g, b, a;
+};
+
+static inline uint8_t qoi_hash(struct qoi_px px)
+{
+	return (px.r * 3 + px.g * 5 + px.b * 7 + px.a * 11) % 64;
+}
+
+static inline uint32_t qoi_get_be32(const uint8_t *in)
+{
+	return in[0] << 24 | in[1] << 16 | in[2] << 8 | in[3];
+}
+
+static uint8_t *logo_put(uint8_t *p, unsigned bytespp, struct qoi_px px)
+{
+	uint16_t rgb565;
+
+	/* Blend with the black background */
+	if (px.a != 0xff) {
+		px.r = px.r * px.a / 0xff;
+		px.g = px.g * px.a / 0xff;
+		px.b = px.b * px.a / 0xff;
+	}
+
+	switch (bytespp) {
+	case 2:
+		rgb565 = (px.r >> 3) << 11 | (px.g >> 2) << 5 | px.b >> 3;
+		*p++ = rgb565;
+		*p++ = rgb565 >> 8;
+		break;
+	case 4:
+		p[3] = 0;
+		/* fallthrough */
+	case 3:
+		p[0] = px.b;
+		p[1] = px.g;
+		p[2] = px.r;
+		p += bytespp;
+		break;
+	}
+	return p;
+}
+
+static bool logo_decode(struct fbcon_config *fb, const uint8_t *in, const uint8_t *end)
+{
+	struct qoi_px index[64] = {0};
+	struct qoi_px px = { .a = 0xff };
+	unsigned bytespp = fb->bpp / 8;
+	unsigned width, height, x, y, run = 0;
+	uint8_t *base, *p;
+	uint8_t op;
+	int vg;
+
+	if (end - in < QOI_HEADER_SIZE || memcmp(in, "qoif", 4)) {
+		dprintf(CRITICAL, "logo: Invalid QOI image\n");
+		return false;
+	}
+
+	width = qoi_get_be32(in + 4);
+	height = qoi_get_be32(in + 8);
+	if (width > fb->width || height > fb->height) {
+		dprintf(CRITICAL, "logo: Image too large for display: %ux%u\n",
+			width, height);
+		return false;
+	}
+	in += QOI_HEADER_SIZE;
+
+	/* Center the logo on the screen */
+	base = fb->base;
+	base += ((fb->height - height) / 2 * fb->stride + (fb->width - width) / 2) * bytespp;
+
+	for (y = 0; y < height; y++) {
+		p = base + y * fb->stride * bytespp;
+
+		for (x = 0; x < width; x++) {
+			if (run) {
+				run--;
+				p = logo_put(p, bytespp, px);
+				continue;
+			}
+
+			/* The longest operation has 5 bytes */
+			if (end - in < 5) {
+				dprintf(CRITICAL, "logo: Truncated QOI image\n");
+				return false;
+			}
+
+			op = *in++;
+			if (op == QOI_OP_RGB) {
+				px.r = *in++;
+				px.g = *in++;
+				px.b = *in++;
+			} else if (op == QOI_OP_RGBA) {
+				px.r = *in++;
+				px.g = *in++;
+				px.b = *in++;
+				px.a = *in++;
+			} else switch (op & QOI_OP_MASK) {
+			case QOI_OP_INDEX:
+				px = index[op];
+				break;
+			case QOI_OP_DIFF:
+				px.r += ((op >> 4) & 0x3) - 2;
+				px.g += ((op >> 2) & 0x3) - 2;
+				px.b += (op & 0x3) - 2;
+				break;
+			case QOI_OP_LUMA:
+				vg = (op & 0x3f) - 32;
+				op = *in++;
+				px.r += vg - 8 + (op >> 4);
+				px.g += vg;
+				px.b += vg - 8 + (op & 0xf);
+				break;
+			case QOI_OP_RUN:
+				run = op & 0x3f;
+				break;
+			}
+
+			index[qoi_hash(px)] = px;
+			p = logo_put(p, bytespp, px);
+		}
+	}
+
+	return true;
+}
+
+bool lk2nd_logo_draw(void)
+{
+	struct fbcon_config *fb = fbcon_display();
+
+	if (!fb)
+		return false;
+
+	switch (fb->bpp) {
+	case 16:
+	case 24:
+	case 32:
+		break;
+	default:
+		dprintf(CRITICAL, "logo: Unsupported display bpp: %u\n", fb->bpp);
+		return false;
+	}
+
+	fbcon_clear();
+
+	/* INCFILE() stores the size minus one */
+	return logo_decode(fb, lk2nd_logo, lk2nd_logo + lk2nd_logo_size + 1);
+}
@@ -0,0 +1,10 @@
+# SPDX-License-Identifier: BSD-3-Clause
+LOCAL_DIR := $(GET_LOCAL_DIR)
+
+DEFINES += LK2ND_LOGO_FILE="$(abspath $(LK2ND_LOGO))"
+
+OBJS += \
+	$(LOCAL_DIR)/logo.o \
+
+# The image is embedded with .incbin, so rebuild if it changes
+$(BUILDDIR)/$(LOCAL_DIR)/logo.o: $(LK2ND_LOGO)
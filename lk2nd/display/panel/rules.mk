@@ -1,7 +1,9 @@
 # SPDX-License-Identifier: BSD-3-Clause
 LOCAL_DIR := $(GET_LOCAL_DIR)
 
-# Filter out original panel implementation
+# Filter out original panel implementation. Only the panel selected with
+# LK2ND_DISPLAY is referenced from oem_panel.c, the (static) tables of all
+# other generated panels are never emitted into the image.
 OBJS := $(filter-out target/$(TARGET)/oem_panel.o, $(OBJS))
 
 OBJS += $(LOCAL_DIR)/oem_panel.o
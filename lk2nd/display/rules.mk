@@ -13,3 +13,7 @@ include $(LOCAL_DIR)/panel/rules.mk
 else
 $(error Please specify the display with LK2ND_DISPLAY option)
 endif
+
+ifneq ($(LK2ND_LOGO),)
+MODULES += lk2nd/display/logo
+endif
@@ -11,6 +11,7 @@
 
 #include <lk2nd/util/cmdline.h>
 #include <lk2nd/util/lkfdt.h>
+#include <lk2nd/util/scratch.h>
 
 #include "cont-splash/cont-splash.h"
 
@@ -22,6 +23,87 @@
  * node if this is requested on the cmdline.
  */
 
+static bool ranges_overlap(uint64_t a, uint64_t a_size, uint64_t b, uint64_t b_size)
+{
+	return a < b + b_size && b < a + a_size;
+}
+
+static uint64_t read_cells(const fdt32_t *cells, int num)
+{
+	uint64_t val = 0;
+
+	while (num--)
+		val = val << 32 | fdt32_to_cpu(*cells++);
+	return val;
+}
+
+/* Check if Linux sees the range as normal RAM (in a /memory node) */
+static bool simplefb_in_memory(const void *dtb, uint32_t base, uint32_t size)
+{
+	int node, len, addr_cells, size_cells;
+	const fdt32_t *reg, *end;
+	uint64_t addr, rsize;
+
+	addr_cells = fdt_address_cells(dtb, 0);
+	size_cells = fdt_size_cells(dtb, 0);
+	if (addr_cells < 1 || size_cells < 1)
+		return false;
+
+	fdt_for_each_subnode(node, dtb, 0) {
+		if (lkfdt_prop_strneq(dtb, node, "device_type", "memory"))
+			continue;
+
+		reg = fdt_getprop(dtb, node, "reg", &len);
+		if (!reg || len < 0)
+			continue;
+
+		end = reg + len / sizeof(*reg);
+		for (; reg + addr_cells + size_cells <= end; reg += addr_cells + size_cells) {
+			addr = read_cells(reg, addr_cells);
+			rsize = read_cells(reg + addr_cells, size_cells);
+			if (base >= addr && (uint64_t)base + size <= addr + rsize)
+				return true;
+		}
+	}
+	return false;
+}
+
+/*
+ * The framebuffer of the previous bootloader can be passed to Linux where it
+ * is if it is in normal RAM that is not reserved for anything else yet. It is
+ * reserved as no-map below. This avoids copying it for "relocate".
+ */
+static bool simplefb_can_stay(const void *dtb, struct fbcon_config *fb)
+{
+	uint32_t base = (uint32_t)fb->base;
+	uint32_t size = fb->stride * fb->bpp/8 * fb->height;
+	uint32_t raddr, rsize;
+	uint64_t addr, len;
+	int i, offset, node;
+
+	if (!simplefb_in_memory(dtb, base, size))
+		return false;
+
+	for (i = 0; i < fdt_num_mem_rsv(dtb); i++) {
+		if (fdt_get_mem_rsv(dtb, i, &addr, &len) == 0 &&
+		    ranges_overlap(base, size, addr, len))
+			return false;
+	}
+
+	offset = fdt_path_offset(dtb, "/reserved-memory");
+	if (offset < 0)
+		return true;
+
+	fdt_for_each_subnode(node, dtb, offset) {
+		if (!lkfdt_node_is_available(dtb, node))
+			continue;
+		if (lkfdt_get_reg(dtb, offset, node, &raddr, &rsize) == 0 &&
+		    ranges_overlap(base, size, raddr, rsize))
+			return false;
+	}
+	return true;
+}
+
 static int lk2nd_simplefb_dt_update(void *dtb, const char *cmdline,
 				    enum boot_type boot_type)
 {
@@ -34,6 +116,9 @@ static int lk2nd_simplefb_dt_update(void *dtb, const char *cmdline,
 	if (!fb)
 		return 0;
 
+	/* The menu might still draw to an off-screen buffer */
+	fbcon_disable_double_buffer();
+
 	if (boot_type & (BOOT_DOWNSTREAM | BOOT_LK2ND))
 		return 0;
 
@@ -46,13 +131,25 @@ static int lk2nd_simplefb_dt_update(void *dtb, const char *cmdline,
 			mdp_enable_autorefresh(fb);
 		}
 
-		if (strstr(args, "relocate")) {
+		/*
+		 * Converting to xrgb8888 grows the framebuffer, which only fits
+		 * into the space at the relocation target.
+		 */
+		if (strstr(args, "relocate") &&
+		    (fb->bpp == 32 || !strstr(args, "xrgb8888")) &&
+		    simplefb_can_stay(dtb, fb)) {
+			dprintf(INFO, "simplefb: Framebuffer stays at %p, no relocation needed\n",
+				fb->base);
+		} else if (strstr(args, "relocate")) {
 			rel_base = target_get_scratch_address()
 				+ target_get_max_flash_size()
 				- (10 * 1024 * 1024); /* 8MiB~=fhd 32bpp, +512k ramoops at the end. */
 
-			dprintf(INFO, "simplefb: Framebuffer will be relocated to 0x%x\n", (uint32_t)rel_base);
-			mdp_relocate(fb, rel_base);
+			if (lk2nd_scratch_claim("simplefb", rel_base, 8 * 1024 * 1024)) {
+				dprintf(INFO, "simplefb: Framebuffer will be relocated to 0x%x\n",
+					(uint32_t)rel_base);
+				mdp_relocate(fb, rel_base);
+			}
 		}
 
 		if (strstr(args, "rgb565"))
@@ -169,4 +266,4 @@ static int lk2nd_simplefb_dt_update(void *dtb, const char *cmdline,
 
 	return 0;
 }
-DEV_TREE_UPDATE(lk2nd_simplefb_dt_update);
+DEV_TREE_UPDATE_SIZE(lk2nd_simplefb_dt_update, 512);
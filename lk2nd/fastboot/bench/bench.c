@@ -0,0 +1,554 @@
+// SPDX-License-Identifier: BSD-3-Clause
+
+#include <arch/arm/mmu.h>
+#include <arch/defines.h>
+#include <arch/ops.h>
+#include <crypto_hash.h>
+#include <decompress.h>
+#include <fastboot.h>
+#include <lib/bio.h>
+#include <lib/fs.h>
+#include <platform.h>
+#include <printf.h>
+#include <stdlib.h>
+#include <string.h>
+#include <target.h>
+
+/*
+ * bench.c - Measure the throughput of storage, USB and the hot paths of
+ * booting. The download buffer is used as scratch memory, staged data is
+ * overwritten (except for "inflate", which uses it as input).
+ */
+
+#define BENCH_DEFAULT_SIZE	(16 * 1024 * 1024)
+#define BENCH_DEFAULT_CHUNK	(1024 * 1024)
+#define BENCH_MEMCPY_LOOPS	8
+
+#define BENCH_MEM_MIN_SIZE	(4 * 1024)
+#define BENCH_MEM_DEFAULT_SIZE	(8 * 1024 * 1024)
+#define BENCH_MEM_MIN_BYTES	(4 * 1024 * 1024)	/* per measurement */
+#define BENCH_MEM_CHASE_LOADS	(512 * 1024)
+#define BENCH_MEM_LINE		64
+#define BENCH_MEM_OUT_SIZE	8192
+#define BENCH_SECTION		(1024 * 1024)
+
+static void bench_report(const char *name, uint64_t bytes, unsigned ops,
+			 bigtime_t usecs)
+{
+	char response[MAX_RSP_SIZE];
+	uint64_t kibps = usecs ? bytes * 1000000 / 1024 / usecs : 0;
+
+	snprintf(response, sizeof(response),
+		 "%s: %llu KiB in %llu us, %llu.%02llu MiB/s, %llu us/op",
+		 name, bytes / 1024, usecs, kibps / 1024, kibps % 1024 * 100 / 1024,
+		 ops ? usecs / ops : 0);
+	fastboot_info(response);
+}
+
+static void bench_report_latency(bigtime_t min, bigtime_t max)
+{
+	char response[MAX_RSP_SIZE];
+
+	snprintf(response, sizeof(response), "latency: min %llu us, max %llu us",
+		 min, max);
+	fastboot_info(response);
+}
+
+/* Parse a size with an optional K/M/G suffix */
+static bool bench_parse_size(const char *str, size_t *size)
+{
+	char *end;
+
+	if (!str)
+		return false;
+
+	*size = strtoul(str, &end, 0);
+	switch (*end) {
+	case 'G':
+		*size <<= 10;
+		/* fallthrough */
+	case 'M':
+		*size <<= 10;
+		/* fallthrough */
+	case 'K':
+		*size <<= 10;
+		end++;
+		break;
+	}
+
+	return *size && !*end;
+}
+
+static size_t bench_max_size(void)
+{
+	return ROUNDDOWN(target_get_max_flash_size(), CACHE_LINE);
+}
+
+/* oem bench mmc-read <bdev> [<size> [<chunk>]] */
+static void cmd_oem_bench_mmc_read(const char *arg, void *data, unsigned sz)
+{
+	size_t size = BENCH_DEFAULT_SIZE, chunk = BENCH_DEFAULT_CHUNK;
+	bigtime_t start, t, total = 0, min = ~0ULL, max = 0;
+	const char *name, *token;
+	unsigned ops = 0;
+	off_t offset;
+	bdev_t *dev;
+	ssize_t ret;
+	char *sp;
+
+	name = strtok_r((char *)arg, " ", &sp);
+	token = strtok_r(NULL, " ", &sp);
+	if (!name || (token && !bench_parse_size(token, &size))) {
+		fastboot_fail("usage: oem bench mmc-read <bdev> [<size> [<chunk>]]");
+		return;
+	}
+	token = strtok_r(NULL, " ", &sp);
+	if (token && !bench_parse_size(token, &chunk)) {
+		fastboot_fail("invalid chunk size");
+		return;
+	}
+
+	dev = bio_open(name);
+	if (!dev) {
+		fastboot_fail("block device not found");
+		return;
+	}
+
+	size = MIN((uint64_t)size, (uint64_t)dev->size);
+	chunk = MIN(chunk, MIN(size, bench_max_size()));
+	chunk = ROUNDDOWN(chunk, dev->block_size);
+	if (!chunk) {
+		fastboot_fail("chunk smaller than a block");
+		goto out;
+	}
+
+	for (offset = 0; offset + chunk <= size; offset += chunk, ops++) {
+		start = current_time_hires();
+		ret = bio_read(dev, data, offset, chunk);
+		t = current_time_hires() - start;
+		if (ret != (ssize_t)chunk) {
+			fastboot_fail("read failed");
+			goto out;
+		}
+
+		total += t;
+		min = MIN(min, t);
+		max = MAX(max, t);
+	}
+
+	bench_report(name, (uint64_t)ops * chunk, ops, total);
+	bench_report_latency(min, max);
+	fastboot_okay("");
+
+out:
+	bio_close(dev);
+}
+FASTBOOT_REGISTER("oem bench mmc-read", cmd_oem_bench_mmc_read);
+
+/* oem bench fs-read <path> [<chunk>] */
+static void cmd_oem_bench_fs_read(const char *arg, void *data, unsigned sz)
+{
+	size_t chunk = BENCH_DEFAULT_CHUNK;
+	bigtime_t start, t, total = 0, min = ~0ULL, max = 0;
+	struct file_stat stat;
+	const char *path, *token;
+	filehandle *file;
+	unsigned ops = 0;
+	off_t offset;
+	ssize_t ret;
+	size_t len;
+	char *sp;
+
+	path = strtok_r((char *)arg, " ", &sp);
+	token = strtok_r(NULL, " ", &sp);
+	if (!path || (token && !bench_parse_size(token, &chunk))) {
+		fastboot_fail("usage: oem bench fs-read <path> [<chunk>]");
+		return;
+	}
+	chunk = MIN(chunk, bench_max_size());
+
+	if (fs_open_file(path, &file) < 0) {
+		fastboot_fail("file not found");
+		return;
+	}
+
+	if (fs_stat_file(file, &stat) < 0 || stat.is_dir) {
+		fastboot_fail("not a file");
+		goto out;
+	}
+
+	for (offset = 0; offset < stat.size; offset += len, ops++) {
+		len = MIN((uint64_t)chunk, (uint64_t)(stat.size - offset));
+
+		start = current_time_hires();
+		ret = fs_read_file(file, data, offset, len);
+		t = current_time_hires() - start;
+		if (ret != (ssize_t)len) {
+			fastboot_fail("read failed");
+			goto out;
+		}
+
+		total += t;
+		min = MIN(min, t);
+		max = MAX(max, t);
+	}
+
+	bench_report(path, stat.size, ops, total);
+	if (ops)
+		bench_report_latency(min, max);
+	fastboot_okay("");
+
+out:
+	fs_close_file(file);
+}
+FASTBOOT_REGISTER("oem bench fs-read", cmd_oem_bench_fs_read);
+
+/* oem bench inflate: decompress the staged gzip file */
+static void cmd_oem_bench_inflate(const char *arg, void *data, unsigned sz)
+{
+	unsigned char *out = (unsigned char *)data + ROUNDUP(sz, CACHE_LINE);
+	unsigned int pos = 0, out_len = 0;
+	bigtime_t start, t;
+
+	if (!sz || !is_gzip_package(data, sz)) {
+		fastboot_fail("stage a gzip file first");
+		return;
+	}
+
+	if (ROUNDUP(sz, CACHE_LINE) >= bench_max_size()) {
+		fastboot_fail("no space left for the output");
+		return;
+	}
+
+	start = current_time_hires();
+	if (decompress(data, sz, out, bench_max_size() - ROUNDUP(sz, CACHE_LINE),
+		       &pos, &out_len)) {
+		fastboot_fail("decompression failed");
+		return;
+	}
+	t = current_time_hires() - start;
+
+	bench_report("inflate (output)", out_len, 1, t);
+	fastboot_okay("");
+}
+FASTBOOT_REGISTER("oem bench inflate", cmd_oem_bench_inflate);
+
+/* oem bench sha256 [<size>] */
+static void cmd_oem_bench_sha256(const char *arg, void *data, unsigned sz)
+{
+	uint32_t digest[SHA256_INIT_VECTOR_SIZE];
+	size_t size = BENCH_DEFAULT_SIZE;
+	bigtime_t start, t;
+
+	if (*arg && !bench_parse_size(arg, &size)) {
+		fastboot_fail("usage: oem bench sha256 [<size>]");
+		return;
+	}
+	size = MIN(size, bench_max_size());
+
+	target_crypto_init_params();
+	start = current_time_hires();
+	if (hash_find(data, size, (void *)digest, CRYPTO_AUTH_ALG_SHA256) != CRYPTO_SHA_ERR_NONE) {
+		fastboot_fail("failed to compute hash");
+		return;
+	}
+	t = current_time_hires() - start;
+
+	bench_report("sha256", size, 1, t);
+	fastboot_okay("");
+}
+FASTBOOT_REGISTER("oem bench sha256", cmd_oem_bench_sha256);
+
+/* oem bench memcpy [<size>] */
+static void cmd_oem_bench_memcpy(const char *arg, void *data, unsigned sz)
+{
+	size_t size = BENCH_DEFAULT_SIZE;
+	bigtime_t start, t;
+	void *dst;
+	int i;
+
+	if (*arg && !bench_parse_size(arg, &size)) {
+		fastboot_fail("usage: oem bench memcpy [<size>]");
+		return;
+	}
+	size = ROUNDDOWN(MIN(size, bench_max_size() / 2), CACHE_LINE);
+	dst = (char *)data + size;
+
+	start = current_time_hires();
+	for (i = 0; i < BENCH_MEMCPY_LOOPS; i++)
+		memset(data, i, size);
+	t = current_time_hires() - start;
+	bench_report("memset", (uint64_t)size * BENCH_MEMCPY_LOOPS, BENCH_MEMCPY_LOOPS, t);
+
+	start = current_time_hires();
+	for (i = 0; i < BENCH_MEMCPY_LOOPS; i++)
+		memcpy(dst, data, size);
+	t = current_time_hires() - start;
+	bench_report("memcpy", (uint64_t)size * BENCH_MEMCPY_LOOPS, BENCH_MEMCPY_LOOPS, t);
+
+	fastboot_okay("");
+}
+FASTBOOT_REGISTER("oem bench memcpy", cmd_oem_bench_memcpy);
+
+#ifndef LPAE /* Sections are only saved and restored with short descriptors */
+/* bench-neon.S */
+void bench_neon_read(const void *src, size_t len);
+void bench_neon_write(void *dst, size_t len);
+void bench_neon_copy(void *dst, const void *src, size_t len);
+
+static const struct {
+	const char *name;
+	uint flags;
+} bench_mem_attrs[] = {
+	{ "wb", MMU_MEMORY_TYPE_NORMAL_WRITE_BACK_ALLOCATE },
+	{ "wt", MMU_MEMORY_TYPE_NORMAL_WRITE_THROUGH },
+	{ "nc", MMU_MEMORY_TYPE_NORMAL },
+};
+
+static uint32_t bench_int_read(const uint32_t *p, size_t len)
+{
+	const uint32_t *end = p + len / sizeof(*p);
+	uint32_t sum = 0;
+
+	for (; p < end; p += 8)
+		sum += p[0] + p[1] + p[2] + p[3] + p[4] + p[5] + p[6] + p[7];
+	return sum;
+}
+
+static void bench_int_write(uint32_t *p, size_t len)
+{
+	uint32_t *end = p + len / sizeof(*p);
+
+	for (; p < end; p += 4) {
+		p[0] = 0;
+		p[1] = 0;
+		p[2] = 0;
+		p[3] = 0;
+	}
+}
+
+/* Link the cache lines of a region into a random cycle (Sattolo's algorithm) */
+static void *bench_chase_init(void *buf, size_t size)
+{
+	size_t i, j, n = size / BENCH_MEM_LINE;
+	uintptr_t *a, *b, tmp;
+	uint32_t seed = 1;
+
+	for (i = 0; i < n; i++)
+		*(uintptr_t *)((char *)buf + i * BENCH_MEM_LINE) = i;
+
+	for (i = n - 1; i > 0; i--) {
+		seed = seed * 1103515245 + 12345;
+		j = (seed >> 8) % i;
+		a = (uintptr_t *)((char *)buf + i * BENCH_MEM_LINE);
+		b = (uintptr_t *)((char *)buf + j * BENCH_MEM_LINE);
+		tmp = *a;
+		*a = *b;
+		*b = tmp;
+	}
+
+	for (i = 0; i < n; i++) {
+		uintptr_t *p = (uintptr_t *)((char *)buf + i * BENCH_MEM_LINE);
+		*p = (uintptr_t)buf + *p * BENCH_MEM_LINE;
+	}
+
+	return buf;
+}
+
+static void *bench_chase(void *p, unsigned int loads)
+{
+	while (loads--)
+		p = *(void * volatile *)p;
+	return p;
+}
+
+/* Throughput in MiB/s for @bytes in @usecs */
+static uint32_t bench_mibps(uint64_t bytes, bigtime_t usecs)
+{
+	return usecs ? bytes * 1000000 / (1024 * 1024) / usecs : 0;
+}
+
+enum { BENCH_MEM_READ, BENCH_MEM_WRITE, BENCH_MEM_COPY };
+
+static uint32_t bench_mem_run(int op, bool neon, char *buf, size_t size)
+{
+	unsigned int i, loops = MAX(1U, BENCH_MEM_MIN_BYTES / size);
+	volatile uint32_t sink = 0;
+	bigtime_t start, t;
+
+	start = current_time_hires();
+	for (i = 0; i < loops; i++) {
+		switch (op) {
+		case BENCH_MEM_READ:
+			if (neon)
+				bench_neon_read(buf, size);
+			else
+				sink += bench_int_read((uint32_t *)buf, size);
+			break;
+		case BENCH_MEM_WRITE:
+			if (neon)
+				bench_neon_write(buf, size);
+			else
+				bench_int_write((uint32_t *)buf, size);
+			break;
+		case BENCH_MEM_COPY:
+			if (neon)
+				bench_neon_copy(buf + size, buf, size);
+			else
+				memcpy(buf + size, buf, size);
+			break;
+		}
+	}
+	t = current_time_hires() - start;
+	(void)sink;
+
+	return bench_mibps((uint64_t)size * loops, t);
+}
+
+/* Average load latency in ns, for a random walk over @size bytes */
+static uint32_t bench_mem_latency(char *buf, size_t size)
+{
+	bigtime_t start, t;
+	void *p;
+
+	p = bench_chase_init(buf, size);
+	arch_clean_cache_range((addr_t)buf, size);
+
+	/* One round-trip to warm up the caches (as far as the region fits) */
+	p = bench_chase(p, size / BENCH_MEM_LINE);
+
+	start = current_time_hires();
+	bench_chase(p, BENCH_MEM_CHASE_LOADS);
+	t = current_time_hires() - start;
+
+	return t * 1000 / BENCH_MEM_CHASE_LOADS;
+}
+
+/* Map the sections of the region with @flags, or restore @saved if NULL */
+static void bench_mem_map(char *buf, size_t len, uint flags, const uint32_t *saved)
+{
+	size_t i;
+
+	arch_clean_invalidate_cache_range((addr_t)buf, len);
+	for (i = 0; i < len / BENCH_SECTION; i++) {
+		addr_t addr = (addr_t)buf + i * BENCH_SECTION;
+
+		if (saved)
+			arm_mmu_set_section_desc(addr, saved[i]);
+		else
+			arm_mmu_map_section(addr, addr, flags | MMU_MEMORY_AP_READ_WRITE |
+					    MMU_MEMORY_XN);
+	}
+	arm_mmu_flush();
+}
+
+/*
+ * oem bench mem [<max size>] [wb|wt|nc]
+ * Measure read, write and copy bandwidth (integer and NEON) and the load
+ * latency for all sizes from 4 KiB up to <max size>, with the memory mapped
+ * write-back, write-through and uncached. Stages the results as a table.
+ */
+static void cmd_oem_bench_mem(const char *arg, void *data, unsigned sz)
+{
+	size_t max = BENCH_MEM_DEFAULT_SIZE, len, size, i;
+	char *buf, *out, *o, *sp;
+	const char *token, *attr = NULL;
+	uint32_t *saved;
+	unsigned int a;
+
+	for (token = strtok_r((char *)arg, " ", &sp); token;
+	     token = strtok_r(NULL, " ", &sp)) {
+		if (!strcmp(token, "wb") || !strcmp(token, "wt") || !strcmp(token, "nc"))
+			attr = token;
+		else if (!bench_parse_size(token, &max) || max < BENCH_MEM_MIN_SIZE) {
+			fastboot_fail("usage: oem bench mem [<max size>] [wb|wt|nc]");
+			return;
+		}
+	}
+
+	/* Whole sections of the download buffer, for two buffers of max size */
+	buf = (char *)ROUNDUP((uintptr_t)data, BENCH_SECTION);
+	len = ROUNDUP(2 * max, BENCH_SECTION);
+	if ((uintptr_t)buf + len > (uintptr_t)data + bench_max_size()) {
+		fastboot_fail("size too large for the download buffer");
+		return;
+	}
+
+	saved = malloc(len / BENCH_SECTION * sizeof(*saved));
+	o = out = malloc(BENCH_MEM_OUT_SIZE);
+	if (!saved || !out) {
+		fastboot_fail("out of memory");
+		goto out;
+	}
+
+	for (i = 0; i < len / BENCH_SECTION; i++) {
+		saved[i] = arm_mmu_get_section_desc((addr_t)buf + i * BENCH_SECTION);
+		if ((saved[i] & 3) != 2) {
+			fastboot_fail("download buffer is not mapped with sections");
+			goto out;
+		}
+	}
+
+	o += sprintf(o, "MiB/s (latency in ns)\n");
+	o += sprintf(o, "attr     size     read    write     copy "
+		     "neon-read neon-write neon-copy latency\n");
+
+	for (a = 0; a < countof(bench_mem_attrs); a++) {
+		if (attr && strcmp(attr, bench_mem_attrs[a].name))
+			continue;
+
+		bench_mem_map(buf, len, bench_mem_attrs[a].flags, NULL);
+		memset(buf, 0, len);
+
+		for (size = BENCH_MEM_MIN_SIZE; size <= max; size *= 2) {
+			if (o - out > BENCH_MEM_OUT_SIZE - 128)
+				break;
+
+			o += sprintf(o, "%-4s %7zuK %8u %8u %8u %9u %10u %9u %7u\n",
+				     bench_mem_attrs[a].name, size / 1024,
+				     bench_mem_run(BENCH_MEM_READ, false, buf, size),
+				     bench_mem_run(BENCH_MEM_WRITE, false, buf, size),
+				     bench_mem_run(BENCH_MEM_COPY, false, buf, size),
+				     bench_mem_run(BENCH_MEM_READ, true, buf, size),
+				     bench_mem_run(BENCH_MEM_WRITE, true, buf, size),
+				     bench_mem_run(BENCH_MEM_COPY, true, buf, size),
+				     bench_mem_latency(buf, size));
+		}
+
+		bench_mem_map(buf, len, 0, saved);
+	}
+
+	/* The table is staged from the start of the download buffer */
+	memcpy(data, out, o - out);
+	fastboot_stage(data, o - out);
+
+out:
+	free(saved);
+	free(out);
+}
+FASTBOOT_REGISTER("oem bench mem", cmd_oem_bench_mem);
+#endif
+
+/*
+ * oem bench usb: report the data phase of the last download & upload, e.g.
+ * after "fastboot stage <file>" and "fastboot get_staged <file>".
+ */
+static void cmd_oem_bench_usb(const char *arg, void *data, unsigned sz)
+{
+	struct fastboot_xfer_stats stats;
+
+	fastboot_get_xfer_stats(0, &stats);
+	if (stats.size)
+		bench_report("usb download", stats.size, 1, stats.usecs);
+	else
+		fastboot_info("usb download: none yet, use 'fastboot stage <file>'");
+
+	fastboot_get_xfer_stats(1, &stats);
+	if (stats.size)
+		bench_report("usb upload", stats.size, 1, stats.usecs);
+	else
+		fastboot_info("usb upload: none yet, use 'fastboot get_staged <file>'");
+
+	fastboot_okay("");
+}
+FASTBOOT_REGISTER("oem bench usb", cmd_oem_bench_usb);
@@ -0,0 +1,10 @@
+# SPDX-License-Identifier: BSD-3-Clause
+LOCAL_DIR := $(GET_LOCAL_DIR)
+
+MODULES += \
+	lib/bio \
+	lib/fs \
+
+OBJS += \
+	$(LOCAL_DIR)/bench.o \
+	$(LOCAL_DIR)/bench-neon.o \
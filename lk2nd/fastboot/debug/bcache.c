@@ -0,0 +1,25 @@
+// SPDX-License-Identifier: BSD-3-Clause
+
+#include <fastboot.h>
+#include <lib/bcache.h>
+#include <printf.h>
+
+static void cmd_oem_debug_bcache(const char *arg, void *data, unsigned sz)
+{
+	char response[MAX_RSP_SIZE];
+	struct bcache_stats stats;
+	uint32_t finds;
+
+	bcache_get_stats(&stats);
+	finds = stats.hits + stats.misses;
+
+	snprintf(response, sizeof(response), "hits %u (%u%%), avg depth %u",
+		 stats.hits, finds ? stats.hits * 100 / finds : 0,
+		 stats.hits ? stats.depth / stats.hits : 0);
+	fastboot_info(response);
+	snprintf(response, sizeof(response), "misses %u, reads %u, writes %u",
+		 stats.misses, stats.reads, stats.writes);
+	fastboot_info(response);
+	fastboot_okay("");
+}
+FASTBOOT_REGISTER("oem debug bcache", cmd_oem_debug_bcache);
@@ -0,0 +1,64 @@
+// SPDX-License-Identifier: BSD-3-Clause
+
+#include <fastboot.h>
+#include <lib/bio.h>
+#include <printf.h>
+#include <string.h>
+
+static void bio_info_op(const char *dev, const char *name,
+			const struct bio_op_stats *op, size_t block_size)
+{
+	char response[MAX_RSP_SIZE];
+
+	if (!op->ops)
+		return;
+
+	snprintf(response, sizeof(response), "%s: %s %u ops, %llu blocks, %llu ms",
+		 dev, name, op->ops, op->bytes / block_size, op->time / 1000);
+	fastboot_info(response);
+}
+
+static void cmd_oem_debug_bio(const char *arg, void *data, unsigned sz)
+{
+	struct bdev_struct *bdevs = bio_get_bdevs();
+	char response[MAX_RSP_SIZE];
+	const uint last = BIO_LATENCY_BUCKETS - 1;
+	bool found = false;
+	bdev_t *dev;
+	uint i;
+
+	mutex_acquire(&bdevs->lock);
+	list_for_every_entry(&bdevs->list, dev, bdev_t, node) {
+		struct bio_stats *stats = &dev->stats;
+
+		if (*arg ? strcmp(dev->name, arg) :
+		    !(stats->read.ops || stats->write.ops || stats->erase.ops))
+			continue;
+
+		found = true;
+		bio_info_op(dev->name, "read", &stats->read, dev->block_size);
+		bio_info_op(dev->name, "write", &stats->write, dev->block_size);
+		bio_info_op(dev->name, "erase", &stats->erase, dev->block_size);
+
+		/* The read latency histogram only for a single device */
+		if (!*arg)
+			continue;
+
+		for (i = 0; i <= last; i++) {
+			if (!stats->latency[i])
+				continue;
+			snprintf(response, sizeof(response), "%s %u us: %u reads",
+				 i == last ? ">=" : "<", 2U << (i == last ? i - 1 : i),
+				 stats->latency[i]);
+			fastboot_info(response);
+		}
+	}
+	mutex_release(&bdevs->lock);
+
+	if (*arg && !found) {
+		fastboot_fail("unknown block device");
+		return;
+	}
+	fastboot_okay("");
+}
+FASTBOOT_REGISTER("oem debug bio", cmd_oem_debug_bio);
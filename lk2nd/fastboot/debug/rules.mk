@@ -12,3 +12,11 @@ MODULES += lk2nd/hw/regulator
 OBJS += $(LOCAL_DIR)/regulator.o
 endif
 endif
+
+ifneq ($(filter lib/bio, $(ALLMODULES)),)
+OBJS += $(LOCAL_DIR)/bio.o
+endif
+
+ifneq ($(filter lib/bcache, $(ALLMODULES)),)
+OBJS += $(LOCAL_DIR)/bcache.o
+endif
@@ -1,6 +1,7 @@
 // SPDX-License-Identifier: BSD-3-Clause
 /* Copyright (c) 2022, Stephan Gerhold <stephan@gerhold.net> */
 
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
@@ -8,14 +9,20 @@
 #include <fastboot.h>
 #include <lib/ptable.h>
 #include <partition_parser.h>
+#include <sparse_format.h>
 #include <target.h>
 
 extern char max_download_size[MAX_RSP_SIZE];
+static char max_fetch_size[MAX_RSP_SIZE];
 
-static bool cmd_fetch_parse_args(uint64_t *offset, uint64_t *size, char **sp)
+/* fetch: replies with a 32-bit size, larger data is fetched in pieces */
+#define FETCH_STREAM_MAX	0xfffff000
+
+static bool cmd_fetch_parse_args(uint64_t *offset, uint64_t *size, char **sp,
+				 uint64_t max_size)
 {
 	const char *token = strtok_r(NULL, ":", sp);
-	unsigned long n;
+	uint64_t n;
 
 	if (token) {
 		n = atoull(token);
@@ -41,7 +48,7 @@ static bool cmd_fetch_parse_args(uint64_t *offset, uint64_t *size, char **sp)
 		fastboot_fail("no data left to fetch");
 		return false;
 	}
-	if (*size > target_get_max_flash_size()) {
+	if (*size > max_size) {
 		fastboot_fail("partition too large");
 		return false;
 	}
@@ -58,7 +65,8 @@ static unsigned cmd_fetch_read_mmc(const char *pname, void *data, char **sp)
 		return 0;
 	}
 
-	if (!cmd_fetch_parse_args(&part.offset, &part.size, sp))
+	if (!cmd_fetch_parse_args(&part.offset, &part.size, sp,
+				  target_get_max_flash_size()))
 		return 0;
 
 	if (mmc_read(part.offset, data, part.size)) {
@@ -88,7 +96,7 @@ static unsigned cmd_fetch_read_flash(const char *pname, void *data, char **sp)
 	}
 
 	size = ptn->length * flash_block_size();
-	if (!cmd_fetch_parse_args(&offset, &size, sp))
+	if (!cmd_fetch_parse_args(&offset, &size, sp, target_get_max_flash_size()))
 		return 0;
 
 	if (flash_read(ptn, offset, data, size)) {
@@ -111,8 +119,55 @@ static unsigned cmd_fetch_read(const char *arg, void *data)
 		return cmd_fetch_read_flash(pname, data, &sp);
 }
 
+static int cmd_fetch_stream_read(void *priv, void *buf, unsigned len)
+{
+	uint64_t *offset = priv;
+
+	if (mmc_read(*offset, buf, len)) {
+		fastboot_fail("failed to read partition");
+		return -1;
+	}
+
+	*offset += len;
+	return 0;
+}
+
+/*
+ * Read the partition in pieces while the previous one is sent, so the size
+ * is not limited by the download buffer.
+ */
+static void cmd_fetch_stream_mmc(const char *pname, char **sp)
+{
+	struct partition_info part = partition_get_info(pname);
+	uint32_t block_size = mmc_get_device_blocksize();
+
+	if (!part.offset) {
+		fastboot_fail("partition not found");
+		return;
+	}
+
+	if (!cmd_fetch_parse_args(&part.offset, &part.size, sp, FETCH_STREAM_MAX))
+		return;
+
+	if (part.offset % block_size || part.size % block_size) {
+		fastboot_fail("offset and size must be block aligned");
+		return;
+	}
+
+	fastboot_write_stream(part.size, cmd_fetch_stream_read, &part.offset);
+}
+
 static void cmd_fetch(const char *arg, void *data, unsigned sz)
 {
+	const char *pname;
+	char *sp;
+
+	if (target_is_emmc_boot()) {
+		pname = strtok_r((char *)arg, ":", &sp);
+		cmd_fetch_stream_mmc(pname, &sp);
+		return;
+	}
+
 	sz = cmd_fetch_read(arg, data);
 	if (sz)
 		fastboot_write_data(data, sz);
@@ -125,10 +180,174 @@ static void cmd_oem_read_partition(const char *arg, void *data, unsigned sz)
 		fastboot_stage(data, sz);
 }
 
+/*
+ * Android sparse image built from the partition data. Blocks that repeat a
+ * single 32-bit value (mostly zeros) become FILL chunks, the rest is copied
+ * into RAW chunks. The image can be flashed back with fastboot as usual.
+ */
+#define SPARSE_READ_SIZE	(1024 * 1024)
+
+struct sparse_out {
+	uint8_t *buf;
+	uint32_t len;
+	uint32_t max;
+	uint32_t blk_sz;
+	sparse_header_t *header;
+	chunk_header_t *chunk;
+};
+
+static bool sparse_block_fill(const uint32_t *blk, uint32_t blk_sz)
+{
+	uint32_t i;
+
+	for (i = 1; i < blk_sz / sizeof(uint32_t); i++)
+		if (blk[i] != blk[0])
+			return false;
+	return true;
+}
+
+static void *sparse_out_reserve(struct sparse_out *s, uint32_t len)
+{
+	void *p = s->buf + s->len;
+
+	if (len > s->max - s->len)
+		return NULL;
+	s->len += len;
+	return p;
+}
+
+static chunk_header_t *sparse_out_chunk(struct sparse_out *s, uint16_t type,
+					uint32_t data_sz)
+{
+	chunk_header_t *chunk = sparse_out_reserve(s, sizeof(*chunk) + data_sz);
+
+	if (!chunk)
+		return NULL;
+
+	chunk->chunk_type = type;
+	chunk->reserved1 = 0;
+	chunk->chunk_sz = 0;
+	chunk->total_sz = sizeof(*chunk) + data_sz;
+	s->header->total_chunks++;
+	s->chunk = chunk;
+	return chunk;
+}
+
+static bool sparse_out_block(struct sparse_out *s, const uint32_t *blk)
+{
+	chunk_header_t *chunk = s->chunk;
+	void *p;
+
+	if (sparse_block_fill(blk, s->blk_sz)) {
+		if (!chunk || chunk->chunk_type != CHUNK_TYPE_FILL ||
+		    *(uint32_t *)(chunk + 1) != blk[0]) {
+			chunk = sparse_out_chunk(s, CHUNK_TYPE_FILL, sizeof(uint32_t));
+			if (!chunk)
+				return false;
+			*(uint32_t *)(chunk + 1) = blk[0];
+		}
+	} else {
+		if (!chunk || chunk->chunk_type != CHUNK_TYPE_RAW) {
+			chunk = sparse_out_chunk(s, CHUNK_TYPE_RAW, 0);
+			if (!chunk)
+				return false;
+		}
+
+		p = sparse_out_reserve(s, s->blk_sz);
+		if (!p)
+			return false;
+		memcpy(p, blk, s->blk_sz);
+		chunk->total_sz += s->blk_sz;
+	}
+
+	chunk->chunk_sz++;
+	s->header->total_blks++;
+	return true;
+}
+
+static void cmd_oem_read_partition_sparse(const char *arg, void *data, unsigned sz)
+{
+	struct partition_info part;
+	struct sparse_out s = {0};
+	uint32_t block_size = mmc_get_device_blocksize();
+	uint32_t len, i;
+	uint8_t *rbuf;
+	const char *pname;
+	char *sp;
+
+	if (!target_is_emmc_boot()) {
+		fastboot_fail("only supported on mmc & ufs");
+		return;
+	}
+
+	pname = strtok_r((char *)arg, ":", &sp);
+	part = partition_get_info(pname);
+	if (!part.offset) {
+		fastboot_fail("partition not found");
+		return;
+	}
+
+	if (!cmd_fetch_parse_args(&part.offset, &part.size, &sp, UINT64_MAX))
+		return;
+
+	/* Use the largest common block size if possible */
+	s.blk_sz = (part.size % 4096 || 4096 % block_size) ? block_size : 4096;
+	if (part.offset % block_size || part.size % s.blk_sz) {
+		fastboot_fail("offset and size must be block aligned");
+		return;
+	}
+
+	/* Read buffer at the end of the download buffer, the image before it */
+	len = ROUNDDOWN(SPARSE_READ_SIZE, s.blk_sz);
+	if (target_get_max_flash_size() < 2 * len) {
+		fastboot_fail("download buffer too small");
+		return;
+	}
+	s.buf = data;
+	s.max = target_get_max_flash_size() - len;
+	rbuf = s.buf + s.max;
+
+	s.header = sparse_out_reserve(&s, sizeof(*s.header));
+	memset(s.header, 0, sizeof(*s.header));
+	s.header->magic = SPARSE_HEADER_MAGIC;
+	s.header->major_version = 1;
+	s.header->file_hdr_sz = sizeof(sparse_header_t);
+	s.header->chunk_hdr_sz = sizeof(chunk_header_t);
+	s.header->blk_sz = s.blk_sz;
+
+	while (part.size) {
+		len = MIN(part.size, (uint64_t)len);
+		if (mmc_read(part.offset, (uint32_t *)rbuf, len)) {
+			fastboot_fail("failed to read partition");
+			return;
+		}
+
+		for (i = 0; i < len; i += s.blk_sz) {
+			if (!sparse_out_block(&s, (uint32_t *)(rbuf + i))) {
+				fastboot_fail("sparse image too large, fetch a smaller range");
+				return;
+			}
+		}
+
+		part.offset += len;
+		part.size -= len;
+	}
+
+	dprintf(INFO, "Sparse image: %u blocks in %u chunks, %u bytes\n",
+		s.header->total_blks, s.header->total_chunks, s.len);
+	fastboot_stage(s.buf, s.len);
+}
+
 static void lk2nd_fastboot_register_fetch(void)
 {
-	fastboot_publish("max-fetch-size", max_download_size);
+	if (target_is_emmc_boot()) {
+		snprintf(max_fetch_size, sizeof(max_fetch_size), "0x%x", FETCH_STREAM_MAX);
+		fastboot_publish("max-fetch-size", max_fetch_size);
+	} else {
+		fastboot_publish("max-fetch-size", max_download_size);
+	}
 	fastboot_register("oem read-partition", cmd_oem_read_partition);
+	fastboot_register("oem read-partition-sparse", cmd_oem_read_partition_sparse);
 	fastboot_register("fetch:", cmd_fetch);
 }
 FASTBOOT_INIT(lk2nd_fastboot_register_fetch);
@@ -0,0 +1,80 @@
+// SPDX-License-Identifier: BSD-3-Clause
+
+#include <debug.h>
+#include <fastboot.h>
+#include <stdio.h>
+#include <string.h>
+#if WITH_LIB_FS
+#include <lib/fs.h>
+#endif
+
+#if WITH_LIB_FS
+/*
+ * Replace the contents of a file on a mounted file system with the staged data,
+ * e.g. to update only the kernel instead of flashing the whole /boot partition.
+ * Nothing is allocated: the data is written over the existing blocks, so the
+ * file cannot grow and (for ext2/ext4) only shrink within its last block.
+ */
+static void cmd_oem_write_file(const char *arg, void *data, unsigned sz)
+{
+	struct file_stat stat;
+	filehandle *file;
+	char response[MAX_RSP_SIZE];
+	ssize_t ret;
+	int err;
+
+	if (!*arg) {
+		fastboot_fail("usage: fastboot oem write-file <path>");
+		return;
+	}
+	if (!sz) {
+		fastboot_fail("no data staged to write");
+		return;
+	}
+
+	if (fs_open_file(arg, &file) < 0) {
+		fastboot_fail("file not found");
+		return;
+	}
+
+	if (fs_stat_file(file, &stat) < 0 || stat.is_dir) {
+		fs_close_file(file);
+		fastboot_fail("not a file");
+		return;
+	}
+	if (sz > stat.size) {
+		fs_close_file(file);
+		snprintf(response, sizeof(response), "file too small (%lld bytes), cannot grow",
+			 (long long)stat.size);
+		fastboot_fail(response);
+		return;
+	}
+
+	/* Nothing is written yet if the file cannot be shrunk */
+	if (sz < stat.size) {
+		err = fs_truncate_file(file, sz);
+		if (err < 0) {
+			dprintf(INFO, "Failed to truncate %s to %u bytes: %d\n", arg, sz, err);
+			fs_close_file(file);
+			fastboot_fail("cannot shrink the file that much");
+			return;
+		}
+	}
+
+	ret = fs_write_file(file, data, 0, sz);
+	err = fs_close_file(file);
+	if (ret != (ssize_t)sz) {
+		dprintf(CRITICAL, "Failed to write %s: %ld\n", arg, (long)ret);
+		fastboot_fail("failed to write file");
+		return;
+	}
+	if (err < 0) {
+		dprintf(CRITICAL, "Failed to update the inode of %s: %d\n", arg, err);
+		fastboot_fail("failed to update file size");
+		return;
+	}
+
+	fastboot_okay("");
+}
+FASTBOOT_REGISTER("oem write-file", cmd_oem_write_file);
+#endif
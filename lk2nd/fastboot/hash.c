@@ -1,11 +1,42 @@
 // SPDX-License-Identifier: BSD-3-Clause
 /* Copyright (c) 2022, Stephan Gerhold <stephan@gerhold.net> */
 
+#include <arch/defines.h>
 #include <crypto_hash.h>
 #include <debug.h>
 #include <fastboot.h>
+#include <kernel/event.h>
+#include <kernel/thread.h>
+#include <partition_parser.h>
+#include <stdlib.h>
 #include <string.h>
 #include <target.h>
+#if WITH_LIB_FS
+#include <lib/fs.h>
+#endif
+
+/* Size of each half of the buffer used to hash partitions & files */
+#define HASH_BUF_SIZE	(4 * 1024 * 1024)
+
+/*
+ * Partitions & files are read into two buffers in turn: a separate thread
+ * reads into one of them while the crypto engine hashes the other one.
+ */
+struct hash_stream {
+	int (*read)(struct hash_stream *h, void *buf, uint64_t pos, unsigned len);
+	uint64_t offset;
+	uint64_t size;
+#if WITH_LIB_FS
+	filehandle *file;
+#endif
+	void *buf[2];
+	unsigned buf_size;
+	bool error;
+	bool stop;
+	event_t full[2];
+	event_t empty[2];
+	event_t done;
+};
 
 static void buf2hex(const uint8_t *buf, unsigned size, char *out)
 {
@@ -19,6 +50,201 @@ static void buf2hex(const uint8_t *buf, unsigned size, char *out)
 	*out = 0;
 }
 
+static int hash_read_part(struct hash_stream *h, void *buf, uint64_t pos, unsigned len)
+{
+	/* The buffer is a multiple of the block size, round up the tail */
+	return mmc_read(h->offset + pos, buf, ROUNDUP(len, mmc_get_device_blocksize()));
+}
+
+#if WITH_LIB_FS
+static int hash_read_file(struct hash_stream *h, void *buf, uint64_t pos, unsigned len)
+{
+	return fs_read_file(h->file, buf, pos, len) != (ssize_t)len;
+}
+#endif
+
+static int hash_stream_reader(void *arg)
+{
+	struct hash_stream *h = arg;
+	uint64_t pos = 0;
+	unsigned i = 0;
+	unsigned len;
+
+	while (pos < h->size) {
+		event_wait(&h->empty[i]);
+		if (h->stop)
+			break;
+
+		len = MIN(h->size - pos, (uint64_t)h->buf_size);
+		if (h->read(h, h->buf[i], pos, len)) {
+			h->error = true;
+			event_signal(&h->full[i], false);
+			break;
+		}
+
+		pos += len;
+		event_signal(&h->full[i], false);
+		i ^= 1;
+	}
+
+	/* h is gone once this is signalled */
+	event_signal(&h->done, false);
+	return 0;
+}
+
+static int hash_stream(struct hash_stream *h, void *data, crypto_auth_alg_type alg,
+		       uint32_t *digest)
+{
+	crypto_hash_ctx ctx;
+	crypto_result_type ret = CRYPTO_SHA_ERR_NONE;
+	thread_t *thr;
+	uint64_t pos = 0;
+	unsigned i = 0;
+	unsigned len;
+
+	h->buf_size = ROUNDDOWN(MIN(target_get_max_flash_size() / 2, HASH_BUF_SIZE), 4096);
+	h->buf[0] = data;
+	h->buf[1] = (char *)data + h->buf_size;
+	if (!h->buf_size || !h->size)
+		return -1;
+
+	if (hash_find_start(&ctx, alg) != CRYPTO_SHA_ERR_NONE) {
+		dprintf(CRITICAL, "hash: Unsupported hash algorithm\n");
+		return -1;
+	}
+
+	event_init(&h->full[0], false, EVENT_FLAG_AUTOUNSIGNAL);
+	event_init(&h->full[1], false, EVENT_FLAG_AUTOUNSIGNAL);
+	event_init(&h->empty[0], true, EVENT_FLAG_AUTOUNSIGNAL);
+	event_init(&h->empty[1], true, EVENT_FLAG_AUTOUNSIGNAL);
+	event_init(&h->done, false, 0);
+
+	thr = thread_create("hash reader", hash_stream_reader, h,
+			    DEFAULT_PRIORITY, DEFAULT_STACK_SIZE);
+	if (!thr) {
+		h->error = true;
+		goto out;
+	}
+	thread_resume(thr);
+
+	while (pos < h->size) {
+		event_wait(&h->full[i]);
+		if (h->error)
+			break;
+
+		len = MIN(h->size - pos, (uint64_t)h->buf_size);
+		pos += len;
+		if (pos < h->size)
+			ret = hash_find_update(&ctx, h->buf[i], len);
+		else
+			ret = hash_find_finish(&ctx, h->buf[i], len, (void *)digest);
+		if (ret != CRYPTO_SHA_ERR_NONE)
+			break;
+
+		event_signal(&h->empty[i], false);
+		i ^= 1;
+	}
+
+	/* Let the reader exit if hashing stopped early */
+	h->stop = true;
+	event_signal(&h->empty[0], false);
+	event_signal(&h->empty[1], false);
+
+	event_wait(&h->done);
+out:
+	event_destroy(&h->full[0]);
+	event_destroy(&h->full[1]);
+	event_destroy(&h->empty[0]);
+	event_destroy(&h->empty[1]);
+	event_destroy(&h->done);
+
+	return (h->error || ret != CRYPTO_SHA_ERR_NONE) ? -1 : 0;
+}
+
+/* part:<name>[:<offset>[:<size>]] */
+static int hash_part(const char *arg, void *data, crypto_auth_alg_type alg, uint32_t *digest)
+{
+	struct hash_stream h = {0};
+	const char *token;
+	char *sp;
+	uint64_t n;
+	int index;
+
+	index = partition_get_index(strtok_r((char *)arg, ":", &sp));
+	if (index == INVALID_PTN) {
+		fastboot_fail("partition not found");
+		return -1;
+	}
+
+	h.offset = partition_get_offset(index);
+	h.size = partition_get_size(index);
+	mmc_set_lun(partition_get_lun(index));
+
+	token = strtok_r(NULL, ":", &sp);
+	if (token) {
+		n = atoull(token);
+		if (n > h.size) {
+			fastboot_fail("offset larger than partition");
+			return -1;
+		}
+		h.offset += n;
+		h.size -= n;
+
+		token = strtok_r(NULL, ":", &sp);
+		if (token) {
+			n = atoull(token);
+			if (n > h.size) {
+				fastboot_fail("size larger than remaining partition");
+				return -1;
+			}
+			h.size = n;
+		}
+	}
+
+	if (h.offset % mmc_get_device_blocksize()) {
+		fastboot_fail("offset must be block aligned");
+		return -1;
+	}
+
+	h.read = hash_read_part;
+	if (hash_stream(&h, data, alg, digest)) {
+		fastboot_fail("failed to hash partition");
+		return -1;
+	}
+	return 0;
+}
+
+#if WITH_LIB_FS
+/* file:<path> */
+static int hash_file(const char *path, void *data, crypto_auth_alg_type alg, uint32_t *digest)
+{
+	struct hash_stream h = {0};
+	struct file_stat stat;
+	int ret;
+
+	if (fs_open_file(path, &h.file) < 0) {
+		fastboot_fail("file not found");
+		return -1;
+	}
+
+	ret = fs_stat_file(h.file, &stat);
+	if (ret >= 0 && stat.is_dir)
+		ret = -1;
+	h.size = stat.size;
+
+	h.read = hash_read_file;
+	if (ret >= 0)
+		ret = hash_stream(&h, data, alg, digest);
+
+	fs_close_file(h.file);
+	if (ret) {
+		fastboot_fail("failed to hash file");
+		return -1;
+	}
+	return 0;
+}
+#endif
+
 static void cmd_oem_hash(const char *arg, void *data, unsigned sz)
 {
 	/* Two chars per byte for hexadecimal and null terminator */
@@ -26,6 +252,12 @@ static void cmd_oem_hash(const char *arg, void *data, unsigned sz)
 	uint32_t digest[SHA256_INIT_VECTOR_SIZE];
 	crypto_auth_alg_type alg;
 	unsigned digest_size;
+	char *src;
+
+	/* Optional source after the algorithm */
+	src = strchr(arg, ' ');
+	if (src)
+		*src++ = 0;
 
 	if (strcmp(arg, "sha1") == 0) {
 		alg = CRYPTO_AUTH_ALG_SHA1;
@@ -34,19 +266,37 @@ static void cmd_oem_hash(const char *arg, void *data, unsigned sz)
 		alg = CRYPTO_AUTH_ALG_SHA256;
 		digest_size = SHA256_INIT_VECTOR_SIZE * sizeof(digest[0]);
 	} else {
-		fastboot_fail("usage: fastboot oem hash <sha1|sha256>");
-		return;
-	}
-
-	if (!sz) {
-		fastboot_fail("no data staged to hash");
+		fastboot_fail("usage: fastboot oem hash <sha1|sha256> [part:<name>[:<offset>[:<size>]]|file:<path>]");
 		return;
 	}
 
 	target_crypto_init_params();
-	if (hash_find(data, sz, (void *)digest, alg) != CRYPTO_SHA_ERR_NONE) {
-		fastboot_fail("failed to compute hash");
+
+	if (src && !strncmp(src, "part:", strlen("part:"))) {
+		if (!target_is_emmc_boot()) {
+			fastboot_fail("only supported on mmc & ufs");
+			return;
+		}
+		if (hash_part(src + strlen("part:"), data, alg, digest))
+			return;
+#if WITH_LIB_FS
+	} else if (src && !strncmp(src, "file:", strlen("file:"))) {
+		if (hash_file(src + strlen("file:"), data, alg, digest))
+			return;
+#endif
+	} else if (src) {
+		fastboot_fail("unknown source to hash");
 		return;
+	} else {
+		if (!sz) {
+			fastboot_fail("no data staged to hash");
+			return;
+		}
+
+		if (hash_find(data, sz, (void *)digest, alg) != CRYPTO_SHA_ERR_NONE) {
+			fastboot_fail("failed to compute hash");
+			return;
+		}
 	}
 
 	buf2hex((void *)digest, digest_size, response);
@@ -3,19 +3,192 @@
 
 #include <debug.h>
 #include <fastboot.h>
+#include <kernel/mutex.h>
+#include <kernel/thread.h>
+#include <lib/heap.h>
+#include <mmc_wrapper.h>
 #include <platform.h>
+#include <stdlib.h>
+#include <string.h>
+#include <target.h>
+
+#include <lk2nd/util/mmu.h>
+#include <lk2nd/util/scratch.h>
+
+/* Defined in aboot.c */
+extern int check_ddr_addr_range_bound(uintptr_t start, uint32_t size);
 
 #if WITH_DEBUG_LOG_BUF
 static void cmd_oem_log(const char *arg, void *data, unsigned sz)
 {
-	fastboot_stage(data, log_copy(data));
+	char response[MAX_RSP_SIZE];
+	unsigned seq = 0;
+
+	/* since:<seq> only stages what was logged after the previous call */
+	if (!strncmp(arg, "since:", strlen("since:")))
+		seq = atoul(arg + strlen("since:"));
+	else if (*arg) {
+		fastboot_fail("invalid argument");
+		return;
+	}
+
+	sz = log_copy_since(data, &seq);
+	snprintf(response, sizeof(response), "seq:%u", seq);
+	fastboot_info(response);
+	fastboot_stage(data, sz);
 }
 FASTBOOT_REGISTER("oem log", cmd_oem_log);
 #endif
 
+static void cmd_oem_heap_stats(const char *arg, void *data, unsigned sz)
+{
+	char response[MAX_RSP_SIZE];
+	struct heap_stats stats;
+
+	heap_get_stats(&stats);
+
+	snprintf(response, sizeof(response), "heap: %p + 0x%zx", stats.base, stats.len);
+	fastboot_info(response);
+	snprintf(response, sizeof(response), "used: 0x%zx, max: 0x%zx",
+		 stats.used, stats.max_used);
+	fastboot_info(response);
+	snprintf(response, sizeof(response), "free: 0x%zx, largest: 0x%zx",
+		 stats.free, stats.largest_free);
+	fastboot_info(response);
+	snprintf(response, sizeof(response), "free chunks: %u, fragmentation: %u%%",
+		 stats.free_chunks, heap_fragmentation(&stats));
+	fastboot_info(response);
+	snprintf(response, sizeof(response), "allocs: %u, total: %u, failed: %u",
+		 stats.allocs, stats.total_allocs, stats.failed_allocs);
+	fastboot_info(response);
+
+	snprintf(response, sizeof(response), "lk: 0x%x + 0x%x", MEMBASE, MEMSIZE);
+	fastboot_info(response);
+	snprintf(response, sizeof(response), "scratch: %p + 0x%x",
+		 target_get_scratch_address(), target_get_max_flash_size());
+	fastboot_info(response);
+	lk2nd_scratch_dump(fastboot_info);
+	snprintf(response, sizeof(response), "download: %p, last: 0x%x", data, sz);
+	fastboot_info(response);
+	fastboot_okay("");
+}
+FASTBOOT_REGISTER("oem heap-stats", cmd_oem_heap_stats);
+
+#define MAX_DUMP_THREADS	32
+
+static void cmd_oem_threads(const char *arg, void *data, unsigned sz)
+{
+	static const char * const states[] = {
+		[THREAD_SUSPENDED] = "suspended",
+		[THREAD_READY] = "ready",
+		[THREAD_RUNNING] = "running",
+		[THREAD_BLOCKED] = "blocked",
+		[THREAD_SLEEPING] = "sleeping",
+		[THREAD_DEATH] = "dead",
+	};
+	struct {
+		char name[32];
+		enum thread_state state;
+		int priority, base_priority;
+		size_t stack_used, stack_size;
+	} info[MAX_DUMP_THREADS];
+	char response[MAX_RSP_SIZE];
+	unsigned int i, num = 0;
+	thread_t *t;
+
+	/* Sending the response blocks, so take a snapshot first */
+	enter_critical_section();
+	list_for_every_entry(&thread_list, t, thread_t, thread_list_node) {
+		if (num == MAX_DUMP_THREADS)
+			break;
+		strlcpy(info[num].name, t->name, sizeof(info[num].name));
+		info[num].state = t->state;
+		info[num].priority = t->priority;
+		info[num].base_priority = t->base_priority;
+		info[num].stack_used = thread_stack_used(t);
+		info[num].stack_size = t->stack_size;
+		num++;
+	}
+	exit_critical_section();
+
+	for (i = 0; i < num; i++) {
+		char prio[16];
+
+		/* Show the base priority too if it was raised by a mutex waiter */
+		if (info[i].priority != info[i].base_priority)
+			snprintf(prio, sizeof(prio), "%2d (%d)",
+				 info[i].priority, info[i].base_priority);
+		else
+			snprintf(prio, sizeof(prio), "%2d", info[i].priority);
+
+		if (info[i].stack_size)
+			snprintf(response, sizeof(response),
+				 "%-16s %-9s prio %s stack %zu/%zu", info[i].name,
+				 states[info[i].state], prio,
+				 info[i].stack_used, info[i].stack_size);
+		else
+			snprintf(response, sizeof(response),
+				 "%-16s %-9s prio %s", info[i].name,
+				 states[info[i].state], prio);
+		fastboot_info(response);
+	}
+
+	snprintf(response, sizeof(response),
+		 "mutex: %u acquires, %u contended, %u priority boosts",
+		 mutex_stats.acquires, mutex_stats.contended, mutex_stats.boosts);
+	fastboot_info(response);
+
+	fastboot_okay("");
+}
+FASTBOOT_REGISTER("oem threads", cmd_oem_threads);
+
 static void cmd_oem_reboot_edl(const char *arg, void *data, unsigned sz)
 {
+	/* The write cache may still be on from flashing */
+	mmc_write_cache_enable(false);
 	fastboot_okay("");
 	reboot_device(EMERGENCY_DLOAD);
 }
 FASTBOOT_REGISTER("oem reboot-edl", cmd_oem_reboot_edl);
+
+/*
+ * Send physical memory directly from where it is, e.g. to dump the RAM after
+ * a warm reset into lk2nd. The USB driver writes back the cache for each
+ * request before the controller reads the memory, so there is no need to
+ * copy anything to the download buffer first.
+ */
+static void cmd_oem_dump_mem(const char *arg, void *data, unsigned sz)
+{
+	char *saveptr;
+	char *args = strdup(arg);
+	char *addr_str = strtok_r(args, " ", &saveptr);
+	char *size_str = strtok_r(NULL, " ", &saveptr);
+	uintptr_t addr;
+	uint32_t size;
+
+	if (!addr_str || !size_str) {
+		free(args);
+		fastboot_fail("missing address/size");
+		return;
+	}
+
+	addr = atoul(addr_str);
+	size = atoul(size_str);
+	free(args);
+
+	if (!size) {
+		fastboot_fail("invalid size");
+		return;
+	}
+	if (check_ddr_addr_range_bound(addr, size)) {
+		fastboot_fail("outside of RAM");
+		return;
+	}
+	if (!lk2nd_mmu_map_ram_dynamic("dump", addr, size)) {
+		fastboot_fail("failed to map memory");
+		return;
+	}
+
+	fastboot_write_data((void *)addr, size);
+}
+FASTBOOT_REGISTER("oem dump-mem", cmd_oem_dump_mem);
@@ -3,6 +3,7 @@ LOCAL_DIR := $(GET_LOCAL_DIR)
 
 OBJS += \
 	$(LOCAL_DIR)/fetch.o \
+	$(LOCAL_DIR)/file.o \
 	$(LOCAL_DIR)/hash.o \
 	$(LOCAL_DIR)/misc.o \
 
@@ -2,17 +2,237 @@
 /* Copyright (c) 2021-2022, Stephan Gerhold <stephan@gerhold.net> */
 
 #include <printf.h>
+#include <stdlib.h>
+#include <string.h>
+#include <target.h>
 
 #include <dev/fbcon.h>
 #include <fastboot.h>
+#include <lk2nd/smp-worker.h>
+
+#define SCREENSHOT_MAX_JOBS	8
+/* Pixels converted at once for QOI, must be a multiple of 8 */
+#define SCREENSHOT_QOI_CHUNK	4096
+
+typedef void *(*convert_func)(void *out, const void *in, uint32_t npixels);
 
 extern void *rgb565_to_rgb888(void *out, const void *in, uint32_t npixels);
 extern void *rgb888_swap(void *out, const void *in, uint32_t npixels);
 extern void *rgb8888_swap_to_rgb888(void *out, const void *in, uint32_t npixels);
 
+static void convert_job(struct lk2nd_smp_job *job)
+{
+	convert_func convert = job->priv;
+
+	convert(job->out, job->in, job->out_len / 3);
+}
+
+/*
+ * Split the conversion into parts for the secondary CPU cores (if any).
+ * Each part must start on a new cache line in the output buffer and the
+ * NEON helpers need a multiple of 8 pixels.
+ */
+static void *convert_parallel(convert_func convert, void *out, const void *in,
+			      unsigned bytespp, uint32_t npixels)
+{
+	struct lk2nd_smp_job jobs[SCREENSHOT_MAX_JOBS] = {0};
+	unsigned n = MIN(lk2nd_smp_worker_start(), SCREENSHOT_MAX_JOBS);
+	uint32_t split, end = npixels;
+	int i;
+
+	for (i = n - 1; i >= 0; i--) {
+		split = ROUNDDOWN(npixels / (n + 1) * (i + 1), 8);
+		while (split < end && ((uintptr_t)out + split * 3) % CACHE_LINE)
+			split += 8;
+		if (split >= end)
+			continue;
+
+		jobs[i].func = convert_job;
+		jobs[i].priv = convert;
+		jobs[i].in = in + split * bytespp;
+		jobs[i].in_len = (end - split) * bytespp;
+		jobs[i].out = out + split * 3;
+		jobs[i].out_len = (end - split) * 3;
+		lk2nd_smp_job_queue(&jobs[i]);
+		end = split;
+	}
+
+	if (end)
+		convert(out, in, end);
+
+	for (i = 0; i < (int)n; i++)
+		if (jobs[i].func)
+			lk2nd_smp_job_wait(&jobs[i]);
+
+	return out + npixels * 3;
+}
+
+/*
+ * QOI image encoder, see https://qoiformat.org/qoi-specification.pdf
+ * Pixels are stored as 0xAABBGGRR, the alpha channel is always 0xff.
+ */
+#define QOI_OP_INDEX	0x00
+#define QOI_OP_DIFF	0x40
+#define QOI_OP_LUMA	0x80
+#define QOI_OP_RUN	0xc0
+#define QOI_OP_RGB	0xfe
+#define QOI_MAX_RUN	62
+#define QOI_HEADER_SIZE	14
+/* Every pixel might need QOI_OP_RGB, plus the header and end marker */
+#define QOI_MAX_SIZE(npixels)	(QOI_HEADER_SIZE + (npixels) * 4 + 8)
+
+struct qoi_enc {
+	uint32_t index[64];
+	uint32_t prev;
+	unsigned run;
+};
+
+static inline uint8_t qoi_hash(uint8_t r, uint8_t g, uint8_t b)
+{
+	return (r * 3 + g * 5 + b * 7 + 0xff * 11) % 64;
+}
+
+static uint8_t *qoi_put_be32(uint8_t *out, uint32_t val)
+{
+	*out++ = val >> 24;
+	*out++ = val >> 16;
+	*out++ = val >> 8;
+	*out++ = val;
+	return out;
+}
+
+static uint8_t *qoi_start(struct qoi_enc *q, uint8_t *out, uint32_t width, uint32_t height)
+{
+	memset(q, 0, sizeof(*q));
+	q->prev = 0xff000000;
+
+	memcpy(out, "qoif", 4);
+	out = qoi_put_be32(out + 4, width);
+	out = qoi_put_be32(out, height);
+	*out++ = 3;	/* RGB */
+	*out++ = 0;	/* sRGB with linear alpha */
+	return out;
+}
+
+static uint8_t *qoi_encode(struct qoi_enc *q, uint8_t *out, const uint8_t *in, uint32_t npixels)
+{
+	for (; npixels; npixels--, in += 3) {
+		uint8_t r = in[0], g = in[1], b = in[2];
+		uint32_t px = 0xff000000 | b << 16 | g << 8 | r;
+		uint8_t h;
+		int8_t vr, vg, vb, vg_r, vg_b;
+
+		if (px == q->prev) {
+			if (++q->run == QOI_MAX_RUN) {
+				*out++ = QOI_OP_RUN | (q->run - 1);
+				q->run = 0;
+			}
+			continue;
+		}
+
+		if (q->run) {
+			*out++ = QOI_OP_RUN | (q->run - 1);
+			q->run = 0;
+		}
+
+		h = qoi_hash(r, g, b);
+		if (q->index[h] == px) {
+			*out++ = QOI_OP_INDEX | h;
+			q->prev = px;
+			continue;
+		}
+		q->index[h] = px;
+
+		vr = r - (uint8_t)q->prev;
+		vg = g - (uint8_t)(q->prev >> 8);
+		vb = b - (uint8_t)(q->prev >> 16);
+		vg_r = vr - vg;
+		vg_b = vb - vg;
+		q->prev = px;
+
+		if (vr >= -2 && vr <= 1 && vg >= -2 && vg <= 1 && vb >= -2 && vb <= 1) {
+			*out++ = QOI_OP_DIFF | (vr + 2) << 4 | (vg + 2) << 2 | (vb + 2);
+		} else if (vg_r >= -8 && vg_r <= 7 && vg >= -32 && vg <= 31 &&
+			   vg_b >= -8 && vg_b <= 7) {
+			*out++ = QOI_OP_LUMA | (vg + 32);
+			*out++ = (vg_r + 8) << 4 | (vg_b + 8);
+		} else {
+			*out++ = QOI_OP_RGB;
+			*out++ = r;
+			*out++ = g;
+			*out++ = b;
+		}
+	}
+	return out;
+}
+
+static uint8_t *qoi_finish(struct qoi_enc *q, uint8_t *out)
+{
+	static const uint8_t end[8] = {0, 0, 0, 0, 0, 0, 0, 1};
+
+	if (q->run)
+		*out++ = QOI_OP_RUN | (q->run - 1);
+	memcpy(out, end, sizeof(end));
+	return out + sizeof(end);
+}
+
+/*
+ * Convert the framebuffer in small chunks that stay in the cache and
+ * encode them right away. While one chunk is encoded the next one is
+ * converted on a secondary CPU core (if any).
+ */
+static void *convert_qoi(convert_func convert, void *out, const void *in,
+			 unsigned bytespp, uint32_t width, uint32_t height)
+{
+	struct lk2nd_smp_job job = {0};
+	uint32_t npixels = width * height;
+	uint32_t pos, n, next;
+	struct qoi_enc q;
+	uint8_t *buf[2];
+	int cur = 0;
+
+	buf[0] = memalign(CACHE_LINE, SCREENSHOT_QOI_CHUNK * 3);
+	buf[1] = memalign(CACHE_LINE, SCREENSHOT_QOI_CHUNK * 3);
+	if (!buf[0] || !buf[1]) {
+		free(buf[0]);
+		free(buf[1]);
+		return NULL;
+	}
+
+	out = qoi_start(&q, out, width, height);
+	convert(buf[cur], in, MIN(npixels, SCREENSHOT_QOI_CHUNK));
+
+	for (pos = 0; pos < npixels; pos = next) {
+		n = MIN(npixels - pos, SCREENSHOT_QOI_CHUNK);
+		next = pos + n;
+
+		if (next < npixels) {
+			job.func = convert_job;
+			job.priv = convert;
+			job.in = in + next * bytespp;
+			job.in_len = MIN(npixels - next, SCREENSHOT_QOI_CHUNK) * bytespp;
+			job.out = buf[!cur];
+			job.out_len = MIN(npixels - next, SCREENSHOT_QOI_CHUNK) * 3;
+			lk2nd_smp_job_queue(&job);
+		}
+
+		out = qoi_encode(&q, out, buf[cur], n);
+
+		if (next < npixels)
+			lk2nd_smp_job_wait(&job);
+		cur = !cur;
+	}
+
+	free(buf[0]);
+	free(buf[1]);
+	return qoi_finish(&q, out);
+}
+
 static void cmd_oem_screenshot(const char *arg, void *data, unsigned sz)
 {
 	struct fbcon_config *fb = fbcon_display();
+	convert_func convert;
+	unsigned bytespp;
 	unsigned hdr;
 	void *end;
 
@@ -27,26 +247,47 @@ static void cmd_oem_screenshot(const char *arg, void *data, unsigned sz)
 		return;
 	}
 
-	/* PPM image header, see http://netpbm.sourceforge.net/doc/ppm.html */
-	hdr = sprintf(data, "P6\n\n%7u %7u\n255\n", fb->width, fb->height);
-	ASSERT(hdr % sizeof(uint64_t) == 0);
-
-	/* Convert to RGB888, swap to change color order for PPM */
+	/* Convert to RGB888, swap to change color order for PPM/QOI */
 	switch (fb->bpp) {
 	case 16:
-		end = rgb565_to_rgb888(data + hdr, fb->base, sz);
+		convert = rgb565_to_rgb888;
+		bytespp = 2;
 		break;
 	case 24:
-		end = rgb888_swap(data + hdr, fb->base, sz);
+		convert = rgb888_swap;
+		bytespp = 3;
 		break;
 	case 32:
-		end = rgb8888_swap_to_rgb888(data + hdr, fb->base, sz);
+		convert = rgb8888_swap_to_rgb888;
+		bytespp = 4;
 		break;
 	default:
 		fastboot_fail("unsupported display bpp");
 		return;
 	}
 
+	if (!strcmp(arg, "qoi")) {
+		if (QOI_MAX_SIZE(sz) > target_get_max_flash_size()) {
+			fastboot_fail("display too large for download buffer");
+			return;
+		}
+
+		end = convert_qoi(convert, data, fb->base, bytespp, fb->width, fb->height);
+		if (!end) {
+			fastboot_fail("out of memory");
+			return;
+		}
+	} else if (!*arg) {
+		/* PPM image header, see http://netpbm.sourceforge.net/doc/ppm.html */
+		hdr = sprintf(data, "P6\n\n%7u %7u\n255\n", fb->width, fb->height);
+		ASSERT(hdr % sizeof(uint64_t) == 0);
+
+		end = convert_parallel(convert, data + hdr, fb->base, bytespp, sz);
+	} else {
+		fastboot_fail("unsupported format");
+		return;
+	}
+
 	fastboot_stage(data, end - data);
 }
 FASTBOOT_REGISTER("oem screenshot", cmd_oem_screenshot);
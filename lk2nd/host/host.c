@@ -0,0 +1,46 @@
+// SPDX-License-Identifier: BSD-3-Clause
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "host.h"
+
+unsigned long long host_time_us(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (unsigned long long)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/* Map the file privately, so it neither needs the heap nor changes the file */
+void *host_load_file(const char *path, unsigned long *len)
+{
+	struct stat st;
+	void *buf;
+	int fd;
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return NULL;
+
+	buf = MAP_FAILED;
+	if (fstat(fd, &st) == 0 && st.st_size > 0)
+		buf = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+	close(fd);
+
+	if (buf == MAP_FAILED)
+		return NULL;
+
+	*len = st.st_size;
+	return buf;
+}
+
+void host_exit(int status)
+{
+	exit(status);
+}
@@ -0,0 +1,13 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+#ifndef __LK2ND_HOST_H
+#define __LK2ND_HOST_H
+
+/*
+ * Interface between the LK side (built with the LK headers) and the few
+ * functions that need the headers of the host C library.
+ */
+unsigned long long host_time_us(void);
+void *host_load_file(const char *path, unsigned long *len);
+void host_exit(int status) __attribute__((noreturn));
+
+#endif
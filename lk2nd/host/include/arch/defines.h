@@ -0,0 +1,10 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+#ifndef __HOST_ARCH_DEFINES_H
+#define __HOST_ARCH_DEFINES_H
+
+#define PAGE_SIZE	4096
+#define CACHE_LINE	64
+
+#define dsb() __sync_synchronize()
+
+#endif
@@ -0,0 +1,32 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+#ifndef __CONFIG_H
+#define __CONFIG_H
+
+/*
+ * Replaces the config.h generated by the LK build: it is included first by
+ * every library source built for the host.
+ */
+#define BYTE_ORDER LITTLE_ENDIAN
+#define DEBUG 1
+#define LK 1
+
+#define WITH_LIB_BIO 1
+#define WITH_LIB_BCACHE 1
+#define WITH_LIB_CONSOLE 1
+#define WITH_LIB_FS 1
+#define WITH_LIB_HEAP 1
+#define WITH_LIB_ZLIB_INFLATE 1
+
+/* lib/heap manages a static array so its behaviour matches the device */
+#define WITH_STATIC_HEAP 1
+#define HEAP_START ((addr_t)host_heap)
+#define HEAP_LEN HOST_HEAP_LEN
+#ifndef HOST_HEAP_LEN
+#define HOST_HEAP_LEN (256 * 1024 * 1024)
+#endif
+
+#ifndef __ASSEMBLY__
+extern char host_heap[];
+#endif
+
+#endif
@@ -0,0 +1,21 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+#ifndef __HOST_KERNEL_EVENT_H
+#define __HOST_KERNEL_EVENT_H
+
+#include <kernel/thread.h>
+
+/*
+ * Without threads every request completes before it is waited for,
+ * so events only need to remember that they were signalled.
+ */
+typedef struct event {
+	bool signalled;
+} event_t;
+
+static inline void event_init(event_t *e, bool initial, uint flags) { e->signalled = initial; }
+static inline void event_destroy(event_t *e) { }
+static inline status_t event_signal(event_t *e, bool reschedule) { e->signalled = true; return 0; }
+static inline status_t event_unsignal(event_t *e) { e->signalled = false; return 0; }
+static inline status_t event_wait(event_t *e) { return e->signalled ? 0 : -1; }
+
+#endif
@@ -0,0 +1,15 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+#ifndef __HOST_KERNEL_THREAD_H
+#define __HOST_KERNEL_THREAD_H
+
+#include <sys/types.h>
+#include <compiler.h>
+#include <arch/ops.h>
+
+/* The host build runs everything in a single thread */
+static inline void enter_critical_section(void) { }
+static inline void exit_critical_section(void) { }
+static inline bool in_critical_section(void) { return false; }
+static inline void thread_yield(void) { }
+
+#endif
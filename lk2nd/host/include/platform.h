@@ -0,0 +1,10 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+#ifndef __HOST_PLATFORM_H
+#define __HOST_PLATFORM_H
+
+#include <sys/types.h>
+
+time_t current_time(void);
+bigtime_t current_time_hires(void);
+
+#endif
@@ -0,0 +1,11 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+#ifndef __HOST_PLATFORM_DEBUG_H
+#define __HOST_PLATFORM_DEBUG_H
+
+#include <sys/types.h>
+#include <stdarg.h>
+#include <compiler.h>
+
+void platform_halt(void);
+
+#endif
@@ -0,0 +1,73 @@
+// SPDX-License-Identifier: BSD-3-Clause
+
+#include <lib/bio.h>
+#include <lib/heap.h>
+
+#include "host.h"
+
+/*
+ * Run the same benchmark as the "fs_bench" console command on the host.
+ * Wall times only give a rough idea of the device, but the block and heap
+ * counts are the same as on the device for the same image.
+ */
+#include "../../app/tests/fs_bench.c"
+
+#define HOST_BDEV	"image"
+
+/* glibc allocates through malloc() before main() already */
+static void __attribute__((constructor)) host_heap_init(void)
+{
+	heap_init();
+}
+
+static void host_bench_totals(void)
+{
+	struct bcache_stats bcache;
+	struct heap_stats heap;
+
+	bcache_get_stats(&bcache);
+	fs_bench_result("total-bcache-hits", NULL, bcache.hits, "blocks");
+	fs_bench_result("total-bcache-misses", NULL, bcache.misses, "blocks");
+	fs_bench_result("total-bcache-reads", NULL, bcache.reads, "blocks");
+	fs_bench_result("total-bcache-depth", NULL, bcache.depth, "entries");
+
+	heap_get_stats(&heap);
+	fs_bench_result("total-heap-allocs", NULL, heap.total_allocs, "allocs");
+	fs_bench_result("total-heap-max-used", NULL, heap.max_used, "bytes");
+	fs_bench_result("total-heap-fragmentation", NULL, heap_fragmentation(&heap), "%");
+}
+
+int main(int argc, char **argv)
+{
+	cmd_args args[argc];
+	unsigned long len;
+	void *image;
+	int i, ret;
+
+	if (argc < 3) {
+		printf("usage: %s <image> [<fs type>] <path>...\n", argv[0]);
+		return 1;
+	}
+
+	image = host_load_file(argv[1], &len);
+	if (!image) {
+		printf("failed to load %s\n", argv[1]);
+		return 1;
+	}
+
+	bio_init();
+	fs_init();
+	create_membdev(HOST_BDEV, image, len);
+
+	memset(args, 0, sizeof(args));
+	args[0].str = "fs_bench";
+	args[1].str = HOST_BDEV;
+	for (i = 2; i < argc; i++)
+		args[i].str = argv[i];
+
+	ret = cmd_fs_bench(argc, args);
+	if (ret == 0)
+		host_bench_totals();
+
+	return ret ? 1 : 0;
+}
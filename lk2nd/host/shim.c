@@ -0,0 +1,92 @@
+// SPDX-License-Identifier: BSD-3-Clause
+
+#include <arch/ops.h>
+#include <debug.h>
+#include <platform.h>
+#include <printf.h>
+#include <stdlib.h>
+
+#include "host.h"
+
+/*
+ * The parts of the kernel, platform and libc used by the libraries. Only a
+ * single thread runs on the host, so there is nothing to lock, interrupts
+ * do not exist and caches are coherent. Everything else (printf, string
+ * functions) comes from the C library of the host, while lib/libc/malloc.c
+ * and lib/heap replace its malloc.
+ */
+
+char host_heap[HOST_HEAP_LEN] __ALIGNED(4096);
+
+time_t current_time(void)
+{
+	return host_time_us() / 1000;
+}
+
+bigtime_t current_time_hires(void)
+{
+	return host_time_us();
+}
+
+int _dputs(const char *str)
+{
+	return printf("%s", str);
+}
+
+int _dprintf(const char *fmt, ...)
+{
+	va_list ap;
+	char buf[256];
+	int ret;
+
+	va_start(ap, fmt);
+	ret = vsnprintf(buf, sizeof(buf), fmt, ap);
+	va_end(ap);
+
+	_dputs(buf);
+	return ret;
+}
+
+void _panic(void *caller, const char *fmt, ...)
+{
+	va_list ap;
+	char buf[256];
+
+	va_start(ap, fmt);
+	vsnprintf(buf, sizeof(buf), fmt, ap);
+	va_end(ap);
+
+	printf("panic (caller %p): %s", caller, buf);
+	host_exit(2);
+}
+
+void platform_halt(void)
+{
+	host_exit(2);
+}
+
+int atomic_add(volatile int *ptr, int val)
+{
+	int old = *ptr;
+
+	*ptr = old + val;
+	return old;
+}
+
+void arch_clean_cache_range(addr_t start, size_t len) { }
+void arch_clean_invalidate_cache_range(addr_t start, size_t len) { }
+void arch_invalidate_cache_range(addr_t start, size_t len) { }
+void arch_sync_cache_range(addr_t start, size_t len) { }
+
+/* Only used if the CPU has the ARMv8 CRC32 instructions */
+uint32_t crc32_armv8(uint32_t crc, const void *buf, size_t size)
+{
+	panic("crc32_armv8 called on the host\n");
+	return crc;
+}
+
+uint32_t crc32c_armv8(uint32_t crc, const void *buf, size_t size)
+{
+	panic("crc32c_armv8 called on the host\n");
+	return crc;
+}
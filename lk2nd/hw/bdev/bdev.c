@@ -1,19 +1,87 @@
 // SPDX-License-Identifier: BSD-3-Clause
 /* Copyright (c) 2023 Nikita Travkin <nikita@trvn.ru> */
 
+#include <boot_device.h>
 #include <compiler.h>
+#include <debug.h>
+#include <kernel/event.h>
+#include <kernel/thread.h>
 #include <lk2nd/hw/bdev.h>
+#include <lk2nd/init.h>
+#include <target.h>
 
 #include "bdev.h"
 
+/*
+ * The SD card identification waits for the card to power up (ACMD41), which
+ * can take several hundred milliseconds. It runs in its own thread, started
+ * from lk2nd_init(), so that it overlaps with the rest of the initialization
+ * (e.g. the display). The block device is still registered after the eMMC,
+ * to keep the order in which the devices are scanned.
+ */
+#if MMC_SDHCI_SUPPORT
+static struct mmc_device *sd_mmc;
+static event_t sd_done;
+static bool sd_started;
+
+static int lk2nd_bdev_sd_thread(void *arg)
+{
+	sd_mmc = target_get_sd_mmc();
+	event_signal(&sd_done, true);
+	return 0;
+}
+
+static void lk2nd_bdev_sd_start(void)
+{
+	thread_t *thr;
+
+	event_init(&sd_done, false, 0);
+
+	thr = thread_create("sd-init", lk2nd_bdev_sd_thread, NULL,
+			    DEFAULT_PRIORITY, DEFAULT_STACK_SIZE);
+	if (!thr) {
+		dprintf(INFO, "Failed to create the SD card thread\n");
+		return;
+	}
+	sd_started = true;
+	thread_resume(thr);
+}
+LK2ND_INIT(lk2nd_bdev_sd_start);
+#endif
+
+/**
+ * lk2nd_bdev_wait() - Wait until the SD card identification is done.
+ *
+ * Must be called before booting, so that the SD card controller is not
+ * used anymore.
+ */
+void lk2nd_bdev_wait(void)
+{
+#if MMC_SDHCI_SUPPORT
+	if (sd_started)
+		event_wait(&sd_done);
+#endif
+}
+
 /**
  * lk2nd_bdev_init() - Prepare block devices for lk2nd
  */
 void lk2nd_bdev_init(void)
 {
-	lk2nd_wrapper_bio_register();
-	if (IS_ENABLED(MMC_SDHCI_SUPPORT))
-		lk2nd_mmc_sdhci_bio_register();
+	/* The wrapper can only access one UFS LUN at a time */
+	if (IS_ENABLED(LK2ND_BDEV_UFS) && !platform_boot_dev_isemmc())
+		lk2nd_ufs_bio_register();
+	else
+		lk2nd_wrapper_bio_register();
+#if MMC_SDHCI_SUPPORT
+	if (sd_started)
+		lk2nd_bdev_wait();
+	else
+		sd_mmc = target_get_sd_mmc();
+	lk2nd_mmc_sdhci_bio_register(sd_mmc);
+#endif
+	if (IS_ENABLED(LK2ND_BDEV_UBI))
+		lk2nd_ubi_bio_register();
 
 	lk2nd_bdev_dump_devices();
 }
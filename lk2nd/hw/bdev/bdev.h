@@ -1,10 +1,50 @@
 #ifndef BDEV_H
 #define BDEV_H
 
+#include <kernel/event.h>
+#include <kernel/mutex.h>
+#include <lib/bio.h>
+#include <list.h>
+
+/* queue.c */
+#define LK2ND_BDEV_QUEUE_BATCH	16
+/* Largest read that adjacent requests are merged into */
+#define LK2ND_BDEV_QUEUE_MERGE_MAX	(512 * 1024)
+/* Requests that waited longer (us) are executed first, in submission order */
+#define LK2ND_BDEV_QUEUE_DEADLINE	10000
+
+struct lk2nd_bdev_queue {
+	struct list_node requests;
+	mutex_t lock;
+	event_t work;
+	bool started;
+	/* Optional, merge adjacent requests into one readv() of up to this size */
+	size_t merge_max;
+
+	/* Optional, executes and completes several queued requests at once */
+	void (*read_batch)(struct lk2nd_bdev_queue *q, struct bio_request **reqs, uint count);
+};
+
+void lk2nd_bdev_queue_init(struct lk2nd_bdev_queue *q);
+status_t lk2nd_bdev_queue_submit(struct lk2nd_bdev_queue *q, struct bdev *dev, struct bio_request *req);
+
 /* util.c */
 void lk2nd_bdev_dump_devices(void);
 
+struct mmc_device;
 void lk2nd_wrapper_bio_register(void);
-void lk2nd_mmc_sdhci_bio_register(void);
+void lk2nd_mmc_sdhci_bio_register(struct mmc_device *mmc);
+void lk2nd_ubi_bio_register(void);
+void lk2nd_ufs_bio_register(void);
+
+/* wrapper.c */
+void lk2nd_bdev_publish_partitions(bdev_t *bdev, int lun);
+
+/* mmc_sdhci.c */
+#define LK2ND_MMC_MAX_SG	16
+ssize_t lk2nd_mmc_sdhci_readv(struct mmc_device *mmc, const struct bio_vec *iov, uint iovcnt,
+			      off_t offset, uint32_t block_size);
+void lk2nd_mmc_sdhci_read_batch(struct mmc_device *mmc, struct lk2nd_bdev_queue *q,
+				struct bio_request **reqs, uint count);
 
 #endif
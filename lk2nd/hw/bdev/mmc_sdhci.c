@@ -22,59 +22,206 @@
 struct mmc_bdev {
 	struct bdev dev;
 	struct mmc_device *mmc;
+	struct lk2nd_bdev_queue queue;
 };
 
 static ssize_t lk2nd_mmc_sdhci_bdev_read_block(struct bdev *bdev, void *buf, bnum_t block, uint count)
 {
 	struct mmc_bdev *dev = container_of(bdev, struct mmc_bdev, dev);
 	uint32_t block_size = dev->dev.block_size;
-	uint32_t read_size = SDHCI_ADMA_MAX_TRANS_SZ;
-	uint32_t data_len = count * block_size;
-	uint64_t data_addr = (uint64_t)block * block_size;
+	/*
+	 * The 16-bit block count (register and CMD23 argument) limits a single
+	 * command. The card is stopped by auto CMD23/CMD12 in hardware, so there
+	 * is no extra round trip between the commands.
+	 */
+	uint max_blocks = SDHCI_ADMA_MAX_TRANS_SZ / block_size;
 	uint8_t *sptr = (uint8_t *)buf;
-	uint32_t ret = 0;
+	uint left = count;
+	uint n;
 
-	arch_clean_invalidate_cache_range((addr_t)(buf), data_len);
+	mutex_acquire(&dev->queue.lock);
+	arch_clean_invalidate_cache_range((addr_t)(buf), count * block_size);
 
-	while (data_len > read_size) {
-		ret = mmc_sdhci_read(dev->mmc, (void *)sptr, (data_addr / block_size), (read_size / block_size));
-		if (ret)
-			return ERR_IO;
+	while (left) {
+		n = MIN(left, max_blocks);
+		if (mmc_sdhci_read(dev->mmc, (void *)sptr, block, n))
+			goto err;
 
-		sptr += read_size;
-		data_addr += read_size;
-		data_len -= read_size;
+		sptr += n * block_size;
+		block += n;
+		left -= n;
 	}
 
-	if (data_len) {
-		ret = mmc_sdhci_read(dev->mmc, (void *)sptr, (data_addr / block_size), (data_len / block_size));
-		if (ret)
-			return ERR_IO;
+	mutex_release(&dev->queue.lock);
+	return count * block_size;
+
+err:
+	mutex_release(&dev->queue.lock);
+	return ERR_IO;
+}
+
+static ssize_t lk2nd_mmc_sdhci_bdev_write_block(struct bdev *bdev, const void *buf, bnum_t block, uint count)
+{
+	struct mmc_bdev *dev = container_of(bdev, struct mmc_bdev, dev);
+	uint32_t block_size = dev->dev.block_size;
+	uint max_blocks = SDHCI_ADMA_MAX_TRANS_SZ / block_size;
+	const uint8_t *sptr = buf;
+	uint left = count;
+	uint n;
+
+	mutex_acquire(&dev->queue.lock);
+	arch_clean_invalidate_cache_range((addr_t)(buf), count * block_size);
+
+	while (left) {
+		n = MIN(left, max_blocks);
+		if (mmc_sdhci_write(dev->mmc, (void *)sptr, block, n))
+			goto err;
+
+		sptr += n * block_size;
+		block += n;
+		left -= n;
 	}
 
+	mutex_release(&dev->queue.lock);
 	return count * block_size;
+
+err:
+	mutex_release(&dev->queue.lock);
+	return ERR_IO;
 }
 
-void lk2nd_mmc_sdhci_bio_register(void)
+/**
+ * lk2nd_mmc_sdhci_readv() - Read consecutive blocks into several buffers.
+ * @mmc:        MMC device, must be locked by the caller
+ * @iov:        Buffers, aligned to CACHE_LINE and a multiple of @block_size
+ * @iovcnt:     Number of buffers
+ * @offset:     Device offset, aligned to @block_size
+ * @block_size: Block size of the device
+ *
+ * All buffers are filled with a single command using one ADMA descriptor
+ * chain.
+ *
+ * Return: Bytes read, ERR_NOT_SUPPORTED if the request cannot be done this way.
+ */
+ssize_t lk2nd_mmc_sdhci_readv(struct mmc_device *mmc, const struct bio_vec *iov, uint iovcnt,
+			      off_t offset, uint32_t block_size)
 {
-	struct mmc_bdev *bdev = malloc(sizeof(*bdev));
-	struct mmc_device *mmc;
+	struct mmc_sg sg[LK2ND_MMC_MAX_SG];
+	size_t len = 0;
+	uint i;
+
+	if (iovcnt > LK2ND_MMC_MAX_SG || offset % block_size)
+		return ERR_NOT_SUPPORTED;
+
+	for (i = 0; i < iovcnt; i++) {
+		if ((addr_t)iov[i].buf % CACHE_LINE || iov[i].len % block_size)
+			return ERR_NOT_SUPPORTED;
+
+		sg[i].addr = iov[i].buf;
+		sg[i].len = iov[i].len;
+		len += iov[i].len;
+	}
+
+	if (len > SDHCI_ADMA_MAX_TRANS_SZ)
+		return ERR_NOT_SUPPORTED;
+
+	for (i = 0; i < iovcnt; i++)
+		arch_clean_invalidate_cache_range((addr_t)iov[i].buf, iov[i].len);
+
+	if (mmc_sdhci_readv(mmc, sg, iovcnt, offset / block_size, len / block_size))
+		return ERR_IO;
+
+	return len;
+}
+
+/**
+ * lk2nd_mmc_sdhci_read_batch() - Execute several queued reads at once.
+ * @mmc:   MMC device
+ * @q:     Queue of the block device, its lock is taken while reading
+ * @reqs:  Requests to execute and complete
+ * @count: Number of requests, at most LK2ND_BDEV_QUEUE_BATCH
+ *
+ * Block aligned reads into cache line aligned buffers are handed to the
+ * card together, so it can use command queueing where available. Other
+ * requests are executed one by one through the block device.
+ */
+void lk2nd_mmc_sdhci_read_batch(struct mmc_device *mmc, struct lk2nd_bdev_queue *q,
+				struct bio_request **reqs, uint count)
+{
+	struct mmc_read_task tasks[LK2ND_BDEV_QUEUE_BATCH];
+	struct bio_request *queued[LK2ND_BDEV_QUEUE_BATCH];
+	uint32_t block_size = mmc->card.block_size;
+	struct bio_request *req;
+	uint i, n = 0;
+
+	for (i = 0; i < count; i++) {
+		req = reqs[i];
+		if ((addr_t)req->buf % CACHE_LINE || req->offset % block_size ||
+		    req->len % block_size || req->len > SDHCI_ADMA_MAX_TRANS_SZ) {
+			bio_complete(req, req->dev->read(req->dev, req->buf, req->offset, req->len));
+			continue;
+		}
+
+		arch_clean_invalidate_cache_range((addr_t)req->buf, req->len);
+		tasks[n].dest = req->buf;
+		tasks[n].blk_addr = req->offset / block_size;
+		tasks[n].num_blocks = req->len / block_size;
+		queued[n++] = req;
+	}
+
+	if (!n)
+		return;
+
+	mutex_acquire(&q->lock);
+	mmc_sdhci_read_queued(mmc, tasks, n);
+	mutex_release(&q->lock);
+
+	for (i = 0; i < n; i++)
+		bio_complete(queued[i], tasks[i].ret ? ERR_IO : (ssize_t)queued[i]->len);
+}
+
+static ssize_t lk2nd_mmc_sdhci_bdev_readv(struct bdev *bdev, const struct bio_vec *iov, uint iovcnt, off_t offset)
+{
+	struct mmc_bdev *dev = container_of(bdev, struct mmc_bdev, dev);
+	ssize_t ret;
+
+	mutex_acquire(&dev->queue.lock);
+	ret = lk2nd_mmc_sdhci_readv(dev->mmc, iov, iovcnt, offset, bdev->block_size);
+	mutex_release(&dev->queue.lock);
+
+	return ret;
+}
+
+static status_t lk2nd_mmc_sdhci_bdev_submit(struct bdev *bdev, struct bio_request *req)
+{
+	struct mmc_bdev *dev = container_of(bdev, struct mmc_bdev, dev);
+
+	return lk2nd_bdev_queue_submit(&dev->queue, bdev, req);
+}
+
+void lk2nd_mmc_sdhci_bio_register(struct mmc_device *mmc)
+{
+	struct mmc_bdev *bdev;
 	char name[32];
 
 	dprintf(INFO, "Registering mmc_sdhci bio devices...\n");
-	mmc = target_get_sd_mmc();
-
 	if (!mmc) {
 		dprintf(INFO, "SD card MMC is unavailable.\n");
-		free(bdev);
 		return;
 	}
 
+	bdev = malloc(sizeof(*bdev));
+
 	snprintf(name, sizeof(name), "mmc%d", mmc->config.slot);
 	bio_initialize_bdev(&bdev->dev, name, mmc->card.block_size, mmc->card.capacity / mmc->card.block_size);
 
 	bdev->mmc = mmc;
 	bdev->dev.read_block = lk2nd_mmc_sdhci_bdev_read_block;
+	bdev->dev.write_block = lk2nd_mmc_sdhci_bdev_write_block;
+	bdev->dev.submit = lk2nd_mmc_sdhci_bdev_submit;
+	bdev->dev.readv = lk2nd_mmc_sdhci_bdev_readv;
+	lk2nd_bdev_queue_init(&bdev->queue);
+	bdev->queue.merge_max = MIN(LK2ND_BDEV_QUEUE_MERGE_MAX, SDHCI_ADMA_MAX_TRANS_SZ);
 
 	bio_register_device(&bdev->dev);
 	partition_publish(name, 0);
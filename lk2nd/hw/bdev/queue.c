@@ -0,0 +1,241 @@
+// SPDX-License-Identifier: BSD-3-Clause
+
+#include <debug.h>
+#include <kernel/thread.h>
+#include <lib/bio.h>
+#include <list.h>
+#include <platform.h>
+#include <string.h>
+
+#include "bdev.h"
+
+/*
+ * queue.c - Asynchronous reads for the lk2nd block devices.
+ *
+ * The requests are executed by a thread per device. The SDHCI driver yields
+ * while the data is transferred, so the submitting thread keeps running
+ * (e.g. decompressing or hashing the previous chunk) in the meantime.
+ * The lock serializes all reads through the block device layer, whether
+ * they come from the queue or from synchronous callers.
+ *
+ * If the device can execute several reads at once (e.g. with eMMC command
+ * queueing), all pending requests are handed over together.
+ *
+ * Within a batch the requests are sorted by device and offset, and runs of
+ * adjacent block aligned requests are merged into a single readv() (one
+ * ADMA descriptor chain) if the device supports it. Requests that already
+ * waited longer than LK2ND_BDEV_QUEUE_DEADLINE are executed first and on
+ * their own, so a large readahead does not hold back a latency sensitive
+ * read (e.g. fastboot). The batches are still taken from the queue in
+ * submission order, so nothing waits for longer than one batch.
+ */
+
+static bool lk2nd_bdev_queue_before(const struct bio_request *a, const struct bio_request *b)
+{
+	if (a->dev != b->dev)
+		return (uintptr_t)a->dev < (uintptr_t)b->dev;
+	return a->offset < b->offset;
+}
+
+/*
+ * Move the expired requests to the front (keeping their order) and sort
+ * the others. Returns the number of expired requests.
+ */
+static uint lk2nd_bdev_queue_sort(struct bio_request **reqs, uint count)
+{
+	bigtime_t now = current_time_hires();
+	struct bio_request *req;
+	uint i, j, expired = 0;
+
+	for (i = 0; i < count; i++) {
+		req = reqs[i];
+		if (now - req->start >= LK2ND_BDEV_QUEUE_DEADLINE) {
+			for (j = i; j > expired; j--)
+				reqs[j] = reqs[j - 1];
+			reqs[expired++] = req;
+			continue;
+		}
+
+		for (j = i; j > expired && lk2nd_bdev_queue_before(req, reqs[j - 1]); j--)
+			reqs[j] = reqs[j - 1];
+		reqs[j] = req;
+	}
+
+	return expired;
+}
+
+static void lk2nd_bdev_queue_dispatch(struct lk2nd_bdev_queue *q, struct bio_request **reqs, uint count)
+{
+	struct bio_request *req;
+	uint i;
+
+	if (q->read_batch && count > 1) {
+		q->read_batch(q, reqs, count);
+		return;
+	}
+
+	for (i = 0; i < count; i++) {
+		req = reqs[i];
+		bio_complete(req, req->dev->read(req->dev, req->buf, req->offset, req->len));
+	}
+}
+
+static bool lk2nd_bdev_queue_mergeable(struct lk2nd_bdev_queue *q, const struct bio_request *req)
+{
+	uint32_t block_size = req->dev->block_size;
+
+	return req->dev->readv && req->offset % block_size == 0 &&
+	       req->len % block_size == 0 && req->len <= q->merge_max;
+}
+
+/* Length of the run of adjacent requests that can be merged, at least 1 */
+static uint lk2nd_bdev_queue_run(struct lk2nd_bdev_queue *q, struct bio_request **reqs, uint count)
+{
+	size_t len = reqs[0]->len;
+	uint n;
+
+	if (!lk2nd_bdev_queue_mergeable(q, reqs[0]))
+		return 1;
+
+	for (n = 1; n < count; n++) {
+		if (reqs[n]->dev != reqs[0]->dev ||
+		    reqs[n]->offset != reqs[n - 1]->offset + (off_t)reqs[n - 1]->len ||
+		    !lk2nd_bdev_queue_mergeable(q, reqs[n]) || len + reqs[n]->len > q->merge_max)
+			break;
+		len += reqs[n]->len;
+	}
+
+	return n;
+}
+
+/* Returns false if the requests must be executed separately */
+static bool lk2nd_bdev_queue_read_merged(struct bio_request **reqs, uint count)
+{
+	struct bio_vec iov[LK2ND_BDEV_QUEUE_BATCH];
+	size_t len = 0;
+	ssize_t ret;
+	uint i;
+
+	for (i = 0; i < count; i++) {
+		iov[i].buf = reqs[i]->buf;
+		iov[i].len = reqs[i]->len;
+		len += reqs[i]->len;
+	}
+
+	ret = reqs[0]->dev->readv(reqs[0]->dev, iov, count, reqs[0]->offset);
+	if (ret != (ssize_t)len)
+		return false;
+
+	for (i = 0; i < count; i++)
+		bio_complete(reqs[i], reqs[i]->len);
+	return true;
+}
+
+/*
+ * Execute the merged runs immediately and collect the remaining requests
+ * in @rest. Returns the number of requests in @rest.
+ */
+static uint lk2nd_bdev_queue_merge(struct lk2nd_bdev_queue *q, struct bio_request **reqs, uint count,
+				   struct bio_request **rest)
+{
+	uint i, n, left = 0;
+
+	for (i = 0; i < count; i += n) {
+		n = lk2nd_bdev_queue_run(q, &reqs[i], count - i);
+		if (n > 1 && lk2nd_bdev_queue_read_merged(&reqs[i], n))
+			continue;
+
+		memcpy(&rest[left], &reqs[i], n * sizeof(*rest));
+		left += n;
+	}
+
+	return left;
+}
+
+static int lk2nd_bdev_queue_thread(void *arg)
+{
+	struct lk2nd_bdev_queue *q = arg;
+	struct bio_request *reqs[LK2ND_BDEV_QUEUE_BATCH];
+	struct bio_request *rest[LK2ND_BDEV_QUEUE_BATCH];
+	uint count, expired;
+
+	for (;;) {
+		event_wait(&q->work);
+
+		for (;;) {
+			enter_critical_section();
+			for (count = 0; count < LK2ND_BDEV_QUEUE_BATCH; count++) {
+				reqs[count] = list_remove_head_type(&q->requests, struct bio_request, node);
+				if (!reqs[count])
+					break;
+			}
+			exit_critical_section();
+			if (!count)
+				break;
+
+			expired = lk2nd_bdev_queue_sort(reqs, count);
+			if (expired)
+				lk2nd_bdev_queue_dispatch(q, reqs, expired);
+
+			count -= expired;
+			if (q->merge_max)
+				count = lk2nd_bdev_queue_merge(q, &reqs[expired], count, rest);
+			else
+				memcpy(rest, &reqs[expired], count * sizeof(*rest));
+
+			if (count)
+				lk2nd_bdev_queue_dispatch(q, rest, count);
+		}
+	}
+
+	return 0;
+}
+
+/**
+ * lk2nd_bdev_queue_init() - Initialize the request queue of a block device.
+ * @q: Queue to initialize
+ */
+void lk2nd_bdev_queue_init(struct lk2nd_bdev_queue *q)
+{
+	list_initialize(&q->requests);
+	mutex_init(&q->lock);
+	event_init(&q->work, false, EVENT_FLAG_AUTOUNSIGNAL);
+	q->started = false;
+	q->merge_max = 0;
+	q->read_batch = NULL;
+}
+
+/**
+ * lk2nd_bdev_queue_submit() - Queue an asynchronous read.
+ * @q:   Queue of the block device
+ * @dev: Block device, used to name the thread
+ * @req: Request to execute, with req->dev set up by bio_submit()
+ *
+ * The thread is started with the first request. If that fails the request
+ * is executed immediately.
+ *
+ * Return: Always 0, errors are reported through the request.
+ */
+status_t lk2nd_bdev_queue_submit(struct lk2nd_bdev_queue *q, struct bdev *dev, struct bio_request *req)
+{
+	thread_t *thr;
+
+	if (!q->started) {
+		/* Same priority as the callers, the I/O thread yields while waiting */
+		thr = thread_create(dev->name, lk2nd_bdev_queue_thread, q,
+				    DEFAULT_PRIORITY, DEFAULT_STACK_SIZE);
+		if (!thr) {
+			dprintf(INFO, "%s: Failed to create I/O thread\n", dev->name);
+			bio_complete(req, req->dev->read(req->dev, req->buf, req->offset, req->len));
+			return 0;
+		}
+		q->started = true;
+		thread_resume(thr);
+	}
+
+	enter_critical_section();
+	list_add_tail(&q->requests, &req->node);
+	exit_critical_section();
+	event_signal(&q->work, false);
+	return 0;
+}
@@ -7,6 +7,7 @@ MODULES += \
 
 OBJS += \
 	$(LOCAL_DIR)/bdev.o \
+	$(LOCAL_DIR)/queue.o \
 	$(LOCAL_DIR)/util.o \
 	$(LOCAL_DIR)/wrapper.o \
 
@@ -15,3 +16,17 @@ ifeq ($(ENABLE_SDHCI_SUPPORT),1)
 OBJS += \
 	$(LOCAL_DIR)/mmc_sdhci.o
 endif
+
+# UBI volumes on NAND
+ifneq ($(filter platform/msm_shared/flash-ubi.o, $(OBJS)),)
+OBJS += \
+	$(LOCAL_DIR)/ubi.o
+DEFINES += LK2ND_BDEV_UBI=1
+endif
+
+# One block device per UFS logical unit
+ifeq ($(ENABLE_UFS_SUPPORT),1)
+OBJS += \
+	$(LOCAL_DIR)/ufs.o
+DEFINES += LK2ND_BDEV_UFS=1
+endif
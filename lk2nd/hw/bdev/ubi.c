@@ -0,0 +1,100 @@
+// SPDX-License-Identifier: BSD-3-Clause
+
+#include <debug.h>
+#include <dev/flash.h>
+#include <dev/flash-ubi.h>
+#include <err.h>
+#include <lib/bio.h>
+#include <lib/ptable.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <lk2nd/util/container_of.h>
+
+#include "bdev.h"
+
+/*
+ * Read-only block devices for the volumes in the UBI partitions on NAND,
+ * similar to ubiblock in Linux. They allow mounting a file system (e.g.
+ * squashfs) that was placed in a UBI volume.
+ */
+struct ubi_bdev {
+	struct bdev dev;
+	struct ubi_volume vol;
+};
+
+static ssize_t lk2nd_ubi_bdev_read(struct bdev *bdev, void *buf, off_t offset, size_t len)
+{
+	struct ubi_bdev *dev = container_of(bdev, struct ubi_bdev, dev);
+	size_t done = 0, n;
+	unsigned lnum, leb_off;
+
+	while (done < len) {
+		lnum = (offset + done) / dev->vol.leb_size;
+		leb_off = (offset + done) % dev->vol.leb_size;
+		n = MIN(len - done, dev->vol.leb_size - leb_off);
+
+		if (ubi_read_leb(&dev->vol, lnum, leb_off, buf + done, n))
+			return ERR_IO;
+		done += n;
+	}
+
+	return done;
+}
+
+static ssize_t lk2nd_ubi_bdev_read_block(struct bdev *bdev, void *buf, bnum_t block, uint count)
+{
+	return lk2nd_ubi_bdev_read(bdev, buf, (off_t)block * bdev->block_size,
+				   count * bdev->block_size);
+}
+
+static void lk2nd_ubi_register_volume(int ptn_index, struct ubi_volume *vol)
+{
+	struct ubi_bdev *udev = malloc(sizeof(*udev));
+	bdev_t *bdev;
+	char name[16];
+
+	if (!udev) {
+		free(vol->pebs);
+		return;
+	}
+
+	udev->vol = *vol;
+	bdev = &udev->dev;
+
+	/* Keep names short, they are used as mountpoints */
+	snprintf(name, sizeof(name), "ubi%d_%d", ptn_index, vol->vol_id);
+	bio_initialize_bdev(bdev, name, 512,
+			    (uint64_t)vol->leb_count * vol->leb_size / 512);
+	bdev->label = udev->vol.name;
+	bdev->is_leaf = true;
+	bdev->read = lk2nd_ubi_bdev_read;
+	bdev->read_block = lk2nd_ubi_bdev_read_block;
+
+	bio_register_device(bdev);
+}
+
+/**
+ * lk2nd_ubi_bio_register() - Register the volumes of all UBI partitions
+ */
+void lk2nd_ubi_bio_register(void)
+{
+	struct ptable *ptable = flash_get_ptable();
+	struct ubi_volume *vols;
+	int i, j, count;
+
+	if (!ptable)
+		return;
+
+	for (i = 0; i < ptable->count; i++) {
+		count = ubi_scan_volumes(&ptable->parts[i], &vols);
+		if (count <= 0)
+			continue;
+
+		dprintf(INFO, "Registering %d UBI volumes of %s\n",
+			count, ptable->parts[i].name);
+		for (j = 0; j < count; j++)
+			lk2nd_ubi_register_volume(i, &vols[j]);
+		free(vols);
+	}
+}
@@ -0,0 +1,143 @@
+// SPDX-License-Identifier: BSD-3-Clause
+
+#include <arch/defines.h>
+#include <debug.h>
+#include <err.h>
+#include <lib/bio.h>
+#include <stdlib.h>
+#include <target.h>
+#include <ufs.h>
+#include <utp.h>
+
+#include <lk2nd/util/container_of.h>
+
+#include "bdev.h"
+
+/*
+ * ufs.c - One block device per UFS logical unit.
+ *
+ * The mmc_read() wrapper only reads from the LUN that was selected last with
+ * mmc_set_lun(), so it cannot be used to scan the partitions of all LUNs.
+ * Here each read selects its LUN explicitly. All logical units are behind
+ * the same host controller, so they share one request queue (and its lock),
+ * and queued reads for different LUNs can be submitted together.
+ */
+
+struct ufs_bdev {
+	struct bdev dev;
+	uint8_t lun;
+};
+
+static struct lk2nd_bdev_queue ufs_queue;
+
+static ssize_t lk2nd_ufs_bdev_read_block(struct bdev *bdev, void *buf, bnum_t block, uint count)
+{
+	struct ufs_bdev *dev = container_of(bdev, struct ufs_bdev, dev);
+	struct ufs_read_task tasks[UTP_MAX_BATCH_REQS];
+	uint8_t *sptr = (uint8_t *)buf;
+	uint left = count;
+	uint n;
+	int ret = 0;
+
+	mutex_acquire(&ufs_queue.lock);
+	while (left && !ret) {
+		/* Large reads are split into several commands that run in parallel */
+		for (n = 0; left && n < ARRAY_SIZE(tasks); n++) {
+			tasks[n].dest = sptr;
+			tasks[n].lun = dev->lun;
+			tasks[n].blk_addr = block;
+			tasks[n].num_blocks = MIN(left, SCSI_MAX_DATA_TRANS_BLK_LEN);
+
+			sptr += tasks[n].num_blocks * bdev->block_size;
+			block += tasks[n].num_blocks;
+			left -= tasks[n].num_blocks;
+		}
+		ret = ufs_read_queued(target_mmc_device(), tasks, n);
+	}
+	mutex_release(&ufs_queue.lock);
+
+	return ret ? ERR_IO : (ssize_t)(count * bdev->block_size);
+}
+
+/*
+ * Block aligned reads into cache line aligned buffers are submitted
+ * together, each in its own transfer request slot. Other requests are
+ * executed one by one through the block device.
+ */
+static void lk2nd_ufs_bdev_read_batch(struct lk2nd_bdev_queue *q, struct bio_request **reqs, uint count)
+{
+	struct ufs_read_task tasks[LK2ND_BDEV_QUEUE_BATCH];
+	struct bio_request *queued[LK2ND_BDEV_QUEUE_BATCH];
+	struct bio_request *req;
+	struct ufs_bdev *dev;
+	uint32_t block_size;
+	uint i, n = 0;
+
+	for (i = 0; i < count; i++) {
+		req = reqs[i];
+		dev = container_of(req->dev, struct ufs_bdev, dev);
+		block_size = req->dev->block_size;
+
+		if ((addr_t)req->buf % CACHE_LINE || req->offset % block_size ||
+		    req->len % block_size || req->len / block_size > SCSI_MAX_DATA_TRANS_BLK_LEN) {
+			bio_complete(req, req->dev->read(req->dev, req->buf, req->offset, req->len));
+			continue;
+		}
+
+		tasks[n].dest = req->buf;
+		tasks[n].lun = dev->lun;
+		tasks[n].blk_addr = req->offset / block_size;
+		tasks[n].num_blocks = req->len / block_size;
+		queued[n++] = req;
+	}
+
+	if (!n)
+		return;
+
+	mutex_acquire(&q->lock);
+	ufs_read_queued(target_mmc_device(), tasks, n);
+	mutex_release(&q->lock);
+
+	for (i = 0; i < n; i++)
+		bio_complete(queued[i], tasks[i].ret ? ERR_IO : (ssize_t)queued[i]->len);
+}
+
+static status_t lk2nd_ufs_bdev_submit(struct bdev *bdev, struct bio_request *req)
+{
+	return lk2nd_bdev_queue_submit(&ufs_queue, bdev, req);
+}
+
+void lk2nd_ufs_bio_register(void)
+{
+	struct ufs_dev *ufs = target_mmc_device();
+	struct ufs_bdev *bdev;
+	char name[32];
+	uint8_t lun;
+
+	dprintf(INFO, "Registering ufs bio devices...\n");
+
+	lk2nd_bdev_queue_init(&ufs_queue);
+	ufs_queue.read_batch = lk2nd_ufs_bdev_read_batch;
+
+	for (lun = 0; lun < ufs->num_lus && lun < ARRAY_SIZE(ufs->lun_cfg); lun++) {
+		if (!ufs->lun_cfg[lun].logical_blk_cnt)
+			continue;
+
+		bdev = malloc(sizeof(*bdev));
+		if (!bdev)
+			return;
+
+		snprintf(name, sizeof(name), "ufs%u", lun);
+		bio_initialize_bdev(&bdev->dev, name, ufs->block_size,
+				    ufs->lun_cfg[lun].logical_blk_cnt);
+
+		bdev->lun = lun;
+		bdev->dev.read_block = lk2nd_ufs_bdev_read_block;
+		bdev->dev.submit = lk2nd_ufs_bdev_submit;
+
+		bio_register_device(&bdev->dev);
+
+		/* Use the partition tables that were already parsed by aboot */
+		lk2nd_bdev_publish_partitions(&bdev->dev, lun);
+	}
+}
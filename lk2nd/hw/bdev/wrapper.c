@@ -1,38 +1,210 @@
 // SPDX-License-Identifier: BSD-3-Clause
 /* Copyright (c) 2023 Nikita Travkin <nikita@trvn.ru> */
 
+#include <boot_device.h>
 #include <debug.h>
+#include <err.h>
 #include <lib/bio.h>
 #include <lib/partition.h>
+#if MMC_SDHCI_SUPPORT
+#include <mmc_sdhci.h>
+#endif
 #include <partition_parser.h>
 #include <stdlib.h>
+#include <string.h>
+#include <target.h>
 
 #include <lk2nd/init.h>
+#include <lk2nd/util/container_of.h>
 
 #include "bdev.h"
 
+struct wrapper_bdev {
+	struct bdev dev;
+	struct lk2nd_bdev_queue queue;
+};
+
 static ssize_t lk2nd_wrapper_bdev_read_block(struct bdev *bdev, void *buf, bnum_t block, uint count)
 {
-	return mmc_read((uint64_t)block * bdev->block_size, buf, count * bdev->block_size);
+	struct wrapper_bdev *dev = container_of(bdev, struct wrapper_bdev, dev);
+	int ret;
+
+	mutex_acquire(&dev->queue.lock);
+	ret = mmc_read((uint64_t)block * bdev->block_size, buf, count * bdev->block_size);
+	mutex_release(&dev->queue.lock);
+
+	return ret;
+}
+
+static ssize_t lk2nd_wrapper_bdev_write_block(struct bdev *bdev, const void *buf, bnum_t block, uint count)
+{
+	struct wrapper_bdev *dev = container_of(bdev, struct wrapper_bdev, dev);
+	uint32_t ret;
+
+	mutex_acquire(&dev->queue.lock);
+	ret = mmc_write((uint64_t)block * bdev->block_size, count * bdev->block_size, (void *)buf);
+	mutex_release(&dev->queue.lock);
+
+	if (ret)
+		return ERR_IO;
+	return count * bdev->block_size;
 }
 
-static void lk2nd_wrapper_publish_subdevices(bdev_t *bdev)
+#if MMC_SDHCI_SUPPORT
+static ssize_t lk2nd_wrapper_bdev_readv(struct bdev *bdev, const struct bio_vec *iov, uint iovcnt, off_t offset)
+{
+	struct wrapper_bdev *dev = container_of(bdev, struct wrapper_bdev, dev);
+	ssize_t ret;
+
+	mutex_acquire(&dev->queue.lock);
+	ret = lk2nd_mmc_sdhci_readv(target_mmc_device(), iov, iovcnt, offset, bdev->block_size);
+	mutex_release(&dev->queue.lock);
+
+	return ret;
+}
+
+static void lk2nd_wrapper_bdev_read_batch(struct lk2nd_bdev_queue *q, struct bio_request **reqs, uint count)
+{
+	lk2nd_mmc_sdhci_read_batch(target_mmc_device(), q, reqs, count);
+}
+/*
+ * The eMMC boot partitions are separate hardware partitions, selected with
+ * a SWITCH to PARTITION_CONFIG. mmc_sdhci switches lazily, so consecutive
+ * reads from the same partition only need a single switch. The lock of the
+ * user area device is shared since all of them use the same card.
+ */
+struct wrapper_boot_bdev {
+	struct bdev dev;
+	struct wrapper_bdev *parent;
+	uint32_t part;
+};
+
+static ssize_t lk2nd_wrapper_boot_bdev_read_block(struct bdev *bdev, void *buf, bnum_t block, uint count)
+{
+	struct wrapper_boot_bdev *dev = container_of(bdev, struct wrapper_boot_bdev, dev);
+	struct mmc_device *mmc = target_mmc_device();
+	uint max_blocks = SDHCI_ADMA_MAX_TRANS_SZ / bdev->block_size;
+	uint8_t *sptr = buf;
+	uint left = count;
+	uint n;
+
+	mutex_acquire(&dev->parent->queue.lock);
+	arch_clean_invalidate_cache_range((addr_t)buf, count * bdev->block_size);
+
+	while (left) {
+		n = MIN(left, max_blocks);
+		if (mmc_sdhci_read_part(mmc, dev->part, sptr, block, n))
+			goto err;
+
+		sptr += n * bdev->block_size;
+		block += n;
+		left -= n;
+	}
+
+	mutex_release(&dev->parent->queue.lock);
+	return count * bdev->block_size;
+
+err:
+	mutex_release(&dev->parent->queue.lock);
+	return ERR_IO;
+}
+
+static void lk2nd_wrapper_boot_bio_register(struct wrapper_bdev *parent)
+{
+	struct mmc_device *mmc = target_mmc_device();
+	uint32_t block_size = mmc->card.block_size;
+	struct wrapper_boot_bdev *bdev;
+	char name[32];
+	int i;
+
+	if (!mmc->card.boot_size)
+		return;
+
+	for (i = 0; i < 2; i++) {
+		bdev = malloc(sizeof(*bdev));
+		if (!bdev)
+			return;
+
+		snprintf(name, sizeof(name), "%sboot%d", parent->dev.name, i);
+		bio_initialize_bdev(&bdev->dev, name, block_size, mmc->card.boot_size / block_size);
+		bdev->dev.read_block = lk2nd_wrapper_boot_bdev_read_block;
+		bdev->parent = parent;
+		bdev->part = PART_ACCESS_BOOT1 + i;
+		bio_register_device(&bdev->dev);
+	}
+}
+#endif
+
+static status_t lk2nd_wrapper_bdev_submit(struct bdev *bdev, struct bio_request *req)
+{
+	struct wrapper_bdev *dev = container_of(bdev, struct wrapper_bdev, dev);
+
+	return lk2nd_bdev_queue_submit(&dev->queue, bdev, req);
+}
+
+/*
+ * Partition types that may contain a nested partition table, e.g. a full
+ * disk image flashed to userdata. The other partitions (firmware etc.) are
+ * not probed to avoid reading the first block of each of them.
+ */
+static const uint8_t nested_type_guids[][PARTITION_TYPE_GUID_SIZE] = {
+	/* Qualcomm userdata: 1b81e7e6-f50d-419b-a739-2aeef8da3335 */
+	{ 0xe6, 0xe7, 0x81, 0x1b, 0x0d, 0xf5, 0x9b, 0x41,
+	  0xa7, 0x39, 0x2a, 0xee, 0xf8, 0xda, 0x33, 0x35 },
+	/* Qualcomm system: 97d7b011-54da-4835-b3c4-917ad6e73d74 */
+	{ 0x11, 0xb0, 0xd7, 0x97, 0xda, 0x54, 0x35, 0x48,
+	  0xb3, 0xc4, 0x91, 0x7a, 0xd6, 0xe7, 0x3d, 0x74 },
+	/* Linux filesystem: 0fc63daf-8483-4772-8e79-3d69d8477de4 */
+	{ 0xaf, 0x3d, 0xc6, 0x0f, 0x83, 0x84, 0x72, 0x47,
+	  0x8e, 0x79, 0x3d, 0x69, 0xd8, 0x47, 0x7d, 0xe4 },
+	/* Microsoft basic data: ebd0a0a2-b9e5-4433-87c0-68b6b72699c7 */
+	{ 0xa2, 0xa0, 0xd0, 0xeb, 0xe5, 0xb9, 0x33, 0x44,
+	  0x87, 0xc0, 0x68, 0xb6, 0xb7, 0x26, 0x99, 0xc7 },
+};
+
+static bool lk2nd_wrapper_may_be_nested(const struct partition_entry *entry)
+{
+	static const uint8_t mbr_guid[PARTITION_TYPE_GUID_SIZE];
+	unsigned int i;
+
+	/* Entries from an MBR only have the MBR partition type */
+	if (!memcmp(entry->type_guid, mbr_guid, sizeof(mbr_guid)))
+		return entry->dtype == MBR_USERDATA_TYPE || entry->dtype == MBR_SYSTEM_TYPE;
+
+	for (i = 0; i < ARRAY_SIZE(nested_type_guids); i++)
+		if (!memcmp(entry->type_guid, nested_type_guids[i], PARTITION_TYPE_GUID_SIZE))
+			return true;
+	return false;
+}
+
+/**
+ * lk2nd_bdev_publish_partitions() - Publish the partitions parsed by aboot.
+ * @bdev: Block device the partitions belong to
+ * @lun:  Only publish the partitions of this UFS LUN, or -1 for all
+ *
+ * The partitions are numbered per block device, in the order of the table.
+ */
+void lk2nd_bdev_publish_partitions(bdev_t *bdev, int lun)
 {
 	struct partition_entry* entries = partition_get_partition_entries();
-	unsigned int i, count = partition_get_partition_count();
+	unsigned int i, n = 0, count = partition_get_partition_count();
 	bdev_t *subdev;
 	char name[32];
 
 	for (i = 0; i < count; ++i) {
-		snprintf(name, sizeof(name), "%sp%d", bdev->name, i);
+		if (lun >= 0 && entries[i].lun != lun)
+			continue;
+
+		snprintf(name, sizeof(name), "%sp%d", bdev->name, n++);
 		bio_publish_subdevice(bdev->name, name, entries[i].first_lba, entries[i].size);
 
 		subdev = bio_open(name);
 		subdev->label = (char *)entries[i].name;
 		bio_close(subdev);
 
-		/* There may be subpartitions... */
-		partition_publish(name, 0);
+		/* There may be subpartitions, e.g. a full disk image in userdata */
+		if (lk2nd_wrapper_may_be_nested(&entries[i]))
+			partition_publish(name, 0);
 	}
 }
 
@@ -40,18 +212,31 @@ void lk2nd_wrapper_bio_register(void)
 {
 	uint32_t block_size = mmc_get_device_blocksize();
 	uint64_t card_capacity = mmc_get_device_capacity();
-	bdev_t *bdev = malloc(sizeof(*bdev));
+	struct wrapper_bdev *wdev = malloc(sizeof(*wdev));
+	bdev_t *bdev = &wdev->dev;
 	char name[32] = "wrp0";
 
 	dprintf(INFO, "Registering wrapper bio devices...\n");
 	bio_initialize_bdev(bdev, name, block_size, card_capacity / block_size);
 
 	bdev->read_block = lk2nd_wrapper_bdev_read_block;
+	bdev->write_block = lk2nd_wrapper_bdev_write_block;
+	bdev->submit = lk2nd_wrapper_bdev_submit;
+	lk2nd_bdev_queue_init(&wdev->queue);
+#if MMC_SDHCI_SUPPORT
+	if (platform_boot_dev_isemmc()) {
+		bdev->readv = lk2nd_wrapper_bdev_readv;
+		wdev->queue.read_batch = lk2nd_wrapper_bdev_read_batch;
+		wdev->queue.merge_max = MIN(LK2ND_BDEV_QUEUE_MERGE_MAX, SDHCI_ADMA_MAX_TRANS_SZ);
+	}
+#endif
 
 	bio_register_device(bdev);
+#if MMC_SDHCI_SUPPORT
+	if (platform_boot_dev_isemmc())
+		lk2nd_wrapper_boot_bio_register(wdev);
+#endif
 
-	/*
-	 * FIXME: the lk's partition module is not GPT aware yet.
-	 */
-	lk2nd_wrapper_publish_subdevices(bdev);
+	/* Use the partition table that was already parsed by aboot */
+	lk2nd_bdev_publish_partitions(bdev, -1);
 }
@@ -5,6 +5,26 @@
 
 #include <libfdt.h>
 #include <lk2nd/hw/gpio_i2c.h>
+#include <lk2nd/hw/i2c.h>
+#include <lk2nd/util/lkfdt.h>
+
+#include "i2c.h"
+
+#define I2C_DEFAULT_FREQ	100000
+
+static status_t i2c_get_reg(const void *dtb, int node, uint8_t *addr)
+{
+	const fdt32_t *prop;
+	int len;
+
+	prop = fdt_getprop(dtb, node, "i2c-reg", &len);
+	if (len != sizeof(*prop)) {
+		dprintf(CRITICAL, "Invalid i2c-reg property: %d\n", len);
+		return ERROR;
+	}
+	*addr = fdt32_to_cpu(*prop);
+	return NO_ERROR;
+}
 
 status_t gpio_i2c_get(const void *dtb, int node, gpio_i2c_info_t *i, uint8_t *addr)
 {
@@ -21,16 +41,32 @@ status_t gpio_i2c_get(const void *dtb, int node, gpio_i2c_info_t *i, uint8_t *ad
 	i->hcd = 10;
 	i->qcd = 5;
 
-	if (addr) {
-		const fdt32_t *prop;
-		int len;
+	if (addr)
+		return i2c_get_reg(dtb, node, addr);
+	return NO_ERROR;
+}
 
-		prop = fdt_getprop(dtb, node, "i2c-reg", &len);
-		if (len != sizeof(*prop)) {
-			dprintf(CRITICAL, "Invalid i2c-reg property: %d\n", len);
-			return ERROR;
-		}
-		*addr = fdt32_to_cpu(*prop);
-	}
+static struct qup_i2c_dev *lk2nd_i2c_get_qup(const void *dtb, int node)
+{
+	uint32_t blsp_id, qup_id, freq;
+
+	if (lkfdt_u32list_get(dtb, node, "i2c-qup", 0, &blsp_id) < 0 ||
+	    lkfdt_u32list_get(dtb, node, "i2c-qup", 1, &qup_id) < 0)
+		return NULL;
+
+	if (lkfdt_getprop_u32(dtb, node, "clock-frequency", &freq) < 0)
+		freq = I2C_DEFAULT_FREQ;
+
+	return lk2nd_i2c_qup_get(blsp_id, qup_id, freq);
+}
+
+status_t lk2nd_i2c_get(const void *dtb, int node, struct lk2nd_i2c *i2c, uint8_t *addr)
+{
+	i2c->qup = lk2nd_i2c_get_qup(dtb, node);
+	if (!i2c->qup)
+		return gpio_i2c_get(dtb, node, &i2c->gpio, addr);
+
+	if (addr)
+		return i2c_get_reg(dtb, node, addr);
 	return NO_ERROR;
 }
@@ -0,0 +1,21 @@
+// SPDX-License-Identifier: BSD-3-Clause
+
+#include <lk2nd/hw/i2c.h>
+
+#include "i2c.h"
+
+status_t lk2nd_i2c_write_reg_bytes(const struct lk2nd_i2c *i2c, uint8_t addr,
+				   uint8_t reg, const uint8_t *val, size_t cnt)
+{
+	if (i2c->qup)
+		return lk2nd_i2c_qup_write_reg_bytes(i2c->qup, addr, reg, val, cnt);
+	return gpio_i2c_write_reg_bytes(&i2c->gpio, addr, reg, val, cnt);
+}
+
+status_t lk2nd_i2c_read_reg_bytes(const struct lk2nd_i2c *i2c, uint8_t addr,
+				  uint8_t reg, uint8_t *val, size_t cnt)
+{
+	if (i2c->qup)
+		return lk2nd_i2c_qup_read_reg_bytes(i2c->qup, addr, reg, val, cnt);
+	return gpio_i2c_read_reg_bytes(&i2c->gpio, addr, reg, val, cnt);
+}
@@ -0,0 +1,32 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+#ifndef LK2ND_HW_I2C_I2C_H
+#define LK2ND_HW_I2C_I2C_H
+
+#include <err.h>
+#include <lk2nd/hw/i2c.h>
+
+#ifdef LK2ND_I2C_QUP
+struct qup_i2c_dev *lk2nd_i2c_qup_get(uint8_t blsp_id, uint8_t id, uint32_t freq);
+status_t lk2nd_i2c_qup_write_reg_bytes(struct qup_i2c_dev *dev, uint8_t addr,
+				       uint8_t reg, const uint8_t *val, size_t cnt);
+status_t lk2nd_i2c_qup_read_reg_bytes(struct qup_i2c_dev *dev, uint8_t addr,
+				      uint8_t reg, uint8_t *val, size_t cnt);
+#else
+static inline struct qup_i2c_dev *lk2nd_i2c_qup_get(uint8_t blsp_id, uint8_t id,
+						    uint32_t freq)
+{
+	return NULL;
+}
+static inline status_t lk2nd_i2c_qup_write_reg_bytes(struct qup_i2c_dev *dev, uint8_t addr,
+						     uint8_t reg, const uint8_t *val, size_t cnt)
+{
+	return ERR_NOT_SUPPORTED;
+}
+static inline status_t lk2nd_i2c_qup_read_reg_bytes(struct qup_i2c_dev *dev, uint8_t addr,
+						    uint8_t reg, uint8_t *val, size_t cnt)
+{
+	return ERR_NOT_SUPPORTED;
+}
+#endif
+
+#endif /* LK2ND_HW_I2C_I2C_H */
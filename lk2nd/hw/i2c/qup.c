@@ -0,0 +1,101 @@
+// SPDX-License-Identifier: BSD-3-Clause
+
+#include <debug.h>
+#include <err.h>
+#include <i2c_qup.h>
+#include <string.h>
+
+#include <lk2nd/hw/i2c.h>
+
+#include "i2c.h"
+
+/* The QUP I2C clocks run from the 19.2 MHz XO */
+#define QUP_I2C_SRC_CLK_FREQ	19200000
+#define QUP_I2C_MAX_FREQ	1000000
+#define QUP_I2C_MAX_WRITE	32
+
+/*
+ * i2c_qup.c only manages one controller (the first one that was
+ * initialized), so only a single QUP bus can be used at the same time.
+ */
+static struct qup_i2c_dev *qup_dev;
+static uint8_t qup_blsp_id, qup_id;
+
+struct qup_i2c_dev *lk2nd_i2c_qup_get(uint8_t blsp_id, uint8_t id, uint32_t freq)
+{
+	if (!freq || freq > QUP_I2C_MAX_FREQ) {
+		dprintf(CRITICAL, "Unsupported I2C clock frequency: %u\n", freq);
+		return NULL;
+	}
+
+	if (qup_dev) {
+		if (blsp_id != qup_blsp_id || id != qup_id) {
+			dprintf(CRITICAL, "Only one QUP I2C bus supported, BLSP%u QUP%u in use\n",
+				qup_blsp_id, qup_id);
+			return NULL;
+		}
+		return qup_dev;
+	}
+
+	qup_dev = qup_blsp_i2c_init(blsp_id, id, freq, QUP_I2C_SRC_CLK_FREQ);
+	if (!qup_dev) {
+		dprintf(CRITICAL, "Failed to initialize BLSP%u QUP%u I2C\n", blsp_id, id);
+		return NULL;
+	}
+
+	qup_blsp_id = blsp_id;
+	qup_id = id;
+	return qup_dev;
+}
+
+static status_t lk2nd_i2c_qup_xfer(struct qup_i2c_dev *dev, struct i2c_msg *msgs, int num)
+{
+	int ret;
+
+	ret = qup_i2c_xfer(dev, msgs, num);
+	if (ret != num)
+		return ret < 0 ? ret : ERR_IO;
+	return NO_ERROR;
+}
+
+status_t lk2nd_i2c_qup_write_reg_bytes(struct qup_i2c_dev *dev, uint8_t addr,
+				       uint8_t reg, const uint8_t *val, size_t cnt)
+{
+	uint8_t buf[1 + QUP_I2C_MAX_WRITE];
+	struct i2c_msg msg = {
+		.addr = addr,
+		.flags = I2C_M_WR,
+		.len = cnt + 1,
+		.buf = buf,
+	};
+
+	if (cnt > QUP_I2C_MAX_WRITE)
+		return ERR_TOO_BIG;
+
+	/* The register address must be sent in the same message */
+	buf[0] = reg;
+	memcpy(&buf[1], val, cnt);
+
+	return lk2nd_i2c_qup_xfer(dev, &msg, 1);
+}
+
+status_t lk2nd_i2c_qup_read_reg_bytes(struct qup_i2c_dev *dev, uint8_t addr,
+				      uint8_t reg, uint8_t *val, size_t cnt)
+{
+	struct i2c_msg msgs[] = {
+		{
+			.addr = addr,
+			.flags = I2C_M_WR,
+			.len = 1,
+			.buf = &reg,
+		},
+		{
+			.addr = addr,
+			.flags = I2C_M_RD,
+			.len = cnt,
+			.buf = val,
+		},
+	};
+
+	return lk2nd_i2c_qup_xfer(dev, msgs, ARRAY_SIZE(msgs));
+}
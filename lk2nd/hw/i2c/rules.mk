@@ -8,3 +8,10 @@ MODULES += \
 OBJS += \
 	$(LOCAL_DIR)/dt.o \
 	$(LOCAL_DIR)/gpio_i2c.o \
+	$(LOCAL_DIR)/i2c.o \
+
+# Platforms that build i2c_qup.c with BLSP support
+ifneq ($(filter msm8909 msm8916 msm8974 msm8996, $(PLATFORM)),)
+DEFINES += LK2ND_I2C_QUP=1
+OBJS += $(LOCAL_DIR)/qup.o
+endif
@@ -31,6 +31,7 @@
 #include <err.h>
 #include <malloc.h>
 #include <pm8x41_hw.h>
+#include <spmi.h>
 #include <stdint.h>
 #include <sys/types.h>
 
@@ -672,12 +673,7 @@ static inline int spmi_vreg_read(struct spmi_regulator *vreg, u16 addr, u8 *buf,
 static int spmi_vreg_read(struct spmi_regulator *vreg, u16 addr, u8 *buf,
 			  int len)
 {
-	int i;
-
-	for (i = 0; i < len; ++i)
-		buf[i] = REG_READ(vreg->base + addr + i);
-
-	return 0;
+	return pmic_spmi_reg_read_burst(vreg->base + addr, buf, len) ? -1 : 0;
 }
 
 static int regulator_is_enabled_regmap(struct regulator_dev *rdev)
@@ -2,7 +2,10 @@
 #ifndef LK2ND_BOOT_H
 #define LK2ND_BOOT_H
 
+#include <stdint.h>
+
 void lk2nd_boot(void);
+uint32_t lk2nd_layout_download_size(void);
 
 #endif /* LK2ND_BOOT_H */
 
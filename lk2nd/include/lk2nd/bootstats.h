@@ -0,0 +1,47 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+#ifndef LK2ND_BOOTSTATS_H
+#define LK2ND_BOOTSTATS_H
+
+#include <compiler.h>
+#include <stddef.h>
+
+#if WITH_LK2ND_BOOTSTATS
+/**
+ * lk2nd_bootstats_start() - Start timing a boot phase.
+ * @fmt: printf-like name of the phase
+ *
+ * Phases may be nested, they are shown indented in the report.
+ *
+ * Return: Id to pass to lk2nd_bootstats_end(), negative if the table is full.
+ */
+int lk2nd_bootstats_start(const char *fmt, ...) __PRINTFLIKE(1, 2);
+
+/**
+ * lk2nd_bootstats_end() - Stop timing a boot phase.
+ * @id: Id returned by lk2nd_bootstats_start()
+ */
+void lk2nd_bootstats_end(int id);
+#else
+static inline int lk2nd_bootstats_start(const char *fmt, ...) { return -1; }
+static inline void lk2nd_bootstats_end(int id) { }
+#endif
+
+#if LK2ND_BOOT_HISTORY
+/**
+ * lk2nd_bootstats_source() - Record where the OS is booted from.
+ * @name: Name of the block device, its read statistics are recorded as well
+ */
+void lk2nd_bootstats_source(const char *name);
+
+/**
+ * lk2nd_bootstats_unpacked() - Record a decompressed image.
+ * @in:  Compressed size
+ * @out: Decompressed size
+ */
+void lk2nd_bootstats_unpacked(size_t in, size_t out);
+#else
+static inline void lk2nd_bootstats_source(const char *name) { }
+static inline void lk2nd_bootstats_unpacked(size_t in, size_t out) { }
+#endif
+
+#endif /* LK2ND_BOOTSTATS_H */
@@ -9,6 +9,8 @@ unsigned char *lk2nd_device_update_cmdline(const char *cmdline, enum boot_type b
 bool lk2nd_device2nd_have_atags(void) __PURE;
 void lk2nd_device2nd_copy_atags(void *tags, const char *cmdline,
 				void *ramdisk, unsigned ramdisk_size);
+/* DTB/ATAGS passed by the previous bootloader, NULL if there were none */
+const void *lk2nd_device2nd_get_tags(unsigned *size);
 
 #if WITH_LK2ND_DEVICE
 const char *const *lk2nd_device_get_dtb_hints(void);
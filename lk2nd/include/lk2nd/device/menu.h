@@ -0,0 +1,30 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+#ifndef LK2ND_DEVICE_MENU_H
+#define LK2ND_DEVICE_MENU_H
+
+#if WITH_LK2ND_DEVICE_MENU
+/**
+ * lk2nd_menu_select() - Let the user pick one entry from a list.
+ * @title:   Title shown above the entries (or NULL)
+ * @items:   Names of the entries
+ * @count:   Number of entries in @items
+ * @sel:     Index of the entry that is selected initially
+ * @timeout: Time in ms after which @sel is returned if no key is pressed,
+ *           or 0 to wait until an entry is selected
+ *
+ * Returns: Index of the selected entry, or @sel if there is no display.
+ */
+unsigned int lk2nd_menu_select(const char *title, const char *const *items,
+			       unsigned int count, unsigned int sel,
+			       unsigned int timeout);
+#else
+static inline unsigned int lk2nd_menu_select(const char *title,
+					     const char *const *items,
+					     unsigned int count, unsigned int sel,
+					     unsigned int timeout)
+{
+	return sel;
+}
+#endif
+
+#endif /* LK2ND_DEVICE_MENU_H */
@@ -0,0 +1,22 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+#ifndef LK2ND_DISPLAY_H
+#define LK2ND_DISPLAY_H
+
+#include <stdbool.h>
+
+#if LK2ND_DISPLAY_CONT_SPLASH
+/**
+ * lk2nd_display_off() - Turn off the panel to save power.
+ *
+ * The display pipeline is stopped and the panel is put into sleep mode with
+ * the standard DCS commands. lk2nd cannot turn it on again, so this should
+ * only be used before powering off or rebooting the device.
+ *
+ * Return: true if the panel was turned off, false otherwise
+ */
+bool lk2nd_display_off(void);
+#else
+static inline bool lk2nd_display_off(void) { return false; }
+#endif
+
+#endif /* LK2ND_DISPLAY_H */
@@ -0,0 +1,43 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+#ifndef LK2ND_HW_I2C_H
+#define LK2ND_HW_I2C_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#include <lk2nd/hw/gpio_i2c.h>
+
+struct qup_i2c_dev;
+
+/**
+ * struct lk2nd_i2c - I2C bus, either a hardware QUP or bit-banged GPIOs.
+ * @qup:  QUP I2C controller, NULL if the GPIO bus is used.
+ * @gpio: GPIO I2C bus, used if there is no (usable) QUP.
+ */
+struct lk2nd_i2c {
+	struct qup_i2c_dev *qup;
+	gpio_i2c_info_t gpio;
+};
+
+/**
+ * lk2nd_i2c_get() - Get the I2C bus from the DT definition.
+ * @dtb:   Pointer to the DT.
+ * @node:  Offset of the node containing the I2C properties.
+ * @i2c:   Pointer to the I2C bus that will be filled.
+ * @addr:  Optional pointer that will be filled with the I2C address (i2c-reg).
+ *
+ * The QUP given in "i2c-qup" (BLSP and QUP number) is used if it is supported
+ * on the platform, with the bus frequency from "clock-frequency" (default:
+ * 100 kHz). Otherwise the bus falls back to the "i2c-sda/scl-gpios".
+ *
+ * Returns: Status code (0 on success)
+ */
+status_t lk2nd_i2c_get(const void *dtb, int node, struct lk2nd_i2c *i2c, uint8_t *addr);
+
+status_t lk2nd_i2c_write_reg_bytes(const struct lk2nd_i2c *i2c, uint8_t addr,
+				   uint8_t reg, const uint8_t *val, size_t cnt);
+status_t lk2nd_i2c_read_reg_bytes(const struct lk2nd_i2c *i2c, uint8_t addr,
+				  uint8_t reg, uint8_t *val, size_t cnt);
+
+#endif /* LK2ND_HW_I2C_H */
@@ -2,9 +2,46 @@
 #ifndef LK2ND_INIT_H
 #define LK2ND_INIT_H
 
+#include <bits.h>
+#include <stdbool.h>
+
 void lk2nd_init(void);
 
-#define LK2ND_INIT(func) static void (*_lk2nd_init_##func)(void) \
-	__SECTION(".lk2nd_init") __USED = (func)
+/*
+ * Hooks are run in ascending priority order (two digits, sorted by the linker
+ * by section name). Hooks with the same priority run in link order.
+ */
+#define LK2ND_INIT_PRIO_EARLY		10	/* Tracing, clock boost */
+#define LK2ND_INIT_PRIO_DEVICE		30	/* Device tree parsing */
+#define LK2ND_INIT_PRIO_DEFAULT		50	/* Anything needing lk2nd_dev */
+
+#define _LK2ND_INIT_SECTION(prio)	".lk2nd_init." #prio
+#define LK2ND_INIT_SECTION(prio)	_LK2ND_INIT_SECTION(prio)
+
+#define LK2ND_INIT_PRIO(func, prio) static void (*_lk2nd_init_##func)(void) \
+	__SECTION(LK2ND_INIT_SECTION(prio)) __USED = (func)
+#define LK2ND_INIT(func) LK2ND_INIT_PRIO(func, LK2ND_INIT_PRIO_DEFAULT)
+
+/*
+ * Deferred hooks are only needed for interactive use. They run on the first
+ * lk2nd_init_require() call for any of their dependencies, so on a normal
+ * boot without user interaction they are never run at all.
+ */
+#define LK2ND_INIT_NEED_FASTBOOT	BIT(0)
+#define LK2ND_INIT_NEED_MENU		BIT(1)
+
+struct lk2nd_init_deferred {
+	void (*func)(void);
+	unsigned int deps;
+	bool *done;
+};
+
+#define LK2ND_INIT_DEFERRED(func, deps) \
+	static bool _lk2nd_init_done_##func; \
+	static const struct lk2nd_init_deferred _lk2nd_init_deferred_##func \
+		__SECTION(".lk2nd_init_deferred") __USED = { \
+			(func), (deps), &_lk2nd_init_done_##func }
+
+void lk2nd_init_require(unsigned int need);
 
 #endif /* LK2ND_INIT_H */
@@ -0,0 +1,21 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+#ifndef LK2ND_LOGO_H
+#define LK2ND_LOGO_H
+
+#include <stdbool.h>
+
+#if WITH_LK2ND_DISPLAY_LOGO
+/**
+ * lk2nd_logo_draw() - Clear the screen and draw the logo built into lk2nd.
+ *
+ * The logo is a QOI image that is decoded directly into the framebuffer.
+ * The caller is responsible for flushing the framebuffer afterwards.
+ *
+ * Return: true if the logo was drawn, false otherwise
+ */
+bool lk2nd_logo_draw(void);
+#else
+static inline bool lk2nd_logo_draw(void) { return false; }
+#endif
+
+#endif /* LK2ND_LOGO_H */
@@ -0,0 +1,51 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+#ifndef LK2ND_PERSIST_H
+#define LK2ND_PERSIST_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+enum lk2nd_persist_slot {
+	LK2ND_PERSIST_BOOT_HINT,
+	LK2ND_PERSIST_PANEL,
+	LK2ND_PERSIST_DTB_HINT,
+	LK2ND_PERSIST_MMC_TUNING,
+	LK2ND_PERSIST_MAX,
+};
+
+#if WITH_LK2ND_PERSIST
+/**
+ * lk2nd_persist_load() - Read data saved in a previous boot.
+ * @slot: Slot to read
+ * @data: Buffer for the data
+ * @size: Expected size of the data
+ *
+ * The data only survives warm reboots. It is checksummed, so anything that
+ * was overwritten in the meantime is reported as missing.
+ *
+ * Return: true if valid data of the exact @size was found.
+ */
+bool lk2nd_persist_load(enum lk2nd_persist_slot slot, void *data, size_t size);
+
+/**
+ * lk2nd_persist_store() - Save data for the next boot.
+ * @slot: Slot to write
+ * @data: Data to save
+ * @size: Size of the data, must fit the slot
+ */
+void lk2nd_persist_store(enum lk2nd_persist_slot slot, const void *data, size_t size);
+
+/**
+ * lk2nd_persist_clear() - Invalidate the data in a slot.
+ * @slot: Slot to clear
+ */
+void lk2nd_persist_clear(enum lk2nd_persist_slot slot);
+#else
+static inline bool lk2nd_persist_load(enum lk2nd_persist_slot slot, void *data,
+				      size_t size) { return false; }
+static inline void lk2nd_persist_store(enum lk2nd_persist_slot slot,
+				       const void *data, size_t size) { }
+static inline void lk2nd_persist_clear(enum lk2nd_persist_slot slot) { }
+#endif
+
+#endif /* LK2ND_PERSIST_H */
@@ -0,0 +1,51 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+#ifndef LK2ND_PMU_H
+#define LK2ND_PMU_H
+
+#include <stdint.h>
+
+enum lk2nd_pmu_counter {
+	LK2ND_PMU_CYCLES,
+	LK2ND_PMU_INSTRUCTIONS,
+	LK2ND_PMU_L1D_REFILL,
+	LK2ND_PMU_L2_REFILL,
+	LK2ND_PMU_BRANCH_MISS,
+	LK2ND_PMU_NUM_COUNTERS,
+};
+
+/**
+ * struct lk2nd_pmu_counts - Snapshot of the PMU counters.
+ * @val: Counter values, indexed by enum lk2nd_pmu_counter.
+ *
+ * The counters are only 32 bits wide, so differences between two snapshots
+ * are only valid if they were taken within a few seconds of each other.
+ */
+struct lk2nd_pmu_counts {
+	uint32_t val[LK2ND_PMU_NUM_COUNTERS];
+};
+
+#if WITH_LK2ND_PMU
+/**
+ * lk2nd_pmu_start() - Reset and start the PMU counters.
+ * @counters: Bit mask of the counters (BIT(enum lk2nd_pmu_counter)) to use.
+ *
+ * Counters for events that are not implemented by the CPU are left disabled
+ * and read as 0.
+ *
+ * Return: Bit mask of the counters that were started.
+ */
+uint32_t lk2nd_pmu_start(uint32_t counters);
+
+/**
+ * lk2nd_pmu_read() - Read the current value of all PMU counters.
+ * @counts: Filled with the counter values.
+ */
+void lk2nd_pmu_read(struct lk2nd_pmu_counts *counts);
+
+const char *lk2nd_pmu_counter_name(enum lk2nd_pmu_counter counter);
+#else
+static inline uint32_t lk2nd_pmu_start(uint32_t counters) { return 0; }
+static inline void lk2nd_pmu_read(struct lk2nd_pmu_counts *counts) { }
+#endif
+
+#endif /* LK2ND_PMU_H */
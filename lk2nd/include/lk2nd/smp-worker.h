@@ -0,0 +1,56 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+#ifndef LK2ND_SMP_WORKER_H
+#define LK2ND_SMP_WORKER_H
+
+#include <arch/defines.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * struct lk2nd_smp_job - Work item that can run on a secondary CPU core.
+ * @func:     Function to run. It runs without LK services: no heap, no
+ *            threads, no dprintf(). Only pure computation on @in and @out.
+ * @in:       Memory read by @func
+ * @in_len:   Size of @in
+ * @out:      Memory written by @func, must be aligned to CACHE_LINE
+ * @out_len:  Size of @out
+ * @priv:     Extra argument for @func (e.g. a function pointer). Must not
+ *            point to memory that is written while lk2nd is running.
+ * @ret:      Result of @func
+ * @in_used:  Result of @func
+ * @out_used: Result of @func
+ *
+ * The caches of the CPU cores are not coherent in lk2nd, so the job tells
+ * which memory has to be kept in sync. The boot CPU must not touch @out or
+ * the job itself until lk2nd_smp_job_wait() returns.
+ */
+struct lk2nd_smp_job {
+	void (*func)(struct lk2nd_smp_job *job);
+	const void *in;
+	size_t in_len;
+	void *out;
+	size_t out_len;
+	void *priv;
+
+	int ret;
+	size_t in_used;
+	size_t out_used;
+
+	/* private */
+	volatile uint32_t done;
+	int cpu;
+} __ALIGNED(CACHE_LINE);
+
+#if WITH_LK2ND_SMP_WORKER
+unsigned int lk2nd_smp_worker_start(void);
+void lk2nd_smp_worker_park(void);
+void lk2nd_smp_job_queue(struct lk2nd_smp_job *job);
+void lk2nd_smp_job_wait(struct lk2nd_smp_job *job);
+#else
+static inline unsigned int lk2nd_smp_worker_start(void) { return 0; }
+static inline void lk2nd_smp_worker_park(void) { }
+static inline void lk2nd_smp_job_queue(struct lk2nd_smp_job *job) { job->func(job); }
+static inline void lk2nd_smp_job_wait(struct lk2nd_smp_job *job) { }
+#endif
+
+#endif /* LK2ND_SMP_WORKER_H */
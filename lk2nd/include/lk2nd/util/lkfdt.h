@@ -74,6 +74,29 @@ int lkfdt_getprop_u32(const void *fdt, int node, const char *prop, uint32_t *val
 int lkfdt_u32list_get(const void *fdt, int node, const char *prop,
 		      int idx, uint32_t *val) __PURE;
 
+/**
+ * lkfdt_node_offset_by_phandle() - Find the node that has a phandle.
+ * @fdt: Device tree blob
+ * @phandle: The phandle to search for
+ *
+ * Like fdt_node_offset_by_phandle(), but uses an index of all phandles that
+ * is built on first use. The index is rebuilt automatically when the tree
+ * has been modified in a way that moves nodes around.
+ *
+ * Return:
+ * * >= 0 - The offset of the phandle node, if successful
+ * *  < 0 - libfdt error, otherwise
+ */
+int lkfdt_node_offset_by_phandle(const void *fdt, uint32_t phandle);
+
+/**
+ * lkfdt_phandle_index_invalidate() - Drop the phandle index.
+ *
+ * Only needed if the blob was replaced with a different tree of the same
+ * size at the same address. The memory of the index is freed as well.
+ */
+void lkfdt_phandle_index_invalidate(void);
+
 /**
  * lkfdt_lookup_phandle() - Read phandle from property and search for the node.
  * @fdt: Device tree blob
@@ -84,7 +107,7 @@ int lkfdt_u32list_get(const void *fdt, int node, const char *prop,
  * * >= 0 - The offset of the phandle node, if successful
  * *  < 0 - libfdt error, otherwise
  */
-int lkfdt_lookup_phandle(const void *fdt, int node, const char *prop) __PURE;
+int lkfdt_lookup_phandle(const void *fdt, int node, const char *prop);
 
 /**
  * lkfdt_subnode_offset_by_phandle() - Return subnode that matches a phandle.
@@ -99,7 +122,7 @@ int lkfdt_lookup_phandle(const void *fdt, int node, const char *prop) __PURE;
  * * >= 0 - The offset of the subnode that matches the phandle, if successful
  * *  < 0 - libfdt error, otherwise
  */
-int lkfdt_subnode_offset_by_phandle(const void *fdt, int parent, uint32_t phandle) __PURE;
+int lkfdt_subnode_offset_by_phandle(const void *fdt, int parent, uint32_t phandle);
 
 /**
  * lkfdt_stringlist_get_all() - Obtain array of strings for a given prop
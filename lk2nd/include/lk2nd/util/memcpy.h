@@ -0,0 +1,54 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+#ifndef LK2ND_UTIL_MEMCPY_H
+#define LK2ND_UTIL_MEMCPY_H
+
+#include <stddef.h>
+
+#include <lk2nd/smp-worker.h>
+
+#define LK2ND_MEMCPY_MAX_JOBS	4
+
+/**
+ * struct lk2nd_memcpy - Copy that runs in the background.
+ * @jobs:  Pieces of the copy that were handed to the workers
+ * @njobs: Number of @jobs in use
+ */
+struct lk2nd_memcpy {
+	struct lk2nd_smp_job jobs[LK2ND_MEMCPY_MAX_JOBS];
+	unsigned int njobs;
+};
+
+/**
+ * lk2nd_memcpy_async() - Start copying memory in the background.
+ * @c:   Copy state, must stay valid until lk2nd_memcpy_wait()
+ * @dst: Destination
+ * @src: Source
+ * @len: Number of bytes to copy
+ *
+ * Large copies are split up and run on the secondary CPU cores, so the boot
+ * CPU can continue with something else (e.g. decompressing or hashing).
+ * Neither @dst nor @src may be touched until lk2nd_memcpy_wait() returns.
+ * Small or overlapping copies and copies without an available worker are
+ * done immediately with memmove().
+ */
+void lk2nd_memcpy_async(struct lk2nd_memcpy *c, void *dst, const void *src, size_t len);
+
+/**
+ * lk2nd_memcpy_wait() - Wait until a copy started in the background is done.
+ * @c: Copy state passed to lk2nd_memcpy_async()
+ */
+void lk2nd_memcpy_wait(struct lk2nd_memcpy *c);
+
+/**
+ * lk2nd_memcpy() - Copy memory using all available CPU cores.
+ * @dst: Destination
+ * @src: Source
+ * @len: Number of bytes to copy
+ *
+ * Same as memmove(), but large copies that do not overlap are split between
+ * the boot CPU and the secondary CPU cores to make better use of the memory
+ * bandwidth.
+ */
+void lk2nd_memcpy(void *dst, const void *src, size_t len);
+
+#endif /* LK2ND_UTIL_MEMCPY_H */
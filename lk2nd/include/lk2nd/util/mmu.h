@@ -2,6 +2,8 @@
 #ifndef LK2ND_UTIL_MMU_H
 #define LK2ND_UTIL_MMU_H
 
+#include <arch/arm/mmu.h>
+
 /**
  * lk2nd_mmu_map_ram() - Validate and map RAM with one of the specified flags.
  * @name: Name of the memory region (for debugging purposes)
@@ -16,7 +18,7 @@
  * Return: true if mapping was successful, false otherwise
  */
 bool lk2nd_mmu_map_ram(const char *name, uintptr_t start, uint32_t size,
-		       uint flags1, uint flags2);
+		       arm_mmu_flags_t flags1, arm_mmu_flags_t flags2);
 
 /**
  * lk2nd_mmu_map_ram() - Validate and map RAM with write-through cache.
@@ -31,6 +33,23 @@ bool lk2nd_mmu_map_ram(const char *name, uintptr_t start, uint32_t size,
  */
 bool lk2nd_mmu_map_ram_wt(const char *name, uintptr_t start, uint32_t size);
 
+/**
+ * lk2nd_mmu_map_ram_wc() - Validate and map RAM as write-combine.
+ * @name: Name of the memory region (for debugging purposes)
+ * @start: Start address of the memory region
+ * @size: Total size of the memory region
+ *
+ * Check that @start is really part of the RAM, then map it as normal
+ * non-cacheable memory. Unlike write-through, consecutive stores are merged
+ * before they are written to memory, and unlike write-back no cache flushes
+ * are needed before the memory is read by other hardware (e.g. the display).
+ * Existing mappings of the region are changed as well, so it must not share
+ * its 1 MiB sections with memory that needs to stay cached.
+ *
+ * Return: true if mapping was successful, false otherwise
+ */
+bool lk2nd_mmu_map_ram_wc(const char *name, uintptr_t start, uint32_t size);
+
 /**
  * lk2nd_mmu_map_ram() - Validate and map RAM based on existing mappings
  * @name: Name of the memory region (for debugging purposes)
@@ -48,4 +67,16 @@ bool lk2nd_mmu_map_ram_wt(const char *name, uintptr_t start, uint32_t size);
  */
 bool lk2nd_mmu_map_ram_dynamic(const char *name, uintptr_t start, uint32_t size);
 
+/**
+ * lk2nd_mmu_map_ddr() - Map all usable DDR as write-back cacheable.
+ * @dtb: Device tree with the no-map reserved-memory to leave out (or NULL)
+ *
+ * Map all DDR partitions from the SMEM RAM partition table up front, using
+ * 16 MiB supersections where possible. Existing mappings (e.g. lk2nd itself
+ * or the framebuffer) are kept as they are. Regions marked as no-map in
+ * @dtb are left unmapped because speculative accesses to memory protected
+ * by the firmware could cause faults.
+ */
+void lk2nd_mmu_map_ddr(const void *dtb);
+
 #endif /* LK2ND_UTIL_MMU_H */
@@ -0,0 +1,72 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+#ifndef LK2ND_UTIL_SCRATCH_H
+#define LK2ND_UTIL_SCRATCH_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/*
+ * The scratch area (target_get_scratch_address(), target_get_max_flash_size())
+ * is shared by several parts of lk2nd. Users that need their part to stay
+ * intact while others use the rest claim it under a name. The fastboot
+ * download buffer starts at the scratch address and is not tracked, anything
+ * that must survive a download has to be placed behind it.
+ */
+
+/**
+ * lk2nd_scratch_claim() - Claim a fixed range of the scratch area.
+ * @name: Name of the owner (must stay valid until the range is released)
+ * @ptr: Start of the range
+ * @size: Size of the range in bytes
+ *
+ * The range is extended to whole pages. Claiming the same range again with
+ * the same name succeeds without doing anything.
+ *
+ * Return: true if the range is now owned by @name, false if it is outside of
+ * the scratch area or overlaps with a range claimed by someone else.
+ */
+bool lk2nd_scratch_claim(const char *name, void *ptr, size_t size);
+
+/**
+ * lk2nd_scratch_alloc() - Claim a free range of the scratch area.
+ * @name: Name of the owner (must stay valid until the range is released)
+ * @size: Size of the range in bytes
+ *
+ * Return: Start of the lowest free range that fits @size (page aligned),
+ * or NULL if there is none.
+ */
+void *lk2nd_scratch_alloc(const char *name, size_t size);
+
+/**
+ * lk2nd_scratch_alloc_max() - Claim the largest free range of the scratch area.
+ * @name: Name of the owner (must stay valid until the range is released)
+ * @size: Returns the size of the range in bytes
+ *
+ * Return: Start of the range (page aligned), or NULL if nothing is free.
+ */
+void *lk2nd_scratch_alloc_max(const char *name, size_t *size);
+
+/**
+ * lk2nd_scratch_release() - Release a range claimed before.
+ * @name: Name of the owner that claimed the range
+ * @ptr: Start of the range as passed to or returned by the claim
+ *
+ * Releasing a range of another owner is a bug and triggers an assertion.
+ */
+void lk2nd_scratch_release(const char *name, void *ptr);
+
+/**
+ * lk2nd_scratch_owner() - Find the owner of an address in the scratch area.
+ * @ptr: Address to look up
+ *
+ * Return: Name of the owner, or NULL if @ptr is not claimed.
+ */
+const char *lk2nd_scratch_owner(const void *ptr);
+
+/**
+ * lk2nd_scratch_dump() - Print all claimed ranges.
+ * @print: Called with one line for each range (e.g. fastboot_info)
+ */
+void lk2nd_scratch_dump(void (*print)(const char *line));
+
+#endif /* LK2ND_UTIL_SCRATCH_H */
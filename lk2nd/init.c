@@ -2,6 +2,7 @@
 /* Copyright (c) 2022, Stephan Gerhold <stephan@gerhold.net> */
 
 #include <debug.h>
+#include <lk2nd/bootstats.h>
 #include <lk2nd/init.h>
 
 void lk2nd_init(void)
@@ -9,8 +10,42 @@ void lk2nd_init(void)
 	extern void (*__lk2nd_init_start)(void);
 	extern void (*__lk2nd_init_end)(void);
 	void (**func)(void);
+	int bs;
 
 	dprintf(INFO, "lk2nd_init()\n");
+	bs = lk2nd_bootstats_start("lk2nd_init");
 	for (func = &__lk2nd_init_start; func < &__lk2nd_init_end; ++func)
 		(*func)();
+	lk2nd_bootstats_end(bs);
+}
+
+/**
+ * lk2nd_init_require() - Run the deferred init hooks needed for a feature.
+ * @need: Mask of LK2ND_INIT_NEED_* flags for the feature about to be used.
+ *
+ * Each deferred hook runs at most once, on the first call that requests
+ * any of its dependencies.
+ */
+void lk2nd_init_require(unsigned int need)
+{
+	extern const struct lk2nd_init_deferred __lk2nd_init_deferred_start;
+	extern const struct lk2nd_init_deferred __lk2nd_init_deferred_end;
+	const struct lk2nd_init_deferred *d;
+	bool started = false;
+	int bs = -1;
+
+	for (d = &__lk2nd_init_deferred_start; d < &__lk2nd_init_deferred_end; ++d) {
+		if (*d->done || !(d->deps & need))
+			continue;
+
+		if (!started) {
+			started = true;
+			dprintf(INFO, "lk2nd_init_require(%#x)\n", need);
+			bs = lk2nd_bootstats_start("lk2nd_init_deferred");
+		}
+		*d->done = true;
+		d->func();
+	}
+	if (started)
+		lk2nd_bootstats_end(bs);
 }
@@ -0,0 +1,104 @@
+// SPDX-License-Identifier: BSD-3-Clause
+
+#include <arch/ops.h>
+#include <crc32.h>
+#include <debug.h>
+#include <string.h>
+#include <target.h>
+
+#include <lk2nd/init.h>
+#include <lk2nd/persist.h>
+#include <lk2nd/util/scratch.h>
+
+/*
+ * persist.c - Small pieces of data kept in RAM across (warm) reboots.
+ *
+ * The region is placed right below the ramoops buffer at the end of the
+ * scratch area. Each slot has a fixed place and is protected with a
+ * checksum, so stale or overwritten data is simply ignored.
+ */
+
+#define PERSIST_RAMOOPS_SIZE	(512 * 1024)
+#define PERSIST_REGION_SIZE	(64 * 1024)
+#define PERSIST_MAGIC		0x50324b4c /* LK2P */
+
+struct persist_hdr {
+	uint32_t magic;
+	uint32_t size;
+	uint32_t crc;
+	uint32_t reserved;
+	uint8_t data[];
+};
+
+static const struct {
+	size_t offset;
+	size_t size;
+} slots[LK2ND_PERSIST_MAX] = {
+	[LK2ND_PERSIST_BOOT_HINT] = { 0, 256 },
+	[LK2ND_PERSIST_PANEL] = { 256, 128 },
+	[LK2ND_PERSIST_DTB_HINT] = { 384, 128 },
+	[LK2ND_PERSIST_MMC_TUNING] = { 512, 64 },
+};
+
+static void *persist_base(void)
+{
+	return target_get_scratch_address() + target_get_max_flash_size()
+	       - PERSIST_RAMOOPS_SIZE - PERSIST_REGION_SIZE;
+}
+
+static struct persist_hdr *persist_slot(enum lk2nd_persist_slot slot)
+{
+	ASSERT(slot < LK2ND_PERSIST_MAX);
+	return persist_base() + slots[slot].offset;
+}
+
+/* Keep the other users of the scratch area away from the region */
+static void persist_init(void)
+{
+	lk2nd_scratch_claim("persist", persist_base(), PERSIST_REGION_SIZE);
+}
+LK2ND_INIT_PRIO(persist_init, LK2ND_INIT_PRIO_EARLY);
+
+static uint32_t persist_crc(const void *data, size_t size)
+{
+	return crc32(~0L, data, size) ^ ~0L;
+}
+
+bool lk2nd_persist_load(enum lk2nd_persist_slot slot, void *data, size_t size)
+{
+	struct persist_hdr *hdr = persist_slot(slot);
+
+	if (hdr->magic != PERSIST_MAGIC || hdr->size != size ||
+	    size > slots[slot].size - sizeof(*hdr))
+		return false;
+
+	if (hdr->crc != persist_crc(hdr->data, size))
+		return false;
+
+	memcpy(data, hdr->data, size);
+	return true;
+}
+
+void lk2nd_persist_store(enum lk2nd_persist_slot slot, const void *data, size_t size)
+{
+	struct persist_hdr *hdr = persist_slot(slot);
+
+	if (size > slots[slot].size - sizeof(*hdr)) {
+		dprintf(CRITICAL, "persist: Data for slot %d too big: %zu\n", slot, size);
+		return;
+	}
+
+	memcpy(hdr->data, data, size);
+	hdr->size = size;
+	hdr->crc = persist_crc(data, size);
+	hdr->magic = PERSIST_MAGIC;
+	arch_clean_invalidate_cache_range((addr_t)hdr, sizeof(*hdr) + size);
+}
+
+void lk2nd_persist_clear(enum lk2nd_persist_slot slot)
+{
+	struct persist_hdr *hdr = persist_slot(slot);
+
+	hdr->magic = 0;
+	arch_clean_invalidate_cache_range((addr_t)hdr, sizeof(*hdr));
+}
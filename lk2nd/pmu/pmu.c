@@ -0,0 +1,130 @@
+// SPDX-License-Identifier: BSD-3-Clause
+
+#include <arch/defines.h>
+#include <bits.h>
+#include <debug.h>
+#include <kernel/thread.h>
+
+#include <lk2nd/pmu.h>
+
+/*
+ * pmu.c - Count CPU events with the ARMv7 performance monitors.
+ *
+ * The cycle counter and the common architectural events are supported on
+ * Cortex-A7/A53 and Krait. Only the boot CPU is counted, including the time
+ * spent in other threads and interrupt handlers.
+ */
+
+#define PMCR_E		BIT(0)
+#define PMCR_P		BIT(1)
+#define PMCR_C		BIT(2)
+#define PMCR_D		BIT(3)
+#define PMCR_N(pmcr)	BITS_SHIFT(pmcr, 15, 11)
+
+#define PMCNT_CYCLES	(1U << 31)
+
+#define PMU_EVENT_L1D_REFILL	0x03
+#define PMU_EVENT_INST_RETIRED	0x08
+#define PMU_EVENT_BR_MIS_PRED	0x10
+#define PMU_EVENT_L2D_REFILL	0x17
+
+#define pmu_read_reg(crm, opc2) ({ \
+	uint32_t _val; \
+	__asm__ volatile("mrc p15, 0, %0, c9, " #crm ", " #opc2 : "=r"(_val)); \
+	_val; \
+})
+#define pmu_write_reg(crm, opc2, val) \
+	__asm__ volatile("mcr p15, 0, %0, c9, " #crm ", " #opc2 :: "r"(val))
+
+static const struct {
+	const char *name;
+	uint8_t event;
+} counters[LK2ND_PMU_NUM_COUNTERS] = {
+	[LK2ND_PMU_CYCLES]		= { "cycles" },
+	[LK2ND_PMU_INSTRUCTIONS]	= { "instructions", PMU_EVENT_INST_RETIRED },
+	[LK2ND_PMU_L1D_REFILL]		= { "l1d-refill", PMU_EVENT_L1D_REFILL },
+	[LK2ND_PMU_L2_REFILL]		= { "l2-refill", PMU_EVENT_L2D_REFILL },
+	[LK2ND_PMU_BRANCH_MISS]		= { "branch-miss", PMU_EVENT_BR_MIS_PRED },
+};
+
+/* Event counter (PMSELR index) used for each counter, -1 if unused */
+static int8_t slots[LK2ND_PMU_NUM_COUNTERS];
+static uint32_t active;
+
+const char *lk2nd_pmu_counter_name(enum lk2nd_pmu_counter counter)
+{
+	return counters[counter].name;
+}
+
+uint32_t lk2nd_pmu_start(uint32_t mask)
+{
+	uint32_t pmcr, ceid, enable = 0;
+	unsigned int i, n = 0, num;
+
+	enter_critical_section();
+
+	pmcr = pmu_read_reg(c12, 0);
+	num = PMCR_N(pmcr);
+
+	/* Stop everything and disable the overflow interrupts */
+	pmu_write_reg(c12, 2, ~0U);	/* PMCNTENCLR */
+	pmu_write_reg(c14, 2, ~0U);	/* PMINTENCLR */
+	pmu_write_reg(c12, 3, ~0U);	/* PMOVSR */
+
+	/* Older cores do not implement PMCEID0, then just try all events */
+	ceid = pmu_read_reg(c12, 6);
+	if (!ceid)
+		ceid = ~0U;
+
+	active = 0;
+	for (i = 0; i < LK2ND_PMU_NUM_COUNTERS; i++) {
+		slots[i] = -1;
+		if (!(mask & BIT(i)))
+			continue;
+
+		if (i == LK2ND_PMU_CYCLES) {
+			enable |= PMCNT_CYCLES;
+			active |= BIT(i);
+			continue;
+		}
+
+		if (n == num || !(ceid & BIT(counters[i].event)))
+			continue;
+
+		pmu_write_reg(c12, 5, n);			/* PMSELR */
+		isb();
+		pmu_write_reg(c13, 1, counters[i].event);	/* PMXEVTYPER */
+		enable |= BIT(n);
+		slots[i] = n++;
+		active |= BIT(i);
+	}
+
+	/* Reset and enable the counters, count every cycle */
+	pmu_write_reg(c12, 0, (pmcr & ~PMCR_D) | PMCR_E | PMCR_P | PMCR_C);
+	pmu_write_reg(c12, 1, enable);	/* PMCNTENSET */
+	isb();
+
+	exit_critical_section();
+
+	dprintf(INFO, "PMU: %u event counters, started %#x\n", num, active);
+	return active;
+}
+
+void lk2nd_pmu_read(struct lk2nd_pmu_counts *counts)
+{
+	unsigned int i;
+
+	enter_critical_section();
+	for (i = 0; i < LK2ND_PMU_NUM_COUNTERS; i++) {
+		if (!(active & BIT(i))) {
+			counts->val[i] = 0;
+		} else if (i == LK2ND_PMU_CYCLES) {
+			counts->val[i] = pmu_read_reg(c13, 0);	/* PMCCNTR */
+		} else {
+			pmu_write_reg(c12, 5, slots[i]);	/* PMSELR */
+			isb();
+			counts->val[i] = pmu_read_reg(c13, 2);	/* PMXEVCNTR */
+		}
+	}
+	exit_critical_section();
+}
@@ -0,0 +1,155 @@
+// SPDX-License-Identifier: BSD-3-Clause
+
+#include <arch/arm.h>
+#include <arch/defines.h>
+#include <bits.h>
+#include <debug.h>
+#include <fastboot.h>
+#include <kernel/thread.h>
+#include <platform/interrupts.h>
+#include <platform/irqs.h>
+#include <printf.h>
+#include <qgic.h>
+#include <qtimer.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * Simple sampling profiler: The virtual timer of the ARM generic timer
+ * (unused by LK) periodically interrupts the CPU and the interrupted PC is
+ * recorded. Note that code running with interrupts disabled is attributed to
+ * the place where interrupts are enabled again.
+ */
+#define PROFILE_MAX_SAMPLES	(64 * 1024)
+#define PROFILE_DEFAULT_HZ	1000
+#define PROFILE_MAX_HZ		10000
+
+#define CNTV_CTL_ENABLE		BIT(0)
+#define CNTV_CTL_IMASK		BIT(1)
+
+static uint32_t *samples;
+static unsigned int num_samples;
+static uint32_t interval;
+static bool running;
+
+static inline void cntv_set_tval(uint32_t val)
+{
+	__asm__ volatile("mcr p15, 0, %0, c14, c3, 0" :: "r"(val));
+	isb();
+}
+
+static inline void cntv_set_ctl(uint32_t val)
+{
+	__asm__ volatile("mcr p15, 0, %0, c14, c3, 1" :: "r"(val));
+	isb();
+}
+
+static void profile_stop(void)
+{
+	enter_critical_section();
+	cntv_set_ctl(CNTV_CTL_IMASK);
+	mask_interrupt(INT_QTMR_VIRTUAL_TIMER_EXP);
+	running = false;
+	exit_critical_section();
+}
+
+static enum handler_return profile_irq(void *arg)
+{
+	struct arm_iframe *frame = gic_current_iframe();
+
+	if (num_samples == PROFILE_MAX_SAMPLES) {
+		cntv_set_ctl(CNTV_CTL_IMASK);
+		running = false;
+		return INT_NO_RESCHEDULE;
+	}
+
+	samples[num_samples++] = frame->pc;
+	cntv_set_tval(interval);
+	return INT_NO_RESCHEDULE;
+}
+
+static void cmd_oem_profile_start(const char *arg, void *data, unsigned sz)
+{
+	unsigned long hz = PROFILE_DEFAULT_HZ;
+
+	if (*arg)
+		hz = atoul(arg);
+	if (!hz || hz > PROFILE_MAX_HZ) {
+		fastboot_fail("invalid sample rate");
+		return;
+	}
+
+	if (!samples) {
+		samples = malloc(PROFILE_MAX_SAMPLES * sizeof(*samples));
+		if (!samples) {
+			fastboot_fail("failed to allocate sample buffer");
+			return;
+		}
+	}
+
+	profile_stop();
+	num_samples = 0;
+	interval = qtimer_tick_rate() / hz;
+
+	enter_critical_section();
+	register_int_handler(INT_QTMR_VIRTUAL_TIMER_EXP, profile_irq, NULL);
+	cntv_set_tval(interval);
+	cntv_set_ctl(CNTV_CTL_ENABLE);
+	unmask_interrupt(INT_QTMR_VIRTUAL_TIMER_EXP);
+	running = true;
+	exit_critical_section();
+
+	fastboot_okay("");
+}
+FASTBOOT_REGISTER("oem profile start", cmd_oem_profile_start);
+
+static void cmd_oem_profile_stop(const char *arg, void *data, unsigned sz)
+{
+	char response[MAX_RSP_SIZE];
+
+	profile_stop();
+
+	snprintf(response, sizeof(response), "%u samples", num_samples);
+	fastboot_info(response);
+	fastboot_okay("");
+}
+FASTBOOT_REGISTER("oem profile stop", cmd_oem_profile_stop);
+
+static int profile_cmp(const void *a, const void *b)
+{
+	uint32_t pa = *(const uint32_t *)a, pb = *(const uint32_t *)b;
+
+	return (pa > pb) - (pa < pb);
+}
+
+/*
+ * Stage a histogram with one "<pc> <count>" line for each sampled address,
+ * which can be symbolized with lk2nd/scripts/profile-symbolize.py.
+ */
+static void cmd_oem_profile_dump(const char *arg, void *data, unsigned sz)
+{
+	char *out = data;
+	unsigned int i, count;
+
+	if (running) {
+		fastboot_fail("profiler is running");
+		return;
+	}
+	if (!num_samples) {
+		fastboot_fail("no samples");
+		return;
+	}
+
+	qsort(samples, num_samples, sizeof(*samples), profile_cmp);
+
+	for (i = 0; i < num_samples; i += count) {
+		for (count = 1; i + count < num_samples; count++)
+			if (samples[i + count] != samples[i])
+				break;
+
+		out += sprintf(out, "%#010x %u\n", samples[i], count);
+	}
+
+	fastboot_stage(data, out - (char *)data);
+}
+FASTBOOT_REGISTER("oem profile dump", cmd_oem_profile_dump);
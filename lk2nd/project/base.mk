@@ -4,7 +4,10 @@ $(error The lk2nd configurations provide development/debugging helpers and are
 	therefore currently not designed to be used together with secure boot)
 endif
 
+# LPAE is only kept if requested, the lk2nd MMU helpers use 2 MiB blocks then
+ifneq ($(LK2ND_LPAE), 1)
 override ENABLE_LPAE_SUPPORT := 0
+endif
 
 # lk2nd provides its own mainline-friendly partial-goods implementation
 ifneq ($(filter msm8909, $(TARGET)),)
@@ -23,7 +26,9 @@ GPL ?= 1
 
 MODULES += \
 	lk2nd \
+	lk2nd/bootstats \
 	lk2nd/fastboot \
+	lk2nd/fastboot/bench \
 	lk2nd/fastboot/debug \
 	lk2nd/hw/gpio \
 	lk2nd/hw/i2c \
@@ -36,6 +41,46 @@ MODULES += \
 # Disable SMP spin table if unsupported (without throwing errors)
 LK2ND_SMP_OPTIONAL := 1
 
+ifeq ($(LK2ND_SMP_WORKERS), 1)
+MODULES += lk2nd/smp/worker
+endif
+
+ifeq ($(LK2ND_BOOT_BOOST), 1)
+MODULES += lk2nd/boost
+endif
+
+ifeq ($(LK2ND_MAP_DDR), 1)
+DEFINES += LK2ND_MAP_DDR=1
+endif
+
+ifeq ($(LK2ND_DOWNLOAD_DYNAMIC), 1)
+DEFINES += LK2ND_DOWNLOAD_DYNAMIC=1
+endif
+
+ifeq ($(LK2ND_TICKLESS), 1)
+DEFINES += PLATFORM_HAS_DYNAMIC_TIMER=1
+endif
+
+ifeq ($(LK2ND_PROFILE), 1)
+MODULES += lk2nd/profile
+endif
+
+ifeq ($(LK2ND_TRACE), 1)
+MODULES += lk2nd/trace
+endif
+
+ifeq ($(LK2ND_PMU), 1)
+MODULES += lk2nd/pmu
+endif
+
+ifeq ($(LK2ND_DISPLAY_ASYNC), 1)
+DEFINES += DISPLAY_INIT_ASYNC=1
+endif
+
+ifeq ($(LK2ND_BOOT_HISTORY), 1)
+DEFINES += LK2ND_BOOT_HISTORY=1
+endif
+
 ifeq ($(ENABLE_DISPLAY), 1)
 ifneq ($(LK2ND_DISPLAY),)
 MODULES += lk2nd/display
@@ -45,13 +90,28 @@ $(info NOTE: Display support is disabled without display/panel selection)
 endif
 endif
 
-# Reserve 32 KiB for the log buffer so it can be accessed via fastboot
+# Reserve 32 KiB for the log buffer so it can be accessed via fastboot.
+# Alternatively, LK_LOG_BUF_ADDR=<addr> places a larger log buffer (with its
+# header, LK_LOG_BUF_SIZE + 16 bytes) in reserved memory mapped by the platform.
+ifneq ($(LK_LOG_BUF_ADDR),)
+DEFINES += WITH_DEBUG_LOG_BUF=1 LK_LOG_BUF_ADDR=$(LK_LOG_BUF_ADDR) \
+	   LK_LOG_BUF_SIZE=$(or $(LK_LOG_BUF_SIZE),1048576)
+else
 DEFINES += WITH_DEBUG_LOG_BUF=1 LK_LOG_BUF_SIZE=32768
+endif
 
 ifeq ($(DEBUG_FBCON), 1)
 	DEFINES += WITH_DEBUG_FBCON=1
 endif
 
+ifeq ($(DEBUG_UART_ASYNC), 1)
+	DEFINES += UART_DM_ASYNC_TX=1
+endif
+
+ifeq ($(DEBUG_LOG_BINARY), 1)
+	DEFINES += WITH_DEBUG_LOG_BINARY=1
+endif
+
 ifeq ($(LK2ND_FORCE_FASTBOOT), 1)
 	DEFINES += LK2ND_FORCE_FASTBOOT=1
 endif
@@ -60,6 +120,14 @@ ifdef LK2ND_FASTBOOT_DELAY
 	DEFINES += LK2ND_FASTBOOT_DELAY=$(LK2ND_FASTBOOT_DELAY)
 endif
 
+ifeq ($(LK2ND_FASTBOOT_EARLY), 1)
+	DEFINES += LK2ND_FASTBOOT_EARLY=1
+endif
+
+ifdef WORKQUEUE_THREADS
+	DEFINES += WORKQUEUE_THREADS=$(WORKQUEUE_THREADS)
+endif
+
 # Keep the kernel command line clean when booting other operating systems
 DEFINES += GENERATE_CMDLINE_ONLY_FOR_ANDROID=1
 
@@ -33,6 +33,15 @@ DEFINES := $(filter-out ENABLE_WBC=1, $(DEFINES))
 # Should be already done by primary bootloader if wanted
 DEFINES := $(filter-out ENABLE_XPU_VIOLATION=1, $(DEFINES))
 
+# The eMMC is already set up by the primary bootloader
+ifeq ($(LK2ND_MMC_ADOPT), 1)
+DEFINES += MMC_SDHCI_ADOPT=1
+endif
+
+ifeq ($(LK2ND_UFS_HS_GEAR), 1)
+DEFINES += UFS_HS_GEAR_SWITCH=1
+endif
+
 # Build Android boot image
 OUTBOOTIMG := $(BUILDDIR)/lk2nd.img
 MKBOOTIMG_CMDLINE := lk2nd
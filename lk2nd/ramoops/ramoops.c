@@ -4,12 +4,17 @@
 #include <boot.h>
 #include <compiler.h>
 #include <debug.h>
+#include <err.h>
 #include <fastboot.h>
+#include <lib/lz4.h>
 #include <libfdt.h>
+#include <stdlib.h>
 #include <target.h>
 #include <zlib.h>
 
+#include <lk2nd/init.h>
 #include <lk2nd/util/cmdline.h>
+#include <lk2nd/util/scratch.h>
 
 #define PERSISTENT_RAM_SIG (0x43474244) /* DBGC */
 
@@ -52,6 +57,16 @@ static void get_ramoops_region(struct ramoops_region *region)
 	region->base		= (scratch + scratch_size - region->size);
 }
 
+/* The previous records must be kept until they are passed on or dumped */
+static void ramoops_init(void)
+{
+	struct ramoops_region region;
+
+	get_ramoops_region(&region);
+	lk2nd_scratch_claim("ramoops", region.base, region.size);
+}
+LK2ND_INIT_PRIO(ramoops_init, LK2ND_INIT_PRIO_EARLY);
+
 
 static int lk2nd_ramoops_dt_update(void *dtb, const char *cmdline, enum boot_type boot_type)
 {
@@ -131,22 +146,47 @@ static void cmd_oem_ramoops_raw(const char *arg, void *data, unsigned sz)
 }
 FASTBOOT_REGISTER("oem ramoops raw", cmd_oem_ramoops_raw);
 
-#define RAMOOPS_KERNMSG_HDR 0x3d3d3d3d /* ==== */
-struct kmsg_hdr {
-	uint32_t magic;
-	char	 time[17];
-	char     dash;
-	char	 compressed;
-	char     newline;
-	uint8_t  data[];
-} __PACKED;
+/*
+ * Dump records start with a "====<sec>.<nsec>-<C|D>\n" header, where C marks
+ * a compressed record. The length of the time stamp varies and older kernels
+ * don't have the "-C"/"-D" suffix.
+ */
+#define RAMOOPS_KERNMSG_HDR	"===="
+#define RAMOOPS_KERNMSG_HDR_MAX	64
+
+static int ramoops_parse_kmsg_hdr(const uint8_t *data, size_t len, bool *compressed)
+{
+	const uint8_t *nl;
+
+	if (len < strlen(RAMOOPS_KERNMSG_HDR) ||
+	    memcmp(data, RAMOOPS_KERNMSG_HDR, strlen(RAMOOPS_KERNMSG_HDR)))
+		return ERR_NOT_VALID;
+
+	nl = memchr(data, '\n', MIN(len, RAMOOPS_KERNMSG_HDR_MAX));
+	if (!nl)
+		return ERR_NOT_VALID;
+
+	*compressed = nl - data >= 2 && nl[-2] == '-' && nl[-1] == 'C';
+	return nl + 1 - data;
+}
+
+static struct pram_buf *ramoops_dump_record(struct ramoops_region *region, int i)
+{
+	struct pram_buf *record = region->base + i * region->record_size;
+
+	if (record->sig != PERSISTENT_RAM_SIG || !record->size ||
+	    record->size > region->record_size - sizeof(*record))
+		return NULL;
+
+	return record;
+}
 
 static void cmd_oem_ramoops_regions(const char *arg, void *data, unsigned sz)
 {
 	struct ramoops_region region;
 	struct pram_buf *record;
 	uint8_t *record_base;
-	char response[MAX_RSP_SIZE], header[sizeof(struct kmsg_hdr)];
+	char response[MAX_RSP_SIZE], header[24];
 	int i, count;
 
 	get_ramoops_region(&region);
@@ -202,45 +242,214 @@ static void cmd_oem_ramoops_console(const char *arg, void *data, unsigned sz)
 }
 FASTBOOT_REGISTER("oem ramoops console", cmd_oem_ramoops_console);
 
+static int ramoops_inflate(const uint8_t *in, size_t in_len, uint8_t *out,
+			   size_t out_len, int window_bits)
+{
+	z_stream strm = {0};
+	int ret;
+
+	ret = inflateInit2(&strm, window_bits);
+	if (ret != Z_OK)
+		return ERR_NO_MEMORY;
+
+	strm.next_in = (Bytef *)in;
+	strm.avail_in = in_len;
+	strm.next_out = out;
+	strm.avail_out = out_len;
+
+	ret = inflate(&strm, Z_FINISH);
+	inflateEnd(&strm);
+
+	if (ret == Z_BUF_ERROR && !strm.avail_out)
+		return ERR_NOT_ENOUGH_BUFFER;
+	if (ret != Z_STREAM_END)
+		return ERR_NOT_VALID;
+
+	return strm.total_out;
+}
+
+/*
+ * Depending on the kernel version and pstore.compress, compressed records
+ * contain zlib (older kernels), raw deflate (crypto API "deflate" and the
+ * zlib code since Linux 6.6) or a raw LZ4 block (pstore.compress=lz4).
+ */
+static int ramoops_decompress(const uint8_t *in, size_t in_len, uint8_t *out,
+			      size_t out_len)
+{
+	size_t used;
+	int ret;
+
+	if (in_len >= 2 && (in[0] & 0x0f) == Z_DEFLATED &&
+	    ((in[0] << 8) | in[1]) % 31 == 0) {
+		ret = ramoops_inflate(in, in_len, out, out_len, MAX_WBITS);
+		if (ret >= 0 || ret == ERR_NOT_ENOUGH_BUFFER)
+			return ret;
+	}
+
+	ret = ramoops_inflate(in, in_len, out, out_len, -MAX_WBITS);
+	if (ret >= 0 || ret == ERR_NOT_ENOUGH_BUFFER)
+		return ret;
+
+	ret = lz4_decompress_block(in, in_len, out, out_len, &used);
+	if (ret == ERR_NOT_ENOUGH_BUFFER)
+		return ret;
+	if (ret == 0)
+		return used;
+
+	return ERR_NOT_VALID;
+}
+
+/**
+ * ramoops_read_dump() - Copy the text of a dump record, decompressed.
+ * @region: ramoops region
+ * @i: Index of the dump record
+ * @out: Buffer for the text
+ * @out_len: Size of @out
+ *
+ * Returns: Length of the text, ERR_NOT_FOUND if the record is empty or
+ * other negative error.
+ */
+static int ramoops_read_dump(struct ramoops_region *region, int i,
+			     uint8_t *out, size_t out_len)
+{
+	struct pram_buf *record = ramoops_dump_record(region, i);
+	bool compressed;
+	int hdr_len;
+	size_t len;
+
+	if (!record)
+		return ERR_NOT_FOUND;
+
+	hdr_len = ramoops_parse_kmsg_hdr(record->data, record->size, &compressed);
+	if (hdr_len < 0)
+		return hdr_len;
+
+	len = record->size - hdr_len;
+	if (compressed)
+		return ramoops_decompress(record->data + hdr_len, len, out, out_len);
+
+	if (len > out_len)
+		return ERR_NOT_ENOUGH_BUFFER;
+
+	memcpy(out, record->data + hdr_len, len);
+	return len;
+}
+
 static void cmd_oem_ramoops_dump(const char *arg, void *data, unsigned sz)
 {
-	unsigned long size = target_get_max_flash_size();
-	void *scratch = target_get_scratch_address();
 	struct ramoops_region region;
 	char response[MAX_RSP_SIZE];
+	uint8_t *scratch;
+	size_t size;
+	int i = 0, ret;
+
+	get_ramoops_region(&region);
+
+	if (*arg)
+		i = atoi(arg);
+	if (i < 0 || i >= (int)(region.dump_size / region.record_size)) {
+		fastboot_fail("invalid record");
+		return;
+	}
+
+	/* The ramoops region itself (and others) must stay intact */
+	scratch = lk2nd_scratch_alloc_max("ramoops-dump", &size);
+	if (!scratch) {
+		fastboot_fail("no scratch space");
+		return;
+	}
+
+	/* NOTE: This can't really work without ECC if the RAM was not retained... */
+	ret = ramoops_read_dump(&region, i, scratch, size);
+	if (ret < 0) {
+		snprintf(response, sizeof(response), "Dump %d corrupted: %d", i, ret);
+		fastboot_fail(response);
+	} else {
+		fastboot_stage(scratch, ret);
+	}
+	lk2nd_scratch_release("ramoops-dump", scratch);
+}
+FASTBOOT_REGISTER("oem ramoops dump", cmd_oem_ramoops_dump);
+
+static int ramoops_append(uint8_t **pos, uint8_t *end, const char *fmt, ...)
+{
+	va_list ap;
+	int len;
+
+	va_start(ap, fmt);
+	len = vsnprintf((char *)*pos, end - *pos, fmt, ap);
+	va_end(ap);
+
+	if (len >= end - *pos)
+		return ERR_NOT_ENOUGH_BUFFER;
+
+	*pos += len;
+	return 0;
+}
+
+/*
+ * Concatenate all dump records and the console into one buffer, so they can
+ * be fetched with a single transfer.
+ */
+static void cmd_oem_ramoops_dump_all(const char *arg, void *data, unsigned sz)
+{
+	struct ramoops_region region;
 	struct pram_buf *record;
-	struct kmsg_hdr *header;
-	uint8_t *record_base;
-	int ret;
+	uint8_t *scratch, *pos, *end;
+	int i, count, ret;
+	size_t size;
 
 	get_ramoops_region(&region);
 
-	record_base = region.base;
-	record = (struct pram_buf*)record_base;
-	header = (struct kmsg_hdr*)record->data;
+	scratch = lk2nd_scratch_alloc_max("ramoops-dump", &size);
+	if (!scratch) {
+		fastboot_fail("no scratch space");
+		return;
+	}
 
-	/*
-	 * FIXME: this is pretty much useless right now.
-	 * 1) This only checks the first record, not all of them.
-	 * 2) This can't really work without ECC...
-	 */
+	pos = scratch;
+	end = scratch + size;
 
-	memset(scratch, 0, record->size);
+	count = region.dump_size / region.record_size;
+	for (i = 0; i < count; ++i) {
+		if (!ramoops_dump_record(&region, i))
+			continue;
 
-	if (header->magic != RAMOOPS_KERNMSG_HDR)
-		fastboot_fail("Dump corrupted.");
+		if (ramoops_append(&pos, end, "==== dmesg-ramoops-%d\n", i))
+			goto full;
 
-	if (header->compressed == 'C') {
-		ret = uncompress(scratch, &size, header->data, record->size);
-		snprintf(response, sizeof(response), "ramoops decompress is %d", ret);
-		fastboot_info(response);
-		if (ret < 0)
-			fastboot_fail("Decompression failed.");
-	} else {
-		size = record->size - sizeof(struct kmsg_hdr);
-		memcpy(scratch, header->data, size);
+		ret = ramoops_read_dump(&region, i, pos, end - pos);
+		if (ret == ERR_NOT_ENOUGH_BUFFER)
+			goto full;
+		if (ret < 0) {
+			if (ramoops_append(&pos, end, "(corrupted: %d)\n", ret))
+				goto full;
+			continue;
+		}
+		pos += ret;
+	}
+
+	record = region.base + region.dump_size;
+	if (region.console_size && record->sig == PERSISTENT_RAM_SIG &&
+	    record->size <= region.console_size - sizeof(*record) &&
+	    record->offt <= record->size) {
+		if (ramoops_append(&pos, end, "==== console-ramoops\n"))
+			goto full;
+		if (record->size > (size_t)(end - pos))
+			goto full;
+
+		/* Oldest data first if the ring buffer has wrapped around */
+		memcpy(pos, record->data + record->offt, record->size - record->offt);
+		memcpy(pos + record->size - record->offt, record->data, record->offt);
+		pos += record->size;
 	}
 
-	fastboot_stage(scratch, size);
+	fastboot_stage(scratch, pos - scratch);
+	lk2nd_scratch_release("ramoops-dump", scratch);
+	return;
+
+full:
+	lk2nd_scratch_release("ramoops-dump", scratch);
+	fastboot_fail("records do not fit into the buffer");
 }
-FASTBOOT_REGISTER("oem ramoops dump", cmd_oem_ramoops_dump);
+FASTBOOT_REGISTER("oem ramoops dump-all", cmd_oem_ramoops_dump_all);
@@ -0,0 +1,119 @@
+#!/usr/bin/env python3
+# SPDX-License-Identifier: BSD-3-Clause
+"""
+Add an index of the device nodes below /lk2nd to a DTB (in place).
+
+The index is stored as "lk2nd,match-index" property in the /lk2nd node:
+  <size_dt_struct> <count> <offset of device node relative to /lk2nd>...
+With it lk2nd can check the device nodes directly instead of walking
+through the (often large) subtrees of all the other devices.
+"""
+import argparse
+import struct
+
+FDT_MAGIC = 0xd00dfeed
+FDT_BEGIN_NODE = 1
+FDT_END_NODE = 2
+FDT_PROP = 3
+FDT_NOP = 4
+FDT_END = 9
+
+PROP_NAME = b'lk2nd,match-index'
+NODE_NAME = b'lk2nd'
+
+
+def align4(n):
+    return (n + 3) & ~3
+
+
+def find_devices(dt):
+    """Return the offset of /lk2nd, the end of its name and its subnodes."""
+    off = depth = 0
+    lk2nd = name_end = None
+    devices = []
+
+    while off < len(dt):
+        tag, = struct.unpack_from('>I', dt, off)
+        if tag == FDT_BEGIN_NODE:
+            end = dt.index(b'\0', off + 4)
+            name = dt[off + 4:end]
+            depth += 1
+            if depth == 2 and name == NODE_NAME:
+                lk2nd, name_end = off, align4(end + 1)
+            elif depth == 3 and lk2nd is not None:
+                devices.append(off)
+            off = align4(end + 1)
+        elif tag == FDT_END_NODE:
+            if depth == 2 and lk2nd is not None:
+                break
+            depth -= 1
+            off += 4
+        elif tag == FDT_PROP:
+            length, = struct.unpack_from('>I', dt, off + 4)
+            off = align4(off + 12 + length)
+        elif tag == FDT_NOP:
+            off += 4
+        elif tag == FDT_END:
+            break
+        else:
+            raise ValueError(f'Invalid tag {tag} at {off:#x}')
+
+    return lk2nd, name_end, devices
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__)
+    parser.add_argument('dtb', help="DTB to add the index to")
+    args = parser.parse_args()
+
+    with open(args.dtb, 'rb') as f:
+        blob = bytearray(f.read())
+
+    (magic, totalsize, off_struct, off_strings, off_rsvmap, version,
+     last_comp, boot_cpuid, size_strings, size_struct) = struct.unpack_from('>10I', blob)
+    if magic != FDT_MAGIC or version < 17:
+        raise SystemExit(f'{args.dtb}: Unsupported DTB')
+    if off_strings < off_struct:
+        raise SystemExit(f'{args.dtb}: Unsupported DTB layout')
+
+    dt = bytes(blob[off_struct:off_struct + size_struct])
+    strings = bytes(blob[off_strings:off_strings + size_strings])
+
+    lk2nd, name_end, devices = find_devices(dt)
+    if lk2nd is None or not devices:
+        return  # Nothing to index
+
+    if PROP_NAME + b'\0' in strings:
+        return  # Already indexed
+
+    nameoff = len(strings)
+    strings += PROP_NAME + b'\0'
+
+    value_len = 4 * (2 + len(devices))
+    # All subnodes are moved by the size of the new property
+    delta = 12 + value_len
+    size_struct += delta
+
+    value = struct.pack(f'>{2 + len(devices)}I', size_struct, len(devices),
+                        *(d - lk2nd + delta for d in devices))
+    prop = struct.pack('>III', FDT_PROP, value_len, nameoff) + value
+    dt = dt[:name_end] + prop + dt[name_end:]
+
+    # Keep the blob layout: header and reserve map, structure, strings
+    out = bytearray(blob[:off_struct])
+    out += dt
+    off_strings = len(out)
+    out += strings
+    out += b'\0' * (-len(out) % 16)
+    size_strings = len(strings)
+
+    struct.pack_into('>10I', out, 0, magic, len(out), off_struct, off_strings,
+                     off_rsvmap, version, last_comp, boot_cpuid,
+                     size_strings, size_struct)
+
+    with open(args.dtb, 'wb') as f:
+        f.write(out)
+
+
+if __name__ == '__main__':
+    main()
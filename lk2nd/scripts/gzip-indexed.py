@@ -0,0 +1,69 @@
+#!/usr/bin/env python3
+# SPDX-License-Identifier: BSD-3-Clause
+"""
+Compress a file (e.g. an initramfs) as independent gzip members with an index
+in the first gzip header, so lk2nd can decompress the members in parallel.
+The result is still a valid gzip file for all other tools.
+"""
+import argparse
+import struct
+import zlib
+
+# Must be a multiple of the cache line size so the members can be placed
+# next to each other by different CPU cores.
+DEFAULT_CHUNK_SIZE = 1024 * 1024
+
+
+def gzip_header(extra=b''):
+    flags = 0x04 if extra else 0
+    hdr = struct.pack('<BBBBIBB', 0x1f, 0x8b, 8, flags, 0, 0, 3)
+    if extra:
+        hdr += struct.pack('<H', len(extra)) + extra
+    return hdr
+
+
+def compress_member(data, level):
+    c = zlib.compressobj(level, zlib.DEFLATED, -zlib.MAX_WBITS)
+    deflate = c.compress(data) + c.flush()
+    return deflate + struct.pack('<II', zlib.crc32(data), len(data) & 0xffffffff)
+
+
+def compress_indexed(data, chunk_size, level):
+    chunks = [data[i:i + chunk_size] for i in range(0, len(data), chunk_size)] or [b'']
+    members = [compress_member(chunk, level) for chunk in chunks]
+
+    # "LK" subfield: member count, then compressed/decompressed size of each
+    index_len = 4 + 8 * len(members)
+    if 4 + index_len > 0xffff:
+        raise ValueError("too many members, use a larger chunk size")
+    first_hdr_len = len(gzip_header(b'\0' * (4 + index_len)))
+
+    index = struct.pack('<I', len(members))
+    for i, (chunk, member) in enumerate(zip(chunks, members)):
+        hdr_len = first_hdr_len if i == 0 else len(gzip_header())
+        index += struct.pack('<II', hdr_len + len(member), len(chunk))
+
+    extra = b'LK' + struct.pack('<H', index_len) + index
+    out = gzip_header(extra) + members[0]
+    for member in members[1:]:
+        out += gzip_header() + member
+    return out
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__)
+    parser.add_argument('input', type=argparse.FileType('rb'))
+    parser.add_argument('output', type=argparse.FileType('wb'))
+    parser.add_argument('-s', '--chunk-size', type=int, default=DEFAULT_CHUNK_SIZE,
+                        help="uncompressed size of each member (default: 1 MiB)")
+    parser.add_argument('-l', '--level', type=int, default=9)
+    args = parser.parse_args()
+
+    if args.chunk_size <= 0 or args.chunk_size % 64:
+        parser.error("chunk size must be a multiple of 64")
+
+    args.output.write(compress_indexed(args.input.read(), args.chunk_size, args.level))
+
+
+if __name__ == '__main__':
+    main()
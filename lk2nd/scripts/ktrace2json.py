@@ -0,0 +1,105 @@
+#!/usr/bin/env python3
+# SPDX-License-Identifier: BSD-3-Clause
+"""
+Convert a trace from "fastboot oem trace" to the JSON trace event format,
+which can be opened with https://ui.perfetto.dev or chrome://tracing.
+
+  fastboot oem trace && fastboot get_staged trace.bin
+  lk2nd/scripts/ktrace2json.py trace.bin trace.json
+"""
+import argparse
+import json
+import struct
+
+KTRACE_MAGIC = 0x5452544b
+HEADER = struct.Struct('<5I')
+ENTRY = struct.Struct('<Q6I')
+THREAD = struct.Struct('<I32s')
+
+(THREAD_SWITCH, IRQ_ENTER, IRQ_EXIT, EVENT_WAIT, EVENT_SIGNAL, MUTEX_WAIT,
+ MMC_CMD_START, MMC_CMD_END, USB_DONE, FS_READ_START, FS_READ_END) = range(11)
+
+# Pseudo threads for events that do not belong to a specific thread
+TID_IRQ, TID_MMC, TID_USB, TID_FS = 1, 2, 3, 4
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__,
+                                     formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument('trace', help='binary trace from "oem trace"')
+    parser.add_argument('output', help='JSON output file')
+    args = parser.parse_args()
+
+    with open(args.trace, 'rb') as f:
+        data = f.read()
+
+    magic, version, tick_rate, num_entries, num_threads = HEADER.unpack_from(data)
+    if magic != KTRACE_MAGIC or version != 1:
+        raise SystemExit('not a supported trace file')
+
+    off = HEADER.size
+    entries = [ENTRY.unpack_from(data, off + i * ENTRY.size) for i in range(num_entries)]
+    off += num_entries * ENTRY.size
+
+    names = {TID_IRQ: 'IRQ', TID_MMC: 'MMC', TID_USB: 'USB', TID_FS: 'FS'}
+    for i in range(num_threads):
+        thread, name = THREAD.unpack_from(data, off + i * THREAD.size)
+        names[thread] = name.split(b'\0')[0].decode(errors='replace')
+
+    events = []
+    open_slices = {}
+
+    def us(ts):
+        return (ts - entries[0][0]) * 1e6 / tick_rate
+
+    def begin(tid, ts, name, **a):
+        # Close slices that did not end properly (e.g. error paths)
+        if tid in open_slices:
+            end(tid, ts)
+        open_slices[tid] = name
+        events.append({'ph': 'B', 'pid': 0, 'tid': tid, 'ts': us(ts), 'name': name, 'args': a})
+
+    def end(tid, ts, **a):
+        if open_slices.pop(tid, None) is not None:
+            events.append({'ph': 'E', 'pid': 0, 'tid': tid, 'ts': us(ts), 'args': a})
+
+    def instant(tid, ts, name, **a):
+        events.append({'ph': 'i', 's': 't', 'pid': 0, 'tid': tid, 'ts': us(ts),
+                       'name': name, 'args': a})
+
+    for ts, etype, thread, a, b, c, _ in entries:
+        if etype == THREAD_SWITCH:
+            end(a, ts)
+            begin(b, ts, 'running')
+        elif etype == IRQ_ENTER:
+            begin(TID_IRQ, ts, f'irq {a}')
+        elif etype == IRQ_EXIT:
+            end(TID_IRQ, ts)
+        elif etype == EVENT_WAIT:
+            instant(thread, ts, 'event_wait', event=hex(a))
+        elif etype == EVENT_SIGNAL:
+            instant(thread, ts, 'event_signal', event=hex(a))
+        elif etype == MUTEX_WAIT:
+            instant(thread, ts, 'mutex_wait', mutex=hex(a))
+        elif etype == MMC_CMD_START:
+            begin(TID_MMC, ts, f'CMD{a}', arg=hex(b), blocks=c)
+        elif etype == MMC_CMD_END:
+            end(TID_MMC, ts, error=b)
+        elif etype == USB_DONE:
+            instant(TID_USB, ts, 'usb_done', req=hex(a), actual=b,
+                    status=struct.unpack('<i', struct.pack('<I', c))[0])
+        elif etype == FS_READ_START:
+            begin(TID_FS, ts, 'fs_read', offset=a, len=b)
+        elif etype == FS_READ_END:
+            end(TID_FS, ts, ret=struct.unpack('<i', struct.pack('<I', a))[0])
+
+    for tid, name in names.items():
+        events.append({'ph': 'M', 'pid': 0, 'tid': tid, 'name': 'thread_name',
+                       'args': {'name': name}})
+
+    with open(args.output, 'w') as f:
+        json.dump({'traceEvents': events, 'displayTimeUnit': 'ns'}, f)
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,85 @@
+#!/usr/bin/env python3
+# SPDX-License-Identifier: BSD-3-Clause
+"""
+Symbolize a histogram from "fastboot oem profile dump" against the LK ELF.
+
+  fastboot oem profile start [hz]
+  <do something>
+  fastboot oem profile stop
+  fastboot oem profile dump
+  fastboot get_staged profile.txt
+  lk2nd/scripts/profile-symbolize.py build-lk2nd-msm8916/lk profile.txt
+
+The histogram has one "<pc> <count>" line per sampled address.
+"""
+import argparse
+import bisect
+import os
+import subprocess
+from collections import Counter
+
+
+def read_symbols(nm, elf):
+    """Return sorted (address, name) pairs of all function symbols."""
+    out = subprocess.run([nm, '-n', '-C', elf], check=True,
+                         capture_output=True, text=True).stdout
+    syms = []
+    for line in out.splitlines():
+        fields = line.split(maxsplit=2)
+        if len(fields) == 3 and fields[1] in 'tTwW':
+            syms.append((int(fields[0], 16), fields[2]))
+    return syms
+
+
+def read_histogram(path):
+    hist = Counter()
+    with open(path) as f:
+        for line in f:
+            fields = line.split()
+            if len(fields) == 2:
+                hist[int(fields[0], 16)] += int(fields[1])
+    return hist
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__,
+                                     formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument('elf', help='LK ELF file (build-*/lk)')
+    parser.add_argument('histogram', help='histogram from "oem profile dump"')
+    parser.add_argument('-n', '--limit', type=int, default=30,
+                        help='number of entries to show (default: 30)')
+    parser.add_argument('-l', '--lines', action='store_true',
+                        help='show the hottest source lines instead of functions')
+    args = parser.parse_args()
+
+    cross = os.environ.get('CROSS_COMPILE', 'arm-none-eabi-')
+    hist = read_histogram(args.histogram)
+    total = sum(hist.values())
+    if not total:
+        return
+
+    if args.lines:
+        pcs = [pc for pc, _ in hist.most_common(args.limit)]
+        out = subprocess.run([cross + 'addr2line', '-f', '-C', '-e', args.elf] +
+                             [hex(pc) for pc in pcs], check=True,
+                             capture_output=True, text=True).stdout.splitlines()
+        for i, pc in enumerate(pcs):
+            func, line = out[2 * i], out[2 * i + 1]
+            print(f'{100 * hist[pc] / total:6.2f}% {hist[pc]:8} {pc:#010x} '
+                  f'{func} ({line})')
+        return
+
+    syms = read_symbols(cross + 'nm', args.elf)
+    addrs = [addr for addr, _ in syms]
+    funcs = Counter()
+    for pc, count in hist.items():
+        i = bisect.bisect_right(addrs, pc) - 1
+        funcs[syms[i][1] if i >= 0 else f'{pc:#010x}'] += count
+
+    print(f'{total} samples')
+    for name, count in funcs.most_common(args.limit):
+        print(f'{100 * count / total:6.2f}% {count:8} {name}')
+
+
+if __name__ == '__main__':
+    main()
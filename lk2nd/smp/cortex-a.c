@@ -109,46 +109,42 @@ static void power_on_l2_cache(uint32_t base)
 	exit_critical_section();
 }
 
-void cpu_boot_cortex_a(uint32_t base, uint32_t apcs_base)
+void cpu_boot_cortex_a(const struct cpu_boot_batch *batch)
 {
 	uint32_t pwr_ctl;
+	unsigned int i;
 
-	if (apcs_base)
-		power_on_l2_cache(apcs_base);
+	/* Only powers on the L2 cache once per cluster, it is skipped otherwise */
+	for (i = 0; i < batch->count; i++)
+		if (batch->extra_reg[i])
+			power_on_l2_cache(batch->extra_reg[i]);
 
 	enter_critical_section();
 
 	pwr_ctl = CPU_PWR_CTL_CLAMP | CPU_PWR_CTL_CORE_MEM_CLAMP |
 		  CPU_PWR_CTL_CORE_RST | CPU_PWR_CTL_COREPOR_RST;
-	writel(pwr_ctl, base + CPU_PWR_CTL);
-	dsb();
+	cpu_boot_writel_all(batch, pwr_ctl, CPU_PWR_CTL);
 
-	writel(APC_PWR_GATE_CTL_GHDS_EN | APC_PWR_GATE_CTL_GHDS_CNT(16),
-	       base + APC_PWR_GATE_CTL);
-	dsb();
+	cpu_boot_writel_all(batch, APC_PWR_GATE_CTL_GHDS_EN | APC_PWR_GATE_CTL_GHDS_CNT(16),
+			    APC_PWR_GATE_CTL);
 	udelay(2);
 
 	pwr_ctl &= ~CPU_PWR_CTL_CORE_MEM_CLAMP;
-	writel(pwr_ctl, base + CPU_PWR_CTL);
-	dsb();
+	cpu_boot_writel_all(batch, pwr_ctl, CPU_PWR_CTL);
 
 	pwr_ctl |= CPU_PWR_CTL_CORE_MEM_HS;
-	writel(pwr_ctl, base + CPU_PWR_CTL);
-	dsb();
+	cpu_boot_writel_all(batch, pwr_ctl, CPU_PWR_CTL);
 	udelay(2);
 
 	pwr_ctl &= ~CPU_PWR_CTL_CLAMP;
-	writel(pwr_ctl, base + CPU_PWR_CTL);
-	dsb();
+	cpu_boot_writel_all(batch, pwr_ctl, CPU_PWR_CTL);
 	udelay(2);
 
 	pwr_ctl &= ~(CPU_PWR_CTL_CORE_RST | CPU_PWR_CTL_COREPOR_RST);
-	writel(pwr_ctl, base + CPU_PWR_CTL);
-	dsb();
+	cpu_boot_writel_all(batch, pwr_ctl, CPU_PWR_CTL);
 
 	pwr_ctl |= CPU_PWR_CTL_CORE_PWRD_UP;
-	writel(pwr_ctl, base + CPU_PWR_CTL);
-	dsb();
+	cpu_boot_writel_all(batch, pwr_ctl, CPU_PWR_CTL);
 
 	exit_critical_section();
 }
@@ -1,9 +1,11 @@
 // SPDX-License-Identifier: BSD-3-Clause
 /* Copyright (c) 2021-2022, Stephan Gerhold <stephan@gerhold.net> */
 
+#include <arch/defines.h>
 #include <bits.h>
 #include <debug.h>
 #include <platform/timer.h>
+#include <reg.h>
 #include <scm.h>
 
 #include <libfdt.h>
@@ -65,9 +67,32 @@ static uint32_t read_phandle_reg(const void *dtb, int node, const char *prop)
 	return fdt32_to_cpu(*val);
 }
 
-bool cpu_boot(const void *dtb, int node, uint32_t mpidr)
+/* Write the same value to a register of all CPUs in the batch */
+void cpu_boot_writel_all(const struct cpu_boot_batch *batch,
+			 uint32_t val, uint32_t offset)
 {
-	uint32_t acc, extra_reg __UNUSED;
+	unsigned int i;
+
+	for (i = 0; i < batch->count; i++)
+		writel(val, batch->reg[i] + offset);
+	dsb();
+}
+
+/**
+ * cpu_boot_add() - Add a CPU to the batch of CPUs to power on.
+ * @batch: Batch the CPU is added to, powered on if it is already full
+ * @dtb: Device tree blob
+ * @node: Device tree node of the CPU
+ * @mpidr: MPIDR of the CPU
+ *
+ * The CPU only starts once the batch is passed to cpu_boot_batch().
+ *
+ * Return: false if the CPU cannot be booted, true otherwise.
+ */
+bool cpu_boot_add(struct cpu_boot_batch *batch, const void *dtb, int node,
+		  uint32_t mpidr)
+{
+	uint32_t acc, extra_reg = 0;
 
 	if (mpidr == read_mpidr()) {
 		dprintf(INFO, "Skipping boot of current CPU (%x)\n", mpidr);
@@ -79,8 +104,6 @@ bool cpu_boot(const void *dtb, int node, uint32_t mpidr)
 	if (!acc)
 		return false;
 
-	dprintf(INFO, "Booting CPU%x @ %#08x\n", mpidr, acc);
-
 #if CPU_BOOT_CORTEX_A
 	/*
 	 * The CPU clock happens to point to the "APCS" node that also controls
@@ -89,12 +112,10 @@ bool cpu_boot(const void *dtb, int node, uint32_t mpidr)
 	 * already be powered on and active.
 	 */
 	extra_reg = read_phandle_reg(dtb, node, "clocks");
-	cpu_boot_cortex_a(acc, extra_reg);
 #elif CPU_BOOT_KPSSV1
 	extra_reg = read_phandle_reg(dtb, node, "qcom,saw");
 	if (!extra_reg)
 		return false;
-	cpu_boot_kpssv1(acc, extra_reg);
 #elif CPU_BOOT_KPSSV2
 	node = lkfdt_lookup_phandle(dtb, node, "next-level-cache");
 	if (node < 0) {
@@ -104,12 +125,39 @@ bool cpu_boot(const void *dtb, int node, uint32_t mpidr)
 	extra_reg = read_phandle_reg(dtb, node, "qcom,saw");
 	if (!extra_reg)
 		return false;
-	cpu_boot_kpssv2(acc, extra_reg);
 #else
 #error Unsupported CPU boot method!
 #endif
 
-	/* Give CPU some time to boot */
-	udelay(100);
+	dprintf(INFO, "Booting CPU%x @ %#08x\n", mpidr, acc);
+
+	if (batch->count == CPU_BOOT_BATCH_MAX)
+		cpu_boot_batch(batch);
+
+	batch->reg[batch->count] = acc;
+	batch->extra_reg[batch->count] = extra_reg;
+	batch->count++;
 	return true;
 }
+
+/**
+ * cpu_boot_batch() - Power on all CPUs added to the batch.
+ * @batch: Batch of CPUs, empty afterwards
+ */
+void cpu_boot_batch(struct cpu_boot_batch *batch)
+{
+	if (!batch->count)
+		return;
+
+#if CPU_BOOT_CORTEX_A
+	cpu_boot_cortex_a(batch);
+#elif CPU_BOOT_KPSSV1
+	cpu_boot_kpssv1(batch);
+#elif CPU_BOOT_KPSSV2
+	cpu_boot_kpssv2(batch);
+#endif
+
+	/* Give CPUs some time to boot */
+	udelay(100);
+	batch->count = 0;
+}
@@ -2,11 +2,29 @@
 #ifndef LK2ND_SMP_CPU_BOOT_H
 #define LK2ND_SMP_CPU_BOOT_H
 
+#define CPU_BOOT_BATCH_MAX	8
+
+/*
+ * CPUs that are powered on together. Each step of the power-on sequence is
+ * done for all of them before waiting, so the delays are only needed once.
+ */
+struct cpu_boot_batch {
+	unsigned int count;
+	uint32_t reg[CPU_BOOT_BATCH_MAX];
+	uint32_t extra_reg[CPU_BOOT_BATCH_MAX];
+};
+
 int cpu_boot_set_addr(uintptr_t addr, bool arm64);
 
-bool cpu_boot(const void *dtb, int node, uint32_t mpidr);
-void cpu_boot_cortex_a(uint32_t base, uint32_t apcs_base);
-void cpu_boot_kpssv1(uint32_t reg, uint32_t saw_reg);
-void cpu_boot_kpssv2(uint32_t reg, uint32_t l2_saw_base);
+bool cpu_boot_add(struct cpu_boot_batch *batch, const void *dtb, int node,
+		  uint32_t mpidr);
+void cpu_boot_batch(struct cpu_boot_batch *batch);
+
+void cpu_boot_cortex_a(const struct cpu_boot_batch *batch);
+void cpu_boot_kpssv1(const struct cpu_boot_batch *batch);
+void cpu_boot_kpssv2(const struct cpu_boot_batch *batch);
+
+void cpu_boot_writel_all(const struct cpu_boot_batch *batch,
+			 uint32_t val, uint32_t offset);
 
 #endif /* LK2ND_SMP_CPU_BOOT_H */
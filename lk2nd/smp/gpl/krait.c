@@ -37,94 +37,87 @@
 #define APCS_SAW2_VCTL			0x14	/* kpssv1 */
 #define APCS_SAW2_2_VCTL		0x1c	/* kpssv2 */
 
-void cpu_boot_kpssv1(uint32_t reg, uint32_t saw_reg)
+void cpu_boot_kpssv1(const struct cpu_boot_batch *batch)
 {
 	uint32_t val;
+	unsigned int i;
 
 	enter_critical_section();
 
 	/* Turn on CPU rail */
-	writel(0xA4, saw_reg + APCS_SAW2_VCTL);
+	for (i = 0; i < batch->count; i++)
+		writel(0xA4, batch->extra_reg[i] + APCS_SAW2_VCTL);
 	dsb();
 	udelay(512);
 
 	/* Krait bring-up sequence */
 	val = CPU_PWR_CTL_PLL_CLAMP | CPU_PWR_CTL_L2DT_SLP | CPU_PWR_CTL_CLAMP;
-	writel(val, reg + CPU_PWR_CTL);
+	cpu_boot_writel_all(batch, val, CPU_PWR_CTL);
 	val &= ~CPU_PWR_CTL_L2DT_SLP;
-	writel(val, reg + CPU_PWR_CTL);
-	dsb();
+	cpu_boot_writel_all(batch, val, CPU_PWR_CTL);
 	udelay(1); /* ndelay(300); */
 
 	val |= CPU_PWR_CTL_COREPOR_RST;
-	writel(val, reg + CPU_PWR_CTL);
-	dsb();
+	cpu_boot_writel_all(batch, val, CPU_PWR_CTL);
 	udelay(2);
 
 	val &= ~CPU_PWR_CTL_CLAMP;
-	writel(val, reg + CPU_PWR_CTL);
-	dsb();
+	cpu_boot_writel_all(batch, val, CPU_PWR_CTL);
 	udelay(2);
 
 	val &= ~CPU_PWR_CTL_COREPOR_RST;
-	writel(val, reg + CPU_PWR_CTL);
-	dsb();
+	cpu_boot_writel_all(batch, val, CPU_PWR_CTL);
 	udelay(100);
 
 	val |= CPU_PWR_CTL_CORE_PWRD_UP;
-	writel(val, reg + CPU_PWR_CTL);
-	dsb();
+	cpu_boot_writel_all(batch, val, CPU_PWR_CTL);
 
 	exit_critical_section();
 }
 
-void cpu_boot_kpssv2(uint32_t reg, uint32_t l2_saw_base)
+void cpu_boot_kpssv2(const struct cpu_boot_batch *batch)
 {
 	uint32_t reg_val;
+	unsigned int i;
 
 	enter_critical_section();
 
 	/* Turn on the BHS, turn off LDO Bypass and power down LDO */
 	reg_val = APC_PWR_GATE_CTL_BHS_EN | APC_PWR_GATE_CTL_LDO_PWR_DWN |
 		  APC_PWR_GATE_CTL_BHS_CNT(64);
-	writel(reg_val, reg + APC_PWR_GATE_CTL);
-	dsb();
+	cpu_boot_writel_all(batch, reg_val, APC_PWR_GATE_CTL);
 	/* wait for the BHS to settle */
 	udelay(1);
 
 	/* Turn on BHS segments */
 	reg_val |= APC_PWR_GATE_CTL_BHS_SEG;
-	writel(reg_val, reg + APC_PWR_GATE_CTL);
-	dsb();
+	cpu_boot_writel_all(batch, reg_val, APC_PWR_GATE_CTL);
 	/* wait for the BHS to settle */
 	udelay(1);
 
 	/* Finally turn on the bypass so that BHS supplies power */
 	reg_val |= APC_PWR_GATE_CTL_LDO_BYP;
-	writel(reg_val, reg + APC_PWR_GATE_CTL);
+	cpu_boot_writel_all(batch, reg_val, APC_PWR_GATE_CTL);
 
-	/* enable max phases */
-	writel(0x10003, l2_saw_base + APCS_SAW2_2_VCTL);
+	/* enable max phases (the L2 SAW is shared, so usually the same) */
+	for (i = 0; i < batch->count; i++)
+		writel(0x10003, batch->extra_reg[i] + APCS_SAW2_2_VCTL);
 	dsb();
 	udelay(50);
 
 	reg_val = CPU_PWR_CTL_COREPOR_RST | CPU_PWR_CTL_CLAMP;
-	writel(reg_val, reg + CPU_PWR_CTL);
-	dsb();
+	cpu_boot_writel_all(batch, reg_val, CPU_PWR_CTL);
 	udelay(2);
 
 	reg_val &= ~CPU_PWR_CTL_CLAMP;
-	writel(reg_val, reg + CPU_PWR_CTL);
-	dsb();
+	cpu_boot_writel_all(batch, reg_val, CPU_PWR_CTL);
 	udelay(2);
 
 	reg_val &= ~CPU_PWR_CTL_COREPOR_RST;
-	writel(reg_val, reg + CPU_PWR_CTL);
-	dsb();
+	cpu_boot_writel_all(batch, reg_val, CPU_PWR_CTL);
 
 	reg_val |= CPU_PWR_CTL_CORE_PWRD_UP;
-	writel(reg_val, reg + CPU_PWR_CTL);
-	dsb();
+	cpu_boot_writel_all(batch, reg_val, CPU_PWR_CTL);
 
 	exit_critical_section();
 }
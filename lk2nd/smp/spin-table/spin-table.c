@@ -134,7 +134,8 @@ static struct smp_spin_table *map_reserved_table(const void *dtb)
 	return (struct smp_spin_table *)addr;
 }
 
-static void boot_and_setup_cpu(void *dtb, int cpu, int cpus, struct smp_spin_table *smp)
+static void boot_and_setup_cpu(void *dtb, int cpu, int cpus, struct smp_spin_table *smp,
+			       struct cpu_boot_batch *batch)
 {
 	int ret, node;
 	uint32_t mpidr;
@@ -158,7 +159,7 @@ static void boot_and_setup_cpu(void *dtb, int cpu, int cpus, struct smp_spin_tab
 		return;
 	}
 
-	if (!cpu_boot(dtb, cpu, mpidr))
+	if (!cpu_boot_add(batch, dtb, cpu, mpidr))
 		return;
 
 	/* Enable the SAW/SPM node for CPU idle functionality */
@@ -179,6 +180,13 @@ static void setup_idle_states(void *dtb, int node)
 {
 	int ret, state_node;
 
+	/*
+	 * There is no way to keep "psci" here: lk2nd runs in the normal world
+	 * below TZ (and usually hyp), so it cannot stay resident to handle the
+	 * SMC/HVC calls itself. Instead, standalone power collapse is handled
+	 * by the SPM cpuidle driver, which talks to TZ through SCM directly.
+	 */
+
 	/* Keep device tree as-is if entry-method is not "psci" */
 	if (lkfdt_prop_strneq(dtb, node, "entry-method", "psci"))
 		return;
@@ -205,6 +213,7 @@ static void setup_idle_states(void *dtb, int node)
 static int lk2nd_smp_spin_table_setup(void *dtb, const char *cmdline,
 				      enum boot_type boot_type)
 {
+	struct cpu_boot_batch batch = {0};
 	struct smp_spin_table *smp;
 	int cpus, ret, node;
 
@@ -247,13 +256,19 @@ static int lk2nd_smp_spin_table_setup(void *dtb, const char *cmdline,
 	smp->magic = SMP_SPIN_TABLE_MAGIC;
 	fdt_for_each_subnode(node, dtb, cpus) {
 		const char *name = fdt_get_name(dtb, node, &ret);
-		if (!name)
+		if (!name) {
+			cpu_boot_batch(&batch);
 			return ret;
+		}
 		if (strncmp(name, "cpu@", strlen("cpu@")) == 0)
-			boot_and_setup_cpu(dtb, node, cpus, smp);
+			boot_and_setup_cpu(dtb, node, cpus, smp, &batch);
 		if (strcmp(name, "idle-states") == 0)
 			setup_idle_states(dtb, node);
 	}
+
+	/* Power on all CPUs together to wait only once */
+	cpu_boot_batch(&batch);
+
 	if (node < 0 && node != -FDT_ERR_NOTFOUND) {
 		dprintf(CRITICAL, "Failed to read /cpus subnodes: %d\n", node);
 		return node;
@@ -0,0 +1,11 @@
+# SPDX-License-Identifier: BSD-3-Clause
+LOCAL_DIR := $(GET_LOCAL_DIR)
+
+ifneq ($(filter CPU_BOOT_CORTEX_A=1,$(DEFINES)),)
+OBJS += \
+	$(LOCAL_DIR)/entry.o \
+	$(LOCAL_DIR)/worker.o \
+
+else
+$(error SMP workers are not supported on $(PLATFORM))
+endif
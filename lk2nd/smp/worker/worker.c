@@ -0,0 +1,370 @@
+// SPDX-License-Identifier: BSD-3-Clause
+
+#include <arch/defines.h>
+#include <arch/ops.h>
+#include <bits.h>
+#include <debug.h>
+#include <kernel/event.h>
+#include <kernel/thread.h>
+#include <libfdt.h>
+#include <platform.h>
+#include <platform/interrupts.h>
+#include <platform/timer.h>
+#include <qgic.h>
+#include <scm.h>
+#include <string.h>
+
+#include <lk2nd/smp-worker.h>
+#include <lk2nd/util/lkfdt.h>
+#include <lk2nd/util/psci.h>
+
+#include "../cpu-boot.h"
+#include "../../device/device.h"
+#include "worker.h"
+
+/*
+ * worker.c - Run pure computation on the secondary CPU cores.
+ *
+ * LK only runs on the boot CPU. The secondary cores are brought up into a
+ * small loop that waits for a job in their mailbox, runs it and signals
+ * completion. The memory mappings are shared with the boot CPU but the
+ * caches are not coherent (all memory is mapped non-shareable), so both
+ * sides explicitly write back or invalidate everything they hand over.
+ *
+ * Completed jobs are signalled to the boot CPU with an SGI, so threads
+ * waiting for them can block instead of polling.
+ *
+ * Before booting the kernel the cores write back their caches and wait
+ * until they are reset again by the spin table or the kernel.
+ */
+
+#define SMP_WORKER_BOOT_TIMEOUT	10 /* ms */
+#define SMP_WORKER_WAIT_TIMEOUT	10 /* ms, in case an SGI is missed */
+
+/* Written only by the boot CPU */
+struct smp_worker_mbox {
+	struct lk2nd_smp_job *job;
+	uint32_t seq;
+	bool park;
+} __ALIGNED(CACHE_LINE);
+
+/* Written only by the worker */
+struct smp_worker_status {
+	volatile uint32_t state;
+} __ALIGNED(CACHE_LINE);
+
+struct smp_worker_boot smp_worker_boot __ALIGNED(CACHE_LINE);
+uint8_t smp_worker_stacks[SMP_WORKER_MAX_CPUS][SMP_WORKER_STACK_SIZE] __ALIGNED(8);
+
+static struct smp_worker_mbox mbox[SMP_WORKER_MAX_CPUS];
+static struct smp_worker_status status[SMP_WORKER_MAX_CPUS];
+static struct lk2nd_smp_job *busy[SMP_WORKER_MAX_CPUS];
+static bool online[SMP_WORKER_MAX_CPUS];
+static unsigned int num_online;
+static bool started;
+static event_t job_done;
+
+#define sync_out(ptr)	arch_clean_invalidate_cache_range((addr_t)(ptr), sizeof(*(ptr)))
+#define sync_in(ptr)	arch_invalidate_cache_range((addr_t)(ptr), sizeof(*(ptr)))
+
+static inline void wfe(void)
+{
+	__asm__ volatile ("wfe" ::: "memory");
+}
+
+static inline void sev(void)
+{
+	__asm__ volatile ("dsb\n\tsev" ::: "memory");
+}
+
+static inline unsigned int mpidr_to_cpu(uint32_t mpidr)
+{
+	return (BITS_SHIFT(mpidr, 15, 8) << 2) | BITS_SHIFT(mpidr, 7, 0);
+}
+
+void smp_worker_main(unsigned int cpu)
+{
+	struct smp_worker_mbox *mb = &mbox[cpu];
+	struct smp_worker_status *st = &status[cpu];
+	struct lk2nd_smp_job *job;
+	uint32_t seq;
+
+	sync_in(mb);
+	sync_in(&smp_worker_boot);
+	seq = mb->seq;
+
+	st->state = SMP_WORKER_IDLE;
+	sync_out(st);
+	sev();
+
+	for (;;) {
+		wfe();
+		sync_in(mb);
+		if (mb->seq == seq)
+			continue;
+		seq = mb->seq;
+
+		if (mb->park)
+			smp_worker_park_cpu(&st->state);
+
+		job = mb->job;
+		sync_in(job);
+		arch_invalidate_cache_range((addr_t)job->in, job->in_len);
+
+		job->func(job);
+
+		arch_clean_invalidate_cache_range((addr_t)job->out, job->out_len);
+		job->done = 1;
+		sync_out(job);
+		sev();
+		qgic_send_sgi(SMP_WORKER_DONE_SGI, smp_worker_boot.gic_cpumask);
+	}
+}
+
+static enum handler_return smp_worker_done_irq(void *arg)
+{
+	event_signal(&job_done, false);
+	return INT_RESCHEDULE;
+}
+
+static uint32_t wait_state(unsigned int cpu, uint32_t state)
+{
+	time_t start = current_time();
+
+	do {
+		sync_in(&status[cpu]);
+		if (status[cpu].state == state)
+			break;
+		udelay(10);
+	} while (current_time() - start < SMP_WORKER_BOOT_TIMEOUT);
+
+	return status[cpu].state;
+}
+
+static void save_boot_state(void)
+{
+	struct smp_worker_boot *b = &smp_worker_boot;
+
+	__asm__ ("mrc p15, 0, %0, c2, c0, 0" : "=r" (b->ttbr0));
+	__asm__ ("mrc p15, 0, %0, c3, c0, 0" : "=r" (b->dacr));
+	__asm__ ("mrc p15, 0, %0, c12, c0, 0" : "=r" (b->vbar));
+	__asm__ ("mrc p15, 0, %0, c1, c0, 0" : "=r" (b->sctlr));
+	b->gic_cpumask = qgic_get_cpumask();
+	sync_out(b);
+}
+
+static void start_cpu(const void *dtb, int cpus, int node, uint32_t self,
+		      struct cpu_boot_batch *batch, bool *starting)
+{
+	unsigned int cpu;
+	uint32_t mpidr;
+
+	if (lkfdt_get_reg(dtb, cpus, node, &mpidr, NULL) < 0 || mpidr == self)
+		return;
+
+	cpu = mpidr_to_cpu(mpidr);
+	if (cpu >= SMP_WORKER_MAX_CPUS)
+		return;
+
+	status[cpu].state = SMP_WORKER_OFFLINE;
+	sync_out(&status[cpu]);
+	sync_out(&mbox[cpu]);
+
+	if (cpu_boot_add(batch, dtb, node, mpidr))
+		starting[cpu] = true;
+}
+
+static void wait_cpus_online(const bool *starting)
+{
+	unsigned int cpu;
+
+	for (cpu = 0; cpu < SMP_WORKER_MAX_CPUS; cpu++) {
+		if (!starting[cpu])
+			continue;
+
+		if (wait_state(cpu, SMP_WORKER_IDLE) != SMP_WORKER_IDLE) {
+			dprintf(CRITICAL, "SMP worker CPU%u did not come up\n", cpu);
+			continue;
+		}
+
+		online[cpu] = true;
+		num_online++;
+	}
+}
+
+/**
+ * lk2nd_smp_worker_start() - Bring up the secondary CPU cores as workers.
+ *
+ * This is done automatically for the first job. It is skipped if the
+ * firmware manages the CPUs itself (PSCI).
+ *
+ * Return: Number of available worker cores.
+ */
+unsigned int lk2nd_smp_worker_start(void)
+{
+	const void *dtb = lk2nd_dev.dtb;
+	bool starting[SMP_WORKER_MAX_CPUS] = {0};
+	struct cpu_boot_batch batch = {0};
+	uint32_t self;
+	int cpus, node, ret;
+
+	if (started)
+		return num_online;
+	started = true;
+
+	if (is_scm_armv8_support() && psci_version() != PSCI_RET_NOT_SUPPORTED)
+		return 0;
+
+	if (!dtb)
+		return 0;
+
+	cpus = fdt_path_offset(dtb, "/cpus");
+	if (cpus < 0) {
+		dprintf(INFO, "SMP workers: No /cpus node: %d\n", cpus);
+		return 0;
+	}
+
+	save_boot_state();
+	event_init(&job_done, false, 0);
+	register_int_handler(SMP_WORKER_DONE_SGI, smp_worker_done_irq, NULL);
+	unmask_interrupt(SMP_WORKER_DONE_SGI);
+
+	ret = cpu_boot_set_addr((uintptr_t)lk2nd_smp_worker_entry, false);
+	if (ret) {
+		dprintf(CRITICAL, "SMP workers: Failed to set CPU boot address: %d\n", ret);
+		return 0;
+	}
+
+	__asm__ ("mrc p15, 0, %0, c0, c0, 5" : "=r" (self));
+	self = BITS(self, 23, 0);
+
+	fdt_for_each_subnode(node, dtb, cpus) {
+		const char *name = fdt_get_name(dtb, node, NULL);
+		if (name && strncmp(name, "cpu@", strlen("cpu@")) == 0)
+			start_cpu(dtb, cpus, node, self, &batch, starting);
+	}
+
+	/* Power on all cores together, then wait for them to come up */
+	cpu_boot_batch(&batch);
+	wait_cpus_online(starting);
+
+	dprintf(INFO, "SMP workers: %u CPU cores online\n", num_online);
+	return num_online;
+}
+
+static int find_idle_cpu(void)
+{
+	int cpu;
+
+	for (cpu = 0; cpu < SMP_WORKER_MAX_CPUS; cpu++)
+		if (online[cpu] && !busy[cpu])
+			return cpu;
+	return -1;
+}
+
+/**
+ * lk2nd_smp_job_queue() - Run a job on a secondary CPU core.
+ * @job: Job to run, must stay valid until lk2nd_smp_job_wait()
+ *
+ * If no worker is available the job runs immediately on the boot CPU.
+ */
+void lk2nd_smp_job_queue(struct lk2nd_smp_job *job)
+{
+	struct smp_worker_mbox *mb;
+	int cpu = -1;
+
+	lk2nd_smp_worker_start();
+
+	if ((uintptr_t)job->out % CACHE_LINE == 0) {
+		enter_critical_section();
+		cpu = find_idle_cpu();
+		if (cpu >= 0)
+			busy[cpu] = job;
+		exit_critical_section();
+	}
+
+	job->cpu = cpu;
+	if (cpu < 0) {
+		job->func(job);
+		job->done = 1;
+		return;
+	}
+
+	job->done = 0;
+	sync_out(job);
+	arch_clean_invalidate_cache_range((addr_t)job->in, job->in_len);
+	arch_clean_invalidate_cache_range((addr_t)job->out, job->out_len);
+
+	mb = &mbox[cpu];
+	mb->job = job;
+	mb->seq++;
+	sync_out(mb);
+	sev();
+}
+
+/**
+ * lk2nd_smp_job_wait() - Wait until a queued job has completed.
+ * @job: Job passed to lk2nd_smp_job_queue()
+ */
+void lk2nd_smp_job_wait(struct lk2nd_smp_job *job)
+{
+	int cpu = job->cpu;
+
+	if (cpu < 0)
+		return;
+
+	for (;;) {
+		/* Block until the next SGI unless the caller must not be preempted */
+		bool block = !in_critical_section();
+
+		if (block)
+			event_unsignal(&job_done);
+
+		sync_in(job);
+		if (job->done)
+			break;
+
+		if (block)
+			event_wait_timeout(&job_done, SMP_WORKER_WAIT_TIMEOUT);
+		else
+			wfe();
+	}
+
+	arch_invalidate_cache_range((addr_t)job->out, job->out_len);
+	job->cpu = -1;
+
+	enter_critical_section();
+	busy[cpu] = NULL;
+	exit_critical_section();
+}
+
+/**
+ * lk2nd_smp_worker_park() - Stop the workers before booting the kernel.
+ *
+ * The cores write back their caches and wait for the next reset. The spin
+ * table (or the kernel) boots them again afterwards.
+ */
+void lk2nd_smp_worker_park(void)
+{
+	int cpu;
+
+	for (cpu = 0; cpu < SMP_WORKER_MAX_CPUS; cpu++) {
+		if (!online[cpu])
+			continue;
+
+		if (busy[cpu])
+			lk2nd_smp_job_wait(busy[cpu]);
+
+		mbox[cpu].job = NULL;
+		mbox[cpu].park = true;
+		mbox[cpu].seq++;
+		sync_out(&mbox[cpu]);
+		sev();
+
+		if (wait_state(cpu, SMP_WORKER_PARKED) != SMP_WORKER_PARKED)
+			dprintf(CRITICAL, "SMP worker CPU%d did not stop\n", cpu);
+
+		online[cpu] = false;
+		num_online--;
+	}
+}
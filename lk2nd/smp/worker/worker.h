@@ -0,0 +1,31 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+#ifndef LK2ND_SMP_WORKER_WORKER_H
+#define LK2ND_SMP_WORKER_WORKER_H
+
+#define SMP_WORKER_MAX_CPUS	8
+#define SMP_WORKER_STACK_SIZE	2048
+#define SMP_WORKER_DONE_SGI	14
+
+#define SMP_WORKER_OFFLINE	0
+#define SMP_WORKER_IDLE		1
+#define SMP_WORKER_PARKED	2
+
+#ifndef ASSEMBLY
+#include <compiler.h>
+#include <stdint.h>
+
+/* CPU state copied from the boot CPU, read with MMU and caches off */
+struct smp_worker_boot {
+	uint32_t ttbr0;
+	uint32_t dacr;
+	uint32_t vbar;
+	uint32_t sctlr;
+	uint32_t gic_cpumask;	/* GIC CPU interface of the boot CPU */
+};
+
+void lk2nd_smp_worker_entry(void);
+void smp_worker_main(unsigned int cpu) __NO_RETURN;
+void smp_worker_park_cpu(volatile uint32_t *state) __NO_RETURN;
+#endif
+
+#endif /* LK2ND_SMP_WORKER_WORKER_H */
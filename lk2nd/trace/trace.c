@@ -0,0 +1,142 @@
+// SPDX-License-Identifier: BSD-3-Clause
+
+#include <debug.h>
+#include <fastboot.h>
+#include <kernel/ktrace.h>
+#include <kernel/thread.h>
+#include <list.h>
+#include <qtimer.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <lk2nd/init.h>
+
+/*
+ * The trace is a ring buffer with fixed-size records. "oem trace" stages
+ * a header, the records (oldest first) and the names of all threads, which
+ * can be converted with lk2nd/scripts/ktrace2json.py for Perfetto or
+ * chrome://tracing.
+ */
+#define KTRACE_ENTRIES	16384
+#define KTRACE_MAGIC	0x5452544b /* KTRT */
+#define KTRACE_VERSION	1
+
+struct ktrace_entry {
+	uint64_t ts;
+	uint32_t type;
+	uint32_t thread;
+	uint32_t a, b, c;
+	uint32_t reserved;
+};
+
+struct ktrace_header {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t tick_rate;
+	uint32_t entries;
+	uint32_t threads;
+};
+
+struct ktrace_thread {
+	uint32_t thread;
+	char name[32];
+};
+
+static struct ktrace_entry *ktrace_buf;
+static unsigned int ktrace_pos;
+static bool ktrace_wrapped;
+static bool ktrace_enabled;
+
+void ktrace(enum ktrace_type type, uint32_t a, uint32_t b, uint32_t c)
+{
+	struct ktrace_entry *e;
+
+	if (!ktrace_enabled)
+		return;
+
+	enter_critical_section();
+	e = &ktrace_buf[ktrace_pos];
+	if (++ktrace_pos == KTRACE_ENTRIES) {
+		ktrace_pos = 0;
+		ktrace_wrapped = true;
+	}
+	exit_critical_section();
+
+	e->ts = qtimer_get_phy_timer_cnt();
+	e->type = type;
+	e->thread = (uintptr_t)current_thread;
+	e->a = a;
+	e->b = b;
+	e->c = c;
+}
+
+static void ktrace_init(void)
+{
+	ktrace_buf = calloc(KTRACE_ENTRIES, sizeof(*ktrace_buf));
+	if (!ktrace_buf) {
+		dprintf(CRITICAL, "ktrace: Failed to allocate trace buffer\n");
+		return;
+	}
+	ktrace_enabled = true;
+}
+LK2ND_INIT_PRIO(ktrace_init, LK2ND_INIT_PRIO_EARLY);
+
+static void cmd_oem_trace(const char *arg, void *data, unsigned sz)
+{
+	struct ktrace_header *hdr = data;
+	struct ktrace_entry *entries = (struct ktrace_entry *)(hdr + 1);
+	struct ktrace_thread *threads;
+	unsigned int count;
+	thread_t *t;
+	char *out;
+
+	if (!ktrace_buf) {
+		fastboot_fail("trace not available");
+		return;
+	}
+	if (*arg && strcmp(arg, "clear")) {
+		fastboot_fail("invalid argument");
+		return;
+	}
+
+	/* Stop tracing while copying, the ring would be overwritten otherwise */
+	ktrace_enabled = false;
+
+	if (ktrace_wrapped) {
+		count = KTRACE_ENTRIES;
+		memcpy(entries, &ktrace_buf[ktrace_pos],
+		       (KTRACE_ENTRIES - ktrace_pos) * sizeof(*entries));
+		memcpy(&entries[KTRACE_ENTRIES - ktrace_pos], ktrace_buf,
+		       ktrace_pos * sizeof(*entries));
+	} else {
+		count = ktrace_pos;
+		memcpy(entries, ktrace_buf, count * sizeof(*entries));
+	}
+
+	hdr->magic = KTRACE_MAGIC;
+	hdr->version = KTRACE_VERSION;
+	hdr->tick_rate = qtimer_tick_rate();
+	hdr->entries = count;
+	hdr->threads = 0;
+
+	threads = (struct ktrace_thread *)&entries[count];
+	enter_critical_section();
+	list_for_every_entry(&thread_list, t, thread_t, thread_list_node) {
+		threads[hdr->threads].thread = (uintptr_t)t;
+		strlcpy(threads[hdr->threads].name, t->name,
+			sizeof(threads[hdr->threads].name));
+		hdr->threads++;
+	}
+	exit_critical_section();
+	out = (char *)&threads[hdr->threads];
+
+	/* "oem trace clear" starts a new trace after fetching the current one */
+	if (*arg) {
+		ktrace_pos = 0;
+		ktrace_wrapped = false;
+	}
+	ktrace_enabled = true;
+
+	fastboot_stage(data, out - (char *)data);
+}
+FASTBOOT_REGISTER("oem trace", cmd_oem_trace);
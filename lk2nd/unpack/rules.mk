@@ -0,0 +1,53 @@
+# SPDX-License-Identifier: BSD-3-Clause
+#
+# Self-decompressing lk2nd: a small stub that decompresses the LZ4 compressed
+# lk.bin to MEMBASE is used as the "kernel" of the boot image. The stub is
+# linked on its own, so its objects are not added to OBJS.
+LOCAL_DIR := $(GET_LOCAL_DIR)
+
+UNPACK_DIR := $(BUILDDIR)/$(LOCAL_DIR)
+UNPACK_LDS := $(LOCAL_DIR)/unpack.ld
+UNPACK_LZ4 := $(UNPACK_DIR)/lk.bin.lz4
+UNPACK_OBJS := \
+	$(UNPACK_DIR)/start.o \
+	$(UNPACK_DIR)/unpack.o \
+	$(UNPACK_DIR)/lz4.o \
+
+# Keep GCC from turning the memcpy() loop into a call to memcpy()
+UNPACK_CFLAGS := $(CFLAGS) $(THUMBCFLAGS) --std=c99 -ffreestanding \
+	-fno-tree-loop-distribute-patterns
+
+OUTUNPACK := $(BUILDDIR)/lk2nd-unpack
+OUTBINLK2ND := $(OUTUNPACK).bin
+
+$(UNPACK_LZ4): $(OUTBIN)
+	@$(MKDIR)
+	@echo compressing: $@
+	$(NOECHO)lz4 -l -12 -f -q $< $@
+
+$(UNPACK_DIR)/start.o: $(LOCAL_DIR)/start.S $(UNPACK_LZ4) $(SRCDEPS)
+	@$(MKDIR)
+	@echo compiling $<
+	$(NOECHO)$(CC) $(CFLAGS) $(ASMFLAGS) $(INCLUDES) \
+		-DLK2ND_UNPACK_PAYLOAD=\"$(UNPACK_LZ4)\" -c $< -o $@
+
+$(UNPACK_DIR)/unpack.o: $(LOCAL_DIR)/unpack.c $(SRCDEPS)
+	@$(MKDIR)
+	@echo compiling $<
+	$(NOECHO)$(CC) $(UNPACK_CFLAGS) $(INCLUDES) -c $< -o $@
+
+$(UNPACK_DIR)/lz4.o: lib/lz4/lz4.c $(SRCDEPS)
+	@$(MKDIR)
+	@echo compiling $<
+	$(NOECHO)$(CC) $(UNPACK_CFLAGS) $(INCLUDES) -c $< -o $@
+
+$(OUTUNPACK): $(UNPACK_OBJS) $(UNPACK_LDS)
+	@echo linking $@
+	$(NOECHO)$(LD) -T $(UNPACK_LDS) $(UNPACK_OBJS) $(LIBGCC) -Map=$@.map -o $@
+
+$(OUTBINLK2ND): $(OUTUNPACK)
+	@echo generating image: $@
+	$(NOECHO)$(SIZE) $<
+	$(NOECHO)$(OBJCOPY) -O binary $< $@
+
+GENERATED += $(UNPACK_LZ4) $(UNPACK_OBJS) $(OUTUNPACK) $(OUTBINLK2ND)
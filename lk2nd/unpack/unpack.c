@@ -0,0 +1,41 @@
+// SPDX-License-Identifier: BSD-3-Clause
+
+#include <err.h>
+#include <lib/lz4.h>
+#include <stdint.h>
+#include <string.h>
+
+/*
+ * This is not part of lk2nd itself but of the small stub that decompresses
+ * it. It runs right after the previous bootloader, without MMU and at an
+ * unknown address, so it must not use any global data. Only lib/lz4 and the
+ * few functions below are linked into it.
+ */
+
+/* Keep some space at the top of the memory region for the stack */
+#define UNPACK_STACK_SIZE	4096
+
+int lk2nd_unpack(const void *in, size_t in_len);
+
+void *memcpy(void *dest, const void *src, size_t n)
+{
+	uint8_t *d = dest;
+	const uint8_t *s = src;
+
+	while (n--)
+		*d++ = *s++;
+
+	return dest;
+}
+
+int lk2nd_unpack(const void *in, size_t in_len)
+{
+	uintptr_t start = (uintptr_t)in;
+
+	/* The compressed data must stay intact while it is decompressed */
+	if (start < MEMBASE + MEMSIZE && start + in_len > MEMBASE)
+		return ERR_NOT_VALID;
+
+	return lz4_decompress(in, in_len, (void *)MEMBASE,
+			      MEMSIZE - UNPACK_STACK_SIZE, NULL, NULL);
+}
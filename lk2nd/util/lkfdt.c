@@ -2,6 +2,7 @@
 
 #if WITH_LIB_LIBFDT
 #include <libfdt.h>
+#include <stdlib.h>
 #include <lk2nd/util/lkfdt.h>
 
 int lkfdt_prop_strneq(const void *fdt, int node, const char *prop, const char *cmp)
@@ -101,6 +102,143 @@ int lkfdt_u32list_get(const void *fdt, int node, const char *prop,
 	return 0;
 }
 
+/*
+ * Index of all phandles in the tree, sorted by phandle. It is built on the
+ * first lookup and rebuilt when the tree seems to have been modified, i.e.
+ * the blob or the size of the structure or strings block changed. Every hit is checked
+ * against the tree, so stale offsets are never returned.
+ */
+struct lkfdt_phandle {
+	uint32_t phandle;
+	int node;
+	int parent;
+};
+
+static struct {
+	const void *fdt;
+	uint32_t size_dt_struct;
+	uint32_t size_dt_strings;
+	struct lkfdt_phandle *entries;
+	int count;
+} phandle_index;
+
+#define LKFDT_INDEX_MAX_DEPTH	32
+
+static int phandle_cmp(const void *a, const void *b)
+{
+	const struct lkfdt_phandle *pa = a, *pb = b;
+
+	if (pa->phandle == pb->phandle)
+		return 0;
+	return pa->phandle < pb->phandle ? -1 : 1;
+}
+
+void lkfdt_phandle_index_invalidate(void)
+{
+	free(phandle_index.entries);
+	phandle_index.fdt = NULL;
+	phandle_index.entries = NULL;
+	phandle_index.count = 0;
+}
+
+static bool phandle_index_build(const void *fdt)
+{
+	int parents[LKFDT_INDEX_MAX_DEPTH];
+	int node, depth = 0, count = 0, i = 0;
+	struct lkfdt_phandle *entries;
+	uint32_t phandle;
+	int j;
+
+	lkfdt_phandle_index_invalidate();
+
+	for (node = fdt_next_node(fdt, -1, &depth); node >= 0;
+	     node = fdt_next_node(fdt, node, &depth)) {
+		if (depth >= LKFDT_INDEX_MAX_DEPTH)
+			return false;
+		phandle = fdt_get_phandle(fdt, node);
+		if (phandle && phandle != ~0U)
+			count++;
+	}
+	if (node != -FDT_ERR_NOTFOUND)
+		return false;
+
+	entries = malloc((count ? count : 1) * sizeof(*entries));
+	if (!entries)
+		return false;
+
+	for (node = fdt_next_node(fdt, -1, &depth); node >= 0 && i < count;
+	     node = fdt_next_node(fdt, node, &depth)) {
+		parents[depth] = node;
+		phandle = fdt_get_phandle(fdt, node);
+		if (!phandle || phandle == ~0U)
+			continue;
+
+		/* dtc mostly allocates phandles in order, so this is cheap */
+		for (j = i; j > 0 && entries[j - 1].phandle > phandle; j--)
+			entries[j] = entries[j - 1];
+
+		entries[j].phandle = phandle;
+		entries[j].node = node;
+		entries[j].parent = depth ? parents[depth - 1] : -FDT_ERR_NOTFOUND;
+		i++;
+	}
+
+	phandle_index.fdt = fdt;
+	phandle_index.size_dt_struct = fdt_size_dt_struct(fdt);
+	phandle_index.size_dt_strings = fdt_size_dt_strings(fdt);
+	phandle_index.entries = entries;
+	phandle_index.count = count;
+	return true;
+}
+
+static const struct lkfdt_phandle *phandle_index_find(const void *fdt, uint32_t phandle)
+{
+	const struct lkfdt_phandle key = { .phandle = phandle };
+	const struct lkfdt_phandle *entry;
+	bool rebuilt = false;
+
+	if (phandle_index.fdt != fdt ||
+	    phandle_index.size_dt_struct != fdt_size_dt_struct(fdt) ||
+	    phandle_index.size_dt_strings != fdt_size_dt_strings(fdt)) {
+		if (!phandle_index_build(fdt))
+			return NULL;
+		rebuilt = true;
+	}
+
+	for (;;) {
+		entry = bsearch(&key, phandle_index.entries, phandle_index.count,
+				sizeof(key), phandle_cmp);
+		if (entry && fdt_get_phandle(fdt, entry->node) == phandle)
+			return entry;
+		if (!entry || rebuilt)
+			return NULL;
+
+		/* The tree was modified without changing its size */
+		if (!phandle_index_build(fdt))
+			return NULL;
+		rebuilt = true;
+	}
+}
+
+int lkfdt_node_offset_by_phandle(const void *fdt, uint32_t phandle)
+{
+	const struct lkfdt_phandle *entry;
+
+	if (phandle == 0 || phandle == ~0U)
+		return -FDT_ERR_BADPHANDLE;
+	if (fdt_check_header(fdt))
+		return fdt_node_offset_by_phandle(fdt, phandle);
+
+	entry = phandle_index_find(fdt, phandle);
+	if (entry)
+		return entry->node;
+	if (phandle_index.fdt == fdt)
+		return -FDT_ERR_NOTFOUND;
+
+	/* No index (e.g. out of memory), search the slow way */
+	return fdt_node_offset_by_phandle(fdt, phandle);
+}
+
 int lkfdt_lookup_phandle(const void *fdt, int node, const char *prop)
 {
 	uint32_t phandle;
@@ -110,13 +248,22 @@ int lkfdt_lookup_phandle(const void *fdt, int node, const char *prop)
 	if (ret < 0)
 		return ret;
 
-	return fdt_node_offset_by_phandle(fdt, phandle);
+	return lkfdt_node_offset_by_phandle(fdt, phandle);
 }
 
 int lkfdt_subnode_offset_by_phandle(const void *fdt, int parent, uint32_t phandle)
 {
+	const struct lkfdt_phandle *entry;
 	int node;
 
+	if (phandle && phandle != ~0U && !fdt_check_header(fdt)) {
+		entry = phandle_index_find(fdt, phandle);
+		if (entry)
+			return entry->parent == parent ? entry->node : -FDT_ERR_NOTFOUND;
+		if (phandle_index.fdt == fdt)
+			return -FDT_ERR_NOTFOUND;
+	}
+
 	fdt_for_each_subnode(node, fdt, parent) {
 		if (fdt_get_phandle(fdt, node) == phandle)
 			return node;
@@ -0,0 +1,97 @@
+// SPDX-License-Identifier: BSD-3-Clause
+
+#include <arch/defines.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <lk2nd/util/memcpy.h>
+
+/*
+ * memcpy.c - Large memory copies on the secondary CPU cores.
+ *
+ * None of the DMA engines in the supported SoCs is usable for plain memory
+ * copies here (ADM is only wired up for the old SD controllers, BAM pipes
+ * always belong to a peripheral), but the secondary CPU cores are idle while
+ * lk2nd is running. A single core does not come close to the bandwidth of
+ * the memory, so copies are split into pieces that run on the SMP workers.
+ * The workers write back whole cache lines of the destination, so only the
+ * cache line aligned middle part is handed over, the unaligned ends are
+ * copied by the boot CPU. Without SMP workers everything ends up in memmove().
+ */
+
+/* Smaller copies are not worth the cache maintenance */
+#define LK2ND_MEMCPY_MIN	(256 * 1024)
+
+static void memcpy_job(struct lk2nd_smp_job *job)
+{
+	memcpy(job->out, job->in, job->out_len);
+	job->in_used = job->out_used = job->out_len;
+	job->ret = 0;
+}
+
+/*
+ * Queue the pieces of the copy on the workers, leaving one share for the boot
+ * CPU if @self is set. Returns the offset of the part that is left for the
+ * boot CPU, which is @len if the copy was done immediately.
+ */
+static size_t memcpy_queue(struct lk2nd_memcpy *c, void *dst, const void *src,
+			   size_t len, bool self)
+{
+	uintptr_t d = (uintptr_t)dst, s = (uintptr_t)src;
+	struct lk2nd_smp_job *job;
+	size_t head, tail, piece, off;
+	unsigned int n;
+
+	c->njobs = 0;
+	n = lk2nd_smp_worker_start();
+	if (!n || len < LK2ND_MEMCPY_MIN || (d < s + len && s < d + len)) {
+		memmove(dst, src, len);
+		return len;
+	}
+	n = MIN(n, LK2ND_MEMCPY_MAX_JOBS);
+
+	head = ROUNDUP(d, CACHE_LINE) - d;
+	tail = (d + len) % CACHE_LINE;
+	memcpy(dst, src, head);
+	memcpy((char *)dst + len - tail, (const char *)src + len - tail, tail);
+	len -= tail;
+
+	piece = ROUNDUP((len - head) / (n + self), CACHE_LINE);
+	for (off = head; c->njobs < n && off < len; off += job->out_len) {
+		job = &c->jobs[c->njobs++];
+		memset(job, 0, sizeof(*job));
+		job->func = memcpy_job;
+		job->in = (const char *)src + off;
+		job->out = (char *)dst + off;
+		job->in_len = job->out_len = MIN(piece, len - off);
+		lk2nd_smp_job_queue(job);
+	}
+
+	/* The tail is copied already */
+	return off + (off == len ? tail : 0);
+}
+
+void lk2nd_memcpy_async(struct lk2nd_memcpy *c, void *dst, const void *src, size_t len)
+{
+	memcpy_queue(c, dst, src, len, false);
+}
+
+void lk2nd_memcpy_wait(struct lk2nd_memcpy *c)
+{
+	unsigned int i;
+
+	for (i = 0; i < c->njobs; i++)
+		lk2nd_smp_job_wait(&c->jobs[i]);
+	c->njobs = 0;
+}
+
+void lk2nd_memcpy(void *dst, const void *src, size_t len)
+{
+	struct lk2nd_memcpy c;
+	size_t off;
+
+	off = memcpy_queue(&c, dst, src, len, true);
+	if (off < len)
+		memcpy((char *)dst + off, (const char *)src + off, len - off);
+	lk2nd_memcpy_wait(&c);
+}
@@ -2,15 +2,19 @@
 /* Copyright (c) 2022, Stephan Gerhold <stephan@gerhold.net> */
 
 #include <debug.h>
+#include <libfdt.h>
+#include <smem.h>
 #include <arch/arm/mmu.h>
 
+#include <lk2nd/util/lkfdt.h>
 #include <lk2nd/util/mmu.h>
 
 /* Defined in aboot.c */
 extern int check_aboot_addr_range_overlap(uintptr_t start, uint32_t size);
 extern int check_ddr_addr_range_bound(uintptr_t start, uint32_t size);
 
-static const char *try_map(uintptr_t start, uint32_t size, uint flags1, uint flags2)
+static const char *try_map(uintptr_t start, uint32_t size, arm_mmu_flags_t flags1,
+			   arm_mmu_flags_t flags2)
 {
 	if (check_aboot_addr_range_overlap(start, size))
 		return "overlaps with aboot";
@@ -23,7 +27,7 @@ static const char *try_map(uintptr_t start, uint32_t size, uint flags1, uint fla
 }
 
 bool lk2nd_mmu_map_ram(const char *name, uintptr_t start, uint32_t size,
-		       uint flags1, uint flags2)
+		       arm_mmu_flags_t flags1, arm_mmu_flags_t flags2)
 {
 	const char *fail = try_map(start, size, flags1, flags2);
 	if (fail) {
@@ -41,6 +45,23 @@ bool lk2nd_mmu_map_ram_wt(const char *name, uintptr_t start, uint32_t size)
 				 MMU_MEMORY_AP_READ_WRITE | MMU_MEMORY_XN, 0);
 }
 
+bool lk2nd_mmu_map_ram_wc(const char *name, uintptr_t start, uint32_t size)
+{
+	arm_mmu_flags_t flags = MMU_MEMORY_TYPE_NORMAL_WRITE_COMBINE |
+		     MMU_MEMORY_AP_READ_WRITE | MMU_MEMORY_XN;
+
+	/* Existing mappings (e.g. from the platform) are changed if needed */
+	if (check_aboot_addr_range_overlap(start, size) ||
+	    check_ddr_addr_range_bound(start, size) ||
+	    (!arm_mmu_remap_sections(start, size, flags) &&
+	     !arm_mmu_try_map_sections(start, start, size, flags))) {
+		dprintf(INFO, "Cannot map %s memory @ %#08lx (size: %#x) write-combine\n",
+			name, start, size);
+		return false;
+	}
+	return true;
+}
+
 bool lk2nd_mmu_map_ram_dynamic(const char *name, uintptr_t start, uint32_t size)
 {
 	/*
@@ -57,3 +78,102 @@ bool lk2nd_mmu_map_ram_dynamic(const char *name, uintptr_t start, uint32_t size)
 				 MMU_MEMORY_TYPE_NORMAL_WRITE_BACK_ALLOCATE |
 				 MMU_MEMORY_AP_READ_WRITE | MMU_MEMORY_XN);
 }
+
+#define MAP_DDR_MAX_NOMAP	16
+#define MAP_DDR_SECTION		(1024 * 1024)
+
+struct nomap_range {
+	uint64_t start;
+	uint64_t end;
+};
+
+static unsigned int find_nomap(const void *dtb, struct nomap_range *nomap)
+{
+	unsigned int num = 0;
+	uint32_t addr, size;
+	int offset, node;
+
+	if (!dtb)
+		return 0;
+
+	offset = fdt_path_offset(dtb, "/reserved-memory");
+	if (offset < 0)
+		return 0;
+
+	fdt_for_each_subnode(node, dtb, offset) {
+		if (!fdt_getprop(dtb, node, "no-map", NULL))
+			continue;
+		if (lkfdt_get_reg(dtb, offset, node, &addr, &size) < 0 || !size)
+			continue;
+
+		if (num == MAP_DDR_MAX_NOMAP) {
+			dprintf(CRITICAL, "Too many no-map regions, not mapping DDR\n");
+			return UINT_MAX;
+		}
+
+		/* Leave out all sections that overlap the region */
+		nomap[num].start = ROUNDDOWN(addr, MAP_DDR_SECTION);
+		nomap[num].end = ROUNDUP((uint64_t)addr + size, (uint64_t)MAP_DDR_SECTION);
+		num++;
+	}
+
+	return num;
+}
+
+static bool is_nomap(const struct nomap_range *nomap, unsigned int num, uint64_t addr)
+{
+	unsigned int i;
+
+	for (i = 0; i < num; i++)
+		if (addr >= nomap[i].start && addr < nomap[i].end)
+			return true;
+	return false;
+}
+
+static void map_ddr_range(uint32_t start, uint32_t size)
+{
+	if (!size)
+		return;
+
+	dprintf(SPEW, "Mapping DDR @ %#08x (size: %#x)\n", start, size);
+	arm_mmu_map_free_sections(start, start, size,
+				  MMU_MEMORY_TYPE_NORMAL_WRITE_BACK_ALLOCATE |
+				  MMU_MEMORY_AP_READ_WRITE | MMU_MEMORY_XN);
+}
+
+void lk2nd_mmu_map_ddr(const void *dtb)
+{
+	struct nomap_range nomap[MAP_DDR_MAX_NOMAP];
+	unsigned int num_nomap;
+	uint32_t i, run_start = 0, run_size = 0;
+	uint64_t start, end;
+	ram_partition ptn;
+
+	num_nomap = find_nomap(dtb, nomap);
+	if (num_nomap == UINT_MAX || !smem_ram_ptable_init_v1())
+		return;
+
+	for (i = 0; i < smem_get_ram_ptable_len(); i++) {
+		smem_get_ram_ptable_entry(&ptn, i);
+		if (!smem_ram_ptn_is_ddr(&ptn))
+			continue;
+
+		start = ROUNDUP(ptn.start, (uint64_t)MAP_DDR_SECTION);
+		end = ROUNDDOWN(MIN(ptn.start + ptn.size, 0x100000000ULL), (uint64_t)MAP_DDR_SECTION);
+
+		for (; start < end; start += MAP_DDR_SECTION) {
+			if (is_nomap(nomap, num_nomap, start)) {
+				map_ddr_range(run_start, run_size);
+				run_size = 0;
+				continue;
+			}
+
+			if (!run_size)
+				run_start = start;
+			run_size += MAP_DDR_SECTION;
+		}
+
+		map_ddr_range(run_start, run_size);
+		run_size = 0;
+	}
+}
@@ -4,4 +4,6 @@ LOCAL_DIR := $(GET_LOCAL_DIR)
 OBJS += \
 	$(LOCAL_DIR)/cmdline.o \
 	$(LOCAL_DIR)/lkfdt.o \
+	$(LOCAL_DIR)/memcpy.o \
 	$(LOCAL_DIR)/mmu.o \
+	$(LOCAL_DIR)/scratch.o \
@@ -0,0 +1,243 @@
+// SPDX-License-Identifier: BSD-3-Clause
+
+#include <assert.h>
+#include <debug.h>
+#include <printf.h>
+#include <stdlib.h>
+#include <string.h>
+#include <target.h>
+#include <kernel/thread.h>
+
+#include <lk2nd/util/scratch.h>
+
+/*
+ * scratch.c - Named, non-overlapping ranges of the scratch area.
+ *
+ * There are only a handful of users at the same time, so the claimed ranges
+ * are kept unsorted in a small table. All operations are short and run in a
+ * critical section, so they can also be used from worker threads.
+ */
+
+#define SCRATCH_ALIGN		4096
+#define SCRATCH_MAX_RANGES	8
+
+struct scratch_range {
+	const char *name;
+	uintptr_t start;
+	uintptr_t end;
+};
+
+static struct scratch_range ranges[SCRATCH_MAX_RANGES];
+
+static void scratch_bounds(uintptr_t *start, uintptr_t *end)
+{
+	*start = ROUNDUP((uintptr_t)target_get_scratch_address(), SCRATCH_ALIGN);
+	*end = ROUNDDOWN((uintptr_t)target_get_scratch_address()
+			 + target_get_max_flash_size(), SCRATCH_ALIGN);
+}
+
+static struct scratch_range *scratch_overlap(uintptr_t start, uintptr_t end)
+{
+	unsigned int i;
+
+	for (i = 0; i < SCRATCH_MAX_RANGES; i++) {
+		if (ranges[i].name && start < ranges[i].end && ranges[i].start < end)
+			return &ranges[i];
+	}
+	return NULL;
+}
+
+static bool scratch_add(const char *name, uintptr_t start, uintptr_t end)
+{
+	unsigned int i;
+
+	for (i = 0; i < SCRATCH_MAX_RANGES; i++) {
+		if (!ranges[i].name) {
+			ranges[i].name = name;
+			ranges[i].start = start;
+			ranges[i].end = end;
+			return true;
+		}
+	}
+
+	dprintf(CRITICAL, "scratch: Too many ranges for '%s'\n", name);
+	return false;
+}
+
+/*
+ * Free space starting at @start, up to the next claimed range or the end of
+ * the scratch area. Returns 0 if @start itself is claimed.
+ */
+static size_t scratch_free_at(uintptr_t start, uintptr_t end)
+{
+	unsigned int i;
+
+	for (i = 0; i < SCRATCH_MAX_RANGES; i++) {
+		if (!ranges[i].name || ranges[i].end <= start)
+			continue;
+		if (ranges[i].start <= start)
+			return 0;
+		end = MIN(end, ranges[i].start);
+	}
+	return start < end ? end - start : 0;
+}
+
+struct scratch_free {
+	uintptr_t start;
+	size_t size;
+};
+
+/*
+ * Free ranges always start at the scratch start or at the end of a claimed
+ * range. Returns the number of them, in no particular order.
+ */
+static unsigned int scratch_free_ranges(struct scratch_free *avail)
+{
+	uintptr_t scratch, end;
+	unsigned int i, n = 0;
+
+	scratch_bounds(&scratch, &end);
+	avail[n].start = scratch;
+	avail[n].size = scratch_free_at(scratch, end);
+	if (avail[n].size)
+		n++;
+
+	for (i = 0; i < SCRATCH_MAX_RANGES; i++) {
+		if (!ranges[i].name)
+			continue;
+		avail[n].start = ranges[i].end;
+		avail[n].size = scratch_free_at(ranges[i].end, end);
+		if (avail[n].size)
+			n++;
+	}
+	return n;
+}
+
+bool lk2nd_scratch_claim(const char *name, void *ptr, size_t size)
+{
+	uintptr_t start = ROUNDDOWN((uintptr_t)ptr, SCRATCH_ALIGN);
+	uintptr_t end = ROUNDUP((uintptr_t)ptr + size, SCRATCH_ALIGN);
+	uintptr_t scratch, scratch_end;
+	struct scratch_range *r;
+	bool ret;
+
+	scratch_bounds(&scratch, &scratch_end);
+	if (!size || start < scratch || end > scratch_end || end < start) {
+		dprintf(CRITICAL, "scratch: '%s' %p + %#zx outside of scratch area\n",
+			name, ptr, size);
+		return false;
+	}
+
+	enter_critical_section();
+	r = scratch_overlap(start, end);
+	if (r && r->start == start && r->end == end && !strcmp(r->name, name))
+		ret = true;
+	else if (r)
+		ret = false;
+	else
+		ret = scratch_add(name, start, end);
+	exit_critical_section();
+
+	if (!ret && r)
+		dprintf(CRITICAL, "scratch: '%s' %p + %#zx overlaps with '%s' 0x%lx-0x%lx\n",
+			name, ptr, size, r->name, r->start, r->end);
+	return ret;
+}
+
+void *lk2nd_scratch_alloc(const char *name, size_t size)
+{
+	struct scratch_free avail[SCRATCH_MAX_RANGES + 1];
+	uintptr_t best = 0;
+	unsigned int i, n;
+
+	size = ROUNDUP(size, SCRATCH_ALIGN);
+
+	enter_critical_section();
+	n = scratch_free_ranges(avail);
+	for (i = 0; i < n; i++) {
+		if (avail[i].size >= size && (!best || avail[i].start < best))
+			best = avail[i].start;
+	}
+	if (best && !scratch_add(name, best, best + size))
+		best = 0;
+	exit_critical_section();
+
+	if (!best)
+		dprintf(INFO, "scratch: No space for '%s' (%#zx bytes)\n", name, size);
+	return (void *)best;
+}
+
+void *lk2nd_scratch_alloc_max(const char *name, size_t *size)
+{
+	struct scratch_free avail[SCRATCH_MAX_RANGES + 1];
+	unsigned int i, n, best = 0;
+
+	enter_critical_section();
+	n = scratch_free_ranges(avail);
+	for (i = 1; i < n; i++) {
+		if (avail[i].size > avail[best].size)
+			best = i;
+	}
+	if (n && !scratch_add(name, avail[best].start, avail[best].start + avail[best].size))
+		n = 0;
+	exit_critical_section();
+
+	if (!n) {
+		dprintf(INFO, "scratch: No space left for '%s'\n", name);
+		*size = 0;
+		return NULL;
+	}
+
+	*size = avail[best].size;
+	return (void *)avail[best].start;
+}
+
+void lk2nd_scratch_release(const char *name, void *ptr)
+{
+	uintptr_t start = ROUNDDOWN((uintptr_t)ptr, SCRATCH_ALIGN);
+	unsigned int i;
+
+	enter_critical_section();
+	for (i = 0; i < SCRATCH_MAX_RANGES; i++) {
+		if (ranges[i].name && ranges[i].start == start)
+			break;
+	}
+	if (i == SCRATCH_MAX_RANGES || strcmp(ranges[i].name, name)) {
+		exit_critical_section();
+		panic("scratch: '%s' releases %p owned by '%s'\n", name, ptr,
+		      i == SCRATCH_MAX_RANGES ? "nobody" : ranges[i].name);
+	}
+	ranges[i].name = NULL;
+	exit_critical_section();
+}
+
+const char *lk2nd_scratch_owner(const void *ptr)
+{
+	struct scratch_range *r;
+	const char *name;
+
+	enter_critical_section();
+	r = scratch_overlap((uintptr_t)ptr, (uintptr_t)ptr + 1);
+	name = r ? r->name : NULL;
+	exit_critical_section();
+	return name;
+}
+
+void lk2nd_scratch_dump(void (*print)(const char *line))
+{
+	struct scratch_range copy[SCRATCH_MAX_RANGES];
+	char line[64];
+	unsigned int i;
+
+	enter_critical_section();
+	memcpy(copy, ranges, sizeof(copy));
+	exit_critical_section();
+
+	for (i = 0; i < SCRATCH_MAX_RANGES; i++) {
+		if (!copy[i].name)
+			continue;
+		snprintf(line, sizeof(line), "scratch: 0x%lx-0x%lx %s",
+			 copy[i].start, copy[i].end, copy[i].name);
+		print(line);
+	}
+}
@@ -52,3 +52,4 @@ $(BUILDDIR)/%.dtb: %.dts
 		-D_DTB_NAME_=\"$(basename $(notdir $<))\" \
 		$(DT_INCLUDES) $< -MD -MT $@ -MF $@.d -o $@.dts
 	$(NOECHO)dtc -O dtb -I dts --align 16 -o $@ $@.dts
+	$(if $(DTB_POSTPROCESS),$(NOECHO)$(DTB_POSTPROCESS) $@)
@@ -48,6 +48,8 @@ int qtmr_irq(void);
 #define INT_QTMR_FRM_0_PHYSICAL_TIMER_EXP_8x39 (GIC_SPI_START + 257)
 #define SDCC1_PWRCTL_IRQ                       (GIC_SPI_START + 138)
 #define SDCC2_PWRCTL_IRQ                       (GIC_SPI_START + 221)
+#define SDCC1_HC_IRQ                           (GIC_SPI_START + 123)
+#define SDCC2_HC_IRQ                           (GIC_SPI_START + 125)
 
 #define USB1_HS_BAM_IRQ                        (GIC_SPI_START + 135)
 #define USB1_HS_IRQ                            (GIC_SPI_START + 134)
@@ -82,6 +82,9 @@
 
 #define CLK_CTL_BASE                       0x1800000
 #define BLSP_QUP_BASE(blsp_id, qup_id) (PERIPH_SS_BASE + 0xB5000 + 0x1000 * qup_id)
+#define BLSP_BAM_BASE(blsp_id)         (PERIPH_SS_BASE + 0x84000)
+/* BAM pipes 0-3 are used by the UARTs, followed by TX and RX of each QUP */
+#define BLSP_QUP_BAM_TX_PIPE(blsp_id, qup_id) (4 + 2 * (qup_id))
 #define PMI_SLAVE_BASE           2
 #define PMI_FIRST_SLAVE_OFFSET   0
 #define PMI_SECOND_SLAVE_OFFSET  1
@@ -49,6 +49,8 @@
 #define USB1_HS_IRQ                            (GIC_SPI_START + 134)
 #define SDCC1_PWRCTL_IRQ                       (GIC_SPI_START + 138)
 #define SDCC2_PWRCTL_IRQ                       (GIC_SPI_START + 221)
+#define SDCC1_HC_IRQ                           (GIC_SPI_START + 123)
+#define SDCC2_HC_IRQ                           (GIC_SPI_START + 125)
 
 /* Retrofit universal macro names */
 #define INT_USB_HS                             USB30_EE1_IRQ
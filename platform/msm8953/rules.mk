@@ -13,6 +13,9 @@ DEFINES += PERIPH_BLK_BLSP=1
 DEFINES += WITH_CPU_EARLY_INIT=0 WITH_CPU_WARM_BOOT=0 \
            MMC_SLOT=$(MMC_SLOT) SSD_ENABLE
 
+# eMMC 5.1 command queue engine, behind the sdhc registers
+DEFINES += SDHCI_CQE_OFFSET=0x500
+
 INCLUDES += -I$(LOCAL_DIR)/include -I$(LK_TOP_DIR)/platform/msm_shared/include
 
 DEVS += fbcon
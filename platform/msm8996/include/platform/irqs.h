@@ -60,6 +60,8 @@ int usb_irq(void);
 
 #define SDCC1_PWRCTL_IRQ                       (GIC_SPI_START + 134)
 #define SDCC2_PWRCTL_IRQ                       (GIC_SPI_START + 221)
+#define SDCC1_HC_IRQ                           (GIC_SPI_START + 141)
+#define SDCC2_HC_IRQ                           (GIC_SPI_START + 125)
 
 #define UFS_IRQ                                (GIC_SPI_START + 265)
 
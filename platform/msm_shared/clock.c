@@ -34,6 +34,7 @@
 #include <bits.h>
 #include <clock.h>
 #include <string.h>
+#include <kernel/thread.h>
 
 static struct clk_list msm_clk_list;
 
@@ -75,6 +76,9 @@ int clk_enable(struct clk *clk)
 	if (!clk)
 		return 0;
 
+	/* The reference counts are shared with other threads (e.g. SD card init) */
+	enter_critical_section();
+
 	if (clk->count == 0) {
 		parent = clk_get_parent(clk);
 		ret = clk_enable(parent);
@@ -90,6 +94,7 @@ int clk_enable(struct clk *clk)
 	}
 	clk->count++;
 out:
+	exit_critical_section();
 	return ret;
 }
 
@@ -100,6 +105,8 @@ void clk_disable(struct clk *clk)
 	if (!clk)
 		return;
 
+	enter_critical_section();
+
 	if (clk->count == 0)
 		goto out;
 	if (clk->count == 1) {
@@ -110,7 +117,7 @@ void clk_disable(struct clk *clk)
 	}
 	clk->count--;
 out:
-	return;
+	exit_critical_section();
 }
 
 unsigned long clk_get_rate(struct clk *clk)
@@ -123,10 +130,16 @@ unsigned long clk_get_rate(struct clk *clk)
 
 int clk_set_rate(struct clk *clk, unsigned long rate)
 {
+	int ret;
+
 	if (!clk->ops->set_rate)
 		return ERR_NOT_VALID;
 
-	return clk->ops->set_rate(clk, rate);
+	enter_critical_section();
+	ret = clk->ops->set_rate(clk, rate);
+	exit_critical_section();
+
+	return ret;
 }
 
 void clk_init(struct clk_lookup *clist, unsigned num)
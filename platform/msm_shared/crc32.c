@@ -28,6 +28,8 @@
 
 #include <stdlib.h>
 #include <debug.h>
+#include <bits.h>
+#include <crc32.h>
 
 static
 const uint32_t crc32_table[256] = {
@@ -85,11 +87,201 @@ const uint32_t crc32_table[256] = {
 	0x2d02ef8dL
 };
 
+/*
+ * Slicing-by-8: crc32_slice[k] is the CRC of a byte followed by k+1 zero
+ * bytes, so 8 bytes can be processed with one table lookup each. The tables
+ * are generated from crc32_table on first use.
+ */
+static uint32_t crc32_slice[7][256];
+static bool crc32_slice_ready;
+
+/* Whether the CPU has the ARMv8 CRC32 instructions, -1 if not checked yet */
+static int crc32_hw = -1;
+
+uint32_t crc32_armv8(uint32_t crc, const void *buf, size_t size);
+
+static void crc32_init_slice(void)
+{
+	uint32_t c;
+	int i, k;
+
+	for (i = 0; i < 256; i++) {
+		c = crc32_table[i];
+		for (k = 0; k < 7; k++) {
+			c = crc32_table[c & 0xff] ^ (c >> 8);
+			crc32_slice[k][i] = c;
+		}
+	}
+	crc32_slice_ready = true;
+}
+
+static bool crc32_has_hw(void)
+{
+	uint32_t isar5 = 0;
+
+	if (crc32_hw < 0) {
+#if ARM_ISA_ARMv7
+		/* ID_ISAR5 is RAZ on ARMv7 cores, CRC32 is bits [19:16] */
+		__asm__ ("mrc p15, 0, %0, c0, c2, 5" : "=r" (isar5));
+#endif
+		crc32_hw = !!BITS_SHIFT(isar5, 19, 16);
+	}
+	return crc32_hw;
+}
+
 uint32_t crc32(uint32_t crc, const void *buf, size_t size)
 {
 	const uint8_t *p = buf;
+	uint32_t one, two;
+
+	if (crc32_has_hw())
+		return crc32_armv8(crc, buf, size);
+
+	if (size >= 64 && !crc32_slice_ready)
+		crc32_init_slice();
+
+	/* not worth it for the short headers */
+	if (size >= 64) {
+		for (; (uintptr_t)p & 3; size--)
+			crc = crc32_table[(crc ^ *p++) & 0xff] ^ (crc >> 8);
+
+		for (; size >= 8; size -= 8, p += 8) {
+			one = *(const uint32_t *)p ^ crc;
+			two = *(const uint32_t *)(p + 4);
+			crc = crc32_slice[6][one & 0xff] ^
+			      crc32_slice[5][(one >> 8) & 0xff] ^
+			      crc32_slice[4][(one >> 16) & 0xff] ^
+			      crc32_slice[3][one >> 24] ^
+			      crc32_slice[2][two & 0xff] ^
+			      crc32_slice[1][(two >> 8) & 0xff] ^
+			      crc32_slice[0][(two >> 16) & 0xff] ^
+			      crc32_table[two >> 24];
+		}
+	}
 
 	while (size--)
 		crc = crc32_table[(crc ^ *p++) & 0xff] ^ (crc >> 8);
 	return crc;
 }
+
+/*
+ * CRC32C (Castagnoli polynomial), e.g. for ext4 metadata checksums. Like
+ * crc32(), the CRC is neither inverted before nor after. The ARMv8 CRC32
+ * extension has instructions for both polynomials, otherwise the same
+ * slicing-by-8 is used with tables generated on first use.
+ */
+#define CRC32C_POLY	0x82f63b78
+
+static uint32_t crc32c_table[8][256];
+static bool crc32c_ready;
+
+uint32_t crc32c_armv8(uint32_t crc, const void *buf, size_t size);
+
+static void crc32c_init(void)
+{
+	uint32_t c;
+	int i, k;
+
+	for (i = 0; i < 256; i++) {
+		c = i;
+		for (k = 0; k < 8; k++)
+			c = (c & 1) ? (c >> 1) ^ CRC32C_POLY : c >> 1;
+		crc32c_table[0][i] = c;
+	}
+	for (i = 0; i < 256; i++) {
+		c = crc32c_table[0][i];
+		for (k = 1; k < 8; k++) {
+			c = crc32c_table[0][c & 0xff] ^ (c >> 8);
+			crc32c_table[k][i] = c;
+		}
+	}
+	crc32c_ready = true;
+}
+
+uint32_t crc32c(uint32_t crc, const void *buf, size_t size)
+{
+	const uint8_t *p = buf;
+	uint32_t one, two;
+
+	if (crc32_has_hw())
+		return crc32c_armv8(crc, buf, size);
+
+	if (!crc32c_ready)
+		crc32c_init();
+
+	for (; size && ((uintptr_t)p & 3); size--)
+		crc = crc32c_table[0][(crc ^ *p++) & 0xff] ^ (crc >> 8);
+
+	for (; size >= 8; size -= 8, p += 8) {
+		one = *(const uint32_t *)p ^ crc;
+		two = *(const uint32_t *)(p + 4);
+		crc = crc32c_table[7][one & 0xff] ^
+		      crc32c_table[6][(one >> 8) & 0xff] ^
+		      crc32c_table[5][(one >> 16) & 0xff] ^
+		      crc32c_table[4][one >> 24] ^
+		      crc32c_table[3][two & 0xff] ^
+		      crc32c_table[2][(two >> 8) & 0xff] ^
+		      crc32c_table[1][(two >> 16) & 0xff] ^
+		      crc32c_table[0][two >> 24];
+	}
+
+	while (size--)
+		crc = crc32c_table[0][(crc ^ *p++) & 0xff] ^ (crc >> 8);
+	return crc;
+}
+
+/* Multiply two polynomials modulo the (reflected) CRC32 polynomial */
+static uint32_t crc32_multmodp(uint32_t a, uint32_t b)
+{
+	uint32_t m = 1U << 31;
+	uint32_t p = 0;
+
+	while (m) {
+		if (a & m)
+			p ^= b;
+		m >>= 1;
+		b = (b & 1) ? (b >> 1) ^ 0xedb88320 : b >> 1;
+	}
+	return p;
+}
+
+/* x^(8 * n) modulo the CRC32 polynomial, i.e. the effect of n zero bytes */
+static uint32_t crc32_x8n(uint64_t n)
+{
+	uint32_t p = 1U << 31;	/* x^0 */
+	uint32_t sq = 1U << 23;	/* x^8 */
+
+	for (; n; n >>= 1) {
+		if (n & 1)
+			p = crc32_multmodp(sq, p);
+		sq = crc32_multmodp(sq, sq);
+	}
+	return p;
+}
+
+/*
+ * CRC32 of buf repeated count times, without going through all the data,
+ * e.g. for large fill or zero ranges. Feeding buf from a zero CRC yields
+ * one, the CRC of the copies is combined by squaring in O(log(count)).
+ */
+uint32_t crc32_repeat(uint32_t crc, const void *buf, size_t size, uint64_t count)
+{
+	/* x^0, so 1 in reflected bit order */
+	uint32_t res_x = 1U << 31, res_c = 0;
+	uint32_t x, c;
+
+	/* x^(8 * size) and the CRC of one copy */
+	x = crc32_x8n(size);
+	c = crc32(0, buf, size);
+
+	for (; count; count >>= 1) {
+		if (count & 1) {
+			res_c = crc32_multmodp(x, res_c) ^ c;
+			res_x = crc32_multmodp(x, res_x);
+		}
+		c = crc32_multmodp(x, c) ^ c;
+		x = crc32_multmodp(x, x);
+	}
+
+	return crc32_multmodp(res_x, crc) ^ res_c;
+}
@@ -265,8 +265,8 @@ void crypto5_init_params(struct crypto_dev *dev, struct crypto_init_params *para
 	dev->bam.pipe[CRYPTO_WRITE_PIPE_INDEX].pipe_num   = params->pipes.write_pipe;
 	/* System producer */
 	dev->bam.pipe[CRYPTO_WRITE_PIPE_INDEX].trans_type = SYS2BAM;
-	dev->bam.pipe[CRYPTO_WRITE_PIPE_INDEX].fifo.size  = params->write_fifo_size;
-	dev->bam.pipe[CRYPTO_WRITE_PIPE_INDEX].fifo.head  = crypto_allocate_fifo(params->write_fifo_size);
+	dev->bam.pipe[CRYPTO_WRITE_PIPE_INDEX].fifo.size  = MAX(params->write_fifo_size, CRYPTO_WRITE_FIFO_MIN_SIZE);
+	dev->bam.pipe[CRYPTO_WRITE_PIPE_INDEX].fifo.head  = crypto_allocate_fifo(dev->bam.pipe[CRYPTO_WRITE_PIPE_INDEX].fifo.size);
 	dev->bam.pipe[CRYPTO_WRITE_PIPE_INDEX].lock_grp   = params->pipes.write_pipe_grp;
 
 	dev->bam.threshold = CRYPTO_MAX_THRESHOLD;
@@ -487,16 +487,13 @@ uint32_t crypto5_send_data(struct crypto_dev *dev,
 	crypto5_set_auth_cfg(dev, &buffer, data_ptr, CRYPTO_BURST_LEN - 1, sha256_ctx->bytes_to_write,
 											&total_bytes_to_write);
 
+	/* The whole buffer is queued at once, bam_add_one_desc() also does the
+	 * cache maintenance for each descriptor.
+	 */
 	if(buffer)
-	{
-		arch_clean_invalidate_cache_range((addr_t) buffer, total_bytes_to_write);
 		bam_status = ADD_WRITE_DESC(&dev->bam, (unsigned char*)PA((addr_t)buffer), total_bytes_to_write, wr_flags);
-	}
 	else
-	{
-		arch_clean_invalidate_cache_range((addr_t) data_ptr, total_bytes_to_write);
 		bam_status = ADD_WRITE_DESC(&dev->bam, (unsigned char*)PA((addr_t)data_ptr), total_bytes_to_write, wr_flags);
-	}
 
 	if (bam_status)
 	{
@@ -26,6 +26,7 @@
  * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
 
+#include <limits.h>
 #include <string.h>
 #if WITH_LIB_OPENSSL
 #include <sha.h>
@@ -40,6 +41,27 @@ static bool crypto_init_done;
 
 extern void ce_clock_init(void);
 
+/*
+ * Check if the digest should be calculated on the CPU: Always if it has the
+ * ARMv8 SHA instructions, these beat the crypto engine even without its setup
+ * cost. Otherwise only for small buffers or if there is nothing better.
+ */
+static bool hash_use_cpu(unsigned char auth_alg, unsigned int size,
+			 crypto_engine_type ce_type)
+{
+	if (sha_sw_has_hw(auth_alg))
+		return true;
+
+#if WITH_LIB_OPENSSL
+	if (ce_type == CRYPTO_ENGINE_TYPE_SW)
+		return false;
+#endif
+	if (ce_type != CRYPTO_ENGINE_TYPE_HW)
+		return true;
+
+	return size <= SHA_SW_SMALL_BUF_SIZE;
+}
+
 /*
  * Top level function which calculates SHAx digest with given data and size.
  * Digest varies based on the authentication algorithm.
@@ -53,6 +75,12 @@ hash_find(unsigned char *addr, unsigned int size, unsigned char *digest,
 	crypto_result_type ret_val = CRYPTO_SHA_ERR_NONE;
 	crypto_engine_type platform_ce_type = board_ce_type();
 
+	if ((auth_alg == CRYPTO_AUTH_ALG_SHA1 || auth_alg == CRYPTO_AUTH_ALG_SHA256) &&
+	    hash_use_cpu(auth_alg, size, platform_ce_type)) {
+		sha_sw(addr, size, digest, auth_alg);
+		return CRYPTO_SHA_ERR_NONE;
+	}
+
 	if (auth_alg == CRYPTO_AUTH_ALG_SHA1) {
 #if WITH_LIB_OPENSSL
 		if(platform_ce_type == CRYPTO_ENGINE_TYPE_SW)
@@ -172,6 +200,102 @@ static crypto_result_type crypto_sha1_init(crypto_SHA1_ctx * ctx_ptr)
 	return CRYPTO_SHA_ERR_NONE;
 }
 
+/*
+ * Functions to calculate the SHAx digest of data passed in several buffers.
+ * Either on the CPU or with the hardware crypto engine. The engine must not
+ * be used for anything else until hash_find_finish() is called.
+ */
+
+crypto_result_type
+hash_find_start(crypto_hash_ctx *hash_ctx, unsigned char auth_alg)
+{
+	if (auth_alg != CRYPTO_AUTH_ALG_SHA1 && auth_alg != CRYPTO_AUTH_ALG_SHA256)
+		return CRYPTO_SHA_ERR_INVALID_PARAM;
+
+	hash_ctx->auth_alg = auth_alg;
+	hash_ctx->sw = board_ce_type() != CRYPTO_ENGINE_TYPE_HW ||
+		       hash_use_cpu(auth_alg, UINT_MAX, CRYPTO_ENGINE_TYPE_HW);
+	if (hash_ctx->sw) {
+		sha_sw_init(&hash_ctx->ctx.sw, auth_alg);
+		return CRYPTO_SHA_ERR_NONE;
+	}
+
+	if (auth_alg == CRYPTO_AUTH_ALG_SHA1)
+		crypto_sha1_init(&hash_ctx->ctx.sha1);
+	else
+		crypto_sha256_init(&hash_ctx->ctx.sha256);
+
+	hash_ctx->first = TRUE;
+
+	/* Initialize crypto engine hardware for a new SHAx operation */
+	crypto_init();
+
+	return CRYPTO_SHA_ERR_NONE;
+}
+
+crypto_result_type
+hash_find_update(crypto_hash_ctx *hash_ctx, unsigned char *addr,
+		 unsigned int size)
+{
+	crypto_SHA1_ctx *sha1_ctx = &hash_ctx->ctx.sha1;
+	crypto_result_type ret_val;
+
+	if (hash_ctx->sw) {
+		sha_sw_update(&hash_ctx->ctx.sw, hash_ctx->auth_alg, addr, size);
+		return CRYPTO_SHA_ERR_NONE;
+	}
+
+	if (!size)
+		return CRYPTO_SHA_ERR_NONE;
+
+	/* Less than a block in total, keep it for the next update */
+	if (sha1_ctx->saved_buff_indx + size < CRYPTO_SHA_BLOCK_SIZE) {
+		memcpy(sha1_ctx->saved_buff + sha1_ctx->saved_buff_indx,
+		       addr, size);
+		sha1_ctx->saved_buff_indx += size;
+		return CRYPTO_SHA_ERR_NONE;
+	}
+
+	ret_val = do_sha_update(&hash_ctx->ctx, addr, size,
+				hash_ctx->auth_alg, hash_ctx->first, FALSE);
+	if (ret_val != CRYPTO_SHA_ERR_NONE)
+		return ret_val;
+
+	hash_ctx->first = FALSE;
+	return CRYPTO_SHA_ERR_NONE;
+}
+
+crypto_result_type
+hash_find_finish(crypto_hash_ctx *hash_ctx, unsigned char *addr,
+		 unsigned int size, unsigned char *digest)
+{
+	crypto_result_type ret_val;
+
+	if (hash_ctx->sw) {
+		sha_sw_update(&hash_ctx->ctx.sw, hash_ctx->auth_alg, addr, size);
+		sha_sw_final(&hash_ctx->ctx.sw, hash_ctx->auth_alg, digest);
+		return CRYPTO_SHA_ERR_NONE;
+	}
+
+	if (!size && !hash_ctx->ctx.sha1.saved_buff_indx)
+		return CRYPTO_SHA_ERR_INVALID_PARAM;
+
+	ret_val = do_sha_update(&hash_ctx->ctx, addr, size,
+				hash_ctx->auth_alg, hash_ctx->first, TRUE);
+	if (ret_val != CRYPTO_SHA_ERR_NONE) {
+		dprintf(CRITICAL, "do_sha_update returns error %d\n", ret_val);
+		return ret_val;
+	}
+
+	/* Copy the digest value from context pointer to digest pointer */
+	if (hash_ctx->auth_alg == CRYPTO_AUTH_ALG_SHA1)
+		memcpy(digest, (unsigned char *)hash_ctx->ctx.sha1.auth_iv, 20);
+	else
+		memcpy(digest, (unsigned char *)hash_ctx->ctx.sha256.auth_iv, 32);
+
+	return CRYPTO_SHA_ERR_NONE;
+}
+
 /*
  * Function to calculate SHA256 digest of given data buffer.
  * It works on contiguous data and gives digest in single pass.
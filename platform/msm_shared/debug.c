@@ -40,6 +40,7 @@
 #include <platform/timer.h>
 #include <platform.h>
 #include <arch/ops.h>
+#include <kernel/thread.h>
 
 #if PON_VIB_SUPPORT
 #include <vibrator.h>
@@ -80,34 +81,81 @@ struct lk_log {
 	char data[LK_LOG_BUF_SIZE];
 };
 
-static struct lk_log log;
+#ifdef LK_LOG_BUF_ADDR
+/*
+ * Keep the log in reserved memory instead, e.g. to make it larger than fits
+ * into the lk binary. The memory must be mapped by the platform and must not
+ * be used by anything else. The log of the previous boot is kept after a
+ * warm reset.
+ */
+static struct lk_log *const log = (struct lk_log *)LK_LOG_BUF_ADDR;
+#else
+static struct lk_log _log;
+static struct lk_log *const log = &_log;
+#endif
 
 static void log_init(void)
 {
-	log.header.cookie = LK_LOG_COOKIE;
-	log.header.max_size = sizeof(log.data);
+	if (log->header.cookie == LK_LOG_COOKIE &&
+	    log->header.max_size == sizeof(log->data) &&
+	    log->header.idx < sizeof(log->data))
+		return;
+
+	log->header.cookie = LK_LOG_COOKIE;
+	log->header.max_size = sizeof(log->data);
+	log->header.size_written = 0;
+	log->header.idx = 0;
 }
 
 static void log_putc(char c)
 {
-	log.data[log.header.idx++] = c;
-	log.header.size_written++;
-	if (unlikely(log.header.idx >= log.header.max_size))
-		log.header.idx = 0;
+	unsigned idx = log->header.idx;
+
+	/* The header might not be initialized yet */
+	if (unlikely(idx >= sizeof(log->data)))
+		idx = 0;
+
+	log->data[idx++] = c;
+	log->header.size_written++;
+	if (unlikely(idx >= sizeof(log->data)))
+		idx = 0;
+	log->header.idx = idx;
+}
+
+/*
+ * Copy the part of the log that was written after seq, which is the total
+ * number of bytes written to the log so far (as returned by a previous call).
+ * If some of it was overwritten already, copy everything that is still there.
+ * seq is updated to the current position at the end of the log.
+ */
+unsigned log_copy_since(void *dst, unsigned *seq)
+{
+	unsigned written, avail, len, start, tail;
+
+	/* Include the messages that were not formatted yet */
+	dlog_flush();
+	enter_critical_section();
+
+	written = log->header.size_written;
+	avail = MIN(written, (unsigned)sizeof(log->data));
+	len = MIN(written - *seq, avail);
+
+	start = (log->header.idx + sizeof(log->data) - len) % sizeof(log->data);
+	tail = MIN(len, sizeof(log->data) - start);
+	memcpy(dst, &log->data[start], tail);
+	memcpy(dst + tail, log->data, len - tail);
+
+	exit_critical_section();
+
+	*seq = written;
+	return len;
 }
 
 unsigned log_copy(void *dst)
 {
-	if (log.header.size_written >= log.header.max_size) {
-		unsigned tail = log.header.max_size - log.header.idx;
+	unsigned seq = 0;
 
-		memcpy(dst, &log.data[log.header.idx], tail);
-		memcpy(dst + tail, log.data, log.header.idx);
-		return log.header.max_size;
-	} else {
-		memcpy(dst, log.data, log.header.idx);
-		return log.header.idx;
-	}
+	return log_copy_since(dst, &seq);
 }
 #endif /* WITH_DEBUG_LOG_BUF */
 
@@ -169,6 +217,9 @@ int dgetc(char *c, bool wait)
 
 void platform_halt(void)
 {
+#if UART_DM_ASYNC_TX
+	uart_flush_tx(0);
+#endif
 #if PON_VIB_SUPPORT
 	vib_turn_off();
 #endif
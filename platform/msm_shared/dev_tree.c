@@ -49,6 +49,9 @@
 #include <ufdt_overlay.h>
 #endif
 #include <boot_stats.h>
+#if WITH_LK2ND_BOOTSTATS
+#include <lk2nd/bootstats.h>
+#endif
 #include <verifiedboot.h>
 
 #define NODE_PROPERTY_MAX_LEN   64
@@ -1267,6 +1270,61 @@ out:
 	bs_set_timestamp(BS_DTB_OVERLAY_END);
 	return ret;
 }
+/*
+ * Function: dev_tree_msm_id_may_match
+ * Arg     : DTB (may be unaligned), its validated header & the msm id
+ * Return  : true if the DTB may be compatible, false if it is for another SoC
+ * Flow:   : Walk the properties of the root node on the raw bytes (libfdt
+ *           requires an aligned DTB) and look for the msm id in any cell of
+ *           qcom,msm-id. Only the DTBs that pass are copied and parsed
+ *           completely by dev_tree_compatible().
+ */
+static bool dev_tree_msm_id_may_match(const void *dtb, const struct fdt_header *hdr,
+				      uint32_t msm_id)
+{
+	const uint8_t *dt = (const uint8_t *)dtb + fdt_off_dt_struct(hdr);
+	const char *strings = (const char *)dtb + fdt_off_dt_strings(hdr);
+	uint32_t size = fdt_size_dt_struct(hdr);
+	uint32_t off, len, nameoff, i;
+
+	/* Skip the FDT_BEGIN_NODE tag and the empty name of the root node */
+	if (size < 2 * FDT_TAGSIZE || fdt32_ld((const fdt32_t *)dt) != FDT_BEGIN_NODE)
+		return true;
+	off = 2 * FDT_TAGSIZE;
+
+	while (off + FDT_TAGSIZE <= size) {
+		switch (fdt32_ld((const fdt32_t *)(dt + off))) {
+		case FDT_NOP:
+			off += FDT_TAGSIZE;
+			continue;
+		case FDT_PROP:
+			break;
+		default:
+			/* End of the root node properties */
+			return false;
+		}
+
+		if (off + 3 * FDT_TAGSIZE > size)
+			return true;
+		len = fdt32_ld((const fdt32_t *)(dt + off + FDT_TAGSIZE));
+		nameoff = fdt32_ld((const fdt32_t *)(dt + off + 2 * FDT_TAGSIZE));
+		off += 3 * FDT_TAGSIZE;
+		if (len > size - off || nameoff >= fdt_size_dt_strings(hdr))
+			return true;
+
+		if (!strncmp(strings + nameoff, "qcom,msm-id", fdt_size_dt_strings(hdr) - nameoff)) {
+			for (i = 0; i + FDT_TAGSIZE <= len; i += FDT_TAGSIZE)
+				if ((fdt32_ld((const fdt32_t *)(dt + off + i)) & 0x0000ffff) == msm_id)
+					return true;
+			return false;
+		}
+
+		off += ROUNDUP(len, FDT_TAGSIZE);
+	}
+
+	return true;
+}
+
 /*
  * Will relocate the DTB to the tags addr if the device tree is found and return
  * its address
@@ -1291,6 +1349,7 @@ void *dev_tree_appended(void *kernel, uint32_t kernel_size, uint32_t dtb_offset,
 	struct dt_entry_node *dt_node_tmp2 = NULL;
 	dtbo_error ret = DTBO_NOT_SUPPORTED;
 	unsigned dtb_count = 0;
+	uint32_t msm_id = board_platform_id() & 0x0000ffff;
 
 	if (dtb_offset)
 		app_dtb_offset = dtb_offset;
@@ -1322,6 +1381,11 @@ void *dev_tree_appended(void *kernel, uint32_t kernel_size, uint32_t dtb_offset,
 	}
 	dtb = (void *)((uintptr_t)kernel + app_dtb_offset);
 
+#if WITH_LK2ND_DEVICE
+	if (lk2nd_dt_override.offset)
+		msm_id = lk2nd_dt_override.platform_id & 0x0000ffff;
+#endif
+
 	while (((uintptr_t)dtb + sizeof(struct fdt_header)) < (uintptr_t)kernel_end) {
 		struct fdt_header dtb_hdr __ALIGNED(8);
 		void *dtb_aligned = dtb;
@@ -1337,6 +1401,13 @@ void *dev_tree_appended(void *kernel, uint32_t kernel_size, uint32_t dtb_offset,
 			break;
 		dtb_size = fdt_totalsize(&dtb_hdr);
 
+		/* Skip the DTBs for other SoCs without copying them */
+		if (!dev_tree_msm_id_may_match(dtb, &dtb_hdr, msm_id)) {
+			dtb += dtb_size;
+			dtb_count++;
+			continue;
+		}
+
 		/* Need to copy DTB if not aligned properly :/ */
 		if ((uintptr_t)dtb & 7) {
 			if (check_aboot_addr_range_overlap((uintptr_t)tags, dtb_size)) {
@@ -2196,6 +2267,18 @@ int dev_tree_add_mem_info(void *fdt, uint32_t offset, uint64_t addr, uint64_t si
 	return ret;
 }
 
+static uint32_t dt_update_handlers_size(void)
+{
+	extern const struct dt_update_handler __dt_update_start;
+	extern const struct dt_update_handler __dt_update_end;
+	const struct dt_update_handler *dtu;
+	uint32_t size = 0;
+
+	for (dtu = &__dt_update_start; dtu < &__dt_update_end; ++dtu)
+		size += dtu->size;
+	return size;
+}
+
 static int call_dt_update_handlers(void *fdt, const char *cmdline,
 				   enum boot_type boot_type)
 {
@@ -2212,7 +2295,13 @@ static int call_dt_update_handlers(void *fdt, const char *cmdline,
 		boot_type |= BOOT_DOWNSTREAM;
 
 	for (dtu = &__dt_update_start; dtu < &__dt_update_end; ++dtu) {
+#if WITH_LK2ND_BOOTSTATS
+		int bs = lk2nd_bootstats_start("%s", dtu->name);
+		ret = dtu->update_dt(fdt, cmdline, boot_type);
+		lk2nd_bootstats_end(bs);
+#else
 		ret = dtu->update_dt(fdt, cmdline, boot_type);
+#endif
 		if (ret) {
 			dprintf(CRITICAL, "%s failed: %d\n", dtu->name, ret);
 			return ret;
@@ -2231,10 +2320,14 @@ int update_device_tree(void *fdt, const char *cmdline, enum boot_type boot_type,
 	uint64_t kaslrseed;
 #endif
 	uint32_t cmdline_len = 0;
+	uint32_t pad_size = DTB_PAD_SIZE;
 
 	if (cmdline)
 		cmdline_len = strlen(cmdline);
 
+	/* Space for the properties added by the update handlers */
+	pad_size += dt_update_handlers_size();
+
 	/* Check the device tree header */
 	ret = fdt_check_header(fdt) || fdt_check_header_ext(fdt);
 	if (ret)
@@ -2244,13 +2337,13 @@ int update_device_tree(void *fdt, const char *cmdline, enum boot_type boot_type,
 	}
 
 	if (check_aboot_addr_range_overlap((uint32_t)fdt,
-				(fdt_totalsize(fdt) + DTB_PAD_SIZE + cmdline_len))) {
+				(fdt_totalsize(fdt) + pad_size + cmdline_len))) {
 		dprintf(CRITICAL, "Error: Fdt addresses overlap with aboot addresses.\n");
 		return ret;
 	}
 
 	/* Add padding to make space for new nodes and properties. */
-	ret = fdt_open_into(fdt, fdt, fdt_totalsize(fdt) + DTB_PAD_SIZE + cmdline_len);
+	ret = fdt_open_into(fdt, fdt, fdt_totalsize(fdt) + pad_size + cmdline_len);
 	if (ret!= 0)
 	{
 		dprintf(CRITICAL, "Failed to move/resize dtb buffer: %d\n", ret);
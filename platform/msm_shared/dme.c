@@ -58,11 +58,11 @@ dme_send_linkstartup_req_err:
 	return -UFS_FAILURE;
 }
 
-int dme_get_req(struct ufs_dev *dev, struct dme_get_req_type *req)
+static int dme_send_get_req(struct ufs_dev *dev, uint32_t uiccmd, struct dme_get_req_type *req)
 {
 	struct uic_cmd cmd;
 
-	cmd.uiccmd	      = UICCMDR_DME_GET;
+	cmd.uiccmd	      = uiccmd;
 	cmd.num_args      = UICCMD_ONE_ARGS;
 	cmd.uiccmdarg1    = req->attribute << 16 | req->index;
 	cmd.timeout_msecs = INFINITE_TIME;
@@ -76,10 +76,42 @@ int dme_get_req(struct ufs_dev *dev, struct dme_get_req_type *req)
 	return UFS_SUCCESS;
 
 dme_get_req_err:
-	dprintf(CRITICAL, "%s:%d DME_GET command failed.\n", __func__, __LINE__);
+	dprintf(CRITICAL, "%s:%d DME_GET 0x%x command failed.\n", __func__, __LINE__,
+			req->attribute);
 	return -UFS_FAILURE;
 }
 
+int dme_get_req(struct ufs_dev *dev, struct dme_get_req_type *req)
+{
+	return dme_send_get_req(dev, UICCMDR_DME_GET, req);
+}
+
+int dme_peer_get_req(struct ufs_dev *dev, struct dme_get_req_type *req)
+{
+	return dme_send_get_req(dev, UICCMDR_DME_PEER_GET, req);
+}
+
+int dme_set_req(struct ufs_dev *dev, uint16_t attribute, uint32_t val)
+{
+	struct uic_cmd cmd;
+
+	cmd.uiccmd        = UICCMDR_DME_SET;
+	cmd.num_args      = UICCMD_ONE_ARGS | UICCMD_TWO_ARGS | UICCMD_THREE_ARGS;
+	cmd.uiccmdarg1    = attribute << 16;
+	cmd.uiccmdarg2    = 0; /* Normal attribute set */
+	cmd.uiccmdarg3    = val;
+	cmd.timeout_msecs = INFINITE_TIME;
+
+	if (uic_send_cmd(dev, &cmd) || cmd.gen_err_code == UICCMD_FAILURE)
+	{
+		dprintf(CRITICAL, "%s:%d DME_SET 0x%x command failed.\n", __func__, __LINE__,
+				attribute);
+		return -UFS_FAILURE;
+	}
+
+	return UFS_SUCCESS;
+}
+
 static int dme_get_query_resp(struct ufs_dev *dev,
 					          struct upiu_req_build_type *req_upiu,
 					          addr_t buffer,
@@ -28,76 +28,12 @@
 
 #include <stdlib.h>
 #include <string.h>
+#include <crc32.h>
 #include <dev/flash-ubi.h>
 #include <dev/flash.h>
 #include <qpic_nand.h>
 #include <rand.h>
 
-static
-const uint32_t crc32_table[256] = {
-	0x00000000L, 0x77073096L, 0xee0e612cL, 0x990951baL, 0x076dc419L,
-	0x706af48fL, 0xe963a535L, 0x9e6495a3L, 0x0edb8832L, 0x79dcb8a4L,
-	0xe0d5e91eL, 0x97d2d988L, 0x09b64c2bL, 0x7eb17cbdL, 0xe7b82d07L,
-	0x90bf1d91L, 0x1db71064L, 0x6ab020f2L, 0xf3b97148L, 0x84be41deL,
-	0x1adad47dL, 0x6ddde4ebL, 0xf4d4b551L, 0x83d385c7L, 0x136c9856L,
-	0x646ba8c0L, 0xfd62f97aL, 0x8a65c9ecL, 0x14015c4fL, 0x63066cd9L,
-	0xfa0f3d63L, 0x8d080df5L, 0x3b6e20c8L, 0x4c69105eL, 0xd56041e4L,
-	0xa2677172L, 0x3c03e4d1L, 0x4b04d447L, 0xd20d85fdL, 0xa50ab56bL,
-	0x35b5a8faL, 0x42b2986cL, 0xdbbbc9d6L, 0xacbcf940L, 0x32d86ce3L,
-	0x45df5c75L, 0xdcd60dcfL, 0xabd13d59L, 0x26d930acL, 0x51de003aL,
-	0xc8d75180L, 0xbfd06116L, 0x21b4f4b5L, 0x56b3c423L, 0xcfba9599L,
-	0xb8bda50fL, 0x2802b89eL, 0x5f058808L, 0xc60cd9b2L, 0xb10be924L,
-	0x2f6f7c87L, 0x58684c11L, 0xc1611dabL, 0xb6662d3dL, 0x76dc4190L,
-	0x01db7106L, 0x98d220bcL, 0xefd5102aL, 0x71b18589L, 0x06b6b51fL,
-	0x9fbfe4a5L, 0xe8b8d433L, 0x7807c9a2L, 0x0f00f934L, 0x9609a88eL,
-	0xe10e9818L, 0x7f6a0dbbL, 0x086d3d2dL, 0x91646c97L, 0xe6635c01L,
-	0x6b6b51f4L, 0x1c6c6162L, 0x856530d8L, 0xf262004eL, 0x6c0695edL,
-	0x1b01a57bL, 0x8208f4c1L, 0xf50fc457L, 0x65b0d9c6L, 0x12b7e950L,
-	0x8bbeb8eaL, 0xfcb9887cL, 0x62dd1ddfL, 0x15da2d49L, 0x8cd37cf3L,
-	0xfbd44c65L, 0x4db26158L, 0x3ab551ceL, 0xa3bc0074L, 0xd4bb30e2L,
-	0x4adfa541L, 0x3dd895d7L, 0xa4d1c46dL, 0xd3d6f4fbL, 0x4369e96aL,
-	0x346ed9fcL, 0xad678846L, 0xda60b8d0L, 0x44042d73L, 0x33031de5L,
-	0xaa0a4c5fL, 0xdd0d7cc9L, 0x5005713cL, 0x270241aaL, 0xbe0b1010L,
-	0xc90c2086L, 0x5768b525L, 0x206f85b3L, 0xb966d409L, 0xce61e49fL,
-	0x5edef90eL, 0x29d9c998L, 0xb0d09822L, 0xc7d7a8b4L, 0x59b33d17L,
-	0x2eb40d81L, 0xb7bd5c3bL, 0xc0ba6cadL, 0xedb88320L, 0x9abfb3b6L,
-	0x03b6e20cL, 0x74b1d29aL, 0xead54739L, 0x9dd277afL, 0x04db2615L,
-	0x73dc1683L, 0xe3630b12L, 0x94643b84L, 0x0d6d6a3eL, 0x7a6a5aa8L,
-	0xe40ecf0bL, 0x9309ff9dL, 0x0a00ae27L, 0x7d079eb1L, 0xf00f9344L,
-	0x8708a3d2L, 0x1e01f268L, 0x6906c2feL, 0xf762575dL, 0x806567cbL,
-	0x196c3671L, 0x6e6b06e7L, 0xfed41b76L, 0x89d32be0L, 0x10da7a5aL,
-	0x67dd4accL, 0xf9b9df6fL, 0x8ebeeff9L, 0x17b7be43L, 0x60b08ed5L,
-	0xd6d6a3e8L, 0xa1d1937eL, 0x38d8c2c4L, 0x4fdff252L, 0xd1bb67f1L,
-	0xa6bc5767L, 0x3fb506ddL, 0x48b2364bL, 0xd80d2bdaL, 0xaf0a1b4cL,
-	0x36034af6L, 0x41047a60L, 0xdf60efc3L, 0xa867df55L, 0x316e8eefL,
-	0x4669be79L, 0xcb61b38cL, 0xbc66831aL, 0x256fd2a0L, 0x5268e236L,
-	0xcc0c7795L, 0xbb0b4703L, 0x220216b9L, 0x5505262fL, 0xc5ba3bbeL,
-	0xb2bd0b28L, 0x2bb45a92L, 0x5cb36a04L, 0xc2d7ffa7L, 0xb5d0cf31L,
-	0x2cd99e8bL, 0x5bdeae1dL, 0x9b64c2b0L, 0xec63f226L, 0x756aa39cL,
-	0x026d930aL, 0x9c0906a9L, 0xeb0e363fL, 0x72076785L, 0x05005713L,
-	0x95bf4a82L, 0xe2b87a14L, 0x7bb12baeL, 0x0cb61b38L, 0x92d28e9bL,
-	0xe5d5be0dL, 0x7cdcefb7L, 0x0bdbdf21L, 0x86d3d2d4L, 0xf1d4e242L,
-	0x68ddb3f8L, 0x1fda836eL, 0x81be16cdL, 0xf6b9265bL, 0x6fb077e1L,
-	0x18b74777L, 0x88085ae6L, 0xff0f6a70L, 0x66063bcaL, 0x11010b5cL,
-	0x8f659effL, 0xf862ae69L, 0x616bffd3L, 0x166ccf45L, 0xa00ae278L,
-	0xd70dd2eeL, 0x4e048354L, 0x3903b3c2L, 0xa7672661L, 0xd06016f7L,
-	0x4969474dL, 0x3e6e77dbL, 0xaed16a4aL, 0xd9d65adcL, 0x40df0b66L,
-	0x37d83bf0L, 0xa9bcae53L, 0xdebb9ec5L, 0x47b2cf7fL, 0x30b5ffe9L,
-	0xbdbdf21cL, 0xcabac28aL, 0x53b39330L, 0x24b4a3a6L, 0xbad03605L,
-	0xcdd70693L, 0x54de5729L, 0x23d967bfL, 0xb3667a2eL, 0xc4614ab8L,
-	0x5d681b02L, 0x2a6f2b94L, 0xb40bbe37L, 0xc30c8ea1L, 0x5a05df1bL,
-	0x2d02ef8dL
-};
-
-static uint32_t mtd_crc32(uint32_t crc, const void *buf, size_t size)
-{
-	const uint8_t *p = buf;
-
-	while (size--)
-		crc = crc32_table[(crc ^ *p++) & 0xff] ^ (crc >> 8);
-	return crc;
-}
-
 /**
  * check_pattern - check if buffer contains only a certain byte pattern.
  * @buf: buffer to check
@@ -216,7 +152,7 @@ static int read_ec_hdr(uint32_t peb, struct ubi_ec_hdr *ec_hdr)
 		goto out;
 	}
 
-	crc = mtd_crc32(UBI_CRC32_INIT, ec_hdr, UBI_EC_HDR_SIZE_CRC);
+	crc = crc32(UBI_CRC32_INIT, ec_hdr, UBI_EC_HDR_SIZE_CRC);
 	if (BE32(ec_hdr->hdr_crc) != crc) {
 		dprintf(CRITICAL,
 			"read_ec_hdr: Wrong crc at peb-%d: calculated %d, recived %d\n",
@@ -296,7 +232,7 @@ static int read_vid_hdr(uint32_t peb, struct ubi_vid_hdr *vid_hdr,
 		goto out;
 	}
 
-	crc = mtd_crc32(UBI_CRC32_INIT, vid_hdr, UBI_EC_HDR_SIZE_CRC);
+	crc = crc32(UBI_CRC32_INIT, vid_hdr, UBI_EC_HDR_SIZE_CRC);
 	if (BE32(vid_hdr->hdr_crc) != crc) {
 		dprintf(CRITICAL,
 			"read_vid_hdr: Wrong crc at peb-%d: calculated %d, received %d\n",
@@ -496,22 +432,379 @@ out:
 	return ret;
 }
 
+/**
+ * add_vtbl_peb() - Record a PEB holding a copy of the volume table
+ * @si: UBI scan information
+ * @peb: number of the PEB relative to the beginning of the partition
+ */
+static void add_vtbl_peb(struct ubi_scan_info *si, int peb)
+{
+	if (si->vtbl_peb1 == -1)
+		si->vtbl_peb1 = peb;
+	else if (si->vtbl_peb2 == -1)
+		si->vtbl_peb2 = peb;
+	else
+		dprintf(CRITICAL, "scan_partition: Found > 2 copies of vtbl");
+}
+
+/**
+ * scan_peb() - Read the headers of a single PEB into the scan information
+ * @si: UBI scan information
+ * @ptn_start: number of first PEB of the partition
+ * @i: number of the PEB relative to the beginning of the partition
+ * @ec_hdr: buffer for the EC header
+ */
+static void scan_peb(struct ubi_scan_info *si, unsigned ptn_start, unsigned i,
+		struct ubi_ec_hdr *ec_hdr)
+{
+	struct ubi_vid_hdr vid_hdr;
+	int page_size = flash_page_size();
+	int ret;
+
+	ret = read_ec_hdr(ptn_start + i, ec_hdr);
+	switch (ret) {
+	case 1:
+		si->empty_cnt++;
+		si->pebs_data[i].ec = UBI_MAX_ERASECOUNTER;
+		si->pebs_data[i].status = UBI_EMPTY_PEB;
+		break;
+	case 0:
+		if (!si->vid_hdr_offs) {
+			si->vid_hdr_offs = BE32(ec_hdr->vid_hdr_offset);
+			si->data_offs = BE32(ec_hdr->data_offset);
+			if (!si->vid_hdr_offs || !si->data_offs ||
+				si->vid_hdr_offs % page_size ||
+				si->data_offs % page_size) {
+				si->bad_cnt++;
+				si->pebs_data[i].ec = UBI_MAX_ERASECOUNTER;
+				si->vid_hdr_offs = 0;
+				return;
+			}
+			if (BE32(ec_hdr->vid_hdr_offset) != si->vid_hdr_offs) {
+				si->bad_cnt++;
+				si->pebs_data[i].ec = UBI_MAX_ERASECOUNTER;
+				return;
+			}
+			if (BE32(ec_hdr->data_offset) != si->data_offs) {
+				si->bad_cnt++;
+				si->pebs_data[i].ec = UBI_MAX_ERASECOUNTER;
+				return;
+			}
+		}
+		si->read_image_seq = BE32(ec_hdr->image_seq);
+		si->pebs_data[i].ec = BE64(ec_hdr->ec);
+		/* Now read the VID header to find if the peb is free */
+		ret = read_vid_hdr(ptn_start + i, &vid_hdr,
+				BE32(ec_hdr->vid_hdr_offset));
+		switch (ret) {
+		case 1:
+			si->pebs_data[i].status = UBI_FREE_PEB;
+			si->free_cnt++;
+			break;
+		case 0:
+			si->pebs_data[i].status = UBI_USED_PEB;
+			si->pebs_data[i].volume = BE32(vid_hdr.vol_id);
+			si->pebs_data[i].lnum = BE32(vid_hdr.lnum);
+			si->pebs_data[i].sqnum = BE64(vid_hdr.sqnum);
+			if (BE32(vid_hdr.vol_id) == UBI_LAYOUT_VOLUME_ID)
+				add_vtbl_peb(si, i);
+			if (BE32(vid_hdr.vol_id) == UBI_FM_SB_VOLUME_ID) {
+				si->fastmap_sb = i;
+				si->fastmap_sb_cnt++;
+			}
+			si->used_cnt++;
+			break;
+		case -1:
+		default:
+			si->bad_cnt++;
+			si->pebs_data[i].ec = UBI_MAX_ERASECOUNTER;
+			si->pebs_data[i].status = UBI_BAD_PEB;
+			break;
+		}
+		break;
+	case -1:
+	default:
+		si->bad_cnt++;
+		si->pebs_data[i].ec = UBI_MAX_ERASECOUNTER;
+		si->pebs_data[i].status = UBI_BAD_PEB;
+		break;
+	}
+}
+
+/**
+ * fm_get() - Get the next structure from the raw fastmap data
+ * @fm: raw fastmap data
+ * @fm_size: size of the fastmap data
+ * @pos: current position in the fastmap data, advanced by @len
+ * @len: size of the structure
+ *
+ * Returns pointer to the structure or NULL if the fastmap is too short.
+ */
+static void *fm_get(void *fm, unsigned fm_size, unsigned *pos, unsigned len)
+{
+	void *ret = fm + *pos;
+
+	if (len > fm_size - *pos)
+		return NULL;
+	*pos += len;
+	return ret;
+}
+
+/**
+ * fm_add_pebs() - Mark the PEBs of a fastmap EC list
+ * @si: UBI scan information
+ * @ptn: partition being scanned
+ * @first: number of the first PEB not scanned yet
+ * @fmec: the EC list
+ * @count: number of entries in @fmec
+ * @status: status of the listed PEBs
+ *
+ * Returns -1 if the list refers to an invalid PEB, 0 on success.
+ */
+static int fm_add_pebs(struct ubi_scan_info *si, struct ptentry *ptn,
+		unsigned first, const struct ubi_fm_ec *fmec, unsigned count,
+		int status)
+{
+	unsigned i, pnum;
+
+	for (i = 0; i < count; i++) {
+		pnum = BE32(fmec[i].pnum);
+		if (pnum >= ptn->length)
+			return -1;
+		/* Already scanned while looking for the superblock */
+		if (pnum < first)
+			continue;
+		if (si->pebs_data[pnum].status != UBI_UNKNOWN)
+			return -1;
+
+		si->pebs_data[pnum].ec = BE32(fmec[i].ec);
+		si->pebs_data[pnum].status = status;
+		si->pebs_data[pnum].volume = -1;
+		if (status == UBI_FREE_PEB)
+			si->free_cnt++;
+		else
+			si->used_cnt++;
+	}
+	return 0;
+}
+
+/**
+ * read_fastmap() - Read and check all the fastmap data
+ * @si: UBI scan information, holding the superblock PEB
+ * @ptn: partition being scanned
+ * @fm_size: returns the size of the fastmap data
+ *
+ * The fastmap consists of the LEB holding the superblock and the LEBs of the
+ * data PEBs listed in it. Their content is checked with the CRC stored in
+ * the superblock.
+ *
+ * Returns allocated buffer with the fastmap data or NULL if there is no valid
+ * fastmap. Note: the buffer should be released by caller.
+ */
+static void *read_fastmap(struct ubi_scan_info *si, struct ptentry *ptn,
+		unsigned *fm_size)
+{
+	unsigned leb_size = flash_block_size() - si->data_offs;
+	struct ubi_ec_hdr ec_hdr;
+	struct ubi_vid_hdr vid_hdr;
+	struct ubi_fm_sb *fmsb;
+	unsigned used_blocks, i, pnum;
+	uint32_t crc;
+	void *fm;
+
+	fm = malloc(leb_size);
+	if (!fm) {
+		dprintf(CRITICAL, "read_fastmap: Memory allocation failed\n");
+		return NULL;
+	}
+
+	if (read_leb_data(ptn->start + si->fastmap_sb, fm, leb_size,
+			si->data_offs))
+		goto out_failed;
+
+	fmsb = fm;
+	used_blocks = BE32(fmsb->used_blocks);
+	if (BE32(fmsb->magic) != UBI_FM_SB_MAGIC ||
+			fmsb->version != UBI_FM_FMT_VERSION ||
+			!used_blocks || used_blocks > UBI_FM_MAX_BLOCKS ||
+			BE32(fmsb->block_loc[0]) != (uint32_t)si->fastmap_sb) {
+		dprintf(CRITICAL, "read_fastmap: Invalid superblock at peb-%d\n",
+				si->fastmap_sb);
+		goto out_failed;
+	}
+
+	*fm_size = used_blocks * leb_size;
+	fm = realloc(fm, *fm_size);
+	if (!fm) {
+		dprintf(CRITICAL, "read_fastmap: Memory allocation failed\n");
+		return NULL;
+	}
+	fmsb = fm;
+
+	for (i = 1; i < used_blocks; i++) {
+		pnum = BE32(fmsb->block_loc[i]);
+		if (pnum >= ptn->length ||
+				read_ec_hdr(ptn->start + pnum, &ec_hdr) ||
+				BE32(ec_hdr.image_seq) != si->read_image_seq ||
+				read_vid_hdr(ptn->start + pnum, &vid_hdr, si->vid_hdr_offs) ||
+				BE32(vid_hdr.vol_id) != UBI_FM_DATA_VOLUME_ID) {
+			dprintf(CRITICAL, "read_fastmap: Invalid data block %d\n", i);
+			goto out_failed;
+		}
+		if (read_leb_data(ptn->start + pnum, fm + i * leb_size, leb_size,
+				si->data_offs))
+			goto out_failed;
+	}
+
+	crc = BE32(fmsb->data_crc);
+	fmsb->data_crc = 0;
+	if (crc32(UBI_CRC32_INIT, fm, *fm_size) != crc) {
+		dprintf(CRITICAL, "read_fastmap: Wrong data crc\n");
+		goto out_failed;
+	}
+	return fm;
+
+out_failed:
+	free(fm);
+	return NULL;
+}
+
+/**
+ * attach_fastmap() - Collect the PEBs info of a partition from its fastmap
+ * @si: UBI scan information, holding the headers of the first
+ * 		UBI_FM_MAX_START PEBs
+ * @ptn: partition being scanned
+ * @first: number of the first PEB not scanned yet
+ * @ec_hdr: buffer for the EC header
+ *
+ * The fastmap lists the erase counters of the free and used PEBs and the
+ * PEBs mapped to each volume. Only the PEBs of the pools, that may have been
+ * written after the fastmap, and all the PEBs not listed in it (bad, to be
+ * erased, fastmap data) are scanned.
+ *
+ * Return codes:
+ * -1 - if the fastmap is not usable, @si is partially filled
+ *  0 - on success
+ */
+static int attach_fastmap(struct ubi_scan_info *si, struct ptentry *ptn,
+		unsigned first, struct ubi_ec_hdr *ec_hdr)
+{
+	struct ubi_fm_hdr *fmhdr;
+	struct ubi_fm_scan_pool *fmpl, *fmpl_wl;
+	struct ubi_fm_volhdr *fmvhdr;
+	struct ubi_fm_eba *fm_eba;
+	struct ubi_fm_ec *fmec;
+	unsigned fm_size, pos = sizeof(struct ubi_fm_sb);
+	unsigned i, j, cnt, pnum, vol_id, reserved_pebs;
+	uint64_t sqnum;
+	uint32_t *eba;
+	int ret = -1;
+	void *fm;
+
+	if (si->fastmap_sb_cnt != 1 || !si->vid_hdr_offs)
+		return -1;
+
+	fm = read_fastmap(si, ptn, &fm_size);
+	if (!fm)
+		return -1;
+
+	/* All LEBs of the EBA tables were written before the fastmap */
+	sqnum = BE64(((struct ubi_fm_sb *)fm)->sqnum);
+
+	fmhdr = fm_get(fm, fm_size, &pos, sizeof(*fmhdr));
+	fmpl = fm_get(fm, fm_size, &pos, sizeof(*fmpl));
+	fmpl_wl = fm_get(fm, fm_size, &pos, sizeof(*fmpl_wl));
+	if (!fmhdr || !fmpl || !fmpl_wl ||
+			BE32(fmhdr->magic) != UBI_FM_HDR_MAGIC ||
+			BE32(fmpl->magic) != UBI_FM_POOL_MAGIC ||
+			BE32(fmpl_wl->magic) != UBI_FM_POOL_MAGIC ||
+			BE16(fmpl->size) > UBI_FM_MAX_POOL_SIZE ||
+			BE16(fmpl_wl->size) > UBI_FM_MAX_POOL_SIZE)
+		goto out;
+
+	/* Free PEBs, used PEBs, PEBs to scrub (still used) */
+	for (i = 0; i < 3; i++) {
+		cnt = BE32(i == 0 ? fmhdr->free_peb_count :
+			   i == 1 ? fmhdr->used_peb_count :
+				    fmhdr->scrub_peb_count);
+		if (cnt > ptn->length)
+			goto out;
+		fmec = fm_get(fm, fm_size, &pos, cnt * sizeof(*fmec));
+		if (!fmec || fm_add_pebs(si, ptn, first, fmec, cnt,
+				i ? UBI_USED_PEB : UBI_FREE_PEB))
+			goto out;
+	}
+
+	/* The PEBs to erase still contain old data, they are scanned below */
+	cnt = BE32(fmhdr->erase_peb_count);
+	if (cnt > ptn->length ||
+			!fm_get(fm, fm_size, &pos, cnt * sizeof(*fmec)))
+		goto out;
+
+	/* Assign the used PEBs to their volumes */
+	cnt = BE32(fmhdr->vol_count);
+	if (cnt > UBI_MAX_VOLUMES + 2)
+		goto out;
+	for (i = 0; i < cnt; i++) {
+		fmvhdr = fm_get(fm, fm_size, &pos, sizeof(*fmvhdr));
+		fm_eba = fm_get(fm, fm_size, &pos, sizeof(*fm_eba));
+		if (!fmvhdr || !fm_eba ||
+				BE32(fmvhdr->magic) != UBI_FM_VHDR_MAGIC ||
+				BE32(fm_eba->magic) != UBI_FM_EBA_MAGIC)
+			goto out;
+
+		vol_id = BE32(fmvhdr->vol_id);
+		reserved_pebs = BE32(fm_eba->reserved_pebs);
+		if (reserved_pebs > ptn->length)
+			goto out;
+		eba = fm_get(fm, fm_size, &pos, reserved_pebs * sizeof(*eba));
+		if (!eba)
+			goto out;
+
+		for (j = 0; j < reserved_pebs; j++) {
+			pnum = BE32(eba[j]);
+			if ((int)pnum < 0 || pnum < first)
+				continue;
+			if (pnum >= ptn->length ||
+					si->pebs_data[pnum].status != UBI_USED_PEB)
+				goto out;
+			si->pebs_data[pnum].volume = vol_id;
+			si->pebs_data[pnum].lnum = j;
+			si->pebs_data[pnum].sqnum = sqnum;
+			if (vol_id == UBI_LAYOUT_VOLUME_ID)
+				add_vtbl_peb(si, pnum);
+		}
+	}
+
+	/* Scan the pools and everything the fastmap doesn't know about */
+	for (i = first; i < ptn->length; i++)
+		if (si->pebs_data[i].status == UBI_UNKNOWN)
+			scan_peb(si, ptn->start, i, ec_hdr);
+
+	ret = 0;
+out:
+	if (ret)
+		dprintf(CRITICAL, "attach_fastmap: Inconsistent fastmap\n");
+	free(fm);
+	return ret;
+}
+
 /**
  * scan_partition() - Collect the ec_headers info of a given partition
  * @ptn: partition to read the headers of
  *
+ * The first UBI_FM_MAX_START PEBs are always scanned. If they hold a valid
+ * fastmap the rest is taken from it, otherwise all PEBs are scanned.
+ *
  * Returns allocated and filled struct ubi_scan_info (si).
  * Note: si should be released by caller.
  */
 static struct ubi_scan_info *scan_partition(struct ptentry *ptn)
 {
-	struct ubi_scan_info *si;
+	struct ubi_scan_info *si, saved_si;
 	struct ubi_ec_hdr *ec_hdr;
-	struct ubi_vid_hdr vid_hdr;
-	unsigned i;
+	unsigned i, first;
 	unsigned long long sum = 0;
-	int page_size = flash_page_size();
-	int ret;
 
 	si = malloc(sizeof(*si));
 	if (!si) {
@@ -541,78 +834,21 @@ static struct ubi_scan_info *scan_partition(struct ptentry *ptn)
 	si->vtbl_peb1 = -1;
 	si->vtbl_peb2 = -1;
 	si->fastmap_sb = -1;
-	for (i = 0; i < ptn->length; i++){
-		ret = read_ec_hdr(ptn->start + i, ec_hdr);
-		switch (ret) {
-		case 1:
-			si->empty_cnt++;
-			si->pebs_data[i].ec = UBI_MAX_ERASECOUNTER;
-			si->pebs_data[i].status = UBI_EMPTY_PEB;
-			break;
-		case 0:
-			if (!si->vid_hdr_offs) {
-				si->vid_hdr_offs = BE32(ec_hdr->vid_hdr_offset);
-				si->data_offs = BE32(ec_hdr->data_offset);
-				if (!si->vid_hdr_offs || !si->data_offs ||
-					si->vid_hdr_offs % page_size ||
-					si->data_offs % page_size) {
-					si->bad_cnt++;
-					si->pebs_data[i].ec = UBI_MAX_ERASECOUNTER;
-					si->vid_hdr_offs = 0;
-					continue;
-				}
-				if (BE32(ec_hdr->vid_hdr_offset) != si->vid_hdr_offs) {
-					si->bad_cnt++;
-					si->pebs_data[i].ec = UBI_MAX_ERASECOUNTER;
-					continue;
-				}
-				if (BE32(ec_hdr->data_offset) != si->data_offs) {
-					si->bad_cnt++;
-					si->pebs_data[i].ec = UBI_MAX_ERASECOUNTER;
-					continue;
-				}
-			}
-			si->read_image_seq = BE32(ec_hdr->image_seq);
-			si->pebs_data[i].ec = BE64(ec_hdr->ec);
-			/* Now read the VID header to find if the peb is free */
-			ret = read_vid_hdr(ptn->start + i, &vid_hdr,
-					BE32(ec_hdr->vid_hdr_offset));
-			switch (ret) {
-			case 1:
-				si->pebs_data[i].status = UBI_FREE_PEB;
-				si->free_cnt++;
-				break;
-			case 0:
-				si->pebs_data[i].status = UBI_USED_PEB;
-				si->pebs_data[i].volume = BE32(vid_hdr.vol_id);
-				if (BE32(vid_hdr.vol_id) == UBI_LAYOUT_VOLUME_ID) {
-					if (si->vtbl_peb1 == -1)
-						si->vtbl_peb1 = i;
-					else if (si->vtbl_peb2 == -1)
-						si->vtbl_peb2 = i;
-					else
-						dprintf(CRITICAL,
-							"scan_partition: Found > 2 copies of vtbl");
-				}
-				if (BE32(vid_hdr.vol_id) == UBI_FM_SB_VOLUME_ID)
-					si->fastmap_sb = i;
-				si->used_cnt++;
-				break;
-			case -1:
-			default:
-				si->bad_cnt++;
-				si->pebs_data[i].ec = UBI_MAX_ERASECOUNTER;
-				si->pebs_data[i].status = UBI_BAD_PEB;
-				break;
-			}
-			break;
-		case -1:
-		default:
-			si->bad_cnt++;
-			si->pebs_data[i].ec = UBI_MAX_ERASECOUNTER;
-			si->pebs_data[i].status = UBI_BAD_PEB;
-			break;
-		}
+
+	first = MIN(ptn->length, UBI_FM_MAX_START);
+	for (i = 0; i < first; i++)
+		scan_peb(si, ptn->start, i, ec_hdr);
+
+	saved_si = *si;
+	if (si->fastmap_sb > -1 && !attach_fastmap(si, ptn, first, ec_hdr)) {
+		dprintf(INFO, "scan_partition: (%s) Attached from fastmap\n",
+				ptn->name);
+	} else {
+		*si = saved_si;
+		memset((void *)(si->pebs_data + first), 0,
+				(ptn->length - first) * sizeof(struct peb_info));
+		for (i = first; i < ptn->length; i++)
+			scan_peb(si, ptn->start, i, ec_hdr);
 	}
 
 	/* Sanity check */
@@ -673,7 +909,7 @@ static void update_ec_header(struct ubi_ec_hdr *old_ech,
 		old_ech->version = UBI_VERSION;
 	}
 	old_ech->image_seq = BE32(si->image_seq);
-	crc = mtd_crc32(UBI_CRC32_INIT,
+	crc = crc32(UBI_CRC32_INIT,
 			(const void *)old_ech, UBI_EC_HDR_SIZE_CRC);
 	old_ech->hdr_crc = BE32(crc);
 }
@@ -694,7 +930,7 @@ static void update_vid_header(struct ubi_vid_hdr *vid_hdr,
 
 	vid_hdr->magic = BE32(UBI_VID_HDR_MAGIC);
 	vid_hdr->version = UBI_VERSION;
-	crc = mtd_crc32(UBI_CRC32_INIT,
+	crc = crc32(UBI_CRC32_INIT,
 			(const void *)vid_hdr, UBI_VID_HDR_SIZE_CRC);
 	vid_hdr->hdr_crc = BE32(crc);
 }
@@ -789,17 +1025,95 @@ static void remove_F_flag(const void *leb_data)
 		return;
 	if (ubifs_sb->flags & UBIFS_FLG_SPACE_FIXUP) {
 		ubifs_sb->flags &= (~UBIFS_FLG_SPACE_FIXUP);
-		ch->crc = mtd_crc32(UBIFS_CRC32_INIT, (void *)ubifs_sb + 8,
+		ch->crc = crc32(UBIFS_CRC32_INIT, (void *)ubifs_sb + 8,
 				sizeof(struct ubifs_sb_node) - 8);
 	}
 }
 
+/**
+ * img_peb_pages() - Check one PEB of the image to flash
+ * @img_peb: the PEB in the image
+ * @len: size of the PEB data in the image, at most one block
+ *
+ * PEBs holding only 0xFF bytes carry no UBI data. They are flashed like the
+ * free PEBs after the end of the image.
+ *
+ * Returns:
+ * -1 - if the PEB is not a valid UBI PEB
+ *  0 - if the PEB is empty
+ *  number of pages to write otherwise
+ */
+static int img_peb_pages(const void *img_peb, unsigned len)
+{
+	unsigned page_size = flash_page_size();
+	unsigned block_size = flash_block_size();
+	const struct ubi_ec_hdr *ech = img_peb;
+	unsigned peb_valid_sz;
+	int num_pages;
+
+	if (check_pattern(img_peb, 0xFF, len))
+		return 0;
+
+	if (len < block_size)
+		num_pages = len / page_size;
+	else
+		num_pages = calc_data_len(page_size, img_peb, block_size);
+
+	/* Total size of valid data in peb */
+	peb_valid_sz = num_pages * page_size;
+
+	if (len < UBI_MAGIC_SIZE)
+	{
+		dprintf(CRITICAL, "flash_ubi_img: invalid size provided.\n");
+		return -1;
+	}
+
+	/*
+	* Check for oob access if any in img_peb.
+	*/
+	if (memcmp(img_peb, UBI_MAGIC, UBI_MAGIC_SIZE) ||
+		BE32(ech->vid_hdr_offset) > peb_valid_sz ||
+		BE32(ech->data_offset) > peb_valid_sz)
+	{
+		dprintf(CRITICAL, "flash_ubi_img: invalid image peb found\n");
+		return -1;
+	}
+	return num_pages;
+}
+
+/**
+ * ubi_free_peb() - Prepare a PEB without data of the flashed image
+ * @peb_num: number of the PEB
+ * @si: UBI scan information
+ * @ptn_start: first PEB of the flashed partition
+ * @keep_empty: leave PEBs that were found empty untouched
+ *
+ * Empty PEBs (no EC header) are valid for UBI, the kernel erases them and
+ * writes the EC header itself when attaching. Erasing them here would only
+ * cost time and another erase cycle.
+ *
+ * Returns: -1 on error
+ *           0 on success
+ */
+static int ubi_free_peb(int peb_num, struct ubi_scan_info *si,
+		int ptn_start, bool keep_empty)
+{
+	if (keep_empty &&
+			si->pebs_data[peb_num - ptn_start].status == UBI_EMPTY_PEB)
+		return 0;
+	return ubi_erase_peb(peb_num, si, ptn_start);
+}
+
 /**
  * flash_ubi_img() - Write the provided (UBI) image to given partition
  * @ptn: partition to write the image to
  * @data: the image to write
  * @size: size of the image to write
  *
+ * The whole image is checked before anything is erased. PEBs without data
+ * that were already found empty are not erased again, unless the image has
+ * a fastmap (which expects all free PEBs to have an EC header).
+ *
  *  Return codes:
  * -1 - in case of error
  *  0 - on success
@@ -818,7 +1132,18 @@ int flash_ubi_img(struct ptentry *ptn, void *data, unsigned size)
 	int bad_blocks_cnt = 0;
 	uint32_t fmsb_peb = UINT_MAX;
 	int is_fmsb_peb_valid = 0;
-	unsigned peb_valid_sz= 0;
+	bool img_has_fm = false;
+	unsigned offs, len;
+
+	/* Check the image first, don't leave a half erased partition behind */
+	for (offs = 0; offs < size; offs += block_size) {
+		len = MIN(size - offs, block_size);
+		num_pages = img_peb_pages(data + offs, len);
+		if (num_pages < 0)
+			return -1;
+		if (num_pages && fastmap_present(data + offs))
+			img_has_fm = true;
+	}
 
 	si = scan_partition(ptn);
 	if (!si) {
@@ -839,6 +1164,15 @@ int flash_ubi_img(struct ptentry *ptn, void *data, unsigned size)
 	/* Update the "to be" flashed image and flash it */
 	img_peb = data;
 	while (size && curr_peb < ptn->start + ptn->length) {
+		len = MIN(size, block_size);
+		num_pages = img_peb_pages(img_peb, len);
+
+		if (!num_pages) {
+			if (ubi_free_peb(curr_peb, si, ptn->start, !img_has_fm))
+				bad_blocks_cnt++;
+			goto next;
+		}
+
 		if (qpic_nand_blk_erase(curr_peb * num_pages_per_blk)) {
 			dprintf(CRITICAL, "flash_ubi_img: erase of %d failed\n",
 				curr_peb);
@@ -847,31 +1181,6 @@ int flash_ubi_img(struct ptentry *ptn, void *data, unsigned size)
 			continue;
 		}
 
-		if (size < block_size)
-			num_pages = size / page_size;
-		else
-			num_pages = calc_data_len(page_size, img_peb, block_size);
-
-		/* Total size of valid data in peb */
-		peb_valid_sz = num_pages * page_size;
-
-		if (size < UBI_MAGIC_SIZE)
-		{
-			dprintf(CRITICAL, "flash_ubi_img: invalid size provided.\n");
-			return -1;
-		}
-
-		/*
-		* Check for oob access if any in img_peb.
-		*/
-		if (memcmp(img_peb, UBI_MAGIC, UBI_MAGIC_SIZE) ||
-			BE32(((struct ubi_ec_hdr *)img_peb)->vid_hdr_offset) > peb_valid_sz ||
-			BE32(((struct ubi_ec_hdr *)img_peb)->data_offset) > peb_valid_sz)
-		{
-			dprintf(CRITICAL, "flash_ubi_img: invalid image peb found\n");
-			return -1;
-		}
-
 		remove_F_flag(img_peb);
 		/* Update the ec_header in the image */
 		old_ech = (struct ubi_ec_hdr *)img_peb;
@@ -886,15 +1195,13 @@ int flash_ubi_img(struct ptentry *ptn, void *data, unsigned size)
 			curr_peb++;
 			continue;
 		}
-		if (size < block_size)
-			size = 0;
-		else
-			size -= block_size;
 
 		if (fastmap_present(img_peb)) {
 			fmsb_peb = curr_peb;
 			is_fmsb_peb_valid = 1;
 		}
+next:
+		size -= len;
 		img_peb += flash_block_size();
 		curr_peb++;
 	}
@@ -908,7 +1215,7 @@ int flash_ubi_img(struct ptentry *ptn, void *data, unsigned size)
 
 	/* Erase and write ec_header for the rest of the blocks */
 	for (; curr_peb < ptn->start + ptn->length; curr_peb++)
-		if (ubi_erase_peb(curr_peb, si, ptn->start))
+		if (ubi_free_peb(curr_peb, si, ptn->start, !img_has_fm))
 			bad_blocks_cnt++;
 
 	ret = 0;
@@ -1144,4 +1451,201 @@ out:
 	return ret;
 }
 
+/**
+ * ubi_is_present() - Check if a partition holds UBI without scanning it
+ * @ptn: partition to check
+ *
+ * Returns true if one of the first good PEBs starts with an EC header.
+ */
+static bool ubi_is_present(struct ptentry *ptn)
+{
+	int page_size = flash_page_size();
+	int num_pages_per_blk = flash_block_size() / page_size;
+	unsigned char *buf;
+	bool ret = false;
+	unsigned i;
+
+	buf = malloc(page_size + flash_spare_size());
+	if (!buf)
+		return false;
 
+	for (i = 0; i < ptn->length && i < 4; i++) {
+		if (qpic_nand_block_isbad((ptn->start + i) * num_pages_per_blk))
+			continue;
+		if (!qpic_nand_read((ptn->start + i) * num_pages_per_blk, 1,
+				buf, buf + page_size))
+			ret = !memcmp(buf, UBI_MAGIC, UBI_MAGIC_SIZE);
+		break;
+	}
+
+	free(buf);
+	return ret;
+}
+
+/**
+ * ubi_scan_volumes() - Find the volumes of a UBI partition
+ * @ptn: partition holding the volumes
+ * @vols: returns allocated array of the found volumes
+ *
+ * The LEBs of each volume are mapped to the newest PEB holding them, so the
+ * volumes can be read with ubi_read_leb().
+ * Note: vols and the pebs of each volume should be released by caller.
+ *
+ * Returns the number of volumes, -1 in case of error.
+ */
+int ubi_scan_volumes(struct ptentry *ptn, struct ubi_volume **vols)
+{
+	struct ubi_scan_info *si;
+	struct ubi_vtbl_record *rec;
+	struct ubi_volume *vol;
+	unsigned block_size = flash_block_size();
+	unsigned i, lnum, vtbl_records, name_len;
+	int n, vtbl_peb, cnt = 0;
+	void *vtbl = NULL;
+
+	*vols = NULL;
+	if (!ubi_is_present(ptn))
+		return 0;
+
+	si = scan_partition(ptn);
+	if (!si)
+		return -1;
+	if (si->vtbl_peb1 < 0)
+		goto out;
+
+	vtbl_records = (block_size - si->data_offs) / UBI_VTBL_RECORD_SIZE;
+	if (vtbl_records > UBI_MAX_VOLUMES)
+		vtbl_records = UBI_MAX_VOLUMES;
+
+	vtbl = malloc(block_size - si->data_offs);
+	*vols = calloc(vtbl_records, sizeof(struct ubi_volume));
+	if (!vtbl || !*vols) {
+		dprintf(CRITICAL, "ubi_scan_volumes: Memory allocation failed\n");
+		goto out_failed;
+	}
+
+	vtbl_peb = si->vtbl_peb1;
+	while (read_leb_data(ptn->start + vtbl_peb, vtbl,
+			block_size - si->data_offs, si->data_offs)) {
+		if (vtbl_peb == si->vtbl_peb2 || si->vtbl_peb2 < 0)
+			goto out_failed;
+		vtbl_peb = si->vtbl_peb2;
+	}
+
+	for (i = 0; i < vtbl_records; i++) {
+		rec = (struct ubi_vtbl_record *)(vtbl + UBI_VTBL_RECORD_SIZE * i);
+		if (!rec->reserved_pebs || !rec->vol_type)
+			continue;
+		if (BE32(rec->crc) != crc32(UBI_CRC32_INIT, rec,
+				UBI_VTBL_RECORD_SIZE_CRC) ||
+				BE32(rec->reserved_pebs) > ptn->length)
+			continue;
+
+		vol = &(*vols)[cnt];
+		name_len = MIN(BE16(rec->name_len), UBI_VOL_NAME_MAX);
+		memcpy(vol->name, rec->name, name_len);
+		vol->name[name_len] = '\0';
+		vol->vol_id = i;
+		vol->leb_size = block_size - si->data_offs - BE32(rec->data_pad);
+		vol->leb_count = BE32(rec->reserved_pebs);
+		vol->data_offs = si->data_offs;
+		vol->pebs = malloc(vol->leb_count * sizeof(int));
+		if (!vol->pebs)
+			goto out_failed;
+		memset(vol->pebs, 0xff, vol->leb_count * sizeof(int));
+		cnt++;
+
+		for (n = 0; n < (int)ptn->length; n++) {
+			if (si->pebs_data[n].status != UBI_USED_PEB ||
+					si->pebs_data[n].volume != vol->vol_id)
+				continue;
+			lnum = si->pebs_data[n].lnum;
+			if (lnum >= vol->leb_count)
+				continue;
+			if (vol->pebs[lnum] >= 0 &&
+					si->pebs_data[vol->pebs[lnum] - ptn->start].sqnum >
+					si->pebs_data[n].sqnum)
+				continue;
+			vol->pebs[lnum] = ptn->start + n;
+		}
+	}
+
+out:
+	free(vtbl);
+	free(si->pebs_data);
+	free(si);
+	return cnt;
+
+out_failed:
+	while (cnt--)
+		free((*vols)[cnt].pebs);
+	free(*vols);
+	*vols = NULL;
+	cnt = -1;
+	goto out;
+}
+
+/**
+ * ubi_read_leb() - Read data from a LEB of a volume
+ * @vol: the volume, found by ubi_scan_volumes()
+ * @lnum: LEB number
+ * @offset: offset in the LEB
+ * @buf: buffer where to store the read data
+ * @len: number of bytes to read, must not cross the end of the LEB
+ *
+ * Whole pages are read directly into @buf. Unmapped LEBs read as 0xFF.
+ *
+ * Return codes:
+ * -1 - in case of error
+ *  0 - on success
+ */
+int ubi_read_leb(const struct ubi_volume *vol, unsigned lnum,
+		unsigned offset, void *buf, unsigned len)
+{
+	unsigned page_size = flash_page_size();
+	unsigned num_pages_per_blk = flash_block_size() / page_size;
+	unsigned char *tmp_buf;
+	unsigned page, in_page, n;
+	int ret = -1;
+
+	if (lnum >= vol->leb_count || offset + len > vol->leb_size)
+		return -1;
+
+	if (vol->pebs[lnum] < 0) {
+		memset(buf, 0xff, len);
+		return 0;
+	}
+
+	tmp_buf = malloc(page_size + flash_spare_size());
+	if (!tmp_buf) {
+		dprintf(CRITICAL, "ubi_read_leb: Mem allocation failed\n");
+		return -1;
+	}
+
+	offset += vol->data_offs;
+	page = vol->pebs[lnum] * num_pages_per_blk;
+	while (len) {
+		in_page = offset % page_size;
+		if (!in_page && len >= page_size) {
+			n = len / page_size;
+			if (qpic_nand_read(page + offset / page_size, n, buf,
+					tmp_buf + page_size))
+				goto out;
+			n *= page_size;
+		} else {
+			n = MIN(len, page_size - in_page);
+			if (qpic_nand_read(page + offset / page_size, 1, tmp_buf,
+					tmp_buf + page_size))
+				goto out;
+			memcpy(buf, tmp_buf + in_page, n);
+		}
+		buf += n;
+		offset += n;
+		len -= n;
+	}
+
+	ret = 0;
+out:
+	free(tmp_buf);
+	return ret;
+}
@@ -38,15 +38,25 @@
 #include <platform/irqs.h>
 #include <platform/interrupts.h>
 #include <platform/timer.h>
+#include <kernel/ktrace.h>
 #include <kernel/thread.h>
 #include <reg.h>
 #include <dev/udc.h>
 #include <target.h>
 #include "hsusb.h"
 
+/*
+ * A TD points to 5 pages and the transfer may start anywhere in the first
+ * one. This covers at least 16 KiB, or 20 KiB once the buffer is page aligned.
+ */
+#define TD_PAGES          5
 #define MAX_TD_XFER_SIZE  (16 * 1024)
-
-BUF_DMA_ALIGN(transfer_desc_item, ROUNDUP(sizeof(struct ept_queue_item), CACHE_LINE));
+/*
+ * Each request owns a chain of TDs, so that large transfers are done by the
+ * controller in one go without idling between TDs.
+ */
+#define MAX_TDS_PER_REQ   256
+#define MAX_REQ_XFER_SIZE (MAX_TDS_PER_REQ * MAX_TD_XFER_SIZE)
 
 /* common code - factor out into a shared file */
 
@@ -263,56 +273,47 @@ struct udc_request *udc_request_alloc(void)
 	ASSERT(req);
 	req->req.buf = 0;
 	req->req.length = 0;
-	req->item = memalign(CACHE_LINE, ROUNDUP(sizeof(struct ept_queue_item),
+	req->item = memalign(CACHE_LINE, ROUNDUP(MAX_TDS_PER_REQ * sizeof(struct ept_queue_item),
 								CACHE_LINE));
+	ASSERT(req->item);
 	return &req->req;
 }
 
-void udc_request_free(struct udc_request *req)
+void udc_request_free(struct udc_request *_req)
 {
+	struct usb_request *req = (struct usb_request *)_req;
+
+	free(req->item);
 	free(req);
 }
 
+static unsigned td_xfer_size(unsigned phys)
+{
+	return TD_PAGES * 0x1000 - (phys & 0xfff);
+}
+
 /*
- * Assumes that TDs allocated already are not freed.
- * But it can handle case where TDs are freed as well.
+ * Requests up to MAX_REQ_XFER_SIZE are split over the TDs of the request,
+ * the controller walks the whole chain after a single prime. Only the first
+ * TD may start in the middle of a page, all others are filled completely.
  */
 int udc_request_queue(struct udc_endpoint *ept, struct udc_request *_req)
 {
 	unsigned xfer = 0;
-	struct ept_queue_item *item, *curr_item;
+	struct ept_queue_item *item;
 	struct usb_request *req = (struct usb_request *)_req;
 	unsigned phys = (unsigned)req->req.buf;
 	unsigned len = req->req.length;
+	unsigned count = 0;
 
-	xfer = (len > MAX_TD_XFER_SIZE) ? MAX_TD_XFER_SIZE : len;
-	/*
-	 * First TD allocated during request allocation
-	 */
-	curr_item = req->item;
-	curr_item->info = INFO_BYTES(xfer) | INFO_ACTIVE;
-	curr_item->page0 = phys;
-	curr_item->page1 = (phys & 0xfffff000) + 0x1000;
-	curr_item->page2 = (phys & 0xfffff000) + 0x2000;
-	curr_item->page3 = (phys & 0xfffff000) + 0x3000;
-	curr_item->page4 = (phys & 0xfffff000) + 0x4000;
-	phys += xfer;
-	len -= xfer;
-
-	/*
-	 * If transfer length is more then
-	 * accomodate by 1 TD
-	 * we add more transfer descriptors
-	 */
-	while (len > 0) {
-		xfer = (len > MAX_TD_XFER_SIZE) ? MAX_TD_XFER_SIZE : len;
-		if (curr_item->next == TERMINATE) {
-				curr_item->next = PA((addr_t)transfer_desc_item);
-				item = (struct ept_queue_item *)transfer_desc_item;
-				item->next = TERMINATE;
-		} else
-			/* Since next TD in chain already exists */
-			item = (struct ept_queue_item *)VA(curr_item->next);
+	if (len > MAX_REQ_XFER_SIZE) {
+		dprintf(CRITICAL, "udc_request_queue: transfer too large: %u\n", len);
+		return -1;
+	}
+
+	do {
+		xfer = MIN(len, td_xfer_size(phys));
+		item = &req->item[count++];
 
 		/* Update TD with transfer information */
 		item->info = INFO_BYTES(xfer) | INFO_ACTIVE;
@@ -321,15 +322,15 @@ int udc_request_queue(struct udc_endpoint *ept, struct udc_request *_req)
 		item->page2 = (phys & 0xfffff000) + 0x2000;
 		item->page3 = (phys & 0xfffff000) + 0x3000;
 		item->page4 = (phys & 0xfffff000) + 0x4000;
+		item->next = PA((addr_t)(item + 1));
 
-		curr_item = item;
 		len -= xfer;
 		phys += xfer;
-	}
+	} while (len > 0);
 
 	/* Terminate and set interrupt for last TD */
-	curr_item->next = TERMINATE;
-	curr_item->info |= INFO_IOC;
+	item->next = TERMINATE;
+	item->info |= INFO_IOC;
 	enter_critical_section();
 	ept->head->next = PA((addr_t)req->item);
 	ept->head->info = 0;
@@ -343,17 +344,9 @@ int udc_request_queue(struct udc_endpoint *ept, struct udc_request *_req)
 	arch_clean_invalidate_cache_range((addr_t) VA((addr_t)req->req.buf),
 					  req->req.length);
 
-	item = req->item;
 	/* Write all TD's to memory from cache */
-	while (item != NULL) {
-		curr_item = item;
-		if (curr_item->next == TERMINATE)
-			item = NULL;
-		else
-			item =  (struct ept_queue_item *)curr_item->next;
-		arch_clean_invalidate_cache_range((addr_t) curr_item,
-					  sizeof(struct ept_queue_item));
-	}
+	arch_clean_invalidate_cache_range((addr_t) req->item,
+					  count * sizeof(struct ept_queue_item));
 
 	DBG("ept%d %s queue req=%p\n", ept->num, ept->in ? "in" : "out", req);
 	writel(ept->bit, USB_ENDPTPRIME);
@@ -424,17 +417,18 @@ static void handle_ept_complete(struct udc_endpoint *ept)
 				/*
 				 * Since we are not in last TD
 				 * the total assumed transfer ascribed to this
-				 * TD woulb the max possible TD transfer size
-				 * (16K)
+				 * TD would be the max possible TD transfer size
+				 * (up to the end of its last page)
 				 */
-				actual += (MAX_TD_XFER_SIZE - (item->info >> 16)) & 0x7FFF;
-				total_len -= (MAX_TD_XFER_SIZE - (item->info >> 16)) & 0x7FFF;
+				actual += (td_xfer_size(item->page0) - (item->info >> 16)) & 0x7FFF;
+				total_len -= (td_xfer_size(item->page0) - (item->info >> 16)) & 0x7FFF;
 				/*Move to next item in chain*/
 				item = (struct ept_queue_item *)VA(item->next);
 			}
 		}
 		status = 0;
 out:
+		ktrace(KTRACE_USB_DONE, (uintptr_t)req, actual, status);
 		if (req->req.complete)
 			req->req.complete(&req->req, actual, status);
 	}
@@ -41,6 +41,192 @@ const char hash_identifier[] = {
 	0x04, 0x02, 0x01, 0x05, 0x00, 0x04, 0x20
 };
 
+/*
+ * The embedded OEM keys never change, so the values needed for Montgomery
+ * multiplication (R^2 mod n and -1/n[0] mod 2^32) are calculated only once.
+ * The public operation with e = 65537 is then just 17 multiplications,
+ * without going through the bignum code of OpenSSL for each signature.
+ */
+#define RSA_FIXED_WORDS		(SIGNATURE_SIZE / 4)
+#define RSA_FIXED_EXPONENT	65537
+
+struct rsa_fixed_key {
+	bool tried;
+	bool valid;
+	uint32_t n0inv;
+	uint32_t n[RSA_FIXED_WORDS];	/* little-endian word order */
+	uint32_t rr[RSA_FIXED_WORDS];
+};
+
+/* For the default OEM certificate and the LE one */
+static struct rsa_fixed_key fixed_keys[2];
+
+/* Returns the low word of a * b + c + *carry, and the high word in *carry */
+static inline uint32_t rsa_mac(uint32_t a, uint32_t b, uint32_t c, uint32_t *carry)
+{
+#if ARM_ISA_ARMv7
+	uint32_t hi = *carry;
+
+	__asm__("umaal %0, %1, %2, %3" : "+r"(c), "+r"(hi) : "r"(a), "r"(b));
+	*carry = hi;
+	return c;
+#else
+	uint64_t t = (uint64_t)a * b + c + *carry;
+
+	*carry = t >> 32;
+	return (uint32_t)t;
+#endif
+}
+
+/* a[] -= n[], returns the borrow */
+static uint32_t rsa_sub_mod(const struct rsa_fixed_key *key, uint32_t *a)
+{
+	uint64_t t;
+	uint32_t borrow = 0;
+	int i;
+
+	for (i = 0; i < RSA_FIXED_WORDS; i++) {
+		t = (uint64_t)a[i] - key->n[i] - borrow;
+		a[i] = (uint32_t)t;
+		borrow = (t >> 32) & 1;
+	}
+	return borrow;
+}
+
+/* Returns a[] >= n[] */
+static bool rsa_ge_mod(const struct rsa_fixed_key *key, const uint32_t *a)
+{
+	int i;
+
+	for (i = RSA_FIXED_WORDS - 1; i >= 0; i--) {
+		if (a[i] != key->n[i])
+			return a[i] > key->n[i];
+	}
+	return true;
+}
+
+/* c[] = a[] * b[] / R mod n, c[] must not overlap a[] or b[] */
+static void rsa_mont_mul(const struct rsa_fixed_key *key, uint32_t *c,
+			 const uint32_t *a, const uint32_t *b)
+{
+	uint32_t ca, cb, d, lo;
+	uint64_t top;
+	int i, j;
+
+	memset(c, 0, RSA_FIXED_WORDS * sizeof(*c));
+
+	for (i = 0; i < RSA_FIXED_WORDS; i++) {
+		/* c[] = (c[] + a[i] * b[] + d * n[]) / 2^32 */
+		ca = cb = 0;
+		lo = rsa_mac(a[i], b[0], c[0], &ca);
+		d = lo * key->n0inv;
+		rsa_mac(d, key->n[0], lo, &cb);
+
+		for (j = 1; j < RSA_FIXED_WORDS; j++) {
+			lo = rsa_mac(a[i], b[j], c[j], &ca);
+			c[j - 1] = rsa_mac(d, key->n[j], lo, &cb);
+		}
+
+		top = (uint64_t)ca + cb;
+		c[RSA_FIXED_WORDS - 1] = (uint32_t)top;
+		if (top >> 32)
+			rsa_sub_mod(key, c);
+	}
+}
+
+static bool rsa_fixed_key_init(struct rsa_fixed_key *key, RSA *rsa)
+{
+	unsigned char n[SIGNATURE_SIZE];
+	uint32_t inv, carry, w;
+	int i, j;
+
+	if (BN_num_bits(rsa->n) != SIGNATURE_SIZE * 8 ||
+	    !BN_is_word(rsa->e, RSA_FIXED_EXPONENT))
+		return false;
+
+	BN_bn2bin(rsa->n, n);
+	for (i = 0; i < RSA_FIXED_WORDS; i++)
+		key->n[i] = (n[SIGNATURE_SIZE - 4 * i - 4] << 24) |
+			    (n[SIGNATURE_SIZE - 4 * i - 3] << 16) |
+			    (n[SIGNATURE_SIZE - 4 * i - 2] << 8) |
+			    n[SIGNATURE_SIZE - 4 * i - 1];
+
+	/* Newton iteration, each step doubles the number of correct bits */
+	inv = key->n[0];
+	for (i = 0; i < 5; i++)
+		inv *= 2 - key->n[0] * inv;
+	key->n0inv = -inv;
+
+	/* R mod n is R - n since the top bit of n is set, double it to R^2 */
+	memset(key->rr, 0, sizeof(key->rr));
+	rsa_sub_mod(key, key->rr);
+	for (i = 0; i < SIGNATURE_SIZE * 8; i++) {
+		carry = 0;
+		for (j = 0; j < RSA_FIXED_WORDS; j++) {
+			w = key->rr[j];
+			key->rr[j] = (w << 1) | carry;
+			carry = w >> 31;
+		}
+		if (carry || rsa_ge_mod(key, key->rr))
+			rsa_sub_mod(key, key->rr);
+	}
+
+	key->valid = true;
+	return true;
+}
+
+/*
+ * Same as RSA_public_decrypt() with RSA_PKCS1_PADDING.
+ * Returns -1 if decryption failed otherwise size of plain_text in bytes
+ */
+static int rsa_fixed_public_decrypt(const struct rsa_fixed_key *key,
+				    const unsigned char *signature_ptr,
+				    unsigned char *plain_text)
+{
+	uint32_t a[RSA_FIXED_WORDS], ar[RSA_FIXED_WORDS], aar[RSA_FIXED_WORDS];
+	unsigned char out[SIGNATURE_SIZE];
+	int i, pad;
+
+	for (i = 0; i < RSA_FIXED_WORDS; i++)
+		a[i] = (signature_ptr[SIGNATURE_SIZE - 4 * i - 4] << 24) |
+		       (signature_ptr[SIGNATURE_SIZE - 4 * i - 3] << 16) |
+		       (signature_ptr[SIGNATURE_SIZE - 4 * i - 2] << 8) |
+		       signature_ptr[SIGNATURE_SIZE - 4 * i - 1];
+	if (rsa_ge_mod(key, a))
+		return -1;
+
+	/* a^65537 = a * (a^(2^16)) */
+	rsa_mont_mul(key, ar, a, key->rr);	/* aR */
+	for (i = 0; i < 16; i += 2) {
+		rsa_mont_mul(key, aar, ar, ar);
+		rsa_mont_mul(key, ar, aar, aar);
+	}
+	rsa_mont_mul(key, aar, ar, a);		/* back out of Montgomery form */
+	if (rsa_ge_mod(key, aar))
+		rsa_sub_mod(key, aar);
+
+	for (i = 0; i < RSA_FIXED_WORDS; i++) {
+		uint32_t w = aar[RSA_FIXED_WORDS - 1 - i];
+
+		out[4 * i] = w >> 24;
+		out[4 * i + 1] = w >> 16;
+		out[4 * i + 2] = w >> 8;
+		out[4 * i + 3] = w;
+	}
+
+	/* EMSA-PKCS1-v1_5: 00 01 FF..FF (at least 8) 00 data */
+	if (out[0] != 0x00 || out[1] != 0x01)
+		return -1;
+	for (pad = 2; pad < SIGNATURE_SIZE && out[pad] == 0xff; pad++)
+		;
+	if (pad == SIGNATURE_SIZE || out[pad] != 0x00 || pad < 2 + 8)
+		return -1;
+	pad++;
+
+	memcpy(plain_text, out + pad, SIGNATURE_SIZE - pad);
+	return SIGNATURE_SIZE - pad;
+}
+
 /*
  * Returns -1 if decryption failed otherwise size of plain_text in bytes
  */
@@ -75,6 +261,10 @@ image_decrypt_signature(unsigned char *signature_ptr, unsigned char *plain_text)
 	X509 *x509_certificate = NULL;
 	const unsigned char *cert_ptr = NULL;
 	unsigned int cert_size = 0;
+	struct rsa_fixed_key *key = &fixed_keys[is_vb_le_enabled() ? 1 : 0];
+
+	if (key->valid)
+		return rsa_fixed_public_decrypt(key, signature_ptr, plain_text);
 
 	if (is_vb_le_enabled()) {
 		cert_ptr = (const unsigned char *)LE_OEM_CERTIFICATE;
@@ -111,6 +301,12 @@ image_decrypt_signature(unsigned char *signature_ptr, unsigned char *plain_text)
 	dprintf(SPEW, "DEBUG openssl: Return of RSA_public_decrypt = %d\n",
 		ret);
 
+	/* Other keys (size, exponent) stay with OpenSSL */
+	if (!key->tried) {
+		key->tried = true;
+		rsa_fixed_key_init(key, rsa_key);
+	}
+
  cleanup:
 	if (rsa_key != NULL)
 		RSA_free(rsa_key);
@@ -152,11 +348,30 @@ image_verify(unsigned char *image_ptr,
 	     unsigned char *signature_ptr,
 	     unsigned int image_size, unsigned hash_type)
 {
+	unsigned int digest[8];
+
+	/*
+	 * Calculate hash of image and save calculated hash on TZ.
+	 */
+	image_find_digest(image_ptr, image_size, hash_type,
+			(unsigned char *)&digest);
+
+	return image_verify_digest((unsigned char *)&digest, signature_ptr,
+				   hash_type);
+}
+
+/*
+ * Same as image_verify(), but with the digest of the image calculated
+ * already, e.g. while the image was read.
+ */
+int
+image_verify_digest(unsigned char *digest,
+		    unsigned char *signature_ptr, unsigned hash_type)
+{
 
 	int ret = -1;
 	int auth = 0;
 	unsigned char *plain_text = NULL;
-	unsigned int digest[8];
 	int hash_size;
 
 	plain_text = (unsigned char *)calloc(sizeof(char), SIGNATURE_SIZE);
@@ -165,15 +380,10 @@ image_verify(unsigned char *image_ptr,
 		goto cleanup;
 	}
 
-	/*
-	 * Calculate hash of image and save calculated hash on TZ.
-	 */
 	hash_size =
 	    (hash_type == CRYPTO_AUTH_ALG_SHA256) ? SHA256_SIZE : SHA1_SIZE;
-	image_find_digest(image_ptr, image_size, hash_type,
-			(unsigned char *)&digest);
 #ifdef TZ_SAVE_KERNEL_HASH
-	save_kernel_hash((unsigned char *) &digest, hash_type);
+	save_kernel_hash(digest, hash_type);
 #endif
 
 	/*
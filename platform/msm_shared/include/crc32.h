@@ -28,3 +28,7 @@
 
 /* API to calculate CRC32 */
 uint32_t crc32(uint32_t crc, const void *buf, size_t size);
+/* API to calculate CRC32 of data repeated count times, e.g. a fill pattern */
+uint32_t crc32_repeat(uint32_t crc, const void *buf, size_t size, uint64_t count);
+/* API to calculate CRC32C (Castagnoli), e.g. for ext4 metadata checksums */
+uint32_t crc32c(uint32_t crc, const void *buf, size_t size);
@@ -96,6 +96,12 @@
 
 #define CRYPTO_MAX_THRESHOLD            (32 * 1024)
 
+/* Minimum number of descriptors in the write fifo. One operation can hash up to
+ * (size - 2) * max_desc_len bytes, so this queues about 64 MiB with a single
+ * wait instead of waiting and reprogramming the CE every 4 MiB.
+ */
+#define CRYPTO_WRITE_FIFO_MIN_SIZE      1024
+
 /* Basic CE setting to put the CE in HS mode. */
 #define CRYPTO_RESET_CONFIG             0xE000F
 
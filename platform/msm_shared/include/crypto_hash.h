@@ -30,6 +30,7 @@
 #define __CRYPTO_HASH_H__
 
 #include <sys/types.h>
+#include <sha_sw.h>
 
 #ifndef NULL
 #define NULL		0
@@ -84,6 +85,18 @@ typedef struct {
 	unsigned int auth_iv[8];
 } crypto_SHA256_ctx;
 
+/* Context of a hash computed over several buffers */
+typedef struct {
+	unsigned char auth_alg;
+	bool first;
+	bool sw;
+	union {
+		crypto_SHA1_ctx sha1;
+		crypto_SHA256_ctx sha256;
+		crypto_sha_sw_ctx sw;
+	} ctx;
+} crypto_hash_ctx;
+
 extern void crypto_eng_reset(void);
 
 extern void crypto_eng_init(void);
@@ -135,5 +148,14 @@ crypto_result_type
 hash_find(unsigned char *addr, unsigned int size, unsigned char *digest,
           unsigned char auth_alg);
 
+crypto_result_type
+hash_find_start(crypto_hash_ctx *hash_ctx, unsigned char auth_alg);
+crypto_result_type
+hash_find_update(crypto_hash_ctx *hash_ctx, unsigned char *addr,
+		 unsigned int size);
+crypto_result_type
+hash_find_finish(crypto_hash_ctx *hash_ctx, unsigned char *addr,
+		 unsigned int size, unsigned char *digest);
+
 crypto_engine_type board_ce_type(void);
 #endif
@@ -48,7 +48,12 @@
 #define DTB_MAGIC               0xedfe0dd0
 #define DTB_OFFSET              0x2C
 
+#if WITH_LK2ND_BOOTSTATS
+/* Leave space for the boot timing table in /chosen */
+#define DTB_PAD_SIZE            4096
+#else
 #define DTB_PAD_SIZE            1024
+#endif
 #define DTBO_TABLE_MAGIC        0xD7B7AB1E
 #define DTBO_CUSTOM_MAX         4
 #define PLATFORM_FOUNDRY_SHIFT  16
@@ -47,6 +47,34 @@
 #define UICCMDR_DME_HIBERNATE_EXIT                       0x18
 #define UICCMDR_DME_TEST_MODE                            0x1a
 
+/* UniPro PHY adapter attributes */
+#define PA_ACTIVE_TX_DATA_LANES                          0x1560
+#define PA_CONNECTED_TX_DATA_LANES                       0x1561
+#define PA_TX_GEAR                                       0x1568
+#define PA_TX_TERMINATION                                0x1569
+#define PA_HS_SERIES                                     0x156A
+#define PA_PWR_MODE                                      0x1571
+#define PA_ACTIVE_RX_DATA_LANES                          0x1580
+#define PA_CONNECTED_RX_DATA_LANES                       0x1581
+#define PA_RX_GEAR                                       0x1583
+#define PA_RX_TERMINATION                                0x1584
+#define PA_MAX_RX_HS_GEAR                                0x1587
+#define PA_PWR_MODE_USER_DATA(n)                         (0x15B0 + (n))
+
+/* UniPro data link layer attributes */
+#define DME_LOCAL_FC0_PROTECTION_TIMEOUT                 0xD041
+#define DME_LOCAL_TC0_REPLAY_TIMEOUT                     0xD042
+#define DME_LOCAL_AFC0_REQ_TIMEOUT                       0xD043
+
+/* Default data link layer timeouts for the power mode change */
+#define DL_FC_PROTECTION_TIMEOUT_VAL                     8191
+#define DL_TC_REPLAY_TIMEOUT_VAL                         65535
+#define DL_AFC_REQ_TIMEOUT_VAL                           32767
+
+#define PA_FAST_MODE                                     1
+#define PA_HS_SERIES_A                                   1
+#define PA_HS_SERIES_B                                   2
+
 /* Retry value for commands. */
 #define DME_NOP_NUM_RETRIES                              20
 #define DME_FDEVICEINIT_RETRIES                          20
@@ -233,6 +261,8 @@ struct ufs_string_desc
 
 int dme_send_linkstartup_req(struct ufs_dev *dev);
 int dme_get_req(struct ufs_dev *dev, struct dme_get_req_type *req);
+int dme_peer_get_req(struct ufs_dev *dev, struct dme_get_req_type *req);
+int dme_set_req(struct ufs_dev *dev, uint16_t attribute, uint32_t val);
 int utp_build_query_req_upiu(struct upiu_trans_mgmt_query_hdr *req_upiu,
 								  struct upiu_req_build_type *upiu_data);
 
@@ -79,6 +79,9 @@
 #define DTYPE_GEN_LWRITE 0x29	/* 4th Byte is 0xc0 */
 #define DTYPE_DCS_WRITE1 0x15	/* 4th Byte is 0x80 */
 
+#define DSI_CMD_HDR_LAST	0x80	/* 4th Byte: last packet of DMA transfer */
+#define DSI_CMD_DMA_BUF_SIZE	1024
+
 #define RDBK_DATA0 0x06C
 
 #define MIPI_VIDEO_MODE	        1
@@ -61,6 +61,7 @@
 #define CMD35_ERASE_GROUP_START                   35
 #define CMD36_ERASE_GROUP_END                     36
 #define CMD38_ERASE                               38
+#define CMD48_CMDQ_TASK_MGMT                      48
 
 /* Card type */
 #define MMC_TYPE_STD_SD                           0
@@ -77,8 +78,10 @@
 
 /* Card status */
 #define MMC_CARD_STATUS(x)                        ((x >> 9) & 0x0F)
+#define MMC_STBY_STATE                            3
 #define MMC_TRAN_STATE                            4
 #define MMC_PROG_STATE                            7
+#define MMC_SLP_STATE                             10
 #define MMC_SWITCH_FUNC_ERR_FLAG                  (1 << 7)
 #define MMC_STATUS_INACTIVE                       0
 #define MMC_STATUS_ACTIVE                         1
@@ -99,11 +102,21 @@
 #define MMC_SEC_COUNT1                            212
 #define MMC_PART_CONFIG                           179
 #define MMC_ERASE_GRP_DEF                         175
+#define MMC_EXT_CSD_ERASED_MEM_CONT               181
+#define MMC_EXT_CSD_SEC_FEATURE_SUPPORT           231
+#define MMC_EXT_CSD_TRIM_MULT                     232
 #define MMC_USR_WP                                171
 #define MMC_ERASE_TIMEOUT_MULT                    223
 #define MMC_HC_ERASE_GRP_SIZE                     224
 #define MMC_PARTITION_CONFIG                      179
 #define MMC_EXT_CSD_EN_RPMB_REL_WR                166 //emmc 5.1 and above
+#define MMC_EXT_CSD_CMDQ_MODE_EN                  15  //emmc 5.1 and above
+#define MMC_EXT_CSD_CMDQ_DEPTH                    307
+#define MMC_EXT_CSD_CMDQ_SUPPORT                  308
+#define MMC_EXT_CSD_FLUSH_CACHE                   32  //emmc 4.5 and above
+#define MMC_EXT_CSD_CACHE_CTRL                    33  //emmc 4.5 and above
+#define MMC_EXT_CSD_CACHE_SIZE                    249
+#define MMC_EXT_CSD_BOOT_SIZE_MULT                226
 
 /* Values for ext csd fields */
 #define MMC_HS_TIMING                             0x1
@@ -118,8 +131,19 @@
 #define MMC_SEC_COUNT3_SHIFT                      16
 #define MMC_SEC_COUNT2_SHIFT                      8
 #define MMC_HC_ERASE_MULT                         (512 * 1024)
+
+/* CMD38 arguments */
+#define MMC_ERASE_ARG                             0x00000000
+#define MMC_TRIM_ARG                              0x00000001
+#define MMC_DISCARD_ARG                           0x00000003
+
+/* Trim & discard support in EXT_CSD_SEC_FEATURE_SUPPORT */
+#define MMC_SEC_GB_CL_EN                          BIT(4)
 #define RST_N_FUNC_ENABLE                         BIT(0)
 
+/* Writing back a full cache can take a while, in us */
+#define MMC_FLUSH_CACHE_TIMEOUT                   (30 * 1000 * 1000)
+
 /* RPMB Related */
 #define RPMB_PART_MIN_SIZE                        (128 * 1024)
 #define RPMB_SIZE_MULT                            168
@@ -127,6 +151,9 @@
 #define PARTITION_ACCESS_MASK                     0x7
 #define MAX_RPMB_CMDS                             0x3
 
+/* Boot partitions */
+#define BOOT_PART_MIN_SIZE                        (128 * 1024)
+
 /* Command related */
 #define MMC_MAX_COMMAND_RETRY                     1000
 #define MMC_MAX_CARD_STAT_RETRY                   10000
@@ -180,6 +207,15 @@
 #define MMC_CARD_TYPE_STD_SD                      0x0
 #define SD_CARD_RCA                               0x0
 #define MMC_SD_SWITCH_HS                          0x80FFFFF1
+#define MMC_SD_S18R                               0x01000000
+#define MMC_SD_S18A                               0x01000000
+#define MMC_SD_SWITCH_CHECK                       0x00FFFFFF
+#define MMC_SD_SWITCH_UHS(func)                   (0x80FFFFF0 | (func))
+
+/* Bus speed functions of CMD6 group 1 */
+#define MMC_SD_FUNC_SDR50                         0x2
+#define MMC_SD_FUNC_SDR104                        0x3
+#define MMC_SD_FUNC_DDR50                         0x4
 
 #define SD_CMD8_MAX_RETRY                         0x3
 #define SD_ACMD41_MAX_RETRY                       0x14
@@ -202,6 +238,8 @@
 
 /* Commands for SD card */
 #define CMD8_SEND_IF_COND                         8
+#define CMD11_SWITCH_VOLTAGE                      11
+#define CMD19_SEND_TUNING_BLOCK                   19
 #define ACMD6_SET_BUS_WIDTH                       6
 #define ACMD13_SEND_SD_STATUS                     13
 #define ACMD41_SEND_OP_COND                       41
@@ -240,6 +278,8 @@
 enum part_access_type
 {
 	PART_ACCESS_DEFAULT = 0x0,
+	PART_ACCESS_BOOT1 = 0x1,
+	PART_ACCESS_BOOT2 = 0x2,
 	PART_ACCESS_RPMB = 0x3,
 };
 
@@ -310,7 +350,13 @@ struct mmc_card {
 	uint32_t raw_csd[4];     /* Raw CSD for the card */
 	uint32_t raw_scr[2];     /* SCR for SD card */
 	uint32_t rpmb_size;      /* Size of rpmb partition */
+	uint32_t boot_size;      /* Size of each boot partition, 0 if none */
+	uint8_t part_access;     /* Partition for data commands (part_access_type) */
 	uint32_t rel_wr_count;   /* Reliable write count */
+	uint32_t cmdq_depth;     /* Command queue depth, 0 if not used */
+	uint32_t cache_size;     /* Volatile write cache size in KiB, 0 if none */
+	uint8_t cache_enabled;   /* Write cache was turned on */
+	uint8_t s18a;            /* SD card uses 1.8V signalling */
 	struct mmc_cid cid;      /* CID structure */
 	struct mmc_csd csd;      /* CSD structure */
 	struct mmc_sd_scr scr;   /* SCR structure */
@@ -330,6 +376,14 @@ struct mmc_config_data {
 	uint8_t use_io_switch; /* IO pad switch flag for shared sdc controller */
 };
 
+/* mmc read task for mmc_sdhci_read_queued() */
+struct mmc_read_task {
+	void *dest;              /* Destination, aligned to CACHE_LINE */
+	uint64_t blk_addr;       /* First block to read */
+	uint32_t num_blocks;     /* Number of blocks, at most 65535 */
+	uint32_t ret;            /* Result, 0 on success */
+};
+
 /* mmc device structure */
 struct mmc_device {
 	struct sdhci_host host;          /* Handle to host controller */
@@ -344,10 +398,26 @@ struct mmc_device {
 struct mmc_device *mmc_init(struct mmc_config_data *);
 /* API: Read required number of blocks from card into destination */
 uint32_t mmc_sdhci_read(struct mmc_device *dev, void *dest, uint64_t blk_addr, uint32_t num_blocks);
+/* API: Read consecutive blocks from card into several destinations */
+uint32_t mmc_sdhci_readv(struct mmc_device *dev, const struct mmc_sg *sg, uint32_t sg_count,
+						 uint64_t blk_addr, uint32_t num_blocks);
+/* API: Read blocks from a hardware partition, e.g. boot1/boot2 */
+uint32_t mmc_sdhci_read_part(struct mmc_device *dev, uint32_t part, void *dest,
+							 uint64_t blk_addr, uint32_t num_blocks);
+/* API: Read several block ranges, with command queueing if available */
+uint32_t mmc_sdhci_read_queued(struct mmc_device *dev, struct mmc_read_task *tasks, uint32_t count);
 /* API: Write requried number of blocks from source to card */
 uint32_t mmc_sdhci_write(struct mmc_device *dev, void *src, uint64_t blk_addr, uint32_t num_blocks);
 /* API: Erase len bytes (after converting to number of erase groups), from specified address */
 uint32_t mmc_sdhci_erase(struct mmc_device *dev, uint32_t blk_addr, uint64_t len);
+/* API: Trim or discard blocks on the card */
+uint32_t mmc_sdhci_trim(struct mmc_device *dev, uint32_t blk_addr, uint32_t num_blocks, bool discard);
+/* API: Check if the card supports trim & discard */
+uint8_t mmc_card_supports_trim(struct mmc_card *card);
+/* API: Turn the volatile write cache on or off */
+uint32_t mmc_sdhci_set_cache(struct mmc_device *dev, bool enable);
+/* API: Write back the contents of the write cache */
+uint32_t mmc_sdhci_flush_cache(struct mmc_device *dev);
 /* API: Write protect or release len bytes (after converting to number of write protect groups) from specified start address*/
 uint32_t mmc_set_clr_power_on_wp_user(struct mmc_device *dev, uint32_t addr, uint64_t len, uint8_t set_clr);
 /* API: Get the WP status of write protect groups starting at addr */
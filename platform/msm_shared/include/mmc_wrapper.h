@@ -42,6 +42,12 @@ uint32_t mmc_write(uint64_t data_addr, uint32_t data_len, void *in);
 uint32_t mmc_erase_card(uint64_t, uint64_t);
 uint64_t mmc_get_device_capacity(void);
 uint32_t mmc_erase_card(uint64_t addr, uint64_t len);
+uint32_t mmc_get_zero_erase_unit(void);
+uint32_t mmc_erase_units(uint64_t addr, uint64_t len);
+uint32_t mmc_trim_supported(void);
+uint32_t mmc_trim_card(uint64_t addr, uint64_t len, bool discard);
+uint32_t mmc_write_cache_enable(bool enable);
+uint32_t mmc_write_cache_flush(void);
 uint32_t mmc_get_device_blocksize(void);
 uint32_t mmc_page_size(void);
 void mmc_device_sleep(void);
@@ -52,8 +52,11 @@
 
 uint32_t qgic_read_iar(void);
 void qgic_write_eoi(uint32_t);
+uint8_t qgic_get_cpumask(void);
+void qgic_send_sgi(uint32_t sgi, uint8_t cpumask);
 
 enum handler_return gic_platform_irq(struct arm_iframe *frame);
+struct arm_iframe *gic_current_iframe(void);
 void gic_platform_fiq(struct arm_iframe *frame);
 status_t gic_mask_interrupt(unsigned int vector);
 status_t gic_unmask_interrupt(unsigned int vector);
@@ -193,6 +193,8 @@
 #define ONFI_READ_ID_BUFFER_SIZE                           0x4
 #define ONFI_READ_PARAM_PAGE_BUFFER_SIZE                   0x200
 #define ONFI_PARAM_PAGE_SIZE                               0x100
+#define ONFI_PARAM_PAGE_CRC_LEN                            254
+#define ONFI_TIMING_MODES_MASK                             0x3F
 
 #define NAND_8BIT_DEVICE                                   0x01
 #define NAND_16BIT_DEVICE                                  0x02
@@ -48,6 +48,7 @@ typedef struct
 typedef rpm_cmd rpm_ack_msg;
 glink_err_type rpm_glink_send_data(uint32_t *data, uint32_t len, msg_type type);
 uint32_t rpm_glink_recv_data(char *rx_buffer, uint32_t *len);
+int rpm_glink_wait_acks(void);
 void rpm_glink_clk_enable(uint32_t *data, uint32_t len);
 void rpm_glink_clk_disable(uint32_t *data, uint32_t len);
 void rpm_glink_init(void);
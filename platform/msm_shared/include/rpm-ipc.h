@@ -97,6 +97,16 @@ typedef rpm_cmd rpm_ack_msg;
 int rpm_send_data(uint32_t *data, uint32_t len, msg_type type);
 void rpm_clk_enable(uint32_t *data, uint32_t len);
 
+/*
+ * Between rpm_batch_begin() and rpm_batch_end(), requests are sent without
+ * waiting for the acknowledgement of the RPM in between. rpm_batch_end()
+ * waits for all of them and returns an error if any of them failed, so the
+ * votes are only guaranteed to be applied after it returned.
+ */
+void rpm_batch_begin(void);
+int rpm_batch_end(void);
+bool rpm_batch_active(void);
+
 void fill_kvp_object(kvp_data **kdata, uint32_t *data, uint32_t len);
 void free_kvp_object(kvp_data **kdata);
 #endif
@@ -37,6 +37,7 @@
 
 int rpm_smd_send_data(uint32_t *data, uint32_t len, msg_type type);
 uint32_t rpm_smd_recv_data(uint32_t *len);
+int rpm_smd_wait_acks(void);
 void rpm_smd_init(void);
 void rpm_smd_uninit(void);
 #endif
@@ -31,7 +31,9 @@
 
 #include <reg.h>
 #include <bits.h>
+#include <compiler.h>
 #include <kernel/event.h>
+#include <lib/dmapool.h>
 
 //#define DEBUG_SDHCI
 
@@ -51,6 +53,7 @@ struct host_caps {
 	uint32_t max_blk_len;    /* Max block len supported */
 	uint8_t bus_width_8bit;  /* 8 Bit mode supported */
 	uint8_t adma_support;    /* Adma support */
+	uint8_t adma64_support;  /* 64 bit adma2 descriptors */
 	uint8_t voltage;         /* Supported voltage */
 	uint8_t sdr_support;     /* Single Data rate */
 	uint8_t ddr_support;     /* Dual Data rate */
@@ -75,6 +78,14 @@ struct sdhci_host {
 	event_t* sdhc_event;     /* Event for power control irqs */
 	struct host_caps caps;   /* Host capabilities */
 	struct sdhci_msm_data *msm_host; /* MSM specific host info */
+	void *desc_pool;         /* Preallocated adma desc table */
+	struct dma_pool desc_dma; /* Memory of desc_pool, uncached if possible */
+	uint32_t cqe_base;       /* Command queue engine registers, 0 if none */
+	void *cqe_tdl;           /* Command queue task descriptor list */
+	struct desc_entry *cqe_trans; /* Command queue transfer descriptors */
+	uint32_t irq;            /* Host controller irq, 0 to poll */
+	event_t irq_event;       /* Signalled by the host controller irq */
+	bool adopted;            /* Clock & bus kept from the previous bootloader */
 };
 
 /*
@@ -84,6 +95,16 @@ struct mmc_data {
 	void *data_ptr;      /* Points to stream of data */
 	uint32_t blk_sz;     /* Block size for the data */
 	uint32_t num_blocks; /* num of blocks, each always of size SDHCI_MMC_BLK_SZ */
+	const struct mmc_sg *sg; /* Scatter list used instead of data_ptr if set */
+	uint32_t sg_count;
+};
+
+/*
+ * Memory segment of a scattered transfer
+ */
+struct mmc_sg {
+	void *addr;
+	uint32_t len;
 };
 
 /*
@@ -114,6 +135,16 @@ struct desc_entry {
 	uint32_t addr;       /* Address of the data */
 };
 
+/*
+ * Descriptor table for adma2 with 64 bit addressing (96 bit entries)
+ */
+struct desc_entry64 {
+	uint16_t tran_att;   /* Attribute for transfer data */
+	uint16_t len;        /* Length of data */
+	uint32_t addr;       /* Address of the data, bits 31:0 */
+	uint32_t addr_hi;    /* Address of the data, bits 63:32 */
+} __PACKED;
+
 /*
  * Command types for sdhci
  */
@@ -176,6 +207,7 @@ typedef enum {
 #define SDHCI_CAPS_REG2                           (0x044)
 #define SDHCI_ADM_ERR_REG                         (0x054)
 #define SDHCI_ADM_ADDR_REG                        (0x058)
+#define SDHCI_ADM_ADDR_HI_REG                     (0x05C)
 
 /*
  * Helper macros for register writes
@@ -193,6 +225,8 @@ typedef enum {
 #define SDHCI_ERR_INT_STS_EN                      0xFFFF
 #define SDHCI_NRML_INT_SIG_EN                     0x000B
 #define SDHCI_ERR_INT_SIG_EN                      0xFFFF
+/* Wait for the irq at most this long before checking the status again */
+#define SDHCI_IRQ_TIMEOUT                         10 /* ms */
 
 #define SDCC_HC_INT_CARD_REMOVE                   BIT(7)
 #define SDCC_HC_INT_CARD_INSERT                   BIT(6)
@@ -221,6 +255,7 @@ typedef enum {
 
 #define SDHCI_CMD_ACT                             BIT(0)
 #define SDHCI_DAT_ACT                             BIT(1)
+#define SDHCI_DAT_LVL_MASK                        0x00F00000
 
 /*
  * Bus voltage related macros
@@ -249,12 +284,15 @@ typedef enum {
 #define SDHCI_BLK_LEN_MASK                        0x00030000
 #define SDHCI_BLK_LEN_BIT                         16
 #define SDHCI_BLK_ADMA_MASK                       0x00080000
+#define SDHCI_64BIT_BUS_MASK                      0x10000000
 #define SDHCI_INT_STS_TRANS_COMPLETE              BIT(1)
 #define SDHCI_STATE_CMD_DAT_MASK                  0x0003
 #define SDHCI_INT_STS_CMD_COMPLETE                BIT(0)
 #define SDHCI_ERR_INT_STAT_MASK                   0x8000
 #define SDHCI_ADMA_DESC_LINE_SZ                   65536
 #define SDHCI_ADMA_MAX_TRANS_SZ                   (65535 * 512)
+/* Enough for a full transfer, plus one split per scatter list segment */
+#define SDHCI_ADMA_POOL_ENTRIES                   ((SDHCI_ADMA_MAX_TRANS_SZ / SDHCI_ADMA_DESC_LINE_SZ) + 1 + 16)
 #define SDHCI_ADMA_TRANS_VALID                    BIT(0)
 #define SDHCI_ADMA_TRANS_END                      BIT(1)
 #define SDHCI_ADMA_TRANS_DATA                     BIT(5)
@@ -268,6 +306,8 @@ typedef enum {
 #define SDHCI_AUTO_CMD23_EN                       BIT(3)
 #define SDHCI_AUTO_CMD12_EN                       BIT(2)
 #define SDHCI_ADMA_32BIT                          BIT(4)
+#define SDHCI_DMA_SEL_MASK                        (BIT(3) | BIT(4))
+#define SDHCI_ADMA_64BIT                          (BIT(3) | BIT(4))
 
 /*
  * Command related macros
@@ -0,0 +1,85 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+#ifndef __SDHCI_CQE_H__
+#define __SDHCI_CQE_H__
+
+#include <bits.h>
+#include <reg.h>
+#include <sdhci.h>
+
+/*
+ * Offset of the command queue engine registers from the sdhc base. Set by
+ * the platforms where the controller has one, 0 means there is none.
+ */
+#ifndef SDHCI_CQE_OFFSET
+#define SDHCI_CQE_OFFSET                          0
+#endif
+
+#define CQE_READ32(host, a)                       readl(host->cqe_base + a)
+#define CQE_WRITE32(host, v, a)                   writel(v, (host->cqe_base + a))
+
+/* CQHCI register offsets */
+#define SDHCI_CQE_VER_REG                         (0x000)
+#define SDHCI_CQE_CAP_REG                         (0x004)
+#define SDHCI_CQE_CFG_REG                         (0x008)
+#define SDHCI_CQE_CTL_REG                         (0x00C)
+#define SDHCI_CQE_IS_REG                          (0x010)
+#define SDHCI_CQE_ISTE_REG                        (0x014)
+#define SDHCI_CQE_ISGE_REG                        (0x018)
+#define SDHCI_CQE_IC_REG                          (0x01C)
+#define SDHCI_CQE_TDLBA_REG                       (0x020)
+#define SDHCI_CQE_TDLBAU_REG                      (0x024)
+#define SDHCI_CQE_TDBR_REG                        (0x028)
+#define SDHCI_CQE_TCN_REG                         (0x02C)
+#define SDHCI_CQE_DQS_REG                         (0x030)
+#define SDHCI_CQE_TCLR_REG                        (0x038)
+#define SDHCI_CQE_SSC2_REG                        (0x044)
+#define SDHCI_CQE_TERRI_REG                       (0x054)
+
+#define SDHCI_CQE_VER_MAJOR(v)                    (((v) >> 8) & 0xF)
+#define SDHCI_CQE_VER_MINOR(v)                    (((v) >> 4) & 0xF)
+
+#define SDHCI_CQE_CFG_ENABLE                      BIT(0)
+#define SDHCI_CQE_CTL_HALT                        BIT(0)
+#define SDHCI_CQE_CTL_CLEAR_ALL_TASKS             BIT(8)
+
+#define SDHCI_CQE_IS_HAC                          BIT(0)
+#define SDHCI_CQE_IS_TCC                          BIT(1)
+#define SDHCI_CQE_IS_RED                          BIT(2)
+#define SDHCI_CQE_IS_TCL                          BIT(3)
+#define SDHCI_CQE_IS_MASK                         (SDHCI_CQE_IS_HAC | SDHCI_CQE_IS_TCC | \
+                                                   SDHCI_CQE_IS_RED | SDHCI_CQE_IS_TCL)
+#define SDHCI_CQE_IS_ERR_MASK                     (SDHCI_CQE_IS_RED | SDHCI_CQE_IS_TCL)
+
+/* Task descriptor, the block address goes into the upper 32 bits */
+#define SDHCI_CQE_TASK_VALID                      BIT(0)
+#define SDHCI_CQE_TASK_END                        BIT(1)
+#define SDHCI_CQE_TASK_INT                        BIT(2)
+#define SDHCI_CQE_TASK_ACT                        (0x5 << 3)
+#define SDHCI_CQE_TASK_DATA_READ                  BIT(12)
+#define SDHCI_CQE_TASK_BLK_COUNT(x)               (((x) & 0xFFFF) << 16)
+
+/* Link descriptor attribute, in the same format as the adma descriptors */
+#define SDHCI_ADMA_TRANS_LINK                     (BIT(4) | BIT(5))
+
+#define SDHCI_CQE_MAX_SLOTS                       32
+/* Transfer descriptors per task, this limits the size of one task */
+#define SDHCI_CQE_SLOT_DESCS                      16
+#define SDHCI_CQE_MAX_BLOCKS                      (SDHCI_CQE_SLOT_DESCS * SDHCI_ADMA_DESC_LINE_SZ / SDHCI_MMC_BLK_SZ)
+
+/* Timeout for a single task to complete */
+#define SDHCI_CQE_TASK_TIMEOUT                    1000 /* ms */
+
+/* API: Detect the command queue engine of the host */
+void sdhci_cqe_init(struct sdhci_host *host);
+/* API: Hand the host over to the command queue engine */
+uint32_t sdhci_cqe_enable(struct sdhci_host *host, uint32_t rca);
+/* API: Return the host to the legacy sdhci interface */
+void sdhci_cqe_disable(struct sdhci_host *host);
+/* API: Queue a read task in a free slot */
+void sdhci_cqe_queue_read(struct sdhci_host *host, uint32_t tag, void *data,
+						  uint32_t blk_addr, uint32_t num_blocks);
+/* API: Wait until at least one of the pending tasks is complete */
+uint32_t sdhci_cqe_wait(struct sdhci_host *host, uint32_t pending, uint32_t *done);
+/* API: Discard all tasks after an error */
+void sdhci_cqe_recover(struct sdhci_host *host);
+#endif
@@ -141,9 +141,13 @@ struct sdhci_msm_data
 };
 
 void sdhci_msm_init(struct sdhci_host *host, struct sdhci_msm_data *data);
+/* API: Check if the controller is still set up by the previous bootloader */
+bool sdhci_msm_can_adopt(struct sdhci_host *host, struct sdhci_msm_data *data);
 uint32_t sdhci_msm_execute_tuning(struct sdhci_host *host, struct mmc_card * card, uint32_t bus_width);
 void sdhci_mode_disable(struct sdhci_host *host);
 /* API: Toggle the bit for clock-data recovery */
 void sdhci_msm_toggle_cdr(struct sdhci_host *host, bool enable);
 void sdhci_msm_set_mci_clk(struct sdhci_host *host);
+/* API: Switch the sd card signalling to 1.8V after CMD11 */
+uint32_t sdhci_msm_switch_1_8v(struct sdhci_host *host);
 #endif
@@ -0,0 +1,28 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+#ifndef __SHA_SW_H__
+#define __SHA_SW_H__
+
+#include <stdbool.h>
+#include <sys/types.h>
+
+/* Buffers up to this size are hashed on the CPU even if there is a CE */
+#define SHA_SW_SMALL_BUF_SIZE		512U
+
+typedef struct {
+	uint32_t state[8];
+	uint64_t bytecnt;
+	unsigned char buf[64];
+	unsigned int buf_len;
+} crypto_sha_sw_ctx;
+
+/* API: Check if the CPU has the ARMv8 instructions for the algorithm */
+bool sha_sw_has_hw(unsigned char auth_alg);
+/* API: Calculate the SHAx digest on the CPU */
+void sha_sw_init(crypto_sha_sw_ctx *ctx, unsigned char auth_alg);
+void sha_sw_update(crypto_sha_sw_ctx *ctx, unsigned char auth_alg,
+		   const void *data, size_t size);
+void sha_sw_final(crypto_sha_sw_ctx *ctx, unsigned char auth_alg,
+		  unsigned char *digest);
+void sha_sw(const void *data, size_t size, unsigned char *digest,
+	    unsigned char auth_alg);
+#endif
@@ -79,6 +79,7 @@
 #define ENOMEM      12
 #define EBUSY       16
 #define ENODEV      19
+#define EINVAL      22
 #define ENOSYS      38
 #define EPROTONOSUPPORT 93
 #define ETIMEDOUT   110
@@ -97,6 +98,7 @@ struct spi_transfer {
  * @ tx_bytes - current transfered output data length in bytes
  * @ bytes_per_word - bytes number per word write to FIFO, valid range [1-4]
  * @ xfer - pointer to SPI transfer contents structure.
+ * @ use_bam - large writes are done by the BLSP BAM instead of the CPU.
  */
 struct qup_spi_dev {
 	unsigned int qup_base;
@@ -111,6 +113,7 @@ struct qup_spi_dev {
 	unsigned int max_speed_hz;
 	uint8_t blsp_id;
 	uint8_t qup_id;
+	unsigned int use_bam;
 };
 
 /* Function Definitions */
@@ -163,6 +163,7 @@ struct scsi_failure_sense_data
 int ucs_scsi_send_inquiry(struct ufs_dev *dev);
 int ucs_do_scsi_cmd(struct ufs_dev *dev, struct scsi_req_build_type *req);
 int ucs_do_scsi_read(struct ufs_dev *dev, struct scsi_rdwr_req *req);
+int ucs_do_scsi_read_batch(struct ufs_dev *dev, struct scsi_rdwr_req *req, uint32_t count, int *status);
 int ucs_do_scsi_write(struct ufs_dev *dev, struct scsi_rdwr_req *req);
 int ucs_do_scsi_unmap(struct ufs_dev *dev, struct scsi_unmap_req *req);
 /*
@@ -63,6 +63,8 @@ struct ufs_uic_meta_data
 {
 	mutex_t  uic_mutex;
 	event_t  uic_event;
+	event_t  pwr_event;
+	uint32_t pwr_status;
 };
 
 struct ufs_unit_desc
@@ -86,6 +88,15 @@ struct ufs_unit_desc
 	uint8_t   large_unit_size_m1;
 }__PACKED;
 
+struct ufs_read_task
+{
+	void     *dest;          /* Destination, aligned to CACHE_LINE */
+	uint8_t  lun;            /* Logical unit to read from */
+	uint32_t blk_addr;       /* First block to read */
+	uint32_t num_blocks;     /* Number of blocks, at most 65535 */
+	int      ret;            /* Result, 0 on success */
+};
+
 struct ufs_dev
 {
 	uint8_t                      instance;
@@ -116,6 +127,7 @@ struct ufs_dev
 
 int ufs_init(struct ufs_dev *dev);
 int ufs_read(struct ufs_dev* dev, uint64_t start_lba, addr_t buffer, uint32_t num_blocks);
+int ufs_read_queued(struct ufs_dev *dev, struct ufs_read_task *tasks, uint32_t count);
 int ufs_write(struct ufs_dev* dev, uint64_t start_lba, addr_t buffer, uint32_t num_blocks);
 int ufs_erase(struct ufs_dev* dev, uint64_t start_lba, uint32_t num_blocks);
 uint64_t ufs_get_dev_capacity(struct ufs_dev* dev);
@@ -61,6 +61,10 @@
 #define UFS_TX_SYMBOL_CLK_NS_US(_base)             (_base + 0x000000C4)
 #define UFS_REG_PA_LINK_STARTUP_TIMER(_base)       (_base + 0x000000D8)
 #define UFS_CFG1(_base)                            (_base + 0x000000DC)
+#define UFS_HW_VERSION(_base)                      (_base + 0x000000E4)
+
+#define UFS_HW_VERSION_MAJOR(_val)                 ((_val) >> 28)
+#define UFS_TX_SYMBOL_CLK_1US_MASK                 0x3FF
 
 #define UFS_CFG1_PHY_SOFT_RESET             BIT(0)
 
@@ -69,6 +73,10 @@
 #define UFS_HCS_UTRLRDY                     BIT(1)
 #define UFS_HCS_UTMRLRDY                    BIT(2)
 #define UFS_HCS_UCRDY                       BIT(3)
+#define UFS_HCS_UPMCRS(_val)                (((_val) >> 8) & 0x7)
+
+/* Values of UFSHCI_HCS.UPMCRS */
+#define UFS_UPMCRS_PWR_LOCAL                1
 
 /* Bit field of UFSHCI_IE register */
 #define UFS_IE_UTRCE                        BIT(0)
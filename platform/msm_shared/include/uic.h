@@ -72,10 +72,13 @@ struct uic_cmd
 #define UFS_LINK_STARTUP_RETRY                           10
 
 #define SHFT_CLK_NS_REG                                  (10)
+#define UIC_PWR_MODE_TIMEOUT                             500
+#define UFS_HS_GEAR_MAX                                  3
 
 int uic_init(struct ufs_dev *dev);
 int uic_send_cmd(struct ufs_dev *dev, struct uic_cmd *cmd);
 int uic_reset(struct ufs_dev *dev);
+int uic_set_hs_gear(struct ufs_dev *dev);
 
 
 #endif
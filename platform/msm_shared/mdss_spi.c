@@ -32,12 +32,17 @@
 #include <target/display.h>
 #include <platform/gpio.h>
 #include <dev/gpio.h>
+#include <kernel/thread.h>
 #include <platform/timer.h>
 #include "mdss_spi.h"
 
 #define SUCCESS           0
 #define FAIL              1
 
+#define DCS_SET_COLUMN_ADDRESS    0x2A
+#define DCS_SET_PAGE_ADDRESS      0x2B
+#define DCS_WRITE_MEMORY_START    0x2C
+
 static struct qup_spi_dev *dev = NULL;
 
 #if QM215_MDSS_SPI
@@ -193,7 +198,7 @@ int mdss_spi_panel_init(struct msm_panel_info *pinfo)
 				pinfo->spi.panel_cmds[cmd_count].size - 1);
 
 		if (pinfo->spi.panel_cmds[cmd_count].wait)
-			mdelay(pinfo->spi.panel_cmds[cmd_count].wait);
+			delay_or_sleep(pinfo->spi.panel_cmds[cmd_count].wait);
 
 		cmd_count ++;
 	}
@@ -214,6 +219,47 @@ int mdss_spi_on(struct msm_panel_info *pinfo, struct fbcon_config *fb)
 	return ret;
 }
 
+/*
+ * Send only the rows y to y + height - 1 of the frame buffer, using the
+ * column/row address window (CASET/RASET) of the panel.
+ */
+int mdss_spi_update_region(struct fbcon_config *fb, unsigned int y,
+			   unsigned int height)
+{
+	unsigned int line_size = fb->stride * (fb->bpp / 8);
+	unsigned int x_end = fb->width - 1;
+	unsigned int y_end = y + height - 1;
+	unsigned char caset[] = {
+		DCS_SET_COLUMN_ADDRESS, 0, 0, x_end >> 8, x_end & 0xFF
+	};
+	unsigned char raset[] = {
+		DCS_SET_PAGE_ADDRESS, y >> 8, y & 0xFF, y_end >> 8, y_end & 0xFF
+	};
+	unsigned char ramwr = DCS_WRITE_MEMORY_START;
+	unsigned char *base = (unsigned char *)fb->base + y * line_size;
+	int ret = 0;
+
+	if (!height || y_end >= fb->height)
+		return -EINVAL;
+
+	mdss_spi_write_cmd(caset);
+	mdss_spi_write_data(caset + 1, sizeof(caset) - 1);
+	mdss_spi_write_cmd(raset);
+	mdss_spi_write_data(raset + 1, sizeof(raset) - 1);
+	mdss_spi_write_cmd(&ramwr);
+
+	if (fb->stride == fb->width) {
+		ret = mdss_spi_write_frame(base, height * line_size);
+	} else {
+		for (; height && !ret; height--, base += line_size)
+			ret = mdss_spi_write_frame(base, fb->width * (fb->bpp / 8));
+	}
+	if (ret)
+		dprintf(CRITICAL, "Send SPI frame data to panel failed\n");
+
+	return ret;
+}
+
 int mdss_spi_cmd_post_on(struct msm_panel_info *pinfo)
 {
 	int cmd_count = 0;
@@ -234,7 +280,7 @@ int mdss_spi_cmd_post_on(struct msm_panel_info *pinfo)
 						- 1);
 
 			if (pinfo->spi.panel_cmds[cmd_count].wait)
-				mdelay(pinfo->spi.panel_cmds[cmd_count].wait);
+				delay_or_sleep(pinfo->spi.panel_cmds[cmd_count].wait);
 		}
 
 		cmd_count ++;
@@ -37,6 +37,7 @@
 #include <target/display.h>
 #include <platform/iomap.h>
 #include <platform/clock.h>
+#include <kernel/thread.h>
 #include <platform/timer.h>
 #include <err.h>
 #include <msm_panel.h>
@@ -176,16 +177,35 @@ static int mdss_dsi_wait4_video_done(uint32_t ctl_base)
 	return status;
 }
 
+#if (DISPLAY_TYPE_MDSS == 1)
+/*
+ * Pack a command into the DMA buffer. Returns the (padded) size of the
+ * command or 0 if it does not fit anymore.
+ */
+static uint32_t mdss_dsi_cmd_dma_add(uint8_t *buf, uint32_t len,
+	struct mipi_dsi_cmd *cm)
+{
+	/* The payload size has to be a multiple of 4 */
+	uint32_t size = ROUNDUP(cm->size, 4);
+
+	if (len + size > DSI_CMD_DMA_BUF_SIZE)
+		return 0;
+
+	memcpy(buf + len, cm->payload, size);
+	return size;
+}
+#endif
+
 int mdss_dsi_cmds_tx(struct mipi_panel_info *mipi,
 	struct mipi_dsi_cmd *cmds, int count, char dual_dsi)
 {
 	int ret = 0;
 #if (DISPLAY_TYPE_MDSS == 1)
+	static uint8_t dma_buf[DSI_CMD_DMA_BUF_SIZE] __ALIGNED(8);
 	struct mipi_dsi_cmd *cm;
 	int i = 0;
-	uint8_t pload[256];
-	uint32_t off;
-	uint32_t size;
+	uint32_t off = (uint32_t) dma_buf;
+	uint32_t len, size, last;
 	uint32_t ctl_base, sctl_base;
 
 	/* if dest controller is not specified, default to DSI0 */
@@ -197,42 +217,49 @@ int mdss_dsi_cmds_tx(struct mipi_panel_info *mipi,
 		sctl_base = mipi->sctl_base;
 	}
 
-	/* Align pload at 8 byte boundary */
-	off = (uint32_t) pload;
-	off &= 0x07;
-	if (off)
-		off = 8 - off;
-	off += (uint32_t) pload;
-
 	cm = cmds;
-	for (i = 0; i < count; i++) {
+	while (i < count) {
 		/* Wait for VIDEO_MODE_DONE */
 		ret = mdss_dsi_wait4_video_done(ctl_base);
 		if (ret)
 			goto wait4video_error;
 
-		/* The payload size has to be a multiple of 4 */
-		size = cm->size;
-		size &= 0x03;
-		if (size)
-			size = 4 - size;
-		size += cm->size;
-		memcpy((uint8_t *)off, (cm->payload), size);
-		arch_clean_invalidate_cache_range((addr_t)(off), size);
+		/*
+		 * Commands without delay are packed into a single DMA transfer.
+		 * Only the last packet of the batch has the LAST flag set in
+		 * the header, the controller sends the others back to back.
+		 */
+		len = last = 0;
+		do {
+			size = mdss_dsi_cmd_dma_add(dma_buf, len, cm);
+			if (!size) {
+				if (len)
+					break;
+				dprintf(CRITICAL, "Panel CMD: command too long (%d bytes)\n",
+					cm->size);
+				return FAIL;
+			}
+			dma_buf[len + 3] &= ~DSI_CMD_HDR_LAST;
+			last = len;
+			len += size;
+			i++;
+		} while (!(cm++)->wait && i < count);
+		dma_buf[last + 3] |= DSI_CMD_HDR_LAST;
+
+		arch_clean_invalidate_cache_range((addr_t)(off), len);
 		writel(off, ctl_base + DMA_CMD_OFFSET);
-		writel(size, ctl_base + DMA_CMD_LENGTH);
+		writel(len, ctl_base + DMA_CMD_LENGTH);
 		if (dual_dsi) {
 			writel(off, sctl_base + DMA_CMD_OFFSET);
-			writel(size, sctl_base + DMA_CMD_LENGTH);
+			writel(len, sctl_base + DMA_CMD_LENGTH);
 		}
 		dsb();
 		ret += mdss_dsi_cmd_dma_trigger_for_panel(dual_dsi, ctl_base,
 			sctl_base);
-		if (cm->wait)
-			mdelay(cm->wait);
+		if (cm[-1].wait)
+			delay_or_sleep(cm[-1].wait);
 		else
 			udelay(80);
-		cm++;
 	}
 wait4video_error:
 #endif
@@ -907,7 +934,7 @@ int mipi_dsi_cmds_tx(struct mipi_dsi_cmd *cmds, int count)
 		ret += dsi_cmd_dma_trigger_for_panel();
 		dsb();
 		if (cm->wait)
-			mdelay(cm->wait);
+			delay_or_sleep(cm->wait);
 		else
 			udelay(80);
 		cm++;
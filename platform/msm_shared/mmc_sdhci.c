@@ -33,14 +33,22 @@
 #include <mmc_sdhci.h>
 #include <sdhci.h>
 #include <sdhci_msm.h>
+#include <sdhci_cqe.h>
 #include <partition_parser.h>
+#include <target.h>
 #include <platform/iomap.h>
 #include <platform/timer.h>
 #include <platform.h>
+#include <kernel/thread.h>
 
 extern void clock_init_mmc(uint32_t);
 extern void clock_config_mmc(uint32_t, uint32_t);
 
+#if MMC_SDHCI_ADOPT
+/* Set if taking over the state of the previous bootloader did not work */
+static bool mmc_adopt_failed;
+#endif
+
 /* data access time unit in ns */
 static const uint32_t taac_unit[] =
 {
@@ -243,6 +251,7 @@ static uint32_t mmc_decode_and_save_csd(struct mmc_card *card)
 						  * (card->csd.erase_grp_mult + 1);
 
 		card->rpmb_size = RPMB_PART_MIN_SIZE * card->ext_csd[RPMB_SIZE_MULT];
+		card->boot_size = BOOT_PART_MIN_SIZE * card->ext_csd[MMC_EXT_CSD_BOOT_SIZE_MULT];
 		card->rel_wr_count = card->ext_csd[REL_WR_SEC_C];
 	}
 	else {
@@ -714,8 +723,9 @@ static uint32_t mmc_get_ext_csd(struct sdhci_host *host, struct mmc_card *card)
  * Return  : 0 on Success, 1 on Failure
  * Flow    : Send switch command to the card to set the ext attribute @ index
  */
-static uint32_t mmc_switch_cmd(struct sdhci_host *host, struct mmc_card *card,
-							   uint32_t access, uint32_t index, uint32_t value)
+static uint32_t mmc_switch_cmd_timeout(struct sdhci_host *host, struct mmc_card *card,
+									   uint32_t access, uint32_t index, uint32_t value,
+									   uint64_t timeout)
 {
 
 	struct mmc_command cmd;
@@ -738,6 +748,7 @@ static uint32_t mmc_switch_cmd(struct sdhci_host *host, struct mmc_card *card,
 	cmd.argument |= (value << 8);
 	cmd.cmd_type = SDHCI_CMD_TYPE_NORMAL;
 	cmd.resp_type = SDHCI_CMD_RESP_R1B;
+	cmd.cmd_timeout = timeout;
 
 	mmc_ret = sdhci_send_command(host, &cmd);
 	if (mmc_ret) {
@@ -765,6 +776,12 @@ static uint32_t mmc_switch_cmd(struct sdhci_host *host, struct mmc_card *card,
 	return mmc_ret;
 }
 
+static uint32_t mmc_switch_cmd(struct sdhci_host *host, struct mmc_card *card,
+							   uint32_t access, uint32_t index, uint32_t value)
+{
+	return mmc_switch_cmd_timeout(host, card, access, index, value, 0);
+}
+
 bool mmc_set_drv_type(struct sdhci_host *host, struct mmc_card *card, uint8_t drv_type)
 {
 	bool drv_type_changed = false;
@@ -857,6 +874,24 @@ static uint8_t mmc_card_supports_ddr_mode(struct mmc_card *card)
 		return 0;
 }
 
+/*
+ * Function: mmc card supports trim
+ * Arg     : Card structure
+ * Return  : 1 if trim is supported, 0 otherwise
+ * Flow    : Check the ext csd attributes of the card
+ */
+uint8_t mmc_card_supports_trim(struct mmc_card *card)
+{
+	if (MMC_CARD_MMC(card)) {
+		if (card->ext_csd[MMC_EXT_CSD_SEC_FEATURE_SUPPORT] & MMC_SEC_GB_CL_EN)
+			return 1;
+		else
+			return 0;
+	}
+	else
+		return 0;
+}
+
 /*
  * Function : Enable HS200 mode
  * Arg      : Host, card structure and bus width
@@ -1099,22 +1134,26 @@ static uint8_t mmc_host_init(struct mmc_device *dev)
 	struct mmc_config_data *cfg;
 	struct sdhci_msm_data *data;
 
-	event_t sdhc_event;
+	event_t *sdhc_event;
 
 	host = &dev->host;
 	cfg = &dev->config;
 
-	event_init(&sdhc_event, false, EVENT_FLAG_AUTOUNSIGNAL);
+	/* The power irq also fires later on, e.g. for the IO voltage switch */
+	sdhc_event = (event_t *) malloc(sizeof(event_t));
+	ASSERT(sdhc_event);
+
+	event_init(sdhc_event, false, EVENT_FLAG_AUTOUNSIGNAL);
 
 	host->base = cfg->sdhc_base;
-	host->sdhc_event = &sdhc_event;
+	host->sdhc_event = sdhc_event;
 	host->caps.hs200_support = cfg->hs200_support;
 	host->caps.hs400_support = cfg->hs400_support;
 
 	data = (struct sdhci_msm_data *) malloc(sizeof(struct sdhci_msm_data));
 	ASSERT(data);
 
-	data->sdhc_event = &sdhc_event;
+	data->sdhc_event = sdhc_event;
 	data->pwrctl_base = cfg->pwrctl_base;
 	data->pwr_irq = cfg->pwr_irq;
 	data->slot = cfg->slot;
@@ -1125,13 +1164,23 @@ static uint8_t mmc_host_init(struct mmc_device *dev)
 	/* Initialize any clocks needed for SDC controller */
 	clock_init_mmc(cfg->slot);
 
-	clock_config_mmc(cfg->slot, cfg->max_clk_rate);
+	/* Keep the clock & bus of the previous bootloader if they are still set up */
+	host->adopted = false;
+#if MMC_SDHCI_ADOPT
+	host->adopted = !mmc_adopt_failed && sdhci_msm_can_adopt(host, data);
+#endif
 
-	/* Configure the CDC clocks needed for emmc storage
-	 * we use slot '1' for emmc
-	 */
-	if (cfg->slot == 1)
-		clock_config_cdc(cfg->slot);
+	if (host->adopted) {
+		host->cur_clk_rate = cfg->max_clk_rate;
+	} else {
+		clock_config_mmc(cfg->slot, cfg->max_clk_rate);
+
+		/* Configure the CDC clocks needed for emmc storage
+		 * we use slot '1' for emmc
+		 */
+		if (cfg->slot == 1)
+			clock_config_cdc(cfg->slot);
+	}
 
 	/*
 	 * MSM specific sdhc init
@@ -1144,6 +1193,9 @@ static uint8_t mmc_host_init(struct mmc_device *dev)
 	 */
 	sdhci_init(host);
 
+	if (host->adopted)
+		return 0;
+
 	/* Setup initial freq to 400KHz */
 	mmc_ret = sdhci_clk_supply(host, SDHCI_CLK_400KHZ);
 
@@ -1253,12 +1305,22 @@ static uint32_t mmc_send_app_cmd(struct sdhci_host *host, struct mmc_card *card)
 uint32_t mmc_sd_card_init(struct sdhci_host *host, struct mmc_card *card)
 {
 	uint8_t i;
+	uint32_t s18r = 0;
 	struct mmc_command cmd;
 
 	memset((struct mmc_command *)&cmd, 0, sizeof(struct mmc_command));
 
 	/* Use the SD card RCA 0x0 during init */
 	card->rca = SD_CARD_RCA;
+	card->s18a = 0;
+
+	/*
+	 * Ask for 1.8V signalling only if the host supports UHS-I modes and
+	 * the target can switch the IO regulator of the slot
+	 */
+	if ((host->caps.sdr104_support || host->caps.sdr50_support || host->caps.ddr_support) &&
+		!target_sd_set_io_voltage(host->msm_host->slot, false))
+		s18r = MMC_SD_S18R;
 
 	/* Send CMD8 for voltage check*/
 	for (i = 0 ;i < SD_CMD8_MAX_RETRY; i++)
@@ -1303,7 +1365,7 @@ uint32_t mmc_sd_card_init(struct sdhci_host *host, struct mmc_card *card)
 
 		/* APP_CMD is successful, send ACMD41 now */
 		cmd.cmd_index = ACMD41_SEND_OP_COND;
-		cmd.argument = MMC_SD_OCR | MMC_SD_HC_HCS;
+		cmd.argument = MMC_SD_OCR | MMC_SD_HC_HCS | s18r;
 		cmd.cmd_type = SDHCI_CMD_TYPE_NORMAL;
 		cmd.resp_type = SDHCI_CMD_RESP_R3;
 
@@ -1326,8 +1388,9 @@ uint32_t mmc_sd_card_init(struct sdhci_host *host, struct mmc_card *card)
 		}
 		/*
 		 * As per SDCC spec try for max 1 second
+		 * Sleep to let other threads run while the card powers up.
 		 */
-		mdelay(50);
+		delay_or_sleep(50);
 	}
 
 	if (i == SD_ACMD41_MAX_RETRY && !(cmd.resp[0] & MMC_SD_DEV_READY))
@@ -1336,6 +1399,28 @@ uint32_t mmc_sd_card_init(struct sdhci_host *host, struct mmc_card *card)
 		return 1;
 	}
 
+	/* Switch to 1.8V signalling if the card accepted it */
+	if (s18r && (cmd.resp[0] & MMC_SD_S18A))
+	{
+		memset((struct mmc_command *)&cmd, 0, sizeof(struct mmc_command));
+
+		cmd.cmd_index = CMD11_SWITCH_VOLTAGE;
+		cmd.argument = 0x0;
+		cmd.cmd_type = SDHCI_CMD_TYPE_NORMAL;
+		cmd.resp_type = SDHCI_CMD_RESP_R1;
+
+		if (sdhci_send_command(host, &cmd))
+		{
+			dprintf(CRITICAL, "Failure sending CMD11\n");
+			return 1;
+		}
+
+		if (sdhci_msm_switch_1_8v(host))
+			return 1;
+
+		card->s18a = 1;
+	}
+
 	return 0;
 }
 
@@ -1488,6 +1573,112 @@ uint32_t mmc_sd_set_hs(struct sdhci_host *host, struct mmc_card *card)
 	return 0;
 }
 
+/*
+ * Function: mmc sd switch func
+ * Arg     : Host, card structure, CMD6 argument & 64 byte status buffer
+ * Return  : 0 on Success, 1 on Failure
+ * Flow    : Send CMD6 to check or switch the card functions
+ */
+static uint32_t mmc_sd_switch_func(struct sdhci_host *host, struct mmc_card *card,
+								   uint32_t arg, uint8_t *status)
+{
+	struct mmc_command cmd = {0};
+
+	cmd.cmd_index = CMD6_SWITCH_FUNC;
+	cmd.argument = arg;
+	cmd.cmd_type = SDHCI_CMD_TYPE_NORMAL;
+	cmd.resp_type = SDHCI_CMD_RESP_R1;
+	cmd.trans_mode = SDHCI_MMC_READ;
+	cmd.data_present = 0x1;
+	cmd.data.data_ptr = status;
+	cmd.data.num_blocks = 0x1;
+	cmd.data.blk_sz = 0x40;
+
+	return sdhci_send_command(host, &cmd);
+}
+
+/*
+ * Function: mmc sd set uhs mode
+ * Arg     : Host, card structure & bus width
+ * Return  : 0 on Success, 1 on Failure
+ * Flow    : 1. Read the supported bus speed functions with CMD6
+ *           2. Switch the card to SDR104, SDR50 or DDR50 in that order,
+ *              as supported by host & card
+ *           3. Set the UHS mode in the controller & execute tuning for
+ *              SDR104/SDR50
+ *           The card stays in high speed mode if none is supported.
+ */
+static uint32_t mmc_sd_set_uhs_mode(struct sdhci_host *host, struct mmc_card *card,
+									uint32_t width)
+{
+	BUF_DMA_ALIGN(switch_resp, 64);
+	uint32_t support;
+	uint32_t func;
+	uint32_t mode;
+	uint32_t mmc_ret;
+
+	if (mmc_sd_switch_func(host, card, MMC_SD_SWITCH_CHECK, switch_resp))
+	{
+		dprintf(CRITICAL, "Failed to read the SD card functions\n");
+		return 1;
+	}
+
+	/* Bits 415:400 of the status are the supported bus speed functions */
+	support = (switch_resp[12] << 8) | switch_resp[13];
+
+	if (host->caps.sdr104_support && (support & BIT(MMC_SD_FUNC_SDR104)))
+	{
+		func = MMC_SD_FUNC_SDR104;
+		mode = SDHCI_SDR104_MODE;
+	}
+	else if (host->caps.sdr50_support && (support & BIT(MMC_SD_FUNC_SDR50)))
+	{
+		func = MMC_SD_FUNC_SDR50;
+		mode = SDHCI_SDR50_MODE;
+	}
+	else if (host->caps.ddr_support && (support & BIT(MMC_SD_FUNC_DDR50)))
+	{
+		func = MMC_SD_FUNC_DDR50;
+		mode = SDHCI_DDR50_MODE;
+	}
+	else
+		return 0;
+
+	if (mmc_sd_switch_func(host, card, MMC_SD_SWITCH_UHS(func), switch_resp))
+	{
+		dprintf(CRITICAL, "Failed to switch the SD card bus speed\n");
+		return 1;
+	}
+
+	/* Bits 379:376 of the status are the selected bus speed function */
+	if ((switch_resp[16] & 0xF) != func)
+	{
+		dprintf(CRITICAL, "SD card did not switch to bus speed function %u\n", func);
+		return 0;
+	}
+
+	/* Save the timing value, before changing the clock */
+	if (mode == SDHCI_DDR50_MODE)
+		MMC_SAVE_TIMING(host, SDHCI_DDR50_MODE);
+	else
+		MMC_SAVE_TIMING(host, MMC_HS200_TIMING);
+
+	sdhci_set_uhs_mode(host, mode);
+
+	if (mode == SDHCI_DDR50_MODE)
+	{
+		dprintf(INFO, "SDHC Running in DDR50 mode\n");
+		return 0;
+	}
+
+	dprintf(INFO, "SDHC Running in %s mode\n", mode == SDHCI_SDR104_MODE ? "SDR104" : "SDR50");
+
+	if ((mmc_ret = sdhci_msm_execute_tuning(host, card, width)))
+		dprintf(CRITICAL, "Tuning for %s failed\n", mode == SDHCI_SDR104_MODE ? "SDR104" : "SDR50");
+
+	return mmc_ret;
+}
+
 static const char *mmc_card_type_str(struct mmc_card *card)
 {
 	switch (card->type) {
@@ -1504,6 +1695,177 @@ static const char *mmc_card_type_str(struct mmc_card *card)
 	}
 }
 
+/*
+ * Function: mmc card enable features
+ * Arg     : host & card structure
+ * Return  : 0 on Success, 1 on Failure
+ * Flow    : Enable the optional features of a card that is ready for
+ *           data transfers
+ */
+static uint32_t mmc_card_enable_features(struct sdhci_host *host, struct mmc_card *card)
+{
+	uint32_t mmc_return = 0;
+
+	card->block_size = MMC_BLK_SZ;
+
+	if (MMC_CARD_MMC(card)) {
+		/* Enable RST_n_FUNCTION */
+		if (!card->ext_csd[MMC_EXT_CSD_RST_N_FUNC])
+		{
+			mmc_return = mmc_switch_cmd(host, card, MMC_SET_BIT, MMC_EXT_CSD_RST_N_FUNC, RST_N_FUNC_ENABLE);
+
+			if (mmc_return)
+			{
+				dprintf(CRITICAL, "Failed to enable RST_n_FUNCTION\n");
+				return mmc_return;
+			}
+		}
+
+		/* Command queueing needs eMMC 5.1, sector addressing & host support */
+		if (host->cqe_base && card->type == MMC_TYPE_MMCHC &&
+			card->ext_csd[MMC_EXT_CSD_REV] >= 8 &&
+			(card->ext_csd[MMC_EXT_CSD_CMDQ_SUPPORT] & BIT(0)))
+		{
+			card->cmdq_depth = (card->ext_csd[MMC_EXT_CSD_CMDQ_DEPTH] & 0x1F) + 1;
+			dprintf(INFO, "eMMC command queue depth: %u\n", card->cmdq_depth);
+		}
+
+		/* Volatile write cache of eMMC 4.5, turned on only while flashing */
+		if (card->ext_csd[MMC_EXT_CSD_REV] >= 6)
+		{
+			card->cache_size = card->ext_csd[MMC_EXT_CSD_CACHE_SIZE] |
+				(card->ext_csd[MMC_EXT_CSD_CACHE_SIZE + 1] << 8) |
+				(card->ext_csd[MMC_EXT_CSD_CACHE_SIZE + 2] << 16) |
+				(card->ext_csd[MMC_EXT_CSD_CACHE_SIZE + 3] << 24);
+			card->cache_enabled = !!card->ext_csd[MMC_EXT_CSD_CACHE_CTRL];
+		}
+
+	}
+	return mmc_return;
+}
+
+#if MMC_SDHCI_ADOPT
+/*
+ * Function: mmc send cid
+ * Arg     : host & card structure
+ * Return  : 0 on Success, 1 on Failure
+ * Flow    : Requests the card in stand-by state to send its CID (CMD10)
+ */
+static uint32_t mmc_send_cid(struct sdhci_host *host, struct mmc_card *card)
+{
+	struct mmc_command cmd = {0};
+
+	cmd.cmd_index = CMD10_SEND_CID;
+	cmd.argument = card->rca << MMC_CARD_RCA_BIT;
+	cmd.cmd_type = SDHCI_CMD_TYPE_NORMAL;
+	cmd.resp_type = SDHCI_CMD_RESP_R2;
+
+	if (sdhci_send_command(host, &cmd))
+		return 1;
+
+	return mmc_decode_and_save_cid(card, cmd.resp);
+}
+
+/*
+ * Function: mmc card adopt
+ * Arg     : mmc device structure
+ * Return  : 0 on Success, 1 on Failure
+ * Flow    : Take over the eMMC left by the previous bootloader without
+ *           identifying it again. It uses the default RCA and puts the card
+ *           to sleep (CMD5) when it is done, the bus width & timing stay set.
+ *           1. Check the card status (CMD13), wake it up if needed (CMD5)
+ *           2. Read CSD & CID in stand-by state (CMD9, CMD10)
+ *           3. Select the card (CMD7) & read the ext csd (CMD8). This is the
+ *              first data transfer, so it also checks the bus width & timing
+ *              kept in the host controller.
+ */
+static uint32_t mmc_card_adopt(struct mmc_device *dev)
+{
+	struct sdhci_host *host = &dev->host;
+	struct mmc_card *card = &dev->card;
+	struct mmc_command cmd = {0};
+	uint32_t status = 0;
+	uint64_t sec_count;
+	uint16_t uhs_mode;
+
+	card->status = MMC_STATUS_INACTIVE;
+	card->rca = MMC_RCA;
+	card->type = MMC_TYPE_STD_MMC;
+
+	if (mmc_get_card_status(host, card, &status) ||
+		MMC_CARD_STATUS(status) == MMC_SLP_STATE)
+	{
+		cmd.cmd_index = CMD5_SLEEP_AWAKE;
+		cmd.argument = card->rca << MMC_CARD_RCA_BIT;
+		cmd.cmd_type = SDHCI_CMD_TYPE_NORMAL;
+		cmd.resp_type = SDHCI_CMD_RESP_R1B;
+
+		if (sdhci_send_command(host, &cmd) || mmc_get_card_status(host, card, &status))
+			return 1;
+	}
+
+	/* CSD & CID can only be read in stand-by state */
+	if (MMC_CARD_STATUS(status) == MMC_TRAN_STATE)
+	{
+		card->rca = 0;
+		if (mmc_select_card(host, card))
+			return 1;
+		card->rca = MMC_RCA;
+	}
+	else if (MMC_CARD_STATUS(status) != MMC_STBY_STATE)
+	{
+		dprintf(INFO, "eMMC is in unexpected state %u\n", MMC_CARD_STATUS(status));
+		return 1;
+	}
+
+	if (mmc_send_csd(host, card) || mmc_send_cid(host, card))
+		return 1;
+
+	if (mmc_select_card(host, card))
+		return 1;
+	card->status = MMC_STATUS_ACTIVE;
+
+	if (mmc_get_ext_csd(host, card))
+		return 1;
+
+	/* Cards larger than 2 GiB use sector addressing */
+	sec_count = (card->ext_csd[MMC_SEC_COUNT4] << MMC_SEC_COUNT4_SHIFT)
+				| (card->ext_csd[MMC_SEC_COUNT3] << MMC_SEC_COUNT3_SHIFT)
+				| (card->ext_csd[MMC_SEC_COUNT2] << MMC_SEC_COUNT2_SHIFT)
+				| card->ext_csd[MMC_SEC_COUNT1];
+	if (sec_count * MMC_BLK_SZ > 0x80000000ULL)
+		card->type = MMC_TYPE_MMCHC;
+
+	if (mmc_decode_and_save_csd(card))
+		return 1;
+
+	switch (card->ext_csd[MMC_EXT_MMC_HS_TIMING] & 0xF)
+	{
+		case MMC_HS400_TIMING:
+			MMC_SAVE_TIMING(host, MMC_HS400_TIMING);
+			break;
+		case MMC_HS200_TIMING:
+			MMC_SAVE_TIMING(host, MMC_HS200_TIMING);
+			break;
+		default:
+			uhs_mode = REG_READ16(host, SDHCI_HOST_CTRL2_REG) & SDHCI_UHS_MODE_MASK;
+			if (uhs_mode == SDHCI_DDR50_MODE_EN)
+				MMC_SAVE_TIMING(host, SDHCI_DDR50_MODE);
+			else
+				MMC_SAVE_TIMING(host, SDHCI_SDR25_MODE);
+			break;
+	}
+
+	dprintf(INFO, "%s card: %s (%d.%d, %02d %04d), manufacturer: %x, OEM: %x, "
+		"capacity: %llu bytes, kept timing %u\n", mmc_card_type_str(card),
+		card->cid.pnm, card->cid.prv >> 4, card->cid.prv & 0xF,
+		card->cid.month, card->cid.year, card->cid.mid, card->cid.oid,
+		card->capacity, host->timing);
+
+	return mmc_card_enable_features(host, card);
+}
+#endif
+
 /*
  * Function: mmc_init_card
  * Arg     : mmc device structure
@@ -1525,6 +1887,11 @@ static uint32_t mmc_card_init(struct mmc_device *dev)
 	card = &dev->card;
 	cfg  = &dev->config;
 
+#if MMC_SDHCI_ADOPT
+	if (host->adopted)
+		return mmc_card_adopt(dev);
+#endif
+
 	/* Initialize MMC card structure */
 	card->status = MMC_STATUS_INACTIVE;
 
@@ -1711,26 +2078,20 @@ static uint32_t mmc_card_init(struct mmc_device *dev)
 			dprintf(CRITICAL, "Failed to set bus width for host controller\n");
 			return mmc_return;
 		}
-	}
-
-
-	card->block_size = MMC_BLK_SZ;
 
-	if (MMC_CARD_MMC(card)) {
-		/* Enable RST_n_FUNCTION */
-		if (!card->ext_csd[MMC_EXT_CSD_RST_N_FUNC])
+		/* UHS-I modes need 1.8V signalling & the 4 bit bus */
+		if (card->s18a && bus_width == DATA_BUS_WIDTH_4BIT)
 		{
-			mmc_return = mmc_switch_cmd(host, card, MMC_SET_BIT, MMC_EXT_CSD_RST_N_FUNC, RST_N_FUNC_ENABLE);
-
+			mmc_return = mmc_sd_set_uhs_mode(host, card, bus_width);
 			if (mmc_return)
 			{
-				dprintf(CRITICAL, "Failed to enable RST_n_FUNCTION\n");
+				dprintf(CRITICAL, "Failed to set UHS mode for SD card\n");
 				return mmc_return;
 			}
 		}
-
 	}
-	return mmc_return;
+
+	return mmc_card_enable_features(host, card);
 }
 
 /*
@@ -1787,6 +2148,14 @@ struct mmc_device *mmc_init(struct mmc_config_data *data)
 
 	/* Initialize and identify cards connected to host */
 	mmc_ret = mmc_card_init(dev);
+#if MMC_SDHCI_ADOPT
+	if (mmc_ret && dev->host.adopted) {
+		dprintf(INFO, "Failed to take over the card @ slot%d, initializing it again\n",
+			dev->config.slot);
+		mmc_adopt_failed = true;
+		return mmc_init(data);
+	}
+#endif
 	if (mmc_ret) {
 		dprintf(CRITICAL, "Failed detecting MMC/SDC @ slot%d\n",
 						  dev->config.slot);
@@ -1873,18 +2242,59 @@ static uint32_t mmc_stop_command(struct mmc_device *dev)
 }
 
 /*
- * Function: mmc sdhci read
- * Arg     : mmc device structure, block address, number of blocks & destination
- * Return  : 0 on Success, non zero on success
- * Flow    : Fill in the command structure & send the command
+ * Switch the partition access type to rpmb, a boot partition or default.
+ * Nothing is sent if the partition is already selected.
  */
-uint32_t mmc_sdhci_read(struct mmc_device *dev, void *dest,
-						uint64_t blk_addr, uint32_t num_blocks)
+static uint32_t mmc_sdhci_switch_part(struct mmc_device *dev, uint32_t type)
+{
+	uint32_t part_access;
+	uint32_t ret;
+
+	if ((dev->card.ext_csd[MMC_PARTITION_CONFIG] & PARTITION_ACCESS_MASK) == type)
+		return 0;
+
+	/* Clear the partition access */
+	part_access = dev->card.ext_csd[MMC_PARTITION_CONFIG] & ~PARTITION_ACCESS_MASK;
+	part_access |= type;
+
+	ret = mmc_switch_cmd(&dev->host, &dev->card, MMC_ACCESS_WRITE, MMC_PARTITION_CONFIG, part_access);
+
+	if (ret)
+	{
+		dprintf(CRITICAL, "Failed to switch partition to type: %u\n", type);
+		return 1;
+	}
+
+	dev->card.ext_csd[MMC_PARTITION_CONFIG] = part_access;
+	return 0;
+}
+
+/*
+ * Select the partition used for data commands (card->part_access).
+ * The switch is done lazily, so the user area stays selected unless a
+ * boot partition was accessed since the last command.
+ */
+static uint32_t mmc_sdhci_select_part(struct mmc_device *dev)
+{
+	struct mmc_card *card = &dev->card;
+
+	if (MMC_CARD_SD(card) || !card->ext_csd)
+		return 0;
+
+	return mmc_sdhci_switch_part(dev, card->part_access);
+}
+
+static uint32_t mmc_sdhci_read_sg(struct mmc_device *dev, void *dest,
+				  const struct mmc_sg *sg, uint32_t sg_count,
+				  uint64_t blk_addr, uint32_t num_blocks)
 {
 	uint32_t mmc_ret = 0;
 	struct mmc_command cmd;
 	struct mmc_card *card = &dev->card;
 
+	if (mmc_sdhci_select_part(dev))
+		return 1;
+
 	memset((struct mmc_command *)&cmd, 0, sizeof(struct mmc_command));
 
 	/* CMD17/18 Format:
@@ -1924,6 +2334,8 @@ uint32_t mmc_sdhci_read(struct mmc_device *dev, void *dest,
 
 	cmd.data.data_ptr = dest;
 	cmd.data.num_blocks = num_blocks;
+	cmd.data.sg = sg;
+	cmd.data.sg_count = sg_count;
 
 	/* send command */
 	mmc_ret = sdhci_send_command(&dev->host, &cmd);
@@ -1941,6 +2353,183 @@ uint32_t mmc_sdhci_read(struct mmc_device *dev, void *dest,
 	return mmc_parse_response(cmd.resp[0]);
 }
 
+/*
+ * Function: mmc sdhci read
+ * Arg     : mmc device structure, block address, number of blocks & destination
+ * Return  : 0 on Success, non zero on success
+ * Flow    : Fill in the command structure & send the command
+ */
+uint32_t mmc_sdhci_read(struct mmc_device *dev, void *dest,
+						uint64_t blk_addr, uint32_t num_blocks)
+{
+	return mmc_sdhci_read_sg(dev, dest, NULL, 0, blk_addr, num_blocks);
+}
+
+/*
+ * Function: mmc sdhci readv
+ * Arg     : mmc device structure, scatter list, block address & number of blocks
+ * Return  : 0 on Success, non zero on failure
+ * Flow    : Read consecutive blocks into several buffers with a single command.
+ *           The segment lengths must add up to num_blocks blocks.
+ */
+uint32_t mmc_sdhci_readv(struct mmc_device *dev, const struct mmc_sg *sg, uint32_t sg_count,
+						 uint64_t blk_addr, uint32_t num_blocks)
+{
+	return mmc_sdhci_read_sg(dev, NULL, sg, sg_count, blk_addr, num_blocks);
+}
+
+/*
+ * Function: mmc sdhci read part
+ * Arg     : mmc device structure, partition, destination, block address &
+ *           number of blocks
+ * Return  : 0 on Success, non zero on failure
+ * Flow    : Read from a hardware partition (e.g. a boot partition). The
+ *           partition stays selected until the next data command for another
+ *           partition, so consecutive reads only need a single switch.
+ */
+uint32_t mmc_sdhci_read_part(struct mmc_device *dev, uint32_t part, void *dest,
+							 uint64_t blk_addr, uint32_t num_blocks)
+{
+	uint32_t mmc_ret;
+
+	dev->card.part_access = part;
+	mmc_ret = mmc_sdhci_read(dev, dest, blk_addr, num_blocks);
+	dev->card.part_access = PART_ACCESS_DEFAULT;
+
+	return mmc_ret;
+}
+
+/*
+ * Function: mmc cmdq discard
+ * Arg     : mmc device structure
+ * Return  : 0 on Success, non zero on failure
+ * Flow    : Discard all the tasks queued on the card after an error
+ */
+static uint32_t mmc_cmdq_discard(struct mmc_device *dev)
+{
+	struct mmc_command cmd;
+
+	memset((struct mmc_command *)&cmd, 0, sizeof(struct mmc_command));
+
+	/* CMD48 Format:
+	 * [20:16] Task id
+	 * [3:0] TM op-code, 1 to discard the entire queue
+	 */
+	cmd.cmd_index = CMD48_CMDQ_TASK_MGMT;
+	cmd.argument = 1;
+	cmd.cmd_type = SDHCI_CMD_TYPE_NORMAL;
+	cmd.resp_type = SDHCI_CMD_RESP_R1B;
+
+	return sdhci_send_command(&dev->host, &cmd);
+}
+
+/*
+ * Function: mmc cmdq read
+ * Arg     : mmc device structure, read tasks & number of tasks
+ * Return  : 0 on Success, non zero if the card is left in command queue mode
+ * Flow    : 1. Enable command queueing on the card & the host
+ *           2. Keep up to queue depth tasks queued until all are done
+ *           3. Disable command queueing again
+ *           Tasks that are not complete after an error keep a non zero ret.
+ */
+static uint32_t mmc_cmdq_read(struct mmc_device *dev, struct mmc_read_task *tasks, uint32_t count)
+{
+	struct sdhci_host *host = &dev->host;
+	struct mmc_card *card = &dev->card;
+	uint32_t depth = MIN(card->cmdq_depth, SDHCI_CQE_MAX_SLOTS);
+	uint32_t slot_task[SDHCI_CQE_MAX_SLOTS];
+	uint32_t all = (depth < 32) ? (1U << depth) - 1 : ~0U;
+	uint32_t pending = 0, done, tag, next = 0;
+
+	if (mmc_switch_cmd(host, card, MMC_ACCESS_WRITE, MMC_EXT_CSD_CMDQ_MODE_EN, 1)) {
+		dprintf(CRITICAL, "Failed to enable command queueing\n");
+		card->cmdq_depth = 0;
+		return 0;
+	}
+
+	if (sdhci_cqe_enable(host, card->rca)) {
+		card->cmdq_depth = 0;
+		goto disable;
+	}
+
+	do {
+		/* Fill all free slots */
+		for (; next < count && pending != all; next++) {
+			if (tasks[next].num_blocks > SDHCI_CQE_MAX_BLOCKS)
+				continue;
+
+			tag = __builtin_ctz(~pending);
+			sdhci_cqe_queue_read(host, tag, tasks[next].dest,
+								 tasks[next].blk_addr, tasks[next].num_blocks);
+			slot_task[tag] = next;
+			pending |= BIT(tag);
+		}
+
+		if (!pending)
+			break;
+
+		if (sdhci_cqe_wait(host, pending, &done)) {
+			sdhci_cqe_recover(host);
+			mmc_cmdq_discard(dev);
+			/* Don't try again, the legacy reads still work */
+			card->cmdq_depth = 0;
+			goto disable;
+		}
+
+		pending &= ~done;
+		while (done) {
+			tag = __builtin_ctz(done);
+			done &= ~BIT(tag);
+			arch_invalidate_cache_range((addr_t)tasks[slot_task[tag]].dest,
+										tasks[slot_task[tag]].num_blocks * card->block_size);
+			tasks[slot_task[tag]].ret = 0;
+		}
+	} while (1);
+
+	sdhci_cqe_disable(host);
+
+disable:
+	if (mmc_switch_cmd(host, card, MMC_ACCESS_WRITE, MMC_EXT_CSD_CMDQ_MODE_EN, 0)) {
+		dprintf(CRITICAL, "Failed to disable command queueing\n");
+		return 1;
+	}
+
+	return 0;
+}
+
+/*
+ * Function: mmc sdhci read queued
+ * Arg     : mmc device structure, read tasks & number of tasks
+ * Return  : 0 on Success, non zero if any task failed
+ * Flow    : Read all tasks with command queueing if the card & host support
+ *           it, so the card can prepare the next reads while one is being
+ *           transferred. Tasks that could not be queued are read one by one.
+ */
+uint32_t mmc_sdhci_read_queued(struct mmc_device *dev, struct mmc_read_task *tasks, uint32_t count)
+{
+	uint32_t mmc_ret = 0;
+	uint32_t i;
+
+	for (i = 0; i < count; i++)
+		tasks[i].ret = 1;
+
+	if (mmc_sdhci_select_part(dev))
+		return 1;
+
+	/* Legacy reads are not possible while the card is in command queue mode */
+	if (count > 1 && dev->card.cmdq_depth && mmc_cmdq_read(dev, tasks, count))
+		return 1;
+
+	for (i = 0; i < count; i++) {
+		if (tasks[i].ret)
+			tasks[i].ret = mmc_sdhci_read(dev, tasks[i].dest, tasks[i].blk_addr,
+										  tasks[i].num_blocks);
+		mmc_ret |= tasks[i].ret;
+	}
+
+	return mmc_ret ? 1 : 0;
+}
+
 /*
  * Function: mmc sdhci write
  * Arg     : mmc device structure, block address, number of blocks & source
@@ -1954,6 +2543,9 @@ uint32_t mmc_sdhci_write(struct mmc_device *dev, void *src,
 	struct mmc_command cmd;
 	struct mmc_card *card = &dev->card;
 
+	if (mmc_sdhci_select_part(dev))
+		return 1;
+
 	memset((struct mmc_command *)&cmd, 0, sizeof(struct mmc_command));
 
 	/* CMD24/25 Format:
@@ -2099,7 +2691,7 @@ static uint32_t mmc_send_erase_grp_end(struct mmc_device *dev, uint32_t erase_en
 /*
  * Send the erase CMD38, to erase the selected erase groups
  */
-static uint32_t mmc_send_erase(struct mmc_device *dev, uint64_t erase_timeout)
+static uint32_t mmc_send_erase(struct mmc_device *dev, uint32_t arg, uint64_t erase_timeout)
 {
 	struct mmc_command cmd;
 	uint32_t status;
@@ -2108,7 +2700,7 @@ static uint32_t mmc_send_erase(struct mmc_device *dev, uint64_t erase_timeout)
 	memset((struct mmc_command *)&cmd, 0, sizeof(struct mmc_command));
 
 	cmd.cmd_index = CMD38_ERASE;
-	cmd.argument = 0x00000000;
+	cmd.argument = arg;
 	cmd.cmd_type = SDHCI_CMD_TYPE_NORMAL;
 	cmd.resp_type = SDHCI_CMD_RESP_R1B;
 	cmd.cmd_timeout = erase_timeout;
@@ -2161,6 +2753,9 @@ uint32_t mmc_sdhci_erase(struct mmc_device *dev, uint32_t blk_addr, uint64_t len
 
 	card = &dev->card;
 
+	if (mmc_sdhci_select_part(dev))
+		return 1;
+
 	/*
 	 * Calculate the erase unit size,
 	 * 1. Based on emmc 4.5 spec for emmc card
@@ -2231,7 +2826,7 @@ uint32_t mmc_sdhci_erase(struct mmc_device *dev, uint32_t blk_addr, uint64_t len
 		erase_timeout = (300 * 1000 * num_erase_grps);
 
 	/* Send CMD38 to perform erase */
-	if (mmc_send_erase(dev, erase_timeout))
+	if (mmc_send_erase(dev, MMC_ERASE_ARG, erase_timeout))
 	{
 		dprintf(CRITICAL, "Failed to erase the specified partition\n");
 		return 1;
@@ -2240,6 +2835,114 @@ uint32_t mmc_sdhci_erase(struct mmc_device *dev, uint32_t blk_addr, uint64_t len
 	return 0;
 }
 
+/*
+ * Function: mmc sdhci trim
+ * Arg     : mmc device structure, block address, number of blocks & discard
+ * Return  : 0 on Success, non zero on failure
+ * Flow    : Tell the card that the blocks are no longer used. Unlike erase
+ *           the range does not need to be aligned to the erase groups.
+ *           1. Trim: the blocks read back as erased memory content
+ *           2. Discard (emmc 4.5): faster, the content is undefined. Falls
+ *              back to trim on older cards.
+ */
+uint32_t mmc_sdhci_trim(struct mmc_device *dev, uint32_t blk_addr, uint32_t num_blocks, bool discard)
+{
+	struct mmc_card *card = &dev->card;
+	uint32_t erase_unit_sz;
+	uint32_t num_erase_grps;
+	uint64_t trim_timeout;
+	uint32_t arg;
+
+	if (!mmc_card_supports_trim(card) || !num_blocks)
+		return 1;
+
+	if (mmc_sdhci_select_part(dev))
+		return 1;
+
+	if (discard && card->ext_csd[MMC_EXT_CSD_REV] >= 6)
+		arg = MMC_DISCARD_ARG;
+	else
+		arg = MMC_TRIM_ARG;
+
+	if (card->ext_csd[MMC_ERASE_GRP_DEF])
+		erase_unit_sz = (MMC_HC_ERASE_MULT * card->ext_csd[MMC_HC_ERASE_GRP_SIZE]) / MMC_BLK_SZ;
+	else
+		erase_unit_sz = (card->csd.erase_grp_size + 1) * (card->csd.erase_grp_mult + 1);
+
+	/* The trim timeout applies to each erase group in the range */
+	num_erase_grps = (blk_addr + num_blocks - 1) / erase_unit_sz - blk_addr / erase_unit_sz + 1;
+	trim_timeout = 300 * 1000 * (uint64_t)card->ext_csd[MMC_EXT_CSD_TRIM_MULT] * num_erase_grps;
+
+	if (mmc_send_erase_grp_start(dev, blk_addr))
+	{
+		dprintf(CRITICAL, "Failed to send trim start address\n");
+		return 1;
+	}
+
+	if (mmc_send_erase_grp_end(dev, blk_addr + num_blocks - 1))
+	{
+		dprintf(CRITICAL, "Failed to send trim end address\n");
+		return 1;
+	}
+
+	if (mmc_send_erase(dev, arg, trim_timeout))
+	{
+		dprintf(CRITICAL, "Failed to trim the specified blocks\n");
+		return 1;
+	}
+
+	return 0;
+}
+
+/*
+ * Function: mmc sdhci set cache
+ * Arg     : mmc device structure, enable or disable
+ * Return  : 0 on Success, 1 on Failure
+ * Flow    : Turn the volatile write cache of eMMC 4.5 cards on or off.
+ *           Turning it off writes back the cached data first. Does
+ *           nothing if the card has no cache.
+ */
+uint32_t mmc_sdhci_set_cache(struct mmc_device *dev, bool enable)
+{
+	struct mmc_card *card = &dev->card;
+
+	if (!card->cache_size || card->cache_enabled == enable)
+		return 0;
+
+	if (mmc_switch_cmd_timeout(&dev->host, card, MMC_ACCESS_WRITE, MMC_EXT_CSD_CACHE_CTRL,
+							   enable, MMC_FLUSH_CACHE_TIMEOUT))
+	{
+		dprintf(CRITICAL, "Failed to %s the write cache\n", enable ? "enable" : "disable");
+		return 1;
+	}
+
+	card->cache_enabled = enable;
+	return 0;
+}
+
+/*
+ * Function: mmc sdhci flush cache
+ * Arg     : mmc device structure
+ * Return  : 0 on Success, 1 on Failure
+ * Flow    : Write back the contents of the write cache to the flash
+ */
+uint32_t mmc_sdhci_flush_cache(struct mmc_device *dev)
+{
+	struct mmc_card *card = &dev->card;
+
+	if (!card->cache_enabled)
+		return 0;
+
+	if (mmc_switch_cmd_timeout(&dev->host, card, MMC_ACCESS_WRITE, MMC_EXT_CSD_FLUSH_CACHE,
+							   1, MMC_FLUSH_CACHE_TIMEOUT))
+	{
+		dprintf(CRITICAL, "Failed to flush the write cache\n");
+		return 1;
+	}
+
+	return 0;
+}
+
 /*
  * Function: mmc get wp status
  * Arg     : mmc device structure, block address and buffer for getting wp status
@@ -2250,6 +2953,9 @@ uint32_t mmc_get_wp_status(struct mmc_device *dev, uint32_t addr, uint8_t *wp_st
 {
 	struct mmc_command cmd;
 
+	if (mmc_sdhci_select_part(dev))
+		return 1;
+
 	memset((struct mmc_command *)&cmd, 0, sizeof(struct mmc_command));
 
 	cmd.cmd_index = CMD31_SEND_WRITE_PROT_TYPE;
@@ -2289,6 +2995,9 @@ uint32_t mmc_set_clr_power_on_wp_user(struct mmc_device *dev, uint32_t addr, uin
 	uint32_t retry = 0;
 	uint32_t i;
 
+	if (mmc_sdhci_select_part(dev))
+		return 1;
+
 	memset((struct mmc_command *)&cmd, 0, sizeof(struct mmc_command));
 
 	/* Convert len into blocks */
@@ -2422,30 +3131,6 @@ void mmc_put_card_to_sleep(struct mmc_device *dev)
 	}
 }
 
-/*
- * Switch the partition access type to rpmb or default
- */
-static uint32_t mmc_sdhci_switch_part(struct mmc_device *dev, uint32_t type)
-{
-	uint32_t part_access;
-	uint32_t ret;
-
-	/* Clear the partition access */
-	part_access = dev->card.ext_csd[MMC_PARTITION_CONFIG] & ~PARTITION_ACCESS_MASK;
-	part_access |= type;
-
-	ret = mmc_switch_cmd(&dev->host, &dev->card, MMC_ACCESS_WRITE, MMC_PARTITION_CONFIG, part_access);
-
-	if (ret)
-	{
-		dprintf(CRITICAL, "Failed to switch partition to type: %u\n", type);
-		return 1;
-	}
-
-	dev->card.ext_csd[MMC_PARTITION_CONFIG] = part_access;
-	return 0;
-}
-
 static uint32_t mmc_sdhci_set_blk_cnt(struct mmc_device *dev, uint32_t blk_cnt, uint32_t rel_write)
 {
 	struct mmc_command cmd = {0};
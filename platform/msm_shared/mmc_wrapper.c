@@ -421,6 +421,144 @@ uint32_t mmc_erase_card(uint64_t addr, uint64_t len)
 	return 0;
 }
 
+/*
+ * Function: mmc get zero erase unit
+ * Arg     : None
+ * Return  : Erase unit size in bytes if erased blocks read back as zeros,
+ *           0 otherwise
+ * Flow    : Check the erased memory content reported by the eMMC card
+ */
+uint32_t mmc_get_zero_erase_unit(void)
+{
+	struct mmc_device *dev;
+	struct mmc_card *card;
+
+	if (!platform_boot_dev_isemmc())
+		return 0;
+
+	dev = target_mmc_device();
+	card = &dev->card;
+	if (!MMC_CARD_MMC(card) || card->ext_csd[MMC_EXT_CSD_ERASED_MEM_CONT])
+		return 0;
+
+	return mmc_get_eraseunit_size() * mmc_get_device_blocksize();
+}
+
+/*
+ * Function: mmc erase units
+ * Arg     : Address & length, aligned to the erase unit
+ * Return  : 0 on Success, 1 on Failure
+ * Flow    : Erase whole erase units only. Unlike mmc_erase_card() this
+ *           never zeroes out unaligned blocks through the scratch region,
+ *           so it can be used while the scratch region holds data.
+ */
+uint32_t mmc_erase_units(uint64_t addr, uint64_t len)
+{
+	struct mmc_device *dev;
+	uint32_t block_size;
+
+	block_size = mmc_get_device_blocksize();
+	dev = target_mmc_device();
+
+	ASSERT(platform_boot_dev_isemmc());
+	ASSERT(!(addr % block_size));
+	ASSERT(!(len % block_size));
+
+	if (mmc_sdhci_erase(dev, addr / block_size, len))
+	{
+		dprintf(CRITICAL, "MMC erase failed\n");
+		return 1;
+	}
+
+	return 0;
+}
+
+/*
+ * Function: mmc trim supported
+ * Arg     : None
+ * Return  : 1 if trim/discard (eMMC) or unmap (UFS) is supported,
+ *           0 otherwise
+ * Flow    : Check the capabilities of the boot device
+ */
+uint32_t mmc_trim_supported(void)
+{
+	struct mmc_device *dev;
+
+	if (!platform_boot_dev_isemmc())
+		return 1;
+
+	dev = target_mmc_device();
+	return mmc_card_supports_trim(&dev->card);
+}
+
+/*
+ * Function: mmc trim card
+ * Arg     : Address, length & discard
+ * Return  : 0 on Success, 1 on Failure
+ * Flow    : Tell the storage that the range is no longer used, with trim
+ *           or discard for eMMC and unmap for UFS. With discard the content
+ *           of the range is undefined afterwards.
+ */
+uint32_t mmc_trim_card(uint64_t addr, uint64_t len, bool discard)
+{
+	void *dev;
+	uint32_t block_size;
+
+	block_size = mmc_get_device_blocksize();
+	dev = target_mmc_device();
+
+	ASSERT(!(addr % block_size));
+	ASSERT(!(len % block_size));
+
+	if (platform_boot_dev_isemmc())
+	{
+		if (mmc_sdhci_trim((struct mmc_device *)dev, addr / block_size, len / block_size, discard))
+		{
+			dprintf(CRITICAL, "MMC trim failed\n");
+			return 1;
+		}
+	}
+	else
+	{
+		if (ufs_erase((struct ufs_dev *)dev, addr, (len / block_size)))
+		{
+			dprintf(CRITICAL, "mmc_trim_card: UFS unmap failed\n");
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+/*
+ * Function: mmc write cache enable
+ * Arg     : Enable or disable
+ * Return  : 0 on Success, 1 on Failure
+ * Flow    : Turn the volatile write cache of eMMC on or off, disabling it
+ *           writes back the cached data. UFS manages its cache itself.
+ */
+uint32_t mmc_write_cache_enable(bool enable)
+{
+	if (!platform_boot_dev_isemmc())
+		return 0;
+
+	return mmc_sdhci_set_cache((struct mmc_device *)target_mmc_device(), enable);
+}
+
+/*
+ * Function: mmc write cache flush
+ * Arg     : None
+ * Return  : 0 on Success, 1 on Failure
+ * Flow    : Write back the data in the eMMC write cache, if it is enabled
+ */
+uint32_t mmc_write_cache_flush(void)
+{
+	if (!platform_boot_dev_isemmc())
+		return 0;
+
+	return mmc_sdhci_flush_cache((struct mmc_device *)target_mmc_device());
+}
+
 /*
  * Function: mmc get psn
  * Arg     : None
@@ -86,6 +86,16 @@ static unsigned partition_count;
 /* this is a pointer to ptn_entries_buffer */
 static unsigned char *new_buffer = NULL;
 
+/*
+ * Hash table of the partition names for partition_get_index(), storing
+ * the index into partition_entries + 1 (0 = empty slot). It is rebuilt on
+ * the next lookup after the partition table was changed.
+ */
+#define PARTITION_HASH_SIZE 256 /* Power of two, larger than NUM_PARTITIONS */
+static uint16_t partition_hash[PARTITION_HASH_SIZE];
+static unsigned partition_hash_count;
+static bool partition_hash_valid;
+
 unsigned partition_get_partition_count(void)
 {
 	return partition_count;
@@ -100,6 +110,7 @@ struct partition_entry *partition_allocate(void)
 {
 	if (partition_count >= NUM_PARTITIONS)
 		return NULL;
+	partition_hash_valid = false;
 	return &partition_entries[partition_count++];
 }
 
@@ -109,6 +120,7 @@ unsigned int partition_read_table(void)
 	uint32_t block_size;
 
 	block_size = mmc_get_device_blocksize();
+	partition_hash_valid = false;
 
 	/* Allocate partition entries array */
 	if(!partition_entries)
@@ -523,55 +535,12 @@ static unsigned int write_mbr(uint32_t size, uint8_t *mbrImage, uint32_t block_s
 	return ret;
 }
 
-/*
- * A8h reflected is 15h, i.e. 10101000 <--> 00010101
-*/
-int reflect(int data, int len)
-{
-	int ref = 0;
-
-	for (int i = 0; i < len; i++) {
-		if (data & 0x1) {
-			ref |= (1 << ((len - 1) - i));
-		}
-		data = (data >> 1);
-	}
-
-	return ref;
-}
-
 /*
 * Function to calculate the CRC32
 */
-unsigned int calculate_crc32(unsigned char *buffer, int len)
+static unsigned int calculate_crc32(unsigned char *buffer, int len)
 {
-	int byte_length = 8;	/*length of unit (i.e. byte) */
-	int msb = 0;
-	int polynomial = 0x04C11DB7;	/* IEEE 32bit polynomial */
-	unsigned int regs = 0xFFFFFFFF;	/* init to all ones */
-	int regs_mask = 0xFFFFFFFF;	/* ensure only 32 bit answer */
-	int regs_msb = 0;
-	unsigned int reflected_regs;
-
-	for (int i = 0; i < len; i++) {
-		int data_byte = buffer[i];
-		data_byte = reflect(data_byte, 8);
-		for (int j = 0; j < byte_length; j++) {
-			msb = data_byte >> (byte_length - 1);	/* get MSB */
-			msb &= 1;	/* ensure just 1 bit */
-			regs_msb = (regs >> 31) & 1;	/* MSB of regs */
-			regs = regs << 1;	/* shift regs for CRC-CCITT */
-			if (regs_msb ^ msb) {	/* MSB is a 1 */
-				regs = regs ^ polynomial;	/* XOR with generator poly */
-			}
-			regs = regs & regs_mask;	/* Mask off excess upper bits */
-			data_byte <<= 1;	/* get to next bit */
-		}
-	}
-	regs = regs & regs_mask;
-	reflected_regs = reflect(regs, 32) ^ 0xFFFFFFFF;
-
-	return reflected_regs;
+	return crc32(~0U, buffer, len) ^ ~0U;
 }
 
 /*
@@ -832,6 +801,7 @@ unsigned int write_partition(unsigned size, unsigned char *partition)
 	}
 
 	block_size = mmc_get_device_blocksize();
+	partition_hash_valid = false;
 	/* size is from target_get_max_flash_size and it will check at
 	* cmd_download if it is size > download_max it will fail early
 	* and will not cause any oob
@@ -942,59 +912,91 @@ mbr_fill_name(struct partition_entry *partition_ent, unsigned int type)
 	};
 }
 
+static uint32_t partition_name_hash(const char *name)
+{
+	uint32_t hash = 2166136261U; /* FNV-1a */
+
+	while (*name)
+	{
+		hash ^= (uint8_t)*name++;
+		hash *= 16777619U;
+	}
+	return hash & (PARTITION_HASH_SIZE - 1);
+}
+
+static void partition_hash_build(void)
+{
+	unsigned n, slot;
+	const char *name;
+
+	memset(partition_hash, 0, sizeof(partition_hash));
+	for (n = 0; n < partition_count; n++)
+	{
+		name = (const char *)partition_entries[n].name;
+		slot = partition_name_hash(name);
+
+		/* Keep the first partition if there are duplicate names */
+		while (partition_hash[slot] &&
+			   strcmp(name, (const char *)partition_entries[partition_hash[slot] - 1].name))
+			slot = (slot + 1) & (PARTITION_HASH_SIZE - 1);
+
+		if (!partition_hash[slot])
+			partition_hash[slot] = n + 1;
+	}
+
+	partition_hash_count = partition_count;
+	partition_hash_valid = true;
+}
+
+static int partition_hash_find(const char *name)
+{
+	unsigned slot = partition_name_hash(name);
+	unsigned n;
+
+	if (!partition_hash_valid || partition_hash_count != partition_count)
+		partition_hash_build();
+
+	while (partition_hash[slot])
+	{
+		n = partition_hash[slot] - 1;
+		if (!strcmp(name, (const char *)partition_entries[n].name))
+			return n;
+		slot = (slot + 1) & (PARTITION_HASH_SIZE - 1);
+	}
+	return INVALID_PTN;
+}
+
 /*
  * Find index of parition in array of partition entries
  */
 int partition_get_index(const char *name)
 {
-	unsigned int input_string_length = strlen(name);
-	unsigned n;
+	char slot_name[MAX_GPT_NAME_SIZE];
+	int index;
 	int curr_slot = INVALID;
-	const char *suffix_curr_actv_slot = NULL;
-	char *curr_suffix = NULL;
 
 	if( partition_count >= NUM_PARTITIONS)
 	{
 		return INVALID_PTN;
 	}
 
-	/*	We iterate through the parition entries list,
-		to find the partition with active slot suffix.
-	*/
-	for (n = 0; n < partition_count; n++)
-	{
-		if (!strncmp((const char*)name, (const char *)partition_entries[n].name,
-					input_string_length))
-		{
-			curr_suffix = (char *)(partition_entries[n].name+input_string_length);
+	index = partition_hash_find(name);
+	if (index != INVALID_PTN || !partition_multislot_is_supported())
+		return index;
 
-			/* if partition_entries.name is NULL terminated return the index */
-			if (*curr_suffix == '\0')
-				return n;
+	/* Otherwise look for the partition with active slot suffix */
+	curr_slot = partition_find_active_slot();
+	if (curr_slot == INVALID)
+	{
+		/* No valid active slot */
+		return INVALID_PTN;
+	}
 
-			if (partition_multislot_is_supported())
-			{
-				curr_slot = partition_find_active_slot();
+	strlcpy(slot_name, name, sizeof(slot_name));
+	if (strlcat(slot_name, SUFFIX_SLOT(curr_slot), sizeof(slot_name)) >= sizeof(slot_name))
+		return INVALID_PTN;
 
-				/* If suffix string matches with current active slot suffix return index */
-				if (curr_slot != INVALID)
-				{
-					suffix_curr_actv_slot = SUFFIX_SLOT(curr_slot);
-					if (!strncmp((const char *)curr_suffix, suffix_curr_actv_slot,
-							strlen(suffix_curr_actv_slot)))
-						return n;
-					else
-						continue;
-				}
-				else
-				{
-					/* No valid active slot */
-					return INVALID_PTN;
-				}
-			}
-		}
-	}
-	return INVALID_PTN;
+	return partition_hash_find(slot_name);
 }
 
 /*
@@ -33,9 +33,11 @@
 
 #include <reg.h>
 #include <arch/arm.h>
+#include <arch/defines.h>
 #include <qgic.h>
 
-static uint8_t qgic_get_cpumask(void)
+/* GIC CPU interface mask of the calling CPU */
+uint8_t qgic_get_cpumask(void)
 {
 	uint32_t mask=0, i;
 
@@ -97,3 +99,10 @@ void qgic_write_eoi(uint32_t num)
 {
 	writel(num, GIC_CPU_EOI);
 }
+
+/* Send a software generated interrupt to the CPUs in cpumask */
+void qgic_send_sgi(uint32_t sgi, uint8_t cpumask)
+{
+	dsb();
+	writel((cpumask << 16) | (sgi & 0xf), GIC_DIST_SOFTINT);
+}
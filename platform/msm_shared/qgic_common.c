@@ -30,6 +30,7 @@
 #include <reg.h>
 #include <bits.h>
 #include <arch/arm.h>
+#include <kernel/ktrace.h>
 #include <kernel/thread.h>
 #include <platform/irqs.h>
 #include <platform/iomap.h>
@@ -74,22 +75,35 @@ void qgic_init(void)
 	qgic_cpu_init();
 }
 
+static struct arm_iframe *gic_irq_frame;
+
+/* Registers of the interrupted code, only valid inside an IRQ handler */
+struct arm_iframe *gic_current_iframe(void)
+{
+	return gic_irq_frame;
+}
+
 /* IRQ handler */
 enum handler_return gic_platform_irq(struct arm_iframe *frame)
 {
-	uint32_t num;
+	uint32_t iar, num;
 	enum handler_return ret;
 
 	/* Read the interrupt number to be served*/
-	num = qgic_read_iar();
+	iar = qgic_read_iar();
 
+	/* SGIs have the ID of the sending CPU in the upper bits */
+	num = iar & 0x3ff;
 	if (num >= NR_IRQS)
 		return 0;
 
+	gic_irq_frame = frame;
+	ktrace(KTRACE_IRQ_ENTER, num, 0, 0);
 	ret = handler[num].func(handler[num].arg);
+	ktrace(KTRACE_IRQ_EXIT, num, 0, 0);
 
 	/* End of interrupt */
-	qgic_write_eoi(num);
+	qgic_write_eoi(iar);
 
 	return ret;
 }
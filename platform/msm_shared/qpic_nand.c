@@ -32,8 +32,11 @@
 #include <lib/ptable.h>
 #include <debug.h>
 #include <string.h>
+#include <stdlib.h>
 #include <malloc.h>
 #include <bits.h>
+#include <arch/defines.h>
+#include <arch/ops.h>
 #include <sys/types.h>
 #include <platform.h>
 #include <platform/clock.h>
@@ -54,11 +57,27 @@ static uint32_t ecc_parity_bytes;
 struct cmd_element ce_array[100] __attribute__ ((aligned(16)));
 struct cmd_element ce_read_array[20] __attribute__ ((aligned(16)));
 
-#define QPIC_BAM_DATA_FIFO_SIZE          64
-#define QPIC_BAM_CMD_FIFO_SIZE           64
+/* Pages read with a single bam transfer and the cmd elements for each page */
+#define QPIC_NAND_READ_BATCH_PAGES       8
+#define QPIC_NAND_PAGE_READ_CES          (8 + 6 * QPIC_NAND_MAX_CWS_IN_PAGE)
+
+static struct cmd_element ce_batch_array[QPIC_NAND_READ_BATCH_PAGES * QPIC_NAND_PAGE_READ_CES] __attribute__ ((aligned(16)));
+
+/* Large enough for the descriptors of QPIC_NAND_READ_BATCH_PAGES pages */
+#define QPIC_BAM_DATA_FIFO_SIZE          256
+#define QPIC_BAM_CMD_FIFO_SIZE           256
 
 #define THRESHOLD_BIT_FLIPS              4
 
+/* Linux on-flash bad block table (NAND_BBT_NO_OOB): "Bbt0"/"1tbB" pattern,
+ * version byte, then 2 bits per block, in one of the last blocks.
+ */
+#define NAND_BBT_PATTERN_LEN             4
+#define NAND_BBT_VERSION_OFFS            4
+#define NAND_BBT_DATA_OFFS               5
+#define NAND_BBT_SCAN_MAXBLOCKS          4
+#define NAND_BBT_BLOCK_GOOD              0x3
+
 static struct bam_desc cmd_desc_fifo[QPIC_BAM_CMD_FIFO_SIZE] __attribute__ ((aligned(BAM_DESC_SIZE)));
 static struct bam_desc data_desc_fifo[QPIC_BAM_DATA_FIFO_SIZE] __attribute__ ((aligned(BAM_DESC_SIZE)));
 
@@ -84,6 +103,8 @@ static struct flash_id supported_flash[] = {
 };
 
 static int qpic_nand_mark_badblock(uint32_t page);
+static int qpic_nand_read_pages(uint32_t page, uint32_t num_pages, unsigned char *buffer,
+								unsigned char *spareaddr, uint32_t *pages_read);
 
 static void
 qpic_nand_wait_for_cmd_exec(uint32_t num_desc)
@@ -490,6 +511,71 @@ qpic_nand_onfi_probe_cleanup(uint32_t vld, uint32_t dev_cmd1)
 	qpic_nand_wait_for_cmd_exec(1);
 }
 
+/* CRC-16 of the ONFI parameter page, over everything but the CRC itself. */
+static uint16_t
+qpic_nand_onfi_crc16(const unsigned char *data, unsigned len)
+{
+	uint16_t crc = ONFI_CRC_INIT_VALUE;
+	unsigned i, bit;
+
+	for (i = 0; i < len; i++)
+	{
+		crc ^= data[i] << 8;
+		for (bit = 0; bit < 8; bit++)
+			crc = (crc & 0x8000) ? (crc << 1) ^ ONFI_CRC_POLYNOMIAL : crc << 1;
+	}
+
+	return crc;
+}
+
+/* Function: qpic_nand_onfi_find_param_page
+ * Arg     : Buffer with the redundant copies of the parameter page
+ * Return  : First copy with a valid CRC, NULL if there is none
+ * Flow    : The device returns the parameter page several times in a row,
+ *           so a corrupted copy can be skipped.
+ */
+static struct onfi_param_page *
+qpic_nand_onfi_find_param_page(unsigned char *buffer)
+{
+	struct onfi_param_page *param_page;
+	unsigned offset;
+
+	for (offset = 0; offset + ONFI_PARAM_PAGE_SIZE <= ONFI_READ_PARAM_PAGE_BUFFER_SIZE;
+		 offset += ONFI_PARAM_PAGE_SIZE)
+	{
+		param_page = (struct onfi_param_page *)(buffer + offset);
+		if (param_page->signature == ONFI_SIGNATURE &&
+			qpic_nand_onfi_crc16(buffer + offset, ONFI_PARAM_PAGE_CRC_LEN) ==
+			param_page->interity_crc)
+			return param_page;
+	}
+
+	return NULL;
+}
+
+/* Function: qpic_nand_onfi_timing_mode
+ * Arg     : Parameter page with a valid CRC
+ * Return  : Fastest asynchronous timing mode supported by the device
+ * Flow    : Mode 0 is always supported and is used after power on. Switching
+ *           to another mode needs the SET FEATURES command, which cannot be
+ *           issued with the operations of the controller (there is no
+ *           FLASH_CMD for a command + address + data sequence without a
+ *           confirm cycle), so the mode is only reported. The wait cycles in
+ *           CFG1 are already below the mode 0 tWB/tRHW, so the controller
+ *           timing stays as it is.
+ */
+static unsigned
+qpic_nand_onfi_timing_mode(struct onfi_param_page *param_page)
+{
+	uint16_t modes = param_page->timing_mode_support & ONFI_TIMING_MODES_MASK;
+	unsigned mode = 0;
+
+	while (modes >> (mode + 1))
+		mode++;
+
+	return mode;
+}
+
 static int
 qpic_nand_onfi_save_params(struct onfi_param_page *param_page, struct flash_info *flash)
 {
@@ -719,9 +805,19 @@ qpic_nand_onfi_probe(struct flash_info *flash)
 	qpic_nand_onfi_probe_cleanup(vld, dev_cmd1);
 
 	/* Verify the integrity of the returned page */
-	param_page = (struct onfi_param_page*)buffer;
-
-	/* TODO: Add CRC check to validate the param page. */
+	param_page = qpic_nand_onfi_find_param_page(buffer);
+	if (param_page)
+	{
+		dprintf(INFO, "ONFI timing modes: 0x%x, fastest: %u\n",
+				param_page->timing_mode_support,
+				qpic_nand_onfi_timing_mode(param_page));
+	}
+	else
+	{
+		/* Keep using the first copy like before, the CRC is not always right */
+		dprintf(CRITICAL, "ONFI param page CRC mismatch\n");
+		param_page = (struct onfi_param_page*)buffer;
+	}
 
 	/* Save the parameter values */
 	onfi_ret = qpic_nand_onfi_save_params(param_page, flash);
@@ -1247,9 +1343,78 @@ qpic_nand_mark_badblock(uint32_t page)
 	if (page & flash.num_pages_per_blk_mask)
 		page = page - (page & flash.num_pages_per_blk_mask);
 
+	bbtbl[page / flash.num_pages_per_blk] = NAND_BAD_BLK_VALUE_IS_BAD;
+
 	return qpic_nand_write_page(page, NAND_CFG_RAW, empty_buf, 0);
 }
 
+/* Look for one copy of the on-flash bad block table in the last blocks.
+ * pattern: Pattern of the main table or the mirror.
+ * buf: Where the table is read to, num_pages long.
+ * Returns the block of the table, -1 if there is none.
+ */
+static int
+qpic_nand_find_bbt(const char *pattern, unsigned char *buf, uint32_t num_pages)
+{
+	uint32_t blk, done, i;
+
+	for (i = 0; i < NAND_BBT_SCAN_MAXBLOCKS && i < flash.num_blocks; i++)
+	{
+		blk = flash.num_blocks - 1 - i;
+		if (qpic_nand_read_pages(blk * flash.num_pages_per_blk, num_pages, buf,
+								 flash_spare_bytes, &done))
+			continue;
+		if (!memcmp(buf, pattern, NAND_BBT_PATTERN_LEN))
+			return blk;
+	}
+
+	return -1;
+}
+
+/* Fill the bad block table from the table maintained by linux, if there is
+ * one. Otherwise the bad block markers of each block are read on first use.
+ */
+static void
+qpic_nand_read_bbt(void)
+{
+	uint32_t len = NAND_BBT_DATA_OFFS + ROUNDUP(flash.num_blocks, 4) / 4;
+	uint32_t num_pages = ROUNDUP(len, flash.page_size) / flash.page_size;
+	unsigned char *buf, *mirror, *bbt;
+	int main_blk, mirror_blk;
+	uint32_t i;
+
+	if (num_pages > QPIC_NAND_READ_BATCH_PAGES)
+		return;
+
+	buf = malloc(2 * num_pages * flash.page_size);
+	if (!buf)
+		return;
+	mirror = buf + num_pages * flash.page_size;
+
+	main_blk = qpic_nand_find_bbt("Bbt0", buf, num_pages);
+	mirror_blk = qpic_nand_find_bbt("1tbB", mirror, num_pages);
+	if (main_blk < 0 && mirror_blk < 0)
+		goto out;
+
+	/* Use the newer copy */
+	bbt = buf;
+	if (main_blk < 0 ||
+		(mirror_blk >= 0 && mirror[NAND_BBT_VERSION_OFFS] > buf[NAND_BBT_VERSION_OFFS]))
+		bbt = mirror;
+
+	for (i = 0; i < flash.num_blocks; i++)
+	{
+		if (((bbt[NAND_BBT_DATA_OFFS + i / 4] >> ((i % 4) * 2)) & 0x3) == NAND_BBT_BLOCK_GOOD)
+			bbtbl[i] = NAND_BAD_BLK_VALUE_IS_GOOD;
+		else
+			bbtbl[i] = NAND_BAD_BLK_VALUE_IS_BAD;
+	}
+	dprintf(INFO, "NAND bad block table version %u found\n", bbt[NAND_BBT_VERSION_OFFS]);
+
+out:
+	free(buf);
+}
+
 static void
 qpic_nand_non_onfi_probe(struct flash_info *flash)
 {
@@ -1372,6 +1537,7 @@ qpic_nand_init(struct qpic_nand_init_config *config)
 		return;
 	}
 
+	qpic_nand_read_bbt();
 }
 
 unsigned
@@ -1624,29 +1790,48 @@ qpic_nand_read_page_error:
 	return nand_ret;
 }
 
-/* Note: No support for raw reads. */
-static int
-qpic_nand_read_page(uint32_t page, unsigned char* buffer, unsigned char* spareaddr)
+/* Status registers of all the codewords in a page, written by the BAM.
+ * Cache line aligned so it can be invalidated on its own.
+ */
+struct qpic_nand_page_sts
+{
+	uint32_t flash[QPIC_NAND_MAX_CWS_IN_PAGE];
+	uint32_t buffer[QPIC_NAND_MAX_CWS_IN_PAGE];
+	uint32_t erased_cw[QPIC_NAND_MAX_CWS_IN_PAGE];
+} __attribute__ ((aligned(CACHE_LINE)));
+
+static struct qpic_nand_page_sts page_sts;
+static struct qpic_nand_page_sts batch_sts[QPIC_NAND_READ_BATCH_PAGES];
+static unsigned char batch_spare[DATA_BYTES_IN_IMG_PER_CW] __attribute__ ((aligned(CACHE_LINE)));
+
+/* Queue up the command and data descriptors for all the codewords in a page.
+ * page: Page to read.
+ * buffer, spareaddr: Where the data and the spare bytes of the last CW go.
+ * cmd_list_ptr: Where the cmd elements for the page are added.
+ * sts: Where the status registers of the codewords are read to.
+ * first: Lock the pipe with the first descriptor.
+ * last: Unlock the pipe with the last descriptor and interrupt once the
+ *       data of the page is transferred.
+ * reset_erased: Reset the erased CW detection as part of the commands, it
+ *               has been done with qpic_nand_erased_status_reset() otherwise.
+ *
+ * Returns the address where the next cmd element can be added.
+ */
+static struct cmd_element*
+qpic_nand_queue_page_read(uint32_t page, unsigned char *buffer, unsigned char *spareaddr,
+						  struct cmd_element *cmd_list_ptr, struct qpic_nand_page_sts *sts,
+						  bool first, bool last, bool reset_erased)
 {
 	struct cfg_params params;
 	uint32_t ecc;
-	uint32_t flash_sts[QPIC_NAND_MAX_CWS_IN_PAGE] = {0};
-	uint32_t buffer_sts[QPIC_NAND_MAX_CWS_IN_PAGE] = {0};
-	uint32_t erased_cw_sts[QPIC_NAND_MAX_CWS_IN_PAGE] = {0};
 	uint32_t addr_loc_0;
 	uint32_t addr_loc_1;
-	struct cmd_element *cmd_list_ptr = ce_array;
-	struct cmd_element *cmd_list_ptr_start = ce_array;
+	struct cmd_element *cmd_list_ptr_start = cmd_list_ptr;
 	uint32_t num_cmd_desc = 0;
 	uint32_t num_data_desc = 0;
-	uint32_t status;
 	uint32_t i;
-	int nand_ret = NANDC_RESULT_SUCCESS;
 	uint8_t flags = 0;
-	uint32_t *cmd_list_temp = NULL;
-#if DEBUG_QPIC_NAND
-    uint8_t *buffer_temp = buffer;
-#endif
+	struct cmd_element *cmd_list_temp = NULL;
 
 	/* UD bytes in last CW is 512 - cws_per_page *4.
 	 * Since each of the CW read earlier reads 4 spare bytes.
@@ -1672,16 +1857,10 @@ qpic_nand_read_page(uint32_t page, unsigned char* buffer, unsigned char* sparead
 	addr_loc_1 |= NAND_RD_LOC_SIZE(oob_bytes);
 	addr_loc_1 |= NAND_RD_LOC_LAST_BIT(1);
 
-	status = qpic_nand_block_isbad(page);
-
-	if (status)
-		return status;
+	/* The status words are written by the BAM */
+	memset(sts, 0, sizeof(*sts));
+	arch_clean_invalidate_cache_range((addr_t)sts, sizeof(*sts));
 
-	/* Reset and Configure erased CW/page detection controller */
-	qpic_nand_erased_status_reset(ce_array, BAM_DESC_LOCK_FLAG);
-
-	/* Queue up the command and data descriptors for all the codewords in a page
-	 * and do a single bam transfer at the end.*/
 	for (i = 0; i < flash.cws_per_page; i++)
 	{
 		num_cmd_desc = 0;
@@ -1689,6 +1868,18 @@ qpic_nand_read_page(uint32_t page, unsigned char* buffer, unsigned char* sparead
 
 		if (i == 0)
 		{
+			if (reset_erased)
+			{
+				/* Reset and re-enable the erased CW/page detection controller */
+				bam_add_cmd_element(cmd_list_ptr, NAND_ERASED_CW_DETECT_CFG,
+									NAND_ERASED_CW_DETECT_CFG_RESET_CTRL, CE_WRITE_TYPE);
+				cmd_list_ptr++;
+				bam_add_cmd_element(cmd_list_ptr, NAND_ERASED_CW_DETECT_CFG,
+									NAND_ERASED_CW_DETECT_CFG_ACTIVATE_CTRL | NAND_ERASED_CW_DETECT_ERASED_CW_ECC_MASK,
+									CE_WRITE_TYPE);
+				cmd_list_ptr++;
+			}
+
 			cmd_list_ptr = qpic_nand_add_addr_n_cfg_ce(&params, cmd_list_ptr);
 
 			bam_add_cmd_element(cmd_list_ptr, NAND_DEV0_ECC_CFG,(uint32_t)ecc, CE_WRITE_TYPE);
@@ -1722,7 +1913,7 @@ qpic_nand_read_page(uint32_t page, unsigned char* buffer, unsigned char* sparead
 							 DATA_PRODUCER_PIPE_INDEX,
 							 (unsigned char *)PA((addr_t)spareaddr),
 							 oob_bytes,
-							 BAM_DESC_INT_FLAG);
+							 last ? BAM_DESC_INT_FLAG : 0);
 			num_data_desc++;
 
 			bam_sys_gen_event(&bam, DATA_PRODUCER_PIPE_INDEX, num_data_desc);
@@ -1752,28 +1943,32 @@ qpic_nand_read_page(uint32_t page, unsigned char* buffer, unsigned char* sparead
 							CE_WRITE_TYPE);
 		cmd_list_ptr++;
 
+		flags = BAM_DESC_NWD_FLAG | BAM_DESC_CMD_FLAG;
+		if (i == 0 && first)
+			flags |= BAM_DESC_LOCK_FLAG;
+
 		/* Enqueue the desc for the above commands */
 		bam_add_one_desc(&bam,
 					 CMD_PIPE_INDEX,
 					 (unsigned char*)PA((addr_t)cmd_list_ptr_start),
 					 PA((uint32_t)cmd_list_ptr - (uint32_t)cmd_list_ptr_start),
-					 BAM_DESC_NWD_FLAG | BAM_DESC_CMD_FLAG);
+					 flags);
 		num_cmd_desc++;
 
-		bam_add_cmd_element(cmd_list_ptr, NAND_FLASH_STATUS, (uint32_t)PA((addr_t)&(flash_sts[i])), CE_READ_TYPE);
+		bam_add_cmd_element(cmd_list_ptr, NAND_FLASH_STATUS, (uint32_t)PA((addr_t)&(sts->flash[i])), CE_READ_TYPE);
 
-		cmd_list_temp = (uint32_t *)cmd_list_ptr;
+		cmd_list_temp = cmd_list_ptr;
 
 		cmd_list_ptr++;
 
-		bam_add_cmd_element(cmd_list_ptr, NAND_BUFFER_STATUS, (uint32_t)PA((addr_t)&(buffer_sts[i])), CE_READ_TYPE);
+		bam_add_cmd_element(cmd_list_ptr, NAND_BUFFER_STATUS, (uint32_t)PA((addr_t)&(sts->buffer[i])), CE_READ_TYPE);
 		cmd_list_ptr++;
 
 		/* Read erased CW status */
-		bam_add_cmd_element(cmd_list_ptr, NAND_ERASED_CW_DETECT_STATUS, (uint32_t)PA((addr_t)&erased_cw_sts[i]), CE_READ_TYPE);
+		bam_add_cmd_element(cmd_list_ptr, NAND_ERASED_CW_DETECT_STATUS, (uint32_t)PA((addr_t)&(sts->erased_cw[i])), CE_READ_TYPE);
 		cmd_list_ptr++;
 
-		if (i == flash.cws_per_page - 1)
+		if (i == flash.cws_per_page - 1 && last)
 		{
 			flags = BAM_DESC_CMD_FLAG | BAM_DESC_UNLOCK_FLAG;
 		}
@@ -1794,61 +1989,162 @@ qpic_nand_read_page(uint32_t page, unsigned char* buffer, unsigned char* sparead
 		bam_sys_gen_event(&bam, CMD_PIPE_INDEX, num_cmd_desc);
 	}
 
-	qpic_nand_wait_for_data(DATA_PRODUCER_PIPE_INDEX);
+	return cmd_list_ptr;
+}
 
-	/* Check flash read status & errors */
-	for (i = 0; i < flash.cws_per_page ; i ++)
+/* Check the status of all the codewords of a page.
+ * Returns false if there are flash op errors on a codeword that was not
+ * detected as erased. Then the page needs the erased page check.
+ */
+static bool
+qpic_nand_page_sts_ok(struct qpic_nand_page_sts *sts)
+{
+	uint32_t i;
+
+	arch_invalidate_cache_range((addr_t)sts, sizeof(*sts));
+
+	for (i = 0; i < flash.cws_per_page; i++)
 	{
 #if DEBUG_QPIC_NAND
 		dprintf(INFO, "FLASH STATUS: 0x%08x, BUFFER STATUS: 0x%08x, ERASED CW STATUS: 0x%08x\n",
-				flash_sts[i], buffer_sts[i], erased_cw_sts[i]);
+				sts->flash[i], sts->buffer[i], sts->erased_cw[i]);
 #endif
 
-		/* If MPU or flash op erros are set, look for erased cw status.
-		 * If erased CW status is not set then look for bit flips to confirm
-		 * if the page is and erased page or a bad page
-		 */
-		if (flash_sts[i] & (NAND_FLASH_OP_ERR | NAND_FLASH_MPU_ERR))
-		{
-			if ((erased_cw_sts[i] & NAND_ERASED_CW) != NAND_ERASED_CW)
-			{
+		if ((sts->flash[i] & (NAND_FLASH_OP_ERR | NAND_FLASH_MPU_ERR)) &&
+			(sts->erased_cw[i] & NAND_ERASED_CW) != NAND_ERASED_CW)
+			return false;
+	}
+
+	return true;
+}
+
+/* Note: No support for raw reads. */
+static int
+qpic_nand_read_page(uint32_t page, unsigned char* buffer, unsigned char* spareaddr)
+{
+	struct qpic_nand_page_sts *sts = &page_sts;
+	uint32_t status;
+	int nand_ret = NANDC_RESULT_SUCCESS;
 #if DEBUG_QPIC_NAND
-			dprintf(CRITICAL, "Page: 0x%08x, addr0: 0x%08x, addr1: 0x%08x\n", page, params.addr0, params.addr1);
+	uint8_t *buffer_temp = buffer;
+	uint32_t i;
 #endif
-			/*
-			 * Depending on the process technology used there could be bit flips on
-			 * pages on the NAND card
-			 * When any page is erased the controller fills the page with all 1's.
-			 * When we try to read from an erased page and there are bit flips the
-			 * controller would not detect the page as erased page instead throws
-			 * an uncorrectable ecc error.
-			 * The NAND data sheet for that card would specify the number of bit flips
-			 * expected per code word. If the number of bit flips is less than expected
-			 * bit flips then we should ignore the uncorrectable ECC error and consider
-			 * the page as an erased page.
-			 */
+
+	status = qpic_nand_block_isbad(page);
+
+	if (status)
+		return status;
+
+	/* Reset and Configure erased CW/page detection controller */
+	qpic_nand_erased_status_reset(ce_array, BAM_DESC_LOCK_FLAG);
+
+	/* Queue up the command and data descriptors for all the codewords in a page
+	 * and do a single bam transfer at the end.*/
+	qpic_nand_queue_page_read(page, buffer, spareaddr, ce_array, sts, false, true, false);
+
+	qpic_nand_wait_for_data(DATA_PRODUCER_PIPE_INDEX);
+
+	/* If MPU or flash op erros are set, look for erased cw status.
+	 * If erased CW status is not set then look for bit flips to confirm
+	 * if the page is and erased page or a bad page
+	 */
+	if (!qpic_nand_page_sts_ok(sts))
+	{
 #if DEBUG_QPIC_NAND
-				for(i = 0; i < 4096; i += 8)
-				{
-					printf("DATA: %x %x %x %x %x %x %x %x",
-									buffer_temp[i], buffer_temp[i+1], buffer_temp[i+2], buffer_temp[i+3],
-									buffer_temp[i+4], buffer_temp[i+5], buffer_temp[i+6], buffer_temp[i+7]);
-					i += 8;
-					printf("DATA: %x %x %x %x %x %x %x %x\n",
-									buffer_temp[i], buffer_temp[i+1], buffer_temp[i+2], buffer_temp[i+3],
-									buffer_temp[i+4], buffer_temp[i+5], buffer_temp[i+6], buffer_temp[i+7]);
-				}
+		dprintf(CRITICAL, "Page: 0x%08x\n", page);
 #endif
-				nand_ret = qpic_nand_read_erased_page(page);
-				goto qpic_nand_read_page_error;
-				}
+		/*
+		 * Depending on the process technology used there could be bit flips on
+		 * pages on the NAND card
+		 * When any page is erased the controller fills the page with all 1's.
+		 * When we try to read from an erased page and there are bit flips the
+		 * controller would not detect the page as erased page instead throws
+		 * an uncorrectable ecc error.
+		 * The NAND data sheet for that card would specify the number of bit flips
+		 * expected per code word. If the number of bit flips is less than expected
+		 * bit flips then we should ignore the uncorrectable ECC error and consider
+		 * the page as an erased page.
+		 */
+#if DEBUG_QPIC_NAND
+		for(i = 0; i < 4096; i += 8)
+		{
+			printf("DATA: %x %x %x %x %x %x %x %x",
+							buffer_temp[i], buffer_temp[i+1], buffer_temp[i+2], buffer_temp[i+3],
+							buffer_temp[i+4], buffer_temp[i+5], buffer_temp[i+6], buffer_temp[i+7]);
+			i += 8;
+			printf("DATA: %x %x %x %x %x %x %x %x\n",
+							buffer_temp[i], buffer_temp[i+1], buffer_temp[i+2], buffer_temp[i+3],
+							buffer_temp[i+4], buffer_temp[i+5], buffer_temp[i+6], buffer_temp[i+7]);
 		}
+#endif
+		nand_ret = qpic_nand_read_erased_page(page);
 	}
 
-qpic_nand_read_page_error:
 	return nand_ret;
 }
 
+/* Read consecutive pages of one block with a single bam transfer.
+ * page: First page to read.
+ * num_pages: Number of pages, must not cross a block boundary.
+ * buffer: Where the data of the pages goes.
+ * spareaddr: Where the spare bytes go, each page overwrites the previous one.
+ * pages_read: Number of pages from the start that have been read successfully.
+ *
+ * Pages that need the erased page check are read again with
+ * qpic_nand_read_page(), the following pages are not read then.
+ * Returns the result of the first page that could not be read.
+ */
+static int
+qpic_nand_read_pages(uint32_t page, uint32_t num_pages, unsigned char *buffer,
+					 unsigned char *spareaddr, uint32_t *pages_read)
+{
+	struct cmd_element *cmd_list_ptr = ce_batch_array;
+	uint32_t status;
+	uint32_t i;
+
+	*pages_read = 0;
+
+	if (num_pages == 1)
+	{
+		status = qpic_nand_read_page(page, buffer, spareaddr);
+		if (!status)
+			*pages_read = 1;
+		return status;
+	}
+
+	num_pages = MIN(num_pages, QPIC_NAND_READ_BATCH_PAGES);
+
+	status = qpic_nand_block_isbad(page);
+	if (status)
+		return status;
+
+	if (!spareaddr)
+		spareaddr = batch_spare;
+
+	for (i = 0; i < num_pages; i++)
+		cmd_list_ptr = qpic_nand_queue_page_read(page + i, buffer + i * flash.page_size,
+												 spareaddr, cmd_list_ptr, &batch_sts[i],
+												 i == 0, i == num_pages - 1, true);
+
+	/* The interrupt flag is only set on the last data descriptor */
+	qpic_nand_wait_for_data(DATA_PRODUCER_PIPE_INDEX);
+
+	for (i = 0; i < num_pages; i++)
+	{
+		if (!qpic_nand_page_sts_ok(&batch_sts[i]))
+		{
+			*pages_read = i;
+			status = qpic_nand_read_page(page + i, buffer + i * flash.page_size, spareaddr);
+			if (!status)
+				*pages_read = i + 1;
+			return status;
+		}
+	}
+
+	*pages_read = num_pages;
+	return NANDC_RESULT_SUCCESS;
+}
+
 /**
  * qpic_nand_read() - read data
  * @start_page: number of page to begin reading from
@@ -1867,15 +2163,19 @@ nand_result_t qpic_nand_read(uint32_t start_page, uint32_t num_pages,
 		unsigned char* buffer, unsigned char* spareaddr)
 {
 	unsigned i = 0, ret = 0;
+	uint32_t n, done;
 
 	if (!buffer) {
 		dprintf(CRITICAL, "qpic_nand_read: buffer = null\n");
 		return NANDC_RESULT_PARAM_INVALID;
 	}
 	while (i < num_pages) {
-		ret = qpic_nand_read_page(start_page + i, buffer + flash.page_size * i,
-				spareaddr);
-		i++;
+		/* As many pages as possible up to the end of the block */
+		n = flash.num_pages_per_blk - ((start_page + i) & flash.num_pages_per_blk_mask);
+		n = MIN(n, num_pages - i);
+		ret = qpic_nand_read_pages(start_page + i, n, buffer + flash.page_size * i,
+				spareaddr, &done);
+		i += done;
 		if (ret == NANDC_RESULT_BAD_PAGE)
 			qpic_nand_mark_badblock(start_page + i);
 		if (ret) {
@@ -2016,7 +2316,23 @@ flash_read_ext(struct ptentry *ptn,
 		}
 
 #if CONTIGUOUS_MEMORY
-		result = qpic_nand_read_page(page, image, (unsigned char *) spare);
+		if (!extra_per_page)
+		{
+			/* Read the rest of the block at once if possible */
+			uint32_t n = flash.num_pages_per_blk - (page & flash.num_pages_per_blk_mask);
+			uint32_t done;
+
+			n = MIN(n, MIN(count, lastpage - page));
+			result = qpic_nand_read_pages(page, n, image, (unsigned char *) spare, &done);
+			page += done;
+			image += done * flash.page_size;
+			count -= done;
+
+			if (result == NANDC_RESULT_SUCCESS)
+				continue;
+		}
+		else
+			result = qpic_nand_read_page(page, image, (unsigned char *) spare);
 #else
 		result = qpic_nand_read_page(page, rdwr_buf, (unsigned char *) spare);
 #endif
@@ -35,6 +35,7 @@
 #include <platform/iomap.h>
 #include <platform/interrupts.h>
 #include <qtimer_mmap_hw.h>
+#include <kernel/thread.h>
 
 static platform_timer_callback timer_callback;
 static void *timer_arg;
@@ -45,6 +46,47 @@ static uint32_t tick_count;
 
 static void qtimer_enable(void);
 
+#if PLATFORM_HAS_DYNAMIC_TIMER
+/*
+ * Without the periodic tick the timer is only programmed for the next
+ * pending event, so the current time is taken from the physical counter.
+ */
+static enum handler_return qtimer_oneshot_irq(void *arg)
+{
+	/* Stop the timer, the callback will program it for the next event */
+	qtimer_disable();
+
+	return timer_callback(timer_arg, qtimer_current_time());
+}
+
+status_t platform_set_oneshot_timer(platform_timer_callback tmr_callback,
+				    void *tmr_arg, time_t msecs_interval)
+{
+	enter_critical_section();
+
+	qtimer_disable();
+
+	timer_arg = tmr_arg;
+	timer_callback = tmr_callback;
+
+	writel(msecs_interval * (qtimer_tick_rate() / 1000), QTMR_V1_CNTP_TVAL);
+	dsb();
+
+	register_int_handler(INT_QTMR_FRM_0_PHYSICAL_TIMER_EXP, qtimer_oneshot_irq, 0);
+	unmask_interrupt(INT_QTMR_FRM_0_PHYSICAL_TIMER_EXP);
+
+	qtimer_enable();
+
+	exit_critical_section();
+	return 0;
+}
+
+void platform_stop_timer(void)
+{
+	qtimer_disable();
+}
+#endif
+
 static enum handler_return qtimer_irq(void *arg)
 {
 	current_time += timer_interval;
@@ -144,5 +186,9 @@ inline __ALWAYS_INLINE uint64_t qtimer_get_phy_timer_cnt(void)
 
 uint32_t qtimer_current_time(void)
 {
+#if PLATFORM_HAS_DYNAMIC_TIMER
+	return qtimer_get_phy_timer_cnt() / (qtimer_tick_rate() / 1000);
+#else
 	return current_time;
+#endif
 }
@@ -57,6 +57,10 @@ static event_t wait_for_rpm_init;
 static event_t wait_for_ssr_init;
 static event_t wait_for_data;
 
+/* Requests sent in a batch that were not acknowledged yet, see rpm-ipc.h */
+static volatile unsigned int acks_pending;
+static bool ack_error;
+
 extern glink_err_type glink_wait_link_down(glink_handle_type handle);
 
 static void rpmdatacpy(uint32_t * dst, uint32_t *src, uint32_t size)
@@ -72,6 +76,49 @@ static void rpmdatacpy(uint32_t * dst, uint32_t *src, uint32_t size)
 	}
 }
 
+static void rpm_glink_acks_add(int n)
+{
+	enter_critical_section();
+	acks_pending += n;
+	exit_critical_section();
+}
+
+static void rpm_glink_drain(void)
+{
+	while (acks_pending)
+		event_wait(&wait_for_data);
+}
+
+/* Send without waiting for the response, it is collected by the ISR */
+static glink_err_type rpm_glink_tx_batched(const void *data, uint32_t len)
+{
+	glink_err_type err;
+
+	/* Count it first, the response might arrive before glink_tx() returns */
+	rpm_glink_acks_add(1);
+	err = glink_tx(rpm_glink_port, NULL, data, len, 0);
+	if (err) {
+		/* Probably the FIFO is full, try again once the RPM caught up */
+		rpm_glink_acks_add(-1);
+		rpm_glink_drain();
+		rpm_glink_acks_add(1);
+		err = glink_tx(rpm_glink_port, NULL, data, len, 0);
+		if (err)
+			rpm_glink_acks_add(-1);
+	}
+	return err;
+}
+
+int rpm_glink_wait_acks(void)
+{
+	int ret;
+
+	rpm_glink_drain();
+	ret = ack_error ? -1 : 0;
+	ack_error = false;
+	return ret;
+}
+
 glink_err_type rpm_glink_send_data(uint32_t *data, uint32_t len, msg_type type)
 {
 	rpm_req req;
@@ -79,7 +126,10 @@ glink_err_type rpm_glink_send_data(uint32_t *data, uint32_t len, msg_type type)
 	glink_err_type send_err = 0;
 	uint32_t len_to_rpm = 0;
 	void *rpm_data = NULL;
-	event_init(&wait_for_data, false, EVENT_FLAG_AUTOUNSIGNAL);
+
+	/* Keep the signals for requests of the current batch */
+	if (!acks_pending)
+		event_init(&wait_for_data, false, EVENT_FLAG_AUTOUNSIGNAL);
 
 	switch(type)
 	{
@@ -102,6 +152,15 @@ glink_err_type rpm_glink_send_data(uint32_t *data, uint32_t len, msg_type type)
 			memcpy(rpm_data + sizeof(rpm_gen_hdr), &req.req_hdr, sizeof(rpm_req_hdr));
 			memcpy(rpm_data + sizeof(rpm_gen_hdr)+ sizeof(rpm_req_hdr), req.data, len);
 
+			if (rpm_batch_active()) {
+				send_err = rpm_glink_tx_batched(rpm_data, len_to_rpm);
+				if (send_err)
+					dprintf(CRITICAL, "%s:%d, Glink tx error: 0x%x\n", __func__, __LINE__, send_err);
+				free(rpm_data);
+				free_kvp_object(&req.data);
+				break;
+			}
+
 			// Send Data Request to RPM
 			send_err = glink_tx(rpm_glink_port, NULL, (const void *)rpm_data, len_to_rpm, 0);
 			if (send_err)
@@ -263,6 +322,11 @@ void rpm_vector_glink_isr(glink_handle_type port, void *unused_open_data, void *
 	{
 		dprintf(CRITICAL, "Return value from recv_data: %x\n", ret);
 	}
+	if (acks_pending) {
+		if (ret != sizeof(rpm_gen_hdr) + sizeof(kvp_data))
+			ack_error = true;
+		acks_pending--;
+	}
 	// Release the mutex
 #ifdef DEBUG_GLINK
 	dprintf(INFO, "Received Data from RPM\n");
@@ -46,6 +46,16 @@ __WEAK int rpm_smd_send_data(uint32_t *data, uint32_t len, msg_type type)
 	return -1;
 }
 
+__WEAK int rpm_glink_wait_acks(void)
+{
+	return 0;
+}
+
+__WEAK int rpm_smd_wait_acks(void)
+{
+	return 0;
+}
+
 void fill_kvp_object(kvp_data **kdata, uint32_t *data, uint32_t len)
 {
 	*kdata = (kvp_data *) memalign(CACHE_LINE, ROUNDUP(len, CACHE_LINE));
@@ -60,16 +70,108 @@ void free_kvp_object(kvp_data **kdata)
 		free(*kdata);
 }
 
+/*
+ * Remember the last request sent for a resource. The RPM keeps the vote of
+ * each master until it is changed, so sending the same request again (e.g.
+ * when the display or SD card regulators are enabled repeatedly) would only
+ * waste time waiting for the acknowledgement.
+ */
+#define RPM_REQ_CACHE_SIZE	16
+#define RPM_REQ_CACHE_DATA	(3 * sizeof(kvp_data))
+
+struct rpm_req_cache {
+	uint32_t type;
+	uint32_t id;
+	uint32_t len;
+	uint32_t data[RPM_REQ_CACHE_DATA / sizeof(uint32_t)];
+};
+
+static struct rpm_req_cache rpm_req_cache[RPM_REQ_CACHE_SIZE];
+
+static struct rpm_req_cache *rpm_req_cache_lookup(uint32_t *data, uint32_t len)
+{
+	struct rpm_req_cache *c, *free = NULL;
+
+	if (len > RPM_REQ_CACHE_DATA)
+		return NULL;
+
+	for (c = rpm_req_cache; c < rpm_req_cache + RPM_REQ_CACHE_SIZE; c++) {
+		if (!c->len) {
+			if (!free)
+				free = c;
+			continue;
+		}
+		if (c->type == data[RESOURCETYPE] && c->id == data[RESOURCEID])
+			return c;
+	}
+
+	if (free) {
+		free->type = data[RESOURCETYPE];
+		free->id = data[RESOURCEID];
+	}
+	return free;
+}
+
 int rpm_send_data(uint32_t *data, uint32_t len, msg_type type)
 {
+	struct rpm_req_cache *c = NULL;
 	int ret = 0;
 
+	if (type == RPM_REQUEST_TYPE) {
+		c = rpm_req_cache_lookup(data, len);
+		if (c && c->len == len && !memcmp(c->data, data + 2, len))
+			return 0;
+	}
+
 	/* Runtime select to call glink or smd */
 	if (platform_is_glink_enabled())
 		ret = rpm_glink_send_data(data, len, type);
 	else
 		ret = rpm_smd_send_data(data, len, type);
 
+	if (c) {
+		if (ret) {
+			/* The state of the resource is unknown now */
+			c->len = 0;
+		} else {
+			c->len = len;
+			memcpy(c->data, data + 2, len);
+		}
+	}
+
+	return ret;
+}
+
+static unsigned int rpm_batch_depth;
+
+void rpm_batch_begin(void)
+{
+	rpm_batch_depth++;
+}
+
+bool rpm_batch_active(void)
+{
+	return rpm_batch_depth > 0;
+}
+
+int rpm_batch_end(void)
+{
+	int ret;
+
+	ASSERT(rpm_batch_depth);
+	if (--rpm_batch_depth)
+		return 0;	/* Nested, the outermost batch waits */
+
+	if (platform_is_glink_enabled())
+		ret = rpm_glink_wait_acks();
+	else
+		ret = rpm_smd_wait_acks();
+
+	if (ret) {
+		dprintf(CRITICAL, "RPM request in batch failed\n");
+		/* It is not known which one, so forget all of them */
+		memset(rpm_req_cache, 0, sizeof(rpm_req_cache));
+	}
 	return ret;
 }
 
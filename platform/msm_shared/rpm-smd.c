@@ -36,7 +36,15 @@
 #include <stdlib.h>
 #include <platform/timer.h>
 
+/*
+ * Requests sent in a batch whose acknowledgement was not read yet. They are
+ * limited to make sure that neither of the FIFOs overflows.
+ */
+#define RPM_SMD_BATCH_MAX	8
+
 static uint32_t msg_id;
+static unsigned int acks_pending;
+static bool ack_error;
 smd_channel_info_t ch;
 
 void rpm_smd_init(void)
@@ -49,6 +57,29 @@ void rpm_smd_uninit(void)
 	smd_uninit(&ch);
 }
 
+static void rpm_smd_read_acks(void)
+{
+	uint32_t ack_msg_len, rlen = 0;
+
+	while (acks_pending) {
+		ack_msg_len = rpm_smd_recv_data(&rlen);
+		smd_signal_read_complete(&ch, ack_msg_len);
+		if (ack_msg_len != sizeof(rpm_gen_hdr) + sizeof(kvp_data))
+			ack_error = true;
+		acks_pending--;
+	}
+}
+
+int rpm_smd_wait_acks(void)
+{
+	int ret;
+
+	rpm_smd_read_acks();
+	ret = ack_error ? -1 : 0;
+	ack_error = false;
+	return ret;
+}
+
 int rpm_smd_send_data(uint32_t *data, uint32_t len, msg_type type)
 {
 	rpm_req req;
@@ -82,10 +113,16 @@ int rpm_smd_send_data(uint32_t *data, uint32_t len, msg_type type)
 
 			ret = smd_write(&ch, smd_data, len_to_smd, SMD_APPS_RPM);
 
-			/* Read the response */
-			ack_msg_len = rpm_smd_recv_data(&rlen);
+			if (!ret && rpm_batch_active()) {
+				/* Read the response later, in rpm_smd_wait_acks() */
+				if (++acks_pending >= RPM_SMD_BATCH_MAX)
+					rpm_smd_read_acks();
+			} else {
+				/* Read the response */
+				ack_msg_len = rpm_smd_recv_data(&rlen);
 
-			smd_signal_read_complete(&ch, ack_msg_len);
+				smd_signal_read_complete(&ch, ack_msg_len);
+			}
 
 			free(smd_data);
 			free_kvp_object(&req.data);
@@ -6,6 +6,8 @@ INCLUDES += \
 DEFINES += $(TARGET_XRES)
 DEFINES += $(TARGET_YRES)
 
+MODULES += lib/dmapool
+
 OBJS += \
 	$(LOCAL_DIR)/debug.o \
 	$(LOCAL_DIR)/smem.o \
@@ -15,7 +17,8 @@ OBJS += \
 	$(LOCAL_DIR)/hsusb.o \
 	$(LOCAL_DIR)/boot_stats.o \
 	$(LOCAL_DIR)/qgic_common.o \
-	$(LOCAL_DIR)/crc32.o
+	$(LOCAL_DIR)/crc32.o \
+	$(LOCAL_DIR)/crc32-armv8.o
 
 ifneq ($(filter $(DEFINES), WITH_DEBUG_JTAG=1),)
 OBJS += \
@@ -46,6 +49,7 @@ endif
 ifeq ($(ENABLE_SDHCI_SUPPORT),1)
 OBJS += \
 	$(LOCAL_DIR)/sdhci.o \
+	$(LOCAL_DIR)/sdhci_cqe.o \
 	$(LOCAL_DIR)/sdhci_msm.o \
 	$(LOCAL_DIR)/mmc_sdhci.o \
 	$(LOCAL_DIR)/mmc_wrapper.o
@@ -766,3 +770,9 @@ ifeq ($(VERIFIED_BOOT_2), 1)
 OBJS += platform/msm_shared/boot_verifier.o
 include platform/msm_shared/avb/rules.mk
 endif
+
+ifneq ($(filter platform/msm_shared/crypto_hash.o, $(OBJS)),)
+OBJS += \
+	platform/msm_shared/sha_sw.o \
+	platform/msm_shared/sha-armv8.o
+endif
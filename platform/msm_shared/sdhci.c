@@ -31,13 +31,21 @@
 #include <platform/interrupts.h>
 #include <platform/timer.h>
 #include <kernel/event.h>
+#include <kernel/thread.h>
 #include <target.h>
 #include <string.h>
 #include <stdlib.h>
 #include <bits.h>
 #include <debug.h>
+#include <err.h>
+#include <platform.h>
+#include <kernel/ktrace.h>
 #include <sdhci.h>
 #include <sdhci_msm.h>
+#include <sdhci_cqe.h>
+#if LPAE
+#include <arch/arm/mmu.h>
+#endif
 
 static void sdhci_dumpregs(struct sdhci_host *host)
 {
@@ -138,6 +146,73 @@ static void sdhci_error_status_enable(struct sdhci_host *host)
 	REG_WRITE16(host, SDHCI_ERR_INT_SIG_EN, SDHCI_ERR_INT_SIG_EN_REG);
 }
 
+/*
+ * Function: sdhci irq handler
+ * Arg     : Host structure
+ * Return  : INT_RESCHEDULE
+ * Flow:   : Disable the interrupt signals so the level irq goes away, the
+ *           status bits stay set for the waiting thread to handle
+ */
+static enum handler_return sdhci_irq_handler(void *arg)
+{
+	struct sdhci_host *host = arg;
+
+	REG_WRITE16(host, 0, SDHCI_NRML_INT_SIG_EN_REG);
+	REG_WRITE16(host, 0, SDHCI_ERR_INT_SIG_EN_REG);
+
+	event_signal(&host->irq_event, false);
+
+	return INT_RESCHEDULE;
+}
+
+/*
+ * Function: sdhci irq init
+ * Arg     : Host structure
+ * Return  : None
+ * Flow:   : Register the host controller irq. The signals stay disabled
+ *           until a thread waits for one of the status bits.
+ */
+static void sdhci_irq_init(struct sdhci_host *host)
+{
+	if (!host->irq)
+		return;
+
+	REG_WRITE16(host, 0, SDHCI_NRML_INT_SIG_EN_REG);
+	REG_WRITE16(host, 0, SDHCI_ERR_INT_SIG_EN_REG);
+
+	event_init(&host->irq_event, false, EVENT_FLAG_AUTOUNSIGNAL);
+	register_int_handler(host->irq, sdhci_irq_handler, host);
+	unmask_interrupt(host->irq);
+}
+
+/*
+ * Function: sdhci wait irq
+ * Arg     : Host structure & normal interrupt status bits to wait for
+ * Return  : None
+ * Flow:   : Sleep until the irq for the status bits or an error arrives,
+ *           or SDHCI_IRQ_TIMEOUT elapsed. Falls back to polling for good if
+ *           the status is set but the irq never came.
+ */
+static void sdhci_wait_irq(struct sdhci_host *host, uint16_t mask)
+{
+	status_t ret;
+
+	event_unsignal(&host->irq_event);
+	REG_WRITE16(host, SDHCI_ERR_INT_SIG_EN, SDHCI_ERR_INT_SIG_EN_REG);
+	REG_WRITE16(host, mask, SDHCI_NRML_INT_SIG_EN_REG);
+
+	ret = event_wait_timeout(&host->irq_event, SDHCI_IRQ_TIMEOUT);
+
+	REG_WRITE16(host, 0, SDHCI_NRML_INT_SIG_EN_REG);
+	REG_WRITE16(host, 0, SDHCI_ERR_INT_SIG_EN_REG);
+
+	if (ret == ERR_TIMED_OUT && (REG_READ16(host, SDHCI_NRML_INT_STS_REG) & mask)) {
+		dprintf(CRITICAL, "sdhci: irq %u not received, polling instead\n", host->irq);
+		mask_interrupt(host->irq);
+		host->irq = 0;
+	}
+}
+
 /*
  * Function: sdhci clock supply
  * Arg     : Host structure
@@ -331,8 +406,17 @@ void sdhci_set_uhs_mode(struct sdhci_host *host, uint32_t mode)
  */
 static void sdhci_set_adma_mode(struct sdhci_host *host)
 {
-	/* Select 32 Bit ADMA2 type */
-	REG_WRITE8(host, SDHCI_ADMA_32BIT, SDHCI_HOST_CTRL1_REG);
+	uint8_t ctrl = 0;
+
+	/* Keep the bus width (and high speed) of an adopted host */
+	if (host->adopted)
+		ctrl = REG_READ8(host, SDHCI_HOST_CTRL1_REG) & ~SDHCI_DMA_SEL_MASK;
+
+	/* Select 32 or 64 Bit ADMA2 type */
+	if (host->caps.adma64_support)
+		REG_WRITE8(host, ctrl | SDHCI_ADMA_64BIT, SDHCI_HOST_CTRL1_REG);
+	else
+		REG_WRITE8(host, ctrl | SDHCI_ADMA_32BIT, SDHCI_HOST_CTRL1_REG);
 }
 
 /*
@@ -435,6 +519,8 @@ static uint8_t sdhci_cmd_complete(struct sdhci_host *host, struct mmc_command *c
 	uint32_t trans_complete = 0;
 	uint32_t err_status;
 	uint64_t max_trans_retry = (cmd->cmd_timeout ? cmd->cmd_timeout : SDHCI_MAX_TRANS_RETRY);
+	bool can_yield, timed_out;
+	time_t trans_start;
 
 	do {
 
@@ -505,6 +591,15 @@ static uint8_t sdhci_cmd_complete(struct sdhci_host *host, struct mmc_command *c
 	 * Clear the transfer complete interrupt
 	 */
 	if (cmd->data_present || cmd->resp_type == SDHCI_CMD_RESP_R1B) {
+		/*
+		 * Let other threads run while the data is transferred, e.g. to
+		 * decompress the kernel while the next files are being read.
+		 * The timeout is then based on time, not on the retry count.
+		 */
+		can_yield = cmd->data_present && !host->tuning_in_progress &&
+			    !in_critical_section();
+		trans_start = current_time();
+
 		do {
 			int_status = REG_READ16(host, SDHCI_NRML_INT_STS_REG);
 
@@ -536,9 +631,17 @@ static uint8_t sdhci_cmd_complete(struct sdhci_host *host, struct mmc_command *c
 				}
 			}
 
-			retry++;
-			udelay(1);
-			if (retry == max_trans_retry) {
+			if (can_yield) {
+				if (host->irq)
+					sdhci_wait_irq(host, SDHCI_INT_STS_TRANS_COMPLETE);
+				else
+					thread_yield();
+				timed_out = current_time() - trans_start >= max_trans_retry / 1000;
+			} else {
+				udelay(1);
+				timed_out = ++retry == max_trans_retry;
+			}
+			if (timed_out) {
 				dprintf(CRITICAL, "Error: Transfer never completed\n");
 				ret = 1;
 				goto err;
@@ -591,93 +694,183 @@ err:
 }
 
 /*
- * Function: sdhci prep desc table
- * Arg     : Pointer data & length
- * Return  : Pointer to desc table
- * Flow:   : Prepare the adma table as per the sd spec v 3.0
+ * Function: sdhci dma addr
+ * Arg     : Pointer to a buffer
+ * Return  : Bus address of the buffer
+ * Flow:   : With LPAE the buffer may be mapped from RAM above 4 GiB
  */
-static struct desc_entry *sdhci_prep_desc_table(void *data, uint32_t len)
+static uint64_t sdhci_dma_addr(const void *ptr)
 {
-	struct desc_entry *sg_list;
-	uint32_t sg_len = 0;
-	uint32_t remain = 0;
-	uint32_t i;
-	uint32_t table_len = 0;
+#if LPAE
+	return virtual_to_physical_mapping((addr_t)ptr);
+#else
+	return (addr_t)ptr;
+#endif
+}
 
-	if (len <= SDHCI_ADMA_DESC_LINE_SZ) {
-		/* Allocate only one descriptor */
-		sg_list = (struct desc_entry *) memalign(lcm(4, CACHE_LINE), ROUNDUP(sizeof(struct desc_entry), CACHE_LINE));
+/*
+ * Function: sdhci desc size
+ * Arg     : Host structure
+ * Return  : Size of one adma desc entry
+ */
+static uint32_t sdhci_desc_size(struct sdhci_host *host)
+{
+	return host->caps.adma64_support ? sizeof(struct desc_entry64) : sizeof(struct desc_entry);
+}
 
-		if (!sg_list) {
-			dprintf(CRITICAL, "Error allocating memory\n");
-			ASSERT(0);
-		}
+/*
+ * Function: sdhci set desc
+ * Arg     : Host structure, desc table, index, data, length & attributes
+ * Return  : None
+ * Flow:   : Fill one entry of the adma table. The length is truncated to
+ *           16 bit, as per SD Spec3.0 'len = 0' implies 65536 bytes.
+ */
+static void sdhci_set_desc(struct sdhci_host *host, void *sg_list, uint32_t i,
+			   const void *data, uint32_t len, uint16_t attr)
+{
+	uint64_t addr = sdhci_dma_addr(data);
 
-		sg_list[0].addr = (uint32_t)data;
-		sg_list[0].len = (len < SDHCI_ADMA_DESC_LINE_SZ) ? len : (SDHCI_ADMA_DESC_LINE_SZ & 0xffff);
-		sg_list[0].tran_att = SDHCI_ADMA_TRANS_VALID | SDHCI_ADMA_TRANS_DATA
-							  | SDHCI_ADMA_TRANS_END;
+	if (host->caps.adma64_support) {
+		struct desc_entry64 *desc = (struct desc_entry64 *)sg_list + i;
 
-		sg_len = 1;
-		table_len = sizeof(struct desc_entry);
+		desc->addr = (uint32_t)addr;
+		desc->addr_hi = (uint32_t)(addr >> 32);
+		desc->len = len & 0xffff;
+		desc->tran_att = attr;
 	} else {
-		/* Calculate the number of entries in desc table */
-		sg_len = len / SDHCI_ADMA_DESC_LINE_SZ;
-		remain = len - (sg_len * SDHCI_ADMA_DESC_LINE_SZ);
+		struct desc_entry *desc = (struct desc_entry *)sg_list + i;
 
-		/* Allocate sg_len + 1 entries if there are remaining bytes at the end */
-		if (remain)
-			sg_len++;
+		desc->addr = (uint32_t)addr;
+		desc->len = len & 0xffff;
+		desc->tran_att = attr;
+	}
+}
 
-		table_len = (sg_len * sizeof(struct desc_entry));
+/*
+ * Function: sdhci alloc desc table
+ * Arg     : Host structure & number of desc entries
+ * Return  : Pointer to desc table
+ * Flow:   : Use the preallocated host table if it is large enough,
+ *           allocate a new one only for unusually long scatter lists
+ */
+static void *sdhci_alloc_desc_table(struct sdhci_host *host, uint32_t entries)
+{
+	void *sg_list;
 
-		sg_list = (struct desc_entry *) memalign(lcm(4, CACHE_LINE), ROUNDUP(table_len, CACHE_LINE));
+	if (host->desc_pool && entries <= SDHCI_ADMA_POOL_ENTRIES)
+		return host->desc_pool;
 
-		if (!sg_list) {
-			dprintf(CRITICAL, "Error allocating memory\n");
-			ASSERT(0);
-		}
+	sg_list = memalign(lcm(4, CACHE_LINE),
+			   ROUNDUP(entries * sdhci_desc_size(host), CACHE_LINE));
+	if (!sg_list) {
+		dprintf(CRITICAL, "Error allocating memory\n");
+		ASSERT(0);
+	}
 
-		memset((void *) sg_list, 0, table_len);
+	return sg_list;
+}
 
-		/*
-		 * Prepare sglist in the format:
-		 *  ___________________________________________________
-		 * |Transfer Len | Transfer ATTR | Data Address        |
-		 * | (16 bit)    | (16 bit)      | (32 bit)            |
-		 * |_____________|_______________|_____________________|
-		 */
-		for (i = 0; i < (sg_len - 1); i++) {
-				sg_list[i].addr = (uint32_t)data;
-				/*
-				 * Length attribute is 16 bit value & max transfer size for one
-				 * descriptor line is 65536 bytes, As per SD Spec3.0 'len = 0'
-				 * implies 65536 bytes. Truncate the length to limit to 16 bit
-				 * range.
-				 */
-				sg_list[i].len = (SDHCI_ADMA_DESC_LINE_SZ & 0xffff);
-				sg_list[i].tran_att = SDHCI_ADMA_TRANS_VALID | SDHCI_ADMA_TRANS_DATA;
-				data += SDHCI_ADMA_DESC_LINE_SZ;
-				len -= SDHCI_ADMA_DESC_LINE_SZ;
-			}
+/*
+ * Function: sdhci flush desc table
+ * Arg     : Host structure, desc table & length
+ * Return  : None
+ * Flow:   : Make the desc table visible to the controller
+ */
+static void sdhci_flush_desc_table(struct sdhci_host *host, void *sg_list,
+				   uint32_t table_len)
+{
+	if (sg_list == host->desc_pool)
+		dma_pool_clean(&host->desc_dma, sg_list, table_len);
+	else
+		arch_clean_invalidate_cache_range((addr_t)sg_list, table_len);
+}
 
-			/* Fill the last entry of the table with Valid & End
-			 * attributes
-			 */
-			sg_list[sg_len - 1].addr = (uint32_t)data;
-			sg_list[sg_len - 1].len = (len < SDHCI_ADMA_DESC_LINE_SZ) ? len : (SDHCI_ADMA_DESC_LINE_SZ & 0xffff);
-			sg_list[sg_len - 1].tran_att = SDHCI_ADMA_TRANS_VALID | SDHCI_ADMA_TRANS_DATA |
-										   SDHCI_ADMA_TRANS_END;
-		}
+/*
+ * Function: sdhci prep desc table
+ * Arg     : Host structure, pointer data & length
+ * Return  : Pointer to desc table
+ * Flow:   : Prepare the adma table as per the sd spec v 3.0
+ */
+static void *sdhci_prep_desc_table(struct sdhci_host *host, void *data, uint32_t len)
+{
+	void *sg_list;
+	uint32_t sg_len = 1;
+	uint32_t table_len = 0;
+	uint16_t attr;
+	uint32_t i;
 
-	arch_clean_invalidate_cache_range((addr_t)sg_list, table_len);
+	/* Calculate the number of entries in desc table */
+	if (len > SDHCI_ADMA_DESC_LINE_SZ)
+		sg_len = (len + SDHCI_ADMA_DESC_LINE_SZ - 1) / SDHCI_ADMA_DESC_LINE_SZ;
 
-	for (i = 0; i < sg_len; i++)
-	{
-		DBG("\n %s: sg_list: addr: 0x%08x len: 0x%04x attr: 0x%04x\n", __func__, sg_list[i].addr,
-			(sg_list[i].len ? sg_list[i].len : SDHCI_ADMA_DESC_LINE_SZ), sg_list[i].tran_att);
+	table_len = sg_len * sdhci_desc_size(host);
+	sg_list = sdhci_alloc_desc_table(host, sg_len);
+
+	/*
+	 * Prepare sglist in the format:
+	 *  _________________________________________________________________
+	 * |Transfer Len | Transfer ATTR | Data Address                      |
+	 * | (16 bit)    | (16 bit)      | (32 bit, or 64 bit for adma2 64)  |
+	 * |_____________|_______________|___________________________________|
+	 *
+	 * The last entry of the table has the Valid & End attributes.
+	 */
+	for (i = 0; i < sg_len; i++) {
+		attr = SDHCI_ADMA_TRANS_VALID | SDHCI_ADMA_TRANS_DATA;
+		if (i == sg_len - 1)
+			attr |= SDHCI_ADMA_TRANS_END;
+
+		sdhci_set_desc(host, sg_list, i, data, MIN(len, SDHCI_ADMA_DESC_LINE_SZ), attr);
+		data += SDHCI_ADMA_DESC_LINE_SZ;
+		len -= MIN(len, SDHCI_ADMA_DESC_LINE_SZ);
+	}
+
+	sdhci_flush_desc_table(host, sg_list, table_len);
+
+	DBG("\n %s: sg_list: %u entries\n", __func__, sg_len);
+
+	return sg_list;
+}
+
+/*
+ * Function: sdhci prep desc table sg
+ * Arg     : Host structure, scatter list & number of segments
+ * Return  : Pointer to desc table
+ * Flow:   : Prepare one adma table for all the segments
+ */
+static void *sdhci_prep_desc_table_sg(struct sdhci_host *host,
+				      const struct mmc_sg *sg, uint32_t sg_count)
+{
+	void *sg_list;
+	uint32_t sg_len = 0;
+	uint32_t table_len;
+	uint32_t i, n, len;
+	uint16_t attr;
+	uint8_t *data;
+
+	for (i = 0; i < sg_count; i++)
+		sg_len += (sg[i].len + SDHCI_ADMA_DESC_LINE_SZ - 1) / SDHCI_ADMA_DESC_LINE_SZ;
+
+	table_len = sg_len * sdhci_desc_size(host);
+	sg_list = sdhci_alloc_desc_table(host, sg_len);
+
+	for (i = 0, n = 0; i < sg_count; i++) {
+		data = sg[i].addr;
+		len = sg[i].len;
+		while (len) {
+			attr = SDHCI_ADMA_TRANS_VALID | SDHCI_ADMA_TRANS_DATA;
+			if (n == sg_len - 1)
+				attr |= SDHCI_ADMA_TRANS_END;
+
+			sdhci_set_desc(host, sg_list, n, data, MIN(len, SDHCI_ADMA_DESC_LINE_SZ), attr);
+			data += MIN(len, SDHCI_ADMA_DESC_LINE_SZ);
+			len -= MIN(len, SDHCI_ADMA_DESC_LINE_SZ);
+			n++;
+		}
 	}
 
+	sdhci_flush_desc_table(host, sg_list, table_len);
+
 	return sg_list;
 }
 
@@ -689,13 +882,13 @@ static struct desc_entry *sdhci_prep_desc_table(void *data, uint32_t len)
  *           2. Write adma register
  *           3. Write block size & block count register
  */
-static struct desc_entry *sdhci_adma_transfer(struct sdhci_host *host,
-											  struct mmc_command *cmd)
+static void *sdhci_adma_transfer(struct sdhci_host *host, struct mmc_command *cmd)
 {
 	uint32_t num_blks = 0;
 	uint32_t sz;
 	void *data;
-	struct desc_entry *adma_addr;
+	void *adma_addr;
+	uint64_t adma_bus_addr;
 
 
 	num_blks = cmd->data.num_blocks;
@@ -715,10 +908,16 @@ static struct desc_entry *sdhci_adma_transfer(struct sdhci_host *host,
 		sz = num_blks * SDHCI_MMC_BLK_SZ;
 
 	/* Prepare adma descriptor table */
-	adma_addr = sdhci_prep_desc_table(data, sz);
+	if (cmd->data.sg)
+		adma_addr = sdhci_prep_desc_table_sg(host, cmd->data.sg, cmd->data.sg_count);
+	else
+		adma_addr = sdhci_prep_desc_table(host, data, sz);
 
 	/* Write adma address to adma register */
-	REG_WRITE32(host, (uint32_t) adma_addr, SDHCI_ADM_ADDR_REG);
+	adma_bus_addr = sdhci_dma_addr(adma_addr);
+	REG_WRITE32(host, (uint32_t)adma_bus_addr, SDHCI_ADM_ADDR_REG);
+	if (host->caps.adma64_support)
+		REG_WRITE32(host, (uint32_t)(adma_bus_addr >> 32), SDHCI_ADM_ADDR_HI_REG);
 
 	/* Write the block size */
 	if (cmd->data.blk_sz)
@@ -751,13 +950,17 @@ uint32_t sdhci_send_command(struct sdhci_host *host, struct mmc_command *cmd)
 	uint16_t trans_mode = 0;
 	uint16_t present_state;
 	uint32_t flags;
-	struct desc_entry *sg_list = NULL;
+	uint32_t i;
+	void *sg_list = NULL;
 
 	DBG("\n %s: START: cmd:%04d, arg:0x%08x, resp_type:0x%04x, data_present:%d\n",
 				__func__, cmd->cmd_index, cmd->argument, cmd->resp_type, cmd->data_present);
 
 	if (cmd->data_present)
-		ASSERT(cmd->data.data_ptr);
+		ASSERT(cmd->data.data_ptr || cmd->data.sg);
+
+	ktrace(KTRACE_MMC_CMD_START, cmd->cmd_index, cmd->argument,
+	       cmd->data_present ? cmd->data.num_blocks : 0);
 
 	/*
 	 * Assert if the data buffer is not aligned to cache
@@ -901,7 +1104,12 @@ uint32_t sdhci_send_command(struct sdhci_host *host, struct mmc_command *cmd)
 	}
 
 	/* Invalidate the cache only for read operations */
-	if (cmd->trans_mode == SDHCI_MMC_READ)
+	if (cmd->trans_mode == SDHCI_MMC_READ && cmd->data.sg)
+	{
+		for (i = 0; i < cmd->data.sg_count; i++)
+			arch_invalidate_cache_range((addr_t)cmd->data.sg[i].addr, cmd->data.sg[i].len);
+	}
+	else if (cmd->trans_mode == SDHCI_MMC_READ)
 	{
 		/* Read can be performed on block size < SDHCI_MMC_BLK_SZ, make sure to flush
 		 * the data only for the read size instead
@@ -914,10 +1122,11 @@ uint32_t sdhci_send_command(struct sdhci_host *host, struct mmc_command *cmd)
 	DBG("\n %s: END: cmd:%04d, arg:0x%08x, resp:0x%08x 0x%08x 0x%08x 0x%08x\n",
 				__func__, cmd->cmd_index, cmd->argument, cmd->resp[0], cmd->resp[1], cmd->resp[2], cmd->resp[3]);
 err:
-	/* Free the scatter/gather list */
-	if (sg_list)
+	/* Free the scatter/gather list unless it is the preallocated one */
+	if (sg_list && sg_list != host->desc_pool)
 		free(sg_list);
 
+	ktrace(KTRACE_MMC_CMD_END, cmd->cmd_index, ret, 0);
 	return ret;
 }
 
@@ -959,6 +1168,26 @@ void sdhci_init(struct sdhci_host *host)
 	if (caps[0] & SDHCI_BLK_ADMA_MASK)
 		host->caps.adma_support = 1;
 
+	/* 64 bit adma2 is only needed if RAM above 4 GiB can be mapped */
+#if LPAE
+	host->caps.adma64_support = (caps[0] & SDHCI_64BIT_BUS_MASK) ? 1 : 0;
+#else
+	host->caps.adma64_support = 0;
+#endif
+
+	/*
+	 * Allocate the adma desc table once, it is reused for every data
+	 * command. It is uncached if possible, so it does not need to be
+	 * flushed for each command. If this fails a table is allocated for
+	 * each command.
+	 */
+	if (dma_pool_init(&host->desc_dma, SDHCI_ADMA_POOL_ENTRIES * sdhci_desc_size(host),
+			  1, DMA_POOL_UNCACHED) == NO_ERROR)
+		host->desc_pool = dma_pool_alloc(&host->desc_dma);
+
+	/* Look for a command queue engine */
+	sdhci_cqe_init(host);
+
 	/* Supported voltage */
 	if (caps[0] & SDHCI_3_3_VOL_MASK)
 		host->caps.voltage = SDHCI_VOL_3_3;
@@ -986,14 +1215,17 @@ void sdhci_init(struct sdhci_host *host)
 	else
 		host->use_cdclp533 = false;
 
-	/* Set bus power on */
-	sdhci_set_bus_power_on(host);
+	/* The bus of an adopted host is already powered & set up for the card */
+	if (!host->adopted) {
+		/* Set bus power on */
+		sdhci_set_bus_power_on(host);
 
-	/* Wait for power interrupt to be handled */
-	event_wait(host->sdhc_event);
+		/* Wait for power interrupt to be handled */
+		event_wait(host->sdhc_event);
 
-	/* Set bus width */
-	sdhci_set_bus_width(host, SDHCI_BUS_WITDH_1BIT);
+		/* Set bus width */
+		sdhci_set_bus_width(host, SDHCI_BUS_WITDH_1BIT);
+	}
 
 	/* Set Adma mode */
 	sdhci_set_adma_mode(host);
@@ -1002,4 +1234,7 @@ void sdhci_init(struct sdhci_host *host)
 	 * Enable error status
 	 */
 	sdhci_error_status_enable(host);
+
+	/* Sleep on the irq during transfers, if there is one */
+	sdhci_irq_init(host);
 }
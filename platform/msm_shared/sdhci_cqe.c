@@ -0,0 +1,271 @@
+// SPDX-License-Identifier: BSD-3-Clause
+/*
+ * sdhci_cqe.c - Command queue engine (CQHCI) of the SDHCI controller.
+ *
+ * With eMMC command queueing the controller queues the tasks on the card
+ * (CMD44/45), polls the queue status and executes the tasks that are ready
+ * (CMD46/47) on its own. Software only fills the task descriptor list and
+ * rings the doorbell. The engine is enabled only for a batch of read tasks,
+ * all other commands still use the legacy sdhci interface.
+ */
+
+#include <arch/ops.h>
+#include <debug.h>
+#include <kernel/thread.h>
+#include <platform.h>
+#include <platform/timer.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sdhci.h>
+#include <sdhci_cqe.h>
+
+/* One slot of the task descriptor list: 64 bit task + 32 bit adma link */
+struct sdhci_cqe_slot {
+	uint32_t task;
+	uint32_t blk_addr;
+	struct desc_entry link;
+};
+
+/*
+ * Function: sdhci cqe init
+ * Arg     : Host structure
+ * Return  : None
+ * Flow:   : Check the version register to see if the host has a command
+ *           queue engine. The descriptor memory is allocated on first use.
+ */
+void sdhci_cqe_init(struct sdhci_host *host)
+{
+	uint32_t ver;
+
+	host->cqe_base = 0;
+	host->cqe_tdl = NULL;
+	host->cqe_trans = NULL;
+
+	if (!SDHCI_CQE_OFFSET)
+		return;
+
+	ver = readl(host->base + SDHCI_CQE_OFFSET + SDHCI_CQE_VER_REG);
+	if ((ver >> 12) || SDHCI_CQE_VER_MAJOR(ver) < 4)
+		return;
+
+	host->cqe_base = host->base + SDHCI_CQE_OFFSET;
+	dprintf(INFO, "SDHC command queue engine v%u.%u\n",
+			SDHCI_CQE_VER_MAJOR(ver), SDHCI_CQE_VER_MINOR(ver));
+}
+
+/*
+ * Function: sdhci cqe alloc
+ * Arg     : Host structure
+ * Return  : 0 on Success, 1 on Failure
+ * Flow:   : Allocate the task descriptor list & the transfer descriptors,
+ *           and link each slot to its own transfer descriptors
+ */
+static uint32_t sdhci_cqe_alloc(struct sdhci_host *host)
+{
+	struct sdhci_cqe_slot *slots;
+	uint32_t trans_len = SDHCI_CQE_MAX_SLOTS * SDHCI_CQE_SLOT_DESCS * sizeof(struct desc_entry);
+	uint32_t tdl_len = SDHCI_CQE_MAX_SLOTS * sizeof(struct sdhci_cqe_slot);
+	uint32_t i;
+
+	if (host->cqe_tdl)
+		return 0;
+
+	slots = memalign(CACHE_LINE, ROUNDUP(tdl_len, CACHE_LINE));
+	host->cqe_trans = memalign(CACHE_LINE, ROUNDUP(trans_len, CACHE_LINE));
+	if (!slots || !host->cqe_trans) {
+		dprintf(CRITICAL, "Error allocating command queue descriptors\n");
+		free(slots);
+		free(host->cqe_trans);
+		host->cqe_trans = NULL;
+		return 1;
+	}
+
+	memset(slots, 0, tdl_len);
+	for (i = 0; i < SDHCI_CQE_MAX_SLOTS; i++) {
+		slots[i].link.addr = (uint32_t)&host->cqe_trans[i * SDHCI_CQE_SLOT_DESCS];
+		slots[i].link.tran_att = SDHCI_ADMA_TRANS_VALID | SDHCI_ADMA_TRANS_LINK;
+	}
+	arch_clean_invalidate_cache_range((addr_t)slots, tdl_len);
+
+	host->cqe_tdl = slots;
+	return 0;
+}
+
+/*
+ * Function: sdhci cqe halt
+ * Arg     : Host structure
+ * Return  : 0 on Success, 1 on Failure
+ * Flow:   : Ask the engine to stop issuing tasks & wait until it did
+ */
+static uint32_t sdhci_cqe_halt(struct sdhci_host *host)
+{
+	time_t start = current_time();
+
+	CQE_WRITE32(host, SDHCI_CQE_CTL_HALT, SDHCI_CQE_CTL_REG);
+	while (!(CQE_READ32(host, SDHCI_CQE_CTL_REG) & SDHCI_CQE_CTL_HALT)) {
+		if (current_time() - start > SDHCI_CQE_TASK_TIMEOUT) {
+			dprintf(CRITICAL, "Error: command queue engine did not halt\n");
+			return 1;
+		}
+		udelay(10);
+	}
+
+	CQE_WRITE32(host, SDHCI_CQE_IS_HAC, SDHCI_CQE_IS_REG);
+	return 0;
+}
+
+/*
+ * Function: sdhci cqe enable
+ * Arg     : Host structure & relative card address
+ * Return  : 0 on Success, 1 on Failure
+ * Flow:   : 1. Program the task descriptor list & the card address
+ *           2. Enable the status bits used for polling, no interrupts
+ *           3. Enable the engine, the legacy interface must not be used
+ *              until sdhci_cqe_disable()
+ */
+uint32_t sdhci_cqe_enable(struct sdhci_host *host, uint32_t rca)
+{
+	if (!host->cqe_base || sdhci_cqe_alloc(host))
+		return 1;
+
+	/* All tasks use the default block length */
+	REG_WRITE16(host, SDHCI_MMC_BLK_SZ, SDHCI_BLKSZ_REG);
+
+	/* The configuration must not be changed while enabled */
+	CQE_WRITE32(host, 0, SDHCI_CQE_CFG_REG);
+
+	CQE_WRITE32(host, (uint32_t)host->cqe_tdl, SDHCI_CQE_TDLBA_REG);
+	CQE_WRITE32(host, 0, SDHCI_CQE_TDLBAU_REG);
+	CQE_WRITE32(host, rca << 16, SDHCI_CQE_SSC2_REG);
+
+	CQE_WRITE32(host, SDHCI_CQE_IS_MASK, SDHCI_CQE_ISTE_REG);
+	CQE_WRITE32(host, 0, SDHCI_CQE_ISGE_REG);
+	CQE_WRITE32(host, SDHCI_CQE_IS_MASK, SDHCI_CQE_IS_REG);
+	CQE_WRITE32(host, ~0U, SDHCI_CQE_TCN_REG);
+
+	CQE_WRITE32(host, SDHCI_CQE_CFG_ENABLE, SDHCI_CQE_CFG_REG);
+
+	if (CQE_READ32(host, SDHCI_CQE_CTL_REG) & SDHCI_CQE_CTL_HALT)
+		CQE_WRITE32(host, 0, SDHCI_CQE_CTL_REG);
+
+	return 0;
+}
+
+/*
+ * Function: sdhci cqe disable
+ * Arg     : Host structure
+ * Return  : None
+ * Flow:   : Halt & disable the engine once all tasks are complete
+ */
+void sdhci_cqe_disable(struct sdhci_host *host)
+{
+	sdhci_cqe_halt(host);
+	CQE_WRITE32(host, 0, SDHCI_CQE_CFG_REG);
+	CQE_WRITE32(host, 0, SDHCI_CQE_CTL_REG);
+	CQE_WRITE32(host, 0, SDHCI_CQE_ISTE_REG);
+}
+
+/*
+ * Function: sdhci cqe queue read
+ * Arg     : Host structure, free slot, destination, block address & count
+ * Return  : None
+ * Flow:   : 1. Prepare the transfer descriptors of the slot
+ *           2. Prepare the task descriptor
+ *           3. Ring the doorbell for the slot
+ *           num_blocks must not exceed SDHCI_CQE_MAX_BLOCKS.
+ */
+void sdhci_cqe_queue_read(struct sdhci_host *host, uint32_t tag, void *data,
+						  uint32_t blk_addr, uint32_t num_blocks)
+{
+	struct sdhci_cqe_slot *slot = &((struct sdhci_cqe_slot *)host->cqe_tdl)[tag];
+	struct desc_entry *desc = &host->cqe_trans[tag * SDHCI_CQE_SLOT_DESCS];
+	uint32_t len = num_blocks * SDHCI_MMC_BLK_SZ;
+	uint32_t n = 0;
+
+	ASSERT(num_blocks && num_blocks <= SDHCI_CQE_MAX_BLOCKS);
+
+	while (len) {
+		desc[n].addr = (uint32_t)data;
+		desc[n].len = MIN(len, SDHCI_ADMA_DESC_LINE_SZ) & 0xffff;
+		desc[n].tran_att = SDHCI_ADMA_TRANS_VALID | SDHCI_ADMA_TRANS_DATA;
+		data += MIN(len, SDHCI_ADMA_DESC_LINE_SZ);
+		len -= MIN(len, SDHCI_ADMA_DESC_LINE_SZ);
+		n++;
+	}
+	desc[n - 1].tran_att |= SDHCI_ADMA_TRANS_END;
+
+	slot->task = SDHCI_CQE_TASK_VALID | SDHCI_CQE_TASK_END | SDHCI_CQE_TASK_INT |
+				 SDHCI_CQE_TASK_ACT | SDHCI_CQE_TASK_DATA_READ |
+				 SDHCI_CQE_TASK_BLK_COUNT(num_blocks);
+	slot->blk_addr = blk_addr;
+
+	arch_clean_invalidate_cache_range((addr_t)desc, n * sizeof(struct desc_entry));
+	arch_clean_invalidate_cache_range((addr_t)slot, sizeof(*slot));
+
+	CQE_WRITE32(host, BIT(tag), SDHCI_CQE_TDBR_REG);
+}
+
+/*
+ * Function: sdhci cqe wait
+ * Arg     : Host structure, mask of pending slots & mask of completed slots
+ * Return  : 0 on Success, 1 on Failure
+ * Flow:   : Poll the task completion register, other threads run meanwhile
+ *           unless we are in a critical section
+ */
+uint32_t sdhci_cqe_wait(struct sdhci_host *host, uint32_t pending, uint32_t *done)
+{
+	time_t start = current_time();
+	uint32_t status, tcn;
+
+	do {
+		status = CQE_READ32(host, SDHCI_CQE_IS_REG);
+		if ((status & SDHCI_CQE_IS_ERR_MASK) || REG_READ16(host, SDHCI_ERR_INT_STS_REG)) {
+			dprintf(CRITICAL, "Error: command queue task failed, is: 0x%x terri: 0x%x err: 0x%x\n",
+					status, CQE_READ32(host, SDHCI_CQE_TERRI_REG),
+					REG_READ16(host, SDHCI_ERR_INT_STS_REG));
+			return 1;
+		}
+
+		if (status & SDHCI_CQE_IS_TCC)
+			CQE_WRITE32(host, SDHCI_CQE_IS_TCC, SDHCI_CQE_IS_REG);
+
+		tcn = CQE_READ32(host, SDHCI_CQE_TCN_REG) & pending;
+		if (tcn) {
+			CQE_WRITE32(host, tcn, SDHCI_CQE_TCN_REG);
+			*done = tcn;
+			return 0;
+		}
+
+		if (in_critical_section())
+			udelay(1);
+		else
+			thread_yield();
+	} while (current_time() - start < SDHCI_CQE_TASK_TIMEOUT);
+
+	dprintf(CRITICAL, "Error: command queue task never completed, pending: 0x%x\n", pending);
+	return 1;
+}
+
+/*
+ * Function: sdhci cqe recover
+ * Arg     : Host structure
+ * Return  : None
+ * Flow:   : Halt the engine, clear all tasks, disable it again & reset the
+ *           command & data lines for the legacy interface
+ */
+void sdhci_cqe_recover(struct sdhci_host *host)
+{
+	sdhci_cqe_halt(host);
+
+	CQE_WRITE32(host, SDHCI_CQE_CTL_HALT | SDHCI_CQE_CTL_CLEAR_ALL_TASKS, SDHCI_CQE_CTL_REG);
+	CQE_WRITE32(host, ~0U, SDHCI_CQE_TCN_REG);
+	CQE_WRITE32(host, SDHCI_CQE_IS_MASK, SDHCI_CQE_IS_REG);
+
+	CQE_WRITE32(host, 0, SDHCI_CQE_CFG_REG);
+	CQE_WRITE32(host, 0, SDHCI_CQE_CTL_REG);
+	CQE_WRITE32(host, 0, SDHCI_CQE_ISTE_REG);
+
+	sdhci_reset(host, (SOFT_RESET_CMD | SOFT_RESET_DATA));
+	REG_WRITE16(host, 0xFFFF, SDHCI_ERR_INT_STS_REG);
+	REG_WRITE16(host, 0xFFFF, SDHCI_NRML_INT_STS_REG);
+}
@@ -40,6 +40,9 @@
 #include <sdhci.h>
 #include <sdhci_msm.h>
 
+#if WITH_LK2ND_PERSIST
+#include <lk2nd/persist.h>
+#endif
 
 #define MX_DRV_SUPPORTED_HS200 3
 static bool attempt_cdr_unlock;
@@ -135,6 +138,33 @@ static void sdhci_clear_power_ctrl_irq(struct sdhci_msm_data *data)
 	writel(irq_ctl, (data->pwrctl_base + SDCC_HC_PWRCTL_CTL_REG));
 }
 
+/*
+ * Function: sdhci msm can adopt
+ * Arg     : Host structure & MSM specific config data for sdhci
+ * Return  : true if the controller can be used without reinitializing it
+ * Flow:   : The previous bootloader only disables the sdhc mode when it is
+ *           done, the clock, bus power & bus width stay as they were. Enable
+ *           the sdhc mode again and check that the card clock is running and
+ *           the bus is still set up for a wide data transfer.
+ */
+bool sdhci_msm_can_adopt(struct sdhci_host *host, struct sdhci_msm_data *config)
+{
+	uint16_t clk;
+	uint8_t ctrl;
+
+	RMWREG32((config->pwrctl_base + SDCC_MCI_HC_MODE), SDHCI_HC_START_BIT, SDHCI_HC_WIDTH, SDHCI_HC_MODE_EN);
+
+	clk = REG_READ16(host, SDHCI_CLK_CTRL_REG);
+	if (!(clk & SDHCI_CLK_EN) || !(clk & SDHCI_CLK_STABLE))
+		return false;
+
+	if (!(REG_READ8(host, SDHCI_PWR_CTRL_REG) & SDHCI_BUS_PWR_EN))
+		return false;
+
+	ctrl = REG_READ8(host, SDHCI_HOST_CTRL1_REG);
+	return !!(ctrl & (SDHCI_BUS_WITDH_4BIT | SDHCI_BUS_WITDH_8BIT));
+}
+
 /*
  * Function: sdhci msm init
  * Arg     : MSM specific config data for sdhci
@@ -147,7 +177,9 @@ void sdhci_msm_init(struct sdhci_host *host, struct sdhci_msm_data *config)
 	uint32_t caps = 0;
 	uint32_t version;
 
-	REG_WRITE32(host, 0xA1C, SDCC_VENDOR_SPECIFIC_FUNC);
+	/* The vendor settings of an adopted host belong to its bus timing */
+	if (!host->adopted)
+		REG_WRITE32(host, 0xA1C, SDCC_VENDOR_SPECIFIC_FUNC);
 
 	/* Enable sdhc mode */
 	RMWREG32((config->pwrctl_base + SDCC_MCI_HC_MODE), SDHCI_HC_START_BIT, SDHCI_HC_WIDTH, SDHCI_HC_MODE_EN);
@@ -158,7 +190,8 @@ void sdhci_msm_init(struct sdhci_host *host, struct sdhci_msm_data *config)
 	/*
 	 * Reset the controller
 	 */
-	sdhci_reset(host, SDHCI_SOFT_RESET);
+	if (!host->adopted)
+		sdhci_reset(host, SDHCI_SOFT_RESET);
 
 	/*
 	 * Some platforms have same SDC instance shared between emmc & sd card.
@@ -192,6 +225,18 @@ void sdhci_msm_init(struct sdhci_host *host, struct sdhci_msm_data *config)
 	/* Enable pwr control interrupt */
 	writel(SDCC_HC_PWR_CTRL_INT, (config->pwrctl_base + SDCC_HC_PWRCTL_MASK_REG));
 
+	/* Host controller irq, used to sleep during data transfers */
+#if defined(SDCC1_HC_IRQ) && defined(SDCC2_HC_IRQ)
+	if (config->slot == 1)
+		host->irq = SDCC1_HC_IRQ;
+	else if (config->slot == 2)
+		host->irq = SDCC2_HC_IRQ;
+	else
+		host->irq = 0;
+#else
+	host->irq = 0;
+#endif
+
 	version = readl(host->msm_host->pwrctl_base + MCI_VERSION);
 
 	host->major = (version & CORE_VERSION_MAJOR_MASK) >> CORE_VERSION_MAJOR_SHIFT;
@@ -258,6 +303,66 @@ void sdhci_msm_set_mci_clk(struct sdhci_host *host)
 	}
 }
 
+/*
+ * Function: sdhci msm switch 1.8v
+ * Arg     : Host structure
+ * Return  : 0 on Success, 1 on Failure
+ * Flow:   : Called once the card accepted CMD11, as per the sd spec 3.0:
+ *           1. Stop the clock & check that the card drives DAT[3:0] low
+ *           2. Switch the IO regulator, the host & the IO pads to 1.8V
+ *           3. Run the clock again after 5ms & check that the card
+ *              releases DAT[3:0] within 1ms
+ * Details : If the switch fails after CMD11 the card only recovers
+ *           with a power cycle.
+ */
+uint32_t sdhci_msm_switch_1_8v(struct sdhci_host *host)
+{
+	uint32_t io_switch;
+	uint16_t clk;
+	uint16_t ctrl;
+
+	clk = REG_READ16(host, SDHCI_CLK_CTRL_REG);
+	REG_WRITE16(host, clk & ~SDHCI_CLK_EN, SDHCI_CLK_CTRL_REG);
+
+	if (REG_READ32(host, SDHCI_PRESENT_STATE_REG) & SDHCI_DAT_LVL_MASK)
+	{
+		dprintf(CRITICAL, "Error: Card did not start the voltage switch\n");
+		goto err;
+	}
+
+	if (target_sd_set_io_voltage(host->msm_host->slot, true))
+	{
+		dprintf(CRITICAL, "Error: Failed to set the IO voltage to 1.8V\n");
+		goto err;
+	}
+
+	/* The power irq for IO_SIG_LOW is acked by sdhci_int_handler */
+	ctrl = REG_READ16(host, SDHCI_HOST_CTRL2_REG);
+	REG_WRITE16(host, ctrl | SDHCI_1_8_VOL_SET, SDHCI_HOST_CTRL2_REG);
+
+	io_switch = REG_READ32(host, SDCC_VENDOR_SPECIFIC_FUNC);
+	io_switch |= HC_IO_PAD_PWR_SWITCH | HC_IO_PAD_PWR_SWITCH_EN;
+	REG_WRITE32(host, io_switch, SDCC_VENDOR_SPECIFIC_FUNC);
+
+	mdelay(5);
+
+	REG_WRITE16(host, clk | SDHCI_CLK_EN, SDHCI_CLK_CTRL_REG);
+
+	mdelay(1);
+
+	if ((REG_READ32(host, SDHCI_PRESENT_STATE_REG) & SDHCI_DAT_LVL_MASK) != SDHCI_DAT_LVL_MASK)
+	{
+		dprintf(CRITICAL, "Error: Card did not complete the voltage switch\n");
+		return 1;
+	}
+
+	return 0;
+
+err:
+	REG_WRITE16(host, clk, SDHCI_CLK_CTRL_REG);
+	return 1;
+}
+
 /*
  * Set the value based on sdcc clock frequency
  */
@@ -691,11 +796,128 @@ static uint32_t sdhci_msm_hs400_calibration(struct sdhci_host *host)
 	return 0;
 }
 
+/*
+ * Function: sdhci msm send tuning
+ * Arg     : Host & card structure, tuning command & expected tuning block
+ * Return  : 0 if the tuning block was read correctly, 1 otherwise
+ * Flow:   : Read the tuning block with the current DLL phase. If the command
+ *           fails wait for the card to get back to TRAN state.
+ */
+static uint32_t sdhci_msm_send_tuning(struct sdhci_host *host, struct mmc_card *card,
+				      uint32_t tuning_cmd, uint32_t *tuning_data,
+				      const uint32_t *tuning_block, uint32_t size)
+{
+	struct mmc_command cmd = {0};
+	struct mmc_command sts_cmd = {0};
+	uint32_t sts_retry;
+	uint32_t sts_err;
+	uint32_t err;
+
+	cmd.cmd_index = tuning_cmd;
+	cmd.argument = 0x0;
+	cmd.cmd_type = SDHCI_CMD_TYPE_NORMAL;
+	cmd.resp_type = SDHCI_CMD_RESP_R1;
+	cmd.trans_mode = SDHCI_MMC_READ;
+	cmd.data_present = 0x1;
+	cmd.data.data_ptr = tuning_data;
+	cmd.data.blk_sz = size;
+	cmd.data.num_blocks = 0x1;
+
+	/* send command */
+	err = sdhci_send_command(host, &cmd);
+	if(err)
+	{
+
+		sts_retry = 50;
+		sts_cmd.cmd_index = CMD13_SEND_STATUS;
+		sts_cmd.argument = card->rca << 16;
+		sts_cmd.cmd_type = SDHCI_CMD_TYPE_NORMAL;
+		sts_cmd.resp_type = SDHCI_CMD_RESP_R1;
+		while(sts_retry)
+		{
+			sts_err = sdhci_send_command(host, &sts_cmd);
+			DBG(" response is %d err is %d\n",sts_cmd.resp[0],sts_err);
+			if( sts_err || (MMC_CARD_STATUS(sts_cmd.resp[0]) != MMC_TRAN_STATE) )
+			{
+				udelay(10);
+				sts_retry--;
+				continue;
+			}
+			break;
+		}
+		return 1;
+	}
+
+	return !!memcmp(tuning_data, tuning_block, size);
+}
+
+#if WITH_LK2ND_PERSIST
+/*
+ * The tuned phase is kept for the next (warm) boot. It only depends on the
+ * board, so it is reused if the same card is tuned for the same bus setup on
+ * the same controller. It is still verified with one tuning block read.
+ */
+struct sdhci_msm_tuning_hint {
+	uint32_t base;
+	uint32_t timing;
+	uint32_t clk_rate;
+	uint32_t bus_width;
+	uint32_t mid;
+	uint32_t oid;
+	uint32_t prv;
+	uint32_t psn;
+	uint8_t pnm[8];
+	uint32_t phase;
+};
+
+static void sdhci_msm_tuning_hint_init(struct sdhci_host *host, struct mmc_card *card,
+				       uint32_t bus_width, struct sdhci_msm_tuning_hint *hint)
+{
+	memset(hint, 0, sizeof(*hint));
+	hint->base = host->base;
+	hint->timing = host->timing;
+	hint->clk_rate = host->cur_clk_rate;
+	hint->bus_width = bus_width;
+	hint->mid = card->cid.mid;
+	hint->oid = card->cid.oid;
+	hint->prv = card->cid.prv;
+	hint->psn = card->cid.psn;
+	memcpy(hint->pnm, card->cid.pnm, sizeof(card->cid.pnm));
+}
+
+static bool sdhci_msm_tuning_hint_load(struct sdhci_host *host, struct mmc_card *card,
+				       uint32_t bus_width, uint32_t *phase)
+{
+	struct sdhci_msm_tuning_hint hint, saved;
+
+	if (!lk2nd_persist_load(LK2ND_PERSIST_MMC_TUNING, &saved, sizeof(saved)))
+		return false;
+
+	sdhci_msm_tuning_hint_init(host, card, bus_width, &hint);
+	hint.phase = saved.phase;
+	if (memcmp(&hint, &saved, sizeof(hint)) || saved.phase >= MAX_PHASES)
+		return false;
+
+	*phase = saved.phase;
+	return true;
+}
+
+static void sdhci_msm_tuning_hint_store(struct sdhci_host *host, struct mmc_card *card,
+					uint32_t bus_width, uint32_t phase)
+{
+	struct sdhci_msm_tuning_hint hint;
+
+	sdhci_msm_tuning_hint_init(host, card, bus_width, &hint);
+	hint.phase = phase;
+	lk2nd_persist_store(LK2ND_PERSIST_MMC_TUNING, &hint, sizeof(hint));
+}
+#endif
+
 /*
  * Function: sdhci msm execute tuning
  * Arg     : Host structure & bus width
  * Return  : 0 on Success, 1 on Failure
- * Flow:   : Execute Tuning sequence for HS200 and calibration for hs400
+ * Flow:   : Execute Tuning sequence for HS200/SDR104 and calibration for hs400
  */
 uint32_t sdhci_msm_execute_tuning(struct sdhci_host *host, struct mmc_card *card, uint32_t bus_width)
 {
@@ -710,10 +932,14 @@ uint32_t sdhci_msm_execute_tuning(struct sdhci_host *host, struct mmc_card *card
 	int ret = 0;
 	uint32_t i;
 	uint32_t err = 0;
+	uint32_t tuning_cmd;
 	struct sdhci_msm_data *msm_host;
 
 	msm_host = host->msm_host;
 
+	/* SD cards use CMD19 for tuning in SDR50/SDR104 mode */
+	tuning_cmd = MMC_CARD_SD(card) ? CMD19_SEND_TUNING_BLOCK : CMD21_SEND_TUNING_BLOCK;
+
 	/* In Tuning mode */
 	host->tuning_in_progress = true;
 
@@ -748,13 +974,25 @@ uint32_t sdhci_msm_execute_tuning(struct sdhci_host *host, struct mmc_card *card
 			goto out;
 	}
 
+#if WITH_LK2ND_PERSIST
+	/* Try the phase tuned in the previous boot first */
+	if (sdhci_msm_tuning_hint_load(host, card, bus_width, &phase))
+	{
+		if (!sdhci_msm_config_dll(host, phase) &&
+			!sdhci_msm_send_tuning(host, card, tuning_cmd, tuning_data, tuning_block, size))
+		{
+			dprintf(INFO, "Using tuning phase %u of previous boot\n", phase);
+			host->msm_host->saved_phase = phase;
+			goto out;
+		}
+		dprintf(INFO, "Tuning phase %u of previous boot failed, tuning again\n", phase);
+	}
+#endif
+
 retry_tuning:
 	tuned_phase_cnt = 0;
 	phase = 0;
 	struct mmc_command cmd = {0};
-	struct mmc_command sts_cmd = {0};
-	uint32_t sts_retry;
-	uint32_t sts_err;
 
 	while (phase < MAX_PHASES)
 	{
@@ -765,41 +1003,8 @@ retry_tuning:
 			goto out;
 		}
 
-		cmd.cmd_index = CMD21_SEND_TUNING_BLOCK;
-		cmd.argument = 0x0;
-		cmd.cmd_type = SDHCI_CMD_TYPE_NORMAL;
-		cmd.resp_type = SDHCI_CMD_RESP_R1;
-		cmd.trans_mode = SDHCI_MMC_READ;
-		cmd.data_present = 0x1;
-		cmd.data.data_ptr = tuning_data;
-		cmd.data.blk_sz = size;
-		cmd.data.num_blocks = 0x1;
-
-		/* send command */
-		err = sdhci_send_command(host, &cmd);
-		if(err)
-		{
-
-			sts_retry = 50;
-			sts_cmd.cmd_index = CMD13_SEND_STATUS;
-			sts_cmd.argument = card->rca << 16;
-			sts_cmd.cmd_type = SDHCI_CMD_TYPE_NORMAL;
-			sts_cmd.resp_type = SDHCI_CMD_RESP_R1;
-			while(sts_retry)
-			{
-				sts_err = sdhci_send_command(host, &sts_cmd);
-				DBG(" response is %d err is %d phase is %d\n",sts_cmd.resp[0],sts_err, phase);
-				if( sts_err || (MMC_CARD_STATUS(sts_cmd.resp[0]) != MMC_TRAN_STATE) )
-				{
-					udelay(10);
-					sts_retry--;
-					continue;
-				}
-				break;
-			}
-		}
-
-		if (!err && !memcmp(tuning_data, tuning_block, size))
+		err = sdhci_msm_send_tuning(host, card, tuning_cmd, tuning_data, tuning_block, size);
+		if (!err)
 				tuned_phases[tuned_phase_cnt++] = phase;
 
 		phase++;
@@ -859,6 +1064,9 @@ retry_tuning:
 
 		/* Save the tuned phase */
 		host->msm_host->saved_phase = phase;
+#if WITH_LK2ND_PERSIST
+		sdhci_msm_tuning_hint_store(host, card, bus_width, phase);
+#endif
 	}
 	else
 	{
@@ -867,12 +1075,12 @@ retry_tuning:
 	}
 
 out:
-	/* If all the tuning phases passed, send CMD21 after enabling
+	/* If all the tuning phases passed, send the tuning cmd after enabling
 	 * CDR to make sure right tuning phase is selected by CDR
 	 */
 	if (attempt_cdr_unlock)
 	{
-		cmd.cmd_index = CMD21_SEND_TUNING_BLOCK;
+		cmd.cmd_index = tuning_cmd;
 		cmd.argument = 0x0;
 		cmd.cmd_type = SDHCI_CMD_TYPE_NORMAL;
 		cmd.resp_type = SDHCI_CMD_RESP_R1;
@@ -885,7 +1093,7 @@ out:
 		/* send command */
 		if (!sdhci_send_command(host, &cmd))
 		{
-			DBG("\n: %s: Sending CMD21 after CDR enable with default phases fail\n", __func__);
+			DBG("\n: %s: Sending tuning cmd after CDR enable with default phases fail\n", __func__);
 		}
 	}
 
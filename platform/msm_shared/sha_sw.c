@@ -0,0 +1,263 @@
+// SPDX-License-Identifier: BSD-3-Clause
+/*
+ * SHA-1 and SHA-256 on the CPU. The ARMv8 cores (e.g. msm8916) have the SHA
+ * instructions also in AArch32 state, they are much faster than the crypto
+ * engine for small buffers and do not need its clocks and BAM setup. There
+ * is a plain C version for the older cores without a usable crypto engine.
+ */
+
+#include <bits.h>
+#include <stdlib.h>
+#include <string.h>
+#include <crypto_hash.h>
+
+/* Implemented in sha-armv8.S, only call these if ID_ISAR5 reports them */
+void sha1_block_armv8(uint32_t state[5], const void *data, size_t blocks);
+void sha256_block_armv8(uint32_t state[8], const void *data, size_t blocks);
+
+static const uint32_t sha1_init_state[5] = {
+	0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476, 0xc3d2e1f0,
+};
+
+static const uint32_t sha256_init_state[8] = {
+	0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+	0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19,
+};
+
+static const uint32_t sha256_k[64] = {
+	0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5,
+	0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+	0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3,
+	0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+	0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc,
+	0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+	0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7,
+	0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+	0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13,
+	0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+	0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3,
+	0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+	0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5,
+	0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+	0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
+	0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+
+static int sha_hw = -1;
+
+#define ROL(x, n)	(((x) << (n)) | ((x) >> (32 - (n))))
+#define ROR(x, n)	(((x) >> (n)) | ((x) << (32 - (n))))
+
+static inline uint32_t sha_load_be32(const unsigned char *p)
+{
+	return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) |
+	       ((uint32_t)p[2] << 8) | p[3];
+}
+
+static inline void sha_store_be32(unsigned char *p, uint32_t v)
+{
+	p[0] = v >> 24;
+	p[1] = v >> 16;
+	p[2] = v >> 8;
+	p[3] = v;
+}
+
+static void sha1_block_c(uint32_t state[5], const unsigned char *data, size_t blocks)
+{
+	uint32_t w[16], a, b, c, d, e, f, k, t;
+	unsigned int i;
+
+	for (; blocks; blocks--, data += CRYPTO_SHA_BLOCK_SIZE) {
+		for (i = 0; i < 16; i++)
+			w[i] = sha_load_be32(data + 4 * i);
+
+		a = state[0];
+		b = state[1];
+		c = state[2];
+		d = state[3];
+		e = state[4];
+
+		for (i = 0; i < 80; i++) {
+			if (i >= 16) {
+				t = w[(i + 13) & 15] ^ w[(i + 8) & 15] ^
+				    w[(i + 2) & 15] ^ w[i & 15];
+				w[i & 15] = ROL(t, 1);
+			}
+
+			if (i < 20) {
+				f = d ^ (b & (c ^ d));
+				k = 0x5a827999;
+			} else if (i < 40) {
+				f = b ^ c ^ d;
+				k = 0x6ed9eba1;
+			} else if (i < 60) {
+				f = (b & c) | (d & (b | c));
+				k = 0x8f1bbcdc;
+			} else {
+				f = b ^ c ^ d;
+				k = 0xca62c1d6;
+			}
+
+			t = ROL(a, 5) + f + e + k + w[i & 15];
+			e = d;
+			d = c;
+			c = ROL(b, 30);
+			b = a;
+			a = t;
+		}
+
+		state[0] += a;
+		state[1] += b;
+		state[2] += c;
+		state[3] += d;
+		state[4] += e;
+	}
+}
+
+static void sha256_block_c(uint32_t state[8], const unsigned char *data, size_t blocks)
+{
+	uint32_t w[64], s[8], t1, t2;
+	unsigned int i;
+
+	for (; blocks; blocks--, data += CRYPTO_SHA_BLOCK_SIZE) {
+		for (i = 0; i < 16; i++)
+			w[i] = sha_load_be32(data + 4 * i);
+
+		for (; i < 64; i++) {
+			t1 = ROR(w[i - 2], 17) ^ ROR(w[i - 2], 19) ^ (w[i - 2] >> 10);
+			t2 = ROR(w[i - 15], 7) ^ ROR(w[i - 15], 18) ^ (w[i - 15] >> 3);
+			w[i] = t1 + w[i - 7] + t2 + w[i - 16];
+		}
+
+		memcpy(s, state, sizeof(s));
+
+		for (i = 0; i < 64; i++) {
+			t1 = s[7] + (ROR(s[4], 6) ^ ROR(s[4], 11) ^ ROR(s[4], 25)) +
+			     (s[6] ^ (s[4] & (s[5] ^ s[6]))) + sha256_k[i] + w[i];
+			t2 = (ROR(s[0], 2) ^ ROR(s[0], 13) ^ ROR(s[0], 22)) +
+			     ((s[0] & s[1]) | (s[2] & (s[0] | s[1])));
+			s[7] = s[6];
+			s[6] = s[5];
+			s[5] = s[4];
+			s[4] = s[3] + t1;
+			s[3] = s[2];
+			s[2] = s[1];
+			s[1] = s[0];
+			s[0] = t1 + t2;
+		}
+
+		for (i = 0; i < 8; i++)
+			state[i] += s[i];
+	}
+}
+
+bool sha_sw_has_hw(unsigned char auth_alg)
+{
+	uint32_t isar5 = 0;
+
+	if (sha_hw < 0) {
+#if ARM_ISA_ARMv7
+		/* ID_ISAR5 is RAZ on ARMv7 cores, SHA1 is [11:8], SHA2 is [15:12] */
+		__asm__ ("mrc p15, 0, %0, c0, c2, 5" : "=r" (isar5));
+#endif
+		sha_hw = (BITS_SHIFT(isar5, 11, 8) ? 1 : 0) |
+			 (BITS_SHIFT(isar5, 15, 12) ? 2 : 0);
+	}
+
+	if (auth_alg == CRYPTO_AUTH_ALG_SHA1)
+		return sha_hw & 1;
+	return sha_hw & 2;
+}
+
+static void sha_sw_blocks(crypto_sha_sw_ctx *ctx, unsigned char auth_alg,
+			  const unsigned char *data, size_t blocks)
+{
+	if (auth_alg == CRYPTO_AUTH_ALG_SHA1) {
+		if (sha_sw_has_hw(auth_alg))
+			sha1_block_armv8(ctx->state, data, blocks);
+		else
+			sha1_block_c(ctx->state, data, blocks);
+	} else {
+		if (sha_sw_has_hw(auth_alg))
+			sha256_block_armv8(ctx->state, data, blocks);
+		else
+			sha256_block_c(ctx->state, data, blocks);
+	}
+}
+
+void sha_sw_init(crypto_sha_sw_ctx *ctx, unsigned char auth_alg)
+{
+	if (auth_alg == CRYPTO_AUTH_ALG_SHA1)
+		memcpy(ctx->state, sha1_init_state, sizeof(sha1_init_state));
+	else
+		memcpy(ctx->state, sha256_init_state, sizeof(sha256_init_state));
+
+	ctx->bytecnt = 0;
+	ctx->buf_len = 0;
+}
+
+void sha_sw_update(crypto_sha_sw_ctx *ctx, unsigned char auth_alg,
+		   const void *data, size_t size)
+{
+	const unsigned char *p = data;
+	size_t n;
+
+	ctx->bytecnt += size;
+
+	if (ctx->buf_len) {
+		n = MIN(size, CRYPTO_SHA_BLOCK_SIZE - ctx->buf_len);
+		memcpy(ctx->buf + ctx->buf_len, p, n);
+		ctx->buf_len += n;
+		p += n;
+		size -= n;
+
+		if (ctx->buf_len < CRYPTO_SHA_BLOCK_SIZE)
+			return;
+
+		sha_sw_blocks(ctx, auth_alg, ctx->buf, 1);
+		ctx->buf_len = 0;
+	}
+
+	n = size / CRYPTO_SHA_BLOCK_SIZE;
+	if (n) {
+		sha_sw_blocks(ctx, auth_alg, p, n);
+		p += n * CRYPTO_SHA_BLOCK_SIZE;
+		size -= n * CRYPTO_SHA_BLOCK_SIZE;
+	}
+
+	memcpy(ctx->buf, p, size);
+	ctx->buf_len = size;
+}
+
+void sha_sw_final(crypto_sha_sw_ctx *ctx, unsigned char auth_alg,
+		  unsigned char *digest)
+{
+	uint64_t bits = ctx->bytecnt * 8;
+	unsigned int i, words;
+
+	/* 0x80, zeroes and the message length in bits (big endian) */
+	ctx->buf[ctx->buf_len++] = 0x80;
+	if (ctx->buf_len > CRYPTO_SHA_BLOCK_SIZE - 8) {
+		memset(ctx->buf + ctx->buf_len, 0, CRYPTO_SHA_BLOCK_SIZE - ctx->buf_len);
+		sha_sw_blocks(ctx, auth_alg, ctx->buf, 1);
+		ctx->buf_len = 0;
+	}
+	memset(ctx->buf + ctx->buf_len, 0, CRYPTO_SHA_BLOCK_SIZE - 8 - ctx->buf_len);
+	sha_store_be32(ctx->buf + CRYPTO_SHA_BLOCK_SIZE - 8, bits >> 32);
+	sha_store_be32(ctx->buf + CRYPTO_SHA_BLOCK_SIZE - 4, bits);
+	sha_sw_blocks(ctx, auth_alg, ctx->buf, 1);
+
+	words = auth_alg == CRYPTO_AUTH_ALG_SHA1 ? SHA1_INIT_VECTOR_SIZE : SHA256_INIT_VECTOR_SIZE;
+	for (i = 0; i < words; i++)
+		sha_store_be32(digest + 4 * i, ctx->state[i]);
+}
+
+void sha_sw(const void *data, size_t size, unsigned char *digest,
+	    unsigned char auth_alg)
+{
+	crypto_sha_sw_ctx ctx;
+
+	sha_sw_init(&ctx, auth_alg);
+	sha_sw_update(&ctx, auth_alg, data, size);
+	sha_sw_final(&ctx, auth_alg, digest);
+}
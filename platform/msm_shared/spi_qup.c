@@ -37,7 +37,9 @@
 #include <kernel/thread.h>
 #include <stdlib.h>
 #include <string.h>
+#include <bam.h>
 #include <gsbi.h>
+#include <platform.h>
 #include <spi_qup.h>
 #include <platform/irqs.h>
 #include <platform/iomap.h>
@@ -340,6 +342,148 @@ static void spi_qup_fifo_read(struct qup_spi_dev *dev, struct spi_transfer *xfer
 	}
 }
 
+#ifdef BLSP_BAM_BASE
+/*
+ * Large writes (e.g. frames for SPI panels) are handed to the BLSP BAM instead
+ * of filling the output FIFO block by block, which needs a PAUSE/RUN cycle of
+ * the QUP for each block.
+ */
+#define SPI_BAM_MIN_LEN			256
+#define SPI_BAM_FIFO_SIZE		8
+#define SPI_BAM_TX_PIPE_INDEX		0
+#define SPI_BAM_TIMEOUT_MS		1000
+
+static struct bam_instance spi_bam;
+static struct bam_desc spi_bam_desc_fifo[SPI_BAM_FIFO_SIZE] __attribute__ ((aligned(BAM_DESC_SIZE)));
+
+static void spi_qup_bam_init(struct qup_spi_dev *dev)
+{
+	struct bam_pipe *pipe = &spi_bam.pipe[SPI_BAM_TX_PIPE_INDEX];
+
+	/* There is only one descriptor FIFO, used by the first device */
+	if (spi_bam.base)
+		return;
+
+	spi_bam.base = BLSP_BAM_BASE(dev->blsp_id);
+	spi_bam.max_desc_len = MAX_QUP_MX_TRANSFER_COUNT;
+	pipe->pipe_num = BLSP_QUP_BAM_TX_PIPE(dev->blsp_id, dev->qup_id);
+	pipe->trans_type = SYS2BAM;
+	pipe->fifo.head = spi_bam_desc_fifo;
+	pipe->fifo.size = SPI_BAM_FIFO_SIZE;
+
+	bam_init(&spi_bam);
+	bam_sys_pipe_init(&spi_bam, SPI_BAM_TX_PIPE_INDEX);
+	if (bam_pipe_fifo_init(&spi_bam, SPI_BAM_TX_PIPE_INDEX)) {
+		dprintf(CRITICAL, "%s: BAM pipe init failed, using PIO\n", __func__);
+		return;
+	}
+
+	dev->use_bam = 1;
+}
+
+static bool spi_qup_bam_usable(struct qup_spi_dev *dev, struct spi_transfer *xfer)
+{
+	if (!dev->use_bam || !xfer->tx_buf || xfer->rx_buf)
+		return false;
+	if (xfer->len < SPI_BAM_MIN_LEN || xfer->len % 4 || (addr_t)xfer->tx_buf % 4)
+		return false;
+
+	/* The BAM provides 32-bit words that the QUP unpacks into SPI words */
+	return dev->bytes_per_word == 1 || dev->bytes_per_word == 2 ||
+	       dev->bytes_per_word == 4;
+}
+
+/*
+ * Not bam_wait_for_interrupt(), which would wait forever if the pipe
+ * is not usable (e.g. because it is assigned to another EE).
+ */
+static int spi_qup_bam_wait(struct qup_spi_dev *dev)
+{
+	uint8_t pipe_num = spi_bam.pipe[SPI_BAM_TX_PIPE_INDEX].pipe_num;
+	time_t start = current_time();
+	uint32_t val;
+
+	do {
+		val = readl(BAM_P_IRQ_STTSn(pipe_num, spi_bam.base));
+		if (val & P_ERR_EN_MASK)
+			return -EIO;
+		if (val & P_PRCSD_DESC_EN_MASK)
+			break;
+	} while (current_time() - start < SPI_BAM_TIMEOUT_MS);
+
+	writel(P_OUT_OF_DESC_EN_MASK | P_PRCSD_DESC_EN_MASK | P_TRNSFR_END_EN_MASK,
+	       BAM_P_IRQ_CLRn(pipe_num, spi_bam.base));
+	if (!(val & P_PRCSD_DESC_EN_MASK))
+		return -ETIMEDOUT;
+
+	/* The QUP might still be shifting out the last words */
+	while (!(readl(dev->qup_base + QUP_OPERATIONAL) & QUP_OP_MAX_OUTPUT_DONE_FLAG)) {
+		if (current_time() - start >= SPI_BAM_TIMEOUT_MS)
+			return -ETIMEDOUT;
+	}
+
+	return 0;
+}
+
+static int spi_qup_bam_write(struct qup_spi_dev *dev, struct spi_transfer *xfer)
+{
+	unsigned int config, iomode;
+	int ret;
+
+	qup_register_init(dev);
+	spi_register_init(dev);
+
+	writel(xfer->len / dev->bytes_per_word, dev->qup_base + QUP_MX_OUTPUT_CNT);
+	writel(0, dev->qup_base + QUP_MX_INPUT_CNT);
+	writel(0, dev->qup_base + QUP_MX_READ_CNT);
+	writel(0, dev->qup_base + QUP_MX_WRITE_CNT);
+
+	iomode = readl_relaxed(dev->qup_base + QUP_IO_MODES);
+	iomode &= ~(INPUT_MODE_MASK | OUTPUT_MODE_MASK);
+	iomode |= (QUP_IO_MODES_BAM << OUTPUT_MODE_SHIFT);
+	iomode |= (QUP_IO_MODES_BAM << INPUT_MODE_SHIFT);
+	iomode |= QUP_IO_MODES_PACK_EN | QUP_IO_MODES_UNPACK_EN;
+	if(dev->bit_shift_en)
+		iomode |= QUP_IO_MODES_OUTPUT_BIT_SHIFT_EN;
+	else
+		iomode &= ~QUP_IO_MODES_OUTPUT_BIT_SHIFT_EN;
+	writel(iomode, dev->qup_base + QUP_IO_MODES);
+
+	config = readl_relaxed(dev->qup_base + QUP_CONFIG);
+	config |= QUP_CONFIG_NO_INPUT | QUP_CONFIG_SPI_MODE;
+	config |= dev->bytes_per_word * 8 - 1;
+	writel(config, dev->qup_base + QUP_CONFIG);
+
+	/* The service flags are handled by the BAM */
+	writel(QUP_OP_IN_SERVICE_FLAG | QUP_OP_OUT_SERVICE_FLAG,
+	       dev->qup_base + QUP_OPERATIONAL_MASK);
+
+	ret = qup_set_state(dev, QUP_RUN_STATE);
+	if (ret) {
+		dprintf(CRITICAL, "%s: cannot set RUN state\n", __func__);
+		goto exit;
+	}
+
+	bam_add_one_desc(&spi_bam, SPI_BAM_TX_PIPE_INDEX,
+			 (unsigned char *)PA((addr_t)xfer->tx_buf), xfer->len,
+			 BAM_DESC_INT_FLAG | BAM_DESC_EOT_FLAG);
+	bam_sys_gen_event(&spi_bam, SPI_BAM_TX_PIPE_INDEX, 1);
+
+	ret = spi_qup_bam_wait(dev);
+	if (ret) {
+		dprintf(CRITICAL, "%s: BAM transfer failed (%d), using PIO\n",
+			__func__, ret);
+		dev->use_bam = 0;
+		goto exit;
+	}
+	dev->tx_bytes = xfer->len;
+
+exit:
+	qup_set_state(dev, QUP_RESET_STATE);
+	return ret;
+}
+#endif
+
 static int _spi_qup_transfer(struct qup_spi_dev *dev, struct spi_transfer *xfer)
 {
 	int ret = -EIO;
@@ -362,6 +506,14 @@ static int _spi_qup_transfer(struct qup_spi_dev *dev, struct spi_transfer *xfer)
 		return ret;
 	}
 
+#ifdef BLSP_BAM_BASE
+	if (spi_qup_bam_usable(dev, xfer)) {
+		ret = spi_qup_bam_write(dev, xfer);
+		dev->xfer = NULL;
+		return ret;
+	}
+#endif
+
 	spi_qup_io_config_block(dev, xfer->len);
 	ret = qup_set_state(dev, QUP_RUN_STATE);
 	if (ret) {
@@ -575,6 +727,10 @@ struct qup_spi_dev *qup_blsp_spi_init(uint8_t blsp_id, uint8_t qup_id)
 
 	qup_spi_sec_init(dev);
 
+#ifdef BLSP_BAM_BASE
+	spi_qup_bam_init(dev);
+#endif
+
 	return dev;
 }
 
@@ -359,15 +359,96 @@ void pmic_spmi_reg_write(uint32_t addr, uint8_t val)
 	pmic_arb_write_cmd(&cmd, &param);
 }
 
+/* Read/write consecutive registers using as few arbiter commands as possible.
+ * A single command can transfer up to 8 bytes, but it must stay within
+ * the same peripheral since only the register offset is incremented.
+ */
+#define PMIC_ARB_MAX_BURST 8
+
+static uint8_t pmic_spmi_burst_len(uint32_t addr, size_t len)
+{
+	size_t max = 0x100 - SPMI_REG_OFFSET(addr);
+
+	if (max > PMIC_ARB_MAX_BURST)
+		max = PMIC_ARB_MAX_BURST;
+	return len < max ? len : max;
+}
+
+unsigned int pmic_spmi_reg_read_burst(uint32_t addr, uint8_t *buf, size_t len)
+{
+	struct pmic_arb_cmd cmd;
+	struct pmic_arb_param param;
+	unsigned int error;
+
+	while (len)
+	{
+		cmd.address  = SPMI_PERIPH_ID(addr);
+		cmd.offset   = SPMI_REG_OFFSET(addr);
+		cmd.slave_id = SPMI_SLAVE_ID(addr);
+		cmd.priority = 0;
+
+		param.buffer = buf;
+		param.size   = pmic_spmi_burst_len(addr, len);
+
+		error = pmic_arb_read_cmd(&cmd, &param);
+		if (error)
+			return error;
+
+		addr += param.size;
+		buf  += param.size;
+		len  -= param.size;
+	}
+
+	return 0;
+}
+
+unsigned int pmic_spmi_reg_write_burst(uint32_t addr, uint8_t *buf, size_t len)
+{
+	struct pmic_arb_cmd cmd;
+	struct pmic_arb_param param;
+	unsigned int error;
+
+	while (len)
+	{
+		cmd.address  = SPMI_PERIPH_ID(addr);
+		cmd.offset   = SPMI_REG_OFFSET(addr);
+		cmd.slave_id = SPMI_SLAVE_ID(addr);
+		cmd.priority = 0;
+
+		param.buffer = buf;
+		param.size   = pmic_spmi_burst_len(addr, len);
+
+		error = pmic_arb_write_cmd(&cmd, &param);
+		if (error)
+			return error;
+
+		addr += param.size;
+		buf  += param.size;
+		len  -= param.size;
+	}
+
+	return 0;
+}
+
 void pmic_spmi_reg_mask_write(uint32_t addr, uint8_t mask, uint8_t val)
 {
-	uint8_t reg;
+	uint8_t old, reg;
 
-	reg = pmic_spmi_reg_read(addr);
+	/* No need to read the register if all bits are replaced */
+	if (mask == 0xFF)
+	{
+		pmic_spmi_reg_write(addr, val);
+		return;
+	}
 
-	reg &= ~mask;
+	old = pmic_spmi_reg_read(addr);
+
+	reg = old & ~mask;
 	reg |= val & mask;
-	pmic_spmi_reg_write(addr, reg);
+
+	/* Avoid another command if the register already has the value */
+	if (reg != old)
+		pmic_spmi_reg_write(addr, reg);
 }
 
 void spmi_uninit(void)
@@ -30,6 +30,7 @@
 #include <stdlib.h>
 #include <debug.h>
 #include <kernel/thread.h>
+#include <kernel/timer.h>
 #include <reg.h>
 #include <sys/types.h>
 #include <platform/iomap.h>
@@ -55,6 +56,8 @@ static int uart_init_flag = 0;
  *   multi-threaded support is required, a simple data-structure can
  *   be maintained for each thread.
  * - Right now we are using polling method than interrupt based.
+ *   With UART_DM_ASYNC_TX the TX path is drained from a timer instead,
+ *   see below.
  * - We are using legacy UART protocol without Data Mover.
  * - Not all interrupts and error events are handled.
  * - While waiting Watchdog hasn't been taken into consideration.
@@ -374,6 +377,140 @@ msm_boot_uart_dm_write(uint32_t base, char *data, unsigned int num_of_chars)
 	return MSM_BOOT_UART_DM_E_SUCCESS;
 }
 
+#if UART_DM_ASYNC_TX
+/*
+ * Asynchronous TX: uart_putc() only adds the characters to a ring buffer,
+ * which is moved into the TX FIFO on every timer tick without waiting for
+ * the UART. The caller is only blocked if the ring buffer is full.
+ * The timer can only be used once interrupts are enabled. Before that, and
+ * after uart_flush_tx() all output is written synchronously.
+ */
+#ifndef UART_DM_TX_RING_SIZE
+#define UART_DM_TX_RING_SIZE          4096 /* power of 2 */
+#endif
+/* Characters programmed for one TX transfer */
+#define UART_DM_TX_CHUNK              256
+
+static struct {
+	char buf[UART_DM_TX_RING_SIZE];
+	unsigned int head, tail;
+	/* Characters of the current transfer that are not in the FIFO yet */
+	unsigned int pending;
+	uint32_t base;
+	timer_t timer;
+	bool started, stopped;
+} tx_ring;
+
+/*
+ * Move characters from the ring buffer to the TX FIFO until at least
+ * min_free bytes are free in the ring buffer. Must be called with
+ * interrupts disabled.
+ */
+static void msm_boot_uart_dm_tx_drain(unsigned int min_free)
+{
+	uint32_t base = tx_ring.base;
+	unsigned int n, i;
+	uint32_t word;
+
+	while (UART_DM_TX_RING_SIZE - (tx_ring.head - tx_ring.tail) < min_free ||
+	       (min_free == 0 && tx_ring.head != tx_ring.tail)) {
+		if (!tx_ring.pending) {
+			/* Wait until the previous transfer is in the FIFO */
+			if (!(readl(MSM_BOOT_UART_DM_SR(base)) & MSM_BOOT_UART_DM_SR_TXEMT) &&
+			    !(readl(MSM_BOOT_UART_DM_ISR(base)) & MSM_BOOT_UART_DM_TX_READY)) {
+				if (!min_free)
+					return;
+				udelay(1);
+				continue;
+			}
+
+			n = MIN(tx_ring.head - tx_ring.tail, UART_DM_TX_CHUNK);
+			writel(n, MSM_BOOT_UART_DM_NO_CHARS_FOR_TX(base));
+			writel(MSM_BOOT_UART_DM_GCMD_RES_TX_RDY_INT, MSM_BOOT_UART_DM_CR(base));
+			tx_ring.pending = n;
+		}
+
+		while (tx_ring.pending) {
+			if (!(readl(MSM_BOOT_UART_DM_SR(base)) & MSM_BOOT_UART_DM_SR_TXRDY)) {
+				if (!min_free)
+					return;
+				udelay(1);
+				continue;
+			}
+
+			n = MIN(tx_ring.pending, 4U);
+			word = 0;
+			for (i = 0; i < n; i++, tx_ring.tail++)
+				word |= (uint8_t)tx_ring.buf[tx_ring.tail % UART_DM_TX_RING_SIZE] << (i * 8);
+			writel(word, MSM_BOOT_UART_DM_TF(base, 0));
+			tx_ring.pending -= n;
+		}
+	}
+}
+
+static enum handler_return msm_boot_uart_dm_tx_timer(struct timer *timer, time_t now, void *arg)
+{
+	msm_boot_uart_dm_tx_drain(0);
+	return INT_NO_RESCHEDULE;
+}
+
+static void msm_boot_uart_dm_tx_push(char c)
+{
+	if (tx_ring.head - tx_ring.tail == UART_DM_TX_RING_SIZE)
+		msm_boot_uart_dm_tx_drain(UART_DM_TX_CHUNK);
+
+	tx_ring.buf[tx_ring.head++ % UART_DM_TX_RING_SIZE] = c;
+}
+
+/*
+ * Queue a character for asynchronous TX.
+ * Returns false if it must be written synchronously instead.
+ */
+static bool msm_boot_uart_dm_tx_queue(uint32_t base, char c)
+{
+	if (tx_ring.stopped)
+		return false;
+
+	if (!tx_ring.started) {
+		if (in_critical_section())
+			return false;
+
+		tx_ring.base = base;
+		tx_ring.started = true;
+		timer_initialize(&tx_ring.timer);
+		timer_set_periodic(&tx_ring.timer, 1, msm_boot_uart_dm_tx_timer, NULL);
+	}
+
+	enter_critical_section();
+	if (c == '\n')
+		msm_boot_uart_dm_tx_push('\r');
+	msm_boot_uart_dm_tx_push(c);
+	exit_critical_section();
+
+	return true;
+}
+
+/*
+ * Write out everything that is still queued and switch back to synchronous
+ * TX, e.g. before booting the kernel or on panic. Does not depend on
+ * interrupts or timers.
+ */
+void uart_flush_tx(int port)
+{
+	enter_critical_section();
+
+	if (tx_ring.started && !tx_ring.stopped) {
+		timer_cancel(&tx_ring.timer);
+		msm_boot_uart_dm_tx_drain(UART_DM_TX_RING_SIZE);
+		while (!(readl(MSM_BOOT_UART_DM_SR(tx_ring.base)) & MSM_BOOT_UART_DM_SR_TXEMT))
+			udelay(1);
+	}
+	tx_ring.stopped = true;
+
+	exit_critical_section();
+}
+#endif /* UART_DM_ASYNC_TX */
+
 /* Defining functions that's exposed to outside world and in coformance to
  * existing uart implemention. These functions are being called to initialize
  * UART and print debug messages in bootloader.
@@ -433,6 +570,11 @@ int uart_putc(int port, char c)
 	if (!uart_init_flag)
 		return -1;
 
+#if UART_DM_ASYNC_TX
+	if (port == 0 && msm_boot_uart_dm_tx_queue(uart_base, c))
+		return 0;
+#endif
+
 	msm_boot_uart_dm_write(uart_base, &c, 1);
 
 	return 0;
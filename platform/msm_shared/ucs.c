@@ -33,56 +33,67 @@
 #include <utp.h>
 #include <rpmb.h>
 
-int ucs_do_scsi_cmd(struct ufs_dev *dev, struct scsi_req_build_type *req)
+static void ucs_fill_scsi_upiu(struct scsi_req_build_type *req, struct upiu_req_build_type *req_upiu,
+							   struct upiu_basic_resp_hdr *resp_upiu)
 {
-	struct upiu_req_build_type req_upiu;
-	struct upiu_basic_resp_hdr      resp_upiu;
-
-	memset(&req_upiu, 0 , sizeof(struct upiu_req_build_type));
-
-	req_upiu.cmd_set_type	   = UPIU_SCSI_CMD_SET;
-	req_upiu.trans_type	       = UPIU_TYPE_COMMAND;
-	req_upiu.data_buffer_addr  = req->data_buffer_addr;
-	req_upiu.expected_data_len = req->data_len;
-	req_upiu.data_seg_len	   = 0;
-	req_upiu.ehs_len		   = 0;
-	req_upiu.flags			   = req->flags;
-	req_upiu.lun			   = req->lun;
-	req_upiu.query_mgmt_func   = 0;
-	req_upiu.cdb			   = req->cdb;
-	req_upiu.cmd_type		   = UTRD_SCSCI_CMD;
-	req_upiu.dd			       = req->dd;
-	req_upiu.resp_ptr		   = &resp_upiu;
-	req_upiu.resp_len		   = sizeof(resp_upiu);
-	req_upiu.timeout_msecs	   = UTP_GENERIC_CMD_TIMEOUT;
-
-	if (utp_enqueue_upiu(dev, &req_upiu))
-	{
-		dprintf(CRITICAL, "ucs_do_scsi_cmd: enqueue failed\n");
-		return -UFS_FAILURE;
-	}
+	memset(req_upiu, 0 , sizeof(struct upiu_req_build_type));
+
+	req_upiu->cmd_set_type	    = UPIU_SCSI_CMD_SET;
+	req_upiu->trans_type	    = UPIU_TYPE_COMMAND;
+	req_upiu->data_buffer_addr  = req->data_buffer_addr;
+	req_upiu->expected_data_len = req->data_len;
+	req_upiu->data_seg_len	    = 0;
+	req_upiu->ehs_len		    = 0;
+	req_upiu->flags			    = req->flags;
+	req_upiu->lun			    = req->lun;
+	req_upiu->query_mgmt_func   = 0;
+	req_upiu->cdb			    = req->cdb;
+	req_upiu->cmd_type		    = UTRD_SCSCI_CMD;
+	req_upiu->dd			    = req->dd;
+	req_upiu->resp_ptr		    = resp_upiu;
+	req_upiu->resp_len		    = sizeof(*resp_upiu);
+	req_upiu->timeout_msecs	    = UTP_GENERIC_CMD_TIMEOUT;
+}
 
-	if (resp_upiu.status != SCSI_STATUS_GOOD)
+static int ucs_check_scsi_resp(struct scsi_req_build_type *req, struct upiu_basic_resp_hdr *resp_upiu)
+{
+	if (resp_upiu->status != SCSI_STATUS_GOOD)
 	{
-		if (resp_upiu.status == SCSI_STATUS_CHK_COND && (*((uint8_t *)(req->cdb)) != SCSI_CMD_SENSE_REQ))
+		if (resp_upiu->status == SCSI_STATUS_CHK_COND && (*((uint8_t *)(req->cdb)) != SCSI_CMD_SENSE_REQ))
 		{
-			dprintf(CRITICAL, "Data segment length: %x\n", BE16(resp_upiu.data_seg_len));
-			if (BE16(resp_upiu.data_seg_len))
+			dprintf(CRITICAL, "Data segment length: %x\n", BE16(resp_upiu->data_seg_len));
+			if (BE16(resp_upiu->data_seg_len))
 			{
 				dprintf(CRITICAL, "SCSI Request failed and we have sense data\n");
-				dprintf(CRITICAL, "Sense Data Length/Response Code: 0x%x/0x%x\n", BE16(resp_upiu.sense_length), BE16(resp_upiu.sense_response_code));
-				parse_sense_key(resp_upiu.sense_data[0]);
-				dprintf(CRITICAL, "Sense Buffer (HEX): 0x%x 0x%x 0x%x 0x%x\n", BE32(resp_upiu.sense_data[0]), BE32(resp_upiu.sense_data[1]), BE32(resp_upiu.sense_data[2]), BE32(resp_upiu.sense_data[3]));
+				dprintf(CRITICAL, "Sense Data Length/Response Code: 0x%x/0x%x\n", BE16(resp_upiu->sense_length), BE16(resp_upiu->sense_response_code));
+				parse_sense_key(resp_upiu->sense_data[0]);
+				dprintf(CRITICAL, "Sense Buffer (HEX): 0x%x 0x%x 0x%x 0x%x\n", BE32(resp_upiu->sense_data[0]), BE32(resp_upiu->sense_data[1]), BE32(resp_upiu->sense_data[2]), BE32(resp_upiu->sense_data[3]));
 			}
 		}
 
-		dprintf(CRITICAL, "ucs_do_scsi_cmd failed status = %x\n", resp_upiu.status);
+		dprintf(CRITICAL, "ucs_do_scsi_cmd failed status = %x\n", resp_upiu->status);
 		return -UFS_FAILURE;
 	}
 
 	return UFS_SUCCESS;
 }
 
+int ucs_do_scsi_cmd(struct ufs_dev *dev, struct scsi_req_build_type *req)
+{
+	struct upiu_req_build_type req_upiu;
+	struct upiu_basic_resp_hdr      resp_upiu;
+
+	ucs_fill_scsi_upiu(req, &req_upiu, &resp_upiu);
+
+	if (utp_enqueue_upiu(dev, &req_upiu))
+	{
+		dprintf(CRITICAL, "ucs_do_scsi_cmd: enqueue failed\n");
+		return -UFS_FAILURE;
+	}
+
+	return ucs_check_scsi_resp(req, &resp_upiu);
+}
+
 int parse_sense_key(uint32_t sense_data)
 {
 	uint32_t key = BE32(sense_data) >> 24;
@@ -298,6 +309,77 @@ int ucs_do_scsi_read(struct ufs_dev *dev, struct scsi_rdwr_req *req)
 	return UFS_SUCCESS;
 }
 
+/*
+ * Function: ucs do scsi read batch
+ * Arg     : ufs device, read requests, number of requests & status per request
+ * Return  : 0 on Success, non zero if any request failed
+ * Flow    : Issue one READ10 per request, all of them at once, so the device
+ *           can process them in parallel. Each request must fit into a single
+ *           command (SCSI_MAX_DATA_TRANS_BLK_LEN blocks).
+ */
+int ucs_do_scsi_read_batch(struct ufs_dev *dev, struct scsi_rdwr_req *req, uint32_t count, int *status)
+{
+	STACKBUF_DMA_ALIGN(cdb, UTP_MAX_BATCH_REQS * CACHE_LINE);
+	struct scsi_req_build_type     scsi_req[UTP_MAX_BATCH_REQS];
+	struct upiu_req_build_type     req_upiu[UTP_MAX_BATCH_REQS];
+	struct upiu_basic_resp_hdr     resp_upiu[UTP_MAX_BATCH_REQS];
+	struct scsi_rdwr_cdb           *cdb_param;
+	uint32_t                       i;
+	int                            ret;
+
+	if (count > UTP_MAX_BATCH_REQS)
+		return -UFS_FAILURE;
+
+	for (i = 0; i < count; i++)
+	{
+		status[i] = -UFS_FAILURE;
+		if (!req[i].num_blocks || req[i].num_blocks > SCSI_MAX_DATA_TRANS_BLK_LEN)
+			return -UFS_FAILURE;
+	}
+
+	for (i = 0; i < count; i++)
+	{
+		/* Each cdb is in its own cache line. */
+		cdb_param = (struct scsi_rdwr_cdb*) (cdb + i * CACHE_LINE);
+
+		memset(cdb_param, 0, sizeof(struct scsi_rdwr_cdb));
+		cdb_param->opcode    = SCSI_CMD_READ10;
+		cdb_param->cdb1      = SCSI_READ_WRITE_10_CDB1(0, 0, 1, 0);
+		cdb_param->lba       = BE32(req[i].start_lba);
+		cdb_param->trans_len = BE16(req[i].num_blocks);
+
+		memset(&scsi_req[i], 0 , sizeof(struct scsi_req_build_type));
+
+		scsi_req[i].cdb              = (addr_t) cdb_param;
+		scsi_req[i].data_buffer_addr = req[i].data_buffer_base;
+		scsi_req[i].data_len         = req[i].num_blocks * UFS_DEFAULT_SECTORE_SIZE;
+		scsi_req[i].flags            = UPIU_FLAGS_READ;
+		scsi_req[i].lun              = req[i].lun;
+		scsi_req[i].dd               = UTRD_TARGET_TO_SYSTEM;
+
+		ucs_fill_scsi_upiu(&scsi_req[i], &req_upiu[i], &resp_upiu[i]);
+	}
+
+	dsb();
+	arch_clean_invalidate_cache_range((addr_t) cdb, count * CACHE_LINE);
+
+	ret = utp_enqueue_upiu_batch(dev, req_upiu, count, status);
+
+	for (i = 0; i < count; i++)
+	{
+		if (!status[i])
+			status[i] = ucs_check_scsi_resp(&scsi_req[i], &resp_upiu[i]);
+
+		if (status[i])
+		{
+			dprintf(CRITICAL, "ucs_do_scsi_read_batch: lun %u block %u failed\n", req[i].lun, req[i].start_lba);
+			ret = -UFS_FAILURE;
+		}
+	}
+
+	return ret;
+}
+
 int ucs_do_scsi_write(struct ufs_dev *dev, struct scsi_rdwr_req *req)
 {
 	struct scsi_req_build_type     req_upiu;
@@ -39,11 +39,14 @@
 #include <platform/iomap.h>
 #include <platform/irqs.h>
 #include <kernel/mutex.h>
+#include <arch/ops.h>
+#include <stdlib.h>
 
 static int ufs_dev_init(struct ufs_dev *dev)
 {
 	/* Init the mutexes. */
 	mutex_init(&(dev->uic_data.uic_mutex));
+	event_init(&(dev->uic_data.pwr_event), false, 0);
 	mutex_init(&(dev->utrd_data.bitmap_mutex));
 	mutex_init(&(dev->utmrd_data.bitmap_mutex));
 
@@ -83,7 +86,7 @@ static void ufs_setup_req_lists(struct ufs_dev *dev)
 	writel(1, UFS_UTRLRSR(dev->base));
 
 	/* Enable the required irqs. */
-	val = UFS_IE_UEE | UFS_IE_UCCE ;
+	val = UFS_IE_UEE | UFS_IE_UCCE | UFS_IE_UPMSE;
 	ufs_irq_enable(dev, val);
 	// Change UFS_IRQ to level based
 	qgic_change_interrupt_cfg(UFS_IRQ, INTERRUPT_LVL_N_TO_N);
@@ -141,6 +144,55 @@ int ufs_read(struct ufs_dev* dev, uint64_t start_lba, addr_t buffer, uint32_t nu
 	return ret;
 }
 
+/*
+ * Function: ufs read queued
+ * Arg     : ufs device, read tasks & number of tasks
+ * Return  : 0 on Success, non zero if any task failed
+ * Flow    : Submit up to UTP_MAX_BATCH_REQS tasks at once, each in its own
+ *           transfer request slot. Unlike ufs_read(), every task selects its
+ *           own LUN, so the current LUN of the device is not changed.
+ */
+int ufs_read_queued(struct ufs_dev *dev, struct ufs_read_task *tasks, uint32_t count)
+{
+	struct scsi_rdwr_req req[UTP_MAX_BATCH_REQS];
+	int                  status[UTP_MAX_BATCH_REQS];
+	uint32_t             i, n;
+	int                  ret = UFS_SUCCESS;
+
+	while (count)
+	{
+		n = MIN(count, UTP_MAX_BATCH_REQS);
+
+		for (i = 0; i < n; i++)
+		{
+			req[i].data_buffer_base = (addr_t) tasks[i].dest;
+			req[i].lun              = tasks[i].lun;
+			req[i].num_blocks       = tasks[i].num_blocks;
+			req[i].start_lba        = tasks[i].blk_addr;
+			arch_clean_invalidate_cache_range((addr_t) tasks[i].dest, tasks[i].num_blocks * dev->block_size);
+		}
+
+		if (ucs_do_scsi_read_batch(dev, req, n, status))
+		{
+			dprintf(CRITICAL, "UFS queued read failed.\n");
+			ret = -UFS_FAILURE;
+		}
+
+		for (i = 0; i < n; i++)
+		{
+			/* Drop lines that were fetched speculatively during the transfer. */
+			if (!status[i])
+				arch_invalidate_cache_range((addr_t) tasks[i].dest, tasks[i].num_blocks * dev->block_size);
+			tasks[i].ret = status[i];
+		}
+
+		tasks += n;
+		count -= n;
+	}
+
+	return ret;
+}
+
 int ufs_write(struct ufs_dev* dev, uint64_t start_lba, addr_t buffer, uint32_t num_blocks)
 {
 	struct scsi_rdwr_req req;
@@ -278,6 +330,12 @@ int ufs_init(struct ufs_dev *dev)
 		goto ufs_init_err;
 	}
 
+#if UFS_HS_GEAR_SWITCH
+	/* Keep going in the power mode left by the previous bootloader on failure */
+	if (uic_set_hs_gear(dev) != UFS_SUCCESS)
+		dprintf(CRITICAL, "UFS uic_set_hs_gear failed\n");
+#endif
+
 
 	for(lun=0; lun < dev->num_lus; lun++)
 	{
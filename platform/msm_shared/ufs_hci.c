@@ -156,6 +156,17 @@ enum handler_return ufs_irq_handler(void* data)
 			irq.irq_handled = UFS_IS_UCCS;
 			continue;
 		}
+		else if (val & UFS_IS_UPMS)
+		{
+			/* UIC power mode change. */
+			dev->uic_data.pwr_status = UFS_HCS_UPMCRS(readl(UFS_HCS(dev->base)));
+			event_signal(&(dev->uic_data.pwr_event), false);
+			/* Clear irq. */
+			writel(UFS_IS_UPMS, UFS_IS(dev->base));
+			val        &= ~UFS_IS_UPMS;
+			irq.irq_handled = UFS_IS_UPMS;
+			continue;
+		}
 		else if (val & UFS_IS_UTRCS)
 		{
 			/* UTRD completion. */
@@ -38,6 +38,7 @@
 #include <platform/interrupts.h>
 #include <platform/clock.h>
 #include <platform/timer.h>
+#include <stdlib.h>
 
 static int uic_check_hci_ucrdy(struct ufs_dev *dev)
 {
@@ -176,3 +177,118 @@ int uic_init(struct ufs_dev *dev)
 	return UFS_SUCCESS;
 }
 
+
+#if UFS_HS_GEAR_SWITCH
+/* Number of TX symbol clock cycles in 1 us for HS-G1..3, rate A and rate B. */
+static const uint32_t uic_tx_symbol_clk_1us[2][UFS_HS_GEAR_MAX] = {
+	{ 0x1F, 0x3E, 0x7D },
+	{ 0x24, 0x49, 0x92 },
+};
+
+static int uic_get_attr(struct ufs_dev *dev, uint16_t attribute, bool peer, uint32_t *val)
+{
+	struct dme_get_req_type req = { attribute, 0, val };
+
+	return peer ? dme_peer_get_req(dev, &req) : dme_get_req(dev, &req);
+}
+
+static int uic_pwr_mode_change(struct ufs_dev *dev, uint32_t gear, uint32_t rx_lanes,
+			       uint32_t tx_lanes, uint32_t series)
+{
+	if (dme_set_req(dev, PA_RX_GEAR, gear) ||
+	    dme_set_req(dev, PA_ACTIVE_RX_DATA_LANES, rx_lanes) ||
+	    dme_set_req(dev, PA_RX_TERMINATION, 1) ||
+	    dme_set_req(dev, PA_TX_GEAR, gear) ||
+	    dme_set_req(dev, PA_ACTIVE_TX_DATA_LANES, tx_lanes) ||
+	    dme_set_req(dev, PA_TX_TERMINATION, 1) ||
+	    dme_set_req(dev, PA_HS_SERIES, series))
+		return -UFS_FAILURE;
+
+	/* Data link layer timeouts for the peer (user data) and the local side. */
+	if (dme_set_req(dev, PA_PWR_MODE_USER_DATA(0), DL_FC_PROTECTION_TIMEOUT_VAL) ||
+	    dme_set_req(dev, PA_PWR_MODE_USER_DATA(1), DL_TC_REPLAY_TIMEOUT_VAL) ||
+	    dme_set_req(dev, PA_PWR_MODE_USER_DATA(2), DL_AFC_REQ_TIMEOUT_VAL) ||
+	    dme_set_req(dev, PA_PWR_MODE_USER_DATA(3), DL_FC_PROTECTION_TIMEOUT_VAL) ||
+	    dme_set_req(dev, PA_PWR_MODE_USER_DATA(4), DL_TC_REPLAY_TIMEOUT_VAL) ||
+	    dme_set_req(dev, PA_PWR_MODE_USER_DATA(5), DL_AFC_REQ_TIMEOUT_VAL) ||
+	    dme_set_req(dev, DME_LOCAL_FC0_PROTECTION_TIMEOUT, DL_FC_PROTECTION_TIMEOUT_VAL) ||
+	    dme_set_req(dev, DME_LOCAL_TC0_REPLAY_TIMEOUT, DL_TC_REPLAY_TIMEOUT_VAL) ||
+	    dme_set_req(dev, DME_LOCAL_AFC0_REQ_TIMEOUT, DL_AFC_REQ_TIMEOUT_VAL))
+		return -UFS_FAILURE;
+
+	/* Writing PA_PWRMode starts the power mode change, completion is signaled by UPMS. */
+	event_init(&(dev->uic_data.pwr_event), false, 0);
+	if (dme_set_req(dev, PA_PWR_MODE, PA_FAST_MODE << 4 | PA_FAST_MODE))
+		return -UFS_FAILURE;
+
+	if (event_wait_timeout(&(dev->uic_data.pwr_event), UIC_PWR_MODE_TIMEOUT))
+	{
+		dprintf(CRITICAL, "UFS power mode change to HS-G%u timed out.\n", gear);
+		return -UFS_FAILURE;
+	}
+
+	if (dev->uic_data.pwr_status != UFS_UPMCRS_PWR_LOCAL)
+	{
+		dprintf(CRITICAL, "UFS power mode change to HS-G%u failed: %u\n", gear,
+				dev->uic_data.pwr_status);
+		return -UFS_FAILURE;
+	}
+
+	return UFS_SUCCESS;
+}
+
+/*
+ * Switch the link to the fastest HS gear supported by both the host and the
+ * device, using all connected lanes. The HS series (rate A/B) selected by the
+ * previous bootloader is kept since the PHY was calibrated for it. Lower gears
+ * are tried if the switch fails, the link stays in its previous power mode if
+ * none of them works.
+ */
+int uic_set_hs_gear(struct ufs_dev *dev)
+{
+	uint32_t max_rx_gear, max_tx_gear, rx_lanes, tx_lanes, active_lanes;
+	uint32_t pwr_mode, cur_gear, series, max_gear, gear, val;
+
+	if (uic_get_attr(dev, PA_MAX_RX_HS_GEAR, false, &max_rx_gear) ||
+	    uic_get_attr(dev, PA_MAX_RX_HS_GEAR, true, &max_tx_gear) ||
+	    uic_get_attr(dev, PA_CONNECTED_RX_DATA_LANES, false, &rx_lanes) ||
+	    uic_get_attr(dev, PA_CONNECTED_TX_DATA_LANES, false, &tx_lanes) ||
+	    uic_get_attr(dev, PA_ACTIVE_RX_DATA_LANES, false, &active_lanes) ||
+	    uic_get_attr(dev, PA_PWR_MODE, false, &pwr_mode) ||
+	    uic_get_attr(dev, PA_RX_GEAR, false, &cur_gear) ||
+	    uic_get_attr(dev, PA_HS_SERIES, false, &series))
+		return -UFS_FAILURE;
+
+	/* Controllers before major version 2 only support up to HS-G2. */
+	max_gear = UFS_HW_VERSION_MAJOR(readl(UFS_HW_VERSION(dev->base))) >= 2 ? 3 : 2;
+	max_gear = MIN(max_gear, MIN(max_rx_gear, max_tx_gear));
+	if (!max_gear || !rx_lanes || !tx_lanes)
+		return -UFS_FAILURE;
+
+	if (series != PA_HS_SERIES_B)
+		series = PA_HS_SERIES_A;
+
+	if ((pwr_mode & 0xF) == PA_FAST_MODE && cur_gear >= max_gear && active_lanes == rx_lanes)
+	{
+		dprintf(INFO, "UFS link already in HS-G%u\n", cur_gear);
+		return UFS_SUCCESS;
+	}
+
+	for (gear = max_gear; gear > 0; gear--)
+	{
+		if (uic_pwr_mode_change(dev, gear, rx_lanes, tx_lanes, series))
+			continue;
+
+		/* The TX symbol clock depends on the gear and the rate. */
+		val = readl(UFS_TX_SYMBOL_CLK_NS_US(dev->base)) & ~UFS_TX_SYMBOL_CLK_1US_MASK;
+		val |= uic_tx_symbol_clk_1us[series - 1][gear - 1];
+		writel(val, UFS_TX_SYMBOL_CLK_NS_US(dev->base));
+
+		dprintf(INFO, "UFS link switched to HS-G%u rate %c, %u RX / %u TX lanes\n",
+				gear, series == PA_HS_SERIES_B ? 'B' : 'A', rx_lanes, tx_lanes);
+		return UFS_SUCCESS;
+	}
+
+	return -UFS_FAILURE;
+}
+#endif
@@ -39,6 +39,7 @@
 #include <stdlib.h>
 #include <arch/defines.h>
 #include <dev/udc.h>
+#include <kernel/ktrace.h>
 #include <platform/iomap.h>
 #include <usb30_dwc.h>
 #include <usb30_wrapper.h>
@@ -860,6 +861,8 @@ void udc_request_complete(void *context, uint32_t actual, int status)
 	/* clear the queued request. */
 	((udc_t *) context)->queued_req = NULL;
 
+	ktrace(KTRACE_USB_DONE, (uintptr_t)req, actual, status);
+
 	if (req->complete)
 	{
 		req->complete(req, actual, status);
@@ -445,15 +445,13 @@ static void utp_fill_prdt_entries(struct upiu_req_build_type *upiu_data, struct
 
 }
 
-int utp_enqueue_upiu(struct ufs_dev *dev, struct upiu_req_build_type *upiu_data)
+static int utp_prepare_upiu(struct ufs_dev *dev, struct upiu_req_build_type *upiu_data,
+							struct utp_utrd_req_build_type *utrd, uint32_t *cmd_desc_len)
 {
 	struct upiu_gen_hdr            *req_upiu;
-	struct utp_utrd_req_build_type utrd;
 	uint32_t                       num_prdt;
 	struct utp_prdt_entry          *prdt_entry;
-	int                            ret = UFS_SUCCESS;
 	uint32_t                       resp_len;
-	uint32_t                       cmd_desc_len;
 	struct utrd_cmd_desc           cmd_desc;
 
 	/* Round up resp_upiu_len to a DWORD boundary.
@@ -465,10 +463,10 @@ int utp_enqueue_upiu(struct ufs_dev *dev, struct upiu_req_build_type *upiu_data)
 		return -UFS_FAILURE;
 
 	/* Calculate the length. */
-	cmd_desc_len = UPIU_HDR_LEN + resp_len + num_prdt * sizeof(struct utp_prdt_entry);
+	*cmd_desc_len = UPIU_HDR_LEN + resp_len + num_prdt * sizeof(struct utp_prdt_entry);
 
 	/* Allocate memory for UTP Command Descriptor. */
-	req_upiu = (struct upiu_gen_hdr*) memalign((size_t ) lcm(CACHE_LINE, UTP_CMD_DESC_BASE_ALIGNMENT_SIZE), ROUNDUP(cmd_desc_len, CACHE_LINE));
+	req_upiu = (struct upiu_gen_hdr*) memalign((size_t ) lcm(CACHE_LINE, UTP_CMD_DESC_BASE_ALIGNMENT_SIZE), ROUNDUP(*cmd_desc_len, CACHE_LINE));
 	if (!req_upiu)
 	{
 		dprintf(CRITICAL, "%s:%d Unable to allocate request upiu\n",__func__, __LINE__);
@@ -476,17 +474,17 @@ int utp_enqueue_upiu(struct ufs_dev *dev, struct upiu_req_build_type *upiu_data)
 	}
 
 	/* Fill req upiu. */
-	ret = utp_fill_req_upiu(dev, upiu_data, req_upiu);
-	if (ret)
+	if (utp_fill_req_upiu(dev, upiu_data, req_upiu))
 	{
-		goto utp_enqueue_upiu_err;
+		free(req_upiu);
+		return -UFS_FAILURE;
 	}
 
 	/* Fill UTRD properties. */
 	cmd_desc.num_prdt      = num_prdt;
 	cmd_desc.req_upiu      = req_upiu;
 	cmd_desc.resp_upiu_len = resp_len;
-	utp_fill_utrd_properties(upiu_data, &utrd, &cmd_desc);
+	utp_fill_utrd_properties(upiu_data, utrd, &cmd_desc);
 
 	prdt_entry         = (struct utp_prdt_entry *) ((uint32_t) req_upiu + UPIU_HDR_LEN + resp_len);
 
@@ -496,24 +494,154 @@ int utp_enqueue_upiu(struct ufs_dev *dev, struct upiu_req_build_type *upiu_data)
 
 	/* Flush req_upiu */
 	dsb();
-	arch_clean_invalidate_cache_range((addr_t) req_upiu, cmd_desc_len);
+	arch_clean_invalidate_cache_range((addr_t) req_upiu, *cmd_desc_len);
 
-	/* Check the response. */
-	ret = utp_enqueue_utrd(dev, &utrd);
-	if (ret)
-	{
-		dprintf(CRITICAL, "%s:%d Command failed. command = %x\n", __func__, __LINE__, req_upiu->basic_hdr.trans_type);
-		goto utp_enqueue_upiu_err;
-	}
+	return UFS_SUCCESS;
+}
 
+static void utp_save_resp(struct upiu_req_build_type *upiu_data, void *req_upiu, uint32_t cmd_desc_len)
+{
 	/* UPIU processed. Invalidate cache to update resp. */
 	arch_invalidate_cache_range((addr_t) req_upiu, cmd_desc_len);
 
 	/* Save the response. */
 	memcpy(upiu_data->resp_ptr, (void *) ((uint32_t)req_upiu + UPIU_HDR_LEN), upiu_data->resp_len);
 	memcpy((void *) upiu_data->resp_data_ptr, (void *) ((uint32_t)req_upiu + 2 * UPIU_HDR_LEN), upiu_data->resp_data_len);
+}
+
+int utp_enqueue_upiu(struct ufs_dev *dev, struct upiu_req_build_type *upiu_data)
+{
+	struct utp_utrd_req_build_type utrd;
+	int                            ret = UFS_SUCCESS;
+	uint32_t                       cmd_desc_len;
+
+	if (utp_prepare_upiu(dev, upiu_data, &utrd, &cmd_desc_len))
+		return -UFS_FAILURE;
+
+	/* Check the response. */
+	ret = utp_enqueue_utrd(dev, &utrd);
+	if (ret)
+	{
+		dprintf(CRITICAL, "%s:%d Command failed. command = %x\n", __func__, __LINE__, utrd.req_upiu->trans_type);
+		goto utp_enqueue_upiu_err;
+	}
+
+	utp_save_resp(upiu_data, utrd.req_upiu, cmd_desc_len);
 
 utp_enqueue_upiu_err:
-	free(req_upiu);
+	free(utrd.req_upiu);
+	return ret;
+}
+
+/*
+ * Each request gets its own transfer request slot and all doorbell bits are
+ * set at once, so the device can work on several requests in parallel
+ * (e.g. fetch the next data while the previous one is transferred).
+ * The completion is detected from the doorbell register, which also works
+ * when the requests complete in a different order.
+ */
+int utp_enqueue_upiu_batch(struct ufs_dev *dev, struct upiu_req_build_type *upiu_data,
+						   uint32_t count, int *status)
+{
+	struct utp_utrd_req_build_type utrd[UTP_MAX_BATCH_REQS];
+	struct utp_trans_req_desc      *desc[UTP_MAX_BATCH_REQS];
+	uint32_t                       door_bell_bit[UTP_MAX_BATCH_REQS];
+	uint32_t                       cmd_desc_len[UTP_MAX_BATCH_REQS];
+	struct utp_bitmap_access_type  bitmap_req;
+	uint32_t                       pending = 0;
+	uint32_t                       timed_out = 0;
+	uint32_t                       retry = 0;
+	uint32_t                       i;
+	int                            ret = UFS_SUCCESS;
+
+	if (count > UTP_MAX_BATCH_REQS)
+		return -UFS_FAILURE;
+
+	/* Check register UTRLRSR and make sure it is read '1' before continuing. */
+	if (!readl(UFS_UTRLRSR(dev->base)))
+		return -UFS_FAILURE;
+
+	for (i = 0; i < count; i++)
+	{
+		door_bell_bit[i] = 0;
+		status[i]        = -UFS_FAILURE;
+
+		if (utp_prepare_upiu(dev, &upiu_data[i], &utrd[i], &cmd_desc_len[i]))
+			continue;
+
+		desc[i] = utp_get_desc_slot_addr(dev, &utrd[i], &door_bell_bit[i]);
+		if (!desc[i])
+		{
+			door_bell_bit[i] = 0;
+			free(utrd[i].req_upiu);
+			continue;
+		}
+
+		utp_enqueue_utrd_fill_desc(desc[i], &utrd[i]);
+		pending |= door_bell_bit[i];
+	}
+
+	if (pending)
+	{
+		dsb();
+
+		utp_ring_door_bell(UFS_UTRLDBR(dev->base), pending);
+
+		dsb();
+
+		/* The controller clears the doorbell bit when a request is complete. */
+		while (readl(UFS_UTRLDBR(dev->base)) & pending)
+		{
+			retry++;
+			udelay(1);
+			if (retry == UTP_MAX_COMMAND_RETRY)
+			{
+				timed_out = readl(UFS_UTRLDBR(dev->base)) & pending;
+				dprintf(CRITICAL, "%s:%d Transaction timeout, slots = %x\n", __func__, __LINE__, timed_out);
+				writel(~timed_out, UFS_UTRLCLR(dev->base));
+				break;
+			}
+		}
+
+		writel(UFS_IS_UTRCS, UFS_IS(dev->base));
+	}
+
+	for (i = 0; i < count; i++)
+	{
+		if (!door_bell_bit[i])
+		{
+			ret = -UFS_FAILURE;
+			continue;
+		}
+
+		if (!(door_bell_bit[i] & timed_out))
+		{
+			/* Force read UTRD from memory. */
+			dsb();
+			cache_clean_invalidate_unaligned_start_addr((addr_t) desc[i], sizeof(struct utp_trans_req_desc));
+
+			if (desc[i]->overall_cmd_status == UTRD_OCS_SUCCESS)
+			{
+				utp_save_resp(&upiu_data[i], utrd[i].req_upiu, cmd_desc_len[i]);
+				status[i] = UFS_SUCCESS;
+			}
+			else
+			{
+				dprintf(CRITICAL, "%s:%d Command failed. ocs = %x\n", __func__, __LINE__, desc[i]->overall_cmd_status);
+			}
+		}
+
+		if (status[i])
+			ret = -UFS_FAILURE;
+
+		/* Signal slot as free. */
+		bitmap_req.bitmap        = &dev->utrd_data.bitmap;
+		bitmap_req.door_bell_bit = door_bell_bit[i];
+		bitmap_req.mutx          = &(dev->utrd_data.bitmap_mutex);
+		utp_remove_from_bitmap(&bitmap_req);
+
+		free(utrd[i].req_upiu);
+	}
+
 	return ret;
 }
@@ -313,7 +313,8 @@ void platform_init_keyboard(void)
 {
 	uint8_t ctr;
 	
-	cbuf_initialize(&key_buf, 32);
+	/* Written by the interrupt handler, read by a single thread */
+	cbuf_initialize_spsc(&key_buf, 32, NULL);
 
 	i8042_flush();
 	
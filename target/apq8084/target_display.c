@@ -43,6 +43,7 @@
 #include <platform/gpio.h>
 #include <platform/clock.h>
 #include <platform/iomap.h>
+#include <kernel/thread.h>
 #include <platform/timer.h>
 #include <target/display.h>
 #include "include/panel.h"
@@ -293,7 +294,7 @@ int target_panel_reset(uint8_t enable, struct panel_reset_sequence *resetseq,
 				gpio_set(reset_gpio.pin_id, GPIO_STATE_LOW);
 			else
 				gpio_set(reset_gpio.pin_id, GPIO_STATE_HIGH);
-			mdelay(resetseq->sleep[i]);
+			delay_or_sleep(resetseq->sleep[i]);
 		}
 	} else {
 		gpio_set(reset_gpio.pin_id, 0);
@@ -257,6 +257,12 @@ __WEAK struct mmc_device *target_get_sd_mmc(void)
 	return NULL;
 }
 
+/* Switch the IO regulator of an sd card slot between 1.8V & 3V */
+__WEAK int target_sd_set_io_voltage(uint8_t slot, bool low)
+{
+	return ERR_NOT_SUPPORTED;
+}
+
 __WEAK unsigned int qseecom_get_version(void)
 {
 	return 0;
@@ -31,6 +31,7 @@
 #include <smem.h>
 #include <err.h>
 #include <string.h>
+#include <kernel/thread.h>
 #include <qtimer.h>
 #include <msm_panel.h>
 #include <mipi_dsi.h>
@@ -142,7 +143,7 @@ int target_panel_reset(uint8_t enable, struct panel_reset_sequence *resetseq,
 				gpio_set(reset_gpio.pin_id, GPIO_STATE_LOW);
 			else
 				gpio_set(reset_gpio.pin_id, GPIO_STATE_HIGH);
-			mdelay(resetseq->sleep[i]);
+			delay_or_sleep(resetseq->sleep[i]);
 		}
 
 		if (pinfo->mipi.mode_gpio_state == MODE_GPIO_STATE_ENABLE)
@@ -40,6 +40,7 @@
 #include <platform/clock.h>
 #include <platform/gpio.h>
 #include <platform/iomap.h>
+#include <kernel/thread.h>
 #include <platform/timer.h>
 #include <target/display.h>
 #include <regulator.h>
@@ -368,7 +369,7 @@ int target_panel_reset(uint8_t enable, struct panel_reset_sequence *resetseq,
 				gpio_set(reset_gpio.pin_id, GPIO_STATE_LOW);
 			else
 				gpio_set(reset_gpio.pin_id, GPIO_STATE_HIGH);
-			mdelay(resetseq->sleep[i]);
+			delay_or_sleep(resetseq->sleep[i]);
 		}
 	} else if(!target_cont_splash_screen()) {
 		gpio_set(reset_gpio.pin_id, 0);
@@ -35,6 +35,7 @@
 #include <mipi_dsi.h>
 #include <target/display.h>
 #include <mipi_dsi_i2c.h>
+#include <kernel/thread.h>
 #include <platform/timer.h>
 
 #include "include/panel.h"
@@ -121,13 +122,13 @@ int oem_panel_on(void)
 	 */
 	if (panel_id == OTM8019A_FWVGA_VIDEO_PANEL) {
 		/* needs extra delay to avoid unexpected artifacts */
-		mdelay(OTM8019A_FWVGA_VIDEO_PANEL_ON_DELAY);
+		delay_or_sleep(OTM8019A_FWVGA_VIDEO_PANEL_ON_DELAY);
 	} else if (panel_id == NT35590_720P_CMD_PANEL) {
 		/* needs extra delay to avoid snow screen artifacts */
-		mdelay(NT35590_720P_CMD_PANEL_ON_DELAY);
+		delay_or_sleep(NT35590_720P_CMD_PANEL_ON_DELAY);
 	} else if (panel_id == SAMSUNG_WXGA_VIDEO_PANEL) {
 		/* needs extra delay to avoid unexpected artifacts */
-		mdelay(SAMSUNG_WXGA_VIDEO_PANEL_ON_DELAY);
+		delay_or_sleep(SAMSUNG_WXGA_VIDEO_PANEL_ON_DELAY);
 	}
 
 	return NO_ERROR;
@@ -618,6 +619,11 @@ uint32_t oem_panel_max_auto_detect_panels(void)
                         DISPLAY_MAX_PANEL_DETECTION : 0;
 }
 
+const char *oem_panel_name(void)
+{
+	return panel_id_to_name(supp_panels, ARRAY_SIZE(supp_panels), panel_id);
+}
+
 int oem_panel_select(const char *panel_name, struct panel_struct *panelstruct,
 			struct msm_panel_info *pinfo,
 			struct mdss_dsi_phy_ctrl *phy_db)
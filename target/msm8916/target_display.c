@@ -40,6 +40,7 @@
 #include <platform/clock.h>
 #include <platform/gpio.h>
 #include <platform/iomap.h>
+#include <kernel/thread.h>
 #include <platform/timer.h>
 #include <target/display.h>
 #include <i2c_qup.h>
@@ -360,7 +361,7 @@ static int dsi2HDMI_i2c_write_regs(struct mipi_dsi_i2c_cmd *cfg, int size)
 			goto w_regs_fail;
 		}
 		if (cfg[i].sleep_in_ms) {
-			udelay(cfg[i].sleep_in_ms*1000);
+			delay_or_sleep(cfg[i].sleep_in_ms);
 		}
 	}
 w_regs_fail:
@@ -571,7 +572,7 @@ int target_panel_reset(uint8_t enable, struct panel_reset_sequence *resetseq,
 				gpio_set_dir(reset_gpio.pin_id, GPIO_STATE_LOW);
 			else
 				gpio_set_dir(reset_gpio.pin_id, GPIO_STATE_HIGH);
-			mdelay(resetseq->sleep[i]);
+			delay_or_sleep(resetseq->sleep[i]);
 		}
 	} else if(!target_cont_splash_screen()) {
 		gpio_set_dir(reset_gpio.pin_id, 0);
@@ -635,6 +636,7 @@ void target_display_init(const char *panel_name)
 	uint32_t panel_loop = 0;
 	int ret = 0;
 	struct oem_panel_data oem;
+	char cached_panel[MAX_PANEL_ID_LEN];
 
 	set_panel_cmd_string(panel_name);
 	oem = mdss_dsi_get_oem_data();
@@ -648,6 +650,17 @@ void target_display_init(const char *panel_name)
 		return;
 	}
 
+	/* Try the panel detected in the previous boot first, it is still verified */
+	if (!oem.panel[0] && oem_panel_max_auto_detect_panels() &&
+	    gcdb_panel_cache_load(cached_panel)) {
+		target_force_cont_splash_disable(false);
+		ret = gcdb_display_init(cached_panel, MDP_REV_50, (void *)MIPI_FB_ADDR);
+		if (!ret)
+			goto cont_splash;
+		target_force_cont_splash_disable(true);
+		msm_display_off();
+	}
+
 	do {
 		target_force_cont_splash_disable(false);
 		ret = gcdb_display_init(oem.panel, MDP_REV_50, (void *)MIPI_FB_ADDR);
@@ -659,6 +672,10 @@ void target_display_init(const char *panel_name)
 		}
 	} while (++panel_loop <= oem_panel_max_auto_detect_panels());
 
+	if (!oem.panel[0] && oem_panel_max_auto_detect_panels())
+		gcdb_panel_cache_store(!ret);
+
+cont_splash:
 	if (!oem.cont_splash) {
 		dprintf(INFO, "Forcing continuous splash disable\n");
 		target_force_cont_splash_disable(true);
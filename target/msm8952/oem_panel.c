@@ -998,6 +998,11 @@ uint32_t oem_panel_max_auto_detect_panels(void)
 		DISPLAY_MAX_PANEL_DETECTION : 0;
 }
 
+const char *oem_panel_name(void)
+{
+	return panel_id_to_name(supp_panels, ARRAY_SIZE(supp_panels), panel_id);
+}
+
 int oem_panel_select(const char *panel_name, struct panel_struct *panelstruct,
 			struct msm_panel_info *pinfo,
 			struct mdss_dsi_phy_ctrl *phy_db)
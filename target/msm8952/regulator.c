@@ -191,6 +191,8 @@ void regulator_enable(uint32_t enable)
 {
 	uint32_t hw_subtype = board_hardware_subtype();
 
+	rpm_batch_begin();
+
 	if (platform_is_msm8956()) {
 		if (enable & REG_LDO1)
 			rpm_send_data(&ldo1[GENERIC_ENABLE][0], 36, RPM_REQUEST_TYPE);
@@ -226,10 +228,14 @@ void regulator_enable(uint32_t enable)
 
 	if (enable & REG_LDO11)
 		rpm_send_data(&ldo11[GENERIC_ENABLE][0], 36, RPM_REQUEST_TYPE);
+
+	rpm_batch_end();
 }
 
 void regulator_disable(uint32_t enable)
 {
+	rpm_batch_begin();
+
 	if (platform_is_msm8956()) {
 		if (enable & REG_LDO1)
 			rpm_send_data(&ldo1[GENERIC_DISABLE][0], 36, RPM_REQUEST_TYPE);
@@ -251,4 +257,6 @@ void regulator_disable(uint32_t enable)
 
 	if (enable & REG_LDO11)
 		rpm_send_data(&ldo11[GENERIC_DISABLE][0], 36, RPM_REQUEST_TYPE);
+
+	rpm_batch_end();
 }
@@ -31,6 +31,7 @@
 #include <string.h>
 #include <smem.h>
 #include <err.h>
+#include <kernel/thread.h>
 #include <msm_panel.h>
 #include <mipi_dsi.h>
 #include <pm8x41.h>
@@ -522,7 +523,7 @@ int target_panel_reset(uint8_t enable, struct panel_reset_sequence *resetseq,
 				gpio_set_dir(reset_gpio.pin_id, GPIO_STATE_LOW);
 			else
 				gpio_set_dir(reset_gpio.pin_id, GPIO_STATE_HIGH);
-			mdelay(resetseq->sleep[i]);
+			delay_or_sleep(resetseq->sleep[i]);
 		}
 
 		if (platform_is_msm8956()) {
@@ -777,6 +778,7 @@ bool target_display_panel_node(char *pbuf, uint16_t buf_size)
 void target_display_init(const char *panel_name)
 {
 	struct oem_panel_data oem;
+	char cached_panel[MAX_PANEL_ID_LEN];
 	int32_t ret = 0;
 	uint32_t panel_loop = 0;
 	uint32_t platform_subtype = board_hardware_subtype();
@@ -801,6 +803,17 @@ void target_display_init(const char *panel_name)
 		return;
 	}
 
+	/* Try the panel detected in the previous boot first, it is still verified */
+	if (!oem.panel[0] && oem_panel_max_auto_detect_panels() &&
+	    gcdb_panel_cache_load(cached_panel)) {
+		target_force_cont_splash_disable(false);
+		ret = gcdb_display_init(cached_panel, MDP_REV_50, (void *)MIPI_FB_ADDR);
+		if (!ret)
+			goto cont_splash;
+		target_force_cont_splash_disable(true);
+		msm_display_off();
+	}
+
 	do {
 		target_force_cont_splash_disable(false);
 		ret = gcdb_display_init(oem.panel, MDP_REV_50, (void *)MIPI_FB_ADDR);
@@ -812,6 +825,10 @@ void target_display_init(const char *panel_name)
 		}
 	} while (++panel_loop <= oem_panel_max_auto_detect_panels());
 
+	if (!oem.panel[0] && oem_panel_max_auto_detect_panels())
+		gcdb_panel_cache_store(!ret);
+
+cont_splash:
 	if (!oem.cont_splash) {
 		dprintf(INFO, "Forcing continuous splash disable\n");
 		target_force_cont_splash_disable(true);
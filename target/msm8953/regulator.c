@@ -105,6 +105,8 @@ static uint32_t ldo17[][11]=
 
 void regulator_enable(uint32_t enable)
 {
+	rpm_batch_begin();
+
 	if (enable & REG_LDO3)
 		rpm_send_data(&ldo3[GENERIC_ENABLE][0], 36, RPM_REQUEST_TYPE);
 
@@ -116,10 +118,14 @@ void regulator_enable(uint32_t enable)
 
 	if (enable & REG_SMPS3)
 		rpm_send_data(&smps3[GENERIC_ENABLE][0], 36, RPM_REQUEST_TYPE);
+
+	rpm_batch_end();
 }
 
 void regulator_disable(uint32_t enable)
 {
+	rpm_batch_begin();
+
 	if (enable & REG_LDO3)
 		rpm_send_data(&ldo3[GENERIC_DISABLE][0], 36, RPM_REQUEST_TYPE);
 
@@ -131,4 +137,6 @@ void regulator_disable(uint32_t enable)
 
 	if (enable & REG_SMPS3)
 		rpm_send_data(&smps3[GENERIC_DISABLE][0], 36, RPM_REQUEST_TYPE);
+
+	rpm_batch_end();
 }
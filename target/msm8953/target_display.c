@@ -32,6 +32,7 @@
 #include <string.h>
 #include <smem.h>
 #include <err.h>
+#include <kernel/thread.h>
 #include <msm_panel.h>
 #include <mipi_dsi.h>
 #include <pm8x41.h>
@@ -277,7 +278,7 @@ int target_panel_reset(uint8_t enable, struct panel_reset_sequence *resetseq,
 				gpio_set_dir(reset_gpio.pin_id, GPIO_STATE_LOW);
 			else
 				gpio_set_dir(reset_gpio.pin_id, GPIO_STATE_HIGH);
-			mdelay(resetseq->sleep[i]);
+			delay_or_sleep(resetseq->sleep[i]);
 		}
 
 	} else if(!target_cont_splash_screen()) {
@@ -31,6 +31,7 @@
 #include <string.h>
 #include <smem.h>
 #include <err.h>
+#include <kernel/thread.h>
 #include <msm_panel.h>
 #include <mipi_dsi.h>
 #include <mdss_hdmi.h>
@@ -471,7 +472,7 @@ int target_panel_reset(uint8_t enable, struct panel_reset_sequence *resetseq,
 				gpio_set(reset_gpio.pin_id, GPIO_STATE_LOW);
 			else
 				gpio_set(reset_gpio.pin_id, GPIO_STATE_HIGH);
-			mdelay(resetseq->sleep[i]);
+			delay_or_sleep(resetseq->sleep[i]);
 		}
 		lcd_bklt_reg_enable();
 	} else {
@@ -20,7 +20,7 @@ KERNEL_SIZE  := 88
 
 # LPAE supports only 32 virtual address, L1 pt size is 4
 L1_PT_SZ     := 4
-L2_PT_SZ     := 3
+L2_PT_SZ     := 4
 
 DEFINES += PMI_CONFIGURED=1
 
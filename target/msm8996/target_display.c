@@ -31,6 +31,7 @@
 #include <string.h>
 #include <smem.h>
 #include <err.h>
+#include <kernel/thread.h>
 #include <msm_panel.h>
 #include <mipi_dsi.h>
 #include <mdss_hdmi.h>
@@ -378,7 +379,7 @@ static int dsi2HDMI_i2c_write_regs(struct msm_panel_info *pinfo,
 			goto w_regs_fail;
 		}
 		if (cfg[i].sleep_in_ms) {
-			udelay(cfg[i].sleep_in_ms*1000);
+			delay_or_sleep(cfg[i].sleep_in_ms);
 		}
 	}
 w_regs_fail:
@@ -586,7 +587,7 @@ int target_panel_reset(uint8_t enable, struct panel_reset_sequence *resetseq,
 				gpio_set(reset_gpio.pin_id, GPIO_STATE_LOW);
 			else
 				gpio_set(reset_gpio.pin_id, GPIO_STATE_HIGH);
-			mdelay(resetseq->sleep[i]);
+			delay_or_sleep(resetseq->sleep[i]);
 		}
 		lcd_bklt_reg_enable();
 	} else {